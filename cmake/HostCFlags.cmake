@@ -26,3 +26,11 @@ else()
   message(STATUS "\nSSE4 disabled.\n")
 endif()
 
+if (ENABLE_AVX2)
+  message(STATUS "\nAVX2 will be enabled if system supports it.\n")
+  if (AVX2_FOUND)
+    set (CMAKE_C_FLAGS_ALL "-mavx2 ${CMAKE_C_FLAGS_ALL}")
+  endif()
+else()
+  message(STATUS "\nAVX2 disabled.\n")
+endif()
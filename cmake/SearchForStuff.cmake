@@ -34,6 +34,9 @@ endmacro()
 include(FindBoost)
 find_package(Boost REQUIRED system thread filesystem program_options)
 
+# zlib compresses the blocks of the logs (see LogFormat.hh).
+find_package(ZLIB REQUIRED)
+
 # We need erb to process the .world.erb files.
 find_program(ERB_EXE_PATH erb)
 if(NOT ERB_EXE_PATH)
@@ -91,3 +94,13 @@ else()
   message(STATUS "Did not find Python; will not build plugin support for Python controllers")
   message(STATUS "(try `sudo apt-get install libpython2.7-dev` or something similar) .")
 endif()
+
+#################################################
+# Check for OpenCL, to allow generating visibility tables on the GPU
+find_package(OpenCL)
+if(OpenCL_FOUND)
+  message(STATUS "Found OpenCL; will build the GPU backend of the visibility tables.")
+else()
+  message(STATUS "Did not find OpenCL; visibility tables will be generated on the CPU")
+  message(STATUS "(try `sudo apt-get install ocl-icd-opencl-dev` or something similar) .")
+endif()
@@ -33,6 +33,7 @@ macro (ign_build_tests)
       ${GAZEBO_LIBRARIES}
       ${PROTOBUF_LIBRARY}
       ${Boost_LIBRARIES}
+      ${ZLIB_LIBRARIES}
       ${IGNITION-TRANSPORT_LIBRARIES}
     )
 
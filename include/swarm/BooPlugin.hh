@@ -21,9 +21,10 @@
 #ifndef __SWARM_BOO_PLUGIN_HH__
 #define __SWARM_BOO_PLUGIN_HH__
 
-#include <map>
+#include <deque>
 #include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 #include <gazebo/common/Events.hh>
 #include <gazebo/common/Plugin.hh>
@@ -33,6 +34,7 @@
 #include <gazebo/physics/PhysicsTypes.hh>
 #include <ignition/math/Vector3.hh>
 #include <sdf/sdf.hh>
+#include "msgs/checkpoint.pb.h"
 #include "msgs/log_entry.pb.h"
 #include "swarm/Logger.hh"
 #include "swarm/RobotPlugin.hh"
@@ -58,6 +60,11 @@ namespace swarm
   /// position of the lost person. If the person is found, a message of type
   /// PersonFound is published in the topic /swarm/found and the simulation is
   /// paused.
+  ///
+  /// The lost person is the model named by <lost_person_model>. With
+  /// <lost_person_prefix> instead, every model whose name starts with the
+  /// prefix is a lost person (see LostPersonCrowdPlugin), and a report is
+  /// valid if it matches any of them.
   class BooPlugin : public RobotPlugin
   {
     /// \brief Class constructor.
@@ -137,36 +144,58 @@ namespace swarm
     /// \return The coordinates of a cell in the 3D grid.
     private: ignition::math::Vector3i PosToGrid(ignition::math::Vector3d _pos);
 
+    /// \brief Register the initial position of every lost person.
+    private: void InitLostPersons();
+
     // Documentation inherited.
     private: void OnLogMin(msgs::LogEntryMin &_logEntry) const;
 
     // Documentation inherited.
     private: virtual void OnLog(msgs::LogEntry &_logEntry) const;
 
+    /// \brief True when there are reports that haven't been logged yet.
+    private: virtual bool LogChanged() const;
+
+    // Documentation inherited.
+    private: virtual void OnSaveController(msgs::CheckpointPart &_part) const;
+
+    // Documentation inherited.
+    private: virtual bool OnRestoreController(
+                 const msgs::CheckpointPart &_part);
+
+    /// \brief Add the buffers of the lost persons and the reports not
+    /// logged yet to the "boo" subsystem.
+    /// \param[in,out] _report The report.
+    private: virtual void OnMemoryController(MemoryReport &_report) const;
+
     /// \brief True when the lost person has been found.
     private: bool found = false;
 
-    /// \brief Pointer to the lost person's model.
-    private: gazebo::physics::ModelPtr lostPerson;
+    /// \brief Pointers to the lost people's models. There is one unless
+    /// <lost_person_prefix> is set, and a report matching any of them is
+    /// valid.
+    private: std::vector<gazebo::physics::ModelPtr> lostPersons;
 
-    /// \brief Buffer of registered lost person's positions.
-    /// The key is the time at which the lost person changed position.
-    /// The value contains the coordinates of a cell in a 3D grid.
+    /// \brief Buffer of registered positions of each lost person, sorted by
+    /// time. Each entry has the time at which the lost person changed
+    /// position, and the coordinates of a cell in a 3D grid.
     /// E.g.: {
     ///         {time 0.0, 10, 0, 0 },  => At t=0.0, the person was at [10,0,0]
     ///         {time 1.0, 20, 20, 0}   => At t=1.0, the person was at [20,20,0]
     ///       }
-    private: std::map<gazebo::common::Time,
-                      ignition::math::Vector3i> lostPersonBuffer;
+    /// The entries that can't match a report newer than maxDt are dropped
+    /// from the front, so it only covers the last maxDt seconds.
+    private: std::vector<std::deque<std::pair<gazebo::common::Time,
+                 ignition::math::Vector3i>>> lostPersonBuffers;
 
-    /// \brief Last known location of the lost person.
-    private: ignition::math::Vector3i lastPersonPosInGrid;
+    /// \brief Last known location of each lost person.
+    private: std::vector<ignition::math::Vector3i> lastPersonPosInGrid;
 
     /// \brief Pointer to the OnUpdateEnd event connection.
     private: gazebo::event::ConnectionPtr updateEndConnection;
 
     // \brief Mutex to avoid race conditions.
-    private: std::mutex mutex;
+    private: mutable std::mutex mutex;
 
     /// \brief We discretize the world in a 3D grid of square cells.
     /// This constant expresses the size of each cell (m). We update the cell
@@ -178,7 +207,7 @@ namespace swarm
     /// time and the reported lost person messages to the BOO.
     private: gazebo::common::Time maxDt = 1000.0;
 
-    /// \brief Logger instance.
+    /// \brief Logger instance of the world.
     private: Logger *logger = Logger::Instance();
 
     /// \brief Last report received
@@ -195,6 +224,11 @@ namespace swarm
     /// \brief Timer to measure the shutdownPeriod once the exit phase has been
     /// triggered.
     private: gazebo::common::Timer shutdownTimer;
+
+    /// \brief If true, the world is stopped instead of shut down once the
+    /// lost person is found, so swarm_batch can reset it for the next run.
+    /// Set by the SWARM_BATCH environment variable.
+    private: bool batch = false;
   };
 }
 #endif
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file BoxHierarchy.hh
+/// \brief Bounding volume hierarchy over static boxes, for ray queries.
+
+#ifndef __SWARM_BOX_HIERARCHY_HH__
+#define __SWARM_BOX_HIERARCHY_HH__
+
+#include <cstddef>
+#include <vector>
+#include <ignition/math/Box.hh>
+#include <ignition/math/Vector3.hh>
+
+#include "swarm/Helpers.hh"
+
+namespace swarm
+{
+  /// \brief A bounding volume hierarchy over a static set of boxes, such as
+  /// the bounding boxes of the trees and buildings of a world.
+  ///
+  /// The hierarchy is a binary tree built once, splitting the boxes at the
+  /// median of their centers along the longest axis. Ray queries skip the
+  /// subtrees whose bounds are not crossed by the ray, and test the boxes of
+  /// the leaves with ignition::math::Box::IntersectDist(), so a box is hit
+  /// exactly when a linear scan would hit it. All the queries are const and
+  /// can be called from multiple threads.
+  ///
+  /// The boxes of a leaf are first filtered together with a slab test in
+  /// single precision, over a structure of arrays copy of their bounds. The
+  /// filter is conservative: the bounds are rounded outwards and enlarged by
+  /// a small margin, and only the boxes it keeps are tested in double
+  /// precision. The filter uses AVX2 when the code is built with it
+  /// (ENABLE_AVX2 in CMake), and a scalar loop otherwise.
+  class IGNITION_VISIBLE BoxHierarchy
+  {
+    /// \brief Class constructor.
+    public: BoxHierarchy() = default;
+
+    /// \brief Class destructor.
+    public: virtual ~BoxHierarchy() = default;
+
+    /// \brief Build the hierarchy, replacing the previous boxes.
+    /// \param[in] _boxes The boxes.
+    public: void Build(const std::vector<ignition::math::Box> &_boxes);
+
+    /// \brief Number of boxes in the hierarchy.
+    /// \return The number of boxes.
+    public: size_t Size() const;
+
+    /// \brief Memory held by the nodes, the boxes and the bounds.
+    /// \return The memory (bytes).
+    public: size_t MemoryBytes() const;
+
+    /// \brief Find the boxes intersected by a ray.
+    /// \param[in] _origin Origin of the ray.
+    /// \param[in] _dir Normalized direction of the ray.
+    /// \param[in] _min Start of the ray, as a distance from the origin.
+    /// \param[in] _max End of the ray, as a distance from the origin.
+    /// \param[in] _maxHits Stop the traversal after hitting this many boxes.
+    /// \param[out] _dist Distance returned by IntersectDist() for the last
+    /// box hit. Not modified if no box is hit.
+    /// \return Number of boxes hit, at most _maxHits.
+    public: unsigned int Intersect(const ignition::math::Vector3d &_origin,
+                                   const ignition::math::Vector3d &_dir,
+                                   const double _min, const double _max,
+                                   const unsigned int _maxHits,
+                                   double &_dist) const;
+
+    /// \brief Build the subtree of a range of boxes.
+    /// \param[in] _first Index of the first box of the range.
+    /// \param[in] _count Number of boxes in the range.
+    /// \return Index of the root node of the subtree.
+    private: unsigned int BuildNode(const unsigned int _first,
+                                    const unsigned int _count);
+
+    /// \brief Filter the boxes of a leaf crossed by a ray.
+    /// \param[in] _first Index of the first box of the leaf.
+    /// \param[in] _count Number of boxes in the leaf, at most kLeafSize.
+    /// \param[in] _origin Origin of the ray.
+    /// \param[in] _invDir Inverse of each component of the direction, or 0
+    /// for the components that are 0.
+    /// \param[in] _tMin Start of the ray.
+    /// \param[in] _tMax End of the ray.
+    /// \return Bit mask of the boxes that the ray may cross, the lowest bit
+    /// for the first box.
+    private: unsigned int LeafMask(const unsigned int _first,
+                                   const unsigned int _count,
+                                   const float _origin[3],
+                                   const float _invDir[3],
+                                   const float _tMin,
+                                   const float _tMax) const;
+
+    /// \brief A node of the hierarchy. The left child of an inner node is
+    /// stored right after it.
+    private: struct Node
+    {
+      /// \brief Lower corner of the bounds of the boxes in the subtree.
+      double min[3];
+
+      /// \brief Upper corner of the bounds of the boxes in the subtree.
+      double max[3];
+
+      /// \brief Index of the first box of a leaf.
+      unsigned int first;
+
+      /// \brief Number of boxes of a leaf, 0 for inner nodes.
+      unsigned int count;
+
+      /// \brief Index of the right child of an inner node.
+      unsigned int right;
+    };
+
+    /// \brief Maximum number of boxes in a leaf, which is the number of
+    /// single precision values in an AVX2 register.
+    private: static const unsigned int kLeafSize = 8;
+
+    /// \brief Nodes of the hierarchy. The first one is the root.
+    private: std::vector<Node> nodes;
+
+    /// \brief The boxes, sorted so that each leaf has a contiguous range.
+    private: std::vector<ignition::math::Box> boxes;
+
+    /// \brief Lower corners of the boxes along X, Y and Z, rounded
+    /// down. Padded so that a full leaf can be loaded from any box.
+    private: std::vector<float> lowerBounds[3];
+
+    /// \brief Upper corners of the boxes along X, Y and Z, rounded up.
+    /// Padded like lowerBounds.
+    private: std::vector<float> upperBounds[3];
+  };
+}
+#endif
@@ -18,12 +18,18 @@
 /// \file Broker.hh
 /// \brief Broker for handling message delivery among robots.
 
+#include <cstdint>
 #include <map>
 #include <deque>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
+#include <ignition/math/Vector3.hh>
 #include "msgs/datagram.pb.h"
 #include "swarm/Helpers.hh"
+#include "swarm/MemoryAccounting.hh"
+#include "swarm/Outbox.hh"
 
 #ifndef __SWARM_BROKER_HH__
 #define __SWARM_BROKER_HH__
@@ -40,12 +46,26 @@ namespace swarm
 
     /// \brief Pointer to the client.
     public: const RobotPlugin *handler;
+
+    /// \brief Index of the callback of the client for this endpoint,
+    /// passed back to RobotPlugin::OnMsgReceived().
+    public: unsigned int callback = 0;
   };
 
+  /// \def EndPointId
+  /// \brief Compact handle of an endpoint, see Broker::Intern().
+  using EndPointId = uint32_t;
+
   /// \def EndPoints_M
   /// \brief Map of endpoints
   using EndPoints_M = std::map<std::string, std::vector<BrokerClientInfo>>;
 
+  /// \def DatagramPtr
+  /// \brief Shared, immutable message. It is created once by the sender,
+  /// and the same message is queued in the broker and delivered to every
+  /// recipient by reference.
+  using DatagramPtr = std::shared_ptr<const msgs::Datagram>;
+
   /// \brief Store messages, and exposes an API for registering new clients,
   /// bind to a particular address, push new messages or get the list of
   /// messages already stored in the queue.
@@ -56,22 +76,84 @@ namespace swarm
     /// \return Pointer to the current Broker instance.
     public: static Broker *Instance();
 
+    /// \brief Get the Broker instance of a world. The worlds simulated in
+    /// the same process have independent brokers.
+    /// \param[in] _world Name of the world. The empty name is the instance
+    /// returned by Instance().
+    /// \return Pointer to the Broker instance of the world.
+    public: static Broker *Instance(const std::string &_world);
+
     /// \brief This method associates an endpoint with a broker client and its
     /// address. An endpoint is constructed as an address followed by ':',
     /// followed by the port. E.g.: "192.168.1.5:8000" is a valid endpoint.
     /// \param[in] _clientAddress Address of the broker client.
     /// \param[in] _client Pointer to the robot plugin.
     /// \param[in] _endpoint End point requested to bind.
+    /// \param[in] _callback Index of the callback of the client for this
+    /// endpoint.
     /// \return True if the operation succeed or false otherwise (if the client
     /// was already bound to the same endpoint).
     public: bool Bind(const std::string &_clientAddress,
                       const RobotPlugin *_client,
-                      const std::string &_endpoint);
+                      const std::string &_endpoint,
+                      const unsigned int _callback = 0);
+
+    /// \brief Get the handle of an endpoint, creating it if needed. The
+    /// handles are consecutive integers starting at 0, and stay valid after
+    /// Reset(), so the messages and the dispatch can identify an endpoint
+    /// without building its name.
+    /// \param[in] _endpoint An endpoint, e.g. "192.168.1.5:8000".
+    /// \return The handle of the endpoint.
+    public: EndPointId Intern(const std::string &_endpoint);
+
+    /// \brief Get the handle of the endpoint of an address and a port,
+    /// creating it if needed.
+    /// \param[in] _address The address.
+    /// \param[in] _port The port.
+    /// \return The handle of the endpoint.
+    public: EndPointId Intern(const std::string &_address,
+                              const uint32_t _port);
 
-    /// \brief Queue a new message.
+    /// \brief Find the handle of the endpoint of an address and a port,
+    /// without creating it. Unlike Intern(), it can be called while other
+    /// threads send messages.
+    /// \param[in] _address The address.
+    /// \param[in] _port The port.
+    /// \param[out] _id The handle of the endpoint, if found.
+    /// \return True if the endpoint has a handle.
+    public: bool Find(const std::string &_address, const uint32_t _port,
+                      EndPointId &_id) const;
+
+    /// \brief Get the clients bound to an endpoint.
+    /// \param[in] _id Handle of the endpoint.
+    /// \return The information of all the clients bound to the endpoint,
+    /// empty if nobody is bound to it.
+    public: const std::vector<BrokerClientInfo> &EndPointClients(
+                const EndPointId _id) const;
+
+    /// \brief Get the version of the clients bound to an endpoint. It
+    /// changes every time that a client binds or unbinds it, so the
+    /// dispatch can cache what it derives from the clients.
+    /// \param[in] _id Handle of the endpoint.
+    /// \return The version, zero for an unknown handle.
+    public: uint64_t EndPointVersion(const EndPointId _id) const;
+
+    /// \brief Queue a new message. The message is copied, see
+    /// Push(DatagramPtr) to avoid the copy. Can be called from any thread.
     /// \param[in] _msg A new message.
     public: void Push(const msgs::Datagram &_msg);
 
+    /// \brief Queue a new message, without copying it. Can be called from
+    /// any thread, without locking.
+    /// \param[in] _msg A new message. It must not be modified afterwards.
+    public: void Push(DatagramPtr _msg);
+
+    /// \brief Queue several messages at once, without copying them. They
+    /// are dispatched in the same order. Can be called from any thread.
+    /// \param[in,out] _msgs The messages, moved from. They must not be
+    /// modified afterwards.
+    public: void Push(std::vector<DatagramPtr> &_msgs);
+
     /// \brief Register a new client for message handling.
     /// \param[in] _id Unique ID of the client.
     /// \param[in] _client Pointer to the robot plugin.
@@ -92,9 +174,11 @@ namespace swarm
     /// \sa BrokerClientInfo.
     public: const EndPoints_M &EndPoints() const;
 
-    /// \brief Get the current message queue.
+    /// \brief Get the current message queue, after moving the messages
+    /// pushed since the last call into it. Must only be called by the
+    /// thread that dispatches the messages.
     /// \return Reference to the queue of messages.
-    public: std::deque<msgs::Datagram> &Messages();
+    public: std::deque<DatagramPtr> &Messages();
 
     /// \brief Unregister a client and unbind from all the endpoints.
     /// \param[in] _id Unique ID of the client.
@@ -102,17 +186,59 @@ namespace swarm
     /// no client registered for this ID).
     public: bool Unregister(const std::string &_id);
 
+    /// \brief Set the members of the swarm whose positions are shared with
+    /// SetPositions(), in the order of the positions.
+    /// \param[in] _addresses Addresses of the members.
+    public: void SetMembers(const std::vector<std::string> &_addresses);
+
+    /// \brief Get the index of a member, in the order of SetMembers().
+    /// \param[in] _address Address of the member.
+    /// \return The index, or -1 if the address isn't a member.
+    public: int MemberIndex(const std::string &_address) const;
+
+    /// \brief Version of the members, incremented by SetMembers(). The
+    /// indices got from MemberIndex() are valid while it doesn't change.
+    /// \return The version.
+    public: uint64_t MembersVersion() const;
+
+    /// \brief Share the positions of the members as the comms model last
+    /// evaluated their links, so the robots can find their nearby neighbors
+    /// without exchanging them. Must only be called by the thread that
+    /// dispatches the messages.
+    /// \param[in] _positions Positions in the world, indexed like the
+    /// members.
+    public: void SetPositions(
+                const std::vector<ignition::math::Vector3d> &_positions);
+
+    /// \brief Get the positions given to SetPositions().
+    /// \return The positions, indexed like the members.
+    public: const std::vector<ignition::math::Vector3d> &Positions() const;
+
     /// \brief Handle reset.
     public: void Reset();
 
+    /// \brief Add the memory of the queue, the clients and the endpoints
+    /// to the "broker" subsystem. Must only be called by the thread that
+    /// dispatches the messages.
+    /// \param[in,out] _report The report.
+    public: void OnMemory(MemoryReport &_report) const;
+
     /// \brief Constructor.
     protected: Broker() = default;
 
     /// \brief Destructor.
     protected: virtual ~Broker() = default;
 
+    /// \brief Number of messages that the senders can push between two
+    /// dispatches without taking a lock.
+    protected: static const size_t kOutboxCapacity = 4096;
+
+    /// \brief Messages pushed by the clients, not yet moved to
+    /// incomingMsgs.
+    protected: Outbox<DatagramPtr> outbox{kOutboxCapacity};
+
     /// \brief Queue to store the incoming messages received from the clients.
-    protected: std::deque<msgs::Datagram> incomingMsgs;
+    protected: std::deque<DatagramPtr> incomingMsgs;
 
     /// \brief List of clients. The key is the ID of the client and the value
     /// is a pointer to each client.
@@ -121,6 +247,28 @@ namespace swarm
     /// \brief List of bound endpoints. The key is an endpoint and the
     /// value is the vector of clients bounded on that endpoint.
     protected: EndPoints_M endpoints;
+
+    /// \brief Handle of each interned endpoint.
+    protected: std::unordered_map<std::string, EndPointId> endpointIds;
+
+    /// \brief Clients bound to each interned endpoint, indexed by handle.
+    protected: std::vector<std::vector<BrokerClientInfo>> endpointClients;
+
+    /// \brief Version of the clients of each interned endpoint, indexed by
+    /// handle.
+    /// \sa EndPointVersion()
+    protected: std::vector<uint64_t> endpointVersions;
+
+    /// \brief Index of each member, by address.
+    /// \sa SetMembers()
+    protected: std::unordered_map<std::string, int> memberIds;
+
+    /// \brief Version of the members.
+    protected: uint64_t membersVersion = 0;
+
+    /// \brief Positions of the members, indexed like them.
+    /// \sa SetPositions()
+    protected: std::vector<ignition::math::Vector3d> positions;
   };
 }  // namespace
 #endif
@@ -21,11 +21,17 @@
 #ifndef __SWARM_BROKER_PLUGIN_HH__
 #define __SWARM_BROKER_PLUGIN_HH__
 
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <queue>
-#include <random>
 #include <string>
+#include <utility>
+#include <vector>
 #include <gazebo/common/Events.hh>
 #include <gazebo/common/Plugin.hh>
 #include <gazebo/common/UpdateInfo.hh>
@@ -33,10 +39,22 @@
 #include <sdf/sdf.hh>
 
 #include "swarm/Broker.hh"
+#include "swarm/Checkpointer.hh"
 #include "swarm/CommsModel.hh"
+#include "swarm/Connectivity.hh"
 #include "swarm/Logger.hh"
+#include "swarm/MemoryAccounting.hh"
+#include "swarm/PartitionLink.hh"
+#include "swarm/Permutation.hh"
+#include "swarm/PoseSnapshot.hh"
+#include "swarm/RandomStream.hh"
+#include "swarm/StepTimers.hh"
 #include "swarm/SwarmTypes.hh"
+#include "swarm/Telemetry.hh"
+#include "swarm/TimingWheel.hh"
+#include "msgs/checkpoint.pb.h"
 #include "msgs/log_entry.pb.h"
+#include "msgs/partition.pb.h"
 
 namespace swarm
 {
@@ -48,8 +66,88 @@ namespace swarm
   /// Dispatch of a message may directly deliver it to
   /// the destination/s node/s or it may forward the message to a
   /// network simulator (ns-3).
+  ///
+  /// The swarm can be split across several gzservers, each one simulating
+  /// a partition of it, with a <partition> element in the SDF of the
+  /// plugin:
+  ///
+  /// <partition>
+  ///   <name>north</name>             Name of this partition.
+  ///   <transport>udp</transport>     "shm" (same host, default) or "udp".
+  ///   <port>9500</port>              Local UDP port.
+  ///   <peer>                         Each other partition.
+  ///     <name>south</name>
+  ///     <address>10.0.0.2:9500</address>   Its UDP address.
+  ///   </peer>
+  /// </partition>
+  ///
+  /// Once per comms cycle, each partition sends the poses and outages of
+  /// its robots to the peers, and the messages sent by its robots that
+  /// may reach the robots of each peer. The robots of the peers are members
+  /// of the swarm without model in the comms model, so the links between
+  /// both sides are evaluated from the exchanged poses. Each partition
+  /// delivers the messages to its own robots. The state of the peers is one
+  /// cycle old at most.
+  ///
+  /// Dashboards can watch a running simulation with a <telemetry> element,
+  /// see TelemetryPublisher:
+  ///
+  /// <telemetry>
+  ///   <transport>shm</transport>     "shm" (same host, default) or "udp".
+  ///   <name>swarm</name>             Segment "/swarm_telemetry_<name>".
+  ///                                  Default: the name of the world.
+  ///   <address>239.255.0.1:9600</address>   UDP (multicast) destination.
+  ///   <period>0.1</period>           Simulation time between snapshots
+  ///                                  (s). Default: 0, every step.
+  /// </telemetry>
+  ///
+  /// Each snapshot holds the counters of the broker in the step, and the
+  /// pose, battery and number of neighbors of each robot.
+  ///
+  /// The broker writes and restores the checkpoints of the world at the end
+  /// of a step, see Checkpointer. SWARM_CHECKPOINT_PERIOD=<seconds> writes
+  /// one every period of simulation time into SWARM_CHECKPOINT_DIR (default
+  /// the current directory), as <world>_<time>.ckpt.
+  /// SWARM_CHECKPOINT_RESTORE=<file> restores a checkpoint at the end of
+  /// the first step, so the simulation continues from it. A split swarm
+  /// can't be checkpointed.
+  ///
+  /// swarm_batch --fork-at runs the world until a warm-up time, and the
+  /// broker forks a replica of the whole process for each run at the end
+  /// of that step. The replicas share the memory of the warm world, e.g.
+  /// the terrain and the visibility tables, until they write it. Each one
+  /// continues with its own seed and log, and may override the parameters
+  /// of the comms model with a <replicas> element:
+  ///
+  /// <replicas>
+  ///   <replica>                      Overrides of the first replica.
+  ///     <comms_model>                Same elements as <comms_model>.
+  ///       <comms_drop_probability_max>0.5</comms_drop_probability_max>
+  ///     </comms_model>
+  ///   </replica>
+  ///   <replica>...</replica>          Second replica, and so on.
+  /// </replicas>
+  ///
+  /// The parent waits for the replicas and stops its world. The Python
+  /// worker processes of the controllers would be shared by the replicas,
+  /// so those worlds can't be forked.
+  ///
+  /// With SWARM_REPLAY=<swarm.log>, the controllers are replayed from the
+  /// log, see ReplayLog: the comms model isn't updated, and the messages
+  /// sent are dropped instead of dispatched.
+  ///
+  /// The broker registers itself and the logger in the memory accounting
+  /// of the world, see MemoryAccounting. With SWARM_MEMORY_REPORT=1, it
+  /// prints the memory of each subsystem when the world is destroyed, and
+  /// at the end of the step after the process receives a SIGUSR1.
+  ///
+  /// With SWARM_STEP_TRACE=<prefix>, the phases of the steps are traced
+  /// into a ring, written as a Chrome trace after a SIGUSR2 or a step over
+  /// SWARM_STEP_TRACE_THRESHOLD ms, see StepTrace. The broker starts and
+  /// ends the steps of the trace.
   class IGNITION_VISIBLE BrokerPlugin
-    : public gazebo::WorldPlugin, public swarm::Loggable
+    : public gazebo::WorldPlugin, public swarm::Loggable,
+      public swarm::Checkpointable, public swarm::MemoryAccountable
   {
     /// \brief Class constructor.
     public: BrokerPlugin() = default;
@@ -77,19 +175,108 @@ namespace swarm
     /// \param[in] _info Update information provided by the server.
     private: void Update(const gazebo::common::UpdateInfo &_info);
 
+    /// \brief End of the world update, with the adaptive fidelity of the
+    /// comms model: passes the wall time of the step to the comms model.
+    /// Then writes or restores the checkpoints due.
+    private: void OnUpdateEnd();
+
+    /// \brief Write or restore the checkpoints requested, and write the
+    /// periodic one if due.
+    private: void ProcessCheckpoints();
+
+    /// \brief Write a checkpoint of the world.
+    /// \param[in] _path Path of the file.
+    /// \return True if the checkpoint was written.
+    private: bool SaveCheckpoint(const std::string &_path);
+
+    /// \brief Restore a checkpoint into the world.
+    /// \param[in] _path Path of the file.
+    /// \return True if every part of the checkpoint was restored.
+    private: bool RestoreCheckpoint(const std::string &_path);
+
+    /// \brief Fork the replicas of the world, and wait for them in the
+    /// parent.
+    private: void ForkReplicas();
+
+    /// \brief Continue the simulation as a replica, in the child process.
+    /// \param[in] _replica Index of the replica.
+    private: void StartReplica(const unsigned int _replica);
+
     /// \brief Send a message to each swarm member
-    /// with its updated neighbors list.
+    /// with its updated neighbors list, if it changed.
     private: void NotifyNeighbors();
 
+    /// \brief Pass the neighbor lists that changed to the connectivity
+    /// tracker.
+    private: void TrackConnectivity();
+
     /// \brief Dispatch all incoming messages.
     private: void DispatchMessages();
 
+    /// \brief Read the <partition> element of the SDF, and open the link
+    /// with the other partitions.
+    /// \param[in] _sdf SDF for this plugin.
+    private: void LoadPartition(sdf::ElementPtr _sdf);
+
+    /// \brief Read the <telemetry> element of the SDF, and open the
+    /// publisher of the snapshots.
+    /// \param[in] _sdf SDF for this plugin.
+    private: void LoadTelemetry(sdf::ElementPtr _sdf);
+
+    /// \brief Publish a snapshot, if the telemetry period elapsed.
+    /// \param[in] _simTime Current simulation time.
+    private: void PublishTelemetry(const double _simTime);
+
+    /// \brief Update the robots of the other partitions with the frames
+    /// received from them, adding the new ones to the swarm.
+    private: void ReceivePartitions();
+
+    /// \brief Send the state of the robots of this partition, and the
+    /// messages forwarded to each peer.
+    /// \param[in] _simTime Current simulation time.
+    private: void SendPartitions(const double _simTime);
+
+    /// \brief Forward a message sent by a robot of this partition to the
+    /// peers of the neighbors of the sender.
+    /// \param[in] _msg The message.
+    /// \param[in] _src Index of the sender in the comms model.
+    private: void ForwardToPartitions(const msgs::Datagram &_msg,
+                                      const unsigned int _src);
+
+    /// \brief Update the data rate usage of each robot with the outgoing
+    /// messages, and find the message from which each robot is saturated.
+    /// \sa saturatedAt
+    private: void AccountDataRate();
+
+    /// \brief Deliver the messages scheduled until the current step.
+    /// \sa deliveries
+    private: void DeliverScheduled();
+
     // Documentation inherited.
     private: void OnLogMin(msgs::LogEntryMin &_logEntry) const;
 
     // Documentation inherited.
     private: virtual void OnLog(msgs::LogEntry &_logEntry) const;
 
+    /// \brief True when the average number of neighbors changed by
+    /// kNeighborsChange since the last logged entry, or when the fidelity of
+    /// the comms model changed.
+    private: virtual bool LogChanged() const;
+
+    // Documentation inherited.
+    private: virtual void OnSave(msgs::CheckpointPart &_part) const;
+
+    // Documentation inherited.
+    private: virtual bool OnRestore(const msgs::CheckpointPart &_part);
+
+    /// \brief Add the memory of the queues of messages to the "broker"
+    /// subsystem, and the memory of the comms model.
+    /// \param[in,out] _report The report.
+    private: virtual void OnMemory(MemoryReport &_report) const;
+
+    /// \brief Print the memory report of the world.
+    private: void PrintMemory() const;
+
     /// \brief World pointer.
     private: gazebo::physics::WorldPtr world;
 
@@ -99,10 +286,17 @@ namespace swarm
     /// \brief Pointer to the update event connection.
     private: gazebo::event::ConnectionPtr updateConnection;
 
+    /// \brief Pointer to the update end event connection, with the
+    /// adaptive fidelity of the comms model and the checkpoints.
+    private: gazebo::event::ConnectionPtr updateEndConnection;
+
+    /// \brief Wall time at the start of the current step.
+    private: std::chrono::steady_clock::time_point stepStart;
+
     /// \brief Information about the members of the swarm.
     private: SwarmMembershipPtr swarm;
 
-    /// \brief Mutex for protecting the queue.
+    /// \brief Mutex for protecting the comms model while it's updated.
     private: std::mutex mutex;
 
     /// \brief Comms model that we're using.
@@ -111,17 +305,251 @@ namespace swarm
     /// \brief Incoming messages from other robots used for logging.
     private: msgs::IncomingMsgs logIncomingMsgs;
 
-    /// \brief Broker instance.
+    /// \brief Number of entries between two keyframes of the visibility,
+    /// with SWARM_LOG_VISIBILITY_DELTA=1.
+    private: static const unsigned int kVisibilityKeyframePeriod = 100;
+
+    /// \brief Status of each pair of robots in the last logged entry.
+    /// Cleared when the comms model is rebuilt, to log a keyframe.
+    private: mutable std::vector<uint8_t> loggedVisibility;
+
+    /// \brief Number of entries with visibility changes logged since the
+    /// last keyframe.
+    private: mutable unsigned int loggedVisibilityDeltas = 0;
+
+    /// \brief Chunk of the log of the last logged entry.
+    private: mutable uint32_t loggedChunk = 0;
+
+    /// \brief Change of the average number of neighbors that is logged
+    /// before the log period of the broker elapses, with SWARM_LOG_ADAPTIVE=1.
+    private: static constexpr double kNeighborsChange = 0.5;
+
+    /// \brief Average number of neighbors in the last logged entry.
+    private: mutable double loggedNeighbors = 0;
+
+    /// \brief Broker instance of the world.
     private: Broker *broker = Broker::Instance();
 
-    /// \brief Logger instance.
+    /// \brief Logger instance of the world.
     private: Logger *logger = Logger::Instance();
 
+    /// \brief Checkpointer of the world.
+    private: Checkpointer *checkpointer = nullptr;
+
+    /// \brief Memory accounting of the world.
+    private: MemoryAccounting *memory = nullptr;
+
+    /// \brief Whether the memory report is printed, from
+    /// SWARM_MEMORY_REPORT.
+    private: bool memoryReport = false;
+
+    /// \brief Simulation time between periodic checkpoints (s), 0 to
+    /// disable them.
+    private: double checkpointPeriod = 0;
+
+    /// \brief Simulation time of the next periodic checkpoint (s).
+    private: double nextCheckpointTime = 0;
+
+    /// \brief Directory of the periodic checkpoints.
+    private: std::string checkpointDir = ".";
+
+    /// \brief Checkpoint restored at the end of the first step, if any.
+    private: std::string restorePath;
+
+    /// \brief Whether the controllers are replayed from a log, from
+    /// SWARM_REPLAY.
+    private: bool replay = false;
+
+    /// \brief Number of replicas forked at replicaTime, from
+    /// SWARM_REPLICAS. 0 once forked.
+    private: unsigned int replicas = 0;
+
+    /// \brief Simulation time when the replicas are forked (s).
+    private: double replicaTime = 0;
+
+    /// \brief Seed of the first replica. Replica k uses replicaSeed + k.
+    private: unsigned int replicaSeed = 0;
+
+    /// \brief Directory of the logs of the replicas. Replica k logs into
+    /// <replicaLogPath>/<replicaFirstId + k>.
+    private: std::string replicaLogPath;
+
+    /// \brief Identifier of the log of the first replica.
+    private: unsigned int replicaFirstId = 0;
+
     /// \brief Maximum data rate allowed per simulation cycle (bits).
     private: uint32_t maxDataRatePerCycle;
 
-    /// \brief Random engine used to shuffle the messages.
-    private: std::default_random_engine rndEngine;
+    /// \brief Seed of the stream that shuffles and drops the messages. The
+    /// stream is at the block of the step, so it has no other state.
+    private: uint64_t dispatchSeed = 0;
+
+    /// \brief A message being dispatched.
+    private: struct Outgoing
+    {
+      /// \brief The message.
+      DatagramPtr msg;
+
+      /// \brief Index of the sender in the comms model.
+      unsigned int src;
+    };
+
+    /// \brief Messages of the current dispatch, in delivery order. Reused
+    /// between iterations.
+    private: std::vector<Outgoing> outgoing;
+
+    /// \brief Bits sent by each robot in the current dispatch, by index in
+    /// the comms model.
+    private: std::vector<uint32_t> senderBits;
+
+    /// \brief For each robot, by index in the comms model, position in
+    /// outgoing of the first message that makes its data rate usage exceed
+    /// maxDataRatePerCycle. The robot doesn't receive that message nor the
+    /// following ones. The maximum size_t value if it never exceeds it.
+    private: std::vector<size_t> saturatedAt;
+
+    /// \brief Version of the neighbors last notified to each robot, by
+    /// index in the comms model.
+    /// \sa CommsModel::NeighborsVersion()
+    private: std::vector<uint64_t> notifiedVersions;
+
+    /// \brief Connectivity of the swarm, updated with the neighbor lists
+    /// and summarized in the minimal log.
+    private: mutable Connectivity connectivity;
+
+    /// \brief Version of the neighbors last passed to the connectivity
+    /// tracker, by index in the comms model.
+    private: std::vector<uint64_t> trackedVersions;
+
+    /// \brief Connectivity in the last logged entry.
+    private: mutable ConnectivityStats loggedConnectivity;
+
+    /// \brief The clients of an endpoint that are members of the swarm,
+    /// cached until the clients bound to the endpoint change.
+    private: struct EndPointMembers
+    {
+      /// \brief Version of the clients of the endpoint when cached.
+      /// \sa Broker::EndPointVersion()
+      uint64_t version = std::numeric_limits<uint64_t>::max();
+
+      /// \brief Number of words of the bitsets of the neighbors when
+      /// cached.
+      size_t words = 0;
+
+      /// \brief Indices of the members in the comms model, sorted.
+      std::vector<unsigned int> ids;
+
+      /// \brief Position of the client of each member of ids in the
+      /// clients of the endpoint.
+      std::vector<uint32_t> slots;
+
+      /// \brief Bitset of the members, only for the endpoints with more
+      /// members than words, e.g. the multicast and broadcast ones.
+      std::vector<uint64_t> bits;
+
+      /// \brief Number of members in the words of bits before each word.
+      std::vector<uint32_t> ranks;
+    };
+
+    /// \brief Get the members bound to an endpoint, updating them if the
+    /// clients of the endpoint changed.
+    /// \param[in] _id Handle of the endpoint.
+    /// \return The members.
+    private: const EndPointMembers &Members(const EndPointId _id);
+
+    /// \brief Members bound to each endpoint, indexed by handle.
+    private: std::vector<EndPointMembers> endpointMembers;
+
+    /// \brief Potential recipients of the message being dispatched: index
+    /// in the comms model and position in the clients of the endpoint.
+    private: std::vector<std::pair<unsigned int, uint32_t>> recipients;
+
+    /// \brief Random order of the potential recipients of the message
+    /// being dispatched.
+    private: Permutation fanOut;
+
+    /// \brief A message that reaches a client in a later step.
+    private: struct Delivery
+    {
+      /// \brief The message.
+      DatagramPtr msg;
+
+      /// \brief Address of the client, to check that it's still registered.
+      std::string address;
+
+      /// \brief The client.
+      const RobotPlugin *handler;
+
+      /// \brief Index of the callback of the client.
+      unsigned int callback;
+    };
+
+    /// \brief Messages in flight, by step of arrival, when the comms model
+    /// has a latency. The steps are counted from the start of the
+    /// simulation.
+    /// \sa CommsModel::Latency()
+    private: TimingWheel<Delivery> deliveries;
+
+    /// \brief Messages arriving in the current step, reused between steps.
+    private: std::vector<Delivery> arrivals;
+
+    /// \brief Current step, counted from the start of the simulation.
+    private: uint64_t step = 0;
+
+    /// \brief Length of a step (secs).
+    private: double stepSize;
+
+    /// \brief Pose snapshot of the world, indexed like the comms model.
+    private: PoseSnapshot *poses = PoseSnapshot::Instance();
+
+    /// \brief Time spent by the subsystems of the world, written into the
+    /// minimal log entries.
+    private: StepTimers *timers = StepTimers::Instance("");
+
+    /// \brief Name of this partition of the swarm, empty if the swarm is
+    /// not split.
+    private: std::string partitionName;
+
+    /// \brief Link with the other partitions, if the swarm is split.
+    private: std::unique_ptr<PartitionLink> partitionLink;
+
+    /// \brief Frame being prepared for each peer partition.
+    private: std::map<std::string, msgs::PartitionFrame> partitionFrames;
+
+    /// \brief State of the robots of this partition, sent to all the peers.
+    private: msgs::PartitionFrame partitionState;
+
+    /// \brief Buffer where the frames are serialized.
+    private: std::string frameBuffer;
+
+    /// \brief Addresses claimed by a peer and by this partition, already
+    /// reported.
+    private: std::set<std::string> partitionConflicts;
+
+    /// \brief Frames received from the peers, reused between cycles.
+    private: std::vector<std::string> receivedFrames;
+
+    /// \brief Messages received from the peers, dispatched in the next
+    /// cycle.
+    private: std::vector<DatagramPtr> remoteMsgs;
+
+    /// \brief Whether a frame couldn't be sent, to report it once.
+    private: bool partitionDropReported = false;
+
+    /// \brief Publisher of the snapshots, if the telemetry is enabled.
+    private: std::unique_ptr<TelemetryPublisher> telemetry;
+
+    /// \brief Snapshot filled at each telemetry period.
+    private: std::unique_ptr<TelemetryFrame> telemetryFrame;
+
+    /// \brief Simulation time between snapshots (s).
+    private: double telemetryPeriod = 0;
+
+    /// \brief Simulation time of the next snapshot (s).
+    private: double nextTelemetryTime = 0;
+
+    /// \brief Whether a snapshot couldn't be published, to report it once.
+    private: bool telemetryDropReported = false;
 
     /// \brief Number of unicast messages sent in the current iteration
     private: int numUnicast = 0;
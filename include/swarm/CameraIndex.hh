@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file CameraIndex.hh
+/// \brief Logical cameras tested against a grid of the models of a world.
+
+#ifndef __SWARM_CAMERA_INDEX_HH__
+#define __SWARM_CAMERA_INDEX_HH__
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <gazebo/common/Time.hh>
+#include <gazebo/physics/PhysicsTypes.hh>
+#include <ignition/math/Box.hh>
+#include <ignition/math/Pose3.hh>
+
+#include "swarm/Helpers.hh"
+#include "swarm/ModelGrid.hh"
+
+namespace swarm
+{
+  class SceneIndex;
+
+  /// \brief A model seen by a camera: its position in the names of the
+  /// scene index, and its pose in the camera frame.
+  typedef std::pair<int, ignition::math::Pose3d> CameraObject;
+
+  /// \brief An alternative to the logical camera sensor of Gazebo, shared
+  /// by the cameras of a world.
+  ///
+  /// The logical camera sensor tests every model of the world against the
+  /// frustum of each camera. The camera index keeps the bounding boxes of
+  /// the models in a grid instead, so a camera only tests the models near
+  /// it. The static models are added once, and the others are updated once
+  /// per step, the first time a camera of the world is updated in the
+  /// step. The models are the ones of the scene index of the world, and a
+  /// model is seen when its bounding box is in the frustum, as with the
+  /// logical camera sensor.
+  class IGNITION_VISIBLE CameraIndex
+  {
+    /// \brief Get the camera index of a world, created from its scene
+    /// index the first time.
+    /// \param[in] _world The world.
+    /// \return Pointer to the camera index of the world.
+    public: static CameraIndex *Instance(gazebo::physics::WorldPtr _world);
+
+    /// \brief Update the bounding boxes and the poses of the models that
+    /// are not static. Only the first call of a step has an effect.
+    /// \param[in] _simTime Current simulation time.
+    public: void Capture(const gazebo::common::Time &_simTime);
+
+    /// \brief Get the models seen by a camera.
+    /// \param[in] _pose Pose of the camera in the world frame.
+    /// \param[in] _near Near clip distance (m).
+    /// \param[in] _far Far clip distance (m).
+    /// \param[in] _hfov Horizontal field of view (radians).
+    /// \param[in] _aspectRatio Aspect ratio of the camera.
+    /// \param[in] _exclude Position of the model of the camera in the names
+    /// of the scene index, not reported.
+    /// \param[out] _objects The models seen, with their poses in the
+    /// camera frame.
+    public: void Observe(const ignition::math::Pose3d &_pose,
+                         const double _near, const double _far,
+                         const double _hfov, const double _aspectRatio,
+                         const int _exclude,
+                         std::vector<CameraObject> &_objects) const;
+
+    /// \brief Number of models in the index.
+    /// \return The number of models.
+    public: size_t Size() const;
+
+    /// \brief Class constructor.
+    /// \param[in] _world The world.
+    private: explicit CameraIndex(gazebo::physics::WorldPtr _world);
+
+    /// \brief Scene index of the world, with the names of the models.
+    private: std::shared_ptr<const SceneIndex> scene;
+
+    /// \brief The models, by index.
+    private: std::vector<gazebo::physics::ModelPtr> models;
+
+    /// \brief Bounding box of each model.
+    private: std::vector<ignition::math::Box> boxes;
+
+    /// \brief Pose of each model in the world frame.
+    private: std::vector<ignition::math::Pose3d> poses;
+
+    /// \brief Indices of the models that are not static.
+    private: std::vector<unsigned int> moving;
+
+    /// \brief Grid of the static models.
+    private: ModelGrid staticGrid;
+
+    /// \brief Grid of the other models, refilled every step.
+    private: ModelGrid movingGrid;
+
+    /// \brief Time of the last capture.
+    private: gazebo::common::Time captureTime;
+
+    /// \brief Whether the moving models were captured at least once.
+    private: bool captured = false;
+  };
+}
+#endif
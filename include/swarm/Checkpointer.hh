@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file Checkpointer.hh
+/// \brief Save and restore the state of a whole swarm simulation.
+
+#ifndef __SWARM_CHECKPOINTER_HH__
+#define __SWARM_CHECKPOINTER_HH__
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "msgs/checkpoint.pb.h"
+#include "swarm/Helpers.hh"
+
+namespace swarm
+{
+  /// \brief Interface that a client must implement to be saved in the
+  /// checkpoints of a world.
+  class IGNITION_VISIBLE Checkpointable
+  {
+    /// \brief Save the state of the client.
+    /// \param[out] _part The part of the checkpoint of the client, with its
+    /// ID already set.
+    public: virtual void OnSave(msgs::CheckpointPart &_part) const = 0;
+
+    /// \brief Restore the state of the client.
+    /// \param[in] _part The part of the checkpoint of the client.
+    /// \return True if the state was restored.
+    public: virtual bool OnRestore(const msgs::CheckpointPart &_part) = 0;
+  };
+
+  /// \brief The clients saved in the checkpoints of a world, and the
+  /// checkpoints requested.
+  ///
+  /// A checkpoint holds the simulation time, the pose and velocities of
+  /// every model that isn't static, and a part for each client: the
+  /// robots, the executor, the broker with the comms model, the BOO and
+  /// the logger. It is written at the end of a step by the broker, and
+  /// restored at the end of a step into a world loaded from the same world
+  /// file, so the next step continues from it.
+  ///
+  /// The file is written as the magic number kCheckpointMagic, the size of
+  /// the serialized msgs::Checkpoint as an uint32 and the message
+  /// compressed with zlib.
+  class IGNITION_VISIBLE Checkpointer
+  {
+    /// \brief Get the checkpointer of a world.
+    /// \param[in] _world Name of the world.
+    /// \return Pointer to the checkpointer of the world.
+    public: static Checkpointer *Instance(const std::string &_world);
+
+    /// \brief Register a new client.
+    /// \param[in] _id Unique ID of the client.
+    /// \param[in] _client Pointer to the client.
+    /// \return True if the operation succeed or false otherwise (if the same
+    /// id was already registered).
+    public: bool Register(const std::string &_id, Checkpointable *_client);
+
+    /// \brief Unregister a client.
+    /// \param[in] _id Unique ID of the client.
+    /// \return True if the operation succeed or false otherwise (if there is
+    /// no client registered for this ID).
+    public: bool Unregister(const std::string &_id);
+
+    /// \brief Save the state of every client.
+    /// \param[out] _checkpoint The checkpoint, where a part is added for
+    /// each client, in ID order.
+    public: void Save(msgs::Checkpoint &_checkpoint) const;
+
+    /// \brief Restore the state of every client from its part.
+    /// \param[in] _checkpoint The checkpoint.
+    /// \return False if a client has no part, or couldn't restore it. The
+    /// other clients are restored anyway.
+    public: bool Restore(const msgs::Checkpoint &_checkpoint);
+
+    /// \brief Ask for a checkpoint to be written at the end of the next
+    /// step. Can be called from any thread.
+    /// \param[in] _path Path of the file.
+    public: void RequestSave(const std::string &_path);
+
+    /// \brief Ask for a checkpoint to be restored at the end of the next
+    /// step. Can be called from any thread.
+    /// \param[in] _path Path of the file.
+    public: void RequestRestore(const std::string &_path);
+
+    /// \brief Take the oldest request.
+    /// \param[out] _path Path of the file.
+    /// \param[out] _restore True to restore it, false to write it.
+    /// \return False if there is no request.
+    public: bool TakeRequest(std::string &_path, bool &_restore);
+
+    /// \brief Write a checkpoint into a file.
+    /// \param[in] _path Path of the file.
+    /// \param[in] _checkpoint The checkpoint.
+    /// \return True if the file was written.
+    public: static bool Write(const std::string &_path,
+                              const msgs::Checkpoint &_checkpoint);
+
+    /// \brief Read a checkpoint from a file.
+    /// \param[in] _path Path of the file.
+    /// \param[out] _checkpoint The checkpoint.
+    /// \return True if the file was read.
+    public: static bool Read(const std::string &_path,
+                             msgs::Checkpoint &_checkpoint);
+
+    /// \brief Magic number at the start of a checkpoint file.
+    public: static const char kCheckpointMagic[];
+
+    /// \brief Size of the magic number (bytes).
+    public: static const size_t kCheckpointMagicSize = 8;
+
+    /// \brief Constructor.
+    private: Checkpointer() = default;
+
+    /// \brief List of clients. The key is the ID of the client and the value
+    /// is a pointer to each client.
+    private: std::map<std::string, Checkpointable *> clients;
+
+    /// \brief Requests not taken yet: path of the file, and whether it's
+    /// restored.
+    private: std::vector<std::pair<std::string, bool>> requests;
+
+    /// \brief Mutex protecting the requests.
+    private: std::mutex mutex;
+  };
+}
+#endif
@@ -21,9 +21,15 @@
 #ifndef __SWARM_COMMON__
 #define __SWARM_COMMON__
 
+#include <memory>
 #include <sdf/sdf.hh>
+#include "gazebo/common/CommonTypes.hh"
 #include "gazebo/physics/PhysicsTypes.hh"
+#include "swarm/Heightmap.hh"
+#include "swarm/SceneIndex.hh"
 #include "swarm/SwarmTypes.hh"
+#include "swarm/TangentPlane.hh"
+#include "swarm/TerrainRaster.hh"
 
 namespace swarm
 {
@@ -89,14 +95,53 @@ namespace swarm
     /// \return True if the spherical coordinates element was found.
     public: bool LoadSphericalCoordinates(sdf::ElementPtr _sphericalCoordsSDF);
 
+    /// \brief Load the search area and the spherical coordinates from the
+    /// SDF of a world. The search area is taken from the first model plugin
+    /// that has a <swarm_search_area> element.
+    /// \param[in] _worldSDF Pointer to the <world> sdf element.
+    /// \return True if both the search area and the spherical coordinates
+    /// were found.
+    public: bool LoadWorldSearchArea(sdf::ElementPtr _worldSDF);
+
+    /// \brief Get the bounding box of the search area in Gazebo's world
+    /// coordinate frame. The world must be set.
+    /// \param[out] _min Minimum corner of the search area.
+    /// \param[out] _max Maximum corner of the search area.
+    /// \return True if a search area is loaded.
+    public: bool SearchAreaBounds(ignition::math::Vector3d &_min,
+                                  ignition::math::Vector3d &_max) const;
+
+    /// \brief Get the bounding box of the search area in the world
+    /// coordinate frame given by a set of spherical coordinates. Used when
+    /// there's no world, e.g. by offline tools.
+    /// \param[in] _sphericalCoords Spherical coordinates of the world.
+    /// \param[out] _min Minimum corner of the search area.
+    /// \param[out] _max Maximum corner of the search area.
+    /// \return True if a search area is loaded.
+    public: bool SearchAreaBounds(
+                const gazebo::common::SphericalCoordinates &_sphericalCoords,
+                ignition::math::Vector3d &_min,
+                ignition::math::Vector3d &_max) const;
+
     /// \brief Get terrain information at the specified location.
     /// \param[in] _pos Reference position.
-    /// \param[out] _terrainPos The 3d point on the terrain.
+    /// \param[out] _terrainPos The 3d point on the terrain, below or above
+    /// _pos.
+    /// \sa Heightmap::Lookup()
     /// \param[out] _norm Normal to the terrain.
     public: void TerrainLookup(const ignition::math::Vector3d &_pos,
                                ignition::math::Vector3d &_terrainPos,
                                ignition::math::Vector3d &_norm) const;
 
+    /// \brief Decompress in the background the terrain tiles around a
+    /// vehicle and around where it will be in a few seconds, so its next
+    /// terrain lookups find them in memory. Does nothing without tiles.
+    /// \param[in] _pos Position of the vehicle.
+    /// \param[in] _vel Linear velocity of the vehicle, in world frame.
+    /// \sa SceneIndex::PrefetchTerrain()
+    public: void PrefetchTerrain(const ignition::math::Vector3d &_pos,
+                                 const ignition::math::Vector3d &_vel) const;
+
     /// \brief Query the map to get the height and terrain type
     /// at a specific latitude and longitude.
     ///
@@ -109,8 +154,32 @@ namespace swarm
     public: bool MapQuery(const double _lat, const double _lon,
                           double &_height, TerrainType &_type);
 
+    /// \brief Query the map at several latitudes and longitudes. The
+    /// heights are looked up eight at a time when AVX2 is available.
+    ///
+    /// \param[in] _count Number of queries.
+    /// \param[in] _lat Latitudes of the queries (degrees).
+    /// \param[in] _lon Longitudes of the queries (degrees).
+    /// \param[out] _height Elevation at each query point (meters).
+    /// \param[out] _type Type of terrain at each query point.
+    /// \param[out] _valid Whether each query is inside the search area. The
+    /// height and type of the other queries are not set. It can be null.
+    /// \return Number of queries inside the search area.
+    /// \sa Heightmap::Lookup(const size_t, const double *, const double *,
+    /// double *, ignition::math::Vector3d *) const
+    public: size_t MapQuery(const size_t _count, const double *_lat,
+                            const double *_lon, double *_height,
+                            TerrainType *_type, bool *_valid);
+
+    /// \brief Get the projection between the spherical coordinates and the
+    /// world, fitted around the origin of the world once it's set.
+    /// \return The projection.
+    public: const TangentPlane &Projection() const;
+
     /// \brief Helper function to get a terrain type at a position in
-    /// Gazebo's world coordinate frame.
+    /// Gazebo's world coordinate frame. The type is looked up in a raster
+    /// built from the trees and buildings of the world by the first query,
+    /// and shared by all the plugins of the world.
     /// \param[in] _pos Position to query.
     /// \return Type of terrain at the location.
     public: TerrainType TerrainAtPos(const ignition::math::Vector3d &_pos);
@@ -123,11 +192,29 @@ namespace swarm
     /// \return Terrain size.
     public: ignition::math::Vector3d TerrainSize() const;
 
-    /// \brief Set the world pointer.
+    /// \brief Get a hash of the terrain heightmap. It combines the size,
+    /// the number of vertices and the height of every vertex, so it can be
+    /// used to identify data derived from a terrain, such as the visibility
+    /// table.
+    /// \return Hash of the terrain, or 0 if there is no terrain.
+    public: uint64_t TerrainHash() const;
+
+    /// \brief Get the samples of the terrain, that can be used without the
+    /// physics engine.
+    /// \return The heightmap. It's not valid if there is no terrain.
+    public: const Heightmap &TerrainHeightmap() const;
+
+    /// \brief Get the scene index of the world.
+    /// \return The index, or null if the world isn't set.
+    public: std::shared_ptr<const SceneIndex> Scene() const;
+
+    /// \brief Set the world pointer. The terrain is taken from the scene
+    /// index of the world, shared by all the plugins.
     /// \param[in] _world Pointer to the world.
     public: void SetWorld(gazebo::physics::WorldPtr _world);
 
-    /// \brief Set the terrain.
+    /// \brief Set a terrain other than the one of the world. The samples
+    /// are copied into an index of its own.
     /// \param[in] _terrain Pointer to the heightmap.
     public: void SetTerrain(gazebo::physics::HeightmapShapePtr _terrain);
 
@@ -138,15 +225,15 @@ namespace swarm
     /// \brief Pointer to the world.
     private: gazebo::physics::WorldPtr world;
 
-    /// \brief This is the scaling from world coordinates to heightmap
-    /// coordinates.
-    private: ignition::math::Vector2d terrainScaling;
+    /// \brief Index with the terrain, and the models of the world.
+    private: std::shared_ptr<const SceneIndex> scene;
 
-    /// \brief Pointer to the terrain
-    private: gazebo::physics::HeightmapShapePtr terrain;
+    /// \brief Type of terrain of the world, null until the first query.
+    private: std::shared_ptr<const TerrainRaster> terrainRaster;
 
-    /// \brief Size of the terrain
-    private: ignition::math::Vector3d terrainSize;
+    /// \brief Projection of the spherical coordinates of the world, used
+    /// instead of the full conversion of SphericalCoordinates.
+    private: TangentPlane projection;
   };
 }
 #endif
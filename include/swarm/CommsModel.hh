@@ -21,8 +21,14 @@
 #ifndef __SWARM_COMMS_MODEL_HH__
 #define __SWARM_COMMS_MODEL_HH__
 
-#include <map>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 #include <gazebo/common/Time.hh>
@@ -30,11 +36,22 @@
 #include <ignition/math.hh>
 #include <sdf/sdf.hh>
 
+#include "msgs/checkpoint.pb.h"
 #include "msgs/log_entry.pb.h"
+#include "swarm/Common.hh"
+#include "swarm/MemoryAccounting.hh"
+#include "swarm/PoseSnapshot.hh"
+#include "swarm/RandomStream.hh"
+#include "swarm/SceneIndex.hh"
+#include "swarm/StepTrace.hh"
 #include "swarm/SwarmTypes.hh"
+#include "swarm/VisibilityLookup.hh"
+#include "swarm/WorkerPool.hh"
 
 namespace swarm
 {
+  class VisibilityTable;
+
   /// \brief Class used to store information about the communication model.
   class CommsModel
   {
@@ -47,21 +64,77 @@ namespace swarm
                        gazebo::physics::WorldPtr _world,
                        sdf::ElementPtr _sdf);
 
-    /// \brief Class destructor.
-    public: virtual ~CommsModel() = default;
+    /// \brief Class destructor. Stops the thread of the pipelined updates.
+    public: virtual ~CommsModel();
 
     /// \brief Update the state of the communication model (outages, visibility
     /// between nodes and neighbors).
+    ///
+    /// With <pipelined>, the state was evaluated by the thread of the model
+    /// during the previous step, from the poses given to StartUpdate(), so
+    /// it's always one step old; Update() only waits for it. The first step
+    /// after a Reset() is evaluated in place.
     public: void Update();
 
-    /// \brief Connectivity state for every pair of robots.
-    /// \return The connectivity information.
-    public: const msgs::VisibilityMap &VisibilityMap() const;
+    /// \brief With <pipelined>, capture the poses of the current step and
+    /// start evaluating them on the thread of the model, for the next
+    /// Update(). It must be called once the state of this step was read,
+    /// e.g. after dispatching and logging, and it does nothing otherwise.
+    /// The other thread only reads the tables and the copy of the poses, so
+    /// the physics and the controllers run meanwhile.
+    public: void StartUpdate();
+
+    /// \brief Whether the updates are pipelined with the rest of the step,
+    /// with <pipelined>.
+    /// \return True if the updates are pipelined.
+    public: bool Pipelined() const;
+
+    /// \brief Stop the thread of the pipelined updates before a fork(),
+    /// once the last update finished. It's started again by the next
+    /// StartUpdate(), in the parent and in the child.
+    public: void PrepareFork();
+
+    /// \brief Restart the dynamic state of the model (outages, visibility,
+    /// neighbors and the random streams, from the current seed). The
+    /// parameters, the indices of the robots, the scene and the visibility
+    /// tables are kept, so a world reset doesn't load them again.
+    public: void Reset();
+
+    /// \brief Set the state of a member of the swarm simulated by another
+    /// partition, received from that partition. It's used by the next
+    /// Update().
+    /// \param[in] _index Index of the member.
+    /// \param[in] _pose Pose of the member in the world.
+    /// \param[in] _onOutage Whether the member is on a comms outage.
+    /// \sa SwarmMember::partition
+    public: void SetRemoteState(const unsigned int _index,
+                                const ignition::math::Pose3d &_pose,
+                                const bool _onOutage);
+
+    /// \brief Connectivity state for every pair of robots. The message is
+    /// only built when logged.
+    /// \param[out] _msg The connectivity information.
+    public: void FillVisibilityMap(msgs::VisibilityMap &_msg) const;
+
+    /// \brief Connectivity state for every pair of robots, as the changes
+    /// since the last call. A keyframe with all the pairs is filled instead
+    /// when requested, or when the number of robots changed.
+    /// \param[in] _keyframe Whether to fill a keyframe.
+    /// \param[in,out] _last Status of each pair at the last call, updated.
+    /// \param[out] _msg The connectivity information.
+    public: void FillVisibilityDelta(const bool _keyframe,
+                                     std::vector<uint8_t> &_last,
+                                     msgs::VisibilityDelta &_msg) const;
 
     /// \brief Get the maximum data rate allowed (bits per second).
     /// \return Maximum data rate allowed (bps).
     public: uint32_t MaxDataRate() const;
 
+    /// \brief Get the latency of the links (secs).
+    /// \return The latency, or a negative value if the messages are
+    /// delivered in the step they're sent.
+    public: double Latency() const;
+
     /// \brief Get the overhead caused by UDP+IP+Ethernet headers (bytes).
     /// \return The overhead in bytes.
     public: uint16_t UdpOverhead() const;
@@ -70,21 +143,319 @@ namespace swarm
     /// \return Average number of neighbors per robot.
     public: double AvgNeighbors() const;
 
-    /// \brief Decide if each member of the swarm enters into a comms outage.
+    /// \brief Get the index of a member of the swarm. The indices follow
+    /// the order of the addresses.
+    /// \param[in] _address Address of the member.
+    /// \return The index, or -1 if the address is not a member.
+    public: int MemberIndex(const std::string &_address) const;
+
+    /// \brief Get a member of the swarm.
+    /// \param[in] _index Index of the member.
+    /// \return The member.
+    /// \sa MemberIndex()
+    public: const SwarmMemberPtr &Member(const unsigned int _index) const;
+
+    /// \brief Get the address of a member of the swarm.
+    /// \param[in] _index Index of the member.
+    /// \return The address.
+    /// \sa MemberIndex()
+    public: const std::string &Address(const unsigned int _index) const;
+
+    /// \brief Get the addresses of the members of the swarm.
+    /// \return The addresses, indexed like the members.
+    public: const std::vector<std::string> &Addresses() const;
+
+    /// \brief Get the position of each member of the swarm at its last
+    /// neighbor update, which is where its neighbors last heard of it.
+    /// \return The positions in the world, indexed like the members.
+    public: const std::vector<ignition::math::Vector3d> &ReportedPositions()
+                const;
+
+    /// \brief Get the neighbors of a member of the swarm, from the last
+    /// neighbor update.
+    /// \param[in] _index Index of the member.
+    /// \return Indices of the neighbors, sorted.
+    public: const std::vector<unsigned int> &Neighbors(
+                const unsigned int _index) const;
+
+    /// \brief Get the neighbors of a member of the swarm as a bitset, from
+    /// the last neighbor update. Bit j % 64 of word j / 64 is set if member
+    /// j is a neighbor.
+    /// \param[in] _index Index of the member.
+    /// \return The NeighborWords() words of the bitset.
+    /// \sa Neighbors()
+    public: const uint64_t *NeighborBits(const unsigned int _index) const;
+
+    /// \brief Get the number of words of the bitsets of the neighbors.
+    /// \return The number of words, enough for a bit per member.
+    public: size_t NeighborWords() const;
+
+    /// \brief Get the version of the neighbors of a member of the swarm.
+    /// It changes every time that a robot enters or leaves its neighbors.
+    /// \param[in] _index Index of the member.
+    /// \return The version, zero until the first change.
+    public: uint64_t NeighborsVersion(const unsigned int _index) const;
+
+    /// \brief Get the neighbors of a member of the swarm by address, with
+    /// their comms probabilities. The map is built on each call, from
+    /// Neighbors() and CommsProbability().
+    /// \param[in] _index Index of the member.
+    /// \return The neighbors.
+    public: Neighbors_M NeighborsMap(const unsigned int _index) const;
+
+    /// \brief Get the probability that a packet between two members of
+    /// the swarm arrives, from the last neighbor update.
+    /// \param[in] _src Index of the sender.
+    /// \param[in] _dst Index of the receiver.
+    /// \return The probability, negative if the receiver is not a neighbor
+    /// of the sender.
+    public: double CommsProbability(const unsigned int _src,
+                                    const unsigned int _dst) const;
+
+    /// \brief Whether the budgets of the visibility and the neighbor updates
+    /// adapt to the wall time of the steps, with <adaptive_fidelity>.
+    /// \return True if the fidelity is adaptive.
+    public: bool AdaptiveFidelity() const;
+
+    /// \brief Adapt the budgets to the wall time of the steps. Once per
+    /// adaptation window, the budgets are scaled down, within their floors,
+    /// if the steps were slower than the target, and restored gradually when
+    /// they are faster again. Each change is kept for the log.
+    /// \param[in] _stepWallTime Wall time of the step that just finished (s).
+    /// \sa TakeFidelityChanges()
+    public: void AdaptFidelity(const double _stepWallTime);
+
+    /// \brief Whether the fidelity changed since the last call to
+    /// TakeFidelityChanges().
+    /// \return True if there are changes to log.
+    public: bool FidelityChanged() const;
+
+    /// \brief Move the changes of fidelity into a log entry.
+    /// \param[out] _changes The changes since the last call, appended.
+    public: void TakeFidelityChanges(
+                google::protobuf::RepeatedPtrField<msgs::CommsFidelity>
+                  &_changes);
+
+    /// \brief Save the dynamic state of the model into a checkpoint: the
+    /// outages, the neighbors and the visibility of the members, and the
+    /// random streams.
+    /// \param[out] _state The state.
+    public: void Save(msgs::CommsState &_state) const;
+
+    /// \brief Restore the dynamic state saved by Save(). The broadphase and
+    /// the caches of the links are rebuilt by the next Update().
+    /// \param[in] _state The state.
+    /// \return False if the members of the state are not the members of the
+    /// model.
+    public: bool Restore(const msgs::CommsState &_state);
+
+    /// \brief Continue the model in a replica of the simulation forked from
+    /// the current state. The random streams change to the current seed,
+    /// and the caches of the links are rebuilt by the next Update(). The
+    /// outages, the neighbors and the visibility are kept.
+    /// \param[in] _overrides Element whose <comms_model> block replaces the
+    /// parameters of the links, or nullptr to keep them.
+    public: void Fork(sdf::ElementPtr _overrides);
+
+    /// \brief Add the memory of the model to a report: the state of the
+    /// pairs and of the members to "comms_model", the mapped tables to
+    /// "visibility_tables", the decompressed tiles of the tiled tables to
+    /// "visibility_tiles", and the scene shared with the robots to
+    /// "scene_index".
+    /// \param[in,out] _report The report.
+    public: void OnMemory(MemoryReport &_report) const;
+
+    /// \brief Counters of the tile caches of the tiled visibility tables.
+    /// \param[out] _hits Number of lookups of a decompressed tile.
+    /// \param[out] _misses Number of tiles decompressed.
+    /// \return True if one of the tables is tiled.
+    public: bool VisibilityTileStats(uint64_t &_hits,
+                                     uint64_t &_misses) const;
+
+    /// \brief Start and finish the comms outages that are due.
     private: void UpdateOutages();
 
+    /// \brief Evaluate the state of the model from the poses of statePoses,
+    /// at stateTime.
+    private: void Evaluate();
+
+    /// \brief Wait for the pipelined update started by StartUpdate(), if
+    /// any, before reading or changing the state from the simulation thread.
+    private: void WaitUpdate() const;
+
+    /// \brief Stop the thread of the pipelined updates.
+    private: void StopPipeline();
+
+    /// \brief Main loop of the thread of the pipelined updates.
+    private: void RunPipeline();
+
+    /// \brief Schedule the next outage event of every robot.
+    private: void ScheduleOutages();
+
+    /// \brief Schedule the next outage event of a robot from the time of
+    /// the last update: the end of its current outage, or the start of its
+    /// next one.
+    /// \param[in] _id Index of the robot.
+    private: void ScheduleOutage(const unsigned int _id);
+
+    /// \brief Draw a uniform number of the outages of a robot, from its own
+    /// stream at the time of the last update.
+    /// \param[in] _id Index of the robot.
+    /// \param[in] _draw Identifier of the number drawn at that time.
+    /// \param[in] _min Minimum value.
+    /// \param[in] _max Maximum value.
+    /// \return A number in [_min, _max).
+    private: double OutageUniform(const unsigned int _id,
+                                  const uint64_t _draw, const double _min,
+                                  const double _max) const;
+
     /// \brief Update the neighbors list of each member of the swarm.
     private: void UpdateNeighbors();
 
+    /// \brief Set or clear the bits of the listed neighbors of a member in
+    /// neighborBits.
+    /// \param[in] _index Index of the member.
+    /// \param[in] _value True to set the bits, false to clear them.
+    private: void SetNeighborBits(const unsigned int _index,
+                                  const bool _value);
+
     /// \brief Update the neighbor list for a single robot and notifies the
-    /// robot with the updated list.
+    /// robot with the updated list. Only the broadphase candidates of the
+    /// robot are considered.
     ///
-    /// \param[in] _address Address of the robot to be updated.
-    private: void UpdateNeighborList(const std::string &_address);
+    /// \param[in] _id Index of the robot to be updated in the members
+    /// vector.
+    /// \param[in,out] _scratch Buffer of the calling thread.
+    /// \tparam kPolicy Index of the specialization for the parameters of
+    /// the comms model, see SelectLinkPolicy().
+    private: template <unsigned int kPolicy>
+             void UpdateNeighborList(const unsigned int _id,
+                                     std::vector<unsigned int> &_scratch);
+
+    /// \brief A specialization of UpdateNeighborList().
+    private: using NeighborListUpdater = void (CommsModel::*)(
+                 const unsigned int _id, std::vector<unsigned int> &_scratch);
+
+    /// \brief Select the specialization of UpdateNeighborList() for the
+    /// parameters of the comms model: the effect of the trees on each
+    /// distance, whether distance limits are set and whether packets can be
+    /// dropped. The branches on fixed parameters are resolved at compile
+    /// time.
+    private: void SelectLinkPolicy();
+
+    /// \brief Store the specializations of UpdateNeighborList() from
+    /// kPolicy on.
+    /// \param[out] _updaters The specializations, by index.
+    private: template <unsigned int kPolicy>
+             static void FillNeighborListUpdaters(
+                 NeighborListUpdater *_updaters);
+
+    /// \brief Apply the comms model to a pair of robots, and update the
+    /// visibility entry used for logging.
+    /// \param[in] _a Index of the robot receiving the neighbor list.
+    /// \param[in] _b Index of the other robot.
+    /// \param[in] _pos Position of the first robot.
+    /// \return Probability of receiving a packet from the other robot, or a
+    /// negative value if it's not a neighbor.
+    /// \tparam kPolicy Index of the specialization of UpdateNeighborList().
+    private: template <unsigned int kPolicy>
+             double NeighborProbability(const unsigned int _a,
+                                        const unsigned int _b,
+                                        const ignition::math::Vector3d &_pos);
+
+    /// \brief Check the obstacles and the distances between two robots
+    /// with line of sight.
+    /// \param[in] _posA Position of the robot receiving the neighbor list.
+    /// \param[in] _posB Position of the other robot.
+    /// \param[out] _status Status to log for the pair.
+    /// \return -1 if the other robot is not a neighbor, 0 if it is a
+    /// neighbor that can't be heard and 1 if its packets can arrive.
+    /// \tparam kPolicy Index of the specialization of UpdateNeighborList().
+    private: template <unsigned int kPolicy>
+             int8_t LinkGeometry(const ignition::math::Vector3d &_posA,
+                                 const ignition::math::Vector3d &_posB,
+                                 msgs::CommsStatus &_status);
+
+    /// \brief Status logged for a pair of robots that are not candidates
+    /// of the broadphase. These robots are too far away to be visible.
+    /// \param[in] _a Index of the first robot.
+    /// \param[in] _b Index of the second robot.
+    /// \return The outage status if a robot is on outage, OBSTACLE
+    /// otherwise, like a pair that has no line of sight.
+    private: msgs::CommsStatus OutOfRangeStatus(const unsigned int _a,
+                                                const unsigned int _b) const;
+
+    /// \brief Set whether a member is on an outage, in the member and in
+    /// the outages mirror.
+    /// \param[in] _index Index of the member.
+    /// \param[in] _onOutage Whether the member is on an outage.
+    private: void SetOutage(const unsigned int _index, const bool _onOutage);
+
+    /// \brief Set the logged status of a pair of robots, and count the
+    /// visible robots. Only the thread updating the first robot may call it.
+    /// \param[in] _a Index of the first robot.
+    /// \param[in] _b Index of the second robot.
+    /// \param[in] _status The new status.
+    private: void SetCommsStatus(const unsigned int _a, const unsigned int _b,
+                                 const msgs::CommsStatus _status);
+
+    /// \brief Refresh the logged status between a robot and the robots that
+    /// are not its broadphase candidates. Called when the robot enters or
+    /// leaves an outage.
+    /// \param[in] _id Index of the robot.
+    private: void RefreshOutOfRangeStatus(const unsigned int _id);
+
+    /// \brief Rebuild the broadphase once per comms cycle, or sooner if a
+    /// robot moved more than half of broadphaseMargin since the last
+    /// rebuild, as two robots could then have closed the margin: hash the
+    /// position of every robot in a uniform grid, collect the candidates of
+    /// each robot (the robots within candidate range) and the visibility
+    /// pairs to check during the cycle.
+    private: void UpdateBroadphase();
+
+    /// \brief Schedule the visibility pairs of the comms cycle. The pairs
+    /// are sorted by how many cells of the visibility table their robots
+    /// moved since their last refresh, and the pairs that did not move are
+    /// left out.
+    private: void ScheduleVisibility();
+
+    /// \brief Cell of a position, in cells of the visibility table.
+    /// \param[in] _pos The position.
+    /// \return The packed X, Y and Z coordinates of the cell.
+    private: uint64_t MotionCell(const ignition::math::Vector3d &_pos) const;
+
+    /// \brief Index of the state of the pair (_a, _b) in the N x N arrays.
+    /// \param[in] _a Index of the first robot.
+    /// \param[in] _b Index of the second robot.
+    /// \return Index of the pair.
+    private: size_t PairIndex(const unsigned int _a,
+                              const unsigned int _b) const;
 
     /// \brief Update the visibility state between vehicles.
     private: void UpdateVisibility();
 
+    /// \brief Read the carriers of the robots from the pose snapshot. The
+    /// pairs of a robot that becomes or stops being an alias are computed
+    /// again.
+    private: void UpdateCarriers();
+
+    /// \brief Copy the visibility of the carriers to the pairs of their
+    /// aliases, after UpdateVisibility().
+    private: void AliasVisibility();
+
+    /// \brief Index of the link cache entry of a pair: the entry of the
+    /// carriers of the robots, or of the pair itself if both have the same
+    /// carrier or none.
+    /// \param[in] _a Index of the first robot.
+    /// \param[in] _b Index of the second robot.
+    /// \return The index.
+    private: size_t LinkIndex(const unsigned int _a,
+                              const unsigned int _b) const;
+
+    /// \brief Scale the budgets of the visibility and the neighbor updates
+    /// with the current fidelity.
+    private: void ApplyFidelity();
+
     /// \brief Check if there is line of sight between two points in the world.
     ///
     /// \param[in] _p1 A 3D point.
@@ -100,39 +471,47 @@ namespace swarm
     private: bool LineOfSight(const ignition::math::Pose3d &_p1,
                               const ignition::math::Pose3d &_p2);
 
+    /// \brief Load a level of the visibility table of the terrain, or its
+    /// tiled version if there is one. The missing table is generated first
+    /// when SWARM_VISIBILITY_GENERATE is set.
+    /// \param[in] _table The level and the area of the table.
+    /// \param[out] _lookup The loaded table.
+    /// \return True if the table was loaded.
+    private: bool LoadVisibilityLevel(VisibilityTable &_table,
+                                      VisibilityLookup &_lookup);
+
+    /// \brief Every visibility table of the model, loaded or not.
+    /// \return The finest level, the obstacle layer and the coarser levels.
+    private: std::vector<const VisibilityLookup*> VisibilityTables() const;
+
     /// \brief Check if a "comms_model" block exists in the SDF element of the
     /// plugin. If so, update the value of the default parameters with the one
     /// read from the world file.
     /// \param[in] _sdf Pointer to the SDF element of the plugin.
     private: void LoadParameters(sdf::ElementPtr _sdf);
 
-    /// \brief Populate a vector with the pairs of addresses that will be
-    /// checked in UpdateVisibility() each iteration. Note that the vector will
-    /// contain all combinations of two different elements (not permutations).
+    /// \brief Assign an index to each robot and size the state used to
+    /// update the visibility and the neighbors. The pairs of robots checked
+    /// in UpdateVisibility() are collected by UpdateBroadphase().
     private: void CacheVisibilityPairs();
 
-    /// \brief A pairing function that maps two values to a unique third
-    /// value.
-    /// \param[in] _a First value
-    /// \param[in] _b Second value
-    /// \return A unique key value
-    private: uint64_t Pair(const int _a, const int _b);
-
-    /// \brief Generate an index from a coordinate.
-    /// \param[in] _x X coordinate
-    /// \param[in] _y Y coordinate
-    private: int Index(const ignition::math::Vector3d &_p);
-
     /// \brief Check for building and tree obstacles between two points.
+    /// Only the obstacles on the segment count, whether the obstacle layer
+    /// of the visibility table answers or not.
     /// \param[in] _posA Start point
     /// \param[in] _posB End point
-    /// \param[out] _visible True if the two points are visible
+    /// \param[out] _visible Set to false if the two points are not visible
     /// \param[out] _treesBlocking True if trees are blocking
-    /// \param[out] _dist Distance to a blocking tree or building
     private: void CheckObstacles(const ignition::math::Vector3d &_posA,
                                  const ignition::math::Vector3d &_posB,
-                                 bool &_visible, bool &_treesBlocking,
-                                 double &_dist);
+                                 bool &_visible, bool &_treesBlocking);
+
+    /// \brief Whether a point is low enough for the visibility tables
+    /// generated 1 meter above the terrain.
+    /// \param[in] _pos The point.
+    /// \return True if the point is on the ground, or if there's no
+    /// terrain.
+    private: bool OnGround(const ignition::math::Vector3d &_pos) const;
 
     /// \brief Minimum free-space distance (m) between two nodes to be
     /// neighbors. Set to <0 for no limit.
@@ -182,6 +561,11 @@ namespace swarm
     /// \brief Maximum data rate allowed (bits per second).
     private: uint32_t commsDataRateMax = 54000000;
 
+    /// \brief Latency of the links (secs), added to the transmission time
+    /// of the messages. Set to <0 to deliver the messages in the step
+    /// they're sent.
+    private: double commsLatency = -1.0;
+
     /// \brief UDP header (8 bytes) + IPv4 header (20 bytes) +
     /// Ethernet 28 (bytes).
     private: uint16_t udpOverhead = 56;
@@ -195,64 +579,281 @@ namespace swarm
     /// \brief Keep track of update sim-time.
     private: gazebo::common::Time lastUpdateTime;
 
+    /// \brief Min-heap of outage events: simulation time (s) and index of
+    /// the robot starting or finishing an outage.
+    private: using OutageQueue = std::priority_queue<
+               std::pair<double, unsigned int>,
+               std::vector<std::pair<double, unsigned int>>,
+               std::greater<std::pair<double, unsigned int>>>;
+
+    /// \brief Pending outage events, at most one per robot.
+    private: OutageQueue outageEvents;
+
+    /// \brief Robots with an outage event due, reused by UpdateOutages().
+    private: std::vector<unsigned int> dueOutages;
+
     // \brief Ray used to test for line of sight between vehicles.
     private: gazebo::physics::RayShapePtr ray;
 
-    /// \brief Visibility between vehicles. The key is a pair with the
-    /// addresses of the vehicles involved. The value is a vector of strings
-    /// that stores the entity names of the first and last obstacles between the
-    /// vehicles. If there is line of sight the value contains a vector of one
-    /// element (empty string).
-    private: std::map<std::pair<std::string, std::string>, bool> visibility;
+    /// \brief Visibility between vehicles, N x N and indexed by
+    /// PairIndex(). A value of 1 means that the vehicles have line of sight.
+    private: std::vector<uint8_t> visibility;
+
+    /// \brief Logged comms status (a msgs::CommsStatus) for each pair of
+    /// robots, N x N and indexed by PairIndex().
+    private: std::vector<uint8_t> commsStatus;
 
-    /// \brief Visibility between all the robots.
-    private: msgs::VisibilityMap visibilityMsg;
+    /// \brief Number of VISIBLE entries in each row of commsStatus.
+    private: std::vector<unsigned int> visibleCounts;
 
-    /// \brief Data structure that allows us to index using a pair of addresses.
-    /// The returned value is a pointer to the visibilityMsgStatus used for
-    /// logging.
-    private: std::map<std::string,
-               std::map<std::string, swarm::msgs::NeighborEntry*>>
-                 visibilityMsgStatus;
+    /// \brief Probability of receiving a packet for each pair of robots,
+    /// N x N and indexed by PairIndex(). Negative if the second robot is
+    /// not a neighbor of the first one.
+    private: std::vector<double> neighborProbabilities;
 
-    /// \brief Pairs of addresses used to update the visibility.
-    private: std::vector<std::pair<std::string, std::string>> visibilityPairs;
+    /// \brief Pairs of robot indices used to update the visibility: the
+    /// broadphase candidates, with the lower index first.
+    private: std::vector<std::pair<unsigned int, unsigned int>>
+               visibilityPairs;
 
-    /// \brief Index used compute the next visibility pair.
+    /// \brief Visibility pairs to refresh during the comms cycle: the
+    /// number of cells moved (key) and index in visibilityPairs, sorted with
+    /// the pairs that moved the most first.
+    private: std::vector<std::pair<unsigned int, unsigned int>>
+               visibilitySchedule;
+
+    /// \brief Index used compute the next visibility pair, in
+    /// visibilitySchedule.
     private: unsigned int visibilityIndex = 0;
 
     /// \brief Number of visibility pairs computed per iteration.
     private: unsigned int visibilityUpdatesPerCycle;
 
+    /// \brief Size (m) of the cells used to measure the motion of the
+    /// robots: the step of the visibility table, if loaded.
+    private: double motionCellSize = 10.0;
+
+    /// \brief Cell of the first robot of each pair when the visibility of
+    /// the pair was last computed, N x N and indexed by PairIndex().
+    /// kNotRefreshed if the visibility must be computed again.
+    private: std::vector<uint64_t> refreshCells;
+
+    /// \brief Result of LinkGeometry() for a pair of robots, valid while
+    /// both robots stay in the same cells.
+    private: struct LinkCacheEntry
+    {
+      /// \brief Cell of the first robot.
+      uint64_t cellA = kNotRefreshed;
+
+      /// \brief Cell of the second robot.
+      uint64_t cellB = kNotRefreshed;
+
+      /// \brief Value returned by LinkGeometry().
+      int8_t prob = -1;
+
+      /// \brief Status set by LinkGeometry().
+      uint8_t status = msgs::CommsStatus::OBSTACLE;
+    };
+
+    /// \brief Link cache of each pair of robots, N x N and indexed by
+    /// PairIndex(). Only the random drops are drawn again on hits.
+    private: std::vector<LinkCacheEntry> linkCache;
+
+    /// \brief Cell of each robot when the broadphase was built.
+    private: std::vector<uint64_t> robotCells;
+
+    /// \brief Carrier of each robot, or -1, read from the pose snapshot. A
+    /// robot with a carrier, e.g. a docked rotor, is an alias: it is where
+    /// its carrier is, its visibility is copied from the carrier and its
+    /// links are in the cache entries of the carrier.
+    private: std::vector<int> carriers;
+
+    /// \brief Indices of the robots with a carrier.
+    private: std::vector<unsigned int> aliases;
+
+    /// \brief Value of refreshCells for the pairs never computed.
+    private: static const uint64_t kNotRefreshed = UINT64_MAX;
+
     /// \brief Number of neighbor updates computed per iteration.
     private: unsigned int neighborUpdatesPerCycle;
 
+    /// \brief Number of visibility pairs computed per iteration at full
+    /// fidelity.
+    private: unsigned int visibilityUpdatesFull = 0;
+
+    /// \brief Number of neighbor updates computed per iteration at full
+    /// fidelity.
+    private: unsigned int neighborUpdatesFull = 0;
+
+    /// \brief Whether the fidelity is adaptive.
+    private: bool adaptiveFidelity = false;
+
+    /// \brief Real time factor that the adaptive fidelity tries to keep.
+    private: double targetRealTimeFactor = 1.0;
+
+    /// \brief Lowest fraction of the visibility updates kept under load.
+    private: double visibilityFloor = 0.25;
+
+    /// \brief Lowest fraction of the neighbor updates kept under load.
+    private: double neighborFloor = 0.25;
+
+    /// \brief Current fraction of the budgets, before the floors.
+    private: double fidelityScale = 1.0;
+
+    /// \brief Wall time of the steps of the current adaptation window (s).
+    private: double fidelityWallTime = 0;
+
+    /// \brief Steps of the current adaptation window.
+    private: unsigned int fidelitySteps = 0;
+
+    /// \brief Changes of fidelity not logged yet.
+    private: std::vector<msgs::CommsFidelity> fidelityChanges;
+
     /// Index used to compute the next neighbor update.
     private: unsigned int neighborIndex = 0;
 
-    /// Vector containing all the addresses of the swarm.
+    /// Vector containing all the addresses of the swarm. The position of
+    /// an address is the index of the robot in the N x N arrays. The
+    /// addresses are sorted, like the keys of the swarm.
     private: std::vector<std::string> addresses;
 
+    /// \brief Members of the swarm, in the same order as addresses.
+    private: std::vector<SwarmMemberPtr> members;
+
+    /// \brief Whether each member is on an outage, indexed like members.
+    /// It mirrors SwarmMember::onOutage, so that the neighbor updates read
+    /// the flags of the candidates without following their pointers.
+    /// \sa SetOutage()
+    private: std::vector<uint8_t> outages;
+
+    /// \brief Poses of the members of the swarm, indexed like members.
+    private: PoseSnapshot *poses = PoseSnapshot::Instance();
+
+    /// \brief Trace of the stages of the evaluation, or nullptr.
+    private: StepTrace *trace = nullptr;
+
+    /// \brief Poses that the state is evaluated from: the shared snapshot,
+    /// or stagedPoses with <pipelined>.
+    private: const PoseSnapshot *statePoses = nullptr;
+
+    /// \brief Copy of the poses given to StartUpdate(), with <pipelined>.
+    private: PoseSnapshot stagedPoses;
+
+    /// \brief Simulation time of the poses that the state is evaluated
+    /// from.
+    private: gazebo::common::Time stateTime;
+
+    /// \brief Extra distance (m) added to <comms_distance_max> to select the
+    /// broadphase candidates. The broadphase is rebuilt before the end of
+    /// the cycle when a robot moves more than half of it, so that robots
+    /// getting within range of each other are never missed.
+    private: double broadphaseMargin = 25.0;
+
+    /// \brief Number of physics steps in a comms cycle.
+    private: unsigned int cycleSteps = 1;
+
+    /// \brief Number of physics steps until the next broadphase rebuild.
+    private: unsigned int broadphaseCountdown = 0;
+
+    /// \brief Position of each robot when the broadphase was built.
+    private: std::vector<ignition::math::Vector3d> positions;
+
+    /// \brief Grid cell of each robot (key) and robot index, sorted by key.
+    private: std::vector<std::pair<uint64_t, unsigned int>> cells;
+
+    /// \brief Broadphase candidates of each robot, sorted by index. The
+    /// relation is symmetric and each robot is a candidate of itself.
+    private: std::vector<std::vector<unsigned int>> candidates;
+
+    /// \brief Position of each robot at its last neighbor update.
+    /// \sa ReportedPositions()
+    private: std::vector<ignition::math::Vector3d> reportedPositions;
+
+    /// \brief Indices of the neighbors of each robot, sorted. Their
+    /// probabilities are in neighborProbabilities.
+    private: std::vector<std::vector<unsigned int>> neighborIds;
+
+    /// \brief Bitsets of the neighbors of each robot, neighborWords words
+    /// per robot, kept in sync with neighborIds.
+    /// \sa NeighborBits()
+    private: std::vector<uint64_t> neighborBits;
+
+    /// \brief Number of words of each bitset in neighborBits.
+    private: size_t neighborWords = 0;
+
+    /// \brief Version of the neighbors of each robot.
+    /// \sa NeighborsVersion()
+    private: std::vector<uint64_t> neighborVersions;
+
+    /// \brief Scratch vector reused by the broadphase, to avoid
+    /// allocations.
+    private: std::vector<unsigned int> scratch;
+
+    /// \brief Specialization of UpdateNeighborList() selected for the
+    /// parameters of the comms model.
+    private: NeighborListUpdater updateNeighborList = nullptr;
+
+    /// \brief Scratch vector of each thread updating the neighbors.
+    private: std::vector<std::vector<unsigned int>> neighborScratch;
+
+    /// \brief Threads updating the neighbors, if enabled with the
+    /// SWARM_COMMS_THREADS environment variable.
+    private: std::unique_ptr<WorkerPool> neighborPool;
+
+    /// \brief Whether the updates are pipelined with the rest of the step.
+    private: bool pipelined = false;
+
+    /// \brief Whether the state of the next Update() was started by
+    /// StartUpdate(), since the last Reset().
+    private: bool pipelineStarted = false;
+
+    /// \brief Whether the thread is evaluating an update.
+    private: bool pipelinePending = false;
+
+    /// \brief Whether the thread of the pipelined updates should stop.
+    private: bool pipelineStopping = false;
+
+    /// \brief Protects the flags of the pipelined updates.
+    private: mutable std::mutex pipelineMutex;
+
+    /// \brief Signals the thread that an update is pending.
+    private: std::condition_variable pipelineWake;
+
+    /// \brief Signals that the thread finished the pending update.
+    private: mutable std::condition_variable pipelineDone;
+
+    /// \brief Thread of the pipelined updates, started by the first
+    /// StartUpdate().
+    private: std::thread pipelineThread;
+
+    /// \brief Seed of the random streams of the comms model.
+    private: uint64_t seed = 0;
+
+    /// \brief Number of neighbor updates of each robot, used as the
+    /// position in its random streams.
+    private: std::vector<uint64_t> neighborUpdates;
+
     /// Update rate of the comms model.
     private: double updateRate = 0.5;
 
-    /// \brief Visibility lookup table
-    private: std::set<uint64_t> visibilityTable;
-
-    /// \brief Maximum Y value of the visibility table
-    private: uint64_t visibilityTableMaxY;
+    /// \brief Terrain information, used to select the visibility table.
+    private: Common common;
 
-    /// \brief The granularity of the visibility table
-    private: uint64_t visibilityTableStepSize;
+    /// \brief Visibility lookup table, mapped read-only from disk.
+    private: VisibilityLookup visibilityTable;
 
-    /// \brief Number of values in each row of the visibility table.
-    private: uint64_t visibilityTableRowSize;
+    /// \brief Optional obstacle layer of the visibility table, with the
+    /// trees and buildings between the cells.
+    private: VisibilityLookup obstacleTable;
 
-    /// \brief Bounding boxes for all the trees
-    private: std::vector<ignition::math::Box> trees;
+    /// \brief Coarser levels of the visibility table, from the finest, for
+    /// the pairs farther apart than the range of visibilityTable. Only the
+    /// levels needed by the maximum comms distance are loaded.
+    private: std::vector<std::unique_ptr<VisibilityLookup>> coarseTables;
 
-    /// \brief Bounding boxes for all the buildings
-    private: std::vector<ignition::math::Box> buildings;
+    /// \brief Index of the world, with the hierarchies of the bounding
+    /// boxes of the trees and the buildings.
+    private: std::shared_ptr<const SceneIndex> scene;
   };
 }  // namespace
 #endif
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file Connectivity.hh
+/// \brief Connectivity of the swarm, tracked as the neighbor lists change.
+
+#ifndef __SWARM_CONNECTIVITY_HH__
+#define __SWARM_CONNECTIVITY_HH__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "swarm/Helpers.hh"
+#include "swarm/MemoryAccounting.hh"
+
+namespace swarm
+{
+  /// \brief Summary of the connectivity of the swarm.
+  struct ConnectivityStats
+  {
+    /// \brief Number of connected components.
+    uint32_t components = 0;
+
+    /// \brief Number of members of the largest component.
+    uint32_t largestComponent = 0;
+
+    /// \brief Number of members without any link.
+    uint32_t isolated = 0;
+
+    /// \brief Number of members whose messages reach the root, directly or
+    /// relayed by other members. The root isn't counted.
+    uint32_t rootReachable = 0;
+
+    /// \brief Average number of hops from the members that reach the root.
+    double avgHops = 0;
+
+    /// \brief Maximum number of hops from a member that reaches the root.
+    uint32_t maxHops = 0;
+  };
+
+  /// \brief Tracks the connected components of the swarm as the neighbor
+  /// lists change, instead of deriving them from the visibility logs.
+  ///
+  /// Two members are linked when either is a neighbor of the other. The
+  /// components are kept in a union-find: a new link merges two components
+  /// as it appears, and a removed link, which may split a component,
+  /// only marks the components stale, so they are rebuilt from the links
+  /// at most once per Stats(). The reachability of the root (e.g. the BOO)
+  /// follows the direction of the links: a member reaches the root when
+  /// there is a path of neighbors from the member to the root, and its
+  /// hops are found with a breadth first search from the root over the
+  /// incoming links, only when some link changed.
+  class IGNITION_VISIBLE Connectivity
+  {
+    /// \brief Forget all the links.
+    /// \param[in] _size Number of members.
+    /// \param[in] _root Index of the root, or -1 if there is none.
+    public: void Reset(const size_t _size, const int _root);
+
+    /// \brief Set the neighbors of a member.
+    /// \param[in] _id Index of the member.
+    /// \param[in] _neighbors Indices of the members that receive the
+    /// messages of _id, sorted.
+    public: void SetNeighbors(const unsigned int _id,
+                              const std::vector<unsigned int> &_neighbors);
+
+    /// \brief Get the number of members.
+    /// \return The number of members.
+    public: size_t Size() const;
+
+    /// \brief Get the summary of the connectivity, rebuilding the
+    /// components or searching the hops only if needed.
+    /// \return The summary.
+    public: const ConnectivityStats &Stats();
+
+    /// \brief Whether two members are in the same component.
+    /// \param[in] _a Index of a member.
+    /// \param[in] _b Index of the other member.
+    /// \return True if they are connected.
+    public: bool Connected(const unsigned int _a, const unsigned int _b);
+
+    /// \brief Number of times the components were rebuilt, for tests and
+    /// profiling.
+    /// \return The number of rebuilds.
+    public: uint64_t Rebuilds() const;
+
+    /// \brief Report the memory of the links and the components.
+    /// \param[in,out] _report The report.
+    public: void OnMemory(MemoryReport &_report) const;
+
+    /// \brief Find the representative of the component of a member, with
+    /// path halving.
+    /// \param[in] _id Index of the member.
+    /// \return Index of the representative.
+    private: unsigned int Find(unsigned int _id);
+
+    /// \brief Merge the components of two members, by size.
+    /// \param[in] _a Index of a member.
+    /// \param[in] _b Index of the other member.
+    private: void Union(const unsigned int _a, const unsigned int _b);
+
+    /// \brief Rebuild the components from the links.
+    private: void Rebuild();
+
+    /// \brief Find the members that reach the root and their hops.
+    private: void SearchRoot();
+
+    /// \brief Outgoing links of each member, sorted.
+    private: std::vector<std::vector<unsigned int>> outgoing;
+
+    /// \brief Incoming links of each member, sorted.
+    private: std::vector<std::vector<unsigned int>> incoming;
+
+    /// \brief Parent of each member in the union-find.
+    private: std::vector<unsigned int> parents;
+
+    /// \brief Size of the component of each representative.
+    private: std::vector<uint32_t> sizes;
+
+    /// \brief Number of components of the union-find.
+    private: uint32_t components = 0;
+
+    /// \brief Index of the root, or -1.
+    private: int root = -1;
+
+    /// \brief Whether a link was removed since the last rebuild.
+    private: bool stale = false;
+
+    /// \brief Whether the hops to the root are up to date.
+    private: bool searched = false;
+
+    /// \brief Hops of each member to the root during the search.
+    private: std::vector<int32_t> hops;
+
+    /// \brief Queue of the search.
+    private: std::vector<unsigned int> queue;
+
+    /// \brief The last summary.
+    private: ConnectivityStats stats;
+
+    /// \brief Number of rebuilds.
+    private: uint64_t rebuilds = 0;
+  };
+}
+#endif
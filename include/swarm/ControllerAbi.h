@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file ControllerAbi.h
+/// \brief C interface between NativeControllerPlugin and the controller
+/// libraries that it loads.
+///
+/// A controller library only depends on this header, so it's built without
+/// Gazebo and can be replaced while the simulation runs. It exports
+/// swarm_controller(), which returns the functions of the controller. The
+/// functions get a SwarmRobotApi to act on their robot. Only the fields
+/// of the structures are appended in later versions of the interface, so a
+/// library built against an older header keeps working.
+
+#ifndef __SWARM_CONTROLLER_ABI_H__
+#define __SWARM_CONTROLLER_ABI_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// \brief Version of the interface described in this header.
+#define SWARM_CONTROLLER_ABI_VERSION 2
+
+/// \brief Name of the function exported by a controller library.
+#define SWARM_CONTROLLER_SYMBOL "swarm_controller"
+
+#if defined(_WIN32)
+  #define SWARM_CONTROLLER_EXPORT __declspec(dllexport)
+#else
+  #define SWARM_CONTROLLER_EXPORT __attribute__ ((visibility ("default")))
+#endif
+
+/// \brief Events awaited with SwarmRobotApi::wait, as
+/// RobotPlugin::WakeEvent.
+#define SWARM_WAKE_MESSAGE 1
+#define SWARM_WAKE_TIME 2
+#define SWARM_WAKE_NEIGHBORS 4
+#define SWARM_WAKE_SENSORS 8
+
+/// \brief A robot, opaque to the controller.
+typedef struct SwarmRobot SwarmRobot;
+
+/// \brief Functions to act on a robot, as in RobotPlugin. The functions
+/// that return an int return 1 on success and 0 otherwise.
+typedef struct SwarmRobotApi
+{
+  /// \brief SWARM_CONTROLLER_ABI_VERSION of the simulator.
+  uint32_t version;
+
+  /// \brief Address of the robot.
+  const char *(*host)(const SwarmRobot *_robot);
+
+  /// \brief Type of the robot, as RobotPlugin::VehicleType.
+  int (*type)(const SwarmRobot *_robot);
+
+  /// \brief Receive the messages sent to an address, the host or
+  /// "multicast", and a port, with on_message(). Binding the same
+  /// endpoint again, e.g. after a reload, succeeds without effect.
+  int (*bind)(SwarmRobot *_robot, const char *_address, uint32_t _port);
+
+  /// \brief Send a message to an address, "broadcast" or "multicast".
+  int (*send_to)(SwarmRobot *_robot, const void *_data, size_t _size,
+                 const char *_dstAddress, uint32_t _port);
+
+  /// \brief Set the linear velocity of the robot, in its frame.
+  int (*set_linear_velocity)(SwarmRobot *_robot, double _x, double _y,
+                             double _z);
+
+  /// \brief Set the angular velocity of the robot, in its frame.
+  int (*set_angular_velocity)(SwarmRobot *_robot, double _x, double _y,
+                              double _z);
+
+  /// \brief Position of the robot from its GPS.
+  int (*pose)(const SwarmRobot *_robot, double *_latitude,
+              double *_longitude, double *_altitude);
+
+  /// \brief Linear and angular velocities, and orientation as w, x, y, z,
+  /// from the IMU.
+  int (*imu)(const SwarmRobot *_robot, double _linVel[3],
+             double _angVel[3], double _orientation[4]);
+
+  /// \brief Bearing of the robot, in radians.
+  int (*bearing)(const SwarmRobot *_robot, double *_bearing);
+
+  /// \brief Addresses of the neighbors of the robot. Up to _capacity
+  /// addresses are stored, valid until the neighbors change.
+  /// \return The number of neighbors.
+  size_t (*neighbors)(const SwarmRobot *_robot, const char **_addresses,
+                      size_t _capacity);
+
+  /// \brief Remaining capacity of the battery (mAh).
+  double (*battery_capacity)(const SwarmRobot *_robot);
+
+  /// \brief Launch a rotorcraft from its vehicle.
+  void (*launch)(SwarmRobot *_robot);
+
+  /// \brief Dock a rotorcraft on a vehicle.
+  int (*dock)(SwarmRobot *_robot, const char *_vehicle);
+
+  /// \brief Skip the updates of the controller until one of the
+  /// SWARM_WAKE_* events of a mask happens: a message on _port, or any port
+  /// if negative, the simulation time _simTime (s), a change of the
+  /// neighbors or an update of the sensors. Since version 2.
+  void (*wait)(SwarmRobot *_robot, uint32_t _events, int _port,
+               double _simTime);
+
+  /// \brief Mask of the SWARM_WAKE_* events that resumed this update, 0 if
+  /// the controller wasn't waiting. Since version 2.
+  uint32_t (*woken_by)(const SwarmRobot *_robot);
+} SwarmRobotApi;
+
+/// \brief Functions of a controller. A controller instance is created for
+/// each robot, and destroyed on every reset of the world and before its
+/// library is reloaded.
+typedef struct SwarmController
+{
+  /// \brief SWARM_CONTROLLER_ABI_VERSION of the library.
+  uint32_t version;
+
+  /// \brief Create the controller of a robot. The robot and the API stay
+  /// valid until destroy().
+  /// \return The instance, passed to the other functions.
+  void *(*create)(const SwarmRobotApi *_api, SwarmRobot *_robot);
+
+  /// \brief Update the controller, with the simulation time (s).
+  void (*update)(void *_controller, double _simTime);
+
+  /// \brief Receive a message sent to an endpoint bound with bind(). The
+  /// pointers are only valid during the call. May be null.
+  void (*on_message)(void *_controller, const char *_srcAddress,
+                     const char *_dstAddress, uint32_t _dstPort,
+                     const void *_data, size_t _size);
+
+  /// \brief Destroy the controller.
+  void (*destroy)(void *_controller);
+} SwarmController;
+
+/// \brief Type of swarm_controller().
+typedef const SwarmController *(*SwarmControllerEntry)(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file FoundReport.hh
+/// \brief Binary encoding of the FOUND reports sent to the BOO.
+
+#ifndef __SWARM_FOUND_REPORT_HH__
+#define __SWARM_FOUND_REPORT_HH__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+
+namespace swarm
+{
+  /// \brief A binary FOUND report starts with this tag, and is followed by
+  /// <version><x><y><z><t>, where the version is a uint32 and the position
+  /// and the time are doubles. All the fields are little-endian. The BOO
+  /// recognizes the report by its size and tag, and the text report
+  /// "FOUND <x> <y> <z> <t>" is still accepted.
+  static const char kFoundReportTag[] = "SWFOUND";
+
+  /// \brief Size of the tag of a binary report (bytes), including its
+  /// terminating null.
+  static const size_t kFoundReportTagSize = sizeof(kFoundReportTag);
+
+  /// \brief Version of the layout of the binary reports.
+  static const uint32_t kFoundReportVersion = 1;
+
+  /// \brief Size of a binary report (bytes).
+  static const size_t kFoundReportSize = kFoundReportTagSize + 4 + 4 * 8;
+
+  /// \brief Append an unsigned integer in little-endian order.
+  /// \param[in] _value The value.
+  /// \param[in] _bytes Number of bytes of the value.
+  /// \param[out] _out The value is appended here.
+  inline void AppendLittleEndian(const uint64_t _value, const size_t _bytes,
+      std::string &_out)
+  {
+    for (size_t i = 0; i < _bytes; ++i)
+      _out.push_back(static_cast<char>((_value >> (8 * i)) & 0xff));
+  }
+
+  /// \brief Read an unsigned integer in little-endian order.
+  /// \param[in] _data The bytes of the value.
+  /// \param[in] _bytes Number of bytes of the value.
+  /// \return The value.
+  inline uint64_t ReadLittleEndian(const char *_data, const size_t _bytes)
+  {
+    uint64_t value = 0;
+    for (size_t i = 0; i < _bytes; ++i)
+    {
+      value |= static_cast<uint64_t>(static_cast<unsigned char>(_data[i]))
+        << (8 * i);
+    }
+    return value;
+  }
+
+  /// \brief Encode a FOUND report.
+  /// \param[in] _x X coordinate of the lost person (m).
+  /// \param[in] _y Y coordinate of the lost person (m).
+  /// \param[in] _z Z coordinate of the lost person (m).
+  /// \param[in] _time Simulation time at which the lost person was there.
+  /// \return The report, to be sent to the BOO.
+  inline std::string EncodeFoundReport(const double _x, const double _y,
+      const double _z, const double _time)
+  {
+    std::string out(kFoundReportTag, kFoundReportTagSize);
+    out.reserve(kFoundReportSize);
+    AppendLittleEndian(kFoundReportVersion, 4, out);
+    for (const double value : {_x, _y, _z, _time})
+    {
+      uint64_t bits;
+      std::memcpy(&bits, &value, sizeof(bits));
+      AppendLittleEndian(bits, 8, out);
+    }
+    return out;
+  }
+
+  /// \brief Whether a payload is a binary FOUND report, of any version.
+  /// \param[in] _data The payload.
+  /// \return True if the payload starts with the tag.
+  inline bool IsFoundReport(const std::string &_data)
+  {
+    return _data.size() >= kFoundReportTagSize &&
+      std::memcmp(_data.data(), kFoundReportTag, kFoundReportTagSize) == 0;
+  }
+
+  /// \brief Decode a binary FOUND report.
+  /// \param[in] _data The payload.
+  /// \param[out] _x X coordinate of the lost person (m).
+  /// \param[out] _y Y coordinate of the lost person (m).
+  /// \param[out] _z Z coordinate of the lost person (m).
+  /// \param[out] _time Simulation time at which the lost person was there.
+  /// \return False if the payload isn't a report of the current version.
+  inline bool DecodeFoundReport(const std::string &_data, double &_x,
+      double &_y, double &_z, double &_time)
+  {
+    if (_data.size() != kFoundReportSize || !IsFoundReport(_data))
+      return false;
+
+    const char *pos = _data.data() + kFoundReportTagSize;
+    if (ReadLittleEndian(pos, 4) != kFoundReportVersion)
+      return false;
+    pos += 4;
+
+    double *values[] = {&_x, &_y, &_z, &_time};
+    for (double *value : values)
+    {
+      const uint64_t bits = ReadLittleEndian(pos, 8);
+      std::memcpy(value, &bits, sizeof(bits));
+      pos += 8;
+    }
+    return true;
+  }
+}
+#endif
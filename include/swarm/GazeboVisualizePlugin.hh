@@ -14,12 +14,24 @@
  * limitations under the License.
  *
 */
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
+#include "gazebo/gazebo_config.h"
 #include "gazebo/common/Plugin.hh"
+#include "gazebo/msgs/msgs.hh"
 #include "gazebo/rendering/rendering.hh"
 #include "gazebo/util/system.hh"
 
+#include "swarm/Heightmap.hh"
 #include "swarm/LogParser.hh"
 
 namespace gazebo
@@ -52,20 +64,68 @@ namespace gazebo
 
     private: void OnWorldCreated();
 
+    /// \brief What is drawn for an entry of the broker, by model name. The
+    /// poses of the models are read when the frame is drawn.
+    private: struct Frame
+    {
+      /// \brief Source and destination of each message delivered.
+      std::vector<std::pair<std::string, std::string>> lines;
+
+      /// \brief Each vehicle followed by the vehicles it can see.
+      std::vector<std::vector<std::string>> circles;
+    };
+
     /// \brief Update the plugin.
     private: void Update();
 
+    /// \brief Reader thread: decode the entries of the broker ahead of the
+    /// playback, and seek when requested.
+    private: void ReadLog();
+
+    /// \brief Planner thread: prepare the frames of the decoded entries.
+    private: void PlanFrames();
+
+    /// \brief Prepare the frame of an entry.
+    /// \param[in] _logEntry Entry of the broker.
+    /// \param[out] _frame The frame.
+    private: static void PlanFrame(const swarm::msgs::LogEntry &_logEntry,
+                                   Frame &_frame);
+
+    /// \brief Seek the playback to a simulation time.
+    /// \param[in] _msg The time.
+    private: void OnSeek(ConstTimePtr &_msg);
+
+    /// \brief Get a model of the world, from a cache.
+    /// \param[in] _name Name of the model.
+    /// \return The model, or nullptr if not found.
+    private: physics::ModelPtr Model(const std::string &_name);
+
     /// \brief Create the lost person marker
     private: void CreateLostPersonMarker();
 
     /// \brief Helper function to visualize messages
-    private: void VisualizeMessages(swarm::msgs::LogEntry &_logEntry);
+    /// \param[in] _frame The frame drawn.
+    private: void VisualizeMessages(const Frame &_frame);
 
-    private: void VisualizeNeighbors(swarm::msgs::LogEntry &_logEntry);
+    /// \brief Draw a circle around each vehicle and its neighbors.
+    /// \param[in] _frame The frame drawn.
+    private: void VisualizeNeighbors(const Frame &_frame);
 
     /// \brief Visualize the search area.
     private: void VisualizeSearchArea();
 
+#if GAZEBO_MAJOR_VERSION >= 7
+    /// \brief Publish a marker, unless it's the same as the last one
+    /// published with its namespace and id.
+    /// \param[in] _msg The marker.
+    private: void PublishMarker(const gazebo::msgs::Marker &_msg);
+#endif
+
+    /// \brief Delete a marker, if it was published.
+    /// \param[in] _ns Namespace of the marker.
+    /// \param[in] _id Id of the marker.
+    private: void DeleteMarker(const std::string &_ns, const int _id);
+
     /// \brief Query the map to get the height and terrain type
     /// at a specific latitude and longitude.
     ///
@@ -122,6 +182,54 @@ namespace gazebo
     /// \brief Size of the terrain
     private: ignition::math::Vector3d terrainSize;
 
+    /// \brief Copy of the samples of the terrain, used by TerrainLookup().
+    private: swarm::Heightmap heightmap;
+
+    /// \brief Vertices of a circle of radius one, closed, used to draw the
+    /// neighbor circles.
+    private: std::vector<ignition::math::Vector2d> circleTemplate;
+
+    /// \brief Last marker published for each namespace and id, serialized,
+    /// so that the markers that didn't change aren't sent again.
+    private: std::map<std::string, std::string> lastMarkers;
+
+    /// \brief Models found by name.
+    private: std::map<std::string, physics::ModelPtr> models;
+
+    /// \brief Subscriber to the seek requests.
+    private: transport::SubscriberPtr seekSub;
+
+    /// \brief Entries decoded by the reader thread.
+    private: std::deque<swarm::msgs::LogEntry> entries;
+
+    /// \brief Frames prepared by the planner thread.
+    private: std::deque<Frame> frames;
+
+    /// \brief Protects the queues and the playback state.
+    private: std::mutex playbackMutex;
+
+    /// \brief Notified when the queues or the playback state change.
+    private: std::condition_variable playbackCond;
+
+    /// \brief Incremented on each seek, to drop the entries and the frames
+    /// in flight.
+    private: uint64_t playbackGeneration = 0;
+
+    /// \brief Time of the requested seek, NaN if none.
+    private: double seekTime = std::numeric_limits<double>::quiet_NaN();
+
+    /// \brief Whether the playback threads should exit.
+    private: bool stopPlayback = false;
+
+    /// \brief Frames consumed on each update. Only the last one is drawn.
+    private: unsigned int playbackSpeed = 1;
+
+    /// \brief Thread that decodes the log.
+    private: std::thread readerThread;
+
+    /// \brief Thread that prepares the frames.
+    private: std::thread plannerThread;
+
     /// \brief Min/max lat/long of search area.
     private: double searchMinLatitude, searchMaxLatitude,
                     searchMinLongitude, searchMaxLongitude;
@@ -0,0 +1,341 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file Heightmap.hh
+/// \brief Height samples of a terrain, with analytic line of sight tests.
+
+#ifndef __SWARM_HEIGHTMAP_HH__
+#define __SWARM_HEIGHTMAP_HH__
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+#include <ignition/math/Vector3.hh>
+
+#include "swarm/Helpers.hh"
+
+namespace swarm
+{
+  class TerrainTiles;
+
+  /// \brief Allocator of memory aligned to a cache line, for the vectors of
+  /// data that is looked up at random.
+  /// \tparam T Type of the elements.
+  template <typename T>
+  class CacheAlignedAllocator
+  {
+    /// \brief Type of the elements.
+    public: using value_type = T;
+
+    /// \brief Size of a cache line (bytes).
+    public: static const size_t kAlignment = 64;
+
+    /// \brief Class constructor.
+    public: CacheAlignedAllocator() = default;
+
+    /// \brief Conversion from an allocator of other type.
+    public: template <typename U>
+            CacheAlignedAllocator(const CacheAlignedAllocator<U> &)
+    {
+    }
+
+    /// \brief Allocate memory for some elements. The address returned by
+    /// operator new is stored right before the aligned block.
+    /// \param[in] _count Number of elements.
+    /// \return The aligned memory.
+    public: T *allocate(const size_t _count)
+    {
+      char *raw = static_cast<char *>(::operator new(
+            _count * sizeof(T) + kAlignment + sizeof(void *)));
+      const uintptr_t start = reinterpret_cast<uintptr_t>(raw) +
+        sizeof(void *);
+      char *aligned = raw + sizeof(void *) +
+        ((kAlignment - start % kAlignment) % kAlignment);
+      reinterpret_cast<void **>(aligned)[-1] = raw;
+      return reinterpret_cast<T *>(aligned);
+    }
+
+    /// \brief Release memory returned by allocate().
+    /// \param[in] _ptr The memory.
+    public: void deallocate(T *_ptr, const size_t)
+    {
+      ::operator delete(reinterpret_cast<void **>(_ptr)[-1]);
+    }
+  };
+
+  /// \brief All the allocators are interchangeable.
+  template <typename T, typename U>
+  bool operator==(const CacheAlignedAllocator<T> &,
+                  const CacheAlignedAllocator<U> &)
+  {
+    return true;
+  }
+
+  /// \brief All the allocators are interchangeable.
+  template <typename T, typename U>
+  bool operator!=(const CacheAlignedAllocator<T> &,
+                  const CacheAlignedAllocator<U> &)
+  {
+    return false;
+  }
+
+  /// \brief A copy of the height samples of a terrain, that can be queried
+  /// without the physics engine.
+  ///
+  /// The samples use the layout of gazebo::physics::HeightmapShape: sample
+  /// (x, y) is stored at y * columns + x, the first row is at the +Y border
+  /// of the terrain and the first column at the -X border. The terrain is
+  /// centered at the origin of the world.
+  ///
+  /// Line of sight tests walk the grid lines crossed by the segment (a DDA
+  /// traversal) and compare the height of the segment with the height of
+  /// the terrain on each crossed edge. The terrain is linear along the
+  /// edges of the grid, so the test only misses ridges along the diagonals
+  /// of the cells. All the methods are const and can be called from
+  /// multiple threads.
+  ///
+  /// The surface of the terrain follows the triangles rendered by Gazebo:
+  /// each cell is split along the diagonal from its first sample on the
+  /// even rows, and along the other diagonal on the odd rows. The plane
+  /// and the normal of both triangles of every cell are precomputed in a
+  /// cache aligned grid, so Lookup() is a few multiplications without
+  /// branches.
+  class IGNITION_VISIBLE Heightmap
+  {
+    /// \brief Class constructor.
+    public: Heightmap() = default;
+
+    /// \brief Class destructor.
+    public: virtual ~Heightmap() = default;
+
+    /// \brief Set the samples of the terrain.
+    /// \param[in] _columns Number of samples along X.
+    /// \param[in] _rows Number of samples along Y.
+    /// \param[in] _size Size of the terrain (m).
+    /// \param[in] _heights _columns * _rows heights (m).
+    /// \return True if the samples are valid.
+    public: bool Set(const int _columns, const int _rows,
+                     const ignition::math::Vector3d &_size,
+                     const std::vector<float> &_heights);
+
+    /// \brief Whether samples have been set.
+    /// \return True if the heightmap can be queried.
+    public: bool Valid() const;
+
+    /// \brief Get the height of the terrain at a coordinate, interpolated
+    /// between the four closest samples. Coordinates outside of the
+    /// terrain use the closest border.
+    /// \param[in] _x X world coordinate.
+    /// \param[in] _y Y world coordinate.
+    /// \return Height of the terrain, or 0 if the heightmap is not valid.
+    public: double HeightAt(const double _x, const double _y) const;
+
+    /// \brief Get the height of the surface of the terrain and its normal
+    /// at a coordinate. Coordinates outside of the terrain use the closest
+    /// border. Nothing is written if the heightmap is not valid.
+    /// \param[in] _x X world coordinate.
+    /// \param[in] _y Y world coordinate.
+    /// \param[out] _height Height of the surface (m).
+    /// \param[out] _norm Unit normal of the surface, pointing up.
+    public: void Lookup(const double _x, const double _y, double &_height,
+                        ignition::math::Vector3d &_norm) const;
+
+    /// \brief Get the height of the surface of the terrain and its normal
+    /// at several coordinates, eight at a time when AVX2 is available.
+    /// The results of the vector path are computed in single precision.
+    /// \param[in] _count Number of coordinates.
+    /// \param[in] _x X world coordinates.
+    /// \param[in] _y Y world coordinates.
+    /// \param[out] _height Height of the surface at each coordinate (m).
+    /// \param[out] _norm Normal of the surface at each coordinate. It can
+    /// be null if the normals aren't needed.
+    /// \sa Lookup(const double, const double, double &,
+    /// ignition::math::Vector3d &) const
+    public: void Lookup(const size_t _count, const double *_x,
+                        const double *_y, double *_height,
+                        ignition::math::Vector3d *_norm) const;
+
+    /// \brief Check if the segment between two points is above the
+    /// terrain.
+    /// \param[in] _p1 First point, in world coordinates.
+    /// \param[in] _p2 Second point, in world coordinates.
+    /// \return True if the terrain does not block the segment, or if the
+    /// heightmap is not valid.
+    public: bool LineOfSight(const ignition::math::Vector3d &_p1,
+                             const ignition::math::Vector3d &_p2) const;
+
+    /// \brief Get how far the terrain rises above the segment between
+    /// two points. Used to answer line of sight questions for endpoints at
+    /// other heights, see VisibilityLookup.
+    /// \param[in] _p1 First point, in world coordinates.
+    /// \param[in] _p2 Second point, in world coordinates.
+    /// \param[out] _t Position along the segment, from 0 at _p1 to 1 at
+    /// _p2, where the terrain rises the most above it.
+    /// \return Largest height of the terrain above the segment (m). It's
+    /// negative if the points have line of sight, and -infinity if the
+    /// segment doesn't cross any edge of the terrain.
+    public: double Clearance(const ignition::math::Vector3d &_p1,
+                             const ignition::math::Vector3d &_p2,
+                             double &_t) const;
+
+    /// \brief Number of samples along X.
+    /// \return Number of columns.
+    public: int Columns() const;
+
+    /// \brief Number of samples along Y.
+    /// \return Number of rows.
+    public: int Rows() const;
+
+    /// \brief Size of the terrain.
+    /// \return Size (m).
+    public: ignition::math::Vector3d Size() const;
+
+    /// \brief Heights of the samples, row by row from the +Y edge.
+    /// \return Columns() * Rows() heights (m).
+    public: const std::vector<float> &Samples() const;
+
+    /// \brief Hash of the samples. It combines the number of samples, the
+    /// size and every height using FNV-1a.
+    /// \return The hash, or 0 if the heightmap is not valid.
+    /// \sa Common::TerrainHash()
+    public: uint64_t Hash() const;
+
+    /// \brief Hash samples the way Hash() does, without building a
+    /// heightmap.
+    /// \param[in] _columns Number of samples along X.
+    /// \param[in] _rows Number of samples along Y.
+    /// \param[in] _size Size of the terrain (m).
+    /// \param[in] _heights _columns * _rows heights (m).
+    /// \return The hash.
+    public: static uint64_t HashSamples(const int _columns, const int _rows,
+                                        const ignition::math::Vector3d &_size,
+                                        const std::vector<float> &_heights);
+
+    /// \brief Memory held by the samples and the cells.
+    /// \return The memory (bytes).
+    public: size_t MemoryBytes() const;
+
+    /// \brief Get the largest height of the terrain above a segment.
+    /// \param[in] _p1 First point, in world coordinates.
+    /// \param[in] _p2 Second point, in world coordinates.
+    /// \param[in] _firstOnly Stop at the first crossing where the terrain is
+    /// above the segment.
+    /// \param[out] _t Position along the segment of the returned height.
+    /// \return Largest height of the terrain above the segment (m).
+    private: double Excess(const ignition::math::Vector3d &_p1,
+                           const ignition::math::Vector3d &_p2,
+                           const bool _firstOnly, double &_t) const;
+
+    /// \brief Check the heights of the terrain along the grid lines of one
+    /// axis that are crossed by a segment.
+    /// \param[in] _a0 Start of the segment along the axis (samples).
+    /// \param[in] _a1 End of the segment along the axis (samples).
+    /// \param[in] _b0 Start of the segment along the other axis (samples).
+    /// \param[in] _b1 End of the segment along the other axis (samples).
+    /// \param[in] _z0 Height at the start of the segment (m).
+    /// \param[in] _z1 Height at the end of the segment (m).
+    /// \param[in] _lineCount Number of grid lines along the axis.
+    /// \param[in] _lineLength Number of samples on each grid line.
+    /// \param[in] _lineStride Distance between two grid lines in the
+    /// sample array.
+    /// \param[in] _sampleStride Distance between two samples of a grid line
+    /// in the sample array.
+    /// \param[in] _firstOnly Stop at the first crossing where the terrain is
+    /// above the segment.
+    /// \param[out] _t Position along the segment of the returned height.
+    /// \return Largest height of the terrain above the segment at the
+    /// crossings (m), or -infinity if no grid line is crossed.
+    private: double Crossings(const double _a0, const double _a1,
+                              const double _b0, const double _b1,
+                              const double _z0, const double _z1,
+                              const int _lineCount, const int _lineLength,
+                              const int _lineStride,
+                              const int _sampleStride,
+                              const bool _firstOnly, double &_t) const;
+
+    /// \brief Build the triangles of the cells from the samples.
+    private: void BuildCells();
+
+    /// \brief The two triangles of a cell. The surface of triangle i is
+    /// offset[i] + fx * slopeX[i] + fy * slopeY[i], where fx and fy are the
+    /// position in the cell (samples). The layout is read by the vector
+    /// path of Lookup(), as 8 consecutive 32 bit words.
+    private: struct Cell
+    {
+      /// \brief Height at the first sample of the cell (m).
+      float offset[2];
+
+      /// \brief Slope along the columns (m per sample).
+      float slopeX[2];
+
+      /// \brief Slope along the rows (m per sample).
+      float slopeY[2];
+
+      /// \brief X and Y components of the unit normal, as 16 bit fixed
+      /// point values. Z is positive, and recovered from them.
+      uint32_t normal[2];
+    };
+
+    /// \brief Interpolate the height between the four samples of a cell.
+    /// \param[in] _row0 First sample of the cell.
+    /// \param[in] _row1 Sample below the first one.
+    /// \param[in] _fx Position in the cell along the columns (samples).
+    /// \param[in] _fy Position in the cell along the rows (samples).
+    /// \return The interpolated height (m).
+    private: static double Interpolate(const float *_row0,
+                                       const float *_row1, const double _fx,
+                                       const double _fy);
+
+    /// \brief Get the height and the normal of the surface of a cell.
+    /// \param[in] _cell The cell.
+    /// \param[in] _fx Position in the cell along the columns (samples).
+    /// \param[in] _fy Position in the cell along the rows (samples).
+    /// \param[in] _odd 1 if the cell is on an odd row.
+    /// \param[out] _height Height of the surface (m).
+    /// \param[out] _norm Unit normal of the surface, pointing up.
+    private: static void Surface(const Cell &_cell, const double _fx,
+                                 const double _fy, const int _odd,
+                                 double &_height,
+                                 ignition::math::Vector3d &_norm);
+
+    /// \brief Number of samples along X.
+    private: int columns = 0;
+
+    /// \brief Number of samples along Y.
+    private: int rows = 0;
+
+    /// \brief Size of the terrain.
+    private: ignition::math::Vector3d size;
+
+    /// \brief Distance between two samples along X and Y (m).
+    private: double scaleX = 0, scaleY = 0;
+
+    /// \brief Height samples.
+    private: std::vector<float> heights;
+
+    /// \brief Triangles of each cell, by row.
+    private: std::vector<Cell, CacheAlignedAllocator<Cell>> cells;
+
+    /// \brief Hash of the samples.
+    private: uint64_t hash = 0;
+
+    /// \brief Splits the samples and the cells into tiles.
+    friend class TerrainTiles;
+  };
+}
+#endif
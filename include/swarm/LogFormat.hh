@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file LogFormat.hh
+/// \brief Layout of the log files made of compressed blocks.
+
+#ifndef __SWARM_LOG_FORMAT_HH__
+#define __SWARM_LOG_FORMAT_HH__
+
+#include <zlib.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace swarm
+{
+  /// \brief A log in the block format starts with this magic number, then
+  /// the header as in the flat format: <size><log_header>. The entries
+  /// follow in blocks:
+  /// <compressed size><raw size><time><entries><compressed entries>,
+  /// where the sizes and the number of entries are uint32, the time of the
+  /// first entry is a double, and the raw entries are in the flat format:
+  /// <size0><log_entry0>...<sizeN><log_entryN>. Each block is compressed
+  /// on its own with zlib. The entries of a simulation time are all in the
+  /// same block. The log ends with an index of the blocks:
+  /// <blocks>{<offset><time><entries>}...<index offset><index magic>,
+  /// where the number of blocks and of entries are uint32 and the offsets
+  /// of the blocks and of the index are uint64. A log without the index,
+  /// e.g. because the simulation was killed, can still be read by walking
+  /// over the blocks.
+  static const char kLogBlockMagic[] = "SWLOG002";
+
+  /// \brief Magic number at the end of the index of a log in the block
+  /// format.
+  static const char kLogIndexMagic[] = "SWIDX002";
+
+  /// \brief Size of the magic numbers (bytes).
+  static const size_t kLogMagicSize = 8;
+
+  /// \brief Size of the header of a block (bytes).
+  static const size_t kLogBlockHeaderSize = 4 + 4 + 8 + 4;
+
+  /// \brief Position and contents of a block of a log in the block format.
+  class LogBlockInfo
+  {
+    /// \brief Offset of the block in the file (bytes).
+    public: uint64_t offset = 0;
+
+    /// \brief Simulation time of the first entry of the block.
+    public: double time = 0;
+
+    /// \brief Number of entries in the block.
+    public: uint32_t entries = 0;
+  };
+
+  /// \brief With SWARM_LOG_MIN_RECORDS=1, the scalars of the entries of a
+  /// minimal log are written next to it, e.g. into swarm.rec for swarm.log,
+  /// as fixed size records: <magic><record size><reserved><record0>...
+  /// <recordN>, where the sizes are uint32 and each record is a
+  /// LogMinRecord. The records are sorted by time, and the file is an array
+  /// of records after kLogRecordHeaderSize bytes, read with LogRecords. The
+  /// other fields of the entries, e.g. the reports of the BOO, stay in the
+  /// log.
+  static const char kLogRecordMagic[] = "SWREC001";
+
+  /// \brief Size of the header of the records (bytes).
+  static const size_t kLogRecordHeaderSize = 8 + 4 + 4;
+
+  /// \brief The scalars of a msgs::LogEntryMin, as stored in the records.
+  class LogMinRecord
+  {
+    /// \brief Simulation time.
+    public: double time = 0;
+
+    /// \brief Unicast messages sent.
+    public: int32_t numUnicast = 0;
+
+    /// \brief Broadcast messages sent.
+    public: int32_t numBroadcast = 0;
+
+    /// \brief Multicast messages sent.
+    public: int32_t numMulticast = 0;
+
+    /// \brief Bytes sent.
+    public: int32_t bytesSent = 0;
+
+    /// \brief Messages delivered.
+    public: int32_t msgsDelivered = 0;
+
+    /// \brief Potential recipients of the messages sent.
+    public: int32_t potentialRecipients = 0;
+
+    /// \brief Average number of neighbors.
+    public: double avgNeighbors = 0;
+  };
+
+  static_assert(sizeof(LogMinRecord) == 40,
+      "The layout of the records is part of the log format");
+
+  /// \brief Get the path of the records of a log.
+  /// \param[in] _logPath Path of the log, e.g. swarm.0001.log.
+  /// \return The path with the .rec extension, e.g. swarm.0001.rec.
+  inline std::string LogRecordPath(const std::string &_logPath)
+  {
+    const size_t slash = _logPath.rfind('/');
+    const size_t dot = _logPath.rfind('.');
+    if (dot == std::string::npos ||
+        (slash != std::string::npos && dot < slash))
+    {
+      return _logPath + ".rec";
+    }
+    return _logPath.substr(0, dot) + ".rec";
+  }
+
+  /// \brief Compress the entries of a block.
+  /// \param[in] _raw The entries, in the flat format.
+  /// \param[out] _compressed The compressed entries.
+  /// \return True if the entries were compressed.
+  inline bool CompressLogBlock(const std::string &_raw,
+      std::string &_compressed)
+  {
+    uLongf size = compressBound(_raw.size());
+    _compressed.resize(size);
+    if (compress2(reinterpret_cast<Bytef *>(&_compressed[0]), &size,
+          reinterpret_cast<const Bytef *>(_raw.data()), _raw.size(),
+          Z_BEST_SPEED) != Z_OK)
+    {
+      return false;
+    }
+    _compressed.resize(size);
+    return true;
+  }
+
+  /// \brief Decompress the entries of a block.
+  /// \param[in] _compressed The compressed entries.
+  /// \param[in] _compressedSize Size of the compressed entries (bytes).
+  /// \param[in] _rawSize Size of the entries once decompressed (bytes).
+  /// \param[out] _raw The entries, in the flat format.
+  /// \return True if the entries were decompressed.
+  inline bool DecompressLogBlock(const char *_compressed,
+      const size_t _compressedSize, const size_t _rawSize, std::string &_raw)
+  {
+    uLongf size = _rawSize;
+    _raw.resize(_rawSize);
+    if (_rawSize > 0 && uncompress(reinterpret_cast<Bytef *>(&_raw[0]),
+          &size, reinterpret_cast<const Bytef *>(_compressed),
+          _compressedSize) != Z_OK)
+    {
+      return false;
+    }
+    return size == _rawSize;
+  }
+}
+#endif
@@ -14,27 +14,100 @@
  * limitations under the License.
  *
 */
-
 /// \file LogParser.hh
 /// \brief Provide functions for parsing a Swarm log file.
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
 #include <cstdint>
-#include <fstream>
+#include <cstring>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <string>
 #include <vector>
+#include "msgs/log_entry_min.pb.h"
 #include "msgs/log_entry.pb.h"
 #include "msgs/log_header.pb.h"
+#include "swarm/LogFormat.hh"
 
 #ifndef __SWARM_LOGPARSER_HH__
 #define __SWARM_LOGPARSER_HH__
 
 namespace swarm
 {
+  /// \brief Selects the entries returned by LogParser::Entries() and
+  /// LogParser::Next(). The entries that don't match are skipped without
+  /// being parsed.
+  class IGNITION_VISIBLE LogFilter
+  {
+    /// \brief Whether an entry matches the filter.
+    /// \param[in] _id ID of the entry.
+    /// \param[in] _idSize Length of the ID.
+    /// \param[in] _time Simulation time of the entry.
+    /// \return True if the entry matches.
+    public: bool Matches(const char *_id, const size_t _idSize,
+                         const double _time) const
+    {
+      if (_time < this->minTime || _time > this->maxTime)
+        return false;
+      if (this->id.empty() && this->ids.empty())
+        return true;
+      if (!this->id.empty() && Equal(this->id, _id, _idSize))
+        return true;
+      for (auto const &other : this->ids)
+      {
+        if (Equal(other, _id, _idSize))
+          return true;
+      }
+      return false;
+    }
+
+    /// \brief Whether an ID is the one of an entry.
+    /// \param[in] _id The ID.
+    /// \param[in] _entryId ID of the entry.
+    /// \param[in] _entryIdSize Length of the ID of the entry.
+    /// \return True if both are equal.
+    private: static bool Equal(const std::string &_id, const char *_entryId,
+                               const size_t _entryIdSize)
+    {
+      return _id.size() == _entryIdSize &&
+        std::memcmp(_id.data(), _entryId, _entryIdSize) == 0;
+    }
+
+    /// \brief Only the entries with this ID, or all of them if empty and
+    /// ids is empty.
+    public: std::string id;
+
+    /// \brief Only the entries with one of these IDs, besides id.
+    public: std::vector<std::string> ids;
+
+    /// \brief Only the entries at or after this simulation time.
+    public: double minTime = -std::numeric_limits<double>::infinity();
+
+    /// \brief Only the entries at or before this simulation time.
+    public: double maxTime = std::numeric_limits<double>::infinity();
+  };
+
+  class LogEntryRange;
+
   /// \brief Parse a Swarm log file. Once you specify the full path to the log
   /// file in the constructor, you can call Next().
   /// Each Next() call returns the next LogEntry stored in the log file.
   /// When the log file reaches the end, Next() will return false.
+  /// The logs in the flat format and in the block format of LogFormat.hh
+  /// are both read. Seek() moves to a simulation time, with a binary search
+  /// over the index of the blocks in the block format.
+  ///
+  /// The file is mapped in memory, and the entries are parsed directly from
+  /// the mapping, or from the decompressed block. Entries() iterates over
+  /// the entries matching a filter, parsed into the same message:
+  ///
+  /// for (const msgs::LogEntry &entry : parser.Entries(filter))
+  ///   ...
   class IGNITION_VISIBLE LogParser
   {
     public: LogParser()
@@ -50,36 +123,168 @@ namespace swarm
       this->Load(_filename);
     };
 
+    /// \brief The parser owns the mapping of the file, so it's not copied.
+    public: LogParser(const LogParser &) = delete;
+
+    /// \brief The parser owns the mapping of the file, so it's not copied.
+    public: LogParser &operator=(const LogParser &) = delete;
+
     /// \brief Load a log file
     public: bool Load(const std::string &_filename)
     {
+      this->Unmap();
       this->filename = _filename;
-      this->input.open(this->filename, std::ios::in | std::ios::binary);
 
-      if (!this->input)
+      const int fd = open(this->filename.c_str(), O_RDONLY);
+      if (fd < 0)
       {
         std::cerr << this->filename << ": File not found" << std::endl;
         return false;
       }
 
-      // Read the header size.
-      int32_t size = 0;
-      if (!this->input.read(reinterpret_cast<char*>(&size), sizeof(size)))
+      struct stat info;
+      if (fstat(fd, &info) == 0 && info.st_size > 0)
+      {
+        void *addr = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd,
+            0);
+        if (addr != MAP_FAILED)
+        {
+          this->data = static_cast<const char *>(addr);
+          this->dataSize = info.st_size;
+          madvise(addr, this->dataSize, MADV_SEQUENTIAL);
+        }
+      }
+      close(fd);
+
+      if (!this->data)
+      {
+        std::cerr << this->filename << ": Unable to map the file"
+                  << std::endl;
         return false;
+      }
+
+      // A log in the flat format starts with the header.
+      size_t pos = 0;
+      this->compressed = this->dataSize >= kLogMagicSize &&
+        std::memcmp(this->data, kLogBlockMagic, kLogMagicSize) == 0;
+      if (this->compressed)
+        pos = kLogMagicSize;
 
       // Read the header.
-      std::vector<char> buffer;
-      buffer.resize(size);
-      this->input.read(reinterpret_cast<char*>(&buffer[0]), size);
-      if (!this->header.ParseFromArray(&buffer[0], size))
+      int32_t size = 0;
+      if (pos + sizeof(size) > this->dataSize)
+        return false;
+      std::memcpy(&size, this->data + pos, sizeof(size));
+      pos += sizeof(size);
+      if (size < 0 || pos + size > this->dataSize ||
+          !this->header.ParseFromArray(this->data + pos, size))
       {
         std::cerr << "Failed to parse header log file" << std::endl;
         return false;
       }
 
+      this->dataStart = pos + size;
+      this->filePos = this->dataStart;
+      if (this->compressed && !this->LoadIndex())
+        return false;
+
+      // Logs without the flag are minimal if the first field of the first
+      // entry is the time (msgs::LogEntryMin) instead of the ID.
+      this->minimal = this->header.minimal();
+      const char *record;
+      if (!this->header.has_minimal() && this->NextRecord(record, size))
+      {
+        this->minimal = size > 0 &&
+          record[0] == ((msgs::LogEntryMin::kTimeFieldNumber << 3) | 1);
+        size_t &recordPos = this->compressed ? this->blockPos : this->filePos;
+        recordPos -= sizeof(size) + size;
+      }
+
       this->isOpen = true;
       return true;
     }
+
+    /// \brief Whether the entries of the log are msgs::LogEntryMin, which
+    /// are read with NextSerialized().
+    /// \return True if the log is minimal.
+    public: bool Minimal() const
+    {
+      return this->minimal;
+    }
+
+    /// \brief Whether the log is in the block format.
+    /// \return True if the blocks of the log are compressed.
+    public: bool Compressed() const
+    {
+      return this->compressed;
+    }
+
+    /// \brief Get the blocks of a log in the block format.
+    /// \return The blocks, empty in the flat format.
+    public: const std::vector<LogBlockInfo> &Blocks() const
+    {
+      return this->blocks;
+    }
+
+    /// \brief Move to the first entry at or after a simulation time, so the
+    /// next call to Next() returns it. In the block format, only the block
+    /// containing the entry is decompressed. In the flat format, the entries
+    /// are read from the beginning of the log. The entries before the time
+    /// are not parsed.
+    /// \param[in] _time The simulation time.
+    /// \return True if there is an entry at or after the time, or false
+    /// otherwise, in which case Next() returns false.
+    public: bool Seek(const double _time)
+    {
+      if (!this->isOpen)
+      {
+        std::cerr << "LogParser::Seek() error: File [" << this->filename
+                  << "] is not open" << std::endl;
+        return false;
+      }
+
+      // The visibility is unknown until the next keyframe.
+      this->visibilityAddresses.clear();
+      this->visibilityStatus.clear();
+
+      size_t index = 0;
+      if (this->compressed)
+      {
+        // The entries of a simulation time are never split between blocks,
+        // so the entry is in the last block starting before the time, or in
+        // the next one.
+        auto it = std::lower_bound(this->blocks.begin(), this->blocks.end(),
+            _time, [](const LogBlockInfo &_info, const double _t)
+            {
+              return _info.time < _t;
+            });
+        index = it - this->blocks.begin();
+        if (index > 0)
+          --index;
+        if (index >= this->blocks.size() || !this->ReadBlock(index))
+          return false;
+      }
+      else
+        this->filePos = this->dataStart;
+
+      const char *record;
+      int32_t size;
+      EntryPrefix prefix;
+      while (this->NextRecord(record, size))
+      {
+        this->ReadPrefix(record, size, prefix);
+        if (prefix.time >= _time)
+        {
+          // Rewind to the entry, in the current block.
+          size_t &pos = this->compressed ? this->blockPos : this->filePos;
+          pos -= sizeof(size) + size;
+          return true;
+        }
+        this->SkipRecord(prefix);
+      }
+      return false;
+    }
+
     /// \brief Get the header of the log file.
     /// \param[out] _header Copy of the header.
     /// \return True if the operation succeed or false otherwise. E.g.: The
@@ -108,24 +313,492 @@ namespace swarm
         return false;
       }
 
-      // Read the size of the next protobuf message.
-      int32_t size = 0;
-      if (!this->input.read(reinterpret_cast<char*>(&size), sizeof(size)))
+      const char *record;
+      int32_t size;
+      if (!this->NextRecord(record, size))
         return false;
+      return this->Parse(record, size, _entry);
+    }
 
-      std::vector<char> buffer;
-      buffer.resize(size);
-      this->input.read(reinterpret_cast<char*>(&buffer[0]), size);
-      if (!_entry.ParseFromArray(&buffer[0], size))
+    /// \brief Get the next entry of the log matching a filter. The entries
+    /// that don't match are skipped without being parsed.
+    /// \param[out] _entry Next matching entry parsed from the log.
+    /// \param[in] _filter The filter.
+    /// \return True when the next matching entry has been succesfully parsed
+    /// or false otherwise (e.g.: when there are no more entries in the log,
+    /// or when the entries are after the time window of the filter).
+    public: bool Next(msgs::LogEntry &_entry, const LogFilter &_filter)
+    {
+      if (!this->isOpen)
       {
-        std::cerr << "Failed to parse log file" << std::endl;
+        std::cerr << "LogParser::Next() error: File [" << this->filename
+                  << "] is not open" << std::endl;
+        return false;
+      }
+
+      const char *record;
+      int32_t size;
+      EntryPrefix prefix;
+      while (this->NextRecord(record, size))
+      {
+        this->ReadPrefix(record, size, prefix);
+
+        // The entries are sorted by time.
+        if (prefix.time > _filter.maxTime)
+          return false;
+
+        if (_filter.Matches(prefix.id, prefix.idSize, prefix.time))
+          return this->Parse(record, size, _entry);
+        this->SkipRecord(prefix);
+      }
+      return false;
+    }
+
+    /// \brief Get the next entry of the log, without parsing it, e.g. to
+    /// parse a minimal log into msgs::LogEntryMin. The changes of the
+    /// visibility of the entry are not tracked by Visibility().
+    /// \param[out] _record The serialized entry, valid until the next call
+    /// to the parser.
+    /// \param[out] _size Size of the serialized entry.
+    /// \return True if there is a next entry.
+    public: bool NextSerialized(const char *&_record, int32_t &_size)
+    {
+      if (!this->isOpen)
+      {
+        std::cerr << "LogParser::NextSerialized() error: File ["
+                  << this->filename << "] is not open" << std::endl;
+        return false;
+      }
+      return this->NextRecord(_record, _size);
+    }
+
+    /// \brief Get the next entry of the log matching a filter, without
+    /// parsing it, e.g. to copy it into another log. The entries that don't
+    /// match are skipped. Unlike NextSerialized(), the changes of the
+    /// visibility of all the entries are tracked, so VisibilityKeyframe()
+    /// gives the visibility after the returned entry.
+    /// \param[out] _record The serialized entry, valid until the next call
+    /// to the parser.
+    /// \param[out] _size Size of the serialized entry.
+    /// \param[in] _filter The filter.
+    /// \param[out] _skippedDelta Whether an entry skipped since the previous
+    /// call changed the visibility.
+    /// \return True if there is a next matching entry.
+    public: bool NextSerialized(const char *&_record, int32_t &_size,
+                                const LogFilter &_filter, bool &_skippedDelta)
+    {
+      _skippedDelta = false;
+      if (!this->isOpen)
+      {
+        std::cerr << "LogParser::NextSerialized() error: File ["
+                  << this->filename << "] is not open" << std::endl;
+        return false;
+      }
+
+      EntryPrefix prefix;
+      while (this->NextRecord(_record, _size))
+      {
+        this->ReadPrefix(_record, _size, prefix);
+
+        // The entries are sorted by time.
+        if (prefix.time > _filter.maxTime)
+          return false;
+
+        this->SkipRecord(prefix);
+        if (_filter.Matches(prefix.id, prefix.idSize, prefix.time))
+          return true;
+        _skippedDelta = _skippedDelta || prefix.delta;
+      }
+      return false;
+    }
+
+    /// \brief Get the current visibility as a keyframe, e.g. to start the
+    /// changes of the visibility of a slice of the log.
+    /// \param[out] _keyframe The addresses and the status of every pair.
+    /// \return True if the keyframe was filled, or false if no keyframe was
+    /// read since the log was opened or since the last Seek().
+    public: bool VisibilityKeyframe(msgs::VisibilityDelta &_keyframe) const
+    {
+      _keyframe.Clear();
+      if (this->visibilityStatus.empty())
         return false;
+
+      for (auto const &address : this->visibilityAddresses)
+        _keyframe.add_address(address);
+      _keyframe.set_status(this->visibilityStatus);
+      return true;
+    }
+
+    /// \brief Iterate over the entries matching a filter, from the current
+    /// position of the parser. The entries are parsed into a message owned
+    /// by the range, and overwritten by the next one.
+    /// \param[in] _filter The filter.
+    /// \return The range of entries.
+    public: LogEntryRange Entries(const LogFilter &_filter = LogFilter());
+
+    /// \brief Get the full visibility map of an entry, logged as is or as
+    /// the changes since the previous entry.
+    /// \param[in] _entry The last entry returned by Next().
+    /// \param[out] _map The visibility among the robots.
+    /// \return True if the map was filled, or false if the entry has no
+    /// visibility, or if no keyframe was read since the log was opened or
+    /// since the last Seek().
+    public: bool Visibility(const msgs::LogEntry &_entry,
+                            msgs::VisibilityMap &_map) const
+    {
+      if (_entry.has_visibility())
+      {
+        if (&_map != &_entry.visibility())
+          _map.CopyFrom(_entry.visibility());
+        return true;
+      }
+
+      if (!_entry.has_visibility_delta() || this->visibilityStatus.empty())
+        return false;
+
+      const size_t n = this->visibilityAddresses.size();
+      _map.Clear();
+      _map.mutable_row()->Reserve(n);
+      for (size_t a = 0; a < n; ++a)
+      {
+        auto row = _map.add_row();
+        row->set_src(this->visibilityAddresses[a]);
+        row->mutable_entry()->Reserve(n);
+
+        for (size_t b = 0; b < n; ++b)
+        {
+          auto entry = row->add_entry();
+          entry->set_dst(this->visibilityAddresses[b]);
+          entry->set_status(static_cast<msgs::CommsStatus>(
+                this->visibilityStatus[a * n + b]));
+        }
       }
       return true;
     }
 
     /// \brief Destructor.
-    public: virtual ~LogParser() = default;
+    public: virtual ~LogParser()
+    {
+      this->Unmap();
+    }
+
+    /// \brief The fields of an entry read without parsing it.
+    private: struct EntryPrefix
+    {
+      /// \brief ID of the entry, inside the record.
+      const char *id = nullptr;
+
+      /// \brief Length of the ID.
+      size_t idSize = 0;
+
+      /// \brief Simulation time of the entry.
+      double time = 0;
+
+      /// \brief Changes of the visibility of the entry, inside the record,
+      /// or null.
+      const char *delta = nullptr;
+
+      /// \brief Size of the changes of the visibility.
+      size_t deltaSize = 0;
+    };
+
+    /// \brief Get the next record of the log, decompressing the next block
+    /// if needed.
+    /// \param[out] _record The serialized entry.
+    /// \param[out] _size Size of the serialized entry.
+    /// \return True if there is a record.
+    private: bool NextRecord(const char *&_record, int32_t &_size)
+    {
+      const char *buffer = this->data;
+      size_t bufferSize = this->dataSize;
+      size_t *pos = &this->filePos;
+      if (this->compressed)
+      {
+        // Decompress the next block once this one is read.
+        while (this->blockPos >= this->block.size())
+        {
+          if (this->nextBlock >= this->blocks.size() ||
+              !this->ReadBlock(this->nextBlock))
+          {
+            return false;
+          }
+        }
+        buffer = this->block.data();
+        bufferSize = this->block.size();
+        pos = &this->blockPos;
+      }
+
+      if (*pos + sizeof(_size) > bufferSize)
+        return false;
+      std::memcpy(&_size, buffer + *pos, sizeof(_size));
+      if (_size < 0 || *pos + sizeof(_size) + _size > bufferSize)
+      {
+        std::cerr << "Failed to parse log file" << std::endl;
+        return false;
+      }
+
+      _record = buffer + *pos + sizeof(_size);
+      *pos += sizeof(_size) + _size;
+      return true;
+    }
+
+    /// \brief Parse a record into an entry.
+    /// \param[in] _record The serialized entry.
+    /// \param[in] _size Size of the serialized entry.
+    /// \param[out] _entry The entry.
+    /// \return True if the entry was parsed.
+    private: bool Parse(const char *_record, const int32_t _size,
+                        msgs::LogEntry &_entry)
+    {
+      if (!_entry.ParseFromArray(_record, _size))
+      {
+        std::cerr << "Failed to parse log file" << std::endl;
+        return false;
+      }
+
+      if (_entry.has_visibility_delta())
+        this->ApplyVisibilityDelta(_entry.visibility_delta());
+      return true;
+    }
+
+    /// \brief Skip a record, only keeping its changes of the visibility,
+    /// which are parsed on their own.
+    /// \param[in] _prefix The fields of the record.
+    private: void SkipRecord(const EntryPrefix &_prefix)
+    {
+      if (!_prefix.delta)
+        return;
+
+      if (this->skippedDelta.ParseFromArray(_prefix.delta, _prefix.deltaSize))
+        this->ApplyVisibilityDelta(this->skippedDelta);
+      else
+      {
+        this->visibilityAddresses.clear();
+        this->visibilityStatus.clear();
+      }
+    }
+
+    /// \brief Read the ID, the time and the changes of the visibility of a
+    /// record, walking over its top-level fields.
+    /// \param[in] _record The serialized entry.
+    /// \param[in] _size Size of the serialized entry.
+    /// \param[out] _prefix The fields.
+    private: static void ReadPrefix(const char *_record, const int32_t _size,
+                                    EntryPrefix &_prefix)
+    {
+      _prefix = EntryPrefix();
+      const uint8_t *p = reinterpret_cast<const uint8_t *>(_record);
+      const uint8_t *end = p + _size;
+      uint64_t tag;
+      while (ReadVarint(p, end, tag))
+      {
+        const uint64_t field = tag >> 3;
+        uint64_t length = 0;
+        switch (tag & 7)
+        {
+          case 0:
+            if (!ReadVarint(p, end, length))
+              return;
+            break;
+          case 1:
+            if (end - p < 8)
+              return;
+            if (field == msgs::LogEntry::kTimeFieldNumber)
+              std::memcpy(&_prefix.time, p, sizeof(_prefix.time));
+            p += 8;
+            break;
+          case 2:
+            if (!ReadVarint(p, end, length) ||
+                length > static_cast<uint64_t>(end - p))
+            {
+              return;
+            }
+            if (field == msgs::LogEntry::kIdFieldNumber)
+            {
+              _prefix.id = reinterpret_cast<const char *>(p);
+              _prefix.idSize = length;
+            }
+            else if (field == msgs::LogEntry::kVisibilityDeltaFieldNumber)
+            {
+              _prefix.delta = reinterpret_cast<const char *>(p);
+              _prefix.deltaSize = length;
+            }
+            p += length;
+            break;
+          case 5:
+            if (end - p < 4)
+              return;
+            p += 4;
+            break;
+          default:
+            return;
+        }
+      }
+    }
+
+    /// \brief Read a varint of a serialized message.
+    /// \param[in,out] _p Position in the message, moved after the varint.
+    /// \param[in] _end End of the message.
+    /// \param[out] _value The value.
+    /// \return True if the varint was read.
+    private: static bool ReadVarint(const uint8_t *&_p, const uint8_t *_end,
+                                    uint64_t &_value)
+    {
+      _value = 0;
+      for (int shift = 0; shift < 64 && _p < _end; shift += 7)
+      {
+        const uint8_t byte = *_p++;
+        _value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+          return true;
+      }
+      return false;
+    }
+
+    /// \brief Update the visibility with the changes of an entry.
+    /// \param[in] _delta The changes, or a keyframe.
+    private: void ApplyVisibilityDelta(const msgs::VisibilityDelta &_delta)
+    {
+      if (_delta.address_size() > 0)
+      {
+        const size_t n = _delta.address_size();
+        this->visibilityAddresses.assign(_delta.address().begin(),
+            _delta.address().end());
+        this->visibilityStatus = _delta.status();
+        if (this->visibilityStatus.size() != n * n)
+        {
+          std::cerr << "Invalid visibility keyframe in the log" << std::endl;
+          this->visibilityAddresses.clear();
+          this->visibilityStatus.clear();
+        }
+        return;
+      }
+
+      const int count =
+        std::min(_delta.changed_pair_size(), _delta.changed_status_size());
+      for (int i = 0; i < count && !this->visibilityStatus.empty(); ++i)
+      {
+        const uint32_t pair = _delta.changed_pair(i);
+        if (pair < this->visibilityStatus.size())
+          this->visibilityStatus[pair] = static_cast<char>(
+              _delta.changed_status(i));
+      }
+    }
+
+    /// \brief Load the index at the end of a log in the block format. When
+    /// the log has no index, e.g. because the simulation was killed, walk
+    /// over the headers of the blocks instead.
+    /// \return True if the blocks were found.
+    private: bool LoadIndex()
+    {
+      this->blocks.clear();
+
+      // Read the offset of the index and its magic number.
+      uint64_t indexOffset = 0;
+      const size_t tail = sizeof(indexOffset) + kLogMagicSize;
+      if (this->dataSize >= this->dataStart + tail &&
+          std::memcmp(this->data + this->dataSize - kLogMagicSize,
+            kLogIndexMagic, kLogMagicSize) == 0)
+      {
+        std::memcpy(&indexOffset, this->data + this->dataSize - tail,
+            sizeof(indexOffset));
+        uint32_t count = 0;
+        const size_t entrySize = sizeof(LogBlockInfo::offset) +
+          sizeof(LogBlockInfo::time) + sizeof(LogBlockInfo::entries);
+        if (indexOffset + sizeof(count) > this->dataSize - tail)
+        {
+          std::cerr << "Failed to read the index of the log file"
+                    << std::endl;
+          return false;
+        }
+        const char *p = this->data + indexOffset;
+        std::memcpy(&count, p, sizeof(count));
+        p += sizeof(count);
+        if (indexOffset + sizeof(count) + count * entrySize >
+            this->dataSize - tail)
+        {
+          std::cerr << "Failed to read the index of the log file"
+                    << std::endl;
+          return false;
+        }
+
+        this->blocks.resize(count);
+        for (auto &info : this->blocks)
+        {
+          std::memcpy(&info.offset, p, sizeof(info.offset));
+          p += sizeof(info.offset);
+          std::memcpy(&info.time, p, sizeof(info.time));
+          p += sizeof(info.time);
+          std::memcpy(&info.entries, p, sizeof(info.entries));
+          p += sizeof(info.entries);
+        }
+        return true;
+      }
+
+      // Walk over the complete blocks.
+      size_t pos = this->dataStart;
+      while (pos + kLogBlockHeaderSize <= this->dataSize)
+      {
+        LogBlockInfo info;
+        info.offset = pos;
+        uint32_t compressedSize = 0;
+        const char *p = this->data + pos;
+        std::memcpy(&compressedSize, p, sizeof(compressedSize));
+        std::memcpy(&info.time, p + 2 * sizeof(uint32_t), sizeof(info.time));
+        std::memcpy(&info.entries, p + 2 * sizeof(uint32_t) + sizeof(double),
+            sizeof(info.entries));
+        if (pos + kLogBlockHeaderSize + compressedSize > this->dataSize)
+          break;
+        this->blocks.push_back(info);
+        pos += kLogBlockHeaderSize + compressedSize;
+      }
+      return true;
+    }
+
+    /// \brief Decompress a block of a log in the block format.
+    /// \param[in] _index Position of the block in the index.
+    /// \return True if the block was decompressed.
+    private: bool ReadBlock(const size_t _index)
+    {
+      this->block.clear();
+      this->blockPos = 0;
+      this->nextBlock = _index + 1;
+
+      const uint64_t offset = this->blocks[_index].offset;
+      uint32_t compressedSize = 0;
+      uint32_t rawSize = 0;
+      if (offset + kLogBlockHeaderSize > this->dataSize)
+        return false;
+      std::memcpy(&compressedSize, this->data + offset,
+          sizeof(compressedSize));
+      std::memcpy(&rawSize, this->data + offset + sizeof(compressedSize),
+          sizeof(rawSize));
+      if (offset + kLogBlockHeaderSize + compressedSize > this->dataSize ||
+          !DecompressLogBlock(this->data + offset + kLogBlockHeaderSize,
+            compressedSize, rawSize, this->block))
+      {
+        std::cerr << "Failed to decompress log block" << std::endl;
+        this->block.clear();
+        return false;
+      }
+      return true;
+    }
+
+    /// \brief Unmap the log file.
+    private: void Unmap()
+    {
+      if (this->data)
+        munmap(const_cast<char *>(this->data), this->dataSize);
+      this->data = nullptr;
+      this->dataSize = 0;
+      this->isOpen = false;
+      this->blocks.clear();
+      this->block.clear();
+      this->blockPos = 0;
+      this->nextBlock = 0;
+      this->visibilityAddresses.clear();
+      this->visibilityStatus.clear();
+    }
 
     /// \brief Full path to the log.
     private: std::string filename;
@@ -133,11 +806,165 @@ namespace swarm
     /// \brief True if the file is currently opened.
     private: bool isOpen;
 
-    /// \brief Stream object to operate on a log file.
-    private: std::fstream input;
+    /// \brief The log file, mapped in memory.
+    private: const char *data = nullptr;
+
+    /// \brief Size of the log file (bytes).
+    private: size_t dataSize = 0;
 
     /// \brief Log header.
     private: msgs::LogHeader header;
+
+    /// \brief Offset of the first entry or block in the file.
+    private: size_t dataStart = 0;
+
+    /// \brief Offset of the next entry in the file, in the flat format.
+    private: size_t filePos = 0;
+
+    /// \brief Whether the log is in the block format.
+    private: bool compressed = false;
+
+    /// \brief Whether the entries are msgs::LogEntryMin.
+    private: bool minimal = false;
+
+    /// \brief Blocks of a log in the block format.
+    private: std::vector<LogBlockInfo> blocks;
+
+    /// \brief Entries of the current block.
+    private: std::string block;
+
+    /// \brief Offset of the next entry in the current block.
+    private: size_t blockPos = 0;
+
+    /// \brief Position of the block after the current one in the index.
+    private: size_t nextBlock = 0;
+
+    /// \brief Addresses of the robots in the last visibility keyframe.
+    private: std::vector<std::string> visibilityAddresses;
+
+    /// \brief Current comms status of each pair of robots, one byte per
+    /// pair, or empty until a visibility keyframe is read.
+    private: std::string visibilityStatus;
+
+    /// \brief Changes of the visibility of the last skipped entry.
+    private: msgs::VisibilityDelta skippedDelta;
+  };
+
+  /// \brief Iterator over the entries of a LogEntryRange.
+  class IGNITION_VISIBLE LogEntryIterator
+    : public std::iterator<std::input_iterator_tag, const msgs::LogEntry>
+  {
+    /// \brief Class constructor.
+    /// \param[in] _range The range, or null at the end.
+    public: explicit LogEntryIterator(LogEntryRange *_range)
+      : range(_range)
+    {
+    }
+
+    /// \brief Get the current entry.
+    /// \return The entry.
+    public: const msgs::LogEntry &operator*() const;
+
+    /// \brief Get the current entry.
+    /// \return Pointer to the entry.
+    public: const msgs::LogEntry *operator->() const
+    {
+      return &**this;
+    }
+
+    /// \brief Move to the next matching entry.
+    /// \return The iterator.
+    public: LogEntryIterator &operator++();
+
+    /// \brief Whether both iterators are at the same position.
+    /// \param[in] _other The other iterator.
+    /// \return True if both are at the end, or in the same range.
+    public: bool operator==(const LogEntryIterator &_other) const
+    {
+      return this->range == _other.range;
+    }
+
+    /// \brief Whether the iterators are at different positions.
+    /// \param[in] _other The other iterator.
+    /// \return True if they are not equal.
+    public: bool operator!=(const LogEntryIterator &_other) const
+    {
+      return !(*this == _other);
+    }
+
+    /// \brief The range, or null at the end.
+    private: LogEntryRange *range;
+  };
+
+  /// \brief The entries of a log matching a filter, returned by
+  /// LogParser::Entries(). Only one pass is possible, since iterating moves
+  /// the parser.
+  class IGNITION_VISIBLE LogEntryRange
+  {
+    /// \brief Class constructor.
+    /// \param[in] _parser The parser.
+    /// \param[in] _filter The filter.
+    public: LogEntryRange(LogParser *_parser, const LogFilter &_filter)
+      : parser(_parser), filter(_filter)
+    {
+    }
+
+    /// \brief Parse the first matching entry.
+    /// \return Iterator to the entry, or the end.
+    public: LogEntryIterator begin()
+    {
+      return this->Advance() ? LogEntryIterator(this) : this->end();
+    }
+
+    /// \brief Get the end of the range.
+    /// \return The end.
+    public: LogEntryIterator end()
+    {
+      return LogEntryIterator(nullptr);
+    }
+
+    /// \brief Parse the next matching entry.
+    /// \return True if there is one.
+    public: bool Advance()
+    {
+      return this->parser->Next(this->entry, this->filter);
+    }
+
+    /// \brief Get the current entry.
+    /// \return The entry.
+    public: const msgs::LogEntry &Entry() const
+    {
+      return this->entry;
+    }
+
+    /// \brief The parser.
+    private: LogParser *parser;
+
+    /// \brief The filter.
+    private: LogFilter filter;
+
+    /// \brief The current entry, reused by all the entries.
+    private: msgs::LogEntry entry;
   };
+
+  //////////////////////////////////////////////////
+  inline LogEntryRange LogParser::Entries(const LogFilter &_filter)
+  {
+    return LogEntryRange(this, _filter);
+  }
+
+  //////////////////////////////////////////////////
+  inline const msgs::LogEntry &LogEntryIterator::operator*() const
+  {
+    return this->range->Entry();
+  }
+
+  //////////////////////////////////////////////////
+  inline LogEntryIterator &LogEntryIterator::operator++()
+  {
+    if (!this->range->Advance())
+      this->range = nullptr;
+    return *this;
+  }
 }  // namespace
 #endif
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef __SWARM_LOG_RECORDS_HH__
+#define __SWARM_LOG_RECORDS_HH__
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "swarm/LogFormat.hh"
+
+namespace swarm
+{
+  /// \brief Read only access to the fixed size records of a minimal log (see
+  /// LogFormat.hh). The file is mapped in memory, and the records are used
+  /// in place, without being parsed:
+  ///
+  /// LogRecords records(LogRecordPath("swarm.log"));
+  /// for (size_t i = records.Find(100); i < records.Size(); ++i)
+  ///   ... records[i].bytesSent ...
+  class IGNITION_VISIBLE LogRecords
+  {
+    public: LogRecords() = default;
+
+    /// \brief Class constructor.
+    /// \param[in] _filename Full path to the records.
+    public: explicit LogRecords(const std::string &_filename)
+    {
+      this->Load(_filename);
+    }
+
+    /// \brief The records own the mapping of the file, so they're not copied.
+    public: LogRecords(const LogRecords &) = delete;
+
+    /// \brief The records own the mapping of the file, so they're not copied.
+    public: LogRecords &operator=(const LogRecords &) = delete;
+
+    /// \brief Class destructor.
+    public: ~LogRecords()
+    {
+      this->Unmap();
+    }
+
+    /// \brief Load the records.
+    /// \param[in] _filename Full path to the records.
+    /// \return True if the file holds records of this version.
+    public: bool Load(const std::string &_filename)
+    {
+      this->Unmap();
+
+      const int fd = open(_filename.c_str(), O_RDONLY);
+      if (fd < 0)
+      {
+        std::cerr << _filename << ": File not found" << std::endl;
+        return false;
+      }
+
+      struct stat info;
+      if (fstat(fd, &info) == 0 &&
+          static_cast<size_t>(info.st_size) >= kLogRecordHeaderSize)
+      {
+        void *addr = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd,
+            0);
+        if (addr != MAP_FAILED)
+        {
+          this->data = static_cast<const char *>(addr);
+          this->dataSize = info.st_size;
+        }
+      }
+      close(fd);
+
+      if (!this->data)
+      {
+        std::cerr << _filename << ": Unable to map the file" << std::endl;
+        return false;
+      }
+
+      uint32_t recordSize = 0;
+      std::memcpy(&recordSize, this->data + 8, sizeof(recordSize));
+      if (std::memcmp(this->data, kLogRecordMagic, 8) != 0 ||
+          recordSize != sizeof(LogMinRecord))
+      {
+        std::cerr << _filename << ": Unknown format of the records"
+                  << std::endl;
+        this->Unmap();
+        return false;
+      }
+
+      return true;
+    }
+
+    /// \brief Get the number of records. A record partially written, e.g.
+    /// when the simulation was killed, isn't counted.
+    /// \return The number of records.
+    public: size_t Size() const
+    {
+      if (!this->data)
+        return 0;
+      return (this->dataSize - kLogRecordHeaderSize) / sizeof(LogMinRecord);
+    }
+
+    /// \brief Get a record.
+    /// \param[in] _index Index of the record, less than Size().
+    /// \return The record.
+    public: const LogMinRecord &operator[](const size_t _index) const
+    {
+      return this->Records()[_index];
+    }
+
+    /// \brief Find the first record at or after a time.
+    /// \param[in] _time Simulation time.
+    /// \return Index of the record, or Size() if there's none.
+    public: size_t Find(const double _time) const
+    {
+      if (this->Size() == 0)
+        return 0;
+
+      const LogMinRecord *begin = this->Records();
+      const LogMinRecord *end = begin + this->Size();
+      return std::lower_bound(begin, end, _time,
+          [](const LogMinRecord &_record, const double _t)
+          {
+            return _record.time < _t;
+          }) - begin;
+    }
+
+    /// \brief Get the records.
+    /// \return Pointer to the first record.
+    private: const LogMinRecord *Records() const
+    {
+      // The header keeps the records aligned to 8 bytes.
+      return reinterpret_cast<const LogMinRecord *>(
+          this->data + kLogRecordHeaderSize);
+    }
+
+    /// \brief Unmap the file.
+    private: void Unmap()
+    {
+      if (this->data)
+        munmap(const_cast<char *>(this->data), this->dataSize);
+      this->data = nullptr;
+      this->dataSize = 0;
+    }
+
+    /// \brief The mapping of the file.
+    private: const char *data = nullptr;
+
+    /// \brief Size of the mapping.
+    private: size_t dataSize = 0;
+  };
+}
+#endif
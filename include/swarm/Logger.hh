@@ -19,15 +19,25 @@
 /// \brief Query log information from clients and create a log in disk.
 
 #include <boost/filesystem.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <fstream>
 #include <map>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 #include <sdf/sdf.hh>
 
 #include "msgs/log_entry_min.pb.h"
 #include "msgs/log_entry.pb.h"
 #include "msgs/log_header.pb.h"
+#include "swarm/Checkpointer.hh"
 #include "swarm/Helpers.hh"
+#include "swarm/LogFormat.hh"
+#include "swarm/MemoryAccounting.hh"
+#include "swarm/RunSummary.hh"
 
 #ifndef __SWARM_LOGGER_HH__
 #define __SWARM_LOGGER_HH__
@@ -50,6 +60,15 @@ namespace swarm
     public: virtual void OnLogMin(msgs::LogEntryMin &/*_logEntry*/) const
     {
     };
+
+    /// \brief Whether the client changed significantly since its last
+    /// logged entry. With the adaptive logging, such a client is logged
+    /// before its log period elapses.
+    /// \return True if the client should be logged now.
+    public: virtual bool LogChanged() const
+    {
+      return false;
+    };
   };
 
   /// \brief A logger is an object that stores a list of loggable clients.
@@ -76,25 +95,175 @@ namespace swarm
   /// ~/.swarm/logs/<timstamp>/swarm.log
   ///
   /// It's possible to introspect a log file using the provided tool "swarmlog".
+  ///
+  /// With SWARM_LOG_ASYNC=1, the entries are serialized into a chunk in
+  /// memory, and a background thread writes the chunks once they are large
+  /// enough. At most kMaxQueuedChunks chunks wait for the thread. When they
+  /// are all taken, Update() waits for the thread, unless
+  /// SWARM_LOG_ASYNC_DROP=1, in which case the new chunk is dropped. Stalls()
+  /// and DroppedChunks() count both events. The file is complete once
+  /// Flush() returns, or the logger is destroyed.
+  ///
+  /// With SWARM_LOG_COMPRESS=1, the log is written in the block format of
+  /// LogFormat.hh instead: the chunks are compressed on their own, and an
+  /// index of the simulation time of each block is written when the log is
+  /// closed, so LogParser::Seek() doesn't decompress the whole log. The
+  /// chunks always start at an Update(), so the entries of a simulation time
+  /// are never split between two blocks. With the asynchronous logging, the
+  /// background thread compresses the chunks.
+  ///
+  /// Each client is logged at most once per log period, in simulation time,
+  /// and Loggable::OnLog() is only called when the client is logged. The
+  /// periods are set in the <log_info> section of the SDF:
+  /// <log_period client="broker">0.1</log_period> for a client, and
+  /// <log_period>1</log_period> for the clients without their own period.
+  /// SWARM_LOG_PERIODS overrides them, e.g. "broker=0.1,boo=0,*=1", where
+  /// "*" is the default period. The default period is 0: every client is
+  /// logged in every Update(). With SWARM_LOG_ADAPTIVE=1, a client is also
+  /// logged before its period elapses when Loggable::LogChanged() is true.
+  ///
+  /// With SWARM_LOG_ROTATE_SIZE=<MB> or SWARM_LOG_ROTATE_TIME=<seconds>, the
+  /// log is split into chunks: swarm.log, then swarm.0001.log,
+  /// swarm.0002.log... A new chunk is started by the first Update() after
+  /// the entries of the current chunk reach the size (before compression)
+  /// or span the simulation time. Each chunk is a complete log with a copy
+  /// of the header, whose chunk field is its index, so the chunks are
+  /// parsed and uploaded on their own while the run goes on. The Update()s
+  /// are never split between two chunks, and the broker logs a keyframe of
+  /// the visibility at the beginning of each chunk.
+  ///
+  /// With SWARM_LOG_REPLAY=1, the entries of the robots also hold the
+  /// simulation time of their last step, and the messages delivered to them
+  /// and sent by them with their payload, so ReplayLog replays their
+  /// controllers without the physics nor the comms model. The robots need
+  /// to be logged in every step, with the default period.
+  ///
+  /// With SWARM_LOG_MIN=1 and SWARM_LOG_MIN_RECORDS=1, the scalars of the
+  /// minimal entries are written as fixed size records next to each chunk,
+  /// e.g. swarm.rec for swarm.log, read in place with LogRecords (see
+  /// LogFormat.hh). Only the entries with reports of the BOO, timings or
+  /// the fidelity of the comms go into the log.
+  ///
+  /// A minimal log also adds up its entries into a RunSummary, written
+  /// next to the log when it's closed, e.g. swarm.summary for swarm.log,
+  /// so swarmlog --summary writes the summary of the run without reading
+  /// the log.
+  ///
+  /// The checkpoints of the world save the next log time of each client,
+  /// the totals of the summary, and the chunk and size of the log once
+  /// flushed, where the entries after the checkpoint start. The log of a
+  /// restored simulation is a new file, see Checkpointer, whose summary
+  /// also counts the steps before the checkpoint.
   /// \sa LogParser
   class IGNITION_VISIBLE Logger
+    : public Checkpointable, public MemoryAccountable
   {
     /// \brief Logger is a singleton. This method gets the Logger instance
     /// shared between all the clients.
     /// \return Pointer to the current Logger instance.
     public: static Logger *Instance();
 
+    /// \brief Get the Logger instance of a world. The worlds simulated in
+    /// the same process have independent loggers. The first world logs to
+    /// swarm.log, and the next ones to swarm_<world>.log, in the same
+    /// directory.
+    /// \param[in] _world Name of the world. The empty name is the instance
+    /// returned by Instance().
+    /// \return Pointer to the Logger instance of the world.
+    public: static Logger *Instance(const std::string &_world);
+
     /// \brief Get the full path of the log file.
-    /// \return Full path to the log.
+    /// \return Full path to the log, or to its first chunk if it's rotated.
     public: std::string FilePath() const;
 
-    /// \brief Collect a new round of log information from the clients.
+    /// \brief Get the full path of a chunk of a rotated log.
+    /// \param[in] _chunk Index of the chunk.
+    /// \return Full path to the chunk. The chunk 0 is FilePath().
+    public: std::string ChunkPath(const uint32_t _chunk) const;
+
+    /// \brief Index of the chunk receiving the entries of the next
+    /// Update(), 0 if the log isn't rotated.
+    /// \return The index of the chunk.
+    public: uint32_t Chunk() const;
+
+    /// \brief Whether the log is being written.
+    /// \return True if the logging is enabled and the log file is open.
+    public: bool Enabled() const;
+
+    /// \brief Whether the log only contains the minimal entries. If so,
+    /// Loggable::OnLog() is never called and the clients don't need to
+    /// collect its information.
+    /// \return True if the logging is minimal.
+    public: bool Minimal() const;
+
+    /// \brief Whether the visibility among the robots is logged as the
+    /// changes since the previous entry, with periodic keyframes, instead of
+    /// the full visibility map. LogParser::Visibility() rebuilds the map.
+    /// \return True if the visibility is delta encoded.
+    public: bool VisibilityDelta() const;
+
+    /// \brief Whether the robots log what ReplayLog needs to replay their
+    /// controllers.
+    /// \return True if SWARM_LOG_REPLAY is 1.
+    public: bool Replay() const;
+
+    /// \brief Collect a new round of log information from the clients whose
+    /// log period elapsed, or that changed with the adaptive logging.
     /// \param[in] _simTime Current simulation time.
     public: void Update(const double _simTime);
 
-    /// \brief Handle reset
+    /// \brief Handle reset. The clients are logged in the next Update().
     public: void Reset();
 
+    /// \brief Get the log period of a client.
+    /// \param[in] _id ID of the client.
+    /// \return Minimum simulation time between two entries of the client.
+    public: double LogPeriod(const std::string &_id) const;
+
+    /// \brief Whether clients are logged when they change, before their
+    /// log period elapses.
+    /// \return True if the logging is adaptive.
+    public: bool Adaptive() const;
+
+    /// \brief Write all the entries collected so far into disk. With the
+    /// asynchronous logging, wait for the background thread to write them.
+    public: void Flush();
+
+    /// \brief Write all the entries and the index of the blocks, and close
+    /// the log file, then write the summary of a minimal log. Enabled() is
+    /// false until the next CreateLogFile().
+    public: void Close();
+
+    /// \brief Write all the entries collected so far and stop the
+    /// background thread, before the process forks.
+    /// \sa ResumeFork()
+    public: void PrepareFork();
+
+    /// \brief Continue logging after a fork(). The parent keeps its log.
+    /// A child leaves the log of the parent as it was and starts its own
+    /// one, with the same header, in another directory.
+    /// \param[in] _dir Directory of the log of a child process, or empty
+    /// in the parent.
+    public: void ResumeFork(const std::string &_dir);
+
+    /// \brief Whether the log is written by a background thread.
+    /// \return True if the logging is asynchronous.
+    public: bool Async() const;
+
+    /// \brief Whether the log is written in the block format.
+    /// \return True if the blocks of the log are compressed.
+    public: bool Compressed() const;
+
+    /// \brief Number of times Update() waited for the background thread,
+    /// because all the chunks were taken.
+    /// \return The number of stalls.
+    public: uint64_t Stalls() const;
+
+    /// \brief Number of chunks dropped because all the chunks were taken,
+    /// with SWARM_LOG_ASYNC_DROP=1.
+    /// \return The number of chunks dropped.
+    public: uint64_t DroppedChunks() const;
+
     /// \brief Register a new client for logging.
     /// \param[in] _id Unique ID of the client.
     /// \param[in] _client Pointer to the client.
@@ -107,6 +276,17 @@ namespace swarm
     /// no client registered for this ID).
     public: bool Unregister(const std::string &_id);
 
+    // Documentation inherited.
+    public: virtual void OnSave(msgs::CheckpointPart &_part) const;
+
+    // Documentation inherited.
+    public: virtual bool OnRestore(const msgs::CheckpointPart &_part);
+
+    /// \brief Add the memory of the entries of the clients, and of the
+    /// chunks being filled or queued, to the "logger" subsystem.
+    /// \param[in,out] _report The report.
+    public: virtual void OnMemory(MemoryReport &_report) const;
+
     /// \brief Create the log file.
     /// \param[in] _maxStepSize Simulation max step size.
     /// \param[in] _sdf SDF element containing the optional <log_info> section.
@@ -117,7 +297,79 @@ namespace swarm
     private: Logger();
 
     /// \brief Destructor.
-    private: virtual ~Logger() = default;
+    private: virtual ~Logger();
+
+    /// \brief Serialize an entry at the end of the current chunk.
+    /// \param[in] _entry The entry.
+    private: void Append(const google::protobuf::MessageLite &_entry);
+
+    /// \brief Queue the current chunk for the background thread, or wait
+    /// for a free one. Without the background thread, write it into disk.
+    private: void Submit();
+
+    /// \brief Write the queued chunks, on the background thread.
+    private: void RunWriter();
+
+    /// \brief Flush the log and stop the background thread.
+    private: void StopWriter();
+
+    /// \brief Start a new chunk of a rotated log. The current chunk is
+    /// closed once its entries are written.
+    private: void Rotate();
+
+    /// \brief Create a file of the log, write its header, and close the
+    /// previous one.
+    /// \param[in] _chunk Index of the chunk of the file.
+    private: void OpenFile(const uint32_t _chunk);
+
+    /// \brief Write the index of the blocks, and close the log file.
+    private: void CloseFile();
+
+    /// \brief Create the records of a chunk, write their header, and close
+    /// the previous ones.
+    /// \param[in] _chunk Index of the chunk of the records.
+    private: void OpenRecords(const uint32_t _chunk);
+
+    /// \brief Move the scalars of a minimal entry into a record.
+    /// \param[in,out] _entry The entry, whose scalars are cleared.
+    /// \param[out] _record The record.
+    /// \return True if the entry had any scalar.
+    private: static bool TakeRecord(msgs::LogEntryMin &_entry,
+        LogMinRecord &_record);
+
+    /// \brief A chunk of serialized entries.
+    private: struct LogChunk
+    {
+      /// \brief The entries: <size0><log_entry0>...<sizeN><log_entryN>.
+      std::string data;
+
+      /// \brief Simulation time of the first entry.
+      double time = 0;
+
+      /// \brief Number of entries.
+      uint32_t entries = 0;
+
+      /// \brief Whether the next chunk of a rotated log is started after
+      /// writing this one.
+      bool rotate = false;
+    };
+
+    /// \brief Write a chunk into disk, as a block in the block format.
+    /// \param[in] _chunk The chunk.
+    private: void WriteChunk(const LogChunk &_chunk);
+
+
+    /// \brief Whether a client is logged in this Update().
+    /// \param[in] _id ID of the client.
+    /// \param[in] _client The client.
+    /// \param[in] _simTime Current simulation time.
+    /// \return True if the client is logged.
+    private: bool LogDue(const std::string &_id, const Loggable &_client,
+                         const double _simTime);
+
+    /// \brief Set log periods from a list, e.g. "broker=0.1,*=1".
+    /// \param[in] _periods The list.
+    private: void SetLogPeriods(const std::string &_periods);
 
     /// \brief Fill the message with the header.
     /// \param[in] _maxStepSize Simulation max step size.
@@ -137,9 +389,30 @@ namespace swarm
     /// client ID and the value is the last logEntry stored for this client.
     private: std::map<std::string, msgs::LogEntryMin> logMin;
 
+    /// \brief Entries of the clients logged in the current Update().
+    private: std::vector<const google::protobuf::MessageLite *> updated;
+
+    /// \brief Log period of the clients with their own period.
+    private: std::map<std::string, double> logPeriods;
+
+    /// \brief Log period of the other clients.
+    private: double defaultLogPeriod = 0;
+
+    /// \brief Simulation time when each client is logged next.
+    private: std::map<std::string, double> nextLogTimes;
+
+    /// \brief Adaptive logging flag.
+    private: bool adaptive = false;
+
     /// \brief Stream object to operate on a log file.
     private: std::fstream output;
 
+    /// \brief The records of the current chunk, with SWARM_LOG_MIN_RECORDS.
+    private: std::ofstream recordOutput;
+
+    /// \brief Name of the log file, inside the log directory.
+    private: std::string fileName = "swarm.log";
+
     /// \brief The complete pathname for the log file.
     private: boost::filesystem::path logCompletePath;
 
@@ -149,8 +422,108 @@ namespace swarm
     /// \brief The log header.
     private: msgs::LogHeader header;
 
+    /// \brief Totals of the run, with the minimal logging.
+    private: RunSummary summary;
+
+    /// \brief Path of the summary of the open log.
+    private: std::string summaryPath;
+
     /// \brief Minimal logging flag.
     private: bool min = true;
+
+    /// \brief Delta encoded visibility flag.
+    private: bool visibilityDelta = false;
+
+    /// \brief Whether the robots log what the replay needs.
+    private: bool replay = false;
+
+    /// \brief Whether the scalars of the minimal entries are records.
+    private: bool records = false;
+
+    /// \brief Size of a chunk handed to the background thread (bytes).
+    private: static const size_t kChunkSize = 1 << 20;
+
+    /// \brief Maximum number of chunks waiting for the background thread.
+    private: static const size_t kMaxQueuedChunks = 8;
+
+    /// \brief Asynchronous logging flag.
+    private: bool async = false;
+
+    /// \brief Whether the chunks are dropped instead of waiting for the
+    /// background thread.
+    private: bool dropWhenFull = false;
+
+    /// \brief Compressed logging flag.
+    private: bool compressed = false;
+
+    /// \brief Chunk being filled by Update().
+    private: LogChunk chunk;
+
+    /// \brief Chunks waiting for the background thread, in order.
+    private: std::deque<LogChunk> queued;
+
+    /// \brief Chunks already written, reused by Submit().
+    private: std::vector<std::string> spare;
+
+    /// \brief Whether the background thread is writing a chunk.
+    private: bool writing = false;
+
+    /// \brief Whether the background thread should stop.
+    private: bool stopping = false;
+
+    /// \brief Number of times Update() waited for the background thread.
+    private: uint64_t stalls = 0;
+
+    /// \brief Number of chunks dropped.
+    private: uint64_t droppedChunks = 0;
+
+    /// \brief Size of the current chunk of the log after the last Flush()
+    /// (bytes).
+    private: uint64_t flushedOffset = 0;
+
+    /// \brief Protects the queued and spare chunks, and the counters.
+    private: mutable std::mutex writerMutex;
+
+    /// \brief Signals the background thread that a chunk is queued.
+    private: std::condition_variable chunkQueued;
+
+    /// \brief Signals that the background thread wrote a chunk.
+    private: std::condition_variable chunkWritten;
+
+    /// \brief Background thread writing the chunks.
+    private: std::thread writer;
+
+    /// \brief Blocks written so far, for the index.
+    private: std::vector<LogBlockInfo> blocks;
+
+    /// \brief Buffer of the compressed chunk, reused by WriteChunk().
+    private: std::string compressedChunk;
+
+    /// \brief Size of the entries of a chunk of a rotated log (bytes), 0
+    /// to only rotate on time.
+    private: uint64_t rotateSize = 0;
+
+    /// \brief Simulation time covered by a chunk of a rotated log (s), 0 to
+    /// only rotate on size.
+    private: double rotateTime = 0;
+
+    /// \brief Index of the chunk receiving the entries.
+    private: uint32_t chunkIndex = 0;
+
+    /// \brief Size of the entries of the current chunk (bytes).
+    private: uint64_t chunkBytes = 0;
+
+    /// \brief Simulation time of the first Update() of the current chunk,
+    /// negative before it.
+    private: double chunkStart = -1;
+
+    /// \brief Index of the chunk of the open file, updated by the thread
+    /// writing it.
+    private: uint32_t fileIndex = 0;
+
+    /// \brief Whether the log was created and not closed yet. The stream may
+    /// be reopened by the background thread when the log is rotated.
+    private: bool fileOpen = false;
   };
 }  // namespace
 #endif
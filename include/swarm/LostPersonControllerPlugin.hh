@@ -31,6 +31,7 @@
 #include <gazebo/physics/physics.hh>
 #include "swarm/LostPersonPlugin.hh"
 #include "swarm/RobotPlugin.hh"
+#include "swarm/TransitionField.hh"
 
 namespace swarm
 {
@@ -94,6 +95,25 @@ namespace swarm
     //Private Variables
     private: void FindNeighbor(double bearing, double distance, double* neighborLat, double* neighborLong);
     private: int DetermineNewGoal(double transitionalProbabilities[]);
+
+    /// \brief Precompute the transitional probabilities of the walk over
+    /// the search area, on a lattice spaced by the distance walked in an
+    /// update period.
+    /// \return True if the field was built.
+    private: bool BuildTransitionField();
+
+    /// \brief Choose the next goal from the precomputed field, and set the
+    /// velocity towards it.
+    /// \return False if the lost person is outside of the field, so the
+    /// probabilities must be computed from the map.
+    private: bool FieldTransition();
+
+    /// \brief Whether to precompute the transitional probabilities,
+    /// from the <precompute_transitions> SDF element.
+    private: bool precomputeTransitions = false;
+
+    /// \brief The precomputed transitional probabilities.
+    private: TransitionField transitionField;
   };
 }
 #endif
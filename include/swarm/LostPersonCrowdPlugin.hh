@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file LostPersonCrowdPlugin.hh
+/// \brief A world plugin that drives many lost people at once.
+
+#ifndef __SWARM_LOST_PERSON_CROWD_PLUGIN_HH__
+#define __SWARM_LOST_PERSON_CROWD_PLUGIN_HH__
+
+#include <random>
+#include <string>
+#include <vector>
+#include <gazebo/common/Events.hh>
+#include <gazebo/common/Plugin.hh>
+#include <gazebo/common/Time.hh>
+#include <gazebo/common/UpdateInfo.hh>
+#include <gazebo/physics/PhysicsTypes.hh>
+#include <ignition/math/Vector3.hh>
+#include <sdf/sdf.hh>
+
+#include "swarm/Common.hh"
+#include "swarm/TransitionField.hh"
+
+namespace swarm
+{
+  /// \brief Drives a crowd of lost people: every model whose name starts
+  /// with <model_prefix> follows the random walk of
+  /// LostPersonControllerPlugin, from a single TransitionField shared by
+  /// all of them.
+  ///
+  /// The state of the walkers is kept in arrays, one per attribute, and
+  /// every <update_period> all of them are advanced in one pass: positions
+  /// to latitude and longitude with the projection of Common, nodes, moves
+  /// and velocities. The lost people don't need a GPS sensor or a
+  /// plugin of their own. Use <lost_person_prefix> in the BooPlugin to
+  /// accept a report of any of them.
+  ///
+  /// SDF parameters:
+  ///   <model_prefix>        Prefix of the lost people ("lost_person_").
+  ///   <update_period>       Time between moves (s), 1 by default.
+  ///   <speed>               Walking speed (m/s), 1.4 by default.
+  ///   <swarm_search_area>   Search area, as in the other plugins.
+  class IGNITION_VISIBLE LostPersonCrowdPlugin : public gazebo::WorldPlugin
+  {
+    /// \brief Class constructor.
+    public: LostPersonCrowdPlugin() = default;
+
+    /// \brief Class destructor.
+    public: virtual ~LostPersonCrowdPlugin();
+
+    // Documentation inherited.
+    public: virtual void Load(gazebo::physics::WorldPtr _world,
+                              sdf::ElementPtr _sdf);
+
+    // Documentation inherited.
+    public: virtual void Reset();
+
+    /// \brief Number of lost people of the crowd.
+    /// \return The number of lost people, 0 before the first update.
+    public: size_t Size() const;
+
+    /// \brief Collect the lost people and build the transition field.
+    /// \return True if there is at least one lost person.
+    private: bool LoadCrowd();
+
+    /// \brief Callback executed at the beginning of each world update.
+    /// \param[in] _info Update information provided by the server.
+    private: void Update(const gazebo::common::UpdateInfo &_info);
+
+    /// \brief Choose the next move of every lost person.
+    private: void Walk();
+
+    /// \brief Keep the lost people on the terrain.
+    private: void AdjustPoses();
+
+    /// \brief Pointer to the world.
+    private: gazebo::physics::WorldPtr world;
+
+    /// \brief Search area and terrain.
+    private: Common common;
+
+    /// \brief Prefix of the names of the lost people.
+    private: std::string modelPrefix = "lost_person_";
+
+    /// \brief Time between moves.
+    private: gazebo::common::Time updatePeriod = 1.0;
+
+    /// \brief Time of the last move.
+    private: gazebo::common::Time prevUpdate = 0.0;
+
+    /// \brief Walking speed (m/s).
+    private: double speed = 1.4;
+
+    /// \brief Whether the lost people have been collected.
+    private: bool initialized = false;
+
+    /// \brief Transitional probabilities of the walk, shared by the crowd.
+    private: TransitionField field;
+
+    /// \brief World position of the center of the search area.
+    private: ignition::math::Vector3d center;
+
+    /// \brief Velocity of each move of the field (m/s).
+    private: ignition::math::Vector3d moveVelocities[TransitionField::kMoves];
+
+    /// \brief The lost people.
+    private: std::vector<gazebo::physics::ModelPtr> models;
+
+    /// \brief Half the height of each lost person.
+    private: std::vector<double> halfHeights;
+
+    /// \brief X coordinate of each lost person.
+    private: std::vector<double> xs;
+
+    /// \brief Y coordinate of each lost person.
+    private: std::vector<double> ys;
+
+    /// \brief Latitude of each lost person (degrees).
+    private: std::vector<double> lats;
+
+    /// \brief Longitude of each lost person (degrees).
+    private: std::vector<double> lons;
+
+    /// \brief Random number of the next move of each lost person.
+    private: std::vector<double> draws;
+
+    /// \brief Move of each lost person, or -1 if it's out of the field.
+    private: std::vector<int> moves;
+
+    /// \brief Random engine of the walk.
+    private: std::default_random_engine rndEngine;
+
+    /// \brief Pointer to the update event connection.
+    private: gazebo::event::ConnectionPtr updateConnection;
+  };
+}
+#endif
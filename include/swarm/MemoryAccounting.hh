@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file MemoryAccounting.hh
+/// \brief Memory held by the subsystems of a swarm simulation.
+
+#ifndef __SWARM_MEMORY_ACCOUNTING_HH__
+#define __SWARM_MEMORY_ACCOUNTING_HH__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iosfwd>
+#include <map>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <google/protobuf/message.h>
+
+#include "swarm/Helpers.hh"
+
+namespace swarm
+{
+  /// \brief Bytes and elements held by each subsystem, as added by the
+  /// clients of a MemoryAccounting.
+  ///
+  /// The sizes are estimated from the capacity of the containers, the
+  /// nodes of the maps and the space used by the protobufs, without the
+  /// overhead of the allocator.
+  class IGNITION_VISIBLE MemoryReport
+  {
+    /// \brief Memory of a subsystem.
+    public: struct Usage
+    {
+      /// \brief Bytes held.
+      uint64_t bytes = 0;
+
+      /// \brief Elements held: entries, messages, cells...
+      uint64_t elements = 0;
+    };
+
+    /// \brief Add memory to a subsystem.
+    /// \param[in] _subsystem Name of the subsystem.
+    /// \param[in] _bytes Bytes held.
+    /// \param[in] _elements Elements held.
+    public: void Add(const std::string &_subsystem, const uint64_t _bytes,
+                     const uint64_t _elements);
+
+    /// \brief Get the memory of each subsystem.
+    /// \return The memory, by name of subsystem.
+    public: const std::map<std::string, Usage> &Subsystems() const;
+
+    /// \brief Get the memory of all the subsystems.
+    /// \return The sum of the subsystems.
+    public: Usage Total() const;
+
+    /// \brief Print a line for each subsystem, and the total.
+    /// \param[out] _out The stream.
+    public: void Print(std::ostream &_out) const;
+
+    /// \brief Bytes of a node of a std::map, besides its value.
+    public: static const size_t kMapNodeOverhead = 4 * sizeof(void *);
+
+    /// \brief Bytes of a node of a std::unordered_map, besides its value.
+    public: static const size_t kHashNodeOverhead = 2 * sizeof(void *);
+
+    /// \brief Memory of each subsystem.
+    private: std::map<std::string, Usage> subsystems;
+  };
+
+  /// \brief Heap bytes of a string, 0 if it fits in the string itself.
+  /// \param[in] _s The string.
+  /// \return The bytes.
+  inline uint64_t HeapBytes(const std::string &_s)
+  {
+    // The short strings are stored in place.
+    return _s.capacity() > 15 ? _s.capacity() + 1 : 0;
+  }
+
+  /// \brief Heap bytes of a protobuf, besides the message itself.
+  /// \param[in] _msg The message.
+  /// \return The bytes.
+  template<typename T>
+  typename std::enable_if<std::is_base_of<google::protobuf::Message,
+           T>::value, uint64_t>::type HeapBytes(const T &_msg)
+  {
+    return _msg.SpaceUsed() - sizeof(T);
+  }
+
+  /// \brief Heap bytes of a vector, without those held by its elements.
+  /// \param[in] _v The vector.
+  /// \return The bytes.
+  template<typename T, typename A>
+  uint64_t HeapBytes(const std::vector<T, A> &_v)
+  {
+    return _v.capacity() * sizeof(T);
+  }
+
+  /// \brief Heap bytes of a vector of strings, with the strings.
+  /// \param[in] _v The vector.
+  /// \return The bytes.
+  inline uint64_t HeapBytes(const std::vector<std::string> &_v)
+  {
+    uint64_t bytes = _v.capacity() * sizeof(std::string);
+    for (auto const &s : _v)
+      bytes += HeapBytes(s);
+    return bytes;
+  }
+
+  /// \brief Heap bytes of a deque, without those held by its elements.
+  /// \param[in] _d The deque.
+  /// \return The bytes.
+  template<typename T, typename A>
+  uint64_t HeapBytes(const std::deque<T, A> &_d)
+  {
+    return _d.size() * sizeof(T);
+  }
+
+  /// \brief Heap bytes of the nodes of a map, without those held by its
+  /// keys and values.
+  /// \param[in] _m The map.
+  /// \return The bytes.
+  template<typename K, typename V, typename C, typename A>
+  uint64_t HeapBytes(const std::map<K, V, C, A> &_m)
+  {
+    return _m.size() * (sizeof(typename std::map<K, V, C, A>::value_type) +
+        MemoryReport::kMapNodeOverhead);
+  }
+
+  /// \brief Heap bytes of the nodes and buckets of a hash map, without
+  /// those held by its keys and values.
+  /// \param[in] _m The map.
+  /// \return The bytes.
+  template<typename K, typename V, typename H, typename E, typename A>
+  uint64_t HeapBytes(const std::unordered_map<K, V, H, E, A> &_m)
+  {
+    return _m.size() *
+      (sizeof(typename std::unordered_map<K, V, H, E, A>::value_type) +
+       MemoryReport::kHashNodeOverhead) +
+      _m.bucket_count() * sizeof(void *);
+  }
+
+  /// \brief Bytes of a container of shared protobufs and of the messages.
+  /// The messages shared by several containers are counted by each one.
+  /// \param[in] _msgs The container.
+  /// \return The bytes.
+  template<typename C>
+  uint64_t SharedMessagesBytes(const C &_msgs)
+  {
+    uint64_t bytes = HeapBytes(_msgs);
+    for (auto const &msg : _msgs)
+    {
+      if (msg)
+        bytes += msg->SpaceUsed();
+    }
+    return bytes;
+  }
+
+  /// \brief Interface that a client must implement to account for its
+  /// memory.
+  class IGNITION_VISIBLE MemoryAccountable
+  {
+    /// \brief Add the memory held by the client.
+    /// \param[in,out] _report The report, where the client adds the memory
+    /// of its subsystems. Several clients may add to the same subsystem.
+    public: virtual void OnMemory(MemoryReport &_report) const = 0;
+  };
+
+  /// \brief The clients whose memory is accounted in a world.
+  ///
+  /// Each client adds the bytes and elements held by its major containers
+  /// to the subsystems it belongs to: the broker adds the comms model, the
+  /// visibility tables and the scene, the logger its entries and chunks,
+  /// each robot its buffers, and the BOO the positions of the lost persons.
+  /// Collect() is called at any time from the thread of the simulation.
+  ///
+  /// With SWARM_MEMORY_REPORT=1, the broker prints the report of its world
+  /// when it is destroyed, and at the end of the step after each SIGUSR1.
+  class IGNITION_VISIBLE MemoryAccounting
+  {
+    /// \brief Get the accounting of a world.
+    /// \param[in] _world Name of the world.
+    /// \return Pointer to the accounting of the world.
+    public: static MemoryAccounting *Instance(const std::string &_world);
+
+    /// \brief Register a new client.
+    /// \param[in] _id Unique ID of the client.
+    /// \param[in] _client Pointer to the client.
+    /// \return True if the operation succeed or false otherwise (if the same
+    /// id was already registered).
+    public: bool Register(const std::string &_id,
+                          const MemoryAccountable *_client);
+
+    /// \brief Unregister a client.
+    /// \param[in] _id Unique ID of the client.
+    /// \return True if the operation succeed or false otherwise (if there is
+    /// no client with this id).
+    public: bool Unregister(const std::string &_id);
+
+    /// \brief Collect the memory of every client.
+    /// \return The report.
+    public: MemoryReport Collect() const;
+
+    /// \brief Whether SWARM_MEMORY_REPORT is 1.
+    /// \return True if the reports are printed.
+    public: static bool Enabled();
+
+    /// \brief Install the handler of SIGUSR1, once per process.
+    public: static void InstallSignalHandler();
+
+    /// \brief Whether a SIGUSR1 arrived since the previous call for this
+    /// world.
+    /// \return True if the report of the world should be printed.
+    public: bool SignalPending();
+
+    /// \brief Constructor.
+    private: MemoryAccounting() = default;
+
+    /// \brief Handler of SIGUSR1.
+    /// \param[in] _signal The signal.
+    private: static void OnSignal(int _signal);
+
+    /// \brief Signals received by the process.
+    private: static std::atomic<uint32_t> signals;
+
+    /// \brief Signals handled by this world.
+    private: uint32_t handledSignals = 0;
+
+    /// \brief Registered clients, by ID.
+    private: std::map<std::string, const MemoryAccountable *> clients;
+
+    /// \brief Protects the clients.
+    private: mutable std::mutex mutex;
+  };
+}
+#endif
@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file MessagePool.hh
+/// \brief Reusable protobuf messages, shared through std::shared_ptr.
+
+#ifndef __SWARM_MESSAGE_POOL_HH__
+#define __SWARM_MESSAGE_POOL_HH__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace swarm
+{
+  /// \brief A pool of messages of one type. Make() returns a cleared
+  /// message, and the message goes back to the pool when its last
+  /// std::shared_ptr is released, so the messages and the capacity of
+  /// their strings and repeated fields are reused instead of allocated
+  /// again for every message.
+  ///
+  /// The msgs generator declares a pool and New<Message>() factories for
+  /// every message, e.g. msgs::DatagramPool and msgs::NewDatagram(). The
+  /// pools can be used from multiple threads, and the messages can be
+  /// released from any of them. The idle messages keep their memory, up
+  /// to Capacity() messages.
+  /// \tparam T Type of the messages.
+  template <typename T>
+  class MessagePool
+  {
+    /// \brief Default number of idle messages kept by a pool.
+    public: static const size_t kDefaultCapacity = 4096;
+
+    /// \brief Get the pool of the process.
+    /// \return The pool.
+    public: static MessagePool &Instance()
+    {
+      static MessagePool pool;
+      return pool;
+    }
+
+    /// \brief Get a cleared message.
+    /// \return The message.
+    public: std::shared_ptr<T> Make()
+    {
+      T *msg = nullptr;
+      {
+        std::lock_guard<std::mutex> lock(this->state->mutex);
+        if (!this->state->idle.empty())
+        {
+          msg = this->state->idle.back();
+          this->state->idle.pop_back();
+          ++this->state->reused;
+        }
+        else
+          ++this->state->allocated;
+      }
+
+      if (!msg)
+        msg = new T();
+
+      // The deleter keeps the state alive, so messages released after the
+      // pool is destroyed are deleted.
+      std::shared_ptr<State> poolState = this->state;
+      return std::shared_ptr<T>(msg, [poolState](T *_msg)
+          {
+            poolState->Release(_msg);
+          });
+    }
+
+    /// \brief Get a copy of a message.
+    /// \param[in] _msg The message to copy.
+    /// \return The copy.
+    public: std::shared_ptr<T> Make(const T &_msg)
+    {
+      std::shared_ptr<T> msg = this->Make();
+      msg->CopyFrom(_msg);
+      return msg;
+    }
+
+    /// \brief Set the number of idle messages kept. The extra idle
+    /// messages are deleted.
+    /// \param[in] _capacity Number of messages.
+    public: void SetCapacity(const size_t _capacity)
+    {
+      std::lock_guard<std::mutex> lock(this->state->mutex);
+      this->state->capacity = _capacity;
+      while (this->state->idle.size() > _capacity)
+      {
+        delete this->state->idle.back();
+        this->state->idle.pop_back();
+      }
+    }
+
+    /// \brief Number of idle messages kept.
+    /// \return The capacity (messages).
+    public: size_t Capacity() const
+    {
+      std::lock_guard<std::mutex> lock(this->state->mutex);
+      return this->state->capacity;
+    }
+
+    /// \brief Number of messages waiting to be reused.
+    /// \return The number of idle messages.
+    public: size_t Idle() const
+    {
+      std::lock_guard<std::mutex> lock(this->state->mutex);
+      return this->state->idle.size();
+    }
+
+    /// \brief Memory held by the idle messages.
+    /// \return The memory (bytes).
+    public: uint64_t IdleBytes() const
+    {
+      std::lock_guard<std::mutex> lock(this->state->mutex);
+      uint64_t bytes = this->state->idle.capacity() * sizeof(T *);
+      for (const T *msg : this->state->idle)
+        bytes += msg->SpaceUsed();
+      return bytes;
+    }
+
+    /// \brief Number of messages returned by Make() that were reused.
+    /// \return The number of messages.
+    public: uint64_t Reused() const
+    {
+      std::lock_guard<std::mutex> lock(this->state->mutex);
+      return this->state->reused;
+    }
+
+    /// \brief Number of messages returned by Make() that were allocated.
+    /// \return The number of messages.
+    public: uint64_t Allocated() const
+    {
+      std::lock_guard<std::mutex> lock(this->state->mutex);
+      return this->state->allocated;
+    }
+
+    /// \brief The idle messages and the counters, shared with the deleters
+    /// of the messages in use.
+    private: struct State
+    {
+      /// \brief Destructor. Deletes the idle messages.
+      ~State()
+      {
+        for (T *msg : this->idle)
+          delete msg;
+      }
+
+      /// \brief Clear a released message and keep it, or delete it if the
+      /// pool is full.
+      /// \param[in] _msg The message.
+      void Release(T *_msg)
+      {
+        _msg->Clear();
+        {
+          std::lock_guard<std::mutex> lock(this->mutex);
+          if (this->idle.size() < this->capacity)
+          {
+            this->idle.push_back(_msg);
+            return;
+          }
+        }
+        delete _msg;
+      }
+
+      /// \brief Protects the members.
+      std::mutex mutex;
+
+      /// \brief Messages waiting to be reused.
+      std::vector<T *> idle;
+
+      /// \brief Number of idle messages kept.
+      size_t capacity = kDefaultCapacity;
+
+      /// \brief Number of messages reused.
+      uint64_t reused = 0;
+
+      /// \brief Number of messages allocated.
+      uint64_t allocated = 0;
+    };
+
+    /// \brief The state of the pool.
+    private: std::shared_ptr<State> state = std::make_shared<State>();
+  };
+
+  template <typename T>
+  const size_t MessagePool<T>::kDefaultCapacity;
+}
+#endif
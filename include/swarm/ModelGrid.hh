@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file ModelGrid.hh
+/// \brief Uniform grid over the bounding boxes of models, for region queries.
+
+#ifndef __SWARM_MODEL_GRID_HH__
+#define __SWARM_MODEL_GRID_HH__
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <ignition/math/Box.hh>
+
+#include "swarm/Helpers.hh"
+
+namespace swarm
+{
+  /// \brief A uniform grid over the X and Y extents of a set of boxes,
+  /// such as the bounding boxes of the models of a world.
+  ///
+  /// Each box is stored in every cell it overlaps, and a query returns the
+  /// boxes stored in the cells overlapped by a region. The result is a
+  /// superset of the boxes that overlap the region, so the caller still
+  /// tests each of them exactly. The cells are hashed, so the grid doesn't
+  /// need the bounds of the world, and the boxes that span too many cells,
+  /// such as the terrain, are kept apart and returned by every query.
+  /// Clear() keeps the memory of the cells, so the grid can be refilled
+  /// every step without allocations. The queries are const and can be
+  /// called from multiple threads.
+  class IGNITION_VISIBLE ModelGrid
+  {
+    /// \brief Class constructor.
+    /// \param[in] _cellSize Size of the cells (m).
+    public: explicit ModelGrid(const double _cellSize = 10.0);
+
+    /// \brief Class destructor.
+    public: virtual ~ModelGrid() = default;
+
+    /// \brief Remove all the boxes.
+    public: void Clear();
+
+    /// \brief Add a box.
+    /// \param[in] _id Identifier of the box.
+    /// \param[in] _box The box.
+    public: void Add(const unsigned int _id, const ignition::math::Box &_box);
+
+    /// \brief Number of boxes in the grid.
+    /// \return The number of boxes.
+    public: size_t Size() const;
+
+    /// \brief Size of the cells.
+    /// \return The size (m).
+    public: double CellSize() const;
+
+    /// \brief Get the boxes stored in the cells overlapped by a region.
+    /// \param[in] _region The region. Only its X and Y extents are used.
+    /// \param[out] _ids The identifiers of the boxes, sorted and without
+    /// duplicates.
+    public: void Query(const ignition::math::Box &_region,
+                       std::vector<unsigned int> &_ids) const;
+
+    /// \brief Index of the cell of a coordinate.
+    /// \param[in] _value The coordinate (m).
+    /// \return The index of the cell.
+    private: int32_t Cell(const double _value) const;
+
+    /// \brief Key of a cell in the hash map.
+    /// \param[in] _x Index of the cell along X.
+    /// \param[in] _y Index of the cell along Y.
+    /// \return The key.
+    private: static uint64_t Key(const int32_t _x, const int32_t _y);
+
+    /// \brief Size of the cells (m).
+    private: double cellSize;
+
+    /// \brief Identifiers of the boxes stored in each cell.
+    private: std::unordered_map<uint64_t, std::vector<unsigned int>> cells;
+
+    /// \brief Identifiers of the boxes that span too many cells.
+    private: std::vector<unsigned int> large;
+
+    /// \brief Number of boxes in the grid.
+    private: size_t count = 0;
+  };
+}
+#endif
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file NativeControllerPlugin.hh
+/// \brief A team controller loaded from a library that can be reloaded
+/// while the simulation runs.
+
+#ifndef __SWARM_NATIVE_CONTROLLER_PLUGIN_HH__
+#define __SWARM_NATIVE_CONTROLLER_PLUGIN_HH__
+
+#include <memory>
+#include <set>
+#include <string>
+#include <gazebo/common/UpdateInfo.hh>
+#include <sdf/sdf.hh>
+#include "swarm/ControllerAbi.h"
+#include "swarm/Helpers.hh"
+#include "swarm/RobotPlugin.hh"
+
+namespace swarm
+{
+  class ControllerLibrary;
+
+  /// \brief Runs the controller of a robot from a library with the C
+  /// interface of ControllerAbi.h, so the controller changes without
+  /// restarting gzserver: the world, the terrain, the plugins and the
+  /// visibility tables stay loaded.
+  ///
+  /// The library is the <controller_library> of the plugin, or the
+  /// environment variable SWARM_CONTROLLER_LIBRARY, and is shared by the
+  /// robots that name the same path. It's reloaded after a SIGHUP, or when
+  /// the file changes unless <reload_on_change> is false. The plugin that
+  /// notices the change first requests a reset of the world, as the reset
+  /// button does, so each robot restarts with the new code from its initial
+  /// state, and the broker and the logger start a new run. The controllers
+  /// of the old library are destroyed in the reset, and the library is
+  /// reloaded once none is left, from a copy of the file, so a library
+  /// being rebuilt in place is never mapped.
+  class IGNITION_VISIBLE NativeControllerPlugin : public swarm::RobotPlugin
+  {
+    /// \brief Class constructor.
+    public: NativeControllerPlugin();
+
+    /// \brief Class destructor.
+    public: virtual ~NativeControllerPlugin();
+
+    // Documentation inherited.
+    public: virtual void Load(sdf::ElementPtr _sdf);
+
+    // Documentation inherited.
+    protected: virtual void Reset();
+
+    // Documentation inherited.
+    private: virtual void Update(const gazebo::common::UpdateInfo &_info);
+
+    /// \brief Create the controller of the robot, if its library is loaded.
+    private: void Create();
+
+    /// \brief Destroy the controller of the robot.
+    private: void Destroy();
+
+    /// \brief Pass a message to the controller.
+    /// \param[in] _srcAddress Address of the sender.
+    /// \param[in] _dstAddress Address of the destination.
+    /// \param[in] _dstPort Port of the destination.
+    /// \param[in] _data Payload.
+    private: void OnDataReceived(const std::string &_srcAddress,
+                                 const std::string &_dstAddress,
+                                 const uint32_t _dstPort,
+                                 const std::string &_data);
+
+    /// \brief Functions passed to the controllers.
+    private: static const SwarmRobotApi kApi;
+
+    /// \brief Address of the robot, kept for SwarmRobotApi::host.
+    private: std::string hostAddress;
+
+    /// \brief The library of the controller.
+    private: std::shared_ptr<ControllerLibrary> library;
+
+    /// \brief The functions of the library used by the controller.
+    private: const SwarmController *controller = nullptr;
+
+    /// \brief The controller, null until created.
+    private: void *instance = nullptr;
+
+    /// \brief Endpoints bound by the controllers of the robot. They are
+    /// kept across the reloads.
+    private: std::set<std::string> boundEndPoints;
+
+    friend struct NativeControllerApi;
+  };
+}
+#endif
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file NoOpControllerPlugin.hh
+/// \brief A team controller that does nothing, for the scale worlds.
+
+#ifndef __SWARM_NO_OP_CONTROLLER_PLUGIN_HH__
+#define __SWARM_NO_OP_CONTROLLER_PLUGIN_HH__
+
+#include <gazebo/common/UpdateInfo.hh>
+#include <sdf/sdf.hh>
+#include "swarm/Helpers.hh"
+#include "swarm/RobotPlugin.hh"
+
+namespace swarm
+{
+  /// \brief Controller of the vehicles of worlds/master.erb's scale.world.
+  /// It never moves, binds or sends, so the benchmarks and the regression
+  /// gate measure the simulator without team code in the loop.
+  class IGNITION_VISIBLE NoOpControllerPlugin : public swarm::RobotPlugin
+  {
+    /// \brief Class constructor.
+    public: NoOpControllerPlugin();
+
+    /// \brief Class destructor.
+    public: virtual ~NoOpControllerPlugin() = default;
+
+    // Documentation inherited.
+    public: virtual void Load(sdf::ElementPtr _sdf);
+
+    // Documentation inherited.
+    private: virtual void Update(const gazebo::common::UpdateInfo &_info);
+  };
+}
+#endif
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file Outbox.hh
+/// \brief Queue with many producers and a single consumer.
+
+#ifndef __SWARM_OUTBOX_HH__
+#define __SWARM_OUTBOX_HH__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace swarm
+{
+  /// \brief A queue where many threads push values, and a single thread
+  /// drains all of them at once.
+  ///
+  /// The values are stored in a bounded ring: Push() claims a slot with a
+  /// compare and swap, and publishes it with the sequence number of the
+  /// slot, so producers never wait for each other or for the consumer.
+  /// When the ring is full, the values go to an overflow list protected by
+  /// a mutex, so no value is ever dropped. The order of the values pushed
+  /// by different threads is not specified.
+  ///
+  /// \tparam T Type of the values. It must be default constructible and
+  /// movable.
+  template <typename T>
+  class Outbox
+  {
+    /// \brief Class constructor.
+    /// \param[in] _capacity Number of slots of the ring, rounded up to a
+    /// power of two.
+    public: explicit Outbox(const size_t _capacity)
+    {
+      size_t capacity = 1;
+      while (capacity < _capacity)
+        capacity *= 2;
+
+      this->mask = capacity - 1;
+      this->slots.reset(new Slot[capacity]);
+      for (size_t i = 0; i < capacity; ++i)
+        this->slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    /// \brief Number of slots of the ring.
+    /// \return The capacity.
+    public: size_t Capacity() const
+    {
+      return this->mask + 1;
+    }
+
+    /// \brief Queue a value. Can be called from any thread.
+    /// \param[in] _value The value.
+    public: void Push(T _value)
+    {
+      Slot *slot;
+      size_t pos = this->tail.load(std::memory_order_relaxed);
+      while (true)
+      {
+        slot = &this->slots[pos & this->mask];
+        const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        const intptr_t diff =
+          static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0)
+        {
+          // The slot is free, claim it.
+          if (this->tail.compare_exchange_weak(pos, pos + 1,
+                std::memory_order_relaxed))
+          {
+            break;
+          }
+        }
+        else if (diff < 0)
+        {
+          // The ring is full until the next drain.
+          std::lock_guard<std::mutex> lock(this->overflowMutex);
+          this->overflow.push_back(std::move(_value));
+          return;
+        }
+        else
+          pos = this->tail.load(std::memory_order_relaxed);
+      }
+
+      slot->value = std::move(_value);
+      slot->sequence.store(pos + 1, std::memory_order_release);
+    }
+
+    /// \brief Queue several values at once, in consecutive slots, so they
+    /// are drained in the same order. Can be called from any thread.
+    /// \param[in] _first Iterator to the first value, moved from.
+    /// \param[in] _last Iterator past the last value.
+    public: template <typename Iterator>
+    void Push(Iterator _first, Iterator _last)
+    {
+      const size_t count = static_cast<size_t>(std::distance(_first, _last));
+      if (count == 0)
+        return;
+
+      // The slots are freed in order, so the range is free when its last
+      // slot is.
+      size_t pos = this->tail.load(std::memory_order_relaxed);
+      while (count <= this->mask + 1)
+      {
+        const size_t last = pos + count - 1;
+        const size_t sequence =
+          this->slots[last & this->mask].sequence.load(
+              std::memory_order_acquire);
+        const intptr_t diff =
+          static_cast<intptr_t>(sequence) - static_cast<intptr_t>(last);
+        if (diff == 0)
+        {
+          // The range is free, claim it.
+          if (this->tail.compare_exchange_weak(pos, pos + count,
+                std::memory_order_relaxed))
+          {
+            for (size_t i = 0; i < count; ++i, ++_first)
+            {
+              Slot &slot = this->slots[(pos + i) & this->mask];
+              slot.value = std::move(*_first);
+              slot.sequence.store(pos + i + 1, std::memory_order_release);
+            }
+            return;
+          }
+        }
+        else if (diff < 0)
+          break;
+        else
+          pos = this->tail.load(std::memory_order_relaxed);
+      }
+
+      // The ring doesn't have room for all of them until the next drain.
+      std::lock_guard<std::mutex> lock(this->overflowMutex);
+      for (; _first != _last; ++_first)
+        this->overflow.push_back(std::move(*_first));
+    }
+
+    /// \brief Move the queued values to a container. Must only be called by
+    /// one thread at a time. The values still being pushed by other threads
+    /// are left for the next drain.
+    /// \param[out] _out Container where the values are appended with
+    /// push_back().
+    /// \return Number of values appended.
+    public: template <typename Container>
+    size_t Drain(Container &_out)
+    {
+      size_t count = 0;
+      while (true)
+      {
+        Slot &slot = this->slots[this->head & this->mask];
+        if (slot.sequence.load(std::memory_order_acquire) != this->head + 1)
+          break;
+
+        _out.push_back(std::move(slot.value));
+        slot.value = T();
+
+        // Free the slot for the next lap of the ring.
+        slot.sequence.store(this->head + this->mask + 1,
+            std::memory_order_release);
+        ++this->head;
+        ++count;
+      }
+
+      std::lock_guard<std::mutex> lock(this->overflowMutex);
+      for (auto &value : this->overflow)
+        _out.push_back(std::move(value));
+      count += this->overflow.size();
+      this->overflow.clear();
+
+      return count;
+    }
+
+    /// \brief A slot of the ring.
+    private: struct Slot
+    {
+      /// \brief Equal to the position of the slot when it's free, and to
+      /// the position plus one once a value is published in it.
+      std::atomic<size_t> sequence;
+
+      /// \brief The value.
+      T value;
+    };
+
+    /// \brief Slots of the ring.
+    private: std::unique_ptr<Slot[]> slots;
+
+    /// \brief Capacity of the ring minus one.
+    private: size_t mask;
+
+    /// \brief Keeps tail on its own cache line. Padding is used instead of
+    /// alignas, so that the outbox can be allocated with new.
+    private: char tailPadding[64];
+
+    /// \brief Position of the next slot to claim. Kept on its own cache
+    /// line, since all the producers update it.
+    private: std::atomic<size_t> tail{0};
+
+    /// \brief Keeps head on its own cache line.
+    private: char headPadding[64];
+
+    /// \brief Position of the next slot to drain, only used by the
+    /// consumer.
+    private: size_t head = 0;
+
+    /// \brief Protects the overflow list.
+    private: std::mutex overflowMutex;
+
+    /// \brief Values pushed while the ring was full.
+    private: std::vector<T> overflow;
+  };
+}
+#endif
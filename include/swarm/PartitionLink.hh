@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file PartitionLink.hh
+/// \brief Channels between the gzservers simulating parts of the swarm.
+
+#ifndef __SWARM_PARTITION_LINK_HH__
+#define __SWARM_PARTITION_LINK_HH__
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "swarm/Helpers.hh"
+
+namespace swarm
+{
+  /// \brief Exchanges frames between the partitions of a swarm, when the
+  /// swarm is split across several gzservers. A frame is an opaque block of
+  /// bytes, sent once per comms cycle to each peer.
+  ///
+  /// Two transports are available:
+  ///   * "shm": a ring in shared memory for each ordered pair of
+  ///     partitions, for gzservers running on the same host.
+  ///   * "udp": the frames are split into datagrams sent to the address of
+  ///     each peer, for gzservers running on different hosts.
+  ///
+  /// Both transports are lossy: a frame that doesn't fit in the ring of
+  /// a peer, or with a missing datagram, is dropped.
+  class IGNITION_VISIBLE PartitionLink
+  {
+    /// \brief Class destructor.
+    public: virtual ~PartitionLink() = default;
+
+    /// \brief Create a link.
+    /// \param[in] _transport "shm" or "udp".
+    /// \param[in] _name Name of the local partition.
+    /// \param[in] _peers Name of each peer partition (key). With "udp",
+    /// the value is its "host:port". Ignored with "shm".
+    /// \param[in] _port Local UDP port. Ignored with "shm".
+    /// \return The link, or nullptr if the transport is unknown or the link
+    /// can't be opened.
+    public: static std::unique_ptr<PartitionLink> Create(
+                const std::string &_transport, const std::string &_name,
+                const std::map<std::string, std::string> &_peers,
+                const uint16_t _port);
+
+    /// \brief Send a frame to a peer.
+    /// \param[in] _peer Name of the peer partition.
+    /// \param[in] _frame The frame.
+    /// \return False if the frame was dropped.
+    public: virtual bool Send(const std::string &_peer,
+                              const std::string &_frame) = 0;
+
+    /// \brief Get the frames received since the last call, from all the
+    /// peers. The frames of each peer are in the order they were sent.
+    /// \param[out] _frames Vector where the frames are appended.
+    public: virtual void Receive(std::vector<std::string> &_frames) = 0;
+  };
+}
+#endif
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file PayloadView.hh
+/// \brief Non-owning views of the addresses and payloads of the messages.
+
+#ifndef __SWARM_PAYLOAD_VIEW_HH__
+#define __SWARM_PAYLOAD_VIEW_HH__
+
+#include <cstddef>
+#include <cstring>
+#include <ostream>
+#include <string>
+
+namespace swarm
+{
+  /// \brief A read-only view of a range of characters, e.g. the payload of
+  /// a message received with RobotPlugin::BindView(). The view doesn't own
+  /// the characters: the ones of a message are those of the datagram shared
+  /// by the broker, and are only valid during the callback. Str() copies
+  /// them, for the controllers that keep the payload.
+  class PayloadView
+  {
+    /// \brief Constructor of an empty view.
+    public: PayloadView() = default;
+
+    /// \brief Constructor.
+    /// \param[in] _data First character.
+    /// \param[in] _size Number of characters.
+    public: PayloadView(const char *_data, const size_t _size)
+      : data(_data), size(_size)
+    {
+    }
+
+    /// \brief Constructor of a view of a string. The string must outlive
+    /// the view.
+    /// \param[in] _str The string.
+    public: PayloadView(const std::string &_str)
+      : data(_str.data()), size(_str.size())
+    {
+    }
+
+    /// \brief First character.
+    /// \return Pointer to the characters, not null terminated.
+    public: const char *Data() const
+    {
+      return this->data;
+    }
+
+    /// \brief Number of characters.
+    /// \return The size (octets).
+    public: size_t Size() const
+    {
+      return this->size;
+    }
+
+    /// \brief Whether the view has no characters.
+    /// \return True if the size is 0.
+    public: bool Empty() const
+    {
+      return this->size == 0;
+    }
+
+    /// \brief Get a character.
+    /// \param[in] _index Index of the character, smaller than Size().
+    /// \return The character.
+    public: char operator[](const size_t _index) const
+    {
+      return this->data[_index];
+    }
+
+    /// \brief Copy the characters.
+    /// \return A string with the characters.
+    public: std::string Str() const
+    {
+      return std::string(this->data, this->size);
+    }
+
+    /// \brief Compare the characters with the ones of another view.
+    /// \param[in] _other The other view.
+    /// \return True if both have the same characters.
+    public: bool operator==(const PayloadView &_other) const
+    {
+      return this->size == _other.size &&
+          (this->size == 0 ||
+           std::memcmp(this->data, _other.data, this->size) == 0);
+    }
+
+    /// \brief Compare the characters with the ones of another view.
+    /// \param[in] _other The other view.
+    /// \return True if they have different characters.
+    public: bool operator!=(const PayloadView &_other) const
+    {
+      return !(*this == _other);
+    }
+
+    /// \brief First character.
+    private: const char *data = nullptr;
+
+    /// \brief Number of characters.
+    private: size_t size = 0;
+  };
+
+  /// \brief Write the characters of a view.
+  /// \param[in] _out The stream.
+  /// \param[in] _view The view.
+  /// \return The stream.
+  inline std::ostream &operator<<(std::ostream &_out, const PayloadView &_view)
+  {
+    return _out.write(_view.Data(), _view.Size());
+  }
+}
+#endif
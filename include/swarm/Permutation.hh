@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file Permutation.hh
+/// \brief Random permutation of indices generated on the fly.
+
+#ifndef __SWARM_PERMUTATION_HH__
+#define __SWARM_PERMUTATION_HH__
+
+#include <cstdint>
+
+#include "swarm/Helpers.hh"
+
+namespace swarm
+{
+  /// \brief Visits the indices [0, size) in a random order, without storing
+  /// them.
+  ///
+  /// The order is given by a Feistel network keyed by a seed: it maps the
+  /// smallest power of four that holds the size onto itself, and the
+  /// values out of range are skipped. Each index takes at most four steps
+  /// on average and no memory is allocated, so a new order can be drawn
+  /// for every message.
+  class IGNITION_VISIBLE Permutation
+  {
+    /// \brief Class constructor. The permutation is empty until Reset().
+    public: Permutation() = default;
+
+    /// \brief Start a new permutation.
+    /// \param[in] _size Number of indices.
+    /// \param[in] _seed Seed that selects the order.
+    public: void Reset(const uint32_t _size, const uint64_t _seed);
+
+    /// \brief Get the next index of the permutation.
+    /// \param[out] _index The index.
+    /// \return False if all the indices were already visited.
+    public: bool Next(uint32_t &_index);
+
+    /// \brief Apply the Feistel network to a value of the domain.
+    /// \param[in] _value The value.
+    /// \return The permuted value.
+    private: uint64_t Encrypt(const uint64_t _value) const;
+
+    /// \brief Number of rounds of the Feistel network.
+    private: static const unsigned int kRounds = 8;
+
+    /// \brief Keys of the rounds.
+    private: uint64_t keys[kRounds] = {};
+
+    /// \brief Number of bits of each half of a value.
+    private: unsigned int halfBits = 0;
+
+    /// \brief Mask of the bits of a half.
+    private: uint64_t halfMask = 0;
+
+    /// \brief Number of indices.
+    private: uint32_t size = 0;
+
+    /// \brief Number of values of the domain already permuted.
+    private: uint64_t counter = 0;
+
+    /// \brief Rotation applied to the values before the Feistel network.
+    private: uint64_t offset = 0;
+
+    /// \brief Size of the domain, a power of four.
+    private: uint64_t domain = 0;
+  };
+}
+#endif
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file PoseSnapshot.hh
+/// \brief Poses of the swarm, captured once per simulation step.
+
+#ifndef __SWARM_POSE_SNAPSHOT_HH__
+#define __SWARM_POSE_SNAPSHOT_HH__
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <gazebo/common/Time.hh>
+#include <gazebo/physics/PhysicsTypes.hh>
+#include <ignition/math/Pose3.hh>
+#include <ignition/math/Quaternion.hh>
+#include <ignition/math/Vector3.hh>
+
+#include "swarm/Helpers.hh"
+
+namespace swarm
+{
+  /// \brief World poses of the members of the swarm, indexed by robot id.
+  ///
+  /// The poses are read from Gazebo once per simulation step, by the first
+  /// plugin calling Capture() during the step, and stored as a structure of
+  /// arrays. The comms model, the broker and the robots then read them from
+  /// the snapshot instead of calling GetWorldPose() on the models. Poses
+  /// set during the step (e.g. by RobotPlugin::AdjustPose()) are seen in
+  /// the next step.
+  ///
+  /// A robot may be an alias of a carrier, e.g. a rotor docked to a ground
+  /// vehicle: its pose is the pose of the carrier, and the comms model
+  /// reuses the links of the carrier instead of evaluating its own.
+  class IGNITION_VISIBLE PoseSnapshot
+  {
+    /// \brief PoseSnapshot is a singleton. This method gets the instance
+    /// shared between all the plugins.
+    /// \return Pointer to the current PoseSnapshot instance.
+    public: static PoseSnapshot *Instance();
+
+    /// \brief Get the PoseSnapshot instance of a world. The worlds
+    /// simulated in the same process have independent snapshots.
+    /// \param[in] _world Name of the world. The empty name is the instance
+    /// returned by Instance().
+    /// \return Pointer to the PoseSnapshot instance of the world.
+    public: static PoseSnapshot *Instance(const std::string &_world);
+
+    /// \brief Set the models of the swarm, replacing the previous ones.
+    /// The id of a robot is the index of its model.
+    /// \param[in] _models The models, indexed by robot id. A null model is
+    /// a robot simulated elsewhere, whose pose is set with SetPose().
+    public: void SetModels(
+                const std::vector<gazebo::physics::ModelPtr> &_models);
+
+    /// \brief Read the poses of all the models, unless they were already
+    /// read at this simulation time.
+    /// \param[in] _simTime Current simulation time.
+    public: void Capture(const gazebo::common::Time &_simTime);
+
+    /// \brief Set the pose of a robot without model.
+    /// \param[in] _id Id of the robot.
+    /// \param[in] _pose Pose of the robot in the world.
+    public: void SetPose(const unsigned int _id,
+                         const ignition::math::Pose3d &_pose);
+
+    /// \brief Copy the poses and the carriers of another snapshot, e.g. to
+    /// read them from another thread while the other one is captured
+    /// again. The models are only copied when the version of the other
+    /// snapshot changed, and the copy isn't captured itself.
+    /// \param[in] _other The snapshot copied.
+    public: void CopyPoses(const PoseSnapshot &_other);
+
+    /// \brief Whether the poses were captured at a simulation time.
+    /// \param[in] _simTime Simulation time.
+    /// \return True if the snapshot is from _simTime.
+    public: bool Captured(const gazebo::common::Time &_simTime) const;
+
+    /// \brief Get the id of a robot.
+    /// \param[in] _name Name of the model of the robot.
+    /// \return The id of the robot, or -1 if the model is not in the
+    /// snapshot.
+    public: int Id(const std::string &_name) const;
+
+    /// \brief Version of the ids, incremented by SetModels(). The ids got
+    /// from Id() are valid while the version doesn't change.
+    /// \return The version.
+    public: uint64_t Version() const;
+
+    /// \brief Number of robots in the snapshot.
+    /// \return The number of robots.
+    public: size_t Size() const;
+
+    /// \brief Make a robot an alias of a carrier, from the next capture.
+    /// \param[in] _id Id of the robot.
+    /// \param[in] _carrier Id of the carrier, or -1 if the robot isn't an
+    /// alias anymore. A carrier can't be an alias itself.
+    public: void SetCarrier(const unsigned int _id, const int _carrier);
+
+    /// \brief Get the carrier of a robot.
+    /// \param[in] _id Id of the robot.
+    /// \return The id of the carrier, or -1 if the robot isn't an alias.
+    public: int Carrier(const unsigned int _id) const;
+
+    /// \brief Number of robots that are aliases of a carrier.
+    /// \return The number of robots.
+    public: size_t Aliases() const;
+
+    /// \brief Position of a robot in the world.
+    /// \param[in] _id Id of the robot.
+    /// \return The position.
+    public: ignition::math::Vector3d Position(const unsigned int _id) const;
+
+    /// \brief Orientation of a robot in the world.
+    /// \param[in] _id Id of the robot.
+    /// \return The orientation.
+    public: ignition::math::Quaterniond Orientation(
+                const unsigned int _id) const;
+
+    /// \brief Pose of a robot in the world.
+    /// \param[in] _id Id of the robot.
+    /// \return The pose.
+    public: ignition::math::Pose3d Pose(const unsigned int _id) const;
+
+    /// \brief Whether two poses are the same to the bit, unlike operator==,
+    /// which has a tolerance.
+    /// \param[in] _a A pose.
+    /// \param[in] _b Another pose.
+    /// \return True if the poses are the same.
+    public: static bool Same(const ignition::math::Pose3d &_a,
+                             const ignition::math::Pose3d &_b);
+
+    /// \brief Models of the swarm, indexed by robot id.
+    private: std::vector<gazebo::physics::ModelPtr> models;
+
+    /// \brief Id of each robot, by model name.
+    private: std::map<std::string, int> ids;
+
+    /// \brief X, Y and Z coordinates of the positions, by robot id.
+    private: std::vector<double> position[3];
+
+    /// \brief W, X, Y and Z components of the orientations, by robot id.
+    private: std::vector<double> orientation[4];
+
+    /// \brief Id of the carrier of each robot, or -1, by robot id.
+    private: std::vector<int> carriers;
+
+    /// \brief Number of robots with a carrier.
+    private: size_t aliases = 0;
+
+    /// \brief Simulation time of the snapshot.
+    private: gazebo::common::Time captureTime;
+
+    /// \brief Whether the poses were captured since SetModels().
+    private: bool captured = false;
+
+    /// \brief Version of the ids.
+    private: uint64_t version = 0;
+  };
+}
+#endif
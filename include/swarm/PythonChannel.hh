@@ -0,0 +1,356 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file PythonChannel.hh
+/// \brief Shared memory between the robot plugin and the processes that
+/// run the Python controllers.
+
+#ifndef __SWARM_PYTHON_CHANNEL_HH__
+#define __SWARM_PYTHON_CHANNEL_HH__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "swarm/Helpers.hh"
+
+namespace swarm
+{
+  /// \brief First field of the segment ("SWPY").
+  static const uint32_t kPythonChannelMagic = 0x59505753;
+
+  /// \brief Version of the layout of the segment, increased when the
+  /// layout changes.
+  static const uint32_t kPythonChannelVersion = 1;
+
+  /// \brief Largest number of robots in the segment.
+  static const uint32_t kPythonMaxRobots = 1024;
+
+  /// \brief Largest number of worker processes.
+  static const uint32_t kPythonMaxWorkers = 64;
+
+  /// \brief Size of the names in the segment, padded with zeros.
+  static const uint32_t kPythonNameSize = 64;
+
+  /// \brief Largest number of objects detected by the camera of a robot.
+  static const uint32_t kPythonMaxObjects = 32;
+
+  /// \brief Size of the data of a queue (bytes).
+  static const uint32_t kPythonQueueSize = 32768;
+
+  /// \brief Commands of the controllers, applied by the plugin after the
+  /// step, in order.
+  enum PythonCommand
+  {
+    /// \brief Bind(address, port).
+    PYTHON_BIND = 1,
+
+    /// \brief SetLinearVelocity(x, y, z).
+    PYTHON_LINEAR_VELOCITY = 2,
+
+    /// \brief SetAngularVelocity(x, y, z).
+    PYTHON_ANGULAR_VELOCITY = 3,
+
+    /// \brief SendTo(data, address, port).
+    PYTHON_SEND_TO = 4,
+
+    /// \brief Launch().
+    PYTHON_LAUNCH = 5,
+
+    /// \brief Dock(vehicle).
+    PYTHON_DOCK = 6,
+
+    /// \brief gzmsg << text.
+    PYTHON_GZMSG = 7,
+
+    /// \brief gzerr << text.
+    PYTHON_GZERR = 8,
+
+    /// \brief gzlog << text.
+    PYTHON_GZLOG = 9
+  };
+
+  /// \brief Records of variable size. A record is either added whole or
+  /// not at all.
+  struct PythonQueue
+  {
+    /// \brief Bytes used in data.
+    uint32_t size;
+
+    /// \brief Reserved, zero.
+    uint32_t reserved;
+
+    /// \brief The records.
+    uint8_t data[kPythonQueueSize];
+  };
+
+  /// \brief An object detected by the camera of a robot.
+  struct PythonObject
+  {
+    /// \brief Name of the object, padded with zeros.
+    char name[kPythonNameSize];
+
+    /// \brief Position in the world (m).
+    double x;
+
+    /// \brief Position in the world (m).
+    double y;
+
+    /// \brief Position in the world (m).
+    double z;
+  };
+
+  /// \brief A robot in the segment. The plugin writes its state before each
+  /// step, and the worker that owns the robot its commands during the step.
+  struct PythonRobot
+  {
+    /// \brief Name of the robot, empty once it's removed.
+    char name[kPythonNameSize];
+
+    /// \brief Address of the robot.
+    char host[kPythonNameSize];
+
+    /// \brief Vehicle type, as returned by swarm.type().
+    char type[16];
+
+    /// \brief Terrain type, as returned by swarm.terrain_type().
+    char terrain[16];
+
+    /// \brief Search area, as returned by swarm.search_area().
+    double searchArea[4];
+
+    /// \brief Position of the BOO, as returned by swarm.boo_pose().
+    double booPose[2];
+
+    /// \brief Direction to the lost person, as swarm.lost_person_dir().
+    double lostPersonDir[2];
+
+    /// \brief GPS pose, as returned by swarm.pose().
+    double pose[3];
+
+    /// \brief IMU, as returned by swarm.imu().
+    double imu[9];
+
+    /// \brief Bearing (rad).
+    double bearing;
+
+    /// \brief 1 if the robot is docked.
+    uint32_t docked;
+
+    /// \brief 1 once the worker called the load function. Written by the
+    /// worker.
+    uint32_t loaded;
+
+    /// \brief Number of objects in the camera.
+    uint32_t numObjects;
+
+    /// \brief Reserved, zero.
+    uint32_t reserved;
+
+    /// \brief Objects in the camera.
+    PythonObject objects[kPythonMaxObjects];
+
+    /// \brief Addresses of the neighbors, a string per record.
+    PythonQueue neighbors;
+
+    /// \brief Messages received since the last step, each one a record of
+    /// source, destination, port and data.
+    PythonQueue inbox;
+
+    /// \brief Commands of the worker in this step. Each record starts with
+    /// the index of the target robot and the PythonCommand.
+    PythonQueue outbox;
+  };
+
+  /// \brief State of the step, written by the plugin.
+  struct PythonHeader
+  {
+    /// \brief kPythonChannelMagic.
+    uint32_t magic;
+
+    /// \brief kPythonChannelVersion.
+    uint32_t version;
+
+    /// \brief Number of worker processes.
+    uint32_t numWorkers;
+
+    /// \brief Number of robots. Robot i is controlled by the worker
+    /// i % numWorkers.
+    uint32_t numRobots;
+
+    /// \brief 1 to stop the workers.
+    uint32_t stop;
+
+    /// \brief Reserved, zero.
+    uint32_t reserved;
+
+    /// \brief Simulation time of the step (s).
+    double simTime;
+
+    /// \brief Real time of the step (s).
+    double realTime;
+
+    /// \brief Name of the world.
+    char worldName[kPythonNameSize];
+  };
+
+  /// \brief Adds records to a queue.
+  class IGNITION_VISIBLE PythonQueueWriter
+  {
+    /// \brief Class constructor. Starts a record.
+    /// \param[in] _queue The queue.
+    public: explicit PythonQueueWriter(PythonQueue &_queue);
+
+    /// \brief Add a number to the record.
+    /// \param[in] _value The number.
+    public: void Add(const uint32_t _value);
+
+    /// \brief Add a number to the record.
+    /// \param[in] _value The number.
+    public: void Add(const double _value);
+
+    /// \brief Add a string to the record.
+    /// \param[in] _value The string.
+    public: void Add(const std::string &_value);
+
+    /// \brief Add the record to the queue, and start a new one.
+    /// \return False if the record doesn't fit, and it was dropped.
+    public: bool End();
+
+    /// \brief Add bytes to the record.
+    /// \param[in] _data The bytes.
+    /// \param[in] _size Number of bytes.
+    private: void Add(const void *_data, const uint32_t _size);
+
+    /// \brief The queue.
+    private: PythonQueue &queue;
+
+    /// \brief Size of the record.
+    private: uint32_t size = 0;
+
+    /// \brief True if the record doesn't fit.
+    private: bool overflow = false;
+  };
+
+  /// \brief Reads the records of a queue, in order.
+  class IGNITION_VISIBLE PythonQueueReader
+  {
+    /// \brief Class constructor.
+    /// \param[in] _queue The queue.
+    public: explicit PythonQueueReader(const PythonQueue &_queue);
+
+    /// \brief Whether all the records were read.
+    /// \return True at the end of the queue.
+    public: bool Done() const;
+
+    /// \brief Read a number.
+    /// \param[out] _value The number.
+    /// \return False at the end of the queue.
+    public: bool Read(uint32_t &_value);
+
+    /// \brief Read a number.
+    /// \param[out] _value The number.
+    /// \return False at the end of the queue.
+    public: bool Read(double &_value);
+
+    /// \brief Read a string.
+    /// \param[out] _value The string.
+    /// \return False at the end of the queue.
+    public: bool Read(std::string &_value);
+
+    /// \brief Read bytes.
+    /// \param[out] _data The bytes.
+    /// \param[in] _size Number of bytes.
+    /// \return False at the end of the queue.
+    private: bool Read(void *_data, const uint32_t _size);
+
+    /// \brief The queue.
+    private: const PythonQueue &queue;
+
+    /// \brief Position of the next read.
+    private: uint32_t pos = 0;
+  };
+
+  /// \brief The shared memory segment "/swarm_python_<name>" between the
+  /// plugin and the worker processes, and the semaphores that run the
+  /// workers in lockstep with the simulation: the plugin fills the state
+  /// of the robots and starts all the workers, and applies the commands
+  /// once all of them are done.
+  class IGNITION_VISIBLE PythonChannel
+  {
+    /// \brief Class destructor. Unmaps the segment, and removes it if it
+    /// was created by this process.
+    public: ~PythonChannel();
+
+    /// \brief Create the segment, for the plugin.
+    /// \param[in] _name Name of the segment.
+    /// \param[in] _workers Number of workers.
+    /// \return The channel, or nullptr on error.
+    public: static std::unique_ptr<PythonChannel> Create(
+                const std::string &_name, const uint32_t _workers);
+
+    /// \brief Open a segment created by the plugin, for a worker.
+    /// \param[in] _name Name of the segment.
+    /// \return The channel, or nullptr on error.
+    public: static std::unique_ptr<PythonChannel> Open(
+                const std::string &_name);
+
+    /// \brief Get the state of the step.
+    /// \return The header.
+    public: PythonHeader &Header();
+
+    /// \brief Get a robot.
+    /// \param[in] _index Index of the robot, lower than kPythonMaxRobots.
+    /// \return The robot.
+    public: PythonRobot &Robot(const uint32_t _index);
+
+    /// \brief Start a step of a worker.
+    /// \param[in] _worker Index of the worker.
+    public: void Start(const uint32_t _worker);
+
+    /// \brief Wait for the start of a step, in a worker.
+    /// \param[in] _worker Index of the worker.
+    public: void WaitStart(const uint32_t _worker);
+
+    /// \brief Finish a step, in a worker.
+    /// \param[in] _worker Index of the worker.
+    public: void Done(const uint32_t _worker);
+
+    /// \brief Wait for a worker to finish its step.
+    /// \param[in] _worker Index of the worker.
+    /// \param[in] _timeout Longest wait (s).
+    /// \return False if the worker didn't finish in time.
+    public: bool WaitDone(const uint32_t _worker, const double _timeout);
+
+    /// \brief Class constructor.
+    /// \param[in] _name Name of the segment.
+    /// \param[in] _segment The mapped segment.
+    /// \param[in] _owner True if this process created the segment.
+    private: PythonChannel(const std::string &_name, void *_segment,
+                           const bool _owner);
+
+    /// \brief Name of the segment.
+    private: std::string name;
+
+    /// \brief The mapped segment.
+    private: void *segment;
+
+    /// \brief True if this process created the segment.
+    private: bool owner;
+  };
+}
+#endif
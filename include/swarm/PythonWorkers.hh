@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file PythonWorkers.hh
+/// \brief Python controllers run by a pool of worker processes.
+
+#ifndef __SWARM_PYTHON_WORKERS_HH__
+#define __SWARM_PYTHON_WORKERS_HH__
+
+#include <sys/types.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <gazebo/common/UpdateInfo.hh>
+
+#include "swarm/Helpers.hh"
+#include "swarm/PythonChannel.hh"
+
+namespace swarm
+{
+  class RobotPlugin;
+
+  /// \brief Runs the Python controllers of the robots in worker processes,
+  /// each one with its own interpreter, so they can use several cores.
+  ///
+  /// The workers run the "swarm_python_worker" executable, or the one in
+  /// the SWARM_PYTHON_WORKER environment variable, and exchange the state
+  /// of the robots and their commands through a PythonChannel. In each
+  /// step, the state of all the robots is written, all the workers call
+  /// the functions of their robots, and the commands are applied once all
+  /// of them are done. The swarm module of the workers has the same
+  /// functions as the embedded one, but the commands are applied after the
+  /// step, their return value only says if they were queued, and the
+  /// messages received are passed to the controllers in the next step.
+  class IGNITION_VISIBLE PythonWorkers
+  {
+    /// \brief Class destructor. Stops the workers.
+    public: ~PythonWorkers();
+
+    /// \brief Start the workers.
+    /// \param[in] _workers Number of worker processes.
+    /// \param[in] _module Python module of the controllers.
+    /// \param[in] _load Function called once for every robot.
+    /// \param[in] _update Function called for every robot in each step.
+    /// \param[in] _onDataReceived Function called for every message.
+    /// \return The workers, or nullptr on error.
+    public: static std::unique_ptr<PythonWorkers> Create(
+                const unsigned int _workers, const std::string &_module,
+                const std::string &_load, const std::string &_update,
+                const std::string &_onDataReceived);
+
+    /// \brief Add a robot. Its load function is called in the next step.
+    /// \param[in] _robot The robot.
+    /// \return False if there are too many robots.
+    public: bool Add(RobotPlugin *_robot);
+
+    /// \brief Remove a robot.
+    /// \param[in] _robot The robot.
+    public: void Remove(RobotPlugin *_robot);
+
+    /// \brief Queue a message received by a robot, for the next step.
+    /// \param[in] _robot The robot.
+    /// \param[in] _srcAddress Source address.
+    /// \param[in] _dstAddress Destination address.
+    /// \param[in] _dstPort Destination port.
+    /// \param[in] _data Payload.
+    public: void Receive(RobotPlugin *_robot, const std::string &_srcAddress,
+                         const std::string &_dstAddress,
+                         const uint32_t _dstPort, const std::string &_data);
+
+    /// \brief Run a step of all the controllers, and apply their commands.
+    /// \param[in] _info Update information of the step.
+    public: void Step(const gazebo::common::UpdateInfo &_info);
+
+    /// \brief Class constructor.
+    /// \param[in] _channel The channel with the workers.
+    private: explicit PythonWorkers(std::unique_ptr<PythonChannel> _channel);
+
+    /// \brief Write the state of a robot in the channel.
+    /// \param[in] _index Index of the robot.
+    private: void Fill(const uint32_t _index);
+
+    /// \brief Apply the commands of the step of a robot.
+    /// \param[in] _index Index of the robot.
+    private: void Apply(const uint32_t _index);
+
+    /// \brief Wait for a worker to finish its step.
+    /// \param[in] _worker Index of the worker.
+    private: void Wait(const uint32_t _worker);
+
+    /// \brief The channel with the workers.
+    private: std::unique_ptr<PythonChannel> channel;
+
+    /// \brief Robots by index in the channel, nullptr once removed.
+    private: std::vector<RobotPlugin *> robots;
+
+    /// \brief Index of each robot in the channel.
+    private: std::unordered_map<RobotPlugin *, uint32_t> indices;
+
+    /// \brief Process of each worker, -1 once it exited.
+    private: std::vector<pid_t> pids;
+
+    /// \brief Whether a message was dropped because of a full inbox.
+    private: bool dropReported = false;
+  };
+}
+#endif
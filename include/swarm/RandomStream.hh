@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file RandomStream.hh
+/// \brief Counter-based random streams of the stochastic subsystems.
+
+#ifndef __SWARM_RANDOM_STREAM_HH__
+#define __SWARM_RANDOM_STREAM_HH__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "swarm/Helpers.hh"
+
+namespace swarm
+{
+  /// \brief A stream of random numbers given by the Philox4x32-10 counter
+  /// based generator. A number only depends on the key of the stream and on
+  /// its position, not on the other streams, so the subsystems and the
+  /// robots draw their numbers from any thread and in any order, and get
+  /// the same ones.
+  ///
+  /// The key is split from the seed of the simulation, a subsystem and a
+  /// member, e.g. the sensor noise of a robot. Each step is a block of the
+  /// stream, selected with Seek(), so the numbers of a step don't depend on
+  /// how many were drawn in the previous ones and the streams don't need
+  /// to be checkpointed.
+  ///
+  /// The stream is a UniformRandomBitGenerator of 32 bits, e.g. for
+  /// std::shuffle().
+  class IGNITION_VISIBLE RandomStream
+  {
+    /// \brief The subsystems that draw random numbers. Each one splits its
+    /// own keys.
+    public: enum Subsystem : uint32_t
+    {
+      /// \brief Noise of the GPS, IMU and compass.
+      SENSORS  = 1,
+
+      /// \brief False negatives, false positives and noise of the camera.
+      CAMERA   = 2,
+
+      /// \brief Outages of the comms model.
+      OUTAGES  = 3,
+
+      /// \brief Order and drops of the messages of the broker.
+      DISPATCH = 4
+    };
+
+    /// \brief Type of the bits generated.
+    public: using result_type = uint32_t;
+
+    /// \brief Class constructor of the stream of key 0.
+    public: RandomStream() = default;
+
+    /// \brief Class constructor. The stream starts at block 0.
+    /// \param[in] _seed Seed of the simulation.
+    /// \param[in] _subsystem Subsystem drawing the numbers.
+    /// \param[in] _member Member of the subsystem, e.g. MemberKey() of a
+    /// robot, or 0.
+    public: RandomStream(const uint64_t _seed, const Subsystem _subsystem,
+                         const uint64_t _member = 0);
+
+    /// \brief Get a stream whose key is split from the key of this one.
+    /// \param[in] _id Identifier of the new stream.
+    /// \return The stream, at block 0.
+    public: RandomStream Split(const uint64_t _id) const;
+
+    /// \brief Key of a member, given by its name or address, stable across
+    /// processes and runs.
+    /// \param[in] _name The name.
+    /// \return The key.
+    public: static uint64_t MemberKey(const std::string &_name);
+
+    /// \brief Move to the start of a block, e.g. a step.
+    /// \param[in] _block The block.
+    public: void Seek(const uint64_t _block);
+
+    /// \brief Current block.
+    /// \return The block.
+    public: uint64_t Block() const;
+
+    /// \brief Number of 32-bit words drawn from the current block.
+    /// \return The number of words.
+    public: uint64_t Position() const;
+
+    /// \brief Smallest value generated.
+    /// \return 0.
+    public: static constexpr result_type min()
+    {
+      return 0u;
+    }
+
+    /// \brief Largest value generated.
+    /// \return 2^32 - 1.
+    public: static constexpr result_type max()
+    {
+      return 0xffffffffu;
+    }
+
+    /// \brief Draw 32 random bits.
+    /// \return The bits.
+    public: result_type operator()();
+
+    /// \brief Draw 64 random bits.
+    /// \return The bits.
+    public: uint64_t Bits64();
+
+    /// \brief Draw a uniform number in [0, 1), with 53 random bits.
+    /// \return The number.
+    public: double Uniform();
+
+    /// \brief Draw a uniform number.
+    /// \param[in] _min Minimum value.
+    /// \param[in] _max Maximum value.
+    /// \return A number in [_min, _max).
+    public: double Uniform(const double _min, const double _max);
+
+    /// \brief Draw a uniform integer.
+    /// \param[in] _min Minimum value.
+    /// \param[in] _max Maximum value, included.
+    /// \return A number in [_min, _max].
+    public: int IntUniform(const int _min, const int _max);
+
+    /// \brief Draw a normal number (Box-Muller).
+    /// \param[in] _mean Mean.
+    /// \param[in] _stdDev Standard deviation.
+    /// \return The number.
+    public: double Normal(const double _mean, const double _stdDev);
+
+    /// \brief Draw several uniform numbers. Same as calling Uniform() for
+    /// each one.
+    /// \param[in] _count Number of numbers.
+    /// \param[in] _min Minimum value.
+    /// \param[in] _max Maximum value.
+    /// \param[out] _out The numbers, in [_min, _max).
+    public: void Uniform(const size_t _count, const double _min,
+                         const double _max, double *_out);
+
+    /// \brief Draw several normal numbers. Both numbers of each pair of
+    /// uniforms are used, so a batch takes half the draws of the same
+    /// number of calls to Normal(), and gives other numbers.
+    /// \param[in] _count Number of numbers.
+    /// \param[in] _mean Mean.
+    /// \param[in] _stdDev Standard deviation.
+    /// \param[out] _out The numbers.
+    public: void Normal(const size_t _count, const double _mean,
+                        const double _stdDev, double *_out);
+
+    /// \brief Apply Philox4x32-10 to a counter.
+    /// \param[in] _counter The counter.
+    /// \param[in] _key The key.
+    /// \param[out] _out The random bits.
+    public: static void Philox(const uint32_t _counter[4],
+                               const uint32_t _key[2], uint32_t _out[4]);
+
+    /// \brief Generate the words of the next counter of the block.
+    private: void Refill();
+
+    /// \brief Key of the stream.
+    private: uint32_t key[2] = {0, 0};
+
+    /// \brief Current block, the high half of the counter.
+    private: uint64_t block = 0;
+
+    /// \brief Next counter of the block, the low half of the counter.
+    private: uint64_t counter = 0;
+
+    /// \brief Words of the last counter.
+    private: uint32_t words[4] = {0, 0, 0, 0};
+
+    /// \brief Number of words of the last counter already drawn.
+    private: unsigned int used = 4;
+  };
+}
+#endif
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file ReplayLog.hh
+/// \brief Replay the controllers of a swarm from a recorded log.
+
+#ifndef __SWARM_REPLAY_LOG_HH__
+#define __SWARM_REPLAY_LOG_HH__
+
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+#include <ignition/math/Vector3.hh>
+
+#include "msgs/log_entry.pb.h"
+#include "swarm/Broker.hh"
+#include "swarm/Helpers.hh"
+
+namespace swarm
+{
+  /// \brief The entries of the robots in a log written with
+  /// SWARM_LOG_REPLAY=1, and the results of replaying their controllers.
+  ///
+  /// With SWARM_REPLAY=<swarm.log>, each robot logged finds the entry of
+  /// each of its steps, by the simulation time of the step. Its controller
+  /// gets the observations, the neighbors and the messages delivered that
+  /// were logged instead of those of Gazebo, the broker doesn't simulate the
+  /// comms model, and the vehicles are kinematic. The velocities requested
+  /// by the controller and the messages it sends are compared with the
+  /// entry instead of being applied, and swarm_replay reports the
+  /// differences.
+  ///
+  /// A controller drawing from ignition::math::Rand doesn't get the same
+  /// numbers as in the logged run, since the sensors and the comms model
+  /// don't draw theirs.
+  class IGNITION_VISIBLE ReplayLog
+  {
+    /// \brief The results of a robot.
+    public: struct Result
+    {
+      /// \brief Steps compared.
+      uint64_t steps = 0;
+
+      /// \brief Steps whose velocities differ from the log.
+      uint64_t actionMismatches = 0;
+
+      /// \brief Steps whose messages sent differ from the log.
+      uint64_t msgMismatches = 0;
+
+      /// \brief Simulation time of the first step that differs, negative
+      /// if none (s).
+      double firstMismatchTime = -1;
+
+      /// \brief Description of the first difference.
+      std::string firstMismatch;
+    };
+
+    /// \brief Get the replay of a world.
+    /// \param[in] _world Name of the world.
+    /// \return Pointer to the replay of the world.
+    public: static ReplayLog *Instance(const std::string &_world);
+
+    /// \brief Read the entries of the robots from a log. Only the first
+    /// call reads the log, and the next ones return its result.
+    /// \param[in] _path Path of the log, not rotated.
+    /// \return True if the log has entries to replay.
+    public: bool Load(const std::string &_path);
+
+    /// \brief Add the entry of a step of a robot.
+    /// \param[in] _entry The entry, with its step_time.
+    public: void Add(const msgs::LogEntry &_entry);
+
+    /// \brief Whether a robot was logged.
+    /// \param[in] _id Address of the robot.
+    /// \return True if the log has entries of the robot.
+    public: bool Has(const std::string &_id) const;
+
+    /// \brief Find the entry of a step of a robot.
+    /// \param[in] _id Address of the robot.
+    /// \param[in] _time Simulation time of the step (s).
+    /// \return The entry, or nullptr if the step wasn't logged.
+    public: const msgs::LogEntry *Find(const std::string &_id,
+                                       const double _time) const;
+
+    /// \brief Simulation time of the last step logged.
+    /// \return The time (s), 0 if nothing was loaded.
+    public: double EndTime() const;
+
+    /// \brief Compare a step of a controller with its entry.
+    /// \param[in] _entry The entry of the step.
+    /// \param[in] _linVel Linear velocity requested by the controller.
+    /// \param[in] _angVel Angular velocity requested by the controller.
+    /// \param[in] _sent Messages sent by the controller, in order.
+    /// \return True if the step matches the entry.
+    public: bool Check(const msgs::LogEntry &_entry,
+                       const ignition::math::Vector3d &_linVel,
+                       const ignition::math::Vector3d &_angVel,
+                       const std::vector<DatagramPtr> &_sent);
+
+    /// \brief Get the results of the robots.
+    /// \return The results, by address.
+    public: const std::map<std::string, Result> &Results() const;
+
+    /// \brief Whether every step compared matches the log.
+    /// \return True if no step differs, and some step was compared.
+    public: bool Passed() const;
+
+    /// \brief Print a line with the results of each robot, and a summary.
+    /// \param[out] _out The stream.
+    public: void Report(std::ostream &_out) const;
+
+    /// \brief Tolerance of the velocities compared (m/s, rad/s).
+    public: static constexpr double kVelocityTolerance = 1e-6;
+
+    /// \brief Tolerance of the step times looked up (s).
+    public: static constexpr double kTimeTolerance = 1e-6;
+
+    /// \brief Constructor.
+    private: ReplayLog() = default;
+
+    /// \brief Record a difference of a step.
+    /// \param[in] _result The results of the robot.
+    /// \param[in] _time Simulation time of the step (s).
+    /// \param[in] _what Description of the difference.
+    private: static void Mismatch(Result &_result, const double _time,
+                                  const std::string &_what);
+
+    /// \brief Whether Load() was called.
+    private: bool loadCalled = false;
+
+    /// \brief Result of the first Load().
+    private: bool loaded = false;
+
+    /// \brief Entries of each robot, by step time.
+    private: std::map<std::string, std::vector<msgs::LogEntry>> entries;
+
+    /// \brief Results of each robot.
+    private: std::map<std::string, Result> results;
+
+    /// \brief Simulation time of the last step logged (s).
+    private: double endTime = 0;
+  };
+}
+#endif
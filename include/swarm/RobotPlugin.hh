@@ -23,8 +23,10 @@
 
 #include <functional>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 #include <gazebo/transport/TransportTypes.hh>
 #include <gazebo/common/Console.hh>
@@ -45,8 +47,18 @@
 #include "msgs/log_entry.pb.h"
 #include "swarm/Common.hh"
 #include "swarm/Broker.hh"
+#include "swarm/CameraIndex.hh"
+#include "swarm/Checkpointer.hh"
 #include "swarm/SwarmTypes.hh"
 #include "swarm/Logger.hh"
+#include "swarm/MemoryAccounting.hh"
+#include "swarm/PayloadView.hh"
+#include "swarm/PoseSnapshot.hh"
+#include "swarm/PythonWorkers.hh"
+#include "swarm/RandomStream.hh"
+#include "swarm/ReplayLog.hh"
+#include "swarm/SceneIndex.hh"
+#include "swarm/SwarmExecutor.hh"
 
 #ifdef SWARM_PYTHON_API
   #include <Python.h>
@@ -66,13 +78,18 @@ namespace swarm
   };
 
   /// \brief A class that stores information about a false positive.
+  /// The models are identified by their position in the names of the
+  /// scene index.
   class IGNITION_VISIBLE FalsePositiveData
   {
+    /// \brief The real model perceived by the camera.
+    public: int model = -1;
+
     /// \brief When will the last false positive period finish?
     public: gazebo::common::Time enabledUntil;
 
-    /// \brief The name of model used in a false positive.
-    public: std::string falsePositiveModel;
+    /// \brief The model used in a false positive.
+    public: int falsePositiveModel = -1;
   };
 
   /// \brief A Model plugin that is the base class for all agent plugins
@@ -86,12 +103,23 @@ namespace swarm
   /// * Communication.
   ///     - Bind()      This method binds an address to a virtual socket, and
   ///                   sends incoming messages to the specified callback.
+  ///     - BindBatch() Like Bind(), but the messages of a step are sent
+  ///                   together to the specified callback.
+  ///     - BindView()  Like Bind(), but the callback receives views of the
+  ///                   addresses and payload, valid during the callback.
   ///     - SendTo()    This method allows an agent to send data to other
   ///                   individual agent (unicast), all the agents (broadcast),
   ///                   or a group of agents (multicast).
+  ///     - SendBatch() Send several messages to other agents at once.
+  ///     - SendFound() Report the location of the lost person to the BOO.
   ///     - Host()      This method will return the agent's address.
   ///     - Neighbors() This method returns the addresses of other vehicles that
   ///                   are inside the communication range of this robot.
+  ///                   NeighborsView() and NeighborsVersion() give access
+  ///                   to them without copies, and tell when they change.
+  ///     - NearbyNeighbors() The neighbors within a distance, with their
+  ///                   positions as they were last heard of.
+  ///                   KNearestNeighbors() gives the closest ones instead.
   ///
   ///  * Motion.
   ///     - Type()               This method returns the type of vehicle where
@@ -139,8 +167,77 @@ namespace swarm
   ///     - Type() Get the vehicle type.
   ///     - Name() Get the name of the vehicle.
   ///     - SearchArea() Get the GPS coordinates of the search area.
+  ///
+  ///  * Threading.
+  ///     Update() runs on the Gazebo update thread, unless the plugin sets
+  ///     <parallel_controller>true</parallel_controller>. Then it runs on a
+  ///     pool of threads, with the controllers of the other robots that are
+  ///     due in the same step. SendTo() and SetCameraOrientation() are
+  ///     deferred and applied once all of them finish, in address order, so
+  ///     the results don't depend on the scheduling of the threads. Bind()
+  ///     must be called from Load().
+  ///
+  ///     The updates of the sensors, the terrain type and the controllers
+  ///     of the swarm are spread evenly over the steps of their periods.
+  ///     <controller_budget> limits the number of controllers updated in a
+  ///     step; the ones over the budget are updated in the next steps.
+  ///
+  ///     The wall time of each update of the controller is measured and
+  ///     logged. <controller_time_budget> is the wall time allowed to an
+  ///     update (s), and <controller_overrun_policy> ("none", "skip" or
+  ///     "throttle") what happens once the controller exceeds it in
+  ///     <controller_overrun_limit> updates in a row (default 3), see
+  ///     SwarmExecutor. SWARM_CONTROLLER_TIME_BUDGET and
+  ///     SWARM_CONTROLLER_OVERRUN_POLICY override them for every robot but
+  ///     the BOO. The first controller updated in a step with the Python
+  ///     workers or the batched Python update runs all the Python
+  ///     controllers, so its time includes theirs.
+  ///
+  ///     With <camera_backend>index</camera_backend>, the camera is tested
+  ///     against the camera index of the world instead of the logical
+  ///     camera sensor, which is then disabled. The models seen, and the
+  ///     noise added, are the same, and the cost grows with the number of
+  ///     models near the camera instead of the size of the world.
+  ///
+  ///     With <lazy_sensors>true</lazy_sensors>, each observation of a
+  ///     sensor period (Pose(), Imu(), Bearing(), Image()) is computed on
+  ///     its first access, and kept until the next period, so the sensors
+  ///     the controller doesn't read cost nothing. The noise is drawn from
+  ///     the streams of the step of the period, so the observations are the
+  ///     ones of the eager sensors. Once read, a sensor is also computed at
+  ///     the end of the step of each period, since the world moves in the
+  ///     next steps; only its first read after that step sees the world at
+  ///     the time of the read.
+  ///
+  ///  * Events.
+  ///     Instead of polling its inbox, its neighbors or the time every
+  ///     update, a controller may wait for them with WaitForMessage(),
+  ///     WaitUntil(), WaitForNeighbors() and WaitForSensors(). The executor
+  ///     skips its updates, at no cost, until one of the events awaited
+  ///     happens, and WokenBy() tells which in the update that resumes. The
+  ///     updates still fall on the steps of the controller period, and the
+  ///     velocities last a step, as between the updates of the period, so
+  ///     a waiting robot stays still.
+  ///
+  ///  * Kinematics.
+  ///     With <kinematic>true</kinematic>, or the environment variable
+  ///     SWARM_KINEMATIC set to 1, the links of the vehicle are disabled in
+  ///     the physics engine, and the executor integrates the pose from the
+  ///     velocities set on the model every step, before it is adjusted to
+  ///     the terrain. The controllers, the sensors and the comms see the
+  ///     same velocities and poses, without the cost of the dynamics.
+  ///
+  ///  * Replay.
+  ///     With SWARM_LOG_REPLAY=1, the entries of the robot hold the messages
+  ///     delivered and sent with their payload. A run with
+  ///     SWARM_REPLAY=<swarm.log> feeds the controller the observations,
+  ///     neighbors and messages of that log instead of the sensors and the
+  ///     broker, and compares its velocities and messages with the log,
+  ///     see ReplayLog and swarm_replay. The vehicles are kinematic, and
+  ///     the sensors of Gazebo are disabled.
   class IGNITION_VISIBLE RobotPlugin
-    : public gazebo::ModelPlugin, public swarm::Loggable
+    : public gazebo::ModelPlugin, public swarm::Loggable,
+      public swarm::Checkpointable, public swarm::MemoryAccountable
   {
     /// \brief The type of vehicle.
     public: enum VehicleType
@@ -158,6 +255,23 @@ namespace swarm
               BOO = 3
             };
 
+    /// \brief Events that resume a controller waiting with WaitForMessage(),
+    /// WaitUntil(), WaitForNeighbors() or WaitForSensors().
+    public: enum WakeEvent
+            {
+              /// \brief A message arrived.
+              WAKE_MESSAGE = 1,
+
+              /// \brief The simulation time was reached.
+              WAKE_TIME = 2,
+
+              /// \brief The neighbors changed.
+              WAKE_NEIGHBORS = 4,
+
+              /// \brief The sensors were updated.
+              WAKE_SENSORS = 8
+            };
+
 
     /// \brief Class constructor.
     public: RobotPlugin();
@@ -180,6 +294,60 @@ namespace swarm
     /// \param[in] _info Update information provided by the server.
     protected: virtual void Update(const gazebo::common::UpdateInfo &_info);
 
+    /// \brief Skip the next updates of the controller until a message
+    /// arrives. The waits of an update add up: the controller resumes on
+    /// the first of the events awaited.
+    /// \param[in] _port Port of the message, or any port if negative.
+    /// \sa WokenBy
+    public: void WaitForMessage(const int _port = -1);
+
+    /// \brief Skip the next updates of the controller until a simulation
+    /// time, like WaitForMessage().
+    /// \param[in] _simTime The simulation time (s).
+    public: void WaitUntil(const double _simTime);
+
+    /// \brief Skip the next updates of the controller until its neighbors
+    /// change, like WaitForMessage().
+    public: void WaitForNeighbors();
+
+    /// \brief Skip the next updates of the controller until its sensors are
+    /// updated, like WaitForMessage().
+    public: void WaitForSensors();
+
+    /// \brief Get the events that resumed this update of the controller.
+    /// \return A mask of WakeEvent, 0 if the controller wasn't waiting.
+    public: unsigned int WokenBy() const;
+
+    /// \brief Save the state of the controller into a checkpoint of the
+    /// world. A controller that keeps state between its updates stores it,
+    /// e.g. serialized into the controller field of the robot state, so a
+    /// restored simulation continues like the saved one.
+    /// \param[out] _part The part of the checkpoint of the robot, already
+    /// filled with the state of the RobotPlugin.
+    protected: virtual void OnSaveController(
+                   msgs::CheckpointPart &/*_part*/) const
+    {
+    }
+
+    /// \brief Restore the state of the controller saved by
+    /// OnSaveController().
+    /// \param[in] _part The part of the checkpoint of the robot.
+    /// \return True if the state was restored.
+    protected: virtual bool OnRestoreController(
+                   const msgs::CheckpointPart &/*_part*/)
+    {
+      return true;
+    }
+
+    /// \brief Add the memory held by the controller to a report. It's
+    /// called with the memory of the RobotPlugin, under the subsystem
+    /// "robots", or "boo" for the base of operations.
+    /// \param[in,out] _report The report.
+    protected: virtual void OnMemoryController(
+                   MemoryReport &/*_report*/) const
+    {
+    }
+
     /// \brief This method can bind a local address and a port to a
     /// virtual socket. This is a required step if your agent needs to
     /// receive messages.
@@ -213,51 +381,106 @@ namespace swarm
               const std::string &_address,
               const int _port = kDefaultPort)
     {
-      // Sanity check: Make sure that you use your local address or multicast.
-      if ((_address != this->kMulticast) && (_address != this->Host()))
-      {
-        gzerr << "[" << this->Host() << "] Bind() error: Address ["
-              << _address << "] is not your local address" << std::endl;
-        return false;
-      }
-
-      // Mapping the "unicast socket" to a topic name.
-      const auto unicastEndPoint = _address + ":" + std::to_string(_port);
-
-      if (!this->broker->Bind(this->Host(), this, unicastEndPoint))
-        return false;
-
-      // Register the user callback using the topic name as the key.
-      this->callbacks[unicastEndPoint] = std::bind(_cb, _obj,
+      return this->BindEndPoints(_address, _port, std::bind(_cb, _obj,
           std::placeholders::_1, std::placeholders::_2, std::placeholders::_3,
-          std::placeholders::_4);
-
-      // Only enable broadcast if the address is a regular unicast address.
-      if (_address != this->kMulticast)
-      {
-        const std::string bcastEndPoint = "broadcast:" + std::to_string(_port);
+          std::placeholders::_4));
+    }
 
-        if (!this->broker->Bind(this->Host(), this, bcastEndPoint))
-          return false;
+    /// \brief Bind a local address and a port to a virtual socket, like
+    /// Bind(), but receive views of the addresses and the payload instead of
+    /// strings. The views point to the message shared by the broker with
+    /// all its recipients, so nothing is copied, and are only valid during
+    /// the callback: use PayloadView::Str() to keep them.
+    ///
+    /// \param[in] _cb Callback function executed for every message, with
+    /// its source address, destination address, destination port and
+    /// payload.
+    /// \param[in] _obj Instance containing the member function callback.
+    /// \param[in] _address Local address or "kMulticast", as in Bind().
+    /// \param[in] _port Port used to receive messages.
+    /// \return True when success or false otherwise.
+    ///
+    /// * Example usage:
+    ///    this->BindView(&MyClass::OnDataView, this, this->Host());
+    public: template<typename C>
+    bool BindView(void(C::*_cb)(const PayloadView _srcAddress,
+                                const PayloadView _dstAddress,
+                                const uint32_t _dstPort,
+                                const PayloadView _data),
+                  C *_obj,
+                  const std::string &_address,
+                  const int _port = kDefaultPort)
+    {
+      return this->BindEndPoints(_address, _port,
+          [_cb, _obj](const std::string &_srcAddress,
+                      const std::string &_dstAddress,
+                      const uint32_t _dstPort,
+                      const std::string &_data)
+          {
+            (_obj->*_cb)(_srcAddress, _dstAddress, _dstPort, _data);
+          });
+    }
 
-        // Register the user callback using the broadcast topic as the key.
-        this->callbacks[bcastEndPoint] = std::bind(_cb, _obj,
-            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3,
-            std::placeholders::_4);
-      }
+    /// \brief Bind a local address and a port to a virtual socket, like
+    /// Bind(), but receive its messages in a batch. The messages of all the
+    /// endpoints bound with BindBatch() are delivered together, once per
+    /// step before the controllers are updated, in the order they arrived.
+    /// The same callback receives all of them; a later call replaces it.
+    ///
+    /// \param[in] _cb Callback function executed with the messages received
+    /// in a step. Each message has its source address, destination address,
+    /// destination port and payload.
+    /// \param[in] _obj Instance containing the member function callback.
+    /// \param[in] _address Local address or "kMulticast", as in Bind().
+    /// \param[in] _port Port used to receive messages.
+    /// \return True when success or false otherwise.
+    ///
+    /// * Example usage:
+    ///    this->BindBatch(&MyClass::OnDataBatch, this, this->Host());
+    public: template<typename C>
+    bool BindBatch(void(C::*_cb)(const std::vector<DatagramPtr> &_msgs),
+                   C *_obj,
+                   const std::string &_address,
+                   const int _port = kDefaultPort)
+    {
+      if (!this->BindEndPoints(_address, _port, Callback_t()))
+        return false;
 
+      this->batchCallback = std::bind(_cb, _obj, std::placeholders::_1);
       return true;
     }
 
-    /// \brief Hand control over to a Python script
+    /// \brief Hand control over to a Python script. If the environment
+    /// variable SWARM_PYTHON_WORKERS is a positive number, the script runs in
+    /// that many worker processes instead of the embedded interpreter (see
+    /// PythonWorkers), and _updateAll is ignored.
+    /// \param[in] _module Python module of the controller.
+    /// \param[in] _load Function called once for every robot.
+    /// \param[in] _update Function called for every robot in each update.
+    /// \param[in] _onDataReceived Function called for every message.
+    /// \param[in] _updateAll Optional function called once per step for all
+    /// the robots instead of _update, with the names of the robots and their
+    /// observations and actions as buffers of doubles, one row per robot
+    /// (see the OBS_* and ACT_* constants of the swarm module). The buffers
+    /// can be viewed without copies, e.g. with numpy.frombuffer().
+    /// \return True if the script was loaded.
     protected: bool LoadPython(const std::string &_module,
                                const std::string &_load,
                                const std::string &_update,
-                               const std::string &_onDataReceived);
+                               const std::string &_onDataReceived,
+                               const std::string &_updateAll = "");
 
     /// \brief Invoke the previously arranged Python update method
     protected: void UpdatePython(const gazebo::common::UpdateInfo & _info);
 
+    /// \brief Whether this is the first Python update of a step with the
+    /// workers or the batched update, which then run all the robots. The
+    /// step is recorded, and pMutex must be held.
+    /// \param[in] _info Update information of the step.
+    /// \return True for the first update of the step.
+    private: static bool FirstPythonUpdate(
+                 const gazebo::common::UpdateInfo &_info);
+
     /// \brief Invoke the previously arranged Python ondatareceived method
     public: void OnDataReceivedPython(const std::string &_srcAddress,
                                       const std::string &_dstAddress,
@@ -280,6 +503,38 @@ namespace swarm
                         const std::string &_dstAddress,
                         const uint32_t _port = kDefaultPort);
 
+    /// \brief Report to the BOO where the lost person was at a given time,
+    /// in the binary format of FoundReport.hh. The BOO acknowledges it as
+    /// it does with the text report "FOUND <x> <y> <z> <t>".
+    /// \param[in] _pos Position of the lost person, in world coordinates.
+    /// \param[in] _time Simulation time at which the person was there.
+    /// \return The result of SendTo().
+    public: bool SendFound(const ignition::math::Vector3d &_pos,
+                           const double _time);
+
+    /// \brief A message of a batch sent with SendBatch().
+    public: struct OutgoingMessage
+    {
+      /// \brief Destination address, as in SendTo().
+      std::string dstAddress;
+
+      /// \brief Destination port.
+      uint32_t port;
+
+      /// \brief Payload. Only read during SendBatch().
+      const std::string *data;
+    };
+
+    /// \brief Send several messages at once. The payloads are all checked
+    /// first, and none is sent if one of them is too large. The messages
+    /// are queued together, and dispatched in the same order.
+    ///
+    /// \param[in] _msgs The messages.
+    /// \return True when success or false otherwise (meaning that no message
+    /// was sent).
+    /// \sa SendTo
+    public: bool SendBatch(const std::vector<OutgoingMessage> &_msgs);
+
     /// \brief Get your local address. This address should be specified as a
     /// SDF model parameter.
     ///
@@ -291,6 +546,60 @@ namespace swarm
     /// \return A vector of addresses from your local neighbors.
     public: std::vector<std::string> Neighbors() const;
 
+    /// \brief Get the list of local neighbors without copying it. The
+    /// reference stays valid, and its content only changes if
+    /// NeighborsVersion() changes.
+    ///
+    /// \return The addresses of your local neighbors.
+    public: const std::vector<std::string> &NeighborsView() const;
+
+    /// \brief Get the version of the list of local neighbors, which
+    /// changes every time that a robot enters or leaves the list. Compare
+    /// it with a previous value to know if the neighbors need to be read
+    /// again.
+    ///
+    /// \return The version of the neighbors.
+    public: uint64_t NeighborsVersion() const;
+
+    /// \brief A neighbor returned by NearbyNeighbors() and
+    /// KNearestNeighbors().
+    public: struct NearbyNeighbor
+    {
+      /// \brief Address of the neighbor.
+      std::string address;
+
+      /// \brief Latitude of the neighbor (degrees).
+      double latitude;
+
+      /// \brief Longitude of the neighbor (degrees).
+      double longitude;
+
+      /// \brief Altitude of the neighbor (meters).
+      double altitude;
+
+      /// \brief Distance between the robot and the neighbor (meters).
+      double distance;
+    };
+
+    /// \brief Get the local neighbors within a distance, closest first.
+    /// The neighbors are where the comms model last evaluated their links,
+    /// as if they had sent their positions then, so no messages are
+    /// needed. The distance is measured from the current position of this
+    /// robot. The neighbors of a replayed log have no positions.
+    ///
+    /// \param[in] _radius Maximum distance (meters).
+    /// \return The neighbors, sorted by distance.
+    /// \sa KNearestNeighbors
+    public: std::vector<NearbyNeighbor> NearbyNeighbors(const double _radius)
+                const;
+
+    /// \brief Get the closest local neighbors, like NearbyNeighbors().
+    ///
+    /// \param[in] _k Maximum number of neighbors.
+    /// \return The neighbors, sorted by distance.
+    public: std::vector<NearbyNeighbor> KNearestNeighbors(
+                const unsigned int _k) const;
+
     /// \brief Get the type of vehicle. The type of vehicle is set in the
     /// SDF world file using the <type> XML element.
     /// \return The enum value that specifies what type of vehicles this
@@ -469,6 +778,23 @@ namespace swarm
     public: bool MapQuery(const double _lat, const double _lon,
                           double &_height, TerrainType &_type);
 
+    /// \brief Query the map at several latitudes and longitudes in one
+    /// call.
+    ///
+    /// \param[in] _count Number of queries.
+    /// \param[in] _lat Latitudes of the queries (degrees).
+    /// \param[in] _lon Longitudes of the queries (degrees).
+    /// \param[out] _height Elevation at each query point (meters).
+    /// \param[out] _type Type of terrain at each query point.
+    /// \param[out] _valid Whether each query is inside the search area. It
+    /// can be null.
+    /// \return Number of queries inside the search area.
+    /// \sa Common::MapQuery(const size_t, const double *, const double *,
+    /// double *, TerrainType *, bool *)
+    public: size_t MapQuery(const size_t _count, const double *_lat,
+                            const double *_lon, double *_height,
+                            TerrainType *_type, bool *_valid = nullptr);
+
     /// \brief Get starting battery capacity (mAh).
     /// \return The battery's start capacity in mAh.
     public: double BatteryStartCapacity() const;
@@ -525,6 +851,8 @@ namespace swarm
     /// rotor vehicle cannot move independently, but can process sensor data.
     /// When launched, a rotor vehicle can move independently from the
     /// ground vehicle.
+    /// A docked rotor is an alias of the ground vehicle: it has its pose,
+    /// and the comms model reuses its links.
     /// This has no affect for ground and fixed wing vehicles.
     /// \param[in] _vehicle Name of the vehicle to dock with.
     /// \return True if docking was successful. Docking can fail if
@@ -556,11 +884,6 @@ namespace swarm
     /// 0,0 is returned.
     public: ignition::math::Vector2d LostPersonDir() const;
 
-    /// \brief Update the plugin.
-    ///
-    /// \param[in] _info Update information provided by the server.
-    private: virtual void Loop(const gazebo::common::UpdateInfo &_info);
-
     // Documentation Inherited.
     private: virtual void Load(gazebo::physics::ModelPtr _model,
                                sdf::ElementPtr _sdf);
@@ -572,14 +895,23 @@ namespace swarm
     /// user's callback.
     ///
     /// \param[in] _msg New message received.
-    private: void OnMsgReceived(const msgs::Datagram &_msg) const;
+    /// \param[in] _callback Index of the callback of the endpoint. The
+    /// endpoints bound with BindBatch() have no callback, and their messages
+    /// are kept for DeliverBatch().
+    private: void OnMsgReceived(const DatagramPtr &_msg,
+                                const unsigned int _callback) const;
+
+    /// \brief Deliver the messages received for the endpoints bound with
+    /// BindBatch() since the last call.
+    private: void DeliverBatch();
 
     /// \brief Callback executed each time that a neighbor update is received.
     /// The messages are coming from the broker. The broker decides which are
     /// the robots inside the communication range of each other vehicle and
     /// notifies these updates.
     ///
-    /// \param[in] _msg New message received containing the list of neighbors.
+    /// \param[in] _neighbors New list of neighbors. The broker only sends
+    /// it when it changes.
     private: void OnNeighborsReceived(
       const std::vector<std::string> &_neighbors);
 
@@ -587,14 +919,91 @@ namespace swarm
     /// boundaries.
     private: void AdjustPose();
 
-    /// \brief Update and store sensor information.
+    /// \brief Compute the pose of the vehicle constrained to the terrain,
+    /// without setting it. Not for a docked rotor, which follows its
+    /// carrier.
+    /// \param[out] _pose The pose.
+    /// \return True if the pose changes.
+    private: bool ConstrainPose(ignition::math::Pose3d &_pose);
+
+    /// \brief Get the world pose of a model of the swarm, from the pose
+    /// snapshot when it is current.
+    /// \param[in] _model The model.
+    /// \param[in] _id Id of the model in the pose snapshot, or -1 to read
+    /// the pose from the model.
+    /// \return The pose of the model.
+    private: ignition::math::Pose3d WorldPose(
+                 const gazebo::physics::ModelPtr &_model, const int _id) const;
+
+    /// \brief Get the closest local neighbors, for NearbyNeighbors() and
+    /// KNearestNeighbors().
+    /// \param[in] _radius Maximum distance (meters).
+    /// \param[in] _k Maximum number of neighbors.
+    /// \return The neighbors, sorted by distance.
+    private: std::vector<NearbyNeighbor> ClosestNeighbors(
+                 const double _radius, const size_t _k) const;
+
+    /// \brief Start a sensor period, and compute its observations unless
+    /// the sensors are lazy.
     private: void UpdateSensors();
 
-    /// \brief Update terrain type
+    /// \brief Compute the observations of the period not computed yet.
+    /// \param[in] _sensors The sensors, a mask of Sensor.
+    private: void Sense(const uint8_t _sensors);
+
+    /// \brief Compute the observations of the period read by the
+    /// controller, once it's done with the step.
+    private: void SettleSensors();
+
+    /// \brief Get ready to read the observations of some sensors, which
+    /// are computed if they're not yet.
+    /// \param[in] _sensors The sensors, a mask of Sensor.
+    private: void Observe(const uint8_t _sensors) const;
+
+    /// \brief Compute the GPS observation.
+    private: void SenseGps();
+
+    /// \brief Compute the IMU observation.
+    private: void SenseImu();
+
+    /// \brief Compute the compass observation.
+    /// \param[in] _afterImu Whether the noise of the IMU was just drawn.
+    private: void SenseBearing(const bool _afterImu);
+
+    /// \brief Compute the camera observation.
+    private: void SenseCamera();
+
+    /// \brief Start a step whose entry is logged for the replay: the
+    /// messages delivered since the previous step are its own.
+    private: void RecordStep();
+
+    /// \brief Start a step replayed from the log, instead of
+    /// UpdateSensors(). The messages logged for the step are delivered, the
+    /// previous step is compared with its entry, and the observations and
+    /// neighbors of the entry are set.
+    private: void ReplayStep();
+
+    /// \brief Whether the robot may move in this step: its controller
+    /// commands a velocity the battery allows, or it follows its carrier.
+    /// \return True if the robot can't sleep.
+    private: bool Restless() const;
+
+    /// \brief Update the terrain type at the position of the robot.
     private: void UpdateTerrainType();
 
-    /// \brief Update the battery capacity.
-    private: void UpdateBattery();
+    /// \brief Find the ids of this robot and of the BOO in the pose
+    /// snapshot, after it changes, and make a docked rotor an alias of its
+    /// carrier.
+    private: void UpdatePoseIds();
+
+    /// \brief Apply the effects deferred while Update() ran on the pool of
+    /// threads.
+    private: void ApplyDeferredEffects();
+
+    /// \brief Whether the battery recharges in this step: the robot is
+    /// stopped near the BOO, or it's a rotor docked to a ground vehicle.
+    /// \return True if the battery recharges.
+    private: bool Recharging() const;
 
     /// \brief Update the linear velocity of the robot model in Gazebo.
     private: void UpdateLinearVelocity();
@@ -602,25 +1011,57 @@ namespace swarm
     /// \brief Update the angular velocity of the robot model in Gazebo.
     private: void UpdateAngularVelocity();
 
+    /// \brief Move the vehicle by the velocities of its model during a
+    /// step, in kinematic mode.
+    private: void IntegratePose();
+
     // Documentation inherited.
     private: virtual void OnLog(msgs::LogEntry &_logEntry) const;
 
+    // Documentation inherited.
+    private: virtual void OnSave(msgs::CheckpointPart &_part) const;
+
+    // Documentation inherited.
+    private: virtual bool OnRestore(const msgs::CheckpointPart &_part);
+
+    // Documentation inherited.
+    private: virtual void OnMemory(MemoryReport &_report) const;
+
     /// \brief For the observed model we decide to create a false positive
     /// based on distance a percentage of the time. If a false positive is
     /// created, we also randomly choose a duration for it. In the future and
     /// if we observe the same model '_model' and the false positive is still
     /// active, we'll replace '_model' with the same false positive.
-    /// \param[in] _model Observed model.
+    /// \param[in] _model Identifier of the observed model.
     /// \param[in] _p Position in the camera frame where the model was seen.
     /// \param[in] _normalizedDist Distance at which the object is perceived
     /// (normalized with camera frustum). The probability of creating a false
     /// positive is proportional to the distance.
     /// \param[in] _curTime Current simulation time.
-    private: void UpdateFalsePositives(const std::string &_model,
+    private: void UpdateFalsePositives(const int _model,
                                        const ignition::math::Pose3d &_p,
                                        const double _normalizedDist,
                                        const gazebo::common::Time &_curTime);
 
+    /// \brief Get the identifier of a model seen by the camera: its position
+    /// in the names of the scene index, followed by the models that are not
+    /// in the index.
+    /// \param[in] _name Name of the model.
+    /// \return The identifier.
+    private: int CameraModelId(const std::string &_name);
+
+    /// \brief Get the name of a model seen by the camera.
+    /// \param[in] _id Identifier of the model.
+    /// \return The name.
+    /// \sa CameraModelId
+    private: const std::string &CameraModelName(const int _id) const;
+
+    /// \brief Record the pose of a model in the current camera image,
+    /// replacing the previous one of the same model.
+    /// \param[in] _id Identifier of the model.
+    /// \param[in] _pose Pose in the camera frame.
+    private: void Detect(const int _id, const ignition::math::Pose3d &_pose);
+
     /// \def Callback_t
     /// \brief The callback specified by the user when new data is available.
     /// This callback contains two parameters: the source address of the agent
@@ -631,6 +1072,16 @@ namespace swarm
                        const uint32_t _dstPort,
                        const std::string &_data)>;
 
+    /// \brief Bind the unicast or multicast endpoint of an address and a
+    /// port, and the broadcast one of the port for a unicast address.
+    /// \param[in] _address Local address or "kMulticast".
+    /// \param[in] _port The port.
+    /// \param[in] _cb Callback of the endpoints, or an empty one for the
+    /// endpoints delivered in a batch.
+    /// \return True when success or false otherwise.
+    private: bool BindEndPoints(const std::string &_address, const int _port,
+                                const Callback_t &_cb);
+
     /// \brief Address used to send a message to all the members of the swarm
     /// listening on a specific port.
     protected: const std::string kBroadcast = "broadcast";
@@ -680,15 +1131,45 @@ namespace swarm
     /// \brief Addresses of all the local neighbors.
     private: std::vector<std::string> neighbors;
 
+    /// \brief Number of neighbor updates received.
+    private: uint64_t neighborsVersion = 0;
+
+    /// \brief Index of each local neighbor in the positions of the broker,
+    /// or -1, for ClosestNeighbors().
+    private: mutable std::vector<int> neighborMembers;
+
+    /// \brief Version of the neighbors in neighborMembers.
+    private: mutable uint64_t neighborMembersVersion = 0;
+
+    /// \brief Version of the members of the broker in neighborMembers.
+    private: mutable uint64_t brokerMembersVersion = 0;
+
     // The gazebo transport node. Used for debugging, see source.
     // private: gazebo::transport::NodePtr gzNode;
 
     // Used to publish markers, Used for debugging, see source.
     // private: gazebo::transport::PublisherPtr markerPub;
 
-    /// \brief User callbacks. The key is the topic name
-    /// (e.g.: "/swarm/192.168.2.1/4000") and the value is the user callback.
-    private: std::map<std::string, Callback_t> callbacks;
+    /// \brief User callbacks, one for each endpoint bound. The index of a
+    /// callback is stored by the broker with the endpoint.
+    /// \sa BrokerClientInfo::callback
+    private: std::vector<Callback_t> callbacks;
+
+    /// \brief Index of the callback of each endpoint bound, as
+    /// "<address>:<port>", to deliver the messages of the replay.
+    private: std::map<std::string, unsigned int> callbackIndices;
+
+    /// \brief User callback of the endpoints bound with BindBatch().
+    private: std::function<void(const std::vector<DatagramPtr> &)>
+      batchCallback;
+
+    /// \brief Messages received for the endpoints bound with BindBatch(),
+    /// waiting for DeliverBatch(). The broker delivers through a const
+    /// handler.
+    private: mutable std::vector<DatagramPtr> batchInbox;
+
+    /// \brief Messages being delivered by DeliverBatch().
+    private: std::vector<DatagramPtr> batch;
 
     /// \brief Pointer to the model;
     private: gazebo::physics::ModelPtr model;
@@ -696,9 +1177,6 @@ namespace swarm
     /// \brief Local address.
     private: std::string address;
 
-    /// \brief Pointer to the update event connection.
-    private: gazebo::event::ConnectionPtr updateConnection;
-
     /// \brief Type of vehicle.
     private: VehicleType type;
 
@@ -711,6 +1189,17 @@ namespace swarm
     /// \brief Pointer to LogicalCamera sensor
     private: gazebo::sensors::LogicalCameraSensorPtr camera;
 
+    /// \brief Camera index of the world, when the frustum of the camera is
+    /// tested by it instead of the logical camera sensor.
+    private: CameraIndex *cameraIndex = nullptr;
+
+    /// \brief Entity the camera is attached to.
+    private: gazebo::physics::EntityPtr cameraParent;
+
+    /// \brief Models seen by the camera in the last sensor update, before
+    /// the noise.
+    private: std::vector<CameraObject> cameraObjects;
+
     /// \brief Mutex to protect shared member variables.
     private: mutable std::mutex mutex;
 
@@ -740,8 +1229,18 @@ namespace swarm
     /// \brief Bearing between the true North and the robot.
     private: ignition::math::Angle observedBearing;
 
-    /// \brief Logical image observed by the robot's camera.
-    private: ImageData img;
+    /// \brief Logical image observed by the robot's camera, by model
+    /// identifier. Image() turns it into names.
+    private: std::vector<CameraObject> detections;
+
+    /// \brief Names and poses of the detections, sorted by name to fill
+    /// the log entry. Kept to reuse its memory at each entry.
+    private: mutable std::vector<std::pair<const std::string *,
+        const ignition::math::Pose3d *>> logObjects;
+
+    /// \brief Names of the models seen by the camera that are not in the
+    /// scene index, following its names.
+    private: std::vector<std::string> extraModelNames;
 
     /// \brief Target linear velocity in the robot's local coordinate frame.
     /// Units: m/s.
@@ -762,7 +1261,8 @@ namespace swarm
     /// \brief The capacity at start. This is used to handle reset.
     private: double startCapacity;
 
-    /// \brief Milli-Amp-Hour battery capacity
+    /// \brief Milli-Amp-Hour battery capacity, until the robot is
+    /// registered with the executor.
     private: double capacity;
 
     /// \brief Milli-Amp vehicle consumption
@@ -803,20 +1303,94 @@ namespace swarm
     /// \brief Max position error in objects detected by the camera
     private: double cameraMaxPositionError = 5.0;
 
-    /// \brief The key is the real model perceived by the camera and the value
-    /// is an object that contains information about this false positive
-    /// (the duration and the model that will replace the real model observed).
-    public: std::map<std::string, FalsePositiveData> camFalsePositiveModels;
+    /// \brief Key of the random streams of this robot, from its address.
+    private: uint64_t randomKey = 0;
+
+    /// \brief Noise of the GPS, IMU and compass, at the block of the step.
+    private: RandomStream sensorNoise;
+
+    /// \brief Noise of the camera, at the block of the step.
+    private: RandomStream cameraNoise;
+
+    /// \brief The sensors, as a mask.
+    private: enum Sensor : uint8_t
+             {
+               /// \brief The GPS.
+               GPS_SENSOR = 1,
+
+               /// \brief The IMU.
+               IMU_SENSOR = 2,
+
+               /// \brief The compass.
+               BEARING_SENSOR = 4,
+
+               /// \brief The camera.
+               CAMERA_SENSOR = 8,
+
+               /// \brief All of them.
+               ALL_SENSORS = 15
+             };
+
+    /// \brief Whether the observations are computed on first access.
+    private: bool lazySensors = false;
+
+    /// \brief The sensors whose observation of the period isn't computed.
+    private: mutable uint8_t pendingSensors = 0;
+
+    /// \brief The sensors read since the simulation started.
+    private: mutable uint8_t usedSensors = 0;
+
+    /// \brief Simulation time of the sensor period.
+    private: gazebo::common::Time sensorTime;
+
+    /// \brief Iteration of the world at the sensor period, the block of the
+    /// noise.
+    private: uint64_t sensorIterations = 0;
 
-    /// \brief Array of all the models
-    private: std::vector<std::string> modelNames;
+    /// \brief The false positives in progress, one per real model perceived
+    /// by the camera, with their duration and the model that replaces the
+    /// real model observed.
+    public: std::vector<FalsePositiveData> camFalsePositiveModels;
 
-    /// \brief Pointer to the shared broker.
+    /// \brief Index of the world, shared by all the robots.
+    private: std::shared_ptr<const SceneIndex> scene;
+
+    /// \brief Position of this model in the names of the scene index, or
+    /// -1 if it's not in the index.
+    private: int modelId = -1;
+
+    /// \brief Pointer to the broker of the world.
     private: Broker *broker = Broker::Instance();
 
-    /// \brief Pointer to the shared logger.
+    /// \brief Pointer to the logger of the world.
     private: Logger *logger = Logger::Instance();
 
+    /// \brief Checkpointer of the world, null until the robot is loaded.
+    private: Checkpointer *checkpointer = nullptr;
+
+    /// \brief Memory accounting of the world, null until the robot is
+    /// loaded.
+    private: MemoryAccounting *memory = nullptr;
+
+    /// \brief Pointer to the pose snapshot of the world.
+    private: PoseSnapshot *poses = PoseSnapshot::Instance();
+
+    /// \brief Id of this robot in the pose snapshot, -1 if unknown.
+    private: int poseId = -1;
+
+    /// \brief Id of the BOO in the pose snapshot, -1 if unknown.
+    private: int booPoseId = -1;
+
+    /// \brief Version of the pose snapshot when the ids were found.
+    private: uint64_t posesVersion = 0;
+
+    /// \brief Id of the vehicle this rotor is docked to in the pose
+    /// snapshot, or -1 if it wasn't found yet.
+    private: int dockPoseId = -1;
+
+    /// \brief Vehicle whose id is dockPoseId.
+    private: gazebo::physics::ModelPtr dockPoseModel;
+
     /// \brief Flag used by rotorcraft to determine if it's docked to
     /// a vehicle.
     private: bool rotorDocked = true;
@@ -843,15 +1417,6 @@ namespace swarm
     /// \brief Camera start yaw
     private: double cameraStartYaw = 0.0;
 
-    /// \brief For computing dt.
-    private: gazebo::common::Time lastSensorUpdateTime;
-
-    /// \brief For computing terrain update times.
-    private: gazebo::common::Time lastTerrainUpdateTime;
-
-    /// \brief For computing controller update times.
-    private: gazebo::common::Time lastControllerUpdateTime;
-
     /// \brief Rate at which the sensors should update.
     private: double sensorsUpdateRate = 20.0;
 
@@ -865,9 +1430,6 @@ namespace swarm
     /// plugins
     private: Common common;
 
-    /// \brief Store the forest and building bounding boxes.
-    private: std::vector<ignition::math::Box> boundingBoxes;
-
     /// \brief Mutex to protect access to common Python-related variables
     private: static std::mutex pMutex;
 
@@ -879,6 +1441,16 @@ namespace swarm
     //  including Python.h
     private: static void *pModule, *pDict, *pUpdateFunc, *pOnDataReceivedFunc;
 
+    /// \brief Batched Python update function, or NULL.
+    private: static void *pUpdateAllFunc;
+
+    /// \brief Simulation time of the last batched or out of process Python
+    /// update. A Time compares its integer seconds and nanoseconds.
+    private: static gazebo::common::Time pStepTime;
+
+    /// \brief Worker processes running the Python controllers, or null.
+    private: static std::unique_ptr<PythonWorkers> pWorkers;
+
     /// \brief BooPlugin needs access to some of the private member variables.
     friend class BooPlugin;
 
@@ -886,6 +1458,87 @@ namespace swarm
     /// functions.
     friend class BrokerPlugin;
 
+    /// \brief SwarmExecutor runs the private steps of the robot.
+    friend class SwarmExecutor;
+
+    /// \brief Executor that steps the robot, or null until it's loaded.
+    private: SwarmExecutor *executor = nullptr;
+
+    /// \brief Slot of the robot in the executor.
+    private: size_t executorSlot = 0;
+
+    /// \brief Whether Update() can run on the pool of threads of the
+    /// executor.
+    private: bool parallelController = false;
+
+    /// \brief Maximum number of controller updates of the swarm in a step
+    /// requested by this robot, 0 for no limit.
+    private: unsigned int controllerBudget = 0;
+
+    /// \brief Wall time allowed to each update of the controller (s), 0 for
+    /// no budget.
+    private: double controllerTimeBudget = 0;
+
+    /// \brief What happens when the controller exceeds its time budget.
+    private: SwarmExecutor::OverrunPolicy controllerOverrunPolicy =
+        SwarmExecutor::OVERRUN_NONE;
+
+    /// \brief Overruns in a row that trigger the overrun policy.
+    private: unsigned int controllerOverrunLimit = 3;
+
+    /// \brief Whether the pose is integrated by the executor instead of
+    /// the physics engine.
+    private: bool kinematic = false;
+
+    /// \brief Messages being built by SendBatch().
+    private: std::vector<DatagramPtr> outgoingBatch;
+
+    /// \brief Whether SendTo() and SetCameraOrientation() are deferred,
+    /// while Update() runs on the pool of threads.
+    private: bool deferEffects = false;
+
+    /// \brief Messages sent while the effects are deferred.
+    private: std::vector<DatagramPtr> deferredMsgs;
+
+    /// \brief Whether the camera orientation was set while the effects are
+    /// deferred.
+    private: bool deferredCamera = false;
+
+    /// \brief Deferred camera pitch.
+    private: double deferredPitch = 0;
+
+    /// \brief Deferred camera yaw.
+    private: double deferredYaw = 0;
+
+    /// \brief Whether the entries of the robot hold what the replay needs.
+    private: bool recordReplay = false;
+
+    /// \brief The replayed log, or null if the robot isn't replayed.
+    private: ReplayLog *replayLog = nullptr;
+
+    /// \brief Entry of the previous replayed step, or null.
+    private: const msgs::LogEntry *replayEntry = nullptr;
+
+    /// \brief Messages delivered since the last step. The broker delivers
+    /// through a const handler.
+    private: mutable std::vector<DatagramPtr> replayPending;
+
+    /// \brief Messages delivered for the steps not logged yet.
+    private: mutable std::vector<DatagramPtr> replayDelivered;
+
+    /// \brief Messages sent since the previous entry, or the previous step
+    /// when replayed.
+    private: mutable std::vector<DatagramPtr> replaySent;
+
+    /// \brief Simulation time of the last step (s).
+    private: double replayStepTime = 0;
+
+    /// \brief Neighbors at the last step.
+    private: std::vector<std::string> replayNeighbors;
+
+    /// \brief Version of the neighbors in replayNeighbors.
+    private: uint64_t replayNeighborsVersion = 0;
+
     /// \brief the maximum physics step-size
     protected: double maxStepSize;
   };
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file RunSummary.hh
+/// \brief Totals of a run that its summary is computed from.
+
+#ifndef __SWARM_RUN_SUMMARY_HH__
+#define __SWARM_RUN_SUMMARY_HH__
+
+#include <string>
+
+#include "msgs/log_entry_min.pb.h"
+#include "msgs/log_header.pb.h"
+#include "msgs/run_summary.pb.h"
+#include "swarm/Helpers.hh"
+#include "swarm/LogFormat.hh"
+
+namespace swarm
+{
+  /// \brief Rates of the comms of a step.
+  class StepRates
+  {
+    /// \brief Messages sent per second.
+    public: double msgFreq = 0;
+
+    /// \brief Fraction of the potential recipients that didn't receive the
+    /// messages.
+    public: double dropRatio = 0;
+
+    /// \brief Bits sent per second.
+    public: double dataRate = 0;
+  };
+
+  /// \brief Get the path of the summary of a log.
+  /// \param[in] _logPath Path of the log, e.g. swarm.log.
+  /// \return The path with the .summary extension, e.g. swarm.summary.
+  IGNITION_VISIBLE std::string RunSummaryPath(const std::string &_logPath);
+
+  /// \brief Adds up the steps and the entries of a minimal log into the
+  /// totals that the summary of the run is computed from, the way the
+  /// report of swarmlog --analyze reads them. The logger adds the entries
+  /// while they're logged, and writes the totals next to the log when it's
+  /// closed, so the summary is written without reading the log again:
+  ///
+  /// RunSummary summary(header);
+  /// for each step: summary.AddStep(record); summary.AddEntry(entry);
+  /// summary.Write(RunSummaryPath("swarm.log"));
+  class IGNITION_VISIBLE RunSummary
+  {
+    /// \brief Constructor, without a log.
+    public: RunSummary();
+
+    /// \brief Constructor.
+    /// \param[in] _header Header of the log summarized.
+    public: explicit RunSummary(const msgs::LogHeader &_header);
+
+    /// \brief Get the scalars of a minimal entry, as in the records.
+    /// \param[in] _entry The entry.
+    /// \return The scalars.
+    public: static LogMinRecord Record(const msgs::LogEntryMin &_entry);
+
+    /// \brief Add the comms of a step.
+    /// \param[in] _step The scalars of the step.
+    /// \return The rates of the step.
+    public: StepRates AddStep(const LogMinRecord &_step);
+
+    /// \brief Add the timings, the connectivity and the reports of the BOO
+    /// of a minimal entry, and its time.
+    /// \param[in] _entry The entry.
+    public: void AddEntry(const msgs::LogEntryMin &_entry);
+
+    /// \brief Add a report of the BOO.
+    /// \param[in] _report The report.
+    public: void AddBooReport(const msgs::BooReport &_report);
+
+    /// \brief Update the duration of the run, until the lost person is
+    /// found, and the time of the last entry.
+    /// \param[in] _time Simulation time of an entry.
+    public: void UpdateDuration(const double _time);
+
+    /// \brief Get the totals, with the connectivity held until the last
+    /// entry.
+    /// \return The totals.
+    public: msgs::RunSummary Totals() const;
+
+    /// \brief Continue from the totals of a run, e.g. of a checkpoint. The
+    /// timestamp of the log summarized is kept.
+    /// \param[in] _totals The totals.
+    public: void Restore(const msgs::RunSummary &_totals);
+
+    /// \brief Write the totals into a file.
+    /// \param[in] _path Path of the file, from RunSummaryPath().
+    /// \return True if the file was written.
+    public: bool Write(const std::string &_path) const;
+
+    /// \brief Read the totals written by Write().
+    /// \param[in] _path Path of the file.
+    /// \param[out] _totals The totals.
+    /// \return True if the file was read.
+    public: static bool Read(const std::string &_path,
+                             msgs::RunSummary &_totals);
+
+    /// \brief Add the last connectivity to some totals, weighted by the
+    /// time that it held.
+    /// \param[in] _time Simulation time until which it held.
+    /// \param[in,out] _totals The totals.
+    private: static void AddConnectivity(const double _time,
+                                         msgs::RunSummary &_totals);
+
+    /// \brief The totals so far.
+    private: msgs::RunSummary totals;
+  };
+}
+#endif
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file SceneIndex.hh
+/// \brief Static contents of a world, shared by all its plugins.
+
+#ifndef __SWARM_SCENE_INDEX_HH__
+#define __SWARM_SCENE_INDEX_HH__
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <ignition/math/Box.hh>
+#include <ignition/math/Vector3.hh>
+#include "gazebo/physics/PhysicsTypes.hh"
+
+#include "swarm/BoxHierarchy.hh"
+#include "swarm/Heightmap.hh"
+#include "swarm/Helpers.hh"
+#include "swarm/MemoryAccounting.hh"
+#include "swarm/TerrainRaster.hh"
+#include "swarm/TerrainTiles.hh"
+#include "swarm/WorldCache.hh"
+
+namespace swarm
+{
+  /// \brief Index of the static contents of a world: the names of the
+  /// models, the bounding boxes of the trees and the buildings with their
+  /// hierarchies, and the terrain.
+  ///
+  /// The index of a world is built the first time a plugin asks for it,
+  /// once all the models of the world are loaded, and it's shared read-only
+  /// by all the plugins, so each robot doesn't scan the models and copy the
+  /// heightmap again. The const methods can be called from multiple
+  /// threads.
+  ///
+  /// When the SWARM_TERRAIN_TILES environment variable names a file, the
+  /// terrain lookups read the TerrainTiles of that file, shared by every
+  /// world of the process, and the samples are only copied into a
+  /// Heightmap the first time TerrainHeightmap() is called, e.g. for the
+  /// line of sight tests of the broker. A missing file is written from
+  /// the terrain, and a file of another terrain is ignored.
+  /// SWARM_TERRAIN_TILE_CACHE sets the number of decompressed tiles kept
+  /// in memory.
+  ///
+  /// When the SWARM_WORLD_CACHE environment variable names a file, the
+  /// boxes of the trees and the buildings are read from the WorldCache of
+  /// that file, instead of the models, if it was written for the same
+  /// world SDF and terrain. Otherwise the file is rewritten once the
+  /// terrain raster is built, see StoreCache().
+  class IGNITION_VISIBLE SceneIndex
+  {
+    /// \brief Get the index of a world, building it the first time.
+    /// \param[in] _world The world.
+    /// \return The index shared by all the plugins of the world.
+    public: static std::shared_ptr<const SceneIndex> Instance(
+                gazebo::physics::WorldPtr _world);
+
+    /// \brief Add a model. Trees and buildings are recognized by their
+    /// name, and the ground plane is ignored.
+    /// \param[in] _name Name of the model.
+    /// \param[in] _box Bounding box of the model.
+    public: void AddModel(const std::string &_name,
+                          const ignition::math::Box &_box);
+
+    /// \brief Set the terrain, copying its samples or loading its tiles.
+    /// \param[in] _terrain Pointer to the heightmap shape.
+    public: void SetTerrain(gazebo::physics::HeightmapShapePtr _terrain);
+
+    /// \brief Build the hierarchies of the trees and the buildings. Called
+    /// once all the models are added.
+    public: void Build();
+
+    /// \brief Names of the models, except the ground plane, in the order
+    /// they were added.
+    /// \return The names.
+    public: const std::vector<std::string> &ModelNames() const;
+
+    /// \brief Get the position of a model in ModelNames().
+    /// \param[in] _name Name of the model.
+    /// \return The index of the name, or -1 if it's not in the index.
+    public: int ModelId(const std::string &_name) const;
+
+    /// \brief Bounding boxes of the trees.
+    /// \return The boxes.
+    public: const std::vector<ignition::math::Box> &TreeBoxes() const;
+
+    /// \brief Bounding boxes of the buildings.
+    /// \return The boxes.
+    public: const std::vector<ignition::math::Box> &BuildingBoxes() const;
+
+    /// \brief Hierarchy of the bounding boxes of the trees.
+    /// \return The hierarchy.
+    public: const BoxHierarchy &Trees() const;
+
+    /// \brief Hierarchy of the bounding boxes of the buildings.
+    /// \return The hierarchy.
+    public: const BoxHierarchy &Buildings() const;
+
+    /// \brief Get a pointer to the terrain.
+    /// \return Pointer to the terrain, or null if there is none.
+    public: gazebo::physics::HeightmapShapePtr Terrain() const;
+
+    /// \brief Get the size of the terrain.
+    /// \return Terrain size.
+    public: const ignition::math::Vector3d &TerrainSize() const;
+
+    /// \brief Get the samples of the terrain. With tiles, the samples are
+    /// copied by the first call.
+    /// \return The heightmap. It's not valid if there is no terrain.
+    public: const Heightmap &TerrainHeightmap() const;
+
+    /// \brief Get the tiles of the terrain.
+    /// \return The tiles, or null if the lookups use the heightmap.
+    public: std::shared_ptr<const TerrainTiles> TerrainTileStore() const;
+
+    /// \brief Hash of the samples of the terrain.
+    /// \return The hash, or 0 if there is no terrain.
+    /// \sa Heightmap::Hash()
+    public: uint64_t TerrainHash() const;
+
+    /// \brief Get the height of the surface of the terrain and its normal
+    /// at several coordinates, from the tiles or the heightmap. Nothing is
+    /// written if there is no terrain.
+    /// \param[in] _count Number of coordinates.
+    /// \param[in] _x X world coordinates.
+    /// \param[in] _y Y world coordinates.
+    /// \param[out] _height Height of the surface at each coordinate (m).
+    /// \param[out] _norm Normal of the surface at each coordinate. It can
+    /// be null if the normals aren't needed.
+    /// \sa Heightmap::Lookup(const size_t, const double *, const double *,
+    /// double *, ignition::math::Vector3d *) const
+    public: void TerrainLookup(const size_t _count, const double *_x,
+                               const double *_y, double *_height,
+                               ignition::math::Vector3d *_norm) const;
+
+    /// \brief Decompress the tiles around a position in the background.
+    /// Does nothing without tiles.
+    /// \param[in] _pos Position, in world coordinates.
+    /// \param[in] _radius Distance around the position (m).
+    /// \sa TerrainTiles::Prefetch()
+    public: void PrefetchTerrain(const ignition::math::Vector3d &_pos,
+                                 const double _radius) const;
+
+    /// \brief Get the startup cache of the world.
+    /// \return The cache, or null unless SWARM_WORLD_CACHE names a cache
+    /// of this world.
+    public: std::shared_ptr<const WorldCache> Cache() const;
+
+    /// \brief Write the startup cache of the world, with the boxes of the
+    /// trees and the buildings and a terrain raster. Does nothing unless
+    /// SWARM_WORLD_CACHE is set and its file didn't match the world.
+    /// \param[in] _raster The terrain raster of the world.
+    public: void StoreCache(const TerrainRaster &_raster) const;
+
+    /// \brief Add the memory of the index to the "scene_index" subsystem.
+    /// \param[in,out] _report The report.
+    public: void OnMemory(MemoryReport &_report) const;
+
+    /// \brief Names of the models.
+    private: std::vector<std::string> modelNames;
+
+    /// \brief Position of each name in modelNames.
+    private: std::unordered_map<std::string, int> modelIds;
+
+    /// \brief Bounding boxes of the trees.
+    private: std::vector<ignition::math::Box> treeBoxes;
+
+    /// \brief Bounding boxes of the buildings.
+    private: std::vector<ignition::math::Box> buildingBoxes;
+
+    /// \brief Hierarchy of the trees.
+    private: BoxHierarchy trees;
+
+    /// \brief Hierarchy of the buildings.
+    private: BoxHierarchy buildings;
+
+    /// \brief Pointer to the terrain.
+    private: gazebo::physics::HeightmapShapePtr terrain;
+
+    /// \brief Size of the terrain.
+    private: ignition::math::Vector3d terrainSize;
+
+    /// \brief Copy the samples of the terrain into the heightmap.
+    private: void LoadHeightmap() const;
+
+    /// \brief Copy of the samples of the terrain.
+    private: mutable Heightmap heightmap;
+
+    /// \brief Whether heightmap holds the samples of the terrain.
+    private: mutable std::atomic<bool> heightmapLoaded{false};
+
+    /// \brief Protects the copy of the samples into the heightmap.
+    private: mutable std::mutex heightmapMutex;
+
+    /// \brief Tiles of the terrain, null if the lookups use the heightmap.
+    private: std::shared_ptr<TerrainTiles> tiles;
+
+    /// \brief Load the startup cache named by SWARM_WORLD_CACHE, if it
+    /// matches the world. The terrain must be set.
+    /// \param[in] _world The world.
+    private: void LoadCache(gazebo::physics::WorldPtr _world);
+
+    /// \brief Path of the startup cache, empty if disabled.
+    private: std::string cachePath;
+
+    /// \brief WorldCache::HashWorld() of the world.
+    private: uint64_t cacheHash = 0;
+
+    /// \brief The startup cache, null if it didn't match the world.
+    private: std::shared_ptr<const WorldCache> cache;
+  };
+}
+#endif
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file StepTimers.hh
+/// \brief Time spent by the subsystems of the simulation in each step.
+
+#ifndef __SWARM_STEP_TIMERS_HH__
+#define __SWARM_STEP_TIMERS_HH__
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "swarm/Helpers.hh"
+#include "swarm/StepTrace.hh"
+
+namespace swarm
+{
+  /// \brief The subsystems timed in each step.
+  enum StepTimer
+  {
+    /// \brief CommsModel::Update().
+    TIMER_COMMS_MODEL = 0,
+
+    /// \brief BrokerPlugin::NotifyNeighbors().
+    TIMER_NOTIFY_NEIGHBORS,
+
+    /// \brief BrokerPlugin::DispatchMessages().
+    TIMER_DISPATCH,
+
+    /// \brief Delivery of the messages scheduled by the latency.
+    TIMER_DELIVERY,
+
+    /// \brief Logger::Update().
+    TIMER_LOGGER,
+
+    /// \brief Poses, terrain types and batteries of the robots.
+    TIMER_POSES,
+
+    /// \brief Sensors of the robots.
+    TIMER_SENSORS,
+
+    /// \brief Controllers of the robots, with the batched messages.
+    TIMER_CONTROLLERS,
+
+    /// \brief Velocities and poses set by the controllers.
+    TIMER_ACTUATION,
+
+    /// \brief Number of timers.
+    TIMER_COUNT
+  };
+
+  /// \brief Accumulates the time spent by each subsystem of the simulation
+  /// of a world, until the broker writes it into its log entry.
+  ///
+  /// The timers are enabled by setting the SWARM_STEP_TIMERS environment
+  /// variable to 1. Each ScopedStepTimer reads the time stamp counter of the
+  /// CPU, where available, so a disabled timer costs a branch. Define
+  /// SWARM_NO_STEP_TIMERS to compile them out. With SWARM_STEP_TRACE, each
+  /// timer also records its span into the StepTrace of the world.
+  class IGNITION_VISIBLE StepTimers
+  {
+    /// \brief Get the timers of a world.
+    /// \param[in] _world Name of the world.
+    /// \return Pointer to the timers of the world.
+    public: static StepTimers *Instance(const std::string &_world);
+
+    /// \brief Whether the timers are accumulating.
+    /// \return True if SWARM_STEP_TIMERS is 1.
+    public: bool Enabled() const
+    {
+      return this->enabled;
+    }
+
+    /// \brief Get the trace of the world.
+    /// \return The trace, or nullptr if disabled.
+    public: StepTrace *Trace() const
+    {
+      return this->trace;
+    }
+
+    /// \brief Get the name of a subsystem, as in the log entries.
+    /// \param[in] _timer The subsystem.
+    /// \return The name.
+    public: static const char *Name(const StepTimer _timer);
+
+    /// \brief Read the clock of the timers.
+    /// \return The ticks of the time stamp counter, or nanoseconds where
+    /// there is none.
+    public: static uint64_t Now()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      return __rdtsc();
+#else
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    /// \brief Add the time spent by a subsystem.
+    /// \param[in] _timer The subsystem.
+    /// \param[in] _ticks Ticks of Now().
+    public: void Add(const StepTimer _timer, const uint64_t _ticks)
+    {
+      this->ticks[_timer] += _ticks;
+    }
+
+    /// \brief Count a simulation step.
+    public: void Step()
+    {
+      ++this->steps;
+    }
+
+    /// \brief Get the time accumulated since the previous call, and start
+    /// again.
+    /// \param[out] _ns Nanoseconds spent by each subsystem.
+    /// \return Number of steps counted since the previous call.
+    public: uint32_t Collect(uint64_t _ns[TIMER_COUNT]);
+
+    /// \brief Constructor.
+    private: StepTimers();
+
+    /// \brief Whether the timers are accumulating.
+    private: bool enabled = false;
+
+    /// \brief Trace of the world, or nullptr.
+    private: StepTrace *trace = nullptr;
+
+    /// \brief Ticks accumulated by each subsystem.
+    private: uint64_t ticks[TIMER_COUNT] = {};
+
+    /// \brief Steps counted.
+    private: uint32_t steps = 0;
+
+    /// \brief Ticks of Now() at the construction, to convert the ticks
+    /// into nanoseconds.
+    private: uint64_t startTicks;
+
+    /// \brief Steady clock at the construction.
+    private: std::chrono::steady_clock::time_point startTime;
+  };
+
+  /// \brief Adds the time spent in a scope to a StepTimers.
+  class ScopedStepTimer
+  {
+#ifndef SWARM_NO_STEP_TIMERS
+    /// \brief Constructor.
+    /// \param[in] _timers The timers, or nullptr.
+    /// \param[in] _timer The subsystem.
+    public: ScopedStepTimer(StepTimers *_timers, const StepTimer _timer)
+      : timers(_timers && _timers->Enabled() ? _timers : nullptr),
+        timer(_timer),
+        start(this->timers ? StepTimers::Now() : 0),
+        span(_timers ? _timers->Trace() : nullptr, StepTimers::Name(_timer))
+    {
+    }
+
+    /// \brief Destructor.
+    public: ~ScopedStepTimer()
+    {
+      if (this->timers)
+        this->timers->Add(this->timer, StepTimers::Now() - this->start);
+    }
+
+    /// \brief The timers, or nullptr if disabled.
+    private: StepTimers *timers;
+
+    /// \brief The subsystem.
+    private: const StepTimer timer;
+
+    /// \brief Ticks at the construction.
+    private: const uint64_t start;
+
+    /// \brief Span in the trace.
+    private: ScopedTraceSpan span;
+#else
+    /// \brief Constructor.
+    public: ScopedStepTimer(StepTimers *, const StepTimer)
+    {
+    }
+#endif
+  };
+}
+#endif
@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file StepTrace.hh
+/// \brief Spans of the phases of the last steps of a simulation, written
+/// as Chrome traces.
+
+#ifndef __SWARM_STEP_TRACE_HH__
+#define __SWARM_STEP_TRACE_HH__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "swarm/Helpers.hh"
+
+namespace swarm
+{
+  /// \brief Records the spans of the phases of each step of a world into a
+  /// ring buffer, and writes them as Chrome trace events (JSON), viewed in
+  /// chrome://tracing or Perfetto.
+  ///
+  /// The trace is enabled by setting SWARM_STEP_TRACE to the prefix of the
+  /// files written, <prefix>-<n>.json. The ring keeps the last
+  /// SWARM_STEP_TRACE_SPANS spans (default 65536), and is written at the end
+  /// of the step after the process receives a SIGUSR2, and when a step takes
+  /// longer than SWARM_STEP_TRACE_THRESHOLD milliseconds, unless the spans of
+  /// the previous write haven't been overwritten yet. The phases of
+  /// StepTimers, the controller and the sensors of each robot, and the
+  /// stages of the comms model are traced. Define SWARM_NO_STEP_TIMERS to
+  /// compile the spans out.
+  class IGNITION_VISIBLE StepTrace
+  {
+    /// \brief A phase traced.
+    public: struct Span
+    {
+      /// \brief Name of the phase, a string literal.
+      const char *name = nullptr;
+
+      /// \brief Label of the span, e.g. the robot, or -1.
+      int32_t label = -1;
+
+      /// \brief Thread that ran the phase, numbered from 0.
+      uint32_t thread = 0;
+
+      /// \brief Step of the span.
+      uint64_t step = 0;
+
+      /// \brief Start of the phase (ns since the trace started).
+      int64_t start = 0;
+
+      /// \brief End of the phase (ns since the trace started).
+      int64_t end = 0;
+    };
+
+    /// \brief Get the trace of a world.
+    /// \param[in] _world Name of the world.
+    /// \return Pointer to the trace of the world, or nullptr if
+    /// SWARM_STEP_TRACE isn't set.
+    public: static StepTrace *Instance(const std::string &_world);
+
+    /// \brief Constructor.
+    /// \param[in] _capacity Number of spans in the ring.
+    /// \param[in] _thresholdMs Steps longer than this are written (ms), or
+    /// 0 to only write them on demand.
+    /// \param[in] _prefix Prefix of the files written.
+    public: StepTrace(const size_t _capacity, const double _thresholdMs,
+                      const std::string &_prefix);
+
+    /// \brief Read the clock of the trace.
+    /// \return Nanoseconds since the trace started.
+    public: int64_t Now() const
+    {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - this->startTime).count();
+    }
+
+    /// \brief Get the label of a name, e.g. the address of a robot. Look it
+    /// up once, since it takes a lock.
+    /// \param[in] _name The name.
+    /// \return The label, the same for the same name.
+    public: int32_t Label(const std::string &_name);
+
+    /// \brief Add a span to the ring. It may be called from any thread.
+    /// \param[in] _name Name of the phase, a string literal.
+    /// \param[in] _label Label of the span, or -1.
+    /// \param[in] _start Start of the phase, from Now().
+    /// \param[in] _end End of the phase, from Now().
+    public: void Record(const char *_name, const int32_t _label,
+                        const int64_t _start, const int64_t _end);
+
+    /// \brief Start a step.
+    /// \param[in] _step The step.
+    public: void BeginStep(const uint64_t _step);
+
+    /// \brief End the step, recording its span, and write the ring if the
+    /// step was slow or the process received a SIGUSR2.
+    public: void EndStep();
+
+    /// \brief Get the spans in the ring, oldest first.
+    /// \return The spans.
+    public: std::vector<Span> Spans() const;
+
+    /// \brief Write the spans in the ring as Chrome trace events.
+    /// \param[out] _out The stream.
+    public: void Write(std::ostream &_out) const;
+
+    /// \brief Write the spans in the ring into the next file of the prefix.
+    /// \param[in] _reason Why the trace is written, for the message.
+    /// \return True if the file was written.
+    public: bool Dump(const std::string &_reason);
+
+    /// \brief Number of spans recorded since the construction.
+    /// \return The spans.
+    public: uint64_t Recorded() const;
+
+    /// \brief Handle a SIGUSR2, counting it.
+    /// \param[in] _signal The signal.
+    private: static void OnSignal(int _signal);
+
+    /// \brief Number of the calling thread.
+    /// \return The number.
+    private: static uint32_t ThreadNumber();
+
+    /// \brief Protects the ring and the labels.
+    private: mutable std::mutex mutex;
+
+    /// \brief The ring of spans.
+    private: std::vector<Span> ring;
+
+    /// \brief Spans recorded, the next one going to ring[recorded % size].
+    private: uint64_t recorded = 0;
+
+    /// \brief Value of recorded at the last write.
+    private: uint64_t dumpedAt = 0;
+
+    /// \brief Whether a file was written.
+    private: bool dumped = false;
+
+    /// \brief The labels, by name.
+    private: std::map<std::string, int32_t> labelIds;
+
+    /// \brief The names, by label.
+    private: std::vector<std::string> labels;
+
+    /// \brief Steps longer than this are written (ns), 0 if never.
+    private: int64_t threshold = 0;
+
+    /// \brief Prefix of the files written.
+    private: std::string prefix;
+
+    /// \brief Number of the next file.
+    private: unsigned int files = 0;
+
+    /// \brief The current step.
+    private: std::atomic<uint64_t> step;
+
+    /// \brief Start of the current step, from Now().
+    private: int64_t stepStart = -1;
+
+    /// \brief Signals handled by this trace.
+    private: uint32_t handledSignals = 0;
+
+    /// \brief Signals received by the process.
+    private: static std::atomic<uint32_t> signals;
+
+    /// \brief Steady clock at the construction.
+    private: std::chrono::steady_clock::time_point startTime;
+  };
+
+  /// \brief Records the duration of a scope into a StepTrace.
+  class ScopedTraceSpan
+  {
+#ifndef SWARM_NO_STEP_TIMERS
+    /// \brief Constructor.
+    /// \param[in] _trace The trace, or nullptr.
+    /// \param[in] _name Name of the phase, a string literal.
+    /// \param[in] _label Label of the span, or -1.
+    public: ScopedTraceSpan(StepTrace *_trace, const char *_name,
+                            const int32_t _label = -1)
+      : trace(_trace), name(_name), label(_label),
+        start(_trace ? _trace->Now() : 0)
+    {
+    }
+
+    /// \brief Destructor.
+    public: ~ScopedTraceSpan()
+    {
+      if (this->trace)
+      {
+        this->trace->Record(this->name, this->label, this->start,
+            this->trace->Now());
+      }
+    }
+
+    /// \brief The trace, or nullptr.
+    private: StepTrace *trace;
+
+    /// \brief Name of the phase.
+    private: const char *name;
+
+    /// \brief Label of the span.
+    private: const int32_t label;
+
+    /// \brief Start of the phase.
+    private: const int64_t start;
+#else
+    /// \brief Constructor.
+    public: ScopedTraceSpan(StepTrace *, const char *, const int32_t = -1)
+    {
+    }
+#endif
+  };
+}
+#endif
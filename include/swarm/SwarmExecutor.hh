@@ -0,0 +1,433 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file SwarmExecutor.hh
+/// \brief Runs the simulation step of all the robots of a world.
+
+#ifndef __SWARM_SWARM_EXECUTOR_HH__
+#define __SWARM_SWARM_EXECUTOR_HH__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <gazebo/common/Events.hh>
+#include <gazebo/common/UpdateInfo.hh>
+#include <ignition/math/Pose3.hh>
+
+#include "msgs/log_entry.pb.h"
+
+#include "swarm/Checkpointer.hh"
+#include "swarm/Helpers.hh"
+#include "swarm/MemoryAccounting.hh"
+#include "swarm/StepTimers.hh"
+#include "swarm/WorkerPool.hh"
+
+namespace swarm
+{
+  class PoseSnapshot;
+  class RobotPlugin;
+
+  /// \brief Steps all the robots of a world from a single world update
+  /// callback.
+  ///
+  /// The robots register when they are loaded. Each step runs a phase at a
+  /// time over the whole swarm: the poses and the terrain, the batteries,
+  /// the sensors, the controllers (RobotPlugin::Update()), the velocities,
+  /// the poses of the kinematic robots and the pose adjustments. The
+  /// adjusted poses are computed first, and the ones that change are set
+  /// together at the end of the step, then the docked rotors follow their
+  /// carriers. The controllers that opt-in run on a pool of threads. The
+  /// state that changes every step, the batteries, the update schedules
+  /// and the adjusted poses, is stored by the executor as a structure of
+  /// arrays indexed by the slot of each robot.
+  ///
+  /// The sensors, the terrain type and the controllers are updated on the
+  /// steps of their periods. The robots are dealt in turn to the steps of
+  /// each period, so the updates are spread evenly instead of all falling
+  /// on the same step. An optional budget limits the number of controllers
+  /// updated in a step, and the ones over it wait for the next steps.
+  ///
+  /// The wall time of each update of a controller is measured, and
+  /// compared with the time budget of the controller. The counters of each
+  /// robot are written into its log entries. A controller may have an
+  /// overrun policy, applied once it exceeds its budget in as many updates
+  /// in a row as its overrun limit: OVERRUN_SKIP stops updating it for the
+  /// rest of the simulation, so the robot stays still, and
+  /// OVERRUN_THROTTLE skips its next updates until the time over the budget
+  /// is repaid, one budget per update skipped. The counters and the
+  /// throttling depend on the host, so they aren't saved in the
+  /// checkpoints.
+  ///
+  /// A robot that stays still, with no velocity commanded and where
+  /// RobotPlugin::AdjustPose() leaves it, falls asleep: its terrain type,
+  /// velocities and pose adjustments aren't updated, while its sensors and
+  /// controller still are. It wakes up as soon as its controller commands
+  /// a velocity, it docks, it's moved (e.g. by a reset or the physics), or
+  /// the simulation is reset.
+  ///
+  /// A controller may wait for events (RobotPlugin::WaitForMessage() and
+  /// the like). Its updates are skipped until the robot receives a
+  /// message on the port awaited, its neighbors change, its sensors are
+  /// updated or the simulation time awaited is reached, whichever it waits
+  /// for happens first. A reset of the simulation ends the waits.
+  ///
+  /// The batteries and the controllers waiting for the budget or for
+  /// events are saved in the checkpoints of the world as the "executor"
+  /// client, and its arrays are accounted in the "executor" subsystem of
+  /// the memory reports. With SWARM_STEP_TRACE, the update of the sensors
+  /// and of the controller of each robot is traced, see StepTrace.
+  class IGNITION_VISIBLE SwarmExecutor
+    : public Checkpointable, public MemoryAccountable
+  {
+    /// \brief Get the executor of a world.
+    /// \param[in] _world Name of the world.
+    /// \return Pointer to the executor of the world.
+    public: static SwarmExecutor *Instance(const std::string &_world);
+
+    /// \brief What happens to a controller that exceeds its time budget.
+    public: enum OverrunPolicy
+            {
+              /// \brief The overruns are only counted.
+              OVERRUN_NONE = 0,
+
+              /// \brief The controller isn't updated anymore.
+              OVERRUN_SKIP = 1,
+
+              /// \brief The next updates are skipped until the time over
+              /// the budget is repaid.
+              OVERRUN_THROTTLE = 2
+            };
+
+    /// \brief Parse the name of an overrun policy: "none", "skip" or
+    /// "throttle".
+    /// \param[in] _name The name.
+    /// \param[out] _policy The policy.
+    /// \return False if the name is unknown.
+    public: static bool ParseOverrunPolicy(const std::string &_name,
+                                           OverrunPolicy &_policy);
+
+    /// \brief Register a robot, once it's loaded. The executor connects to
+    /// the world update event when the first robot is registered.
+    /// \param[in] _robot The robot.
+    public: void Add(RobotPlugin *_robot);
+
+    /// \brief Unregister a robot. The last robot of the swarm takes its
+    /// slot.
+    /// \param[in] _robot The robot.
+    public: void Remove(RobotPlugin *_robot);
+
+    /// \brief Number of robots registered.
+    /// \return The number of robots.
+    public: size_t Size() const;
+
+    /// \brief Get the battery capacity of a robot.
+    /// \param[in] _slot Slot of the robot.
+    /// \return The capacity (mAh).
+    public: double BatteryCapacity(const size_t _slot) const;
+
+    /// \brief Set the battery capacity of a robot.
+    /// \param[in] _slot Slot of the robot.
+    /// \param[in] _capacity The capacity (mAh).
+    public: void SetBatteryCapacity(const size_t _slot,
+                                    const double _capacity);
+
+    /// \brief Get the maximum number of controllers updated in a step.
+    /// \return The budget, or 0 if there is no limit.
+    public: unsigned int Budget() const;
+
+    /// \brief Set the maximum number of controllers updated in a step.
+    /// \param[in] _budget The budget, or 0 for no limit.
+    public: void SetBudget(const unsigned int _budget);
+
+    /// \brief Number of controllers due and waiting for the budget.
+    /// \return The number of controllers.
+    public: size_t Waiting() const;
+
+    /// \brief Fill the wall time counters of the controller of a robot.
+    /// \param[in] _slot Slot of the robot.
+    /// \param[out] _timing The counters.
+    public: void FillControllerTiming(const size_t _slot,
+                                      msgs::ControllerTiming &_timing) const;
+
+    /// \brief Skip the updates of the controller of a robot until one of
+    /// some events happens, see RobotPlugin::WaitForMessage(). The events
+    /// add up to the ones awaited already.
+    /// \param[in] _slot Slot of the robot.
+    /// \param[in] _events Mask of RobotPlugin::WakeEvent.
+    /// \param[in] _port Port of the messages, or any port if negative.
+    /// Waiting for two ports waits for any.
+    /// \param[in] _simTime Simulation time of RobotPlugin::WAKE_TIME (s).
+    public: void Wait(const size_t _slot, const unsigned int _events,
+                      const int _port, const double _simTime);
+
+    /// \brief Notify an event to the controller of a robot, which resumes
+    /// in its next update if it waits for the event.
+    /// \param[in] _slot Slot of the robot.
+    /// \param[in] _event The RobotPlugin::WakeEvent.
+    /// \param[in] _port Port of a message.
+    public: void Wake(const size_t _slot, const unsigned int _event,
+                      const int _port = -1);
+
+    /// \brief Get the events that resumed the last update of the
+    /// controller of a robot.
+    /// \param[in] _slot Slot of the robot.
+    /// \return Mask of RobotPlugin::WakeEvent, 0 if it wasn't waiting.
+    public: unsigned int WokenBy(const size_t _slot) const;
+
+    /// \brief Run a simulation step of all the robots.
+    /// \param[in] _info Update information provided by the server.
+    public: void Step(const gazebo::common::UpdateInfo &_info);
+
+    // Documentation inherited.
+    public: virtual void OnSave(msgs::CheckpointPart &_part) const;
+
+    // Documentation inherited.
+    public: virtual bool OnRestore(const msgs::CheckpointPart &_part);
+
+    // Documentation inherited.
+    public: virtual void OnMemory(MemoryReport &_report) const;
+
+    /// \brief Update the batteries of all the robots: settle the capacity
+    /// of the robots that start or stop charging, and count the step.
+    private: void UpdateBatteries();
+
+    /// \brief Put a robot to sleep if it stays still: no velocity, and the
+    /// pose of the snapshot left as it is by the adjustments of the step.
+    /// \param[in] _slot Slot of the robot.
+    private: void Sleep(const size_t _slot);
+
+    /// \brief Find the step when the battery of a robot runs out, from its
+    /// capacity and whether it is charging.
+    /// \param[in] _slot Slot of the robot.
+    private: void ScheduleDepletion(const size_t _slot);
+
+    /// \brief Whether an update is due in a step.
+    /// \param[in] _step The step.
+    /// \param[in] _period Period of the updates (steps).
+    /// \param[in] _phase Phase of the updates (steps).
+    /// \return True if the update is due.
+    private: static bool Due(const uint64_t _step, const uint32_t _period,
+                             const uint32_t _phase);
+
+    /// \brief Whether the controller of a robot resumes, because it doesn't
+    /// wait or one of the events it waits for happened. A controller that
+    /// resumes stops waiting.
+    /// \param[in] _slot Slot of the robot.
+    /// \param[in] _simTime Simulation time of the step (s).
+    /// \return True if the controller is updated.
+    private: bool Resume(const size_t _slot, const double _simTime);
+
+    /// \brief Update the controllers due in this step, within the budget.
+    /// \param[in] _info Update information provided by the server.
+    /// \param[in] _step The step.
+    private: void UpdateControllers(const gazebo::common::UpdateInfo &_info,
+                                    const uint64_t _step);
+
+    /// \brief Run the parallel controllers due in this step on the pool of
+    /// threads, and apply their effects.
+    /// \param[in] _info Update information provided by the server.
+    private: void UpdateParallel(const gazebo::common::UpdateInfo &_info);
+
+    /// \brief Whether the overrun policy skips the update of a controller
+    /// due in this step, counting it.
+    /// \param[in] _slot Slot of the robot.
+    /// \return True if the update is skipped.
+    private: bool SkipController(const size_t _slot);
+
+    /// \brief Update a controller, measuring its wall time.
+    /// \param[in] _slot Slot of the robot.
+    /// \param[in] _info Update information provided by the server.
+    private: void RunController(const size_t _slot,
+                                const gazebo::common::UpdateInfo &_info);
+
+    /// \brief Account the wall time of an update of a controller, and
+    /// apply the overrun policy.
+    /// \param[in] _slot Slot of the robot.
+    /// \param[in] _wallTime Wall time of the update (s).
+    private: void AccountController(const size_t _slot,
+                                    const double _wallTime);
+
+    /// \brief The robots, by slot.
+    private: std::vector<RobotPlugin *> robots;
+
+    /// \brief Poses of the swarm, shared with the robots.
+    private: PoseSnapshot *poses = nullptr;
+
+    /// \brief Time spent by the phases of the step, shared with the broker.
+    private: StepTimers *timers = nullptr;
+
+    /// \brief Battery capacity (mAh) when each robot last started or
+    /// stopped charging, by slot. The current capacity is given by the
+    /// steps since then.
+    /// \sa BatteryCapacity()
+    private: std::vector<double> capacity;
+
+    /// \brief Battery capacity at start (mAh), by slot.
+    private: std::vector<double> startCapacity;
+
+    /// \brief Capacity consumed in a step (mAh), by slot.
+    private: std::vector<double> drain;
+
+    /// \brief Capacity recharged in a step (mAh), by slot.
+    private: std::vector<double> recharge;
+
+    /// \brief Whether each robot recharges in this step, by slot.
+    private: std::vector<uint8_t> charging;
+
+    /// \brief Value of batterySteps when the capacity of each robot was
+    /// set, by slot.
+    private: std::vector<uint64_t> batteryFrom;
+
+    /// \brief Value of batterySteps when the battery of each robot runs
+    /// out, by slot.
+    private: std::vector<uint64_t> depletedAt;
+
+    /// \brief Number of steps of the batteries.
+    private: uint64_t batterySteps = 0;
+
+    /// \brief Period of the sensor updates (steps), by slot.
+    private: std::vector<uint32_t> sensorPeriod;
+
+    /// \brief Phase of the sensor updates (steps), by slot.
+    private: std::vector<uint32_t> sensorPhase;
+
+    /// \brief Period of the terrain updates (steps), by slot.
+    private: std::vector<uint32_t> terrainPeriod;
+
+    /// \brief Phase of the terrain updates (steps), by slot.
+    private: std::vector<uint32_t> terrainPhase;
+
+    /// \brief Period of the controller updates (steps), by slot.
+    private: std::vector<uint32_t> controllerPeriod;
+
+    /// \brief Phase of the controller updates (steps), by slot.
+    private: std::vector<uint32_t> controllerPhase;
+
+    /// \brief Whether each controller is due and not updated yet, by slot.
+    private: std::vector<uint8_t> pending;
+
+    /// \brief Whether each robot is asleep, by slot.
+    private: std::vector<uint8_t> asleep;
+
+    /// \brief Mask of the events awaited by each controller, 0 if it
+    /// doesn't wait, by slot.
+    private: std::vector<uint8_t> waitEvents;
+
+    /// \brief Port of the messages awaited by each controller, negative
+    /// for any port, by slot.
+    private: std::vector<int32_t> waitPort;
+
+    /// \brief Simulation time awaited by each controller (s), by slot.
+    private: std::vector<double> waitTime;
+
+    /// \brief Mask of the events awaited that happened, by slot.
+    private: std::vector<uint8_t> firedEvents;
+
+    /// \brief Mask of the events that resumed the last update of each
+    /// controller, by slot.
+    private: std::vector<uint8_t> wokenBy;
+
+    /// \brief Label of each robot in the StepTrace, by slot.
+    private: std::vector<int32_t> traceLabel;
+
+    /// \brief Pose where each robot fell asleep, by slot.
+    private: std::vector<ignition::math::Pose3d> sleepPose;
+
+    /// \brief Pose of each robot constrained to the terrain in this step,
+    /// by slot.
+    private: std::vector<ignition::math::Pose3d> adjustedPose;
+
+    /// \brief What happens to the pose of each robot at the end of the
+    /// step, by slot: POSE_KEPT, POSE_ADJUSTED or POSE_FOLLOWED.
+    private: std::vector<uint8_t> poseCommit;
+
+    /// \brief Wall time allowed to each update of the controller of each
+    /// robot (s), 0 if it has no budget.
+    private: std::vector<double> timeBudget;
+
+    /// \brief Overrun policy of each robot.
+    private: std::vector<OverrunPolicy> overrunPolicy;
+
+    /// \brief Overruns in a row that trigger the policy of each robot.
+    private: std::vector<uint32_t> overrunLimit;
+
+    /// \brief Overruns in a row of each robot.
+    private: std::vector<uint32_t> overrunStreak;
+
+    /// \brief Wall time over the budget left to repay by each throttled
+    /// robot (s).
+    private: std::vector<double> overrunDebt;
+
+    /// \brief Whether the controller of each robot is skipped for good.
+    private: std::vector<uint8_t> disabled;
+
+    /// \brief Updates of the controller of each robot.
+    private: std::vector<uint64_t> controllerUpdates;
+
+    /// \brief Updates of each robot over the budget.
+    private: std::vector<uint64_t> controllerOverruns;
+
+    /// \brief Updates of each robot skipped by the policy.
+    private: std::vector<uint64_t> controllerSkipped;
+
+    /// \brief Wall time spent in the controller of each robot (s).
+    private: std::vector<double> controllerWallTime;
+
+    /// \brief Longest update of the controller of each robot (s).
+    private: std::vector<double> controllerMaxWallTime;
+
+    /// \brief Slots of the controllers due and over the budget, in the
+    /// order they became due.
+    private: std::vector<size_t> waiting;
+
+    /// \brief Slots of the controllers due in this step.
+    private: std::vector<size_t> due;
+
+    /// \brief Maximum number of controllers updated in a step, 0 for no
+    /// limit.
+    private: unsigned int budget = 0;
+
+    /// \brief Number of robots registered so far, used to deal the phases.
+    private: uint64_t added = 0;
+
+    /// \brief Physics step size (s).
+    private: double stepSize = 0.001;
+
+    /// \brief Last step run, used to detect a reset.
+    private: uint64_t lastStep = 0;
+
+    /// \brief Slots of the parallel controllers due in this step.
+    private: std::vector<size_t> parallelDue;
+
+    /// \brief Threads running the parallel controllers, created when they
+    /// are first due.
+    private: std::unique_ptr<WorkerPool> pool;
+
+    /// \brief Connection to the world update event.
+    private: gazebo::event::ConnectionPtr updateConnection;
+
+    /// \brief Checkpointer of the world, where the executor is registered
+    /// while it has robots.
+    private: Checkpointer *checkpointer = nullptr;
+
+    /// \brief Memory accounting of the world, where the executor is
+    /// registered while it has robots.
+    private: MemoryAccounting *memory = nullptr;
+  };
+}
+#endif
@@ -28,7 +28,10 @@
 namespace swarm
 {
   /// \def Neighbors_M
-  /// \brief Map of neighbors
+  /// \brief Map of neighbors. The key is the address of the neighbor and the
+  /// value its comms probability. The comms model keeps the neighbors as
+  /// sorted indices, and only builds this map on demand.
+  /// \sa CommsModel::NeighborsMap()
   using Neighbors_M = std::map<std::string, double>;
 
   /// \brief Class used to store information about a member of the Swarm.
@@ -43,9 +46,6 @@ namespace swarm
     /// \brief Model pointer.
     public: gazebo::physics::ModelPtr model;
 
-    /// \brief List of neighbors and comms probabilities for this robot.
-    public: Neighbors_M neighbors;
-
     /// \brief Is this robot on outage?
     public: bool onOutage;
 
@@ -54,6 +54,11 @@ namespace swarm
 
     /// \brief Current data rate usage (bits).
     public: uint32_t dataRateUsage;
+
+    /// \brief Partition of the swarm simulating this robot, when the swarm
+    /// is split across several gzservers. Empty if this gzserver simulates
+    /// it, otherwise the robot has no model.
+    public: std::string partition;
   };
 
   /// \def SwarmMemberPtr
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file TangentPlane.hh
+/// \brief Fast conversion between spherical and world coordinates.
+
+#ifndef __SWARM_TANGENT_PLANE_HH__
+#define __SWARM_TANGENT_PLANE_HH__
+
+#include <cstddef>
+#include <functional>
+#include <ignition/math/Vector3.hh>
+
+#include "swarm/Helpers.hh"
+
+namespace swarm
+{
+  /// \brief A projection of the latitude and longitude onto the XY plane
+  /// of the world, fitted once around an origin.
+  ///
+  /// Each of X and Y is a quadratic polynomial of the offsets of latitude
+  /// and longitude from the origin, fitted with central differences of the
+  /// exact conversion (e.g. SphericalCoordinates, with its ellipsoid and
+  /// heading). The neglected terms are of third order, about d^3 / R^2 for
+  /// a point at a distance d of the origin and the earth radius R. With the
+  /// default fit, up to 60 degrees of latitude, the error is below 1 mm
+  /// within 2 km of the origin, 1 cm within 5 km and 6 cm within 10 km,
+  /// much less than a sample of the terrain. A projection is a few
+  /// multiplications, and the inverse converges in three Newton steps.
+  class IGNITION_VISIBLE TangentPlane
+  {
+    /// \brief Exact conversion from spherical to world coordinates.
+    /// \param[in] _lat Latitude (degrees).
+    /// \param[in] _lon Longitude (degrees).
+    /// \return The world position. Only X and Y are used.
+    public: using Conversion = std::function<ignition::math::Vector3d(
+        const double _lat, const double _lon)>;
+
+    /// \brief Fit the projection around an origin.
+    /// \param[in] _lat Latitude of the origin (degrees).
+    /// \param[in] _lon Longitude of the origin (degrees).
+    /// \param[in] _conversion Exact conversion.
+    /// \param[in] _step Offset of the samples of the fit (degrees).
+    /// \return False if the conversion is degenerate. The projection is not
+    /// valid in that case.
+    public: bool Fit(const double _lat, const double _lon,
+                     const Conversion &_conversion,
+                     const double _step = 0.01);
+
+    /// \brief Whether the projection has been fitted.
+    /// \return True if it can be used.
+    public: bool Valid() const;
+
+    /// \brief Get the world coordinates of a latitude and longitude.
+    /// \param[in] _lat Latitude (degrees).
+    /// \param[in] _lon Longitude (degrees).
+    /// \param[out] _x X world coordinate.
+    /// \param[out] _y Y world coordinate.
+    public: void Project(const double _lat, const double _lon,
+                         double &_x, double &_y) const;
+
+    /// \brief Get the world coordinates of several latitudes and
+    /// longitudes.
+    /// \param[in] _count Number of coordinates.
+    /// \param[in] _lat Latitudes (degrees).
+    /// \param[in] _lon Longitudes (degrees).
+    /// \param[out] _x X world coordinates.
+    /// \param[out] _y Y world coordinates.
+    public: void Project(const size_t _count, const double *_lat,
+                         const double *_lon, double *_x, double *_y) const;
+
+    /// \brief Get the latitude and longitude of world coordinates.
+    /// \param[in] _x X world coordinate.
+    /// \param[in] _y Y world coordinate.
+    /// \param[out] _lat Latitude (degrees).
+    /// \param[out] _lon Longitude (degrees).
+    public: void Unproject(const double _x, const double _y,
+                           double &_lat, double &_lon) const;
+
+    /// \brief Get the latitudes and longitudes of several world
+    /// coordinates.
+    /// \param[in] _count Number of coordinates.
+    /// \param[in] _x X world coordinates.
+    /// \param[in] _y Y world coordinates.
+    /// \param[out] _lat Latitudes (degrees).
+    /// \param[out] _lon Longitudes (degrees).
+    public: void Unproject(const size_t _count, const double *_x,
+                           const double *_y, double *_lat,
+                           double *_lon) const;
+
+    /// \brief Coefficients of a coordinate: constant, latitude, longitude,
+    /// latitude^2, longitude^2 and latitude * longitude.
+    private: using Coefficients = double[6];
+
+    /// \brief Latitude of the origin (degrees).
+    private: double lat0 = 0;
+
+    /// \brief Longitude of the origin (degrees).
+    private: double lon0 = 0;
+
+    /// \brief Coefficients of X.
+    private: Coefficients x = {0, 0, 0, 0, 0, 0};
+
+    /// \brief Coefficients of Y.
+    private: Coefficients y = {0, 0, 0, 0, 0, 0};
+
+    /// \brief Determinant of the linear terms, 0 if not fitted.
+    private: double det = 0;
+  };
+}
+#endif
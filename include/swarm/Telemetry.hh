@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file Telemetry.hh
+/// \brief Live snapshots of a running simulation, for dashboards.
+
+#ifndef __SWARM_TELEMETRY_HH__
+#define __SWARM_TELEMETRY_HH__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "swarm/Helpers.hh"
+
+namespace swarm
+{
+  /// \brief First field of each snapshot ("SWMT").
+  static const uint32_t kTelemetryMagic = 0x544d5753;
+
+  /// \brief Version of the layout of the snapshots, increased when the
+  /// layout changes.
+  static const uint32_t kTelemetryVersion = 1;
+
+  /// \brief Largest number of robots in a snapshot.
+  static const uint32_t kTelemetryMaxRobots = 1024;
+
+  /// \brief Size of the address of a robot, padded with zeros.
+  static const uint32_t kTelemetryAddressSize = 32;
+
+  /// \brief Largest number of robots in a UDP datagram.
+  static const uint32_t kTelemetryUdpRobots = 700;
+
+  /// \brief State of a robot in a snapshot. The layout is fixed, in the
+  /// byte order of the host.
+  struct TelemetryRobot
+  {
+    /// \brief Address of the robot, padded with zeros. Longer addresses
+    /// are truncated.
+    char address[kTelemetryAddressSize];
+
+    /// \brief Position in the world (m).
+    double x;
+
+    /// \brief Position in the world (m).
+    double y;
+
+    /// \brief Position in the world (m).
+    double z;
+
+    /// \brief Heading in the world (rad).
+    double yaw;
+
+    /// \brief Battery capacity (mAh), NaN for robots of other partitions.
+    double battery;
+
+    /// \brief Number of neighbors.
+    uint32_t neighbors;
+
+    /// \brief 1 if the robot is on outage.
+    uint8_t onOutage;
+
+    /// \brief 1 if the robot is simulated by another partition.
+    uint8_t remote;
+
+    /// \brief Reserved, zero.
+    uint16_t reserved;
+  };
+
+  /// \brief Header of a snapshot, with the counters of the broker in the
+  /// step of the snapshot. The layout is fixed, in the byte order of the
+  /// host.
+  struct TelemetryHeader
+  {
+    /// \brief kTelemetryMagic.
+    uint32_t magic;
+
+    /// \brief kTelemetryVersion.
+    uint32_t version;
+
+    /// \brief Sequence number of the snapshot, from 1.
+    uint64_t seq;
+
+    /// \brief Simulation time (s).
+    double simTime;
+
+    /// \brief Average number of neighbors per robot.
+    double avgNeighbors;
+
+    /// \brief Unicast messages sent in the step.
+    int32_t numUnicast;
+
+    /// \brief Broadcast messages sent in the step.
+    int32_t numBroadcast;
+
+    /// \brief Multicast messages sent in the step.
+    int32_t numMulticast;
+
+    /// \brief Bytes sent in the step.
+    int32_t bytesSent;
+
+    /// \brief Messages delivered in the step.
+    int32_t msgsDelivered;
+
+    /// \brief Potential recipients of the messages sent in the step.
+    int32_t potentialRecipients;
+
+    /// \brief Number of robots in the snapshot.
+    uint32_t numRobots;
+
+    /// \brief Index of the first robot in this datagram (UDP only, zero
+    /// otherwise).
+    uint32_t firstRobot;
+
+    /// \brief Number of robots in this datagram (UDP only, numRobots
+    /// otherwise).
+    uint32_t chunkRobots;
+
+    /// \brief Reserved, zero.
+    uint32_t reserved;
+  };
+
+  /// \brief A full snapshot. Only the first numRobots robots are valid.
+  struct TelemetryFrame
+  {
+    /// \brief The header.
+    TelemetryHeader header;
+
+    /// \brief The robots.
+    TelemetryRobot robots[kTelemetryMaxRobots];
+  };
+
+  /// \brief Publishes snapshots of a running simulation, to be read by
+  /// dashboards without stopping the simulation or touching the disk.
+  /// Publishing never blocks: readers that fall behind miss snapshots.
+  ///
+  /// Two transports are available:
+  ///   * "shm": the last snapshots are kept in the shared memory segment
+  ///     "/swarm_telemetry_<name>", in a ring of slots, each one guarded by
+  ///     a sequence number. Readers on the same host map the segment and
+  ///     copy the last slot with TelemetryReader.
+  ///   * "udp": each snapshot is sent to a UDP address, which may be
+  ///     multicast, split into datagrams of at most kTelemetryUdpRobots
+  ///     robots. Each datagram starts with a TelemetryHeader, followed by
+  ///     chunkRobots TelemetryRobot.
+  class IGNITION_VISIBLE TelemetryPublisher
+  {
+    /// \brief Class destructor.
+    public: virtual ~TelemetryPublisher() = default;
+
+    /// \brief Create a publisher.
+    /// \param[in] _transport "shm" or "udp".
+    /// \param[in] _name Name of the segment. Ignored with "udp".
+    /// \param[in] _address "host:port" of the UDP destination, e.g.
+    /// "239.255.0.1:9600". Ignored with "shm".
+    /// \return The publisher, or nullptr if the transport is unknown or it
+    /// can't be opened.
+    public: static std::unique_ptr<TelemetryPublisher> Create(
+                const std::string &_transport, const std::string &_name,
+                const std::string &_address);
+
+    /// \brief Publish a snapshot. The publisher sets the magic, the
+    /// version and the sequence number of its header.
+    /// \param[in] _frame The snapshot, with header.numRobots robots.
+    /// \return False if the snapshot couldn't be sent.
+    public: virtual bool Publish(TelemetryFrame &_frame) = 0;
+  };
+
+  /// \brief Reads the snapshots published with TelemetryPublisher.
+  class IGNITION_VISIBLE TelemetryReader
+  {
+    /// \brief Class destructor.
+    public: virtual ~TelemetryReader() = default;
+
+    /// \brief Create a reader.
+    /// \param[in] _transport "shm" or "udp".
+    /// \param[in] _name Name of the segment. Ignored with "udp".
+    /// \param[in] _address "host:port" to listen on with "udp". A multicast
+    /// host is joined. Ignored with "shm".
+    /// \return The reader, or nullptr if the transport is unknown or it
+    /// can't be opened.
+    public: static std::unique_ptr<TelemetryReader> Create(
+                const std::string &_transport, const std::string &_name,
+                const std::string &_address);
+
+    /// \brief Get the last snapshot, if it's newer than the last one read.
+    /// \param[out] _frame The snapshot.
+    /// \return True if a new snapshot was read.
+    public: virtual bool Read(TelemetryFrame &_frame) = 0;
+  };
+}
+#endif
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file TerrainRaster.hh
+/// \brief Grid with the type of terrain of each cell.
+
+#ifndef __SWARM_TERRAIN_RASTER_HH__
+#define __SWARM_TERRAIN_RASTER_HH__
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <ignition/math/Vector3.hh>
+
+#include "swarm/Helpers.hh"
+#include "swarm/SwarmTypes.hh"
+
+namespace swarm
+{
+  /// \brief The type of terrain of the world, sampled on a regular grid of
+  /// the XY plane.
+  ///
+  /// The raster is built once from the bounding boxes of the trees and the
+  /// buildings. Each cell stores the type of terrain and the vertical range
+  /// of the boxes covering it, so a query is a lookup: a position is in the
+  /// forest or in a building if its cell has that type and it's within the
+  /// vertical range. Everything else is plain terrain. The query is const
+  /// and can be called from multiple threads.
+  class IGNITION_VISIBLE TerrainRaster
+  {
+    /// \brief Classifies a point of the footprint of a box.
+    /// \param[in] _pos The point. Z is the top of the box.
+    /// \return The type of terrain at the point.
+    public: using Classifier =
+      std::function<TerrainType(const ignition::math::Vector3d &_pos)>;
+
+    /// \brief Set the area covered by the raster, removing all the cells.
+    /// \param[in] _min Minimum corner of the area. Z is ignored.
+    /// \param[in] _max Maximum corner of the area. Z is ignored.
+    /// \param[in] _cellSize Side of the cells (m).
+    public: void Reset(const ignition::math::Vector3d &_min,
+                       const ignition::math::Vector3d &_max,
+                       const double _cellSize);
+
+    /// \brief Add the bounding box of a model. The cells that its footprint
+    /// overlaps take the type returned by the classifier for the point of
+    /// the footprint closest to their center, unless they already have a
+    /// type other than plain.
+    /// \param[in] _min Minimum corner of the box.
+    /// \param[in] _max Maximum corner of the box.
+    /// \param[in] _classify The classifier.
+    public: void Add(const ignition::math::Vector3d &_min,
+                     const ignition::math::Vector3d &_max,
+                     const Classifier &_classify);
+
+    /// \brief Get the type of terrain at a position.
+    /// \param[in] _pos Position in the world.
+    /// \return The type of terrain.
+    public: TerrainType At(const ignition::math::Vector3d &_pos) const;
+
+    /// \brief Number of cells along X.
+    /// \return The number of columns.
+    public: unsigned int Columns() const;
+
+    /// \brief Number of cells along Y.
+    /// \return The number of rows.
+    public: unsigned int Rows() const;
+
+    /// \brief A cell of the raster.
+    private: struct Cell
+    {
+      /// \brief Lowest point of the boxes covering the cell.
+      float zMin;
+
+      /// \brief Highest point of the boxes covering the cell.
+      float zMax;
+
+      /// \brief Type of terrain, or kEmpty if no box covers it.
+      uint8_t type;
+    };
+
+    /// \brief Type of the cells not covered by any box.
+    private: static const uint8_t kEmpty = 0xff;
+
+    /// \brief Minimum X of the area.
+    private: double minX = 0;
+
+    /// \brief Minimum Y of the area.
+    private: double minY = 0;
+
+    /// \brief Side of the cells (m).
+    private: double cellSize = 1;
+
+    /// \brief Number of cells along X.
+    private: unsigned int columns = 0;
+
+    /// \brief Number of cells along Y.
+    private: unsigned int rows = 0;
+
+    /// \brief Cells, by row.
+    private: std::vector<Cell> cells;
+
+    /// \brief The cache saves and restores the cells.
+    friend class WorldCache;
+  };
+}
+#endif
@@ -0,0 +1,373 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file TerrainTiles.hh
+/// \brief Heights and normals of a terrain, paged in by tiles.
+
+#ifndef __SWARM_TERRAIN_TILES_HH__
+#define __SWARM_TERRAIN_TILES_HH__
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <ignition/math/Vector3.hh>
+
+#include "swarm/Heightmap.hh"
+#include "swarm/Helpers.hh"
+
+namespace swarm
+{
+  /// \brief Header stored at the beginning of a terrain tiles file.
+  struct TerrainTilesHeader
+  {
+    /// \brief Always TerrainTiles::kMagic.
+    int32_t magic;
+
+    /// \brief Version of the layout.
+    int32_t version;
+
+    /// \brief Number of samples along X.
+    int32_t columns;
+
+    /// \brief Number of samples along Y.
+    int32_t rows;
+
+    /// \brief Number of rows and columns of cells of each tile.
+    int32_t tileSize;
+
+    /// \brief Number of tiles in each row of tiles.
+    int32_t tileColumns;
+
+    /// \brief Number of rows of tiles.
+    int32_t tileRows;
+
+    /// \brief Unused, keeps the size 8 byte aligned.
+    int32_t reserved;
+
+    /// \brief Size of the terrain (m).
+    double size[3];
+
+    /// \brief Heightmap::Hash() of the terrain.
+    uint64_t hash;
+  };
+
+  /// \brief Heights and normals of a terrain, read from a file of
+  /// compressed tiles, for terrains whose Heightmap is too large to keep
+  /// in memory.
+  ///
+  /// The cells of the heightmap are split into squares of tileSize x
+  /// tileSize cells. Each tile stores the triangles of its cells, with
+  /// their packed normals, followed by the (tileSize + 1)^2 samples around
+  /// them, and is compressed on its own with zlib. The TerrainTilesHeader
+  /// is followed by the file offset of every tile, row of tiles after row
+  /// of tiles, plus the end of the last one. Only the compressed file is
+  /// mapped: the tiles are decompressed into a least recently used cache
+  /// of SetCacheSize() tiles. The queries give the same results as the
+  /// Heightmap that was written.
+  ///
+  /// Prefetch() queues the tiles around a vehicle, and a background thread
+  /// decompresses them, so a vehicle that enters a new tile usually finds
+  /// it in the cache. The cache must hold the tiles around every vehicle,
+  /// or the tiles are decompressed over and over.
+  ///
+  /// Open() shares the tiles of a file between all the users of the
+  /// process. All the methods but Load() can be called from multiple
+  /// threads.
+  class IGNITION_VISIBLE TerrainTiles
+  {
+    /// \brief Constructor.
+    public: TerrainTiles();
+
+    /// \brief Destructor. Stops the prefetching and unmaps the file.
+    public: ~TerrainTiles();
+
+    /// \brief Get the tiles of a file, loading them the first time.
+    /// \param[in] _filename Path to the tiles.
+    /// \return The tiles shared by every user of the file in the process,
+    /// or null if the file can't be loaded.
+    public: static std::shared_ptr<TerrainTiles> Open(
+                const std::string &_filename);
+
+    /// \brief Split a heightmap into tiles and write them to a file. The
+    /// tiles are written to a temporary file, that is renamed once it's
+    /// complete.
+    /// \param[in] _heightmap The terrain.
+    /// \param[in] _filename Path of the tiles.
+    /// \param[in] _tileSize Number of rows and columns of cells of each
+    /// tile.
+    /// \return True if the file was written.
+    public: static bool Write(const Heightmap &_heightmap,
+                              const std::string &_filename,
+                              const int _tileSize = kDefaultTileSize);
+
+    /// \brief Map and validate a file of tiles.
+    /// \param[in] _filename Path to the tiles.
+    /// \return True if the tiles can be queried.
+    public: bool Load(const std::string &_filename);
+
+    /// \brief Whether tiles have been loaded.
+    /// \return True if the tiles can be queried.
+    public: bool Valid() const;
+
+    /// \brief Header of the loaded tiles.
+    /// \return The header.
+    public: const TerrainTilesHeader &Header() const;
+
+    /// \brief Number of samples along X.
+    /// \return Number of columns.
+    public: int Columns() const;
+
+    /// \brief Number of samples along Y.
+    /// \return Number of rows.
+    public: int Rows() const;
+
+    /// \brief Size of the terrain.
+    /// \return Size (m).
+    public: ignition::math::Vector3d Size() const;
+
+    /// \brief Hash of the samples the tiles were written from.
+    /// \return The hash, or 0 if no tiles are loaded.
+    /// \sa Heightmap::Hash()
+    public: uint64_t Hash() const;
+
+    /// \brief Get the height of the terrain at a coordinate.
+    /// \param[in] _x X world coordinate.
+    /// \param[in] _y Y world coordinate.
+    /// \return Height of the terrain, or 0 if no tiles are loaded.
+    /// \sa Heightmap::HeightAt()
+    public: double HeightAt(const double _x, const double _y) const;
+
+    /// \brief Get the height of the surface of the terrain and its normal
+    /// at a coordinate. Nothing is written if no tiles are loaded, and a
+    /// corrupt tile reads as flat ground at height 0.
+    /// \param[in] _x X world coordinate.
+    /// \param[in] _y Y world coordinate.
+    /// \param[out] _height Height of the surface (m).
+    /// \param[out] _norm Unit normal of the surface, pointing up.
+    /// \sa Heightmap::Lookup()
+    public: void Lookup(const double _x, const double _y, double &_height,
+                        ignition::math::Vector3d &_norm) const;
+
+    /// \brief Get the height of the surface of the terrain and its normal
+    /// at several coordinates. Consecutive coordinates in the same tile
+    /// share one access to the cache.
+    /// \param[in] _count Number of coordinates.
+    /// \param[in] _x X world coordinates.
+    /// \param[in] _y Y world coordinates.
+    /// \param[out] _height Height of the surface at each coordinate (m).
+    /// \param[out] _norm Normal of the surface at each coordinate. It can
+    /// be null if the normals aren't needed.
+    public: void Lookup(const size_t _count, const double *_x,
+                        const double *_y, double *_height,
+                        ignition::math::Vector3d *_norm) const;
+
+    /// \brief Queue the tiles within a distance of a position, so they are
+    /// decompressed in the background. The tiles that are already cached
+    /// become the most recently used ones.
+    /// \param[in] _pos Position, in world coordinates.
+    /// \param[in] _radius Distance around the position (m).
+    public: void Prefetch(const ignition::math::Vector3d &_pos,
+                          const double _radius) const;
+
+    /// \brief Number of tiles queued by Prefetch() and not decompressed
+    /// yet.
+    /// \return The number of tiles.
+    public: size_t PendingPrefetches() const;
+
+    /// \brief Set the number of decompressed tiles kept in memory. The
+    /// least recently used tiles are dropped first.
+    /// \param[in] _tiles Number of tiles, at least 1.
+    public: void SetCacheSize(const size_t _tiles);
+
+    /// \brief Number of decompressed tiles kept in memory.
+    /// \return The size of the cache (tiles).
+    public: size_t CacheSize() const;
+
+    /// \brief Number of tiles currently decompressed.
+    /// \return The number of cached tiles.
+    public: size_t CachedTiles() const;
+
+    /// \brief Memory used by the decompressed tiles.
+    /// \return The size of the cached tiles (bytes).
+    public: uint64_t CacheBytes() const;
+
+    /// \brief Number of lookups of a tile that was already decompressed.
+    /// \return The number of hits.
+    public: uint64_t Hits() const;
+
+    /// \brief Number of lookups that had to decompress a tile.
+    /// \return The number of misses.
+    public: uint64_t Misses() const;
+
+    /// \brief Number of tiles decompressed by the prefetching.
+    /// \return The number of tiles.
+    public: uint64_t Prefetched() const;
+
+    /// \brief First value of every terrain tiles file.
+    public: static const int32_t kMagic = 0x53575454;
+
+    /// \brief Current version of the layout.
+    public: static const int32_t kVersion = 1;
+
+    /// \brief Default number of rows and columns of cells of each tile.
+    public: static const int kDefaultTileSize = 64;
+
+    /// \brief Default number of decompressed tiles kept in memory.
+    public: static const size_t kDefaultCacheSize = 256;
+
+    /// \brief A decompressed tile.
+    private: struct Tile
+    {
+      /// \brief Number of columns of cells.
+      int width;
+
+      /// \brief Triangles of the cells, by row.
+      std::vector<Heightmap::Cell> cells;
+
+      /// \brief Samples around the cells, by row. Each row has width + 1
+      /// samples.
+      std::vector<float> heights;
+    };
+
+    /// \brief Unmap the file and drop the cached tiles.
+    private: void Unload();
+
+    /// \brief Get the tile of a sample position, and the position in the
+    /// tile.
+    /// \param[in] _x X world coordinate.
+    /// \param[in] _y Y world coordinate.
+    /// \param[out] _cellX First column of the cell, in the tile.
+    /// \param[out] _cellY First row of the cell, in the tile.
+    /// \param[out] _fx Position in the cell along the columns (samples).
+    /// \param[out] _fy Position in the cell along the rows (samples).
+    /// \param[out] _odd 1 if the cell is on an odd row of the terrain.
+    /// \return Index of the tile.
+    private: uint64_t Locate(const double _x, const double _y, int &_cellX,
+                             int &_cellY, double &_fx, double &_fy,
+                             int &_odd) const;
+
+    /// \brief Get a tile, decompressing it if it isn't in the cache.
+    /// \param[in] _tile Index of the tile.
+    /// \return The tile, or null if it's corrupt.
+    private: std::shared_ptr<const Tile> TileAt(const uint64_t _tile) const;
+
+    /// \brief Decompress a tile.
+    /// \param[in] _tile Index of the tile.
+    /// \return The tile, or null if it's corrupt.
+    private: std::shared_ptr<const Tile> Decompress(
+                 const uint64_t _tile) const;
+
+    /// \brief Add a decompressed tile to the cache as the most recently
+    /// used one. Must be called with mutex locked.
+    /// \param[in] _tile Index of the tile.
+    /// \param[in] _data The tile.
+    /// \return The cached tile, which is the one already in the cache if
+    /// another thread decompressed it first.
+    private: std::shared_ptr<const Tile> Insert(const uint64_t _tile,
+                 const std::shared_ptr<const Tile> &_data) const;
+
+    /// \brief Drop the least recently used tiles over the cache size. Must
+    /// be called with mutex locked.
+    private: void TrimCache() const;
+
+    /// \brief Decompress the queued tiles, until the destructor.
+    private: void RunPrefetch();
+
+    /// \brief The mapped file.
+    private: const char *data = nullptr;
+
+    /// \brief Size of the mapped file.
+    private: size_t dataSize = 0;
+
+    /// \brief Header of the tiles.
+    private: TerrainTilesHeader header;
+
+    /// \brief File offsets of the compressed tiles, plus the end of the
+    /// last tile.
+    private: const uint64_t *offsets = nullptr;
+
+    /// \brief Distance between two samples along X and Y (m).
+    private: double scaleX = 0, scaleY = 0;
+
+    /// \brief A tile in the cache.
+    private: struct CachedTile
+    {
+      /// \brief Index of the tile.
+      uint64_t tile;
+
+      /// \brief The tile. Lookups keep their own reference, so it can be
+      /// dropped from the cache while they use it.
+      std::shared_ptr<const Tile> data;
+    };
+
+    /// \brief Decompressed tiles, the most recently used first.
+    private: mutable std::list<CachedTile> cache;
+
+    /// \brief Position of each decompressed tile in cache.
+    private: mutable std::unordered_map<uint64_t,
+             std::list<CachedTile>::iterator> cacheIndex;
+
+    /// \brief Number of decompressed tiles kept in memory.
+    private: size_t cacheSize = kDefaultCacheSize;
+
+    /// \brief Number of lookups of a cached tile.
+    private: mutable uint64_t hits = 0;
+
+    /// \brief Number of tiles decompressed by the lookups.
+    private: mutable uint64_t misses = 0;
+
+    /// \brief Number of tiles decompressed by the prefetching.
+    private: mutable uint64_t prefetched = 0;
+
+    /// \brief Whether a corrupt tile was already reported.
+    private: mutable bool tileError = false;
+
+    /// \brief Tiles queued by Prefetch(), oldest first.
+    private: mutable std::deque<uint64_t> pending;
+
+    /// \brief The tiles in pending.
+    private: mutable std::unordered_set<uint64_t> pendingSet;
+
+    /// \brief Whether the prefetching is decompressing a tile.
+    private: bool prefetchBusy = false;
+
+    /// \brief Set by the destructor to stop the prefetching.
+    private: bool stop = false;
+
+    /// \brief Protects the cache, the counters and the queue.
+    private: mutable std::mutex mutex;
+
+    /// \brief Signaled when tiles are queued or on stop.
+    private: mutable std::condition_variable pendingCondition;
+
+    /// \brief Signaled when the prefetching finishes a tile.
+    private: mutable std::condition_variable idleCondition;
+
+    /// \brief Decompresses the queued tiles.
+    private: std::thread prefetchThread;
+  };
+}
+#endif
@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file TimingWheel.hh
+/// \brief Values scheduled for a future tick.
+
+#ifndef __SWARM_TIMING_WHEEL_HH__
+#define __SWARM_TIMING_WHEEL_HH__
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace swarm
+{
+  /// \brief Hierarchical timing wheel: values scheduled for a tick, and
+  /// collected when the wheel advances to it.
+  ///
+  /// The first level has a slot per tick for the next kSlots ticks. Each
+  /// slot of the next level covers kSlots times as many ticks, and its
+  /// values are moved down when the level below wraps around. Values
+  /// scheduled beyond the last level wait in an overflow list. Scheduling
+  /// and collecting a value are O(1), and the wheel jumps over the ticks
+  /// where nothing is due.
+  ///
+  /// \tparam T Type of the values. It must be movable.
+  template <typename T>
+  class TimingWheel
+  {
+    /// \brief Class constructor.
+    /// \param[in] _now Current tick.
+    public: explicit TimingWheel(const uint64_t _now = 0)
+      : now(_now)
+    {
+      for (auto &level : this->levels)
+        level.resize(kSlots);
+    }
+
+    /// \brief Current tick.
+    /// \return The last tick the wheel advanced to.
+    public: uint64_t Now() const
+    {
+      return this->now;
+    }
+
+    /// \brief Number of values scheduled and not collected yet.
+    /// \return The number of values.
+    public: size_t Size() const
+    {
+      return this->size;
+    }
+
+    /// \brief Schedule a value.
+    /// \param[in] _tick Tick when the value is due. A value due at the
+    /// current tick or before is collected by the next Advance().
+    /// \param[in] _value The value.
+    public: void Schedule(const uint64_t _tick, T _value)
+    {
+      ++this->size;
+      this->Insert(Entry{_tick, std::move(_value)});
+    }
+
+    /// \brief Advance to a tick, collecting the values due until it, in the
+    /// order of their ticks. The values due at the same tick are collected
+    /// in no specific order.
+    /// \param[in] _tick New tick. Nothing happens if it's not after the
+    /// current tick, except collecting the values already due.
+    /// \param[out] _due Vector where the values are appended.
+    public: void Advance(const uint64_t _tick, std::vector<T> &_due)
+    {
+      this->Collect(this->late, _due);
+
+      while (this->now < _tick)
+      {
+        // Skip the idle ticks.
+        if (this->size == 0)
+        {
+          this->now = _tick;
+          break;
+        }
+
+        // Nothing happens until the first level with values reaches its
+        // next slot.
+        size_t lowest = 0;
+        while (lowest < kLevels && this->counts[lowest] == 0)
+          ++lowest;
+        if (lowest > 0)
+        {
+          const uint64_t span = uint64_t(1) << (lowest * kBits);
+          const uint64_t next = (this->now | (span - 1)) + 1;
+          if (next > _tick)
+          {
+            this->now = _tick;
+            break;
+          }
+          this->now = next - 1;
+        }
+
+        ++this->now;
+
+        // Move down the values of the levels that reach a new slot.
+        for (size_t l = 1; l < kLevels; ++l)
+        {
+          if ((this->now & ((uint64_t(1) << (l * kBits)) - 1)) != 0)
+            break;
+          this->Cascade(this->levels[l][this->Slot(this->now, l)], l);
+        }
+        if ((this->now & ((uint64_t(1) << (kLevels * kBits)) - 1)) == 0)
+          this->Cascade(this->overflow, kLevels);
+
+        auto &slot = this->levels[0][this->Slot(this->now, 0)];
+        this->counts[0] -= slot.size();
+        this->Collect(slot, _due);
+        this->Collect(this->late, _due);
+      }
+    }
+
+    /// \brief Visit the values scheduled and not collected yet, in no
+    /// specific order.
+    /// \param[in] _visit Function called with the tick and the value of
+    /// each one.
+    public: template <typename F>
+            void ForEach(F _visit) const
+    {
+      for (auto const &level : this->levels)
+      {
+        for (auto const &slot : level)
+        {
+          for (auto const &entry : slot)
+            _visit(entry.tick, entry.value);
+        }
+      }
+      for (auto const &entry : this->overflow)
+        _visit(entry.tick, entry.value);
+      for (auto const &entry : this->late)
+        _visit(entry.tick, entry.value);
+    }
+
+    /// \brief Remove all the values.
+    /// \param[in] _now New current tick.
+    public: void Clear(const uint64_t _now)
+    {
+      for (auto &level : this->levels)
+      {
+        for (auto &slot : level)
+          slot.clear();
+      }
+      this->overflow.clear();
+      this->late.clear();
+      for (auto &count : this->counts)
+        count = 0;
+      this->size = 0;
+      this->now = _now;
+    }
+
+    /// \brief Bits of the tick indexing the slots of each level.
+    public: static const size_t kBits = 6;
+
+    /// \brief Slots of each level.
+    public: static const size_t kSlots = size_t(1) << kBits;
+
+    /// \brief Number of levels.
+    public: static const size_t kLevels = 4;
+
+    /// \brief A scheduled value.
+    private: struct Entry
+    {
+      /// \brief Tick when the value is due.
+      uint64_t tick;
+
+      /// \brief The value.
+      T value;
+    };
+
+    /// \brief Slot of a tick in a level.
+    /// \param[in] _tick The tick.
+    /// \param[in] _level The level.
+    /// \return Index of the slot.
+    private: static size_t Slot(const uint64_t _tick, const size_t _level)
+    {
+      return static_cast<size_t>(_tick >> (_level * kBits)) & (kSlots - 1);
+    }
+
+    /// \brief Store an entry in the level matching its distance to the
+    /// current tick.
+    /// \param[in] _entry The entry.
+    private: void Insert(Entry &&_entry)
+    {
+      if (_entry.tick <= this->now)
+      {
+        this->late.push_back(std::move(_entry));
+        return;
+      }
+
+      const uint64_t delta = _entry.tick - this->now;
+      for (size_t l = 0; l < kLevels; ++l)
+      {
+        if (delta < (uint64_t(1) << ((l + 1) * kBits)))
+        {
+          ++this->counts[l];
+          this->levels[l][this->Slot(_entry.tick, l)].push_back(
+              std::move(_entry));
+          return;
+        }
+      }
+      ++this->counts[kLevels];
+      this->overflow.push_back(std::move(_entry));
+    }
+
+    /// \brief Insert again the entries of a slot, relative to the current
+    /// tick.
+    /// \param[in,out] _slot The slot, emptied.
+    /// \param[in] _level Level of the slot, kLevels for the overflow list.
+    private: void Cascade(std::vector<Entry> &_slot, const size_t _level)
+    {
+      if (_slot.empty())
+        return;
+
+      this->counts[_level] -= _slot.size();
+      this->moving.clear();
+      std::swap(this->moving, _slot);
+      for (auto &entry : this->moving)
+        this->Insert(std::move(entry));
+    }
+
+    /// \brief Collect the values of a slot.
+    /// \param[in,out] _slot The slot, emptied.
+    /// \param[out] _due Vector where the values are appended.
+    private: void Collect(std::vector<Entry> &_slot, std::vector<T> &_due)
+    {
+      for (auto &entry : _slot)
+        _due.push_back(std::move(entry.value));
+      this->size -= _slot.size();
+      _slot.clear();
+    }
+
+    /// \brief Slots of each level. The vectors keep their capacity, so the
+    /// wheel stops allocating once it reaches its usual load.
+    private: std::vector<std::vector<Entry>> levels[kLevels];
+
+    /// \brief Entries beyond the last level.
+    private: std::vector<Entry> overflow;
+
+    /// \brief Number of entries in each level, and in the overflow list.
+    private: size_t counts[kLevels + 1] = {};
+
+    /// \brief Entries already due when they were stored.
+    private: std::vector<Entry> late;
+
+    /// \brief Entries being moved down by Cascade().
+    private: std::vector<Entry> moving;
+
+    /// \brief Current tick.
+    private: uint64_t now;
+
+    /// \brief Number of values scheduled.
+    private: size_t size = 0;
+  };
+}
+#endif
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file TransitionField.hh
+/// \brief Precomputed transitional probabilities of the lost person walk.
+
+#ifndef __SWARM_TRANSITION_FIELD_HH__
+#define __SWARM_TRANSITION_FIELD_HH__
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "swarm/Helpers.hh"
+#include "swarm/SwarmTypes.hh"
+
+namespace swarm
+{
+  /// \brief The transitional probabilities of the random walk of the lost
+  /// people, precomputed on a hexagonal lattice over the search area.
+  ///
+  /// The neighbors of a node are at the bearings 0, 60, ..., 300 degrees
+  /// (moves 0 to 5), and the move 6 stays at the node. The lattice spacing
+  /// is the distance walked in an update period, so the probabilities only
+  /// depend on the heights and the terrain types of the nodes, and the map
+  /// is queried once per node. The columns follow the longitude, and the odd
+  /// columns are shifted half a row to the north. The field is read-only
+  /// once built and it can be shared by any number of walkers.
+  class IGNITION_VISIBLE TransitionField
+  {
+    /// \brief Number of moves of a node.
+    public: static const int kMoves = 7;
+
+    /// \brief Maximum number of nodes of a field.
+    public: static const size_t kMaxNodes = 1 << 22;
+
+    /// \brief Queries the map at a position.
+    /// \param[in] _lat Latitude (degrees).
+    /// \param[in] _lon Longitude (degrees).
+    /// \param[out] _height Elevation (m).
+    /// \param[out] _type Type of terrain.
+    /// \return False if the position is outside of the map.
+    public: using MapQuery = std::function<bool(const double _lat,
+        const double _lon, double &_height, TerrainType &_type)>;
+
+    /// \brief Build the field, replacing the previous one.
+    /// \param[in] _minLat Minimum latitude of the search area (degrees).
+    /// \param[in] _maxLat Maximum latitude of the search area (degrees).
+    /// \param[in] _minLon Minimum longitude of the search area (degrees).
+    /// \param[in] _maxLon Maximum longitude of the search area (degrees).
+    /// \param[in] _spacing Distance between neighbor nodes (m).
+    /// \param[in] _slopeThreshold Maximum slope of a level move (degrees).
+    /// \param[in] _slopeMeans Probabilities of a level, down and up move.
+    /// \param[in] _topographyMeans Probabilities of moving from a type of
+    /// terrain (row) to another (column).
+    /// \param[in] _query Map query.
+    /// \return False if the area is empty or it needs more than kMaxNodes
+    /// nodes. The field is empty in that case.
+    public: bool Build(const double _minLat, const double _maxLat,
+                       const double _minLon, const double _maxLon,
+                       const double _spacing, const double _slopeThreshold,
+                       const double _slopeMeans[3],
+                       const double _topographyMeans[3][3],
+                       const MapQuery &_query);
+
+    /// \brief Whether the field has been built.
+    /// \return True if it has nodes.
+    public: bool Valid() const;
+
+    /// \brief Find the node closest to a position: the node of the column
+    /// nearest in longitude that is nearest in latitude.
+    /// \param[in] _lat Latitude (degrees).
+    /// \param[in] _lon Longitude (degrees).
+    /// \param[out] _node Index of the node.
+    /// \return False if the position isn't covered by a node of the search
+    /// area.
+    public: bool Node(const double _lat, const double _lon,
+                      size_t &_node) const;
+
+    /// \brief Choose a move from a node.
+    /// \param[in] _node Index of the node, as returned by Node().
+    /// \param[in] _random A random number in [0, 1].
+    /// \return The index of the move (0 to 6).
+    public: int Move(const size_t _node, const double _random) const;
+
+    /// \brief Get the probability of a move.
+    /// \param[in] _node Index of the node.
+    /// \param[in] _move Index of the move.
+    /// \return The probability.
+    public: double Probability(const size_t _node, const int _move) const;
+
+    /// \brief Get the offset of a move.
+    /// \param[in] _move Index of the move.
+    /// \param[out] _lat Latitude offset (degrees).
+    /// \param[out] _lon Longitude offset (degrees).
+    public: void Offset(const int _move, double &_lat, double &_lon) const;
+
+    /// \brief Number of columns (along the longitude).
+    /// \return The number of columns.
+    public: int Columns() const;
+
+    /// \brief Number of rows (along the latitude).
+    /// \return The number of rows.
+    public: int Rows() const;
+
+    /// \brief Cumulative probabilities of the moves of each node, column
+    /// major. The last one is 1 for the nodes in the search area, and 0 for
+    /// the others.
+    private: std::vector<std::array<double, kMoves>> cumulative;
+
+    /// \brief Number of columns.
+    private: int columns = 0;
+
+    /// \brief Number of rows.
+    private: int rows = 0;
+
+    /// \brief Latitude of the first node (degrees).
+    private: double minLat = 0;
+
+    /// \brief Longitude of the first node (degrees).
+    private: double minLon = 0;
+
+    /// \brief Latitude between two rows (degrees).
+    private: double latStep = 0;
+
+    /// \brief Longitude between two columns (degrees).
+    private: double lonStep = 0;
+  };
+}
+#endif
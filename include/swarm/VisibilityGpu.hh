@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file VisibilityGpu.hh
+/// \brief Stencil visibility tables computed on an OpenCL device.
+
+#ifndef __SWARM_VISIBILITY_GPU_HH__
+#define __SWARM_VISIBILITY_GPU_HH__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "swarm/Heightmap.hh"
+#include "swarm/Helpers.hh"
+#include "swarm/VisibilityLookup.hh"
+
+namespace swarm
+{
+  /// \brief Evaluate the heightmap line of sight tests of a STENCIL table
+  /// on an OpenCL device, see VisibilityTable.
+  ///
+  /// The samples of the heightmap are uploaded once, as a single channel
+  /// float image. Each work group computes the stencil of one cell of the
+  /// table: its work items test the offsets of the stencil, set their bits
+  /// in local memory, and the group writes the words of the cell. The
+  /// kernel repeats the computations of Heightmap::HeightAt() and
+  /// Heightmap::LineOfSight() in double precision, without contractions,
+  /// so its words match the CPU ones. Devices without cl_khr_fp64 are not
+  /// used.
+  ///
+  /// The first GPU is used, or the first device if there is no GPU. The
+  /// SWARM_VISIBILITY_GPU_DEVICE environment variable selects another one,
+  /// by its index in that order.
+  ///
+  /// Without OpenCL at build time, Load() always fails and the table is
+  /// generated on the CPU.
+  class IGNITION_VISIBLE VisibilityGpu
+  {
+    /// \brief Constructor.
+    public: VisibilityGpu();
+
+    /// \brief Destructor. Releases the device.
+    public: ~VisibilityGpu();
+
+    /// \brief Whether Swarm was built with OpenCL.
+    /// \return True if Load() can succeed.
+    public: static bool Available();
+
+    /// \brief Select a device, compile the kernel and upload a heightmap.
+    /// \param[in] _heightmap The terrain.
+    /// \param[in] _radius Radius of the stencil (cells).
+    /// \return True if the device is ready.
+    public: bool Load(const Heightmap &_heightmap, const int _radius);
+
+    /// \brief Name of the device used.
+    /// \return The name, empty before Load().
+    public: std::string DeviceName() const;
+
+    /// \brief Compute the stencil words of consecutive rows of a table.
+    /// \param[in] _header Header of the STENCIL table.
+    /// \param[in] _firstRow First row to compute.
+    /// \param[in] _rowCount Number of rows.
+    /// \param[out] _out The words of each cell of the rows, in index
+    /// order, are appended here.
+    /// \return False if the device failed.
+    public: bool Stencil(const VisibilityTableHeader &_header,
+                         const int _firstRow, const int _rowCount,
+                         std::vector<uint64_t> &_out);
+
+    /// \brief OpenCL objects, defined where OpenCL is included.
+    private: struct Device;
+
+    /// \brief The device, null until Load() succeeds.
+    private: std::unique_ptr<Device> device;
+  };
+}
+#endif
@@ -0,0 +1,559 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file VisibilityLookup.hh
+/// \brief Read-only access to a visibility table stored on disk.
+
+#ifndef __SWARM_VISIBILITY_LOOKUP_HH__
+#define __SWARM_VISIBILITY_LOOKUP_HH__
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <ignition/math/Vector3.hh>
+
+#include "swarm/Helpers.hh"
+
+namespace swarm
+{
+  class BoxHierarchy;
+
+  /// \brief Layouts of a visibility table file.
+  enum VisibilityTableFormat
+  {
+    /// \brief Sorted list of the keys of the blocked pairs.
+    KEYS = 0,
+
+    /// \brief One bitmask per cell over the neighborhood of the cell.
+    STENCIL = 1,
+
+    /// \brief Height of the terrain above the segment between each cell
+    /// and its neighbors. Answers queries for endpoints at any height.
+    CLEARANCE = 2,
+
+    /// \brief Trees and buildings crossed by the segment between each cell
+    /// and its neighbors. Stored next to the terrain table, see
+    /// Obstacles().
+    OBSTACLES = 3
+  };
+
+  /// \brief Header stored at the beginning of every visibility table.
+  struct VisibilityTableHeader
+  {
+    /// \brief Always VisibilityLookup::kMagic.
+    int32_t magic;
+
+    /// \brief Version of the file layout.
+    int32_t version;
+
+    /// \brief One of VisibilityTableFormat.
+    int32_t format;
+
+    /// \brief Distance between two cells (m).
+    int32_t stepSize;
+
+    /// \brief X coordinate of the first column (m).
+    int32_t minX;
+
+    /// \brief Y coordinate of the first row (m).
+    int32_t minY;
+
+    /// \brief Number of cells in each row.
+    int32_t columns;
+
+    /// \brief Number of rows.
+    int32_t rows;
+
+    /// \brief Radius of the neighborhood of a cell that was tested (cells).
+    int32_t radius;
+
+    /// \brief Number of uint64_t words per cell (STENCIL, CLEARANCE and
+    /// OBSTACLES).
+    int32_t wordsPerCell;
+
+    /// \brief Hash of the terrain used to generate the table.
+    /// \sa Common::TerrainHash()
+    uint64_t terrainHash;
+  };
+
+  /// \brief Header stored at the beginning of a tiled visibility table.
+  struct VisibilityTilesHeader
+  {
+    /// \brief Always VisibilityLookup::kTilesMagic.
+    int32_t magic;
+
+    /// \brief Version of the tiled layout.
+    int32_t version;
+
+    /// \brief Number of rows and columns of cells of each tile.
+    int32_t tileSize;
+
+    /// \brief Number of tiles in each row of tiles.
+    int32_t tileColumns;
+
+    /// \brief Number of rows of tiles.
+    int32_t tileRows;
+
+    /// \brief Unused, keeps the offsets of the tiles 8 byte aligned.
+    int32_t reserved;
+
+    /// \brief Header of the table that was split into tiles.
+    VisibilityTableHeader table;
+  };
+
+  /// \brief Query a visibility table generated by VisibilityTable.
+  ///
+  /// The table file is mapped read-only into memory, so no heap structure
+  /// is built when it's loaded and all the processes that use the same
+  /// table share the same pages of the page cache.
+  ///
+  /// Every table starts with a VisibilityTableHeader, followed by:
+  ///
+  /// * KEYS: the sorted list of uint64_t keys of the pairs of cells that
+  ///   *do not* have visibility. A key is computed as
+  ///   Pair(min(index1, index2), max(index1, index2)), so a single search
+  ///   answers the query for both orderings of a pair.
+  ///
+  /// * STENCIL: wordsPerCell uint64_t words for each cell. Each bit
+  ///   corresponds to one offset of the half disk of `radius` cells that
+  ///   follows the cell in index order (see StencilLayout()), and is set
+  ///   when the pair *does not* have visibility. A query is a single load
+  ///   plus a bit test.
+  ///
+  /// * CLEARANCE: wordsPerCell uint64_t words for each cell. The low 32
+  ///   bits of the first word hold the terrain height of the cell as a
+  ///   float. They are followed by one uint16_t for each offset of the
+  ///   stencil, four per word. The high byte is how far the terrain rises
+  ///   above the segment between the two cells, 1 meter above the ground,
+  ///   rounded up to the next meter (0 for visible pairs). The low byte is
+  ///   where that happens along the segment, in 1/255 units. Raising the
+  ///   endpoints raises the segment, so an altitude-aware query is a
+  ///   single load plus a comparison.
+  ///
+  /// * OBSTACLES: wordsPerCell uint64_t words for each cell, with 4 bits
+  ///   for each offset of the stencil, sixteen per word. The low two bits
+  ///   are the number of trees crossed by the segment between the two
+  ///   cells, 1 meter above the ground, up to 2. The next bit
+  ///   (kObstacleBuilding) is set when a building is crossed. These tables
+  ///   don't describe the terrain: they complement a terrain table of the
+  ///   same area, and are keyed by the obstacles of the world too (see
+  ///   ObstaclesCachePath()).
+  ///
+  /// Pairs that are farther apart than the generation radius are always
+  /// reported as visible.
+  ///
+  /// A table only covers the rectangle described by its header, usually
+  /// the search area plus a margin. Coordinates outside of that rectangle
+  /// have the index kOutside, and any pair that involves them is reported
+  /// as visible: the terrain is ignored there.
+  ///
+  /// Tables are stored in a cache directory, keyed by the hash of the
+  /// terrain they were generated for, by the area they cover and by their
+  /// step (see CachePath()).
+  ///
+  /// A terrain can have several levels of tables, with the same radius in
+  /// cells and a step kLevelFactor times larger at each level (see
+  /// VisibilityTable::SetLevel()). The finest level answers the pairs up to
+  /// 250 m apart and the coarser ones the pairs farther apart, so every
+  /// lookup stays a single load and the coarser tables stay small.
+  /// InRange() tells whether a level stores a pair.
+  ///
+  /// The STENCIL, CLEARANCE and OBSTACLES tables of very large terrains
+  /// can also be stored tiled, at TilesFilename() (see
+  /// VisibilityTable::WriteTiles()). The cells are split into squares of
+  /// tileSize x tileSize cells, each compressed on its own with zlib. The
+  /// VisibilityTilesHeader is followed by the file offset of every tile,
+  /// row of tiles after row of tiles, plus the end of the last one. Inside
+  /// a tile, the cells keep the index order and their words. Only the
+  /// compressed file is mapped: the tiles are decompressed when a query
+  /// needs them, into a least recently used cache of SetTileCacheSize()
+  /// tiles, so the memory used follows the cells that are queried rather
+  /// than the size of the terrain. The cache is shared by the threads that
+  /// query the table.
+  class IGNITION_VISIBLE VisibilityLookup
+  {
+    /// \brief Class constructor.
+    public: VisibilityLookup();
+
+    /// \brief Class destructor. Unmaps the table.
+    public: virtual ~VisibilityLookup();
+
+    /// \brief Map a visibility table file into memory.
+    /// \param[in] _filename Path to the visibility table.
+    /// \return True if the table was successfully loaded.
+    public: bool Load(const std::string &_filename);
+
+    /// \brief Unmap the current table, if any.
+    public: void Unload();
+
+    /// \brief Whether a table is currently loaded.
+    /// \return True if a table is loaded.
+    public: bool Loaded() const;
+
+    /// \brief Check if two cells of the table have line of sight.
+    /// \param[in] _index1 Index of the first cell.
+    /// \param[in] _index2 Index of the second cell.
+    /// \return True if the cells are visible, if no table is loaded, or if
+    /// one of the cells is kOutside. OBSTACLES tables report the cells as
+    /// visible unless a building or two trees are in between.
+    public: bool Visible(const uint64_t _index1, const uint64_t _index2) const;
+
+    /// \brief Check if two points at given heights have line of sight.
+    /// Only CLEARANCE tables consider the heights, the other formats assume
+    /// the points are 1 meter above the ground.
+    /// \param[in] _index1 Index of the cell of the first point.
+    /// \param[in] _z1 Height of the first point (m).
+    /// \param[in] _index2 Index of the cell of the second point.
+    /// \param[in] _z2 Height of the second point (m).
+    /// \return True if the points are visible, if no table is loaded, or
+    /// if one of the cells is kOutside.
+    public: bool Visible(const uint64_t _index1, const double _z1,
+                         const uint64_t _index2, const double _z2) const;
+
+    /// \brief Get the obstacles between two cells of an OBSTACLES table.
+    /// \param[in] _index1 Index of the first cell.
+    /// \param[in] _index2 Index of the second cell.
+    /// \param[out] _trees Number of trees crossed, up to 2.
+    /// \param[out] _building True if a building is crossed.
+    /// \return True if the table stores the pair. False if the table has
+    /// another format, if one of the cells is kOutside, or if the cells are
+    /// farther apart than the radius of the table.
+    public: bool Obstacles(const uint64_t _index1, const uint64_t _index2,
+                           unsigned int &_trees, bool &_building) const;
+
+    /// \brief Get the OBSTACLES entry of a segment: the trees and
+    /// buildings between its two ends, ignoring those beyond them. Used to
+    /// generate the tables, and for the pairs that they don't store.
+    /// \param[in] _trees The trees.
+    /// \param[in] _buildings The buildings.
+    /// \param[in] _p1 One end of the segment.
+    /// \param[in] _p2 The other end of the segment.
+    /// \return The 4 bit entry, the same for both orderings of the ends.
+    public: static unsigned int SegmentObstacles(const BoxHierarchy &_trees,
+                const BoxHierarchy &_buildings,
+                const ignition::math::Vector3d &_p1,
+                const ignition::math::Vector3d &_p2);
+
+    /// \brief Check if the table stores a pair of cells: both cells are
+    /// covered and within the radius of the table.
+    /// \param[in] _index1 Index of the first cell.
+    /// \param[in] _index2 Index of the second cell.
+    /// \return True if Visible() looks the pair up in the table.
+    public: bool InRange(const uint64_t _index1,
+                         const uint64_t _index2) const;
+
+    /// \brief Get the index of the cell that contains a coordinate.
+    /// \param[in] _x X world coordinate.
+    /// \param[in] _y Y world coordinate.
+    /// \return The cell index, or kOutside if the coordinate is not
+    /// covered by the table.
+    public: uint64_t Index(const double _x, const double _y) const;
+
+    /// \brief Get the number of blocked pairs stored in a KEYS table.
+    /// \return Number of keys.
+    public: uint64_t KeyCount() const;
+
+    /// \brief Format of the loaded table.
+    /// \return The table format.
+    public: VisibilityTableFormat Format() const;
+
+    /// \brief Header of the loaded table.
+    /// \return The table header.
+    public: const VisibilityTableHeader &Header() const;
+
+    /// \brief Granularity of the table.
+    /// \return Distance between two cells (m).
+    public: int StepSize() const;
+
+    /// \brief Number of cells in each row of the table.
+    /// \return Number of cells per row.
+    public: int RowSize() const;
+
+    /// \brief Hash of the terrain the table was generated for.
+    /// \return The terrain hash.
+    public: uint64_t TerrainHash() const;
+
+    /// \brief Size of the mapped table file. The pages are shared by the
+    /// processes that map the same table.
+    /// \return The size (bytes), or 0 if no table is loaded.
+    public: size_t MappedSize() const;
+
+    /// \brief Whether the loaded table is tiled.
+    /// \return True if the cells are decompressed on demand.
+    public: bool Tiled() const;
+
+    /// \brief Set the number of decompressed tiles kept in memory. The
+    /// least recently used tiles are dropped first.
+    /// \param[in] _tiles Number of tiles, at least 1.
+    public: void SetTileCacheSize(const size_t _tiles);
+
+    /// \brief Number of decompressed tiles kept in memory.
+    /// \return The size of the tile cache (tiles).
+    public: size_t TileCacheSize() const;
+
+    /// \brief Number of tiles currently decompressed.
+    /// \return The number of cached tiles.
+    public: size_t CachedTiles() const;
+
+    /// \brief Memory used by the decompressed tiles.
+    /// \return The size of the cached tiles (bytes).
+    public: uint64_t TileCacheBytes() const;
+
+    /// \brief Number of lookups of a tile that was already decompressed.
+    /// \return The number of cache hits.
+    public: uint64_t TileHits() const;
+
+    /// \brief Number of lookups that had to decompress a tile.
+    /// \return The number of cache misses.
+    public: uint64_t TileMisses() const;
+
+    /// \brief Get the directory where visibility tables are stored. It can
+    /// be set with the SWARM_VISIBILITY_CACHE environment variable, and
+    /// defaults to ~/.swarm/visibility.
+    /// \return Path to the cache directory.
+    public: static std::string CacheDirectory();
+
+    /// \brief Get the path of the visibility table of a terrain.
+    /// \param[in] _terrainHash Hash of the terrain.
+    /// \param[in] _minX X coordinate of the first column (m).
+    /// \param[in] _minY Y coordinate of the first row (m).
+    /// \param[in] _maxX X coordinate of the last column (m).
+    /// \param[in] _maxY Y coordinate of the last row (m).
+    /// \param[in] _stepSize Distance between two cells (m). The tables of
+    /// the coarser levels have it in their name.
+    /// \return Path to the table inside CacheDirectory().
+    public: static std::string CachePath(const uint64_t _terrainHash,
+                const int _minX, const int _minY,
+                const int _maxX, const int _maxY,
+                const int _stepSize = kFinestStepSize);
+
+    /// \brief Get the path of the obstacle table of a terrain.
+    /// \param[in] _terrainHash Hash of the terrain.
+    /// \param[in] _obstaclesHash Hash of the trees and buildings.
+    /// \param[in] _minX X coordinate of the first column (m).
+    /// \param[in] _minY Y coordinate of the first row (m).
+    /// \param[in] _maxX X coordinate of the last column (m).
+    /// \param[in] _maxY Y coordinate of the last row (m).
+    /// \param[in] _stepSize Distance between two cells (m).
+    /// \return Path to the table inside CacheDirectory().
+    /// \sa VisibilityTable::ObstaclesHash()
+    public: static std::string ObstaclesCachePath(
+                const uint64_t _terrainHash, const uint64_t _obstaclesHash,
+                const int _minX, const int _minY,
+                const int _maxX, const int _maxY,
+                const int _stepSize = kFinestStepSize);
+
+    /// \brief Get the path of the tiled version of a table.
+    /// \param[in] _table Path of the table.
+    /// \return The path, next to the table, with a .tiles extension.
+    public: static std::string TilesFilename(const std::string &_table);
+
+    /// \brief A pairing function that maps two values to a unique third
+    /// value (Szudzik's function).
+    /// \param[in] _a First value
+    /// \param[in] _b Second value
+    /// \return A unique key value
+    public: static uint64_t Pair(const uint64_t _a, const uint64_t _b);
+
+    /// \brief Assign a bit to each offset of the stencil of a cell.
+    /// The stencil contains the offsets (dx, dy), in cells, that satisfy
+    /// dx*dx + dy*dy <= radius*radius and that lead to a larger index:
+    /// dy > 0, or dy == 0 and dx > 0.
+    /// \param[in] _radius Radius of the stencil (cells).
+    /// \param[out] _bitCount Number of bits used by the stencil.
+    /// \return A vector with (_radius + 1) * (2 * _radius + 1) elements.
+    /// The element dy * (2 * _radius + 1) + dx + _radius stores the bit of
+    /// the offset (dx, dy), or -1 if the offset is not in the stencil.
+    public: static std::vector<int> StencilLayout(const int _radius,
+                                                  int &_bitCount);
+
+    /// \brief Number of uint64_t words used by each cell of a table.
+    /// \param[in] _format Format of the table.
+    /// \param[in] _bitCount Number of offsets of the stencil.
+    /// \return Number of words per cell, 0 for KEYS tables.
+    /// \sa StencilLayout()
+    public: static int WordsPerCell(const VisibilityTableFormat _format,
+                                    const int _bitCount);
+
+    /// \brief First value of every visibility table.
+    public: static const int32_t kMagic = 0x53575654;
+
+    /// \brief Current version of the file layout.
+    public: static const int32_t kVersion = 2;
+
+    /// \brief Distance between two cells of the finest level (m).
+    public: static const int kFinestStepSize = 10;
+
+    /// \brief Ratio between the steps of two consecutive levels.
+    public: static const int kLevelFactor = 4;
+
+    /// \brief First value of every tiled visibility table.
+    public: static const int32_t kTilesMagic = 0x53575449;
+
+    /// \brief Current version of the tiled layout.
+    public: static const int32_t kTilesVersion = 1;
+
+    /// \brief Default number of decompressed tiles kept in memory.
+    public: static const size_t kDefaultTileCache = 64;
+
+    /// \brief Index of the coordinates that are not covered by the table.
+    public: static const uint64_t kOutside = UINT64_MAX;
+
+    /// \brief Bits of an OBSTACLES entry that count the trees.
+    public: static const unsigned int kObstacleTrees = 0x3;
+
+    /// \brief Bit of an OBSTACLES entry set when a building is crossed.
+    public: static const unsigned int kObstacleBuilding = 0x4;
+
+    /// \brief Load and validate a KEYS table.
+    /// \param[in] _filename Path to the visibility table.
+    /// \return True if the table is valid.
+    private: bool LoadKeys(const std::string &_filename);
+
+    /// \brief Load and validate a STENCIL, CLEARANCE or OBSTACLES table.
+    /// \param[in] _filename Path to the visibility table.
+    /// \return True if the table is valid.
+    private: bool LoadCells(const std::string &_filename);
+
+    /// \brief Load and validate a tiled table.
+    /// \param[in] _filename Path to the tiled table.
+    /// \return True if the table is valid.
+    private: bool LoadTiles(const std::string &_filename);
+
+    /// \brief Whether the loaded table has cells, mapped or tiled.
+    /// \return True for STENCIL, CLEARANCE and OBSTACLES tables.
+    private: bool HasCells() const;
+
+    /// \brief Get a word of a cell, from the mapped cells or from its tile.
+    /// \param[in] _index Index of the cell.
+    /// \param[in] _word Index of the word in the cell.
+    /// \return The word.
+    private: uint64_t CellWord(const uint64_t _index, const int _word) const;
+
+    /// \brief Get the words of a tile, decompressing it if it isn't in the
+    /// cache. Must be called with tileMutex locked.
+    /// \param[in] _tile Index of the tile.
+    /// \return The words of the cells of the tile, or null if the tile is
+    /// corrupt.
+    private: const uint64_t *TileWords(const uint64_t _tile) const;
+
+    /// \brief Drop the least recently used tiles over the cache size.
+    private: void TrimTileCache() const;
+
+    /// \brief Check a pair of cells in a KEYS table.
+    /// \param[in] _a Smallest cell index.
+    /// \param[in] _b Largest cell index.
+    /// \return True if the cells are visible.
+    private: bool KeysVisible(const uint64_t _a, const uint64_t _b) const;
+
+    /// \brief Check a pair of cells in a STENCIL table.
+    /// \param[in] _a Smallest cell index.
+    /// \param[in] _b Largest cell index.
+    /// \return True if the cells are visible.
+    private: bool StencilVisible(const uint64_t _a, const uint64_t _b) const;
+
+    /// \brief Check a pair of cells in a CLEARANCE table.
+    /// \param[in] _a Smallest cell index.
+    /// \param[in] _za Height of the point in cell _a (m).
+    /// \param[in] _b Largest cell index.
+    /// \param[in] _zb Height of the point in cell _b (m).
+    /// \return True if the points are visible.
+    private: bool ClearanceVisible(const uint64_t _a, const double _za,
+                                   const uint64_t _b, const double _zb) const;
+
+    /// \brief Get the entry of a pair of cells in an OBSTACLES table.
+    /// \param[in] _a Smallest cell index.
+    /// \param[in] _b Largest cell index.
+    /// \return The 4 bit entry, or -1 if the pair is not in the stencil.
+    private: int ObstacleEntry(const uint64_t _a, const uint64_t _b) const;
+
+    /// \brief Get the stencil bit of a pair of cells.
+    /// \param[in] _a Smallest cell index.
+    /// \param[in] _b Largest cell index.
+    /// \return The stencil bit, or -1 if the pair is not in the stencil.
+    private: int StencilBit(const uint64_t _a, const uint64_t _b) const;
+
+    /// \brief Start of the memory mapped file.
+    private: const char *data = nullptr;
+
+    /// \brief Size of the memory mapped file (bytes).
+    private: size_t dataSize = 0;
+
+    /// \brief Header of the loaded table.
+    private: VisibilityTableHeader header;
+
+    /// \brief Keys of a KEYS table.
+    private: const uint64_t *keys = nullptr;
+
+    /// \brief Number of keys stored in a KEYS table.
+    private: uint64_t keyCount = 0;
+
+    /// \brief Cell words of a STENCIL, CLEARANCE or OBSTACLES table.
+    private: const uint64_t *cells = nullptr;
+
+    /// \brief Number of cells of the table.
+    private: uint64_t cellCount = 0;
+
+    /// \brief Header of a tiled table.
+    private: VisibilityTilesHeader tilesHeader;
+
+    /// \brief File offsets of the compressed tiles of a tiled table, plus
+    /// the end of the last tile.
+    private: const uint64_t *tileOffsets = nullptr;
+
+    /// \brief A decompressed tile.
+    private: struct CachedTile
+    {
+      /// \brief Index of the tile.
+      uint64_t tile;
+
+      /// \brief Words of the cells of the tile.
+      std::vector<uint64_t> words;
+    };
+
+    /// \brief Decompressed tiles, the most recently used first.
+    private: mutable std::list<CachedTile> tileCache;
+
+    /// \brief Position of each decompressed tile in tileCache.
+    private: mutable std::unordered_map<uint64_t,
+             std::list<CachedTile>::iterator> tileIndex;
+
+    /// \brief Number of decompressed tiles kept in memory.
+    private: size_t tileCacheSize = kDefaultTileCache;
+
+    /// \brief Number of lookups of a cached tile.
+    private: mutable uint64_t tileHits = 0;
+
+    /// \brief Number of tiles decompressed.
+    private: mutable uint64_t tileMisses = 0;
+
+    /// \brief Whether a corrupt tile was already reported.
+    private: mutable bool tileError = false;
+
+    /// \brief Protects the tile cache and its counters.
+    private: mutable std::mutex tileMutex;
+
+    /// \brief Bit assigned to each offset of the stencil.
+    /// \sa StencilLayout()
+    private: std::vector<int> stencilLayout;
+  };
+}
+#endif
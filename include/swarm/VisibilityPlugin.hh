@@ -22,28 +22,42 @@
 
 namespace gazebo
 {
-  /// \brief This plugin generates a visibility lookup table with the
-  /// following contents:
-  ///
-  /// int max_y_value
-  /// int step_size
-  /// int row_size
-  /// uint64_t keys
-  ///
-  /// Data is stored in binary, and keys is a list of unique uint64_t values
-  /// that represent two coordinates that *do not* have visiblity. It is
+  /// \brief This plugin generates a visibility lookup table. See
+  /// swarm::VisibilityTable for a description of the table formats. It is
   /// assumed that any two coordiantes separated by more than 250m are not
   /// visible.
   ///
-  /// Keys are generated using a combination of an Index and Pair function.
-  ///
   /// We assume a terrain, without any other objects, is used to generate
   /// the visibility lookup table.
   ///
   /// Example usage:
   ///   gzserver -s libVisibilityPlugin.so --iters 1 worlds/swarm_vis.world
   ///
-  /// The visibility table will be located at /tmp/visibility.dat
+  /// The table is generated in parallel. Set the SWARM_VISIBILITY_THREADS
+  /// environment variable to limit the number of worker threads, and
+  /// SWARM_VISIBILITY_FORMAT=keys to generate the key list format instead
+  /// of the default stencil format, or SWARM_VISIBILITY_FORMAT=clearance
+  /// for the altitude-aware format (always uses the heightmap backend).
+  /// Only the heightmap and gpu backends scale with the threads: the ray
+  /// casts go through the shared state of the physics engine, and may
+  /// not run faster than on a single thread. SWARM_VISIBILITY_BACKEND=heightmap
+  /// replaces the ray casts by analytic tests on the heightmap, and
+  /// SWARM_VISIBILITY_BACKEND=gpu runs them on an OpenCL device, with
+  /// SWARM_VISIBILITY_GPU_VALIDATE=<n> to compare n cells with the CPU. The
+  /// swarm_visibility tool does the same without starting a server.
+  /// SWARM_VISIBILITY_SHARD=<i>/<n> only generates shard i of n, so that
+  /// the nodes of an array job split the table, merged afterwards with
+  /// swarm_visibility_merge. SWARM_VISIBILITY_TILES=<n> also writes the
+  /// table split into compressed tiles of n x n cells, that the broker
+  /// loads instead of the table and decompresses on demand.
+  /// SWARM_VISIBILITY_LEVELS=<n> generates the n finest levels of the
+  /// table, the coarser ones storing the pairs farther apart than 250m for
+  /// long range radios.
+  ///
+  /// The visibility table will be located in the directory given by the
+  /// SWARM_VISIBILITY_CACHE environment variable (~/.swarm/visibility by
+  /// default), in a file named after the hash of the terrain and the area
+  /// covered.
   class GAZEBO_VISIBLE VisibilityPlugin : public SystemPlugin
   {
     /// \brief Destructor
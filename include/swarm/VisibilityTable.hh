@@ -17,26 +17,79 @@
 #ifndef _SWARM_VISIBILITYTABLE_HH_
 #define _SWARM_VISIBILITYTABLE_HH_
 
+#include <cstdint>
 #include <string>
-#include <array>
+#include <vector>
 
 #include "gazebo/common/Plugin.hh"
 #include "gazebo/util/system.hh"
+#include "swarm/BoxHierarchy.hh"
+#include "swarm/Heightmap.hh"
+#include "swarm/VisibilityGpu.hh"
+#include "swarm/VisibilityLookup.hh"
 
 namespace swarm
 {
-  /// \brief This class generates a visibility lookup table with the
-  /// following contents:
-  ///
-  /// int max_y_value
-  /// int step_size
-  /// int row_size
-  /// uint64_t keys
-  ///
-  /// Data is stored in binary, and keys is a list of unique uint64_t values
-  /// that represent two coordinates that *do not* have visiblity. It is
-  /// assumed that any two coordiantes separated by more than 250m are not
-  /// visible.
+  /// \brief How VisibilityTable tests the line of sight between cells.
+  enum VisibilityTableBackend
+  {
+    /// \brief Ray casts against the physics scene.
+    RAY_BACKEND = 0,
+
+    /// \brief Analytic tests on the heightmap samples, see Heightmap.
+    /// Much faster, and doesn't need a physics engine.
+    HEIGHTMAP_BACKEND = 1,
+
+    /// \brief The heightmap tests of STENCIL tables run on an OpenCL
+    /// device, see VisibilityGpu. Other formats, and builds or machines
+    /// without OpenCL, use HEIGHTMAP_BACKEND.
+    GPU_BACKEND = 2
+  };
+
+  /// \brief Header stored at the beginning of a shard of a visibility
+  /// table, written instead of the table after VisibilityTable::SetShard().
+  /// It's followed by the words of the rows of the shard, or by its sorted
+  /// keys.
+  struct VisibilityShardHeader
+  {
+    /// \brief Always VisibilityTable::kShardMagic.
+    int32_t magic;
+
+    /// \brief Version of the shard layout.
+    int32_t version;
+
+    /// \brief Index of the shard, from 0 to count - 1.
+    int32_t index;
+
+    /// \brief Number of shards of the table.
+    int32_t count;
+
+    /// \brief First row of the table computed by the shard.
+    int32_t firstRow;
+
+    /// \brief Number of rows computed by the shard.
+    int32_t rowCount;
+
+    /// \brief Number of uint64_t words that follow the header.
+    uint64_t wordCount;
+
+    /// \brief Hash of the trees and buildings, for OBSTACLES tables.
+    uint64_t obstaclesHash;
+
+    /// \brief Header of the merged table.
+    VisibilityTableHeader table;
+  };
+
+  /// \brief This class generates a visibility lookup table. By default the
+  /// table uses the STENCIL format: a bitmask per cell with one bit for
+  /// each cell within 250m that comes later in index order. The KEYS
+  /// format stores a sorted list of unique uint64_t values that represent
+  /// two coordinates that *do not* have visiblity. The CLEARANCE format
+  /// stores how far the terrain rises above each pair, so aerial vehicles
+  /// can be tested at their real altitude, and requires the heightmap
+  /// backend. All formats start with a VisibilityTableHeader and can be
+  /// queried with VisibilityLookup. It is assumed that any two coordiantes
+  /// separated by more than 250m are not visible.
   ///
   /// Keys are generated using a combination of an Index and Pair function.
   ///
@@ -46,54 +99,402 @@ namespace swarm
   /// To generate the lookup table:
   ///   gzserver -s libVisibilityPlugin.so --iters 1 worlds/swarm_vis.world
   ///
-  /// The visibility table will be located at /tmp/visibility.dat
+  /// The table covers the search area of the world, extended by the
+  /// 250m radius so that robots at the border still see their neighbors,
+  /// and clipped to the terrain. Worlds without a search area use the whole
+  /// terrain. Coordinates outside of the table are reported as visible by
+  /// VisibilityLookup.
+  ///
+  /// The visibility table will be located at Filename(), keyed by the hash
+  /// of the terrain and by the area covered.
+  ///
+  /// Pairs farther apart than 250m are stored by the coarser levels of the
+  /// table (see SetLevel()). Level n has a step of 10 * 4^n meters, and the
+  /// same radius in cells, so it covers pairs up to 250 * 4^n meters apart
+  /// with 16^n times fewer cells than the finest level. CommsModel reads
+  /// each pair from the finest level that stores it:
+  ///   swarm_visibility --levels 3 <world file>
+  ///
+  /// Generation is split into bands of rows that are processed by a pool
+  /// of worker threads, each one with its own ray shape. The output does
+  /// not depend on the number of threads. Only the heightmap backend
+  /// scales with them: the ray casts of RAY_BACKEND share the collision
+  /// space of the physics engine, and its locking may serialize the
+  /// workers. Rows are generated in chunks,
+  /// and only the terrain heights of a sliding window of rows are kept, so
+  /// memory doesn't grow with the size of the area. KEYS tables still
+  /// gather their keys, to sort them.
+  ///
+  /// With HEIGHTMAP_BACKEND, the rays are replaced by Heightmap queries.
+  /// A table can then be generated without a running server, using the
+  /// swarm_visibility tool:
+  ///   swarm_visibility worlds/swarm_vis.world
+  ///
+  /// The OBSTACLES format is an optional second layer, generated from the
+  /// trees and buildings of a world instead of its terrain. It's stored
+  /// next to the terrain table, at ObstaclesFilename(), and lets
+  /// CommsModel classify the links of robots on the ground with a single
+  /// lookup. It needs the world with its obstacles, and always uses the
+  /// heightmap for the terrain, so that rays don't hit the trees:
+  ///   SWARM_VISIBILITY_FORMAT=obstacles gzserver -s libVisibilityPlugin.so
+  ///     --iters 1 <world file>
+  ///
+  /// With GPU_BACKEND, the stencil of each cell is computed by a work group
+  /// of an OpenCL device, with the same words as the heightmap backend.
+  /// SetGpuValidation() generates a sample of the cells on the CPU too,
+  /// and discards the table if any word differs:
+  ///   swarm_visibility --gpu --validate 10000 worlds/swarm_vis.world
+  ///
+  /// Large tables can be generated on several nodes of a cluster. After
+  /// SetShard(), Generate() only computes a contiguous band of the rows and
+  /// writes it to ShardFilename(), next to the table. Once every shard is
+  /// done, MergeShards() validates them and writes the table, identical to
+  /// the one generated in a single run:
+  ///   swarm_visibility --shard $SLURM_ARRAY_TASK_ID/16 <world file>
+  ///   swarm_visibility_merge <table>.shard-*-of-16
+  ///
+  /// The cells of very large terrains can also be split into tiles,
+  /// compressed independently, that VisibilityLookup decompresses on
+  /// demand. WriteTiles() converts an existing table, and SetTileSize()
+  /// writes the tiled table after generating the table:
+  ///   swarm_visibility --tiles 32 <world file>
+  ///
+  /// Two tables of a terrain, of any formats, steps or tiles, can be
+  /// compared on random or all the pairs of cells, and their load time,
+  /// lookup latency and memory measured on the same queries:
+  ///   swarm_visibility_compare <table> <other table>
+  class Common;
+
   class VisibilityTable
   {
-    /// \brief Destructor
+    /// \brief Constructor
     public: VisibilityTable();
 
-    /// \brief Generate the table
-    public: void Generate();
+    /// \brief Select the level of the table to generate. Must be called
+    /// before SetArea().
+    /// \param[in] _level Level, from 0 (the finest) to kMaxLevels - 1.
+    /// \return False if the level is out of range.
+    public: bool SetLevel(const int _level);
+
+    /// \brief Level of the table.
+    /// \return The level, 0 for the finest.
+    public: int Level() const;
+
+    /// \brief Distance between two cells of a level.
+    /// \param[in] _level The level.
+    /// \return The step (m).
+    public: static int LevelStepSize(const int _level);
+
+    /// \brief Distance up to which a level stores the pairs of cells.
+    /// \param[in] _level The level.
+    /// \return The radius of the level (m).
+    public: static double LevelRange(const int _level);
+
+    /// \brief Number of levels of a table.
+    public: static const int kMaxLevels = 4;
+
+    /// \brief Set the terrain and the area covered by the table, from the
+    /// terrain and the search area of a Common object. The terrain must be
+    /// set, and the search area is optional.
+    /// \param[in] _common Terrain and search area of the world.
+    public: void SetArea(const Common &_common);
+
+    /// \brief Cover a whole terrain.
+    /// \param[in] _terrainHash Hash of the terrain.
+    /// \param[in] _terrainSize Size of the terrain (m).
+    public: void SetArea(const uint64_t _terrainHash,
+                         const ignition::math::Vector3d &_terrainSize);
+
+    /// \brief Cover the search area of a terrain, extended by the radius
+    /// of the table.
+    /// \param[in] _terrainHash Hash of the terrain.
+    /// \param[in] _terrainSize Size of the terrain (m).
+    /// \param[in] _searchMin Minimum corner of the search area (m).
+    /// \param[in] _searchMax Maximum corner of the search area (m).
+    /// \sa Common::SearchAreaBounds()
+    public: void SetArea(const uint64_t _terrainHash,
+                         const ignition::math::Vector3d &_terrainSize,
+                         const ignition::math::Vector3d &_searchMin,
+                         const ignition::math::Vector3d &_searchMax);
+
+    /// \brief Get the path of the table for the area set with SetArea().
+    /// \return Path to the table inside VisibilityLookup::CacheDirectory().
+    public: std::string Filename() const;
+
+    /// \brief Get the path of the obstacle table for the area set with
+    /// SetArea().
+    /// \param[in] _obstaclesHash Hash of the trees and buildings.
+    /// \return Path to the table inside VisibilityLookup::CacheDirectory().
+    /// \sa ObstaclesHash()
+    public: std::string ObstaclesFilename(const uint64_t _obstaclesHash) const;
+
+    /// \brief Set the trees and buildings tested by OBSTACLES tables.
+    /// \param[in] _trees Bounding boxes of the trees.
+    /// \param[in] _buildings Bounding boxes of the buildings.
+    public: void SetObstacles(
+                const std::vector<ignition::math::Box> &_trees,
+                const std::vector<ignition::math::Box> &_buildings);
+
+    /// \brief Hash of the trees and buildings of a world, which keys its
+    /// obstacle table.
+    /// \param[in] _trees Bounding boxes of the trees.
+    /// \param[in] _buildings Bounding boxes of the buildings.
+    /// \return The hash of the boxes.
+    public: static uint64_t ObstaclesHash(
+                const std::vector<ignition::math::Box> &_trees,
+                const std::vector<ignition::math::Box> &_buildings);
+
+    /// \brief Compare a sample of the cells computed by the GPU with the
+    /// CPU, and fail the generation if any of them differs.
+    /// \param[in] _cells Number of cells of the sample, 0 to disable the
+    /// validation.
+    public: void SetGpuValidation(const unsigned int _cells);
+
+    /// \brief Only generate one shard of the table. Rows are split evenly
+    /// between the shards.
+    /// \param[in] _index Index of the shard, from 0 to _count - 1.
+    /// \param[in] _count Number of shards. 1 generates the whole table.
+    /// \return False if the index is out of range.
+    public: bool SetShard(const int _index, const int _count);
+
+    /// \brief Also write the tiled version of the generated table, next to
+    /// it, see WriteTiles(). Ignored by KEYS tables and shards.
+    /// \param[in] _tileSize Rows and columns of cells of each tile, 0 to
+    /// only write the table.
+    public: void SetTileSize(const int _tileSize);
+
+    /// \brief Parse a shard given as "<index>/<count>", as accepted by
+    /// SetShard().
+    /// \param[in] _spec The shard.
+    /// \param[out] _index Index of the shard.
+    /// \param[out] _count Number of shards.
+    /// \return False if the shard is not valid.
+    public: static bool ParseShard(const std::string &_spec, int &_index,
+                                   int &_count);
+
+    /// \brief Get the path of a shard of a table.
+    /// \param[in] _table Path of the table.
+    /// \param[in] _index Index of the shard.
+    /// \param[in] _count Number of shards.
+    /// \return The path of the shard, next to the table.
+    public: static std::string ShardFilename(const std::string &_table,
+                                             const int _index,
+                                             const int _count);
+
+    /// \brief Merge the shards of a table. All the shards must be given,
+    /// with the same table header, and cover every row once.
+    /// \param[in] _shards Paths of the shards, in any order.
+    /// \param[in] _output Path of the table. If empty, the table is written
+    /// to the cache, at the path given by the header of the shards.
+    /// \return True if the table was merged or already existed.
+    public: static bool MergeShards(const std::vector<std::string> &_shards,
+                                    const std::string &_output = "");
+
+    /// \brief Split a STENCIL, CLEARANCE or OBSTACLES table into square
+    /// tiles of cells, compressed independently, as loaded by
+    /// VisibilityLookup.
+    /// \param[in] _table Path of the table.
+    /// \param[in] _tileSize Rows and columns of cells of each tile.
+    /// \param[in] _output Path of the tiled table. If empty, it's written
+    /// next to the table, at VisibilityLookup::TilesFilename().
+    /// \return True if the tiled table was written or already existed.
+    public: static bool WriteTiles(const std::string &_table,
+                                   const int _tileSize = kDefaultTileSize,
+                                   const std::string &_output = "");
+
+    /// \brief Default number of rows and columns of cells of a tile.
+    public: static const int kDefaultTileSize = 32;
+
+    /// \brief Magic number of the shards.
+    public: static const int32_t kShardMagic = 0x53575653;
+
+    /// \brief Version of the shard layout.
+    public: static const int32_t kShardVersion = 1;
+
+    /// \brief Generate the table of the current world.
+    /// \param[in] _threads Number of worker threads. A value of zero
+    /// uses one thread per hardware core. The ray casts of RAY_BACKEND
+    /// are not expected to scale with the threads.
+    /// \param[in] _format Format of the table.
+    /// \param[in] _backend Line of sight test used.
+    /// \return True if the table was generated or already existed.
+    public: bool Generate(const unsigned int _threads = 0,
+                const VisibilityTableFormat _format = STENCIL,
+                const VisibilityTableBackend _backend = RAY_BACKEND);
+
+    /// \brief Generate the table of a heightmap, without a world. The
+    /// area covered by the table must be set with SetArea().
+    /// \param[in] _heightmap Samples of the terrain.
+    /// \param[in] _threads Number of worker threads. A value of zero
+    /// uses one thread per hardware core.
+    /// \param[in] _format Format of the table.
+    /// \param[in] _backend GPU_BACKEND to run the tests on the GPU, any
+    /// other value for the CPU.
+    /// \return True if the table was generated or already existed.
+    public: bool Generate(const Heightmap &_heightmap,
+                const unsigned int _threads = 0,
+                const VisibilityTableFormat _format = STENCIL,
+                const VisibilityTableBackend _backend = HEIGHTMAP_BACKEND);
+
+    /// \brief Set the area covered by the table, snapped to its grid.
+    /// \param[in] _terrainHash Hash of the terrain.
+    /// \param[in] _min Minimum corner of the area (m).
+    /// \param[in] _max Maximum corner of the area (m).
+    private: void SetBounds(const uint64_t _terrainHash,
+                            const ignition::math::Vector3d &_min,
+                            const ignition::math::Vector3d &_max);
+
+    /// \brief Generate the table in the cache.
+    /// \param[in] _rays One ray per worker thread. The rays are not used
+    /// if a heightmap is set.
+    /// \param[in] _format Format of the table.
+    /// \return True if the table was generated or already existed.
+    private: bool Build(
+                 const std::vector<gazebo::physics::RayShapePtr> &_rays,
+                 const VisibilityTableFormat _format);
+
+    /// \brief Compute the visibility of all the pairs that start on a row
+    /// of the table.
+    /// \param[in] _y Y world coordinate of the row.
+    /// \param[in] _ray Ray used for the line of sight tests.
+    /// \param[out] _out The stencil words of each cell of the row, or the
+    /// keys of the blocked pairs, are appended here.
+    private: void GenerateRow(const int _y,
+                              gazebo::physics::RayShapePtr _ray,
+                              std::vector<uint64_t> &_out) const;
+
+    /// \brief Compute the visibility of all the pairs that start on a cell.
+    /// \param[in] _x X world coordinate of the cell.
+    /// \param[in] _y Y world coordinate of the cell.
+    /// \param[in] _ray Ray used for the line of sight tests.
+    /// \param[out] _out The words of the cell, or the keys of the blocked
+    /// pairs, are appended here.
+    private: void GenerateCell(const int _x, const int _y,
+                               gazebo::physics::RayShapePtr _ray,
+                               std::vector<uint64_t> &_out) const;
 
     /// \brief Get the height at a coordinate
+    /// \param[in] _ray Ray used for the height test, unless a heightmap
+    /// is set.
     /// \param[in] _x X world coordinate
     /// \param[in] _y Y world coordinate
     /// \return Height at the coordinate
-    private: double HeightAt(const double _x, const double _y) const;
+    private: double HeightAt(gazebo::physics::RayShapePtr _ray,
+                             const double _x, const double _y) const;
 
     /// \brief Get whether two points have line of sight.
+    /// \param[in] _ray Ray used for the line of sight test, unless a
+    /// heightmap is set.
     /// \param[in] _p1 First coordinate
     /// \param[in] _p1 Second coordinate
     /// \return True if the two points are visible
-    private: bool LineOfSight(const ignition::math::Vector3d &_p1,
-                              const ignition::math::Vector3d &_p2);
-
-    /// \brief A pairing function that maps two values to a unique third
-    /// value.
-    /// \param[in] _a First value
-    /// \param[in] _b Second value
-    /// \return A unique key value
-    private: uint64_t Pair(const uint64_t _a, uint64_t _b);
+    private: bool LineOfSight(gazebo::physics::RayShapePtr _ray,
+                              const ignition::math::Vector3d &_p1,
+                              const ignition::math::Vector3d &_p2) const;
 
     /// \brief Generate an index from a coordinate.
     /// \param[in] _x X coordinate
     /// \param[in] _y Y coordinate
-    private: uint64_t Index(int _x, int _y);
+    private: uint64_t Index(int _x, int _y) const;
+
+    /// \brief Get the index of the height of a coordinate in the window of
+    /// height rows.
+    /// \param[in] _x X coordinate
+    /// \param[in] _y Y coordinate
+    /// \return The index in heights.
+    private: size_t HeightIndex(int _x, int _y) const;
+
+    /// \brief X coordinate of the first column (m).
+    private: int minX;
+
+    /// \brief Y coordinate of the first row (m).
+    private: int minY;
 
-    /// \brief XY range, or size of the swarm search area
-    private: std::array<int, 2> range;
+    /// \brief X coordinate of the last column (m).
+    private: int maxX;
 
-    /// \brief Maximum Y value of the range
+    /// \brief Y coordinate of the last row (m).
     private: int maxY;
 
     /// \brief The granularity of the visibility table
     private: int stepSize;
 
+    /// \brief Level of the table, see SetLevel().
+    private: int level = 0;
+
+    /// \brief Radius of the finest level (m).
+    private: static const int kFinestRange = 250;
+
     /// \brief Number of values in each row of the visibility table.
-    private: int rowSize;
+    private: int columns;
+
+    /// \brief Number of rows of the visibility table.
+    private: int rows;
+
+    /// \brief Hash of the terrain.
+    private: uint64_t terrainHash = 0;
+
+    /// \brief Trees tested by OBSTACLES tables.
+    private: BoxHierarchy trees;
+
+    /// \brief Buildings tested by OBSTACLES tables.
+    private: BoxHierarchy buildings;
+
+    /// \brief Hash of the trees and buildings.
+    private: uint64_t obstaclesHash = 0;
+
+    /// \brief Heightmap used instead of the rays, if any.
+    private: const Heightmap *heightmap = nullptr;
+
+    /// \brief Largest coordinate covered by a table (m).
+    private: static const int kMaxRange = 20000;
+
+    /// \brief Format of the table being generated.
+    private: VisibilityTableFormat format = STENCIL;
+
+    /// \brief Radius of the stencil (cells).
+    private: int radius;
+
+    /// \brief Number of uint64_t words per cell.
+    private: int wordsPerCell;
+
+    /// \brief Number of offsets of the stencil.
+    private: int bitCount = 0;
+
+    /// \brief Bit assigned to each offset of the stencil.
+    /// \sa VisibilityLookup::StencilLayout()
+    private: std::vector<int> stencilLayout;
+
+    /// \brief Device running the tests, if any.
+    private: VisibilityGpu *gpu = nullptr;
+
+    /// \brief Number of cells compared between the GPU and the CPU.
+    private: unsigned int gpuValidation = 0;
+
+    /// \brief Number of different cells printed by the validation.
+    private: static const uint64_t kMaxReportedCells = 10;
+
+    /// \brief Index of the shard generated.
+    private: int shardIndex = 0;
+
+    /// \brief Number of shards of the table.
+    private: int shardCount = 1;
+
+    /// \brief Size of the tiles written after the table, 0 for none.
+    private: int tileSize = 0;
+
+    /// \brief Number of rows processed by a worker thread at a time.
+    private: static const int kRowsPerBand = 8;
+
+    /// \brief Number of words copied at a time by MergeShards().
+    private: static const size_t kMergeBlockWords = 1 << 16;
+
+    /// \brief Number of rows of the window of heights.
+    private: int heightRows = 1;
 
-    // \brief Ray used to test for line of sight.
-    private: gazebo::physics::RayShapePtr ray;
+    /// \brief Terrain height of the cells of the window of rows being
+    /// generated, a ring buffer indexed by HeightIndex().
+    private: std::vector<double> heights;
   };
 }
 #endif
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file WorkerPool.hh
+/// \brief Persistent worker threads for data parallel loops.
+
+#ifndef __SWARM_WORKER_POOL_HH__
+#define __SWARM_WORKER_POOL_HH__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "swarm/Helpers.hh"
+
+namespace swarm
+{
+  /// \brief A set of threads that run the iterations of a loop in parallel.
+  ///
+  /// The threads are created once and wait between loops, so the pool can
+  /// be used at every simulation step. The thread calling Run() also runs
+  /// iterations, as worker 0.
+  ///
+  /// Only the thread calling fork() survives in the child process, so the
+  /// threads of every pool are stopped before a fork() and started again in
+  /// both processes. The process must not fork while a loop is running.
+  class IGNITION_VISIBLE WorkerPool
+  {
+    /// \brief Signature of the body of a loop.
+    /// \param[in] _index Index of the iteration.
+    /// \param[in] _worker Index of the worker running it, lower than
+    /// Size(). A worker runs one iteration at a time, so it can be used
+    /// to select per thread buffers.
+    public: using Task = std::function<void(const unsigned int _index,
+                                            const unsigned int _worker)>;
+
+    /// \brief Class constructor.
+    /// \param[in] _workers Number of workers, including the thread calling
+    /// Run(). A value of zero uses one worker per hardware core.
+    public: explicit WorkerPool(const unsigned int _workers);
+
+    /// \brief Class destructor. Stops the threads.
+    public: virtual ~WorkerPool();
+
+    /// \brief Number of workers, including the thread calling Run().
+    /// \return The number of workers.
+    public: unsigned int Size() const;
+
+    /// \brief Run the iterations of a loop, and wait for all of them to
+    /// finish. The order of the iterations is not specified.
+    /// \param[in] _count Number of iterations.
+    /// \param[in] _task Body of the loop.
+    public: void Run(const unsigned int _count, const Task &_task);
+
+    /// \brief Main loop of a worker thread.
+    /// \param[in] _worker Index of the worker.
+    private: void Work(const unsigned int _worker);
+
+    /// \brief Run iterations of the current loop until there are none left.
+    /// \param[in] _worker Index of the worker.
+    private: void RunIterations(const unsigned int _worker);
+
+    /// \brief Start the worker threads.
+    private: void StartThreads();
+
+    /// \brief Stop the worker threads, once they finish the current loop.
+    private: void StopThreads();
+
+    /// \brief Stop the threads of every pool, before a fork().
+    private: static void OnForkPrepare();
+
+    /// \brief Start the threads of every pool again, after a fork(), in the
+    /// parent and in the child.
+    private: static void OnForkResume();
+
+    /// \brief Number of workers, including the thread calling Run().
+    private: unsigned int workers;
+
+    /// \brief Worker threads, from worker 1.
+    private: std::vector<std::thread> threads;
+
+    /// \brief Protects the state of the current loop.
+    private: std::mutex mutex;
+
+    /// \brief Notifies the workers of a new loop, or that they must stop.
+    private: std::condition_variable wake;
+
+    /// \brief Notifies Run() that the workers finished the loop.
+    private: std::condition_variable done;
+
+    /// \brief Body of the current loop.
+    private: const Task *task = nullptr;
+
+    /// \brief Number of iterations of the current loop.
+    private: unsigned int count = 0;
+
+    /// \brief Next iteration to run.
+    private: std::atomic<unsigned int> next;
+
+    /// \brief Number of worker threads still running the current loop.
+    private: unsigned int busy = 0;
+
+    /// \brief Number of loops started, used to wake the workers once per
+    /// loop.
+    private: uint64_t generation = 0;
+
+    /// \brief Whether the threads must stop.
+    private: bool stop = false;
+  };
+}
+#endif
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file WorldCache.hh
+/// \brief Data derived from a world, kept between runs.
+
+#ifndef __SWARM_WORLD_CACHE_HH__
+#define __SWARM_WORLD_CACHE_HH__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ignition/math/Box.hh>
+
+#include "swarm/Helpers.hh"
+#include "swarm/TerrainRaster.hh"
+
+namespace swarm
+{
+  /// \brief Header stored at the beginning of a world cache file.
+  struct WorldCacheHeader
+  {
+    /// \brief Always WorldCache::kMagic.
+    int32_t magic;
+
+    /// \brief Version of the layout.
+    int32_t version;
+
+    /// \brief WorldCache::HashWorld() of the world.
+    uint64_t hash;
+
+    /// \brief Number of bounding boxes of trees.
+    uint64_t trees;
+
+    /// \brief Number of bounding boxes of buildings.
+    uint64_t buildings;
+
+    /// \brief Minimum X and Y of the area of the raster.
+    double rasterMin[2];
+
+    /// \brief Side of the cells of the raster (m).
+    double cellSize;
+
+    /// \brief Number of cells of the raster along X.
+    uint32_t columns;
+
+    /// \brief Number of cells of the raster along Y.
+    uint32_t rows;
+  };
+
+  /// \brief The data that every start of a world derives from its models,
+  /// saved to a file after the first start and mapped by the next ones:
+  /// the bounding boxes of the trees and the buildings, which take a walk
+  /// over the collisions of every model, and the TerrainRaster, which takes
+  /// a ray cast per cell.
+  ///
+  /// The WorldCacheHeader is followed by the boxes of the trees and of the
+  /// buildings, as their minimum and maximum corners, and by the cells of
+  /// the raster, row after row. The file is identified by HashWorld(), so
+  /// a file written for another world, or before the world or its terrain
+  /// changed, is detected and replaced.
+  class IGNITION_VISIBLE WorldCache
+  {
+    /// \brief Constructor.
+    public: WorldCache() = default;
+
+    /// \brief The cache owns the mapping of the file, so it's not copied.
+    public: WorldCache(const WorldCache &) = delete;
+
+    /// \brief The cache owns the mapping of the file, so it's not copied.
+    public: WorldCache &operator=(const WorldCache &) = delete;
+
+    /// \brief Destructor. Unmaps the file.
+    public: ~WorldCache();
+
+    /// \brief Hash a world, with FNV-1a.
+    /// \param[in] _world Description of the world, e.g. its SDF.
+    /// \param[in] _terrainHash Heightmap::Hash() of the terrain, or 0.
+    /// \return The hash.
+    public: static uint64_t HashWorld(const std::string &_world,
+                                      const uint64_t _terrainHash);
+
+    /// \brief Write the data of a world to a file. The data is written to
+    /// a temporary file, that is renamed once it's complete.
+    /// \param[in] _filename Path of the cache.
+    /// \param[in] _hash HashWorld() of the world.
+    /// \param[in] _trees Bounding boxes of the trees.
+    /// \param[in] _buildings Bounding boxes of the buildings.
+    /// \param[in] _raster Terrain raster of the world.
+    /// \return True if the file was written.
+    public: static bool Write(const std::string &_filename,
+                              const uint64_t _hash,
+                              const std::vector<ignition::math::Box> &_trees,
+                              const std::vector<ignition::math::Box>
+                                &_buildings,
+                              const TerrainRaster &_raster);
+
+    /// \brief Map and validate a cache file.
+    /// \param[in] _filename Path of the cache.
+    /// \return True if the data can be read.
+    public: bool Load(const std::string &_filename);
+
+    /// \brief Hash of the world that the cache was written for.
+    /// \return The hash, or 0 if nothing is loaded.
+    public: uint64_t Hash() const;
+
+    /// \brief Get the bounding boxes of the trees.
+    /// \return The boxes.
+    public: std::vector<ignition::math::Box> TreeBoxes() const;
+
+    /// \brief Get the bounding boxes of the buildings.
+    /// \return The boxes.
+    public: std::vector<ignition::math::Box> BuildingBoxes() const;
+
+    /// \brief Copy the terrain raster.
+    /// \param[out] _raster The raster.
+    public: void Raster(TerrainRaster &_raster) const;
+
+    /// \brief Identifies a world cache file ("SWWC").
+    public: static const int32_t kMagic = 0x53575743;
+
+    /// \brief Version of the layout.
+    public: static const int32_t kVersion = 1;
+
+    /// \brief Copy boxes out of the file.
+    /// \param[in] _first Index of the first box, counting the trees and
+    /// then the buildings.
+    /// \param[in] _count Number of boxes.
+    /// \return The boxes.
+    private: std::vector<ignition::math::Box> Boxes(const uint64_t _first,
+                                                    const uint64_t _count)
+                                                    const;
+
+    /// \brief Unmap the file.
+    private: void Unload();
+
+    /// \brief Header of the loaded file.
+    private: WorldCacheHeader header = WorldCacheHeader();
+
+    /// \brief The mapping of the file, null if nothing is loaded.
+    private: const char *data = nullptr;
+
+    /// \brief Size of the mapping.
+    private: size_t dataSize = 0;
+  };
+}
+#endif
@@ -97,6 +97,7 @@ bool IgnGenerator::Generate(const FileDescriptor *_file,
 
     printer.Print("#include <memory>\n", "name", "includes");
     printer.Print("#include <swarm/Helpers.hh>\n", "name", "includes");
+    printer.Print("#include <swarm/MessagePool.hh>\n", "name", "includes");
   }
 
   // Add std::shared_ptr typedef
@@ -116,6 +117,53 @@ bool IgnGenerator::Generate(const FileDescriptor *_file,
     printer.Print(ptrType.c_str(), "name", "namespace_scope");
   }
 
+  // Add a pool and factories for every message. Messages that are
+  // created at high rates are taken from the pool instead of the heap, or
+  // from an arena with protobuf 3.
+  {
+    std::unique_ptr<io::ZeroCopyOutputStream> output(
+        _generatorContext->OpenForInsert(headerFilename,
+          "namespace_scope"));
+    io::Printer printer(output.get(), '$');
+
+    for (int i = 0; i < _file->message_type_count(); ++i)
+    {
+      const std::string name = _file->message_type(i)->name();
+      printer.Print(
+          "/// \\brief Pool of reusable $name$ messages.\n"
+          "typedef ::swarm::MessagePool<$name$> $name$Pool;\n"
+          "\n"
+          "/// \\brief Get a cleared $name$ from its pool. It goes back to\n"
+          "/// the pool when the last pointer to it is released.\n"
+          "/// \\return The message.\n"
+          "inline std::shared_ptr<$name$> New$name$()\n"
+          "{\n"
+          "  return $name$Pool::Instance().Make();\n"
+          "}\n"
+          "\n"
+          "/// \\brief Get a copy of a $name$ from its pool.\n"
+          "/// \\param[in] _msg The message to copy.\n"
+          "/// \\return The copy.\n"
+          "inline std::shared_ptr<$name$> New$name$(const $name$ &_msg)\n"
+          "{\n"
+          "  return $name$Pool::Instance().Make(_msg);\n"
+          "}\n"
+          "\n"
+          "#if GOOGLE_PROTOBUF_VERSION >= 3000000\n"
+          "/// \\brief Create a $name$ owned by an arena, e.g. one per\n"
+          "/// step. It's destroyed with the arena.\n"
+          "/// \\param[in] _arena The arena.\n"
+          "/// \\return The message.\n"
+          "inline $name$ *New$name$(::google::protobuf::Arena *_arena)\n"
+          "{\n"
+          "  return ::google::protobuf::Arena::Create<$name$>(_arena);\n"
+          "}\n"
+          "#endif\n"
+          "\n",
+          "name", name);
+    }
+  }
+
   // Add const std::shared_ptr typedef
   {
     std::unique_ptr<io::ZeroCopyOutputStream> output(
@@ -16,9 +16,12 @@
 */
 
 #include <boost/algorithm/string.hpp>
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
 #include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 #include <gazebo/common/Assert.hh>
 #include <gazebo/common/Console.hh>
@@ -28,7 +31,9 @@
 #include <gazebo/physics/PhysicsTypes.hh>
 #include <gazebo/physics/World.hh>
 #include <sdf/sdf.hh>
+#include "msgs/checkpoint.pb.h"
 #include "swarm/BooPlugin.hh"
+#include "swarm/FoundReport.hh"
 #include "swarm/SwarmTypes.hh"
 
 using namespace swarm;
@@ -51,6 +56,7 @@ BooPlugin::~BooPlugin()
 void BooPlugin::Load(gazebo::physics::ModelPtr _model, sdf::ElementPtr _sdf)
 {
   RobotPlugin::Load(_model, _sdf);
+  this->logger = Logger::Instance(_model->GetWorld()->GetName());
 
   // Sanity check.
   if (this->Host() != this->kBoo)
@@ -60,8 +66,9 @@ void BooPlugin::Load(gazebo::physics::ModelPtr _model, sdf::ElementPtr _sdf)
     gazebo::shutdown();
   }
 
-  // Read the <lost_person_model> SDF parameter.
-  if (!_sdf->HasElement("lost_person_model"))
+  // Read the <lost_person_model> or <lost_person_prefix> SDF parameter.
+  if (!_sdf->HasElement("lost_person_model") &&
+      !_sdf->HasElement("lost_person_prefix"))
   {
     gzerr << "BooPlugin::Load() error: Unable to find the <lost_person_model> "
           << "parameter" << std::endl;
@@ -79,15 +86,31 @@ void BooPlugin::Load(gazebo::physics::ModelPtr _model, sdf::ElementPtr _sdf)
   if (_sdf->HasElement("cell_size"))
     this->cellSize = _sdf->Get<double>("cell_size");
 
-  auto modelName = _sdf->Get<std::string>("lost_person_model");
-  this->lostPerson = this->model->GetWorld()->GetModel(modelName);
-  GZ_ASSERT(this->lostPerson, "Victim's model not found");
+  // swarm_batch resets the world between runs instead of exiting.
+  const char *batchEnv = std::getenv("SWARM_BATCH");
+  this->batch = batchEnv && std::string(batchEnv) == "1";
 
-  // Initialize the position of the lost person.
-  auto personPos = this->lostPerson->GetWorldPose().Ign().Pos();
-  auto personPosInGrid = this->PosToGrid(personPos);
-  this->lostPersonBuffer[gazebo::common::Time::Zero] = personPosInGrid;
-  this->lastPersonPosInGrid = personPosInGrid;
+  if (_sdf->HasElement("lost_person_prefix"))
+  {
+    // A crowd: the models have to be loaded before the BOO.
+    auto prefix = _sdf->Get<std::string>("lost_person_prefix");
+    for (auto const &m : this->model->GetWorld()->GetModels())
+    {
+      if (m->GetName().compare(0, prefix.size(), prefix) == 0)
+        this->lostPersons.push_back(m);
+    }
+  }
+  else
+  {
+    auto modelName = _sdf->Get<std::string>("lost_person_model");
+    auto lostPerson = this->model->GetWorld()->GetModel(modelName);
+    if (lostPerson)
+      this->lostPersons.push_back(lostPerson);
+  }
+  GZ_ASSERT(!this->lostPersons.empty(), "Victim's model not found");
+
+  // Initialize the position of the lost people.
+  this->InitLostPersons();
 
   // Bind on my BOO address and default BOO port.
   this->Bind(&BooPlugin::OnDataReceived, this, this->kBoo, this->kBooPort);
@@ -102,46 +125,43 @@ void BooPlugin::OnUpdateEnd()
 {
   std::lock_guard<std::mutex> lock(this->mutex);
 
-  // Translate the person's position to a grid cell.
-  auto personPos = this->lostPerson->GetWorldPose().Ign().Pos();
-  auto personPosInGrid = this->PosToGrid(personPos);
   auto now = gazebo::physics::get_world()->GetSimTime();
+  auto boundaryTime = now - this->maxDt;
 
-  // Check the buffer of stored lost person's poses.
-  while (!this->lostPersonBuffer.empty())
+  for (size_t i = 0; i < this->lostPersons.size(); ++i)
   {
-    auto oldestEntry = this->lostPersonBuffer.lower_bound(
-      gazebo::common::Time::Zero);
-    auto oldestTime(oldestEntry->first);
+    // Translate the person's position to a grid cell.
+    auto personPos = this->lostPersons[i]->GetWorldPose().Ign().Pos();
+    auto personPosInGrid = this->PosToGrid(personPos);
+    auto &buffer = this->lostPersonBuffers[i];
 
-    auto boundaryTime = now - this->maxDt;
-    if (boundaryTime <= oldestTime)
-      break;
+    // Drop the oldest positions while the next one is already older than
+    // maxDt: no valid report can match them.
+    while (buffer.size() > 1 && buffer[1].first <= boundaryTime)
+      buffer.pop_front();
 
-    auto nextEntry = this->lostPersonBuffer.upper_bound(oldestTime);
-    if ((nextEntry == this->lostPersonBuffer.end()) ||
-        (nextEntry->first > boundaryTime))
-      break;
-
-    // Remove old entry.
-    this->lostPersonBuffer.erase(oldestEntry);
-  }
+    GZ_ASSERT(!buffer.empty(), "Buffer of lost person's positions is empty");
 
-  GZ_ASSERT(!this->lostPersonBuffer.empty(),
-            "Buffer of lost person's positions is empty");
-
-  // The lost person has changed the cell.
-  if (personPosInGrid != this->lastPersonPosInGrid)
-  {
-    this->lostPersonBuffer[now] = personPosInGrid;
-    this->lastPersonPosInGrid = personPosInGrid;
+    // The lost person has changed the cell.
+    if (personPosInGrid != this->lastPersonPosInGrid[i])
+    {
+      buffer.push_back(std::make_pair(now, personPosInGrid));
+      this->lastPersonPosInGrid[i] = personPosInGrid;
+    }
   }
 
   if (this->gazeboExit)
   {
     if (this->shutdownTimer.GetElapsed() >= shutdownPeriod)
     {
-      gazebo::shutdown();
+      if (this->batch)
+      {
+        this->gazeboExit = false;
+        this->shutdownTimer.Stop();
+        this->model->GetWorld()->Stop();
+      }
+      else
+        gazebo::shutdown();
     }
   }
 }
@@ -180,10 +200,37 @@ void BooPlugin::OnDataReceived(const std::string &_srcAddress,
   // List of supported commands:
   // <FOUND> <x> <y> <z> <t> : Person found in [x,y,z] at time t.
   //
+  // The same report can be sent in the binary format of FoundReport.hh,
+  // e.g. with RobotPlugin::SendFound().
+  //
   // The BOO sends an ACK message with the result to the sender of the request.
   // The destination port of is the default Swarm port.
   // See also SendAck().
 
+  // Binary reports are decoded without tokenizing.
+  if (IsFoundReport(_data))
+  {
+    double x, y, z, time;
+    if (!DecodeFoundReport(_data, x, y, z, time))
+    {
+      gzerr << "BooPlugin::OnDataReceived() Unable to parse a binary FOUND "
+            << "message of " << _data.size() << " bytes" << std::endl;
+      this->SendAck(_srcAddress, 3);
+      return;
+    }
+    this->FoundHelper(ignition::math::Vector3d(x, y, z),
+        gazebo::common::Time(time), _srcAddress);
+    return;
+  }
+
+  // The other messages are passed as is.
+  const size_t start = _data.find_first_not_of("\t ");
+  if (start == std::string::npos || _data.compare(start, 5, "FOUND") != 0)
+  {
+    this->OnData(_srcAddress, _dstAddress, _dstPort, _data);
+    return;
+  }
+
   // Split the string into a vector of parameters.
   std::vector<std::string> v;
   std::string data = _data;
@@ -287,24 +334,39 @@ bool BooPlugin::FoundHelper(const ignition::math::Vector3d &_pos,
   msg.mutable_pos_seen()->set_y(_pos.Y());
   msg.mutable_pos_seen()->set_z(_pos.Z());
 
-  // Validate the result.
+  // Validate the result against every lost person.
   auto reportedPosInGrid = this->PosToGrid(_pos);
-  ignition::math::Vector3i realPosInGrid;
+  size_t person = this->lostPersons.size();
 
   {
     std::lock_guard<std::mutex> lock(this->mutex);
-    auto nextRealEntry = this->lostPersonBuffer.upper_bound(_time);
-    GZ_ASSERT(nextRealEntry != this->lostPersonBuffer.begin(),
-        "Unexpected iterator");
-    --nextRealEntry;
-    realPosInGrid = nextRealEntry->second;
+    for (size_t i = 0; i < this->lostPersonBuffers.size(); ++i)
+    {
+      auto const &buffer = this->lostPersonBuffers[i];
+      auto nextRealEntry = std::upper_bound(buffer.begin(), buffer.end(),
+          _time,
+          [](const gazebo::common::Time &_t,
+             const std::pair<gazebo::common::Time,
+                             ignition::math::Vector3i> &_e)
+          {
+            return _t < _e.first;
+          });
+      GZ_ASSERT(nextRealEntry != buffer.begin(), "Unexpected iterator");
+      --nextRealEntry;
+      if (nextRealEntry->second == reportedPosInGrid)
+      {
+        person = i;
+        break;
+      }
+    }
   }
 
-  if (reportedPosInGrid == realPosInGrid)
+  if (person < this->lostPersons.size())
   {
     this->found = true;
     gzdbg << "Congratulations! Robot [" << _srcAddress << "] has found "
-          << "the lost person at time [" << _time << "]" << std::endl;
+          << "the lost person [" << this->lostPersons[person]->GetName()
+          << "] at time [" << _time << "]" << std::endl;
 
     if (!_srcAddress.empty())
       this->SendAck(_srcAddress, 0);
@@ -329,13 +391,30 @@ bool BooPlugin::FoundHelper(const ignition::math::Vector3d &_pos,
 /////////////////////////////////////////////////
 void BooPlugin::Reset()
 {
-  this->lostPersonBuffer.clear();
+  this->lastReports.clear();
+  this->found = false;
+  this->gazeboExit = false;
+  this->shutdownTimer.Stop();
+  this->shutdownTimer.Reset();
 
-  // Initialize the position of the lost person.
-  auto personPos = this->lostPerson->GetWorldPose().Ign().Pos();
-  auto personPosInGrid = this->PosToGrid(personPos);
-  this->lostPersonBuffer[gazebo::common::Time::Zero] = personPosInGrid;
-  this->lastPersonPosInGrid = personPosInGrid;
+  // Initialize the position of the lost people.
+  this->InitLostPersons();
+}
+
+/////////////////////////////////////////////////
+void BooPlugin::InitLostPersons()
+{
+  this->lostPersonBuffers.clear();
+  this->lostPersonBuffers.resize(this->lostPersons.size());
+  this->lastPersonPosInGrid.resize(this->lostPersons.size());
+  for (size_t i = 0; i < this->lostPersons.size(); ++i)
+  {
+    auto personPos = this->lostPersons[i]->GetWorldPose().Ign().Pos();
+    auto personPosInGrid = this->PosToGrid(personPos);
+    this->lostPersonBuffers[i].push_back(
+        std::make_pair(gazebo::common::Time::Zero, personPosInGrid));
+    this->lastPersonPosInGrid[i] = personPosInGrid;
+  }
 }
 
 /////////////////////////////////////////////////
@@ -371,6 +450,12 @@ void BooPlugin::OnLogMin(msgs::LogEntryMin &_logEntry) const
   }
 }
 
+//////////////////////////////////////////////////
+bool BooPlugin::LogChanged() const
+{
+  return !this->lastReports.empty();
+}
+
 //////////////////////////////////////////////////
 void BooPlugin::OnLog(msgs::LogEntry &_logEntry) const
 {
@@ -384,3 +469,79 @@ void BooPlugin::OnLog(msgs::LogEntry &_logEntry) const
     this->lastReports.clear();
   }
 }
+
+//////////////////////////////////////////////////
+void BooPlugin::OnSaveController(msgs::CheckpointPart &_part) const
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+
+  msgs::BooState *state = _part.mutable_boo();
+  state->set_found(this->found);
+  for (auto const &buffer : this->lostPersonBuffers)
+  {
+    msgs::PersonBuffer *personBuffer = state->add_buffer();
+    for (auto const &position : buffer)
+    {
+      msgs::PersonCell *cell = personBuffer->add_cell();
+      cell->set_time(position.first.Double());
+      cell->set_x(position.second.X());
+      cell->set_y(position.second.Y());
+      cell->set_z(position.second.Z());
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+bool BooPlugin::OnRestoreController(const msgs::CheckpointPart &_part)
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+
+  if (!_part.has_boo() ||
+      _part.boo().buffer_size() !=
+        static_cast<int>(this->lostPersons.size()))
+  {
+    gzerr << "BooPlugin::OnRestoreController() The checkpoint doesn't match "
+          << "the lost persons of the world" << std::endl;
+    return false;
+  }
+
+  this->found = _part.boo().found();
+  for (size_t i = 0; i < this->lostPersons.size(); ++i)
+  {
+    auto const &cells = _part.boo().buffer(i).cell();
+    if (cells.size() == 0)
+      return false;
+
+    auto &buffer = this->lostPersonBuffers[i];
+    buffer.clear();
+    for (auto const &cell : cells)
+    {
+      buffer.push_back(std::make_pair(gazebo::common::Time(cell.time()),
+            ignition::math::Vector3i(cell.x(), cell.y(), cell.z())));
+    }
+
+    // The last cell of the buffer is always the current one.
+    this->lastPersonPosInGrid[i] = buffer.back().second;
+  }
+
+  return true;
+}
+
+//////////////////////////////////////////////////
+void BooPlugin::OnMemoryController(MemoryReport &_report) const
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+
+  uint64_t bytes = HeapBytes(this->lostPersonBuffers) +
+    HeapBytes(this->lastPersonPosInGrid) + HeapBytes(this->lastReports);
+  uint64_t elements = this->lastReports.size();
+  for (auto const &buffer : this->lostPersonBuffers)
+  {
+    bytes += HeapBytes(buffer);
+    elements += buffer.size();
+  }
+  for (auto const &report : this->lastReports)
+    bytes += HeapBytes(report);
+
+  _report.Add("boo", bytes, elements);
+}
@@ -0,0 +1,327 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <tuple>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "swarm/BoxHierarchy.hh"
+
+using namespace swarm;
+
+// Margin (m) added to the bounds of the nodes, so that rounding in the
+// traversal never culls a box that IntersectDist() would hit.
+static const double kBoundsMargin = 1e-6;
+
+// Margin (m) added to the single precision bounds of the boxes, larger than
+// the rounding errors of the filter for worlds of tens of kilometers.
+static const float kFilterMargin = 0.05f;
+
+//////////////////////////////////////////////////
+/// \brief Coordinate of a vector along an axis.
+/// \param[in] _v The vector.
+/// \param[in] _axis 0 for X, 1 for Y and 2 for Z.
+/// \return The coordinate.
+static double axisValue(const ignition::math::Vector3d &_v, const int _axis)
+{
+  return _axis == 0 ? _v.X() : (_axis == 1 ? _v.Y() : _v.Z());
+}
+
+//////////////////////////////////////////////////
+void BoxHierarchy::Build(const std::vector<ignition::math::Box> &_boxes)
+{
+  this->boxes = _boxes;
+  this->nodes.clear();
+
+  if (!this->boxes.empty())
+  {
+    this->nodes.reserve(2 * this->boxes.size() / kLeafSize + 1);
+    this->BuildNode(0, this->boxes.size());
+  }
+
+  // Single precision copy of the sorted boxes, rounded outwards.
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    this->lowerBounds[axis].assign(this->boxes.size() + kLeafSize - 1, 0.0f);
+    this->upperBounds[axis].assign(this->boxes.size() + kLeafSize - 1, 0.0f);
+    for (size_t i = 0; i < this->boxes.size(); ++i)
+    {
+      const double boxMin = axisValue(this->boxes[i].Min(), axis);
+      const double boxMax = axisValue(this->boxes[i].Max(), axis);
+      this->lowerBounds[axis][i] = static_cast<float>(boxMin) - kFilterMargin;
+      this->upperBounds[axis][i] = static_cast<float>(boxMax) + kFilterMargin;
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+unsigned int BoxHierarchy::BuildNode(const unsigned int _first,
+    const unsigned int _count)
+{
+  const unsigned int index = this->nodes.size();
+  this->nodes.push_back(Node());
+
+  // Bounds of the boxes and of their centers.
+  double min[3], max[3], centerMin[3], centerMax[3];
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    min[axis] = centerMin[axis] = std::numeric_limits<double>::max();
+    max[axis] = centerMax[axis] = -std::numeric_limits<double>::max();
+  }
+
+  for (unsigned int i = _first; i < _first + _count; ++i)
+  {
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      const double boxMin = axisValue(this->boxes[i].Min(), axis);
+      const double boxMax = axisValue(this->boxes[i].Max(), axis);
+      const double center = (boxMin + boxMax) * 0.5;
+      min[axis] = std::min(min[axis], boxMin);
+      max[axis] = std::max(max[axis], boxMax);
+      centerMin[axis] = std::min(centerMin[axis], center);
+      centerMax[axis] = std::max(centerMax[axis], center);
+    }
+  }
+
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    this->nodes[index].min[axis] = min[axis] - kBoundsMargin;
+    this->nodes[index].max[axis] = max[axis] + kBoundsMargin;
+  }
+
+  if (_count <= kLeafSize)
+  {
+    this->nodes[index].first = _first;
+    this->nodes[index].count = _count;
+    this->nodes[index].right = 0;
+    return index;
+  }
+
+  // Split at the median of the centers along the longest axis.
+  int splitAxis = 0;
+  for (int axis = 1; axis < 3; ++axis)
+  {
+    if (centerMax[axis] - centerMin[axis] >
+        centerMax[splitAxis] - centerMin[splitAxis])
+    {
+      splitAxis = axis;
+    }
+  }
+
+  const unsigned int half = _count / 2;
+  auto begin = this->boxes.begin() + _first;
+  std::nth_element(begin, begin + half, begin + _count,
+      [splitAxis](const ignition::math::Box &_a,
+                  const ignition::math::Box &_b)
+      {
+        return axisValue(_a.Min(), splitAxis) + axisValue(_a.Max(), splitAxis) <
+               axisValue(_b.Min(), splitAxis) + axisValue(_b.Max(), splitAxis);
+      });
+
+  this->nodes[index].first = _first;
+  this->nodes[index].count = 0;
+  this->BuildNode(_first, half);
+  const unsigned int right = this->BuildNode(_first + half, _count - half);
+  this->nodes[index].right = right;
+
+  return index;
+}
+
+//////////////////////////////////////////////////
+size_t BoxHierarchy::Size() const
+{
+  return this->boxes.size();
+}
+
+//////////////////////////////////////////////////
+size_t BoxHierarchy::MemoryBytes() const
+{
+  size_t bytes = this->nodes.capacity() * sizeof(Node) +
+    this->boxes.capacity() * sizeof(ignition::math::Box);
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    bytes += (this->lowerBounds[axis].capacity() +
+        this->upperBounds[axis].capacity()) * sizeof(float);
+  }
+  return bytes;
+}
+
+//////////////////////////////////////////////////
+unsigned int BoxHierarchy::Intersect(const ignition::math::Vector3d &_origin,
+    const ignition::math::Vector3d &_dir, const double _min, const double _max,
+    const unsigned int _maxHits, double &_dist) const
+{
+  unsigned int hits = 0;
+  if (this->nodes.empty() || _maxHits == 0)
+    return hits;
+
+  const double origin[3] = {_origin.X(), _origin.Y(), _origin.Z()};
+  const double dir[3] = {_dir.X(), _dir.Y(), _dir.Z()};
+  double invDir[3];
+  float originF[3];
+  float invDirF[3];
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    invDir[axis] = std::abs(dir[axis]) > 0 ? 1.0 / dir[axis] : 0.0;
+    originF[axis] = static_cast<float>(origin[axis]);
+
+    // The ray barely moves along components too small to be inverted in
+    // single precision, the filter handles them as parallel.
+    invDirF[axis] = std::abs(invDir[axis]) < std::numeric_limits<float>::max() ?
+      static_cast<float>(invDir[axis]) : 0.0f;
+  }
+
+  // The depth of the tree is logarithmic in the number of boxes.
+  unsigned int stack[64];
+  unsigned int stackSize = 0;
+  stack[stackSize++] = 0;
+
+  while (stackSize > 0)
+  {
+    const Node &node = this->nodes[stack[--stackSize]];
+
+    // Slab test against the bounds of the node.
+    double tMin = _min;
+    double tMax = _max;
+    bool crossed = true;
+    for (int axis = 0; axis < 3 && crossed; ++axis)
+    {
+      if (std::abs(dir[axis]) > 0)
+      {
+        double t0 = (node.min[axis] - origin[axis]) * invDir[axis];
+        double t1 = (node.max[axis] - origin[axis]) * invDir[axis];
+        if (t0 > t1)
+          std::swap(t0, t1);
+        tMin = std::max(tMin, t0);
+        tMax = std::min(tMax, t1);
+        crossed = tMin <= tMax;
+      }
+      else
+      {
+        crossed = origin[axis] >= node.min[axis] &&
+                  origin[axis] <= node.max[axis];
+      }
+    }
+
+    if (!crossed)
+      continue;
+
+    if (node.count == 0)
+    {
+      stack[stackSize++] = node.right;
+      stack[stackSize++] = &node - &this->nodes[0] + 1;
+      continue;
+    }
+
+    unsigned int mask = this->LeafMask(node.first, node.count, originF,
+        invDirF, static_cast<float>(_min) - kFilterMargin,
+        static_cast<float>(_max) + kFilterMargin);
+    for (unsigned int i = node.first; mask != 0; ++i, mask >>= 1)
+    {
+      if ((mask & 1u) == 0)
+        continue;
+
+      bool intersects;
+      double dist;
+      std::tie(intersects, dist) =
+        this->boxes[i].IntersectDist(_origin, _dir, _min, _max);
+      if (intersects)
+      {
+        _dist = dist;
+        if (++hits >= _maxHits)
+          return hits;
+      }
+    }
+  }
+
+  return hits;
+}
+
+//////////////////////////////////////////////////
+unsigned int BoxHierarchy::LeafMask(const unsigned int _first,
+    const unsigned int _count, const float _origin[3], const float _invDir[3],
+    const float _tMin, const float _tMax) const
+{
+  const unsigned int countMask = (1u << _count) - 1;
+
+#ifdef __AVX2__
+  // One box per lane.
+  __m256 tMin = _mm256_set1_ps(_tMin);
+  __m256 tMax = _mm256_set1_ps(_tMax);
+  __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    const __m256 boxMin = _mm256_loadu_ps(&this->lowerBounds[axis][_first]);
+    const __m256 boxMax = _mm256_loadu_ps(&this->upperBounds[axis][_first]);
+    const __m256 origin = _mm256_set1_ps(_origin[axis]);
+    if (std::abs(_invDir[axis]) > 0)
+    {
+      const __m256 invDir = _mm256_set1_ps(_invDir[axis]);
+      const __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(boxMin, origin), invDir);
+      const __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(boxMax, origin), invDir);
+      tMin = _mm256_max_ps(tMin, _mm256_min_ps(t0, t1));
+      tMax = _mm256_min_ps(tMax, _mm256_max_ps(t0, t1));
+    }
+    else
+    {
+      // The ray is parallel to the slab.
+      inside = _mm256_and_ps(inside, _mm256_and_ps(
+            _mm256_cmp_ps(origin, boxMin, _CMP_GE_OQ),
+            _mm256_cmp_ps(origin, boxMax, _CMP_LE_OQ)));
+    }
+  }
+  inside = _mm256_and_ps(inside, _mm256_cmp_ps(tMin, tMax, _CMP_LE_OQ));
+
+  return static_cast<unsigned int>(_mm256_movemask_ps(inside)) & countMask;
+#else
+  unsigned int mask = 0;
+  for (unsigned int k = 0; k < _count; ++k)
+  {
+    const unsigned int i = _first + k;
+    float tMin = _tMin;
+    float tMax = _tMax;
+    bool inside = true;
+    for (int axis = 0; axis < 3 && inside; ++axis)
+    {
+      const float boxMin = this->lowerBounds[axis][i];
+      const float boxMax = this->upperBounds[axis][i];
+      if (std::abs(_invDir[axis]) > 0)
+      {
+        const float t0 = (boxMin - _origin[axis]) * _invDir[axis];
+        const float t1 = (boxMax - _origin[axis]) * _invDir[axis];
+        tMin = std::max(tMin, std::min(t0, t1));
+        tMax = std::min(tMax, std::max(t0, t1));
+        inside = tMin <= tMax;
+      }
+      else
+      {
+        // The ray is parallel to the slab.
+        inside = _origin[axis] >= boxMin && _origin[axis] <= boxMax;
+      }
+    }
+
+    if (inside)
+      mask |= 1u << k;
+  }
+
+  return mask & countMask;
+#endif
+}
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <tuple>
+#include <vector>
+#include "gtest/gtest.h"
+#include "swarm/BoxHierarchy.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Create a 20x20 grid of 2x2x10m boxes, 10m apart.
+/// \return The boxes.
+std::vector<ignition::math::Box> MakeForest()
+{
+  std::vector<ignition::math::Box> boxes;
+  for (int x = 0; x < 20; ++x)
+  {
+    for (int y = 0; y < 20; ++y)
+    {
+      boxes.push_back(ignition::math::Box(
+            ignition::math::Vector3d(x * 10 - 1, y * 10 - 1, 0),
+            ignition::math::Vector3d(x * 10 + 1, y * 10 + 1, 10)));
+    }
+  }
+  return boxes;
+}
+
+//////////////////////////////////////////////////
+/// \brief Count the boxes hit by a ray with a linear scan.
+/// \param[in] _boxes The boxes.
+/// \param[in] _origin Origin of the ray.
+/// \param[in] _dir Direction of the ray.
+/// \return Number of boxes hit.
+unsigned int CountHits(const std::vector<ignition::math::Box> &_boxes,
+    const ignition::math::Vector3d &_origin,
+    const ignition::math::Vector3d &_dir)
+{
+  unsigned int hits = 0;
+  for (auto const &box : _boxes)
+  {
+    bool intersects;
+    double dist;
+    std::tie(intersects, dist) = box.IntersectDist(_origin, _dir, 0, 250);
+    if (intersects)
+      ++hits;
+  }
+  return hits;
+}
+
+//////////////////////////////////////////////////
+/// \brief Check that the hierarchy finds the same boxes as a linear scan.
+TEST(BoxHierarchyTest, Intersect)
+{
+  const std::vector<ignition::math::Box> boxes = MakeForest();
+  BoxHierarchy hierarchy;
+  hierarchy.Build(boxes);
+  EXPECT_EQ(hierarchy.Size(), boxes.size());
+
+  const ignition::math::Vector3d origins[] =
+  {
+    ignition::math::Vector3d(-5, -5, 1),
+    ignition::math::Vector3d(5, 0, 5),
+    ignition::math::Vector3d(95, 95, 20),
+    ignition::math::Vector3d(33, 71, 2)
+  };
+  const ignition::math::Vector3d dirs[] =
+  {
+    ignition::math::Vector3d(1, 0, 0),
+    ignition::math::Vector3d(0, 1, 0),
+    ignition::math::Vector3d(1, 1, 0).Normalize(),
+    ignition::math::Vector3d(3, -2, -0.1).Normalize(),
+    ignition::math::Vector3d(0, 0, -1)
+  };
+
+  for (auto const &origin : origins)
+  {
+    for (auto const &dir : dirs)
+    {
+      const unsigned int expected = CountHits(boxes, origin, dir);
+      double dist = -1;
+      EXPECT_EQ(hierarchy.Intersect(origin, dir, 0, 250, boxes.size(), dist),
+          expected);
+      if (expected == 0)
+      {
+        EXPECT_DOUBLE_EQ(dist, -1);
+      }
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+/// \brief Check the early termination and the reported distance.
+TEST(BoxHierarchyTest, MaxHits)
+{
+  BoxHierarchy hierarchy;
+  hierarchy.Build(MakeForest());
+
+  // Along the first row of boxes.
+  const ignition::math::Vector3d origin(-5, 0, 1);
+  const ignition::math::Vector3d dir(1, 0, 0);
+  double dist = -1;
+  EXPECT_EQ(hierarchy.Intersect(origin, dir, 0, 250, 100, dist), 20u);
+  EXPECT_EQ(hierarchy.Intersect(origin, dir, 0, 250, 2, dist), 2u);
+
+  // A single box in range.
+  EXPECT_EQ(hierarchy.Intersect(origin, dir, 0, 10, 2, dist), 1u);
+  EXPECT_DOUBLE_EQ(dist, 4);
+
+  // Nothing to hit.
+  BoxHierarchy empty;
+  empty.Build(std::vector<ignition::math::Box>());
+  EXPECT_EQ(empty.Size(), 0u);
+  EXPECT_EQ(empty.Intersect(origin, dir, 0, 250, 2, dist), 0u);
+}
+
+//////////////////////////////////////////////////
+/// \brief Check that the single precision filter keeps the boxes grazed by
+/// a ray, far away from the origin of the world.
+TEST(BoxHierarchyTest, Grazing)
+{
+  const ignition::math::Vector3d offset(12345.678, -9876.543, 0);
+  std::vector<ignition::math::Box> boxes = MakeForest();
+  for (auto &box : boxes)
+    box = ignition::math::Box(box.Min() + offset, box.Max() + offset);
+
+  BoxHierarchy hierarchy;
+  hierarchy.Build(boxes);
+
+  // Along the faces and the edges of the first row of boxes.
+  const ignition::math::Vector3d origins[] =
+  {
+    ignition::math::Vector3d(-5, 1, 5) + offset,
+    ignition::math::Vector3d(-5, -1, 5) + offset,
+    ignition::math::Vector3d(-5, 1, 10) + offset,
+    ignition::math::Vector3d(-5, -1, 0) + offset
+  };
+  for (auto const &origin : origins)
+  {
+    const ignition::math::Vector3d dir(1, 0, 0);
+    double dist = -1;
+    EXPECT_EQ(hierarchy.Intersect(origin, dir, 0, 250, boxes.size(), dist),
+        CountHits(boxes, origin, dir));
+  }
+
+  // Diagonal through the corners of the boxes.
+  const ignition::math::Vector3d origin =
+    ignition::math::Vector3d(-9, -9, 1) + offset;
+  const ignition::math::Vector3d dir =
+    ignition::math::Vector3d(1, 1, 0).Normalize();
+  double dist = -1;
+  EXPECT_EQ(hierarchy.Intersect(origin, dir, 0, 250, boxes.size(), dist),
+      CountHits(boxes, origin, dir));
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -18,22 +18,45 @@
 #include <iostream>
 #include <map>
 #include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
 #include "msgs/datagram.pb.h"
 #include "swarm/Broker.hh"
 
 using namespace swarm;
 
+const size_t Broker::kOutboxCapacity;
+
 //////////////////////////////////////////////////
 Broker *Broker::Instance()
 {
-  static Broker instance;
-  return &instance;
+  return Instance("");
+}
+
+//////////////////////////////////////////////////
+Broker *Broker::Instance(const std::string &_world)
+{
+  using BrokerPtr = std::unique_ptr<Broker, void(*)(Broker*)>;
+  static std::mutex mutex;
+  static std::map<std::string, BrokerPtr> instances;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = instances.find(_world);
+  if (it == instances.end())
+  {
+    BrokerPtr instance(new Broker(), [](Broker *_broker) {delete _broker;});
+    it = instances.emplace(_world, std::move(instance)).first;
+  }
+  return it->second.get();
 }
 
 //////////////////////////////////////////////////
 bool Broker::Bind(const std::string &_clientAddress,
-  const RobotPlugin *_client, const std::string &_endpoint)
+  const RobotPlugin *_client, const std::string &_endpoint,
+  const unsigned int _callback)
 {
   // Make sure that the same client didn't bind the same end point before.
   if (this->endpoints.find(_endpoint) != this->endpoints.end())
@@ -53,15 +76,91 @@ bool Broker::Bind(const std::string &_clientAddress,
   BrokerClientInfo clientInfo;
   clientInfo.address = _clientAddress;
   clientInfo.handler = _client;
+  clientInfo.callback = _callback;
   this->endpoints[_endpoint].push_back(clientInfo);
+  const EndPointId id = this->Intern(_endpoint);
+  this->endpointClients[id].push_back(clientInfo);
+  ++this->endpointVersions[id];
+  return true;
+}
+
+//////////////////////////////////////////////////
+EndPointId Broker::Intern(const std::string &_endpoint)
+{
+  auto inserted = this->endpointIds.emplace(_endpoint,
+      static_cast<EndPointId>(this->endpointClients.size()));
+  if (inserted.second)
+  {
+    this->endpointClients.push_back(std::vector<BrokerClientInfo>());
+    this->endpointVersions.push_back(0);
+  }
+
+  return inserted.first->second;
+}
+
+//////////////////////////////////////////////////
+EndPointId Broker::Intern(const std::string &_address, const uint32_t _port)
+{
+  return this->Intern(_address + ":" + std::to_string(_port));
+}
+
+//////////////////////////////////////////////////
+bool Broker::Find(const std::string &_address, const uint32_t _port,
+    EndPointId &_id) const
+{
+  auto it = this->endpointIds.find(_address + ":" + std::to_string(_port));
+  if (it == this->endpointIds.end())
+    return false;
+
+  _id = it->second;
   return true;
 }
 
+//////////////////////////////////////////////////
+const std::vector<BrokerClientInfo> &Broker::EndPointClients(
+    const EndPointId _id) const
+{
+  static const std::vector<BrokerClientInfo> kNoClients;
+  if (_id >= this->endpointClients.size())
+    return kNoClients;
+
+  return this->endpointClients[_id];
+}
+
+//////////////////////////////////////////////////
+uint64_t Broker::EndPointVersion(const EndPointId _id) const
+{
+  if (_id >= this->endpointVersions.size())
+    return 0;
+
+  return this->endpointVersions[_id];
+}
+
 //////////////////////////////////////////////////
 void Broker::Push(const msgs::Datagram &_msg)
+{
+  auto msg = msgs::NewDatagram(_msg);
+  EndPointId id;
+  if (!msg->has_dst_endpoint() &&
+      this->Find(msg->dst_address(), msg->dst_port(), id))
+  {
+    msg->set_dst_endpoint(id);
+  }
+
+  this->Push(std::move(msg));
+}
+
+//////////////////////////////////////////////////
+void Broker::Push(DatagramPtr _msg)
 {
   // Queue the new message.
-  this->incomingMsgs.push_back(_msg);
+  this->outbox.Push(std::move(_msg));
+}
+
+//////////////////////////////////////////////////
+void Broker::Push(std::vector<DatagramPtr> &_msgs)
+{
+  this->outbox.Push(_msgs.begin(), _msgs.end());
 }
 
 //////////////////////////////////////////////////
@@ -92,8 +191,9 @@ const std::map<std::string, std::vector<BrokerClientInfo>>
 }
 
 //////////////////////////////////////////////////
-std::deque<msgs::Datagram> &Broker::Messages()
+std::deque<DatagramPtr> &Broker::Messages()
 {
+  this->outbox.Drain(this->incomingMsgs);
   return this->incomingMsgs;
 }
 
@@ -108,26 +208,96 @@ bool Broker::Unregister(const std::string &_id)
   }
 
   // Unbind.
-  for (auto &endpointKv : this->endpoints)
+  auto unbind = [&_id](std::vector<BrokerClientInfo> &_clientsV)
   {
-    auto &clientsV = endpointKv.second;
-
-    auto i = std::begin(clientsV);
-    while (i != std::end(clientsV))
+    const size_t size = _clientsV.size();
+    auto i = std::begin(_clientsV);
+    while (i != std::end(_clientsV))
     {
       if (i->address == _id)
-        i = clientsV.erase(i);
+        i = _clientsV.erase(i);
       else
         ++i;
     }
+    return _clientsV.size() != size;
+  };
+
+  for (auto &endpointKv : this->endpoints)
+    unbind(endpointKv.second);
+  for (size_t i = 0; i < this->endpointClients.size(); ++i)
+  {
+    if (unbind(this->endpointClients[i]))
+      ++this->endpointVersions[i];
   }
 
   return true;
 }
 
+//////////////////////////////////////////////////
+void Broker::SetMembers(const std::vector<std::string> &_addresses)
+{
+  this->memberIds.clear();
+  for (size_t i = 0; i < _addresses.size(); ++i)
+    this->memberIds[_addresses[i]] = static_cast<int>(i);
+  ++this->membersVersion;
+  this->positions.clear();
+}
+
+//////////////////////////////////////////////////
+int Broker::MemberIndex(const std::string &_address) const
+{
+  auto it = this->memberIds.find(_address);
+  return it == this->memberIds.end() ? -1 : it->second;
+}
+
+//////////////////////////////////////////////////
+uint64_t Broker::MembersVersion() const
+{
+  return this->membersVersion;
+}
+
+//////////////////////////////////////////////////
+void Broker::SetPositions(
+    const std::vector<ignition::math::Vector3d> &_positions)
+{
+  this->positions = _positions;
+}
+
+//////////////////////////////////////////////////
+const std::vector<ignition::math::Vector3d> &Broker::Positions() const
+{
+  return this->positions;
+}
+
 //////////////////////////////////////////////////
 void Broker::Reset()
 {
+  this->outbox.Drain(this->incomingMsgs);
   this->incomingMsgs.clear();
   this->endpoints.clear();
+
+  // The handles are kept, the clients may still hold them. The versions
+  // keep growing, so nothing cached before the reset is reused.
+  for (auto &clientsV : this->endpointClients)
+    clientsV.clear();
+  for (uint64_t &version : this->endpointVersions)
+    ++version;
+}
+
+//////////////////////////////////////////////////
+void Broker::OnMemory(MemoryReport &_report) const
+{
+  // The slots of the outbox are allocated once.
+  uint64_t bytes = this->outbox.Capacity() * sizeof(DatagramPtr) +
+    SharedMessagesBytes(this->incomingMsgs) + HeapBytes(this->clients) +
+    HeapBytes(this->endpoints) + HeapBytes(this->endpointIds) +
+    HeapBytes(this->endpointClients) + HeapBytes(this->endpointVersions) +
+    HeapBytes(this->memberIds) + HeapBytes(this->positions);
+  for (auto const &endpoint : this->endpoints)
+    bytes += HeapBytes(endpoint.first) + HeapBytes(endpoint.second);
+  for (auto const &clientsV : this->endpointClients)
+    bytes += HeapBytes(clientsV);
+
+  _report.Add("broker", bytes,
+      this->incomingMsgs.size() + this->endpoints.size());
 }
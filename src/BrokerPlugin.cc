@@ -15,17 +15,27 @@
  *
 */
 
+#include <sys/wait.h>
+#include <unistd.h>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <deque>
+#include <limits>
 #include <memory>
-#include <random>
 #include <string>
+#include <utility>
+#include <vector>
 #include <gazebo/common/Assert.hh>
 #include <gazebo/common/Console.hh>
 #include <gazebo/common/Events.hh>
 #include <gazebo/common/Plugin.hh>
 #include <gazebo/common/UpdateInfo.hh>
 #include <gazebo/gazebo.hh>
+#include <gazebo/msgs/msgs.hh>
 #include <gazebo/physics/PhysicsEngine.hh>
 #include <gazebo/physics/PhysicsTypes.hh>
 #include <gazebo/physics/World.hh>
@@ -33,10 +43,17 @@
 #include <ignition/math/Rand.hh>
 #include <sdf/sdf.hh>
 
+#include "msgs/checkpoint.pb.h"
 #include "msgs/datagram.pb.h"
+#include "msgs/partition.pb.h"
 #include "swarm/RobotPlugin.hh"
 #include "swarm/CommsModel.hh"
 #include "swarm/BrokerPlugin.hh"
+#include "swarm/Checkpointer.hh"
+#include "swarm/PartitionLink.hh"
+#include "swarm/Permutation.hh"
+#include "swarm/PoseSnapshot.hh"
+#include "swarm/Telemetry.hh"
 
 using namespace swarm;
 
@@ -46,7 +63,24 @@ GZ_REGISTER_WORLD_PLUGIN(BrokerPlugin)
 BrokerPlugin::~BrokerPlugin()
 {
   gazebo::event::Events::DisconnectWorldUpdateBegin(this->updateConnection);
+  if (this->updateEndConnection)
+  {
+    gazebo::event::Events::DisconnectWorldUpdateEnd(
+        this->updateEndConnection);
+  }
   this->logger->Unregister("broker");
+  if (this->checkpointer)
+  {
+    this->checkpointer->Unregister("broker");
+    this->checkpointer->Unregister("logger");
+  }
+  if (this->memory)
+  {
+    if (this->memoryReport)
+      this->PrintMemory();
+    this->memory->Unregister("broker");
+    this->memory->Unregister("logger");
+  }
 }
 
 //////////////////////////////////////////////////
@@ -59,15 +93,29 @@ void BrokerPlugin::Load(gazebo::physics::WorldPtr _world, sdf::ElementPtr _sdf)
   this->world = _world;
   this->swarm = std::make_shared<SwarmMembership_M>();
 
-  this->rndEngine = std::default_random_engine(ignition::math::Rand::Seed());
+  // Each world has its own broker and logger.
+  this->broker = Broker::Instance(this->world->GetName());
+  this->logger = Logger::Instance(this->world->GetName());
+  this->poses = PoseSnapshot::Instance(this->world->GetName());
+  this->timers = StepTimers::Instance(this->world->GetName());
+
+  this->dispatchSeed = ignition::math::Rand::Seed();
 
   // Get the addresses of the swarm.
   this->ReadSwarmFromSDF(_sdf);
 
+  // Connect with the other partitions of the swarm, if it's split.
+  this->LoadPartition(_sdf);
+
+  // Publish snapshots for the dashboards.
+  this->LoadTelemetry(_sdf);
+
   this->commsModel.reset(new CommsModel(this->swarm, this->world, _sdf));
+  this->broker->SetMembers(this->commsModel->Addresses());
 
-  this->maxDataRatePerCycle = this->commsModel->MaxDataRate() *
-      this->world->GetPhysicsEngine()->GetMaxStepSize();
+  this->stepSize = this->world->GetPhysicsEngine()->GetMaxStepSize();
+  this->maxDataRatePerCycle =
+    this->commsModel->MaxDataRate() * this->stepSize;
 
   auto maxStepSize = this->world->GetPhysicsEngine()->GetMaxStepSize();
   this->logger->CreateLogFile(maxStepSize, _sdf);
@@ -75,9 +123,64 @@ void BrokerPlugin::Load(gazebo::physics::WorldPtr _world, sdf::ElementPtr _sdf)
   // Register in the logger.
   this->logger->Register("broker", this);
 
+  // Register in the checkpoints, with the logger of the world.
+  this->checkpointer = Checkpointer::Instance(this->world->GetName());
+  this->checkpointer->Register("broker", this);
+  this->checkpointer->Register("logger", this->logger);
+
+  const char *periodEnv = std::getenv("SWARM_CHECKPOINT_PERIOD");
+  if (periodEnv)
+  {
+    this->checkpointPeriod = std::max(0.0, std::atof(periodEnv));
+    this->nextCheckpointTime = this->checkpointPeriod;
+  }
+  const char *dirEnv = std::getenv("SWARM_CHECKPOINT_DIR");
+  if (dirEnv && std::string(dirEnv) != "")
+    this->checkpointDir = dirEnv;
+  const char *restoreEnv = std::getenv("SWARM_CHECKPOINT_RESTORE");
+  if (restoreEnv)
+    this->restorePath = restoreEnv;
+
+  // Register in the memory accounting, with the logger of the world.
+  this->memory = MemoryAccounting::Instance(this->world->GetName());
+  this->memory->Register("broker", this);
+  this->memory->Register("logger", this->logger);
+  this->memoryReport = MemoryAccounting::Enabled();
+  if (this->memoryReport)
+    MemoryAccounting::InstallSignalHandler();
+
+  // The controllers replayed from a log get their neighbors and messages
+  // from it.
+  const char *replayEnv = std::getenv("SWARM_REPLAY");
+  this->replay = replayEnv && std::string(replayEnv) != "";
+
+  // The replicas forked by swarm_batch.
+  const char *replicasEnv = std::getenv("SWARM_REPLICAS");
+  if (replicasEnv && std::atoi(replicasEnv) > 0)
+  {
+    this->replicas = std::atoi(replicasEnv);
+    const char *timeEnv = std::getenv("SWARM_REPLICA_TIME");
+    if (timeEnv)
+      this->replicaTime = std::max(0.0, std::atof(timeEnv));
+    const char *seedEnv = std::getenv("SWARM_REPLICA_SEED");
+    this->replicaSeed = seedEnv ? std::strtoul(seedEnv, nullptr, 10) :
+      ignition::math::Rand::Seed() + 1;
+    const char *logPathEnv = std::getenv("SWARM_REPLICA_LOG_PATH");
+    this->replicaLogPath = logPathEnv ? logPathEnv : "replicas";
+    const char *firstIdEnv = std::getenv("SWARM_REPLICA_FIRST_ID");
+    if (firstIdEnv)
+      this->replicaFirstId = std::strtoul(firstIdEnv, nullptr, 10);
+  }
+
   // Listen to the update event broadcasted every simulation iteration.
   this->updateConnection = gazebo::event::Events::ConnectWorldUpdateBegin(
       std::bind(&BrokerPlugin::Update, this, std::placeholders::_1));
+
+  // The adaptive fidelity of the comms model needs the wall time of each
+  // step, until the end of the physics update. The checkpoints are taken
+  // there too, once the state of the step is complete.
+  this->updateEndConnection = gazebo::event::Events::ConnectWorldUpdateEnd(
+      std::bind(&BrokerPlugin::OnUpdateEnd, this));
 }
 
 //////////////////////////////////////////////////
@@ -131,26 +234,683 @@ void BrokerPlugin::ReadSwarmFromSDF(sdf::ElementPtr _sdf)
   }
 }
 
+//////////////////////////////////////////////////
+void BrokerPlugin::LoadPartition(sdf::ElementPtr _sdf)
+{
+  if (!_sdf->HasElement("partition"))
+    return;
+
+  auto const &partitionElem = _sdf->GetElement("partition");
+  if (!partitionElem->HasElement("name"))
+  {
+    gzerr << "BrokerPlugin::LoadPartition(): Missing <name> in <partition>"
+          << std::endl;
+    return;
+  }
+  this->partitionName = partitionElem->Get<std::string>("name");
+
+  std::string transport = "shm";
+  if (partitionElem->HasElement("transport"))
+    transport = partitionElem->Get<std::string>("transport");
+
+  uint16_t port = 0;
+  if (partitionElem->HasElement("port"))
+    port = static_cast<uint16_t>(partitionElem->Get<int>("port"));
+
+  std::map<std::string, std::string> peers;
+  if (partitionElem->HasElement("peer"))
+  {
+    auto peerElem = partitionElem->GetElement("peer");
+    while (peerElem)
+    {
+      if (peerElem->HasElement("name"))
+      {
+        std::string address;
+        if (peerElem->HasElement("address"))
+          address = peerElem->Get<std::string>("address");
+        peers[peerElem->Get<std::string>("name")] = address;
+      }
+      else
+      {
+        gzerr << "BrokerPlugin::LoadPartition(): Ignoring <peer> without "
+              << "<name>" << std::endl;
+      }
+      peerElem = peerElem->GetNextElement("peer");
+    }
+  }
+
+  this->partitionLink =
+    PartitionLink::Create(transport, this->partitionName, peers, port);
+  if (!this->partitionLink)
+  {
+    gzerr << "BrokerPlugin::LoadPartition(): Unable to connect partition ["
+          << this->partitionName << "] with its peers" << std::endl;
+    return;
+  }
+
+  for (auto const &peer : peers)
+    this->partitionFrames[peer.first];
+
+  gzmsg << "BrokerPlugin::LoadPartition(): Partition [" << this->partitionName
+        << "] connected with " << peers.size() << " peers" << std::endl;
+}
+
+//////////////////////////////////////////////////
+void BrokerPlugin::LoadTelemetry(sdf::ElementPtr _sdf)
+{
+  if (!_sdf->HasElement("telemetry"))
+    return;
+
+  auto const &telemetryElem = _sdf->GetElement("telemetry");
+  std::string transport = "shm";
+  if (telemetryElem->HasElement("transport"))
+    transport = telemetryElem->Get<std::string>("transport");
+
+  std::string name = this->world->GetName();
+  if (telemetryElem->HasElement("name"))
+    name = telemetryElem->Get<std::string>("name");
+
+  std::string address;
+  if (telemetryElem->HasElement("address"))
+    address = telemetryElem->Get<std::string>("address");
+
+  if (telemetryElem->HasElement("period"))
+    this->telemetryPeriod = telemetryElem->Get<double>("period");
+
+  this->telemetry = TelemetryPublisher::Create(transport, name, address);
+  if (!this->telemetry)
+  {
+    gzerr << "BrokerPlugin::LoadTelemetry(): Unable to open the telemetry"
+          << std::endl;
+    return;
+  }
+  this->telemetryFrame.reset(new TelemetryFrame());
+
+  gzmsg << "BrokerPlugin::LoadTelemetry(): Publishing telemetry with "
+        << "transport [" << transport << "]" << std::endl;
+}
+
+//////////////////////////////////////////////////
+void BrokerPlugin::PublishTelemetry(const double _simTime)
+{
+  // The simulation time went backwards after a reset.
+  if (_simTime + this->telemetryPeriod < this->nextTelemetryTime)
+    this->nextTelemetryTime = _simTime;
+  if (_simTime + 1e-9 < this->nextTelemetryTime)
+    return;
+  this->nextTelemetryTime = _simTime + this->telemetryPeriod;
+
+  TelemetryHeader &header = this->telemetryFrame->header;
+  header.simTime = _simTime;
+  header.avgNeighbors = this->commsModel->AvgNeighbors();
+  header.numUnicast = this->numUnicast;
+  header.numBroadcast = this->numBroadcast;
+  header.numMulticast = this->numMulticast;
+  header.bytesSent = this->bytesSent;
+  header.msgsDelivered = this->msgsDelivered;
+  header.potentialRecipients = this->potentialRecipients;
+  header.reserved = 0;
+
+  const unsigned int numRobots = std::min<unsigned int>(this->swarm->size(),
+      kTelemetryMaxRobots);
+  header.numRobots = numRobots;
+
+  auto const &clients = this->broker->Clients();
+  for (unsigned int idx = 0; idx < numRobots; ++idx)
+  {
+    const SwarmMemberPtr &member = this->commsModel->Member(idx);
+    TelemetryRobot &robot = this->telemetryFrame->robots[idx];
+    std::memset(robot.address, 0, sizeof(robot.address));
+    member->address.copy(robot.address, sizeof(robot.address) - 1);
+
+    const ignition::math::Vector3d pos = this->poses->Position(idx);
+    robot.x = pos.X();
+    robot.y = pos.Y();
+    robot.z = pos.Z();
+    robot.yaw = this->poses->Orientation(idx).Yaw();
+
+    auto client = clients.find(member->address);
+    robot.battery = client != clients.end() ?
+      client->second->BatteryCapacity() :
+      std::numeric_limits<double>::quiet_NaN();
+
+    robot.neighbors = this->commsModel->Neighbors(idx).size();
+    robot.onOutage = member->onOutage;
+    robot.remote = !member->partition.empty();
+    robot.reserved = 0;
+  }
+
+  if (!this->telemetry->Publish(*this->telemetryFrame) &&
+      !this->telemetryDropReported)
+  {
+    gzwarn << "BrokerPlugin::PublishTelemetry(): Unable to publish a "
+           << "snapshot. Further errors won't be reported" << std::endl;
+    this->telemetryDropReported = true;
+  }
+}
+
+//////////////////////////////////////////////////
+void BrokerPlugin::ReceivePartitions()
+{
+  this->receivedFrames.clear();
+  this->partitionLink->Receive(this->receivedFrames);
+  if (this->receivedFrames.empty())
+    return;
+
+  std::vector<msgs::PartitionFrame> frames(this->receivedFrames.size());
+  for (size_t i = 0; i < frames.size(); ++i)
+  {
+    if (!frames[i].ParseFromString(this->receivedFrames[i]))
+    {
+      gzerr << "BrokerPlugin::ReceivePartitions(): Discarding malformed "
+            << "frame" << std::endl;
+      frames[i].Clear();
+    }
+  }
+
+  // The robots of the peers join the swarm the first time they're seen,
+  // without model.
+  bool joined = false;
+  for (auto const &frame : frames)
+  {
+    for (auto const &member : frame.member())
+    {
+      auto it = this->swarm->find(member.address());
+      if (it == this->swarm->end())
+      {
+        auto newMember = std::make_shared<SwarmMember>();
+        newMember->address = member.address();
+        newMember->name = member.address();
+        newMember->partition = frame.partition();
+        newMember->onOutage = false;
+        newMember->dataRateUsage = 0;
+        (*this->swarm)[member.address()] = newMember;
+        joined = true;
+      }
+      else if (it->second->partition.empty() &&
+          this->partitionConflicts.insert(member.address()).second)
+      {
+        gzerr << "BrokerPlugin::ReceivePartitions(): Robot ["
+              << member.address() << "] of partition [" << frame.partition()
+              << "] is also simulated by this partition. Ignoring it"
+              << std::endl;
+      }
+    }
+  }
+
+  // The ids of the robots change, so the comms model is rebuilt and all the
+  // robots get their neighbors again.
+  if (joined)
+  {
+    this->commsModel.reset(
+        new CommsModel(this->swarm, this->world, this->sdf));
+    this->notifiedVersions.clear();
+    this->trackedVersions.clear();
+    this->loggedVisibility.clear();
+  }
+
+  for (auto &frame : frames)
+  {
+    for (auto const &member : frame.member())
+    {
+      const int idx = this->commsModel->MemberIndex(member.address());
+      if (idx < 0 || this->commsModel->Member(idx)->partition.empty())
+        continue;
+
+      this->commsModel->SetRemoteState(idx,
+          gazebo::msgs::ConvertIgn(member.pose()), member.on_outage());
+    }
+
+    for (auto &datagram : *frame.mutable_datagram())
+    {
+      auto msgPtr = msgs::NewDatagram();
+      msgPtr->Swap(&datagram);
+      this->remoteMsgs.push_back(std::move(msgPtr));
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+void BrokerPlugin::SendPartitions(const double _simTime)
+{
+  // The state of the robots is the same for all the peers. The messages
+  // for each peer are appended to it, as the repeated fields of
+  // concatenated messages are merged when parsed.
+  this->partitionState.Clear();
+  this->partitionState.set_partition(this->partitionName);
+  this->partitionState.set_time(_simTime);
+  for (unsigned int idx = 0; idx < this->swarm->size(); ++idx)
+  {
+    const SwarmMemberPtr &swarmMember = this->commsModel->Member(idx);
+    if (!swarmMember->partition.empty())
+      continue;
+
+    auto member = this->partitionState.add_member();
+    member->set_address(swarmMember->address);
+    gazebo::msgs::Set(member->mutable_pose(), this->poses->Pose(idx));
+    member->set_on_outage(swarmMember->onOutage);
+  }
+
+  for (auto &peer : this->partitionFrames)
+  {
+    this->frameBuffer.clear();
+    this->partitionState.AppendToString(&this->frameBuffer);
+    peer.second.AppendPartialToString(&this->frameBuffer);
+    peer.second.Clear();
+
+    if (!this->partitionLink->Send(peer.first, this->frameBuffer) &&
+        !this->partitionDropReported)
+    {
+      gzwarn << "BrokerPlugin::SendPartitions(): Dropped a frame for "
+             << "partition [" << peer.first << "]. Further drops won't be "
+             << "reported" << std::endl;
+      this->partitionDropReported = true;
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+void BrokerPlugin::ForwardToPartitions(const msgs::Datagram &_msg,
+    const unsigned int _src)
+{
+  // Each peer gets the message once, if it simulates any neighbor of the
+  // sender. The handle of the endpoint is only valid in this broker.
+  std::vector<const std::string *> forwarded;
+  for (const unsigned int neighbor : this->commsModel->Neighbors(_src))
+  {
+    const std::string &partition =
+      this->commsModel->Member(neighbor)->partition;
+    if (partition.empty() ||
+        std::find_if(forwarded.begin(), forwarded.end(),
+          [&partition](const std::string *_other)
+          {
+            return *_other == partition;
+          }) != forwarded.end())
+    {
+      continue;
+    }
+    forwarded.push_back(&partition);
+
+    auto frame = this->partitionFrames.find(partition);
+    if (frame == this->partitionFrames.end())
+      continue;
+
+    auto datagram = frame->second.add_datagram();
+    datagram->CopyFrom(_msg);
+    datagram->clear_dst_endpoint();
+  }
+}
+
 //////////////////////////////////////////////////
 void BrokerPlugin::Update(const gazebo::common::UpdateInfo &_info)
 {
+  this->stepStart = std::chrono::steady_clock::now();
+  if (StepTrace *trace = this->timers->Trace())
+    trace->BeginStep(std::llround(_info.simTime.Double() / this->stepSize));
+
+  // Without the comms model, the messages of the robots that aren't
+  // replayed, such as the BOO, are dropped.
+  if (this->replay)
+  {
+    this->step = std::llround(_info.simTime.Double() / this->stepSize);
+    this->timers->Step();
+    this->broker->Messages().clear();
+    this->logger->Update(_info.simTime.Double());
+    return;
+  }
+
   {
     std::lock_guard<std::mutex> lock(this->mutex);
 
-    // Update the state of the communication model.
-    this->commsModel->Update();
+    // Update the robots simulated by the other partitions.
+    if (this->partitionLink)
+      this->ReceivePartitions();
 
-    // Send a message to each swarm member with its updated neighbors list.
+    // Update the state of the communication model. With <pipelined>, this
+    // only waits for the state evaluated during the previous step.
+    {
+      ScopedStepTimer timer(this->timers, TIMER_COMMS_MODEL);
+      this->commsModel->Update();
+    }
+
+    // Send a message to each swarm member with its updated neighbors list,
+    // and share where the neighbors were last heard of.
+    ScopedStepTimer timer(this->timers, TIMER_NOTIFY_NEIGHBORS);
     this->NotifyNeighbors();
+    this->broker->SetPositions(this->commsModel->ReportedPositions());
+    this->TrackConnectivity();
   }
 
+  this->step = std::llround(_info.simTime.Double() / this->stepSize);
+  this->timers->Step();
+
   // Dispatch all the incoming messages, deciding whether the destination gets
-  // the message according to the communication model.
-  // Mutex handling is done inside DispatchMessages().
-  this->DispatchMessages();
+  // the message according to the communication model. The outbox is drained
+  // without a lock, so the robots keep sending while this runs.
+  {
+    ScopedStepTimer timer(this->timers, TIMER_DISPATCH);
+    this->DispatchMessages();
+  }
+
+  // Deliver the messages whose latency ends in this step.
+  {
+    ScopedStepTimer timer(this->timers, TIMER_DELIVERY);
+    this->DeliverScheduled();
+  }
+
+  // Send the state of this partition and the messages that may reach the
+  // robots of the other partitions.
+  if (this->partitionLink)
+    this->SendPartitions(_info.simTime.Double());
+
+  // Publish a snapshot of this step for the dashboards.
+  if (this->telemetry)
+    this->PublishTelemetry(_info.simTime.Double());
 
   // Log the current iteration.
-  this->logger->Update(_info.simTime.Double());
+  {
+    ScopedStepTimer timer(this->timers, TIMER_LOGGER);
+    this->logger->Update(_info.simTime.Double());
+  }
+
+  // The state of this step was read, so the comms model can evaluate the
+  // next one while the controllers and the physics run.
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->commsModel->StartUpdate();
+}
+
+//////////////////////////////////////////////////
+void BrokerPlugin::OnUpdateEnd()
+{
+  const double wallTime = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - this->stepStart).count();
+
+  if (this->commsModel->AdaptiveFidelity())
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->commsModel->AdaptFidelity(wallTime);
+  }
+
+  this->ProcessCheckpoints();
+
+  if (this->memoryReport && this->memory->SignalPending())
+    this->PrintMemory();
+
+  // The step ends here, so a slow step is written with its spans.
+  if (StepTrace *trace = this->timers->Trace())
+    trace->EndStep();
+
+  const double kTolerance = 1e-9;
+  if (this->replicas > 0 &&
+      this->world->GetSimTime().Double() + kTolerance >= this->replicaTime)
+  {
+    this->ForkReplicas();
+  }
+}
+
+//////////////////////////////////////////////////
+void BrokerPlugin::ForkReplicas()
+{
+  const unsigned int count = this->replicas;
+  this->replicas = 0;
+
+  // Only the thread calling fork() survives in the child. swarm_batch runs
+  // the world in its main thread, unlike gzserver.
+  const char *batchEnv = std::getenv("SWARM_BATCH");
+  if (!batchEnv || std::string(batchEnv) != "1")
+  {
+    gzerr << "BrokerPlugin::ForkReplicas() The replicas are only forked "
+          << "by swarm_batch" << std::endl;
+    return;
+  }
+  if (this->partitionLink)
+  {
+    gzerr << "BrokerPlugin::ForkReplicas() A split swarm can't be forked"
+          << std::endl;
+    return;
+  }
+
+  gzmsg << "Forking " << count << " replicas at time "
+        << this->world->GetSimTime().Double() << std::endl;
+
+  // The entries logged until now belong to the warm-up.
+  this->logger->PrepareFork();
+  this->commsModel->PrepareFork();
+  std::vector<pid_t> pids;
+  for (unsigned int k = 0; k < count; ++k)
+  {
+    const pid_t pid = fork();
+    if (pid < 0)
+    {
+      gzerr << "BrokerPlugin::ForkReplicas() Unable to fork replica " << k
+            << std::endl;
+      break;
+    }
+    if (pid == 0)
+    {
+      this->StartReplica(k);
+      return;
+    }
+    pids.push_back(pid);
+  }
+  this->logger->ResumeFork("");
+
+  unsigned int failed = count - pids.size();
+  for (unsigned int k = 0; k < pids.size(); ++k)
+  {
+    int status;
+    if (waitpid(pids[k], &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0)
+    {
+      gzerr << "BrokerPlugin::ForkReplicas() Replica " << k << " failed"
+            << std::endl;
+      ++failed;
+    }
+  }
+  gzmsg << count - failed << " of " << count << " replicas finished"
+        << std::endl;
+
+  // The warm world was only the origin of the replicas.
+  this->world->Stop();
+}
+
+//////////////////////////////////////////////////
+void BrokerPlugin::StartReplica(const unsigned int _replica)
+{
+  setenv("SWARM_REPLICA", std::to_string(_replica).c_str(), 1);
+
+  // Each replica draws its own random numbers from here on.
+  const unsigned int seed = this->replicaSeed + _replica;
+  ignition::math::Rand::Seed(seed);
+  this->dispatchSeed = seed;
+
+  sdf::ElementPtr overrides;
+  if (this->sdf->HasElement("replicas"))
+  {
+    overrides = this->sdf->GetElement("replicas")->GetElement("replica");
+    for (unsigned int k = 0; overrides && k < _replica; ++k)
+      overrides = overrides->GetNextElement("replica");
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->commsModel->Fork(overrides);
+    this->maxDataRatePerCycle =
+      this->commsModel->MaxDataRate() * this->stepSize;
+  }
+
+  // The replicas would share the segment of the dashboards.
+  this->telemetry.reset();
+
+  const std::string logPath = this->replicaLogPath + "/" +
+    std::to_string(this->replicaFirstId + _replica);
+  this->logger->ResumeFork(logPath);
+  this->loggedVisibility.clear();
+  this->loggedVisibilityDeltas = 0;
+
+  gzmsg << "Replica " << _replica << ": seed " << seed
+        << (overrides ? ", with overrides" : "") << std::endl;
+}
+
+//////////////////////////////////////////////////
+void BrokerPlugin::ProcessCheckpoints()
+{
+  // The checkpoint given at startup replaces the first step.
+  if (!this->restorePath.empty())
+  {
+    this->RestoreCheckpoint(this->restorePath);
+    this->restorePath.clear();
+  }
+
+  std::string path;
+  bool restore;
+  while (this->checkpointer->TakeRequest(path, restore))
+  {
+    if (restore)
+      this->RestoreCheckpoint(path);
+    else
+      this->SaveCheckpoint(path);
+  }
+
+  if (this->checkpointPeriod <= 0)
+    return;
+
+  const double kTolerance = 1e-9;
+  const double simTime = this->world->GetSimTime().Double();
+  if (simTime + kTolerance < this->nextCheckpointTime)
+    return;
+
+  // E.g. ./swarm_120.000.ckpt.
+  char time[32];
+  std::snprintf(time, sizeof(time), "_%.3f.ckpt", simTime);
+  this->SaveCheckpoint(
+      this->checkpointDir + "/" + this->world->GetName() + time);
+
+  this->nextCheckpointTime += this->checkpointPeriod;
+  if (this->nextCheckpointTime + kTolerance <= simTime)
+    this->nextCheckpointTime = simTime + this->checkpointPeriod;
+}
+
+//////////////////////////////////////////////////
+bool BrokerPlugin::SaveCheckpoint(const std::string &_path)
+{
+  if (this->partitionLink)
+  {
+    gzerr << "BrokerPlugin::SaveCheckpoint() A split swarm can't be "
+          << "checkpointed [" << _path << "]" << std::endl;
+    return false;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+
+  // The entries logged until now are before the checkpoint.
+  this->logger->Flush();
+
+  msgs::Checkpoint checkpoint;
+  checkpoint.set_world(this->world->GetName());
+  checkpoint.set_sim_time(this->world->GetSimTime().Double());
+
+  // The state of the random generator of ignition can't be saved, so both
+  // this simulation and the restored one continue from a new seed.
+  const uint32_t seed = static_cast<uint32_t>(
+      ignition::math::Rand::IntUniform(1, std::numeric_limits<int>::max()));
+  ignition::math::Rand::Seed(seed);
+  checkpoint.set_seed(seed);
+
+  for (auto const &model : this->world->GetModels())
+  {
+    if (model->IsStatic())
+      continue;
+
+    msgs::ModelState *state = checkpoint.add_model();
+    state->set_name(model->GetName());
+    gazebo::msgs::Set(state->mutable_pose(), model->GetWorldPose().Ign());
+    gazebo::msgs::Set(state->mutable_linear_vel(),
+        model->GetWorldLinearVel().Ign());
+    gazebo::msgs::Set(state->mutable_angular_vel(),
+        model->GetWorldAngularVel().Ign());
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->checkpointer->Save(checkpoint);
+  }
+
+  if (!Checkpointer::Write(_path, checkpoint))
+    return false;
+
+  gzmsg << "Checkpoint [" << _path << "] written in "
+        << std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start).count()
+        << " ms" << std::endl;
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool BrokerPlugin::RestoreCheckpoint(const std::string &_path)
+{
+  const auto start = std::chrono::steady_clock::now();
+
+  msgs::Checkpoint checkpoint;
+  if (!Checkpointer::Read(_path, checkpoint))
+    return false;
+
+  if (checkpoint.world() != this->world->GetName())
+  {
+    gzerr << "BrokerPlugin::RestoreCheckpoint() The checkpoint ["
+          << _path << "] is of the world [" << checkpoint.world()
+          << "]" << std::endl;
+    return false;
+  }
+
+  if (this->partitionLink)
+  {
+    gzerr << "BrokerPlugin::RestoreCheckpoint() A split swarm can't be "
+          << "checkpointed [" << _path << "]" << std::endl;
+    return false;
+  }
+
+  this->world->SetSimTime(gazebo::common::Time(checkpoint.sim_time()));
+  for (auto const &state : checkpoint.model())
+  {
+    auto const &model = this->world->GetModel(state.name());
+    if (!model)
+    {
+      gzwarn << "BrokerPlugin::RestoreCheckpoint() Model [" << state.name()
+             << "] not found" << std::endl;
+      continue;
+    }
+
+    model->SetWorldPose(gazebo::msgs::ConvertIgn(state.pose()));
+    model->SetLinearVel(gazebo::msgs::ConvertIgn(state.linear_vel()));
+    model->SetAngularVel(gazebo::msgs::ConvertIgn(state.angular_vel()));
+  }
+
+  ignition::math::Rand::Seed(checkpoint.seed());
+
+  bool restored;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    restored = this->checkpointer->Restore(checkpoint);
+  }
+
+  if (!restored)
+  {
+    gzerr << "BrokerPlugin::RestoreCheckpoint() The checkpoint [" << _path
+          << "] doesn't match the world. Some parts weren't restored"
+          << std::endl;
+  }
+
+  // Start the periodic checkpoints again from the restored time.
+  if (this->checkpointPeriod > 0)
+    this->nextCheckpointTime = checkpoint.sim_time() + this->checkpointPeriod;
+
+  gzmsg << "Checkpoint [" << _path << "] restored at time "
+        << checkpoint.sim_time() << " in "
+        << std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start).count()
+        << " ms" << std::endl;
+  return restored;
 }
 
 //////////////////////////////////////////////////
@@ -158,22 +918,61 @@ void BrokerPlugin::NotifyNeighbors()
 {
   const auto &clients = this->broker->Clients();
 
-  // Send neighbors update to each member of the swarm.
-  for (auto const &robot : (*this->swarm))
+  // The members that were never notified get their first list.
+  const unsigned int numMembers = this->swarm->size();
+  this->notifiedVersions.resize(numMembers,
+      std::numeric_limits<uint64_t>::max());
+
+  // Send neighbors update to each member of the swarm whose neighbors
+  // changed since its last notification.
+  for (unsigned int idx = 0; idx < numMembers; ++idx)
   {
-    std::vector<std::string> v;
-    auto address = robot.first;
-    auto swarmMember = (*this->swarm)[address];
+    const uint64_t version = this->commsModel->NeighborsVersion(idx);
+    if (this->notifiedVersions[idx] == version)
+      continue;
+
+    const SwarmMemberPtr &swarmMember = this->commsModel->Member(idx);
 
     // This address is not registered as a broker client.
-    if (clients.find(address) == clients.end())
+    const auto client = clients.find(swarmMember->address);
+    if (client == clients.end())
       continue;
 
-    for (auto const &neighbor : swarmMember->neighbors)
-      v.push_back(neighbor.first);
+    const std::vector<unsigned int> &neighbors =
+      this->commsModel->Neighbors(idx);
+    std::vector<std::string> v;
+    v.reserve(neighbors.size());
+    for (const unsigned int neighbor : neighbors)
+      v.push_back(this->commsModel->Address(neighbor));
 
     // Notify the node with its updated list of neighbors.
-    clients.at(address)->OnNeighborsReceived(v);
+    client->second->OnNeighborsReceived(v);
+    this->notifiedVersions[idx] = version;
+  }
+}
+
+//////////////////////////////////////////////////
+void BrokerPlugin::TrackConnectivity()
+{
+  // The tracker starts over when the members change, e.g. after a reset.
+  const unsigned int numMembers = this->swarm->size();
+  if (this->trackedVersions.size() != numMembers)
+  {
+    this->connectivity.Reset(numMembers,
+        this->commsModel->MemberIndex("boo"));
+    this->trackedVersions.assign(numMembers,
+        std::numeric_limits<uint64_t>::max());
+    this->loggedConnectivity = ConnectivityStats();
+  }
+
+  for (unsigned int idx = 0; idx < numMembers; ++idx)
+  {
+    const uint64_t version = this->commsModel->NeighborsVersion(idx);
+    if (this->trackedVersions[idx] == version)
+      continue;
+
+    this->connectivity.SetNeighbors(idx, this->commsModel->Neighbors(idx));
+    this->trackedVersions[idx] = version;
   }
 }
 
@@ -187,129 +986,387 @@ void BrokerPlugin::DispatchMessages()
   this->msgsDelivered = 0;
   this->potentialRecipients = 0;
 
-  // Create a copy of the incoming message queue, then release the mutex, to
-  // avoid the potential for a deadlock later if a robot calls SendTo() inside
-  // its message callback.
-  std::deque<msgs::Datagram> incomingMsgsBuffer;
-  {
-    std::lock_guard<std::mutex> lock(this->mutex);
-    std::swap(incomingMsgsBuffer, this->broker->Messages());
-  }
+  // Take all the messages sent since the last dispatch at once. The robots
+  // push them without locking, and the messages sent by the callbacks below
+  // are dispatched in the next cycle.
+  std::deque<DatagramPtr> incomingMsgsBuffer;
+  std::swap(incomingMsgsBuffer, this->broker->Messages());
+
+  // The messages received from the other partitions compete with the local
+  // ones.
+  for (DatagramPtr &msgPtr : this->remoteMsgs)
+    incomingMsgsBuffer.push_back(std::move(msgPtr));
+  this->remoteMsgs.clear();
 
   this->logIncomingMsgs.Clear();
 
-  // Shuffle the messages.
+  // Shuffle the messages. The order and the drops of a step only depend on
+  // the seed and the step.
+  RandomStream dispatch(this->dispatchSeed, RandomStream::DISPATCH);
+  dispatch.Seek(this->step);
   std::shuffle(incomingMsgsBuffer.begin(), incomingMsgsBuffer.end(),
-    this->rndEngine);
-
-  // Get the current list of endpoints and clients bound.
-  const EndPoints_M &endpoints = this->broker->EndPoints();
-
-  // Clear the data rate usage for each robot.
-  for (const auto &member : (*this->swarm))
-    member.second->dataRateUsage = 0;
+    dispatch);
 
-  while (!incomingMsgsBuffer.empty())
+  // Resolve the sender of each message once.
+  this->outgoing.clear();
+  for (DatagramPtr &msgPtr : incomingMsgsBuffer)
   {
-    // Get the next message to dispatch.
-    const msgs::Datagram msg = incomingMsgsBuffer.front();
-    incomingMsgsBuffer.pop_front();
-
     // Sanity check: Make sure that the sender is a member of the swarm.
-    if (this->swarm->find(msg.src_address()) == this->swarm->end())
+    const int src = this->commsModel->MemberIndex(msgPtr->src_address());
+    if (src < 0)
     {
       gzerr << "BrokerPlugin::DispatchMessages(): Discarding message. Robot ["
-            << msg.src_address() << "] is not registered as a member of the "
-            << "swarm" << std::endl;
+            << msgPtr->src_address() << "] is not registered as a member of "
+            << "the swarm" << std::endl;
       continue;
     }
 
+    this->outgoing.push_back({std::move(msgPtr),
+        static_cast<unsigned int>(src)});
+  }
+  incomingMsgsBuffer.clear();
+
+  this->AccountDataRate();
+
+  // The counters are only needed when logging, and the records of the
+  // messages only when logging the full entries.
+  const bool logging = this->logger->Enabled();
+  const bool logRecords = logging && !this->logger->Minimal();
+
+  // With latency, the messages arrive after their transmission time plus
+  // the latency, rounded to the step.
+  const double latency = this->commsModel->Latency();
+  const double bitTime = 1.0 / this->commsModel->MaxDataRate();
+  const uint16_t overhead = this->commsModel->UdpOverhead();
+
+  for (size_t i = 0; i < this->outgoing.size(); ++i)
+  {
+    // Get the next message to dispatch. The message is shared with the
+    // sender and delivered by reference, it's never copied.
+    const DatagramPtr msgPtr = std::move(this->outgoing[i].msg);
+    const msgs::Datagram &msg = *msgPtr;
+    const unsigned int src = this->outgoing[i].src;
+
     // For logging purposes, we store the request for communication.
-    swarm::msgs::Message *logMsg = this->logIncomingMsgs.add_message();
-    logMsg->set_src_address(msg.src_address());
-    logMsg->set_dst_address(msg.dst_address());
-    logMsg->set_dst_port(msg.dst_port());
-    logMsg->set_size(msg.data().size());
-
-    if (msg.dst_address() == "broadcast")
-      this->numBroadcast += 1;
-    else if (msg.dst_address() == "multicast")
-      this->numMulticast += 1;
-    else
-      this->numUnicast += 1;
+    swarm::msgs::Message *logMsg = nullptr;
+    if (logRecords)
+    {
+      logMsg = this->logIncomingMsgs.add_message();
+      logMsg->set_src_address(msg.src_address());
+      logMsg->set_dst_address(msg.dst_address());
+      logMsg->set_dst_port(msg.dst_port());
+      logMsg->set_size(msg.data().size());
+    }
+
+    // The messages of the other partitions are counted there.
+    const bool local = this->commsModel->Member(src)->partition.empty();
+    if (local)
+    {
+      if (msg.dst_address() == "broadcast")
+        this->numBroadcast += 1;
+      else if (msg.dst_address() == "multicast")
+        this->numMulticast += 1;
+      else
+        this->numUnicast += 1;
+
+      this->bytesSent += msg.data().size() + 56;
+    }
+
+    // An isolated sender, e.g. on an outage, can't reach anybody.
+    const std::vector<unsigned int> &neighbors =
+      this->commsModel->Neighbors(src);
+    if (neighbors.empty() || this->commsModel->Member(src)->onOutage)
+      continue;
+
+    // The other partitions decide whether their robots get the message.
+    if (local && this->partitionLink)
+      this->ForwardToPartitions(msg, src);
+
+    // Neither can a sender whose neighbors are all saturated. These drops
+    // are only skipped when nothing is logged, as they are counted.
+    if (!logging && std::all_of(neighbors.begin(), neighbors.end(),
+          [this, i](const unsigned int _neighbor)
+          {
+            return i >= this->saturatedAt[_neighbor];
+          }))
+    {
+      continue;
+    }
 
-    this->bytesSent += msg.data().size() + 56;
+    // The sender found the handle of the endpoint, unless it was bound
+    // after the message was sent.
+    EndPointId dstEndPoint = msg.dst_endpoint();
+    if (!msg.has_dst_endpoint() &&
+        !this->broker->Find(msg.dst_address(), msg.dst_port(), dstEndPoint))
+    {
+      continue;
+    }
 
-    // Get the list of neighbors of the sender.
-    const Neighbors_M &neighbors = (*this->swarm)[msg.src_address()]->neighbors;
+    uint64_t arrival = this->step;
+    if (latency >= 0)
+    {
+      const double delay =
+        (msg.data().size() + overhead) * 8 * bitTime + latency;
+      arrival += std::llround(delay / this->stepSize);
+    }
 
-    // Update the data rate usage.
-    auto dataSize = (msg.data().size() + this->commsModel->UdpOverhead()) * 8;
-    (*this->swarm)[msg.src_address()]->dataRateUsage += dataSize;
-    for (const auto &neighbor : neighbors)
+    // The potential recipients are the members bound to the endpoint that
+    // are neighbors of the sender. The small endpoints, e.g. unicast, test
+    // the bit of each member, and the others AND their bitset with the
+    // neighbors, a word per 64 robots.
+    const EndPointMembers &members = this->Members(dstEndPoint);
+    const uint64_t *neighborBits = this->commsModel->NeighborBits(src);
+    this->recipients.clear();
+    if (members.bits.empty())
+    {
+      for (size_t k = 0; k < members.ids.size(); ++k)
+      {
+        const unsigned int dst = members.ids[k];
+        if (neighborBits[dst / 64] & (uint64_t(1) << (dst % 64)))
+          this->recipients.push_back({dst, members.slots[k]});
+      }
+    }
+    else
     {
-      // We account the overhead caused by the UDP/IP/Ethernet headers + the
-      // payload. We convert the total amount of bytes to bits.
-      (*this->swarm)[neighbor.first]->dataRateUsage += dataSize;
+      for (size_t w = 0; w < members.words; ++w)
+      {
+        uint64_t word = members.bits[w] & neighborBits[w];
+        while (word != 0)
+        {
+          const unsigned int bit = __builtin_ctzll(word);
+          const uint64_t below = members.bits[w] & ((uint64_t(1) << bit) - 1);
+          const uint32_t rank = members.ranks[w] + __builtin_popcountll(below);
+          this->recipients.push_back({static_cast<unsigned int>(w * 64 + bit),
+              members.slots[rank]});
+          word &= word - 1;
+        }
+      }
     }
+    this->potentialRecipients += this->recipients.size();
+
+    // Visit the potential recipients in a random order. The clients are
+    // looked up at every step, as the callbacks may bind new endpoints and
+    // move them. The clients bound meanwhile don't get this message, and
+    // neither do the ones unbound meanwhile.
+    const uint64_t version = this->broker->EndPointVersion(dstEndPoint);
+    this->fanOut.Reset(this->recipients.size(), dispatch.Bits64());
 
-    std::string dstEndPoint =
-      msg.dst_address() + ":" + std::to_string(msg.dst_port());
-    if (endpoints.find(dstEndPoint) != endpoints.end())
+    uint32_t next;
+    while (this->fanOut.Next(next))
     {
-      // Shuffle the clients bound to this endpoint.
-      std::vector<BrokerClientInfo> clientsV = endpoints.at(dstEndPoint);
-      std::shuffle(clientsV.begin(), clientsV.end(), this->rndEngine);
+      const unsigned int dst = this->recipients[next].first;
+      const uint32_t slot = this->recipients[next].second;
+      const std::vector<BrokerClientInfo> &clients =
+        this->broker->EndPointClients(dstEndPoint);
+      if (this->broker->EndPointVersion(dstEndPoint) != version &&
+          (slot >= clients.size() ||
+           clients[slot].address != this->commsModel->Address(dst)))
+      {
+        continue;
+      }
+      const BrokerClientInfo &client = clients[slot];
+      const double neighborProb = this->commsModel->CommsProbability(src, dst);
 
-      for (const BrokerClientInfo &client : clientsV)
+      msgs::CommsStatus status;
+      // Check if the maximum data rate has been reached in the destination.
+      if (i >= this->saturatedAt[dst])
+      {
+        status = msgs::CommsStatus::DATARATE;
+        // Debug output
+        // gzdbg << "Dropping message (max data rate) from "
+        //       << msg.src_address() << " to " << client.address
+        //       << " (addressed to " << msg.dst_address()
+        //       << ")" << std::endl;
+      }
+      // Decide whether this neighbor gets this message, according to the
+      // probability of communication between them right now.
+      else if (dispatch.Uniform() < neighborProb)
+      {
+        // Debug output
+        // gzdbg << "Sending message from " << msg.src_address() << " to "
+        //       << client.address << " (addressed to " << msg.dst_address()
+        //       << ")" << std::endl;
+        status = msgs::CommsStatus::DELIVERED;
+        this->msgsDelivered += 1;
+      }
+      else
       {
-        // Make sure that we're sending the message to a valid neighbor.
-        if (neighbors.find(client.address) == neighbors.end())
-          continue;
+        status = msgs::CommsStatus::DROPPED;
+        // Debug output.
+        // gzdbg << "Dropping message from " << msg.src_address() << " to "
+        //       << client.address << " (addressed to " << msg.dst_address()
+        //       << ")" << std::endl;
+      }
 
+      if (logMsg)
+      {
         auto neighborEntryLog = logMsg->add_neighbor();
         neighborEntryLog->set_dst(client.address);
-        this->potentialRecipients += 1;
+        neighborEntryLog->set_status(status);
+      }
 
-        // Check if the maximum data rate has been reached in the destination.
-        if ((*this->swarm)[client.address]->dataRateUsage >
-            this->maxDataRatePerCycle)
-        {
-          neighborEntryLog->set_status(msgs::CommsStatus::DATARATE);
-          // Debug output
-          // gzdbg << "Dropping message (max data rate) from "
-          //       << msg.src_address() << " to " << client.address
-          //       << " (addressed to " << msg.dst_address()
-          //       << ")" << std::endl;
-          continue;
-        }
+      if (status != msgs::CommsStatus::DELIVERED)
+        continue;
 
-        // Decide whether this neighbor gets this message, according to the
-        // probability of communication between them right now.
-        const double &neighborProb = neighbors.at(client.address);
-        if (ignition::math::Rand::DblUniform(0.0, 1.0) < neighborProb)
-        {
-          // Debug output
-          // gzdbg << "Sending message from " << msg.src_address() << " to "
-          //       << client.address << " (addressed to " << msg.dst_address()
-          //       << ")" << std::endl;
-          client.handler->OnMsgReceived(msg);
-          neighborEntryLog->set_status(msgs::CommsStatus::DELIVERED);
-          this->msgsDelivered += 1;
-        }
-        else
-        {
-          neighborEntryLog->set_status(msgs::CommsStatus::DROPPED);
-          // Debug output.
-          // gzdbg << "Dropping message from " << msg.src_address() << " to "
-          //       << client.address << " (addressed to " << msg.dst_address()
-          //       << ")" << std::endl;
-        }
+      // Deliver last, as the callback may bind endpoints and move the
+      // client.
+      if (latency >= 0)
+      {
+        this->deliveries.Schedule(arrival,
+            {msgPtr, client.address, client.handler, client.callback});
       }
+      else
+        client.handler->OnMsgReceived(msgPtr, client.callback);
     }
   }
 }
 
+//////////////////////////////////////////////////
+const BrokerPlugin::EndPointMembers &BrokerPlugin::Members(
+    const EndPointId _id)
+{
+  if (_id >= this->endpointMembers.size())
+    this->endpointMembers.resize(_id + 1);
+
+  EndPointMembers &members = this->endpointMembers[_id];
+  const uint64_t version = this->broker->EndPointVersion(_id);
+  const size_t words = this->commsModel->NeighborWords();
+  if (members.version == version && members.words == words)
+    return members;
+
+  members.version = version;
+  members.words = words;
+
+  // The clients that are not members of the swarm never get messages.
+  const std::vector<BrokerClientInfo> &clients =
+    this->broker->EndPointClients(_id);
+  std::vector<std::pair<unsigned int, uint32_t>> bound;
+  for (uint32_t slot = 0; slot < clients.size(); ++slot)
+  {
+    const int dst = this->commsModel->MemberIndex(clients[slot].address);
+    if (dst >= 0)
+      bound.push_back({static_cast<unsigned int>(dst), slot});
+  }
+  std::sort(bound.begin(), bound.end());
+
+  members.ids.clear();
+  members.slots.clear();
+  for (const auto &member : bound)
+  {
+    members.ids.push_back(member.first);
+    members.slots.push_back(member.second);
+  }
+
+  // The position of a member in ids is its rank in the bitset.
+  members.bits.clear();
+  members.ranks.clear();
+  if (members.ids.size() > words)
+  {
+    members.bits.assign(words, 0);
+    for (const unsigned int dst : members.ids)
+      members.bits[dst / 64] |= uint64_t(1) << (dst % 64);
+
+    members.ranks.assign(words, 0);
+    for (size_t w = 1; w < words; ++w)
+    {
+      members.ranks[w] = members.ranks[w - 1] +
+        __builtin_popcountll(members.bits[w - 1]);
+    }
+  }
+
+  return members;
+}
+
+//////////////////////////////////////////////////
+void BrokerPlugin::DeliverScheduled()
+{
+  this->deliveries.Advance(this->step, this->arrivals);
+
+  // The clients unregistered meanwhile don't get their messages.
+  const auto &clients = this->broker->Clients();
+  for (const Delivery &delivery : this->arrivals)
+  {
+    const auto client = clients.find(delivery.address);
+    if (client != clients.end() && client->second == delivery.handler)
+      delivery.handler->OnMsgReceived(delivery.msg, delivery.callback);
+  }
+  this->arrivals.clear();
+}
+
+//////////////////////////////////////////////////
+void BrokerPlugin::AccountDataRate()
+{
+  const size_t kNever = std::numeric_limits<size_t>::max();
+  const unsigned int numMembers = this->swarm->size();
+  this->senderBits.assign(numMembers, 0);
+  this->saturatedAt.assign(numMembers, kNever);
+
+  // First, add up the bits sent by each robot. We account the overhead
+  // caused by the UDP/IP/Ethernet headers + the payload.
+  const uint16_t overhead = this->commsModel->UdpOverhead();
+  for (const Outgoing &out : this->outgoing)
+    this->senderBits[out.src] += (out.msg->data().size() + overhead) * 8;
+
+  // Then, the bits sent by each robot occupy its channel and the channel
+  // of all its neighbors.
+  for (unsigned int idx = 0; idx < numMembers; ++idx)
+    this->commsModel->Member(idx)->dataRateUsage = 0;
+
+  for (unsigned int src = 0; src < numMembers; ++src)
+  {
+    const uint32_t bits = this->senderBits[src];
+    if (bits == 0)
+      continue;
+
+    this->commsModel->Member(src)->dataRateUsage += bits;
+    for (const unsigned int neighbor : this->commsModel->Neighbors(src))
+      this->commsModel->Member(neighbor)->dataRateUsage += bits;
+  }
+
+  // The usage only grows while the messages are dispatched, so the robots
+  // that stay under the maximum in total don't drop any message.
+  unsigned int pending = 0;
+  auto saturated = [this](const unsigned int _idx)
+  {
+    return this->commsModel->Member(_idx)->dataRateUsage >
+      this->maxDataRatePerCycle;
+  };
+  for (unsigned int idx = 0; idx < numMembers; ++idx)
+  {
+    if (saturated(idx))
+      ++pending;
+  }
+
+  // For the saturated robots, replay the messages in order to find the
+  // first one that exceeds the maximum. The replay stops once all of them
+  // are found.
+  std::fill(this->senderBits.begin(), this->senderBits.end(), 0);
+  for (size_t i = 0; i < this->outgoing.size() && pending > 0; ++i)
+  {
+    const unsigned int src = this->outgoing[i].src;
+    const uint32_t bits =
+      (this->outgoing[i].msg->data().size() + overhead) * 8;
+
+    auto occupy = [&](const unsigned int _idx)
+    {
+      if (this->saturatedAt[_idx] != kNever || !saturated(_idx))
+        return;
+
+      // senderBits now holds the usage replayed so far.
+      this->senderBits[_idx] += bits;
+      if (this->senderBits[_idx] > this->maxDataRatePerCycle)
+      {
+        this->saturatedAt[_idx] = i;
+        --pending;
+      }
+    };
+
+    occupy(src);
+    for (const unsigned int neighbor : this->commsModel->Neighbors(src))
+      occupy(neighbor);
+  }
+}
+
 //////////////////////////////////////////////////
 void BrokerPlugin::OnLogMin(msgs::LogEntryMin &_logEntry) const
 {
@@ -318,8 +1375,47 @@ void BrokerPlugin::OnLogMin(msgs::LogEntryMin &_logEntry) const
   _logEntry.set_num_multicast(this->numMulticast);
   _logEntry.set_bytes_sent(this->bytesSent);
   _logEntry.set_msgs_delivered(this->msgsDelivered);
-  _logEntry.set_avg_neighbors(this->commsModel->AvgNeighbors());
+  this->loggedNeighbors = this->commsModel->AvgNeighbors();
+  _logEntry.set_avg_neighbors(this->loggedNeighbors);
   _logEntry.set_potential_recipients(this->potentialRecipients);
+  this->commsModel->TakeFidelityChanges(*_logEntry.mutable_comms_fidelity());
+
+  // The connectivity is only logged when it changes. The average is a
+  // double, compared to the bit.
+  const ConnectivityStats &stats = this->connectivity.Stats();
+  if (stats.components != this->loggedConnectivity.components ||
+      stats.largestComponent != this->loggedConnectivity.largestComponent ||
+      stats.isolated != this->loggedConnectivity.isolated ||
+      stats.rootReachable != this->loggedConnectivity.rootReachable ||
+      std::memcmp(&stats.avgHops, &this->loggedConnectivity.avgHops,
+        sizeof(stats.avgHops)) != 0 ||
+      stats.maxHops != this->loggedConnectivity.maxHops)
+  {
+    auto connectivityMsg = _logEntry.mutable_connectivity();
+    connectivityMsg->set_components(stats.components);
+    connectivityMsg->set_largest_component(stats.largestComponent);
+    connectivityMsg->set_isolated(stats.isolated);
+    connectivityMsg->set_boo_reachable(stats.rootReachable);
+    connectivityMsg->set_avg_hops(stats.avgHops);
+    connectivityMsg->set_max_hops(stats.maxHops);
+    this->loggedConnectivity = stats;
+  }
+
+  if (this->timers->Enabled())
+  {
+    uint64_t ns[TIMER_COUNT];
+    auto timings = _logEntry.mutable_timings();
+    timings->set_steps(this->timers->Collect(ns));
+    timings->set_comms_model(ns[TIMER_COMMS_MODEL]);
+    timings->set_notify_neighbors(ns[TIMER_NOTIFY_NEIGHBORS]);
+    timings->set_dispatch(ns[TIMER_DISPATCH]);
+    timings->set_delivery(ns[TIMER_DELIVERY]);
+    timings->set_logger(ns[TIMER_LOGGER]);
+    timings->set_poses(ns[TIMER_POSES]);
+    timings->set_sensors(ns[TIMER_SENSORS]);
+    timings->set_controllers(ns[TIMER_CONTROLLERS]);
+    timings->set_actuation(ns[TIMER_ACTUATION]);
+  }
 }
 
 //////////////////////////////////////////////////
@@ -328,19 +1424,198 @@ void BrokerPlugin::OnLog(msgs::LogEntry &_logEntry) const
   // Our logging contribution:
   //   * Visibility information of all the nodes.
   //   * Incoming messages.
-  _logEntry.mutable_visibility()->CopyFrom(this->commsModel->VisibilityMap());
+  if (this->logger->VisibilityDelta())
+  {
+    // Each chunk of a rotated log starts with a keyframe, so it's parsed on
+    // its own.
+    if (this->loggedChunk != this->logger->Chunk())
+      this->loggedVisibilityDeltas = 0;
+    this->loggedChunk = this->logger->Chunk();
+
+    const bool keyframe = this->loggedVisibilityDeltas == 0;
+    this->loggedVisibilityDeltas =
+      (this->loggedVisibilityDeltas + 1) % kVisibilityKeyframePeriod;
+    this->commsModel->FillVisibilityDelta(keyframe, this->loggedVisibility,
+        *_logEntry.mutable_visibility_delta());
+  }
+  else
+    this->commsModel->FillVisibilityMap(*_logEntry.mutable_visibility());
   _logEntry.mutable_incoming_msgs()->CopyFrom(this->logIncomingMsgs);
+  this->commsModel->TakeFidelityChanges(*_logEntry.mutable_comms_fidelity());
+  this->loggedNeighbors = this->commsModel->AvgNeighbors();
+}
+
+//////////////////////////////////////////////////
+bool BrokerPlugin::LogChanged() const
+{
+  return std::abs(this->commsModel->AvgNeighbors() - this->loggedNeighbors) >=
+    kNeighborsChange || this->commsModel->FidelityChanged();
+}
+
+//////////////////////////////////////////////////
+void BrokerPlugin::OnSave(msgs::CheckpointPart &_part) const
+{
+  msgs::BrokerState *state = _part.mutable_broker();
+  state->set_step(this->step);
+
+  // The messages sent in this step wait for the next dispatch.
+  for (auto const &msg : this->broker->Messages())
+    state->add_incoming()->CopyFrom(*msg);
+
+  // Keep the order of arrival of the messages in flight.
+  std::vector<std::pair<uint64_t, const Delivery *>> inFlight;
+  this->deliveries.ForEach(
+      [&inFlight](const uint64_t _step, const Delivery &_delivery)
+      {
+        inFlight.emplace_back(_step, &_delivery);
+      });
+  std::stable_sort(inFlight.begin(), inFlight.end(),
+      [](const std::pair<uint64_t, const Delivery *> &_a,
+         const std::pair<uint64_t, const Delivery *> &_b)
+      {
+        return _a.first < _b.first;
+      });
+  for (auto const &entry : inFlight)
+  {
+    msgs::Delivery *delivery = state->add_delivery();
+    delivery->set_step(entry.first);
+    delivery->set_address(entry.second->address);
+    delivery->set_callback(entry.second->callback);
+    delivery->mutable_datagram()->CopyFrom(*entry.second->msg);
+  }
+
+  state->set_rnd_engine(std::to_string(this->dispatchSeed));
+
+  this->commsModel->Save(*state->mutable_comms());
+}
+
+//////////////////////////////////////////////////
+bool BrokerPlugin::OnRestore(const msgs::CheckpointPart &_part)
+{
+  if (!_part.has_broker())
+    return false;
+
+  const msgs::BrokerState &state = _part.broker();
+  if (!this->commsModel->Restore(state.comms()))
+    return false;
+
+  this->step = state.step();
+
+  // The messages sent in the first step of this simulation are replaced.
+  auto &incoming = this->broker->Messages();
+  incoming.clear();
+  for (auto const &msg : state.incoming())
+    incoming.push_back(std::make_shared<msgs::Datagram>(msg));
+
+  // The clients unregistered meanwhile don't get their messages.
+  this->deliveries.Clear(this->step);
+  const auto &clients = this->broker->Clients();
+  for (auto const &delivery : state.delivery())
+  {
+    const auto client = clients.find(delivery.address());
+    if (client == clients.end())
+      continue;
+
+    this->deliveries.Schedule(delivery.step(),
+        {std::make_shared<msgs::Datagram>(delivery.datagram()),
+         delivery.address(), client->second, delivery.callback()});
+  }
+
+  this->dispatchSeed = std::strtoull(state.rnd_engine().c_str(), nullptr, 10);
+
+  // The robots restore the neighbors they were notified.
+  const unsigned int numMembers = this->swarm->size();
+  this->notifiedVersions.resize(numMembers);
+  for (unsigned int idx = 0; idx < numMembers; ++idx)
+    this->notifiedVersions[idx] = this->commsModel->NeighborsVersion(idx);
+  this->trackedVersions.clear();
+
+  // The next entry of the log is a keyframe.
+  this->logIncomingMsgs.Clear();
+  this->loggedVisibility.clear();
+  this->loggedVisibilityDeltas = 0;
+  this->nextTelemetryTime = 0;
+  return true;
+}
+
+//////////////////////////////////////////////////
+void BrokerPlugin::OnMemory(MemoryReport &_report) const
+{
+  this->broker->OnMemory(_report);
+
+  // The messages in flight, with the slots of the wheel.
+  uint64_t bytes = TimingWheel<Delivery>::kLevels *
+    TimingWheel<Delivery>::kSlots * sizeof(std::vector<Delivery>) +
+    this->deliveries.Size() * sizeof(Delivery);
+  this->deliveries.ForEach(
+      [&bytes](const uint64_t /*_step*/, const Delivery &_delivery)
+      {
+        bytes += HeapBytes(_delivery.address) + _delivery.msg->SpaceUsed();
+      });
+
+  bytes += HeapBytes(this->outgoing) + HeapBytes(this->senderBits) +
+    HeapBytes(this->saturatedAt) + HeapBytes(this->notifiedVersions) +
+    HeapBytes(this->trackedVersions) +
+    HeapBytes(this->arrivals) + HeapBytes(this->loggedVisibility) +
+    HeapBytes(this->logIncomingMsgs) + SharedMessagesBytes(this->remoteMsgs) +
+    HeapBytes(this->partitionFrames) + HeapBytes(this->partitionState) +
+    HeapBytes(this->frameBuffer) + HeapBytes(this->receivedFrames) +
+    HeapBytes(this->endpointMembers) + HeapBytes(this->recipients);
+  for (auto const &members : this->endpointMembers)
+  {
+    bytes += HeapBytes(members.ids) + HeapBytes(members.slots) +
+      HeapBytes(members.bits) + HeapBytes(members.ranks);
+  }
+  for (auto const &peer : this->partitionFrames)
+    bytes += HeapBytes(peer.first) + HeapBytes(peer.second);
+
+  _report.Add("broker", bytes, this->deliveries.Size() +
+      this->outgoing.size() + this->remoteMsgs.size());
+
+  // The datagrams released by the robots and the broker, kept for reuse.
+  const msgs::DatagramPool &pool = msgs::DatagramPool::Instance();
+  _report.Add("datagram_pool", pool.IdleBytes(), pool.Idle());
+
+  this->commsModel->OnMemory(_report);
+  this->connectivity.OnMemory(_report);
+}
+
+//////////////////////////////////////////////////
+void BrokerPlugin::PrintMemory() const
+{
+  const MemoryReport report = this->memory->Collect();
+  gzmsg << "Memory of the world [" << this->world->GetName() << "] at "
+        << this->world->GetSimTime().Double() << " s:" << std::endl;
+  report.Print(gzmsg);
+
+  uint64_t hits, misses;
+  if (this->commsModel->VisibilityTileStats(hits, misses))
+  {
+    gzmsg << "Visibility tiles: " << hits << " hits, " << misses
+          << " misses" << std::endl;
+  }
 }
 
 //////////////////////////////////////////////////
 void BrokerPlugin::Reset()
 {
+  this->dispatchSeed = ignition::math::Rand::Seed();
   this->logger->Reset();
   this->logIncomingMsgs.Clear();
   this->broker->Reset();
+  this->notifiedVersions.clear();
+  this->remoteMsgs.clear();
+  this->deliveries.Clear(0);
+  for (auto &peer : this->partitionFrames)
+    peer.second.Clear();
 
-  // Recreate the comms model
-  this->commsModel.reset(new CommsModel(this->swarm, this->world, this->sdf));
+  // Restart the comms model, keeping its tables.
+  this->commsModel->Reset();
+  this->loggedVisibility.clear();
+  this->loggedVisibilityDeltas = 0;
+  this->loggedNeighbors = 0;
+  this->trackedVersions.clear();
+  this->nextTelemetryTime = 0;
 
   // Create a new log file.
   auto maxStepSize = this->world->GetPhysicsEngine()->GetMaxStepSize();
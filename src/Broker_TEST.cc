@@ -15,6 +15,8 @@
  *
 */
 
+#include <memory>
+#include <vector>
 #include "gtest/gtest.h"
 #include "msgs/datagram.pb.h"
 #include "swarm/Broker.hh"
@@ -34,7 +36,8 @@ class Client : public RobotPlugin
   }
 
   // Documentation inherited.
-  void OnMsgReceived(const msgs::Datagram &/*_msg*/) const
+  void OnMsgReceived(const DatagramPtr &/*_msg*/,
+                     const unsigned int /*_callback*/) const
   {
   }
 
@@ -83,6 +86,27 @@ TEST(brokerTest, Broker)
   ASSERT_TRUE(endpoints.find(endPoint2) != endpoints.end());
   EXPECT_EQ(endpoints.at(endPoint2).size(), 1u);
 
+  // Endpoints are interned into consecutive handles.
+  const EndPointId id1 = broker->Intern(endPoint1);
+  const EndPointId id2 = broker->Intern(client2.id, port);
+  EXPECT_NE(id1, id2);
+  EXPECT_EQ(broker->Intern(client1.id, port), id1);
+  EXPECT_EQ(broker->Intern(endPoint2), id2);
+  ASSERT_EQ(broker->EndPointClients(id1).size(), 1u);
+  EXPECT_EQ(broker->EndPointClients(id1)[0].address, client1.id);
+  EXPECT_EQ(broker->EndPointClients(id2).size(), 1u);
+
+  const EndPointId unbound = broker->Intern("192.168.3.3", port);
+  EXPECT_TRUE(broker->EndPointClients(unbound).empty());
+  EXPECT_TRUE(broker->EndPointClients(unbound + 1000).empty());
+
+  // The versions change with the clients bound.
+  EXPECT_EQ(broker->EndPointVersion(unbound), 0u);
+  EXPECT_EQ(broker->EndPointVersion(unbound + 1000), 0u);
+  const uint64_t version1 = broker->EndPointVersion(id1);
+  const uint64_t version2 = broker->EndPointVersion(id2);
+  EXPECT_GT(version1, 0u);
+
   // Push.
   msgs::Datagram msg;
   msg.set_src_address(client1.id);
@@ -93,15 +117,90 @@ TEST(brokerTest, Broker)
   broker2->Push(msg);
   EXPECT_EQ(broker->Messages().size(), 2u);
 
+  // Shared messages are queued without a copy.
+  DatagramPtr sharedMsg = std::make_shared<const msgs::Datagram>(msg);
+  broker1->Push(sharedMsg);
+  ASSERT_EQ(broker->Messages().size(), 3u);
+  EXPECT_EQ(broker->Messages().back(), sharedMsg);
+  EXPECT_EQ(broker->Messages().front()->data(), "some data");
+
+  // The handle of the destination is set when it's missing.
+  ASSERT_TRUE(broker->Messages().front()->has_dst_endpoint());
+  EXPECT_EQ(broker->Messages().front()->dst_endpoint(), id2);
+
+  // A batch is queued in order.
+  std::vector<DatagramPtr> batch = {sharedMsg,
+    std::make_shared<const msgs::Datagram>(msg), sharedMsg};
+  const DatagramPtr second = batch[1];
+  broker1->Push(batch);
+  ASSERT_EQ(broker->Messages().size(), 6u);
+  EXPECT_EQ(broker->Messages()[3], sharedMsg);
+  EXPECT_EQ(broker->Messages()[4], second);
+  EXPECT_EQ(broker->Messages()[5], sharedMsg);
+
   // Unregister the clients.
   EXPECT_TRUE(broker1->Unregister(client1.id));
   EXPECT_TRUE(broker2->Unregister(client2.id));
 
+  EXPECT_TRUE(broker->EndPointClients(id1).empty());
+  EXPECT_TRUE(broker->EndPointClients(id2).empty());
+  EXPECT_NE(broker->EndPointVersion(id1), version1);
+  EXPECT_NE(broker->EndPointVersion(id2), version2);
+  EXPECT_EQ(broker->EndPointVersion(unbound), 0u);
+
   // Try to unregister clients that are not registered anymore.
   EXPECT_FALSE(broker1->Unregister(client1.id));
   EXPECT_FALSE(broker2->Unregister(client2.id));
 }
 
+//////////////////////////////////////////////////
+/// \brief Check that each world has its own broker.
+TEST(brokerTest, Worlds)
+{
+  Broker *brokerA = Broker::Instance("worldA");
+  Broker *brokerB = Broker::Instance("worldB");
+  EXPECT_NE(brokerA, brokerB);
+  EXPECT_EQ(brokerA, Broker::Instance("worldA"));
+  EXPECT_EQ(Broker::Instance(), Broker::Instance(""));
+
+  Client client("192.168.3.10");
+  EXPECT_TRUE(brokerA->Register(client.id, &client));
+  EXPECT_EQ(brokerA->Clients().size(), 1u);
+  EXPECT_TRUE(brokerB->Clients().empty());
+
+  // The same address can be used in another world.
+  EXPECT_TRUE(brokerB->Register(client.id, &client));
+  EXPECT_TRUE(brokerA->Unregister(client.id));
+  EXPECT_TRUE(brokerB->Unregister(client.id));
+}
+
+//////////////////////////////////////////////////
+/// \brief Check the members and the positions shared with the robots.
+TEST(brokerTest, Positions)
+{
+  Broker *broker = Broker::Instance("worldPositions");
+  EXPECT_EQ(broker->MemberIndex("192.168.3.1"), -1);
+  EXPECT_TRUE(broker->Positions().empty());
+
+  const uint64_t version = broker->MembersVersion();
+  broker->SetMembers({"192.168.3.1", "192.168.3.2"});
+  EXPECT_NE(broker->MembersVersion(), version);
+  EXPECT_EQ(broker->MemberIndex("192.168.3.1"), 0);
+  EXPECT_EQ(broker->MemberIndex("192.168.3.2"), 1);
+  EXPECT_EQ(broker->MemberIndex("192.168.3.3"), -1);
+
+  broker->SetPositions({ignition::math::Vector3d(1, 2, 3),
+      ignition::math::Vector3d(-4, 5, 6)});
+  ASSERT_EQ(broker->Positions().size(), 2u);
+  EXPECT_EQ(broker->Positions()[1], ignition::math::Vector3d(-4, 5, 6));
+
+  // The positions of the previous members are dropped.
+  broker->SetMembers({"192.168.3.3"});
+  EXPECT_EQ(broker->MemberIndex("192.168.3.1"), -1);
+  EXPECT_EQ(broker->MemberIndex("192.168.3.3"), 0);
+  EXPECT_TRUE(broker->Positions().empty());
+}
+
 //////////////////////////////////////////////////
 int main(int argc, char **argv)
 {
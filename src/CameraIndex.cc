@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <gazebo/common/Console.hh>
+#include <gazebo/physics/physics.hh>
+#include <ignition/math/Angle.hh>
+#include <ignition/math/Frustum.hh>
+#include "swarm/CameraIndex.hh"
+#include "swarm/SceneIndex.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+CameraIndex *CameraIndex::Instance(gazebo::physics::WorldPtr _world)
+{
+  static std::mutex mutex;
+  static std::map<std::string, std::unique_ptr<CameraIndex>> instances;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  std::unique_ptr<CameraIndex> &instance = instances[_world->GetName()];
+  if (!instance)
+    instance.reset(new CameraIndex(_world));
+  return instance.get();
+}
+
+//////////////////////////////////////////////////
+CameraIndex::CameraIndex(gazebo::physics::WorldPtr _world)
+  : scene(SceneIndex::Instance(_world))
+{
+  const std::vector<std::string> &names = this->scene->ModelNames();
+  this->models.resize(names.size());
+  this->boxes.resize(names.size());
+  this->poses.resize(names.size());
+
+  for (unsigned int i = 0; i < names.size(); ++i)
+  {
+    this->models[i] = _world->GetModel(names[i]);
+    if (!this->models[i])
+      continue;
+
+    if (this->models[i]->IsStatic())
+    {
+      this->boxes[i] = this->models[i]->GetBoundingBox().Ign();
+      this->poses[i] = this->models[i]->GetWorldPose().Ign();
+      this->staticGrid.Add(i, this->boxes[i]);
+    }
+    else
+      this->moving.push_back(i);
+  }
+
+  gzmsg << "Camera index of world [" << _world->GetName() << "]: "
+        << this->staticGrid.Size() << " static models, "
+        << this->moving.size() << " moving models" << std::endl;
+}
+
+//////////////////////////////////////////////////
+void CameraIndex::Capture(const gazebo::common::Time &_simTime)
+{
+  if (this->captured && this->captureTime == _simTime)
+    return;
+
+  this->movingGrid.Clear();
+  for (const unsigned int i : this->moving)
+  {
+    this->boxes[i] = this->models[i]->GetBoundingBox().Ign();
+    this->poses[i] = this->models[i]->GetWorldPose().Ign();
+    this->movingGrid.Add(i, this->boxes[i]);
+  }
+
+  this->captureTime = _simTime;
+  this->captured = true;
+}
+
+//////////////////////////////////////////////////
+void CameraIndex::Observe(const ignition::math::Pose3d &_pose,
+    const double _near, const double _far, const double _hfov,
+    const double _aspectRatio, const int _exclude,
+    std::vector<CameraObject> &_objects) const
+{
+  _objects.clear();
+
+  // The corners of the far plane are the points of the frustum furthest
+  // from the camera.
+  const double tanX = std::tan(_hfov * 0.5);
+  const double tanY = _aspectRatio > 0 ? tanX / _aspectRatio : tanX;
+  const double reach = _far * std::sqrt(1 + tanX * tanX + tanY * tanY);
+  const ignition::math::Vector3d extent(reach, reach, reach);
+  const ignition::math::Box region(_pose.Pos() - extent,
+      _pose.Pos() + extent);
+
+  std::vector<unsigned int> candidates;
+  std::vector<unsigned int> movingCandidates;
+  this->staticGrid.Query(region, candidates);
+  this->movingGrid.Query(region, movingCandidates);
+  candidates.insert(candidates.end(), movingCandidates.begin(),
+      movingCandidates.end());
+
+  // Report the models in the order of the world, as the sensor does.
+  std::sort(candidates.begin(), candidates.end());
+
+  const ignition::math::Frustum frustum(_near, _far,
+      ignition::math::Angle(_hfov), _aspectRatio, _pose);
+  for (const unsigned int i : candidates)
+  {
+    if (!this->models[i] || static_cast<int>(i) == _exclude ||
+        !frustum.Contains(this->boxes[i]))
+    {
+      continue;
+    }
+    _objects.push_back(CameraObject(i, this->poses[i] - _pose));
+  }
+}
+
+//////////////////////////////////////////////////
+size_t CameraIndex::Size() const
+{
+  return this->staticGrid.Size() + this->moving.size();
+}
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "msgs/checkpoint.pb.h"
+#include "swarm/Checkpointer.hh"
+#include "swarm/LogFormat.hh"
+
+using namespace swarm;
+
+const char Checkpointer::kCheckpointMagic[] = "SWCKP001";
+
+//////////////////////////////////////////////////
+Checkpointer *Checkpointer::Instance(const std::string &_world)
+{
+  static std::mutex mutex;
+  static std::map<std::string, std::unique_ptr<Checkpointer>> instances;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  std::unique_ptr<Checkpointer> &instance = instances[_world];
+  if (!instance)
+    instance.reset(new Checkpointer());
+  return instance.get();
+}
+
+//////////////////////////////////////////////////
+bool Checkpointer::Register(const std::string &_id, Checkpointable *_client)
+{
+  if (this->clients.find(_id) != this->clients.end())
+  {
+    std::cerr << "Checkpointer::Register() error: ID [" << _id
+              << "] already exists" << std::endl;
+    return false;
+  }
+
+  this->clients[_id] = _client;
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool Checkpointer::Unregister(const std::string &_id)
+{
+  if (this->clients.erase(_id) != 1)
+  {
+    std::cerr << "Checkpointer::Unregister() error: ID [" << _id
+              << "] doesn't exist" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//////////////////////////////////////////////////
+void Checkpointer::Save(msgs::Checkpoint &_checkpoint) const
+{
+  for (auto const &client : this->clients)
+  {
+    msgs::CheckpointPart *part = _checkpoint.add_part();
+    part->set_id(client.first);
+    client.second->OnSave(*part);
+  }
+}
+
+//////////////////////////////////////////////////
+bool Checkpointer::Restore(const msgs::Checkpoint &_checkpoint)
+{
+  std::map<std::string, const msgs::CheckpointPart *> parts;
+  for (auto const &part : _checkpoint.part())
+    parts[part.id()] = &part;
+
+  bool restored = true;
+  for (auto const &client : this->clients)
+  {
+    auto part = parts.find(client.first);
+    if (part == parts.end())
+    {
+      std::cerr << "Checkpointer::Restore() error: No state for ID ["
+                << client.first << "]" << std::endl;
+      restored = false;
+      continue;
+    }
+
+    if (!client.second->OnRestore(*part->second))
+    {
+      std::cerr << "Checkpointer::Restore() error: Unable to restore ID ["
+                << client.first << "]" << std::endl;
+      restored = false;
+    }
+  }
+  return restored;
+}
+
+//////////////////////////////////////////////////
+void Checkpointer::RequestSave(const std::string &_path)
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->requests.emplace_back(_path, false);
+}
+
+//////////////////////////////////////////////////
+void Checkpointer::RequestRestore(const std::string &_path)
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->requests.emplace_back(_path, true);
+}
+
+//////////////////////////////////////////////////
+bool Checkpointer::TakeRequest(std::string &_path, bool &_restore)
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (this->requests.empty())
+    return false;
+
+  _path = this->requests.front().first;
+  _restore = this->requests.front().second;
+  this->requests.erase(this->requests.begin());
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool Checkpointer::Write(const std::string &_path,
+    const msgs::Checkpoint &_checkpoint)
+{
+  std::string raw;
+  std::string compressed;
+  if (!_checkpoint.SerializeToString(&raw) ||
+      !CompressLogBlock(raw, compressed))
+  {
+    std::cerr << "Checkpointer: Unable to serialize the checkpoint"
+              << std::endl;
+    return false;
+  }
+
+  // The file is complete once renamed, so a run killed while writing it
+  // doesn't leave a truncated checkpoint behind.
+  const std::string tmpPath = _path + ".tmp";
+  std::ofstream output(tmpPath, std::ios::binary | std::ios::trunc);
+  const uint32_t rawSize = static_cast<uint32_t>(raw.size());
+  output.write(kCheckpointMagic, kCheckpointMagicSize);
+  output.write(reinterpret_cast<const char *>(&rawSize), sizeof(rawSize));
+  output.write(compressed.data(), compressed.size());
+  output.close();
+  if (!output || std::rename(tmpPath.c_str(), _path.c_str()) != 0)
+  {
+    std::cerr << "Checkpointer: Unable to write [" << _path << "]"
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool Checkpointer::Read(const std::string &_path,
+    msgs::Checkpoint &_checkpoint)
+{
+  std::ifstream input(_path, std::ios::binary);
+  std::string data((std::istreambuf_iterator<char>(input)),
+      std::istreambuf_iterator<char>());
+  const size_t headerSize = kCheckpointMagicSize + sizeof(uint32_t);
+  if (!input.good() && !input.eof())
+    data.clear();
+  if (data.size() < headerSize ||
+      data.compare(0, kCheckpointMagicSize, kCheckpointMagic) != 0)
+  {
+    std::cerr << "Checkpointer: [" << _path << "] is not a checkpoint"
+              << std::endl;
+    return false;
+  }
+
+  uint32_t rawSize;
+  std::memcpy(&rawSize, data.data() + kCheckpointMagicSize, sizeof(rawSize));
+  std::string raw;
+  if (!DecompressLogBlock(data.data() + headerSize, data.size() - headerSize,
+        rawSize, raw) || !_checkpoint.ParseFromString(raw))
+  {
+    std::cerr << "Checkpointer: [" << _path << "] is corrupted" << std::endl;
+    return false;
+  }
+  return true;
+}
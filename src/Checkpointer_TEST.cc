@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <unistd.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include "gtest/gtest.h"
+#include "msgs/checkpoint.pb.h"
+#include "swarm/Checkpointer.hh"
+
+using namespace swarm;
+
+/// \brief A client whose state is the step of its executor part.
+class StepClient : public Checkpointable
+{
+  // Documentation inherited.
+  public: virtual void OnSave(msgs::CheckpointPart &_part) const
+  {
+    _part.mutable_executor()->set_last_step(this->step);
+  }
+
+  // Documentation inherited.
+  public: virtual bool OnRestore(const msgs::CheckpointPart &_part)
+  {
+    if (!_part.has_executor())
+      return false;
+    this->step = _part.executor().last_step();
+    return true;
+  }
+
+  /// \brief The state.
+  public: uint64_t step = 0;
+};
+
+//////////////////////////////////////////////////
+/// \brief Path of a temporary file.
+/// \param[in] _name Name of the file.
+/// \return The path.
+static std::string tmpPath(const std::string &_name)
+{
+  return "/tmp/checkpointer_test_" + std::to_string(getpid()) + "_" + _name;
+}
+
+//////////////////////////////////////////////////
+TEST(CheckpointerTest, Register)
+{
+  Checkpointer *checkpointer = Checkpointer::Instance("register");
+  EXPECT_EQ(checkpointer, Checkpointer::Instance("register"));
+  EXPECT_NE(checkpointer, Checkpointer::Instance("other"));
+
+  StepClient client;
+  EXPECT_TRUE(checkpointer->Register("a", &client));
+  EXPECT_FALSE(checkpointer->Register("a", &client));
+  EXPECT_TRUE(checkpointer->Unregister("a"));
+  EXPECT_FALSE(checkpointer->Unregister("a"));
+}
+
+//////////////////////////////////////////////////
+TEST(CheckpointerTest, SaveRestore)
+{
+  Checkpointer *checkpointer = Checkpointer::Instance("save_restore");
+  StepClient a;
+  StepClient b;
+  checkpointer->Register("b", &b);
+  checkpointer->Register("a", &a);
+  a.step = 10;
+  b.step = 20;
+
+  msgs::Checkpoint checkpoint;
+  checkpoint.set_world("save_restore");
+  checkpoint.set_sim_time(1.5);
+  checkpoint.set_seed(7);
+  checkpointer->Save(checkpoint);
+  ASSERT_EQ(checkpoint.part_size(), 2);
+  EXPECT_EQ(checkpoint.part(0).id(), "a");
+  EXPECT_EQ(checkpoint.part(1).id(), "b");
+
+  const std::string path = tmpPath("save_restore");
+  ASSERT_TRUE(Checkpointer::Write(path, checkpoint));
+
+  a.step = 0;
+  b.step = 0;
+  msgs::Checkpoint read;
+  ASSERT_TRUE(Checkpointer::Read(path, read));
+  EXPECT_EQ(read.world(), "save_restore");
+  EXPECT_DOUBLE_EQ(read.sim_time(), 1.5);
+  EXPECT_TRUE(checkpointer->Restore(read));
+  EXPECT_EQ(a.step, 10u);
+  EXPECT_EQ(b.step, 20u);
+
+  // A client missing from the checkpoint keeps its state, the others are
+  // restored anyway.
+  StepClient c;
+  c.step = 30;
+  checkpointer->Register("c", &c);
+  a.step = 0;
+  EXPECT_FALSE(checkpointer->Restore(read));
+  EXPECT_EQ(a.step, 10u);
+  EXPECT_EQ(c.step, 30u);
+
+  checkpointer->Unregister("a");
+  checkpointer->Unregister("b");
+  checkpointer->Unregister("c");
+  std::remove(path.c_str());
+}
+
+//////////////////////////////////////////////////
+TEST(CheckpointerTest, Corrupted)
+{
+  msgs::Checkpoint checkpoint;
+  EXPECT_FALSE(Checkpointer::Read(tmpPath("missing"), checkpoint));
+
+  const std::string path = tmpPath("corrupted");
+  {
+    std::ofstream output(path, std::ios::binary);
+    output << "not a checkpoint";
+  }
+  EXPECT_FALSE(Checkpointer::Read(path, checkpoint));
+
+  // A valid header followed by garbage.
+  {
+    std::ofstream output(path, std::ios::binary);
+    output.write(Checkpointer::kCheckpointMagic,
+        Checkpointer::kCheckpointMagicSize);
+    const uint32_t size = 100;
+    output.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    output << "garbage";
+  }
+  EXPECT_FALSE(Checkpointer::Read(path, checkpoint));
+  std::remove(path.c_str());
+}
+
+//////////////////////////////////////////////////
+TEST(CheckpointerTest, Requests)
+{
+  Checkpointer *checkpointer = Checkpointer::Instance("requests");
+  std::string path;
+  bool restore = false;
+  EXPECT_FALSE(checkpointer->TakeRequest(path, restore));
+
+  checkpointer->RequestSave("a.ckpt");
+  checkpointer->RequestRestore("b.ckpt");
+  EXPECT_TRUE(checkpointer->TakeRequest(path, restore));
+  EXPECT_EQ(path, "a.ckpt");
+  EXPECT_FALSE(restore);
+  EXPECT_TRUE(checkpointer->TakeRequest(path, restore));
+  EXPECT_EQ(path, "b.ckpt");
+  EXPECT_TRUE(restore);
+  EXPECT_FALSE(checkpointer->TakeRequest(path, restore));
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
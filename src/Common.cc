@@ -15,13 +15,121 @@
  *
 */
 
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 #include <ignition/math.hh>
 #include <gazebo/math/gzmath.hh>
+#include <gazebo/common/SphericalCoordinates.hh>
 #include <gazebo/physics/physics.hh>
 #include "swarm/Common.hh"
 
 using namespace swarm;
 
+/// \brief Side of the cells of the terrain raster (m).
+static const double kTerrainCellSize = 1.0;
+
+/// \brief Distance around a vehicle whose terrain tiles are prefetched (m).
+static const double kTerrainPrefetchRadius = 50.0;
+
+/// \brief How far ahead the terrain tiles are prefetched along the
+/// velocity of a vehicle (s).
+static const double kTerrainPrefetchHorizon = 5.0;
+
+//////////////////////////////////////////////////
+/// \brief Get the type of terrain of a model from its name.
+/// \param[in] _name Name of the model.
+/// \return FOREST for trees, BUILDING for buildings, PLAIN otherwise.
+static TerrainType terrainOfModel(const std::string &_name)
+{
+  if (_name.find("tree") != std::string::npos)
+    return TerrainType::FOREST;
+  if (_name.find("building") != std::string::npos)
+    return TerrainType::BUILDING;
+  return TerrainType::PLAIN;
+}
+
+//////////////////////////////////////////////////
+/// \brief Get the terrain raster of a world, building it the first time.
+/// The trees and buildings are static, so the raster is built once and
+/// shared by all the plugins of the world.
+/// \param[in] _world The world.
+/// \return The raster.
+static std::shared_ptr<const TerrainRaster> terrainRasterOf(
+    gazebo::physics::WorldPtr _world)
+{
+  static std::mutex mutex;
+  static std::map<std::string, std::shared_ptr<const TerrainRaster>> rasters;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &raster = rasters[_world->GetName()];
+  if (raster)
+    return raster;
+
+  // A raster built by a previous run of the same world is reused.
+  const std::shared_ptr<const SceneIndex> scene = SceneIndex::Instance(_world);
+  auto newRaster = std::make_shared<TerrainRaster>();
+  if (scene->Cache())
+  {
+    scene->Cache()->Raster(*newRaster);
+    gzmsg << "Terrain raster of world [" << _world->GetName() << "]: "
+          << newRaster->Columns() << "x" << newRaster->Rows() << " cells, "
+          << "from the world cache" << std::endl;
+    raster = newRaster;
+    return raster;
+  }
+
+  // The boxes of the trees and the buildings, and the area they cover.
+  std::vector<std::pair<ignition::math::Box, TerrainType>> boxes;
+  for (auto const &box : scene->TreeBoxes())
+    boxes.push_back(std::make_pair(box, TerrainType::FOREST));
+  for (auto const &box : scene->BuildingBoxes())
+    boxes.push_back(std::make_pair(box, TerrainType::BUILDING));
+
+  ignition::math::Vector3d min(0, 0, 0);
+  ignition::math::Vector3d max(0, 0, 0);
+  for (size_t i = 0; i < boxes.size(); ++i)
+  {
+    if (i == 0)
+    {
+      min = boxes[i].first.Min();
+      max = boxes[i].first.Max();
+    }
+    else
+    {
+      min.Min(boxes[i].first.Min());
+      max.Max(boxes[i].first.Max());
+    }
+  }
+
+  newRaster->Reset(min, max, kTerrainCellSize);
+
+  // The bounding boxes are aligned to the global axis, so each cell is
+  // classified by the model found below it by a ray cast.
+  for (auto const &box : boxes)
+  {
+    const TerrainType fallback = box.second;
+    newRaster->Add(box.first.Min(), box.first.Max(),
+        [&_world, fallback](const ignition::math::Vector3d &_pos)
+        {
+          const gazebo::physics::ModelPtr rayModel =
+            _world->GetModelBelowPoint(
+                gazebo::math::Vector3(_pos.X(), _pos.Y(), 1000));
+          return rayModel ? terrainOfModel(rayModel->GetName()) : fallback;
+        });
+  }
+
+  gzmsg << "Terrain raster of world [" << _world->GetName() << "]: "
+        << newRaster->Columns() << "x" << newRaster->Rows() << " cells, "
+        << boxes.size() << " trees and buildings" << std::endl;
+
+  scene->StoreCache(*newRaster);
+  raster = newRaster;
+  return raster;
+}
+
 //////////////////////////////////////////////////
 Common::Common()
   : searchMinLatitude(0),
@@ -86,6 +194,85 @@ bool Common::LoadSphericalCoordinates(sdf::ElementPtr _sphericalCoordsSDF)
   return false;
 }
 
+//////////////////////////////////////////////////
+bool Common::LoadWorldSearchArea(sdf::ElementPtr _worldSDF)
+{
+  if (!_worldSDF || !_worldSDF->HasElement("model"))
+    return false;
+
+  // GetElement() would create the elements that are missing, so always
+  // check with HasElement() first.
+  sdf::ElementPtr modelSDF = _worldSDF->GetElement("model");
+  while (modelSDF)
+  {
+    sdf::ElementPtr pluginSDF;
+    if (modelSDF->HasElement("plugin"))
+      pluginSDF = modelSDF->GetElement("plugin");
+
+    while (pluginSDF)
+    {
+      if (pluginSDF->HasElement("swarm_search_area") &&
+          this->LoadSearchArea(pluginSDF->GetElement("swarm_search_area")))
+      {
+        return _worldSDF->HasElement("spherical_coordinates") &&
+          this->LoadSphericalCoordinates(
+              _worldSDF->GetElement("spherical_coordinates"));
+      }
+      pluginSDF = pluginSDF->GetNextElement("plugin");
+    }
+    modelSDF = modelSDF->GetNextElement("model");
+  }
+
+  return false;
+}
+
+//////////////////////////////////////////////////
+bool Common::SearchAreaBounds(ignition::math::Vector3d &_min,
+    ignition::math::Vector3d &_max) const
+{
+  if (!this->world)
+    return false;
+
+  return this->SearchAreaBounds(*this->world->GetSphericalCoordinates(),
+      _min, _max);
+}
+
+//////////////////////////////////////////////////
+bool Common::SearchAreaBounds(
+    const gazebo::common::SphericalCoordinates &_sphericalCoords,
+    ignition::math::Vector3d &_min, ignition::math::Vector3d &_max) const
+{
+  if (this->searchMinLatitude >= this->searchMaxLatitude ||
+      this->searchMinLongitude >= this->searchMaxLongitude)
+  {
+    return false;
+  }
+
+  // Convert the four corners, the search area might not be aligned with
+  // the world axes.
+  const double lats[2] = {this->searchMinLatitude, this->searchMaxLatitude};
+  const double lons[2] = {this->searchMinLongitude, this->searchMaxLongitude};
+  for (int i = 0; i < 4; ++i)
+  {
+    ignition::math::Vector3d corner = _sphericalCoords.GlobalFromLocal(
+        _sphericalCoords.LocalFromSpherical(
+          ignition::math::Vector3d(lats[i / 2], lons[i % 2], 0)));
+
+    if (i == 0)
+    {
+      _min = corner;
+      _max = corner;
+    }
+    else
+    {
+      _min.Min(corner);
+      _max.Max(corner);
+    }
+  }
+
+  return true;
+}
+
 //////////////////////////////////////////////////
 void Common::SearchArea(double &_minLatitude,
                         double &_maxLatitude,
@@ -157,12 +344,20 @@ bool Common::MapQuery(const double _lat, const double _lon,
     return false;
   }
 
-  // Get the location in the local coordinate frame
-  ignition::math::Vector3d local =
-    this->world->GetSphericalCoordinates()->LocalFromSpherical(
+  // Get the location in the world coordinate frame
+  ignition::math::Vector3d local;
+  if (this->projection.Valid())
+  {
+    double x, y;
+    this->projection.Project(_lat, _lon, x, y);
+    local.Set(x, y, 0);
+  }
+  else
+  {
+    local = this->world->GetSphericalCoordinates()->LocalFromSpherical(
         ignition::math::Vector3d(_lat, _lon, 0));
-
-  local = this->world->GetSphericalCoordinates()->GlobalFromLocal(local);
+    local = this->world->GetSphericalCoordinates()->GlobalFromLocal(local);
+  }
 
   ignition::math::Vector3d pos, norm;
 
@@ -180,254 +375,165 @@ bool Common::MapQuery(const double _lat, const double _lon,
 }
 
 //////////////////////////////////////////////////
-void Common::TerrainLookup(const ignition::math::Vector3d &_pos,
-    ignition::math::Vector3d &_terrainPos,
-    ignition::math::Vector3d &_norm) const
+size_t Common::MapQuery(const size_t _count, const double *_lat,
+    const double *_lon, double *_height, TerrainType *_type, bool *_valid)
 {
-  if (!this->terrain)
-    return;
-
-  // The robot position in the coordinate frame of the terrain
-  ignition::math::Vector3d robotPos(
-      (this->terrainSize.X() * 0.5 + _pos.X()) / this->terrainScaling.X(),
-      (this->terrainSize.Y() * 0.5 - _pos.Y()) / this->terrainScaling.Y(), 0);
-
-  // Three vertices that define the triangle on which the vehicle rests
-  // The first vertex is closest point on the terrain
-  ignition::math::Vector3d v1(std::round(robotPos.X()),
-      std::round(robotPos.Y()), 0);
-  ignition::math::Vector3d v2 = v1;
-  ignition::math::Vector3d v3 = v1;
-
-  // The second and third vertices are chosen based on how OGRE layouts
-  // the triangle strip.
-  if (static_cast<int>(v1.X()) == static_cast<int>(std::ceil(robotPos.X())) &&
-      static_cast<int>(v1.Y()) == static_cast<int>(std::ceil(robotPos.Y())))
+  if (!this->projection.Valid())
   {
-    if (static_cast<int>(v1.Y()) % 2 == 0)
+    size_t valid = 0;
+    for (size_t i = 0; i < _count; ++i)
     {
-      v2.Y(v1.Y()-1);
-      v3.X(v1.X()-1);
-    }
-    else
-    {
-      ignition::math::Vector3d b(v1.X()-1, v1.Y(), 0);
-      ignition::math::Vector3d c(v1.X(), v1.Y()-1, 0);
-      if (robotPos.Distance(b) < robotPos.Distance(c))
-      {
-        v3 = b;
-        v2.X(v1.X()-1);
-        v2.Y(v1.Y()-1);
-      }
-      else
-      {
-        v2 = c;
-        v3.X(v1.X()-1);
-        v3.Y(v1.Y()-1);
-      }
+      const bool inside = this->MapQuery(_lat[i], _lon[i], _height[i],
+          _type[i]);
+      if (_valid)
+        _valid[i] = inside;
+      valid += inside;
     }
+    return valid;
   }
-  else if (static_cast<int>(v1.X()) ==
-      static_cast<int>(std::floor(robotPos.X())) &&
-      static_cast<int>(v1.Y()) == static_cast<int>(std::ceil(robotPos.Y())))
-  {
-    if (static_cast<int>(v1.Y()) % 2 == 0)
-    {
-      ignition::math::Vector3d b(v1.X()+1, v1.Y(), 0);
-      ignition::math::Vector3d c(v1.X(), v1.Y()-1, 0);
-      if (robotPos.Distance(b) < robotPos.Distance(c))
-      {
-        v2 = b;
-        v3.X(v1.X()+1);
-        v3.Y(v1.Y()-1);
-      }
-      else
-      {
-        v3 = c;
-        v2.X(v1.X()+1);
-        v2.Y(v1.Y()-1);
-      }
-    }
-    else
-    {
-      v2.X(v1.X()+1);
-      v3.Y(v1.Y()-1);
-    }
-  }
-  else if (static_cast<int>(v1.X()) ==
-      static_cast<int>(std::floor(robotPos.X())) &&
-      static_cast<int>(v1.Y()) == static_cast<int>(std::floor(robotPos.Y())))
+
+  std::vector<double> xs(_count), ys(_count);
+  this->projection.Project(_count, _lat, _lon, xs.data(), ys.data());
+
+  // The heights of the points outside of the search area are looked up
+  // too, so the loop has no branches.
+  std::vector<double> heights(_count, 0.0);
+  if (this->scene && this->scene->Terrain())
   {
-    if (static_cast<int>(v1.Y()) % 2 == 0)
-    {
-      ignition::math::Vector3d b(v1.X()+1, v1.Y(), 0);
-      ignition::math::Vector3d c(v1.X(), v1.Y()+1, 0);
-      if (robotPos.Distance(b) < robotPos.Distance(c))
-      {
-        v2.X(v1.X()+1);
-        v2.Y(v1.Y()+1);
-        v3 = b;
-      }
-      else
-      {
-        v2 = c;
-        v3.X(v1.X()+1);
-        v3.Y(v1.Y()+1);
-      }
-    }
-    else
-    {
-      v2.Y(v1.Y()+1);
-      v3.X(v1.X()+1);
-    }
+    this->scene->TerrainLookup(_count, xs.data(), ys.data(), heights.data(),
+        nullptr);
   }
-  else
+
+  const double elevation =
+    this->world->GetSphericalCoordinates()->GetElevationReference();
+  size_t valid = 0;
+  for (size_t i = 0; i < _count; ++i)
   {
-    if (static_cast<int>(v1.Y()) % 2 == 0)
-    {
-      v2.X() -= 1;
-      v3.Y() += 1;
-    }
-    else
-    {
-      ignition::math::Vector3d b(v1.X()-1, v1.Y(), 0);
-      ignition::math::Vector3d c(v1.X(), v1.Y()+1, 0);
-      if (robotPos.Distance(b) < robotPos.Distance(c))
-      {
-        v2 = b;
-        v3.X(v1.X()-1);
-        v3.Y(v1.Y()+1);
-      }
-      else
-      {
-        v2.X(v1.X()-1);
-        v2.Y(v1.Y()+1);
-        v3 = c;
-      }
-    }
+    const bool inside =
+      _lat[i] >= this->searchMinLatitude &&
+      _lat[i] <= this->searchMaxLatitude &&
+      _lon[i] >= this->searchMinLongitude &&
+      _lon[i] <= this->searchMaxLongitude;
+    if (_valid)
+      _valid[i] = inside;
+    if (!inside)
+      continue;
+
+    _height[i] = heights[i] + elevation;
+    _type[i] = this->TerrainAtPos(
+        ignition::math::Vector3d(xs[i], ys[i], heights[i]));
+    ++valid;
   }
+  return valid;
+}
 
-  // Get the height at each vertex
-  v1.Z(this->terrain->GetHeight(v1.X(), v1.Y()));
-  v2.Z(this->terrain->GetHeight(v2.X(), v2.Y()));
-  v3.Z(this->terrain->GetHeight(v3.X(), v3.Y()));
-
-  // Display a marker that highlights the vertices currently used to
-  // compute the vehicles height. This is debug code that is very useful
-  // but it requires a version of gazebo with visual markers.
-  //
-  // gazebo::msgs::Marker markerMsg;
-  // markerMsg.set_layer("default");
-  // markerMsg.set_id(0);
-  // markerMsg.set_action(gazebo::msgs::Marker::MODIFY);
-  // markerMsg.set_type(gazebo::msgs::Marker::LINE_STRIP);
-
-
-  // v1a.Z() += 0.1;
-  // v2a.Z() += 0.1;
-  // v3a.Z() += 0.1;
-  // gazebo::msgs::Set(markerMsg.add_point(), v1a);
-  // gazebo::msgs::Set(markerMsg.add_point(), v2a);
-  // gazebo::msgs::Set(markerMsg.add_point(), v3a);
-  // if (this->markerPub)
-  //   this->markerPub->Publish(markerMsg);
-  // END DEBUG CODE
-
-  ignition::math::Vector3d v1a = v1;
-  ignition::math::Vector3d v2a = v2;
-  ignition::math::Vector3d v3a = v3;
-  v1a.X(v1a.X()*this->terrainScaling.X() - this->terrainSize.X()*0.5);
-  v1a.Y(this->terrainSize.Y()*0.5 - v1a.Y()*this->terrainScaling.Y());
-
-  v2a.X(v2a.X()*this->terrainScaling.X() - this->terrainSize.X()*0.5);
-  v2a.Y(this->terrainSize.Y()*0.5 - v2a.Y()*this->terrainScaling.Y());
-
-  v3a.X(v3a.X()*this->terrainScaling.X() - this->terrainSize.X()*0.5);
-  v3a.Y(this->terrainSize.Y()*0.5 - v3a.Y()*this->terrainScaling.Y());
-
-  _norm = ignition::math::Vector3d::Normal(v1a, v2a, v3a);
-
-  // Triangle normal
-  ignition::math::Vector3d norm = ignition::math::Vector3d::Normal(v1, v2, v3);
+//////////////////////////////////////////////////
+const TangentPlane &Common::Projection() const
+{
+  return this->projection;
+}
 
-  // Ray direction to intersect with triangle
-  ignition::math::Vector3d rayDir(0, 0, -1);
+//////////////////////////////////////////////////
+void Common::TerrainLookup(const ignition::math::Vector3d &_pos,
+    ignition::math::Vector3d &_terrainPos,
+    ignition::math::Vector3d &_norm) const
+{
+  if (!this->scene || !this->scene->Terrain())
+    return;
 
-  // Ray start point
-  ignition::math::Vector3d rayPt(robotPos.X(), robotPos.Y(), 1000);
+  double height;
+  const double x = _pos.X();
+  const double y = _pos.Y();
+  this->scene->TerrainLookup(1, &x, &y, &height, &_norm);
+  _terrainPos.Set(_pos.X(), _pos.Y(), height);
+}
 
-  // Distance from ray start to triangle intersection
-  double intersection = -norm.Dot(rayPt - v1) / norm.Dot(rayDir);
+//////////////////////////////////////////////////
+void Common::PrefetchTerrain(const ignition::math::Vector3d &_pos,
+    const ignition::math::Vector3d &_vel) const
+{
+  if (!this->scene || !this->scene->TerrainTileStore())
+    return;
 
-  // Height of the terrain
-  _terrainPos = rayPt + intersection * rayDir;
+  this->scene->PrefetchTerrain(_pos, kTerrainPrefetchRadius);
+  if (_vel != ignition::math::Vector3d::Zero)
+  {
+    this->scene->PrefetchTerrain(_pos + _vel * kTerrainPrefetchHorizon,
+        kTerrainPrefetchRadius);
+  }
 }
 
 /////////////////////////////////////////////////
 void Common::SetWorld(gazebo::physics::WorldPtr _world)
 {
   this->world = _world;
+  this->scene = this->world ? SceneIndex::Instance(this->world) : nullptr;
+
+  // The search areas are a few km across, so a projection fitted around
+  // the origin of the world is as accurate as the full conversion.
+  this->projection = TangentPlane();
+  if (this->world)
+  {
+    gazebo::common::SphericalCoordinatesPtr sphericalCoords =
+      this->world->GetSphericalCoordinates();
+    this->projection.Fit(sphericalCoords->LatitudeReference().Degree(),
+        sphericalCoords->LongitudeReference().Degree(),
+        [sphericalCoords](const double _lat, const double _lon)
+        {
+          return sphericalCoords->GlobalFromLocal(
+              sphericalCoords->LocalFromSpherical(
+                ignition::math::Vector3d(_lat, _lon, 0)));
+        });
+  }
 }
 
 /////////////////////////////////////////////////
 void Common::SetTerrain(gazebo::physics::HeightmapShapePtr _terrain)
 {
-  this->terrain = _terrain;
+  auto index = std::make_shared<SceneIndex>();
+  index->SetTerrain(_terrain);
+  index->Build();
+  this->scene = index;
+}
 
-  // Get the size of the terrain
-  this->terrainSize = this->terrain->GetSize().Ign();
+/////////////////////////////////////////////////
+std::shared_ptr<const SceneIndex> Common::Scene() const
+{
+  return this->scene;
+}
+
+/////////////////////////////////////////////////
+uint64_t Common::TerrainHash() const
+{
+  return this->scene ? this->scene->TerrainHash() : 0;
+}
 
-  // Set the terrain scaling.
-  this->terrainScaling.Set(this->terrain->GetSize().x /
-      (this->terrain->GetVertexCount().x-1),
-      this->terrain->GetSize().y /
-      (this->terrain->GetVertexCount().y-1));
+/////////////////////////////////////////////////
+const Heightmap &Common::TerrainHeightmap() const
+{
+  static const Heightmap empty;
+  return this->scene ? this->scene->TerrainHeightmap() : empty;
 }
 
 /////////////////////////////////////////////////
 TerrainType Common::TerrainAtPos(
     const ignition::math::Vector3d &_pos)
 {
-  TerrainType result = TerrainType::PLAIN;
-
-  for (auto const &mdl : this->world->GetModels())
-  {
-    if (mdl->GetBoundingBox().Contains(_pos))
-    {
-      // The bounding box of a model is aligned to the global axis, and can
-      // lead to incorrect results.
-      // If a point is in the bounding box, then we use a ray-cast to see
-      // if the point is actually within the model.
-      gazebo::physics::ModelPtr rayModel = this->world->GetModelBelowPoint(
-          gazebo::math::Vector3(_pos.X(), _pos.Y(), 1000));
-
-      // Just in case rayModel is null
-      const gazebo::physics::ModelPtr m = rayModel != NULL ? rayModel : mdl;
-
-      if (m->GetName().find("tree") != std::string::npos)
-      {
-        result = TerrainType::FOREST;
-        break;
-      }
-      else if (m->GetName().find("building") != std::string::npos)
-      {
-        result = TerrainType::BUILDING;
-        break;
-      }
-    }
-  }
+  if (!this->terrainRaster)
+    this->terrainRaster = terrainRasterOf(this->world);
 
-  return result;
+  return this->terrainRaster->At(_pos);
 }
 
 /////////////////////////////////////////////////
 ignition::math::Vector3d Common::TerrainSize() const
 {
-  return this->terrainSize;
+  return this->scene ? this->scene->TerrainSize() :
+    ignition::math::Vector3d::Zero;
 }
 
 /////////////////////////////////////////////////
 gazebo::physics::HeightmapShapePtr Common::Terrain() const
 {
-  return this->terrain;
+  return this->scene ? this->scene->Terrain() : nullptr;
 }
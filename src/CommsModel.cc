@@ -16,6 +16,9 @@
 */
 
 #include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
 #include <sys/stat.h>
 #include <string>
 #include <utility>
@@ -23,6 +26,8 @@
 #include <gazebo/common/Console.hh>
 #include <gazebo/common/Time.hh>
 #include <gazebo/physics/Collision.hh>
+#include <gazebo/physics/HeightmapShape.hh>
+#include <gazebo/physics/Link.hh>
 #include <gazebo/physics/Model.hh>
 #include <gazebo/physics/PhysicsEngine.hh>
 #include <gazebo/physics/RayShape.hh>
@@ -36,6 +41,133 @@
 
 using namespace swarm;
 
+//////////////////////////////////////////////////
+/// \brief Mix the bits of a value (the splitmix64 finalizer).
+/// \param[in] _x Value.
+/// \return A well distributed hash of the value.
+static uint64_t mixBits(uint64_t _x)
+{
+  _x = (_x ^ (_x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  _x = (_x ^ (_x >> 27)) * 0x94d049bb133111ebULL;
+  return _x ^ (_x >> 31);
+}
+
+//////////////////////////////////////////////////
+/// \brief Uniform random number of a counter-based stream. The same
+/// arguments always give the same number, no matter the thread or the order
+/// of the calls.
+/// \param[in] _seed Seed of the simulation.
+/// \param[in] _stream Stream, e.g. a pair of robots.
+/// \param[in] _counter Position in the stream.
+/// \param[in] _min Minimum value.
+/// \param[in] _max Maximum value.
+/// \return A number in [_min, _max).
+static double streamUniform(const uint64_t _seed, const uint64_t _stream,
+    const uint64_t _counter, const double _min, const double _max)
+{
+  const uint64_t bits =
+    mixBits(mixBits(mixBits(_seed) ^ _stream) ^ _counter);
+  const double u = (bits >> 11) * (1.0 / 9007199254740992.0);
+  return _min + (_max - _min) * u;
+}
+
+//////////////////////////////////////////////////
+/// \brief Pack the coordinates of a cell in 21 bits each.
+/// \param[in] _x X coordinate of the cell.
+/// \param[in] _y Y coordinate of the cell.
+/// \param[in] _z Z coordinate of the cell.
+/// \return The packed coordinates.
+static uint64_t packCell(const int64_t _x, const int64_t _y, const int64_t _z)
+{
+  const uint64_t mask = (1ULL << 21) - 1;
+  const int64_t offset = 1LL << 20;
+  return (static_cast<uint64_t>(_x + offset) & mask) << 42 |
+    (static_cast<uint64_t>(_y + offset) & mask) << 21 |
+    (static_cast<uint64_t>(_z + offset) & mask);
+}
+
+//////////////////////////////////////////////////
+/// \brief Number of cells between two packed cells, along the axis where
+/// they are the farthest.
+/// \param[in] _a A packed cell.
+/// \param[in] _b Another packed cell.
+/// \return The distance, in cells.
+static unsigned int cellDistance(const uint64_t _a, const uint64_t _b)
+{
+  const uint64_t mask = (1ULL << 21) - 1;
+  int64_t dist = 0;
+  for (int shift = 0; shift <= 42; shift += 21)
+  {
+    const int64_t a = static_cast<int64_t>((_a >> shift) & mask);
+    const int64_t b = static_cast<int64_t>((_b >> shift) & mask);
+    dist = std::max(dist, std::abs(a - b));
+  }
+  return static_cast<unsigned int>(dist);
+}
+
+// Height (m) above the reference points of the visibility tables, 1 meter
+// above the ground, from which a robot is flying. The tables other than
+// CLEARANCE are only valid below it.
+static const double kFlyingHeight = 1;
+
+// Effect of the trees between two robots on a distance of the comms model.
+static const unsigned int kTreesIgnored = 0;
+static const unsigned int kTreesBlock = 1;
+static const unsigned int kTreesAdd = 2;
+
+// Number of specializations of the comms model.
+static const unsigned int kLinkPolicies = 72;
+
+// Minimum number of steps between two adaptations of the fidelity. Longer
+// comms cycles adapt once per cycle.
+static const unsigned int kFidelityWindow = 10;
+
+// The fidelity goes down when the steps are slower than the target by this
+// fraction, and up when they are faster by kFidelityRestoreMargin.
+static const double kFidelityDegradeMargin = 0.05;
+static const double kFidelityRestoreMargin = 0.2;
+
+// The fidelity goes down multiplicatively and up additively, so it backs off
+// quickly and probes the load slowly.
+static const double kFidelityDecrease = 0.75;
+static const double kFidelityIncrease = 0.1;
+
+// Changes of fidelity kept when nothing logs them.
+static const size_t kMaxFidelityChanges = 1000;
+
+//////////////////////////////////////////////////
+/// \brief Parameters of the comms model fixed for a whole run, decoded
+/// from the index of a specialization of UpdateNeighborList().
+template <unsigned int kPolicy>
+struct LinkPolicy
+{
+  /// \brief Effect of the trees on the neighbor distance.
+  static const unsigned int kNeighborTrees = kPolicy % 3;
+
+  /// \brief Effect of the trees on the comms distance.
+  static const unsigned int kCommsTrees = (kPolicy / 3) % 3;
+
+  /// \brief Whether a minimum neighbor or comms distance is set.
+  static const bool kMinLimits = (kPolicy / 9) % 2 != 0;
+
+  /// \brief Whether a maximum neighbor or comms distance is set.
+  static const bool kMaxLimits = (kPolicy / 18) % 2 != 0;
+
+  /// \brief Whether packets can be dropped randomly.
+  static const bool kDrops = (kPolicy / 36) % 2 != 0;
+};
+
+//////////////////////////////////////////////////
+/// \brief Effect of the trees for a distance penalty.
+/// \param[in] _penalty Penalty (m) for crossing trees.
+/// \return kTreesIgnored, kTreesBlock or kTreesAdd.
+static unsigned int treesPolicy(const double _penalty)
+{
+  if (ignition::math::equal(_penalty, 0.0))
+    return kTreesIgnored;
+  return _penalty < 0.0 ? kTreesBlock : kTreesAdd;
+}
+
 //////////////////////////////////////////////////
 CommsModel::CommsModel(SwarmMembershipPtr _swarm,
     gazebo::physics::WorldPtr _world, sdf::ElementPtr _sdf)
@@ -45,478 +177,1770 @@ CommsModel::CommsModel(SwarmMembershipPtr _swarm,
   GZ_ASSERT(_world, "CommsModel() error: _world pointer is NULL");
   GZ_ASSERT(_sdf, "CommsModel() error: _sdf pointer is NULL");
 
-  this->LoadParameters(_sdf);
+  this->poses = PoseSnapshot::Instance(this->world->GetName());
+  this->statePoses = this->poses;
+  this->trace = StepTrace::Instance(this->world->GetName());
+
+  this->LoadParameters(_sdf);
+
+  // Sanity check: Confirm that the penalty for crossing two lines of trees is
+  // bigger than the maximum neighbor distance.
+  if (this->neighborDistancePenaltyTree * 2 <= this->neighborDistanceMax)
+  {
+    std::cerr << "The combination of <neighborDistancePenaltyTree> and "
+              << " <neighborDistanceMax> violates the rule that no more than "
+              << "one line of trees is allowed between vehicles to communicate "
+              << "(2*neighborDistancePenaltyTree > neighborDistanceMax)."
+              << std::endl;
+  }
+
+  // Sanity check: Confirm that the penalty for crossing two lines of trees is
+  // bigger than the maximum comms distance.
+  if (this->commsDistancePenaltyTree * 2 <= this->commsDistanceMax)
+  {
+    std::cerr << "The combination of <commsDistancePenaltyTree> and "
+              << " <commsDistanceMax> violates the rule that no more than "
+              << "one line of trees is allowed between vehicles to communicate "
+              << "(2*commsDistancePenaltyTree > commsDistanceMax)."
+              << std::endl;
+  }
+
+  this->CacheVisibilityPairs();
+
+  // The neighbor lists can be updated in parallel, by setting the number
+  // of threads with the SWARM_COMMS_THREADS environment variable. They
+  // are updated by the simulation thread only by default. The results don't
+  // depend on the number of threads.
+  char *threadsEnv = std::getenv("SWARM_COMMS_THREADS");
+  if (threadsEnv && std::atoi(threadsEnv) > 1)
+  {
+    this->neighborPool.reset(new WorkerPool(std::atoi(threadsEnv)));
+    gzmsg << "CommsModel: updating the neighbors with "
+          << this->neighborPool->Size() << " threads" << std::endl;
+  }
+  this->neighborScratch.resize(
+      this->neighborPool ? this->neighborPool->Size() : 1);
+
+  // The terrain, trees and buildings come from the index of the world,
+  // shared with the robots.
+  this->common.SetWorld(this->world);
+  this->scene = this->common.Scene();
+
+  // The tiled tables keep SWARM_VISIBILITY_TILE_CACHE decompressed tiles
+  // in memory, around the robots that query them.
+  const char *tileCacheEnv = std::getenv("SWARM_VISIBILITY_TILE_CACHE");
+  const int tileCache = tileCacheEnv ? std::atoi(tileCacheEnv) : 0;
+  if (tileCache > 0)
+  {
+    this->visibilityTable.SetTileCacheSize(tileCache);
+    this->obstacleTable.SetTileCacheSize(tileCache);
+  }
+
+  // Load the visibility table of the terrain. Tables are cached by terrain
+  // hash and covered area, so multiple terrains can coexist.
+  this->coarseTables.clear();
+  if (this->common.Terrain())
+  {
+    this->common.LoadWorldSearchArea(this->world->GetSDF());
+
+    // The table generated for this world covers the search area.
+    VisibilityTable table;
+    table.SetArea(this->common);
+    this->LoadVisibilityLevel(table, this->visibilityTable);
+
+    // The pairs farther apart than the finest level are read from the
+    // coarser levels, up to the maximum comms distance.
+    for (int level = 1; level < VisibilityTable::kMaxLevels &&
+         VisibilityTable::LevelRange(level - 1) < this->commsDistanceMax;
+         ++level)
+    {
+      VisibilityTable coarse;
+      coarse.SetLevel(level);
+      coarse.SetArea(this->common);
+      std::unique_ptr<VisibilityLookup> lookup(new VisibilityLookup());
+      if (tileCache > 0)
+        lookup->SetTileCacheSize(tileCache);
+      if (this->LoadVisibilityLevel(coarse, *lookup))
+        this->coarseTables.push_back(std::move(lookup));
+    }
+  }
+
+  // Robots moving within a cell of the table keep the same visibility.
+  if (this->visibilityTable.Loaded())
+    this->motionCellSize = this->visibilityTable.StepSize();
+
+  const std::vector<ignition::math::Box> &treeBoxes =
+    this->scene->TreeBoxes();
+  const std::vector<ignition::math::Box> &buildingBoxes =
+    this->scene->BuildingBoxes();
+
+  // The optional obstacle layer of the visibility table classifies the
+  // links between robots on the ground without testing the boxes.
+  if (this->common.TerrainHeightmap().Valid() &&
+      (!treeBoxes.empty() || !buildingBoxes.empty()))
+  {
+    VisibilityTable table;
+    table.SetArea(this->common);
+    std::string obstaclesFilename = table.ObstaclesFilename(
+        VisibilityTable::ObstaclesHash(treeBoxes, buildingBoxes));
+    struct stat buffer;
+    const std::string tilesFilename =
+      VisibilityLookup::TilesFilename(obstaclesFilename);
+    if (stat(tilesFilename.c_str(), &buffer) == 0)
+      obstaclesFilename = tilesFilename;
+    if (stat(obstaclesFilename.c_str(), &buffer) != 0)
+    {
+      std::cout << "No obstacle table [" << obstaclesFilename << "], the "
+                << "trees and buildings will be tested on their bounding "
+                << "boxes." << std::endl;
+    }
+    else if (!this->obstacleTable.Load(obstaclesFilename) ||
+        this->obstacleTable.Format() != OBSTACLES ||
+        this->obstacleTable.TerrainHash() != this->common.TerrainHash())
+    {
+      std::cerr << "Unable to use the obstacle table [" << obstaclesFilename
+                << "]. The trees and buildings will be tested on their "
+                << "bounding boxes." << std::endl;
+      this->obstacleTable.Unload();
+    }
+  }
+
+  this->Reset();
+}
+
+//////////////////////////////////////////////////
+bool CommsModel::LoadVisibilityLevel(VisibilityTable &_table,
+    VisibilityLookup &_lookup)
+{
+  std::string tableFilename = _table.Filename();
+  struct stat buffer;
+
+  // The tiled version of the table, if any, is decompressed on demand
+  // instead of mapping every cell.
+  const std::string tilesFilename =
+    VisibilityLookup::TilesFilename(tableFilename);
+  if (stat(tilesFilename.c_str(), &buffer) == 0)
+    tableFilename = tilesFilename;
+
+  // Generate the missing table with the number of threads in the
+  // SWARM_VISIBILITY_GENERATE environment variable, 0 for all the cores.
+  // The first process of a node generates it, the others wait for it, and
+  // all of them map the same file.
+  const char *generateEnv = std::getenv("SWARM_VISIBILITY_GENERATE");
+  if (generateEnv && stat(tableFilename.c_str(), &buffer) != 0 &&
+      this->common.TerrainHeightmap().Valid())
+  {
+    _table.Generate(this->common.TerrainHeightmap(),
+        std::max(0, std::atoi(generateEnv)));
+  }
+
+  if (stat(tableFilename.c_str(), &buffer) != 0)
+  {
+    // Without a table, the line of sight is computed on the heightmap
+    // when needed. It's slower, but doesn't delay the start up.
+    std::cout << "No visibility table [" << tableFilename << "], the "
+              << "line of sight will be computed on the heightmap. Run "
+              << "swarm_visibility on the world file, or set "
+              << "SWARM_VISIBILITY_GENERATE, to generate it." << std::endl;
+    return false;
+  }
+
+  // Map the visibility table information
+  if (!_lookup.Load(tableFilename))
+  {
+    std::cerr << "Unable to load the visibility table. The line of sight "
+              << "will be computed on the heightmap." << std::endl;
+    return false;
+  }
+
+  if (_lookup.TerrainHash() != this->common.TerrainHash())
+  {
+    std::cerr << "The visibility table [" << tableFilename << "] was "
+              << "generated for a different terrain. The line of sight "
+              << "will be computed on the heightmap." << std::endl;
+    _lookup.Unload();
+    return false;
+  }
+
+  return true;
+}
+
+//////////////////////////////////////////////////
+void CommsModel::Reset()
+{
+  // The first step evaluates its own poses again.
+  this->WaitUpdate();
+  this->pipelineStarted = false;
+
+  // The random streams restart from the current seed.
+  this->seed = ignition::math::Rand::Seed();
+
+  const unsigned int n = this->members.size();
+  for (unsigned int i = 0; i < n; ++i)
+  {
+    this->SetOutage(i, false);
+    this->members[i]->onOutageUntil = gazebo::common::Time::Zero;
+  }
+
+  // The neighbor lists are rebuilt by UpdateNeighborList(), starting from
+  // empty lists.
+  this->candidates.assign(n, std::vector<unsigned int>());
+  this->neighborIds.assign(n, std::vector<unsigned int>());
+  this->reportedPositions.assign(n, ignition::math::Vector3d::Zero);
+  this->neighborWords = (n + 63) / 64;
+  this->neighborBits.assign(n * this->neighborWords, 0);
+  this->neighborVersions.assign(n, 0);
+  this->neighborUpdates.assign(n, 0);
+  this->neighborIndex = 0;
+
+  // The pairs are collected by UpdateBroadphase() at the start of each
+  // comms cycle.
+  this->visibilityPairs.clear();
+  this->visibilitySchedule.clear();
+  this->visibilityIndex = 0;
+  this->visibilityUpdatesPerCycle = 0;
+  this->visibilityUpdatesFull = 0;
+  this->broadphaseCountdown = 0;
+
+  // The run starts again at full fidelity.
+  this->fidelityScale = 1.0;
+  this->fidelityWallTime = 0;
+  this->fidelitySteps = 0;
+  this->fidelityChanges.clear();
+  this->ApplyFidelity();
+
+  // Initialize visibility.
+  this->visibility.assign(n * n, 0);
+  this->neighborProbabilities.assign(n * n, -1.0);
+  this->refreshCells.assign(n * n, kNotRefreshed);
+  this->linkCache.assign(n * n, LinkCacheEntry());
+
+  // The robots are not visible until they are found by the broadphase.
+  this->commsStatus.assign(n * n, msgs::CommsStatus::OBSTACLE);
+  this->visibleCounts.assign(n, 0);
+  for (unsigned int a = 0; a < n; ++a)
+  {
+    for (unsigned int b = 0; b < n; ++b)
+      this->SetCommsStatus(a, b, this->OutOfRangeStatus(a, b));
+  }
+
+  // Draw the time of the first outage of each robot.
+  this->lastUpdateTime = this->world->GetSimTime();
+  this->ScheduleOutages();
+}
+
+//////////////////////////////////////////////////
+void CommsModel::Save(msgs::CommsState &_state) const
+{
+  this->WaitUpdate();
+
+  const unsigned int n = this->members.size();
+  _state.set_seed(this->seed);
+  _state.set_last_update_time(this->lastUpdateTime.Double());
+  _state.set_fidelity_scale(this->fidelityScale);
+  _state.set_neighbor_index(this->neighborIndex);
+  _state.set_visibility(std::string(this->visibility.begin(),
+        this->visibility.end()));
+  _state.set_comms_status(std::string(this->commsStatus.begin(),
+        this->commsStatus.end()));
+
+  // At most one event is pending per robot.
+  std::vector<double> events(n, -1.0);
+  OutageQueue pending = this->outageEvents;
+  for (; !pending.empty(); pending.pop())
+    events[pending.top().second] = pending.top().first;
+
+  _state.mutable_member()->Reserve(n);
+  for (unsigned int i = 0; i < n; ++i)
+  {
+    auto const &swarmMember = this->members[i];
+    msgs::MemberState *member = _state.add_member();
+    member->set_address(this->addresses[i]);
+    member->set_on_outage(swarmMember->onOutage);
+    member->set_on_outage_until(swarmMember->onOutageUntil.Double());
+    member->set_outage_event(events[i]);
+    member->set_data_rate_usage(swarmMember->dataRateUsage);
+    member->set_neighbor_updates(this->neighborUpdates[i]);
+    const ignition::math::Vector3d &reported = this->reportedPositions[i];
+    member->add_reported_position(reported.X());
+    member->add_reported_position(reported.Y());
+    member->add_reported_position(reported.Z());
+    for (const unsigned int j : this->neighborIds[i])
+    {
+      member->add_neighbor(j);
+      member->add_probability(
+          this->neighborProbabilities[this->PairIndex(i, j)]);
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+bool CommsModel::Restore(const msgs::CommsState &_state)
+{
+  this->WaitUpdate();
+
+  const unsigned int n = this->members.size();
+  if (_state.member_size() != static_cast<int>(n) ||
+      _state.visibility().size() != size_t(n) * n ||
+      _state.comms_status().size() != size_t(n) * n)
+  {
+    std::cerr << "CommsModel::Restore(): The checkpoint has "
+              << _state.member_size() << " members instead of " << n
+              << std::endl;
+    return false;
+  }
+  for (unsigned int i = 0; i < n; ++i)
+  {
+    const msgs::MemberState &member = _state.member(i);
+    bool valid = member.address() == this->addresses[i] &&
+      member.neighbor_size() == member.probability_size() &&
+      (member.reported_position_size() == 0 ||
+       member.reported_position_size() == 3);
+    for (const unsigned int j : member.neighbor())
+      valid = valid && j < n;
+    if (!valid)
+    {
+      std::cerr << "CommsModel::Restore(): Unexpected member ["
+                << member.address() << "]" << std::endl;
+      return false;
+    }
+  }
+
+  this->seed = _state.seed();
+  this->lastUpdateTime = _state.last_update_time();
+  this->neighborIndex = _state.neighbor_index() % std::max(n, 1u);
+  this->visibility.assign(_state.visibility().begin(),
+      _state.visibility().end());
+  this->commsStatus.assign(_state.comms_status().begin(),
+      _state.comms_status().end());
+
+  this->outageEvents = OutageQueue();
+  this->neighborProbabilities.assign(n * n, -1.0);
+  this->visibleCounts.assign(n, 0);
+  for (unsigned int i = 0; i < n; ++i)
+  {
+    const msgs::MemberState &member = _state.member(i);
+    auto const &swarmMember = this->members[i];
+    this->SetOutage(i, member.on_outage());
+    swarmMember->onOutageUntil = member.on_outage_until();
+    swarmMember->dataRateUsage = member.data_rate_usage();
+    if (member.outage_event() >= 0)
+      this->outageEvents.emplace(member.outage_event(), i);
+
+    this->neighborUpdates[i] = member.neighbor_updates();
+    if (member.reported_position_size() == 3)
+    {
+      this->reportedPositions[i].Set(member.reported_position(0),
+          member.reported_position(1), member.reported_position(2));
+    }
+    this->SetNeighborBits(i, false);
+    this->neighborIds[i].assign(member.neighbor().begin(),
+        member.neighbor().end());
+    this->SetNeighborBits(i, true);
+    for (int k = 0; k < member.neighbor_size(); ++k)
+    {
+      const unsigned int j = member.neighbor(k);
+      this->neighborProbabilities[this->PairIndex(i, j)] =
+        member.probability(k);
+    }
+
+    for (unsigned int j = 0; j < n; ++j)
+    {
+      if (this->commsStatus[this->PairIndex(i, j)] ==
+          msgs::CommsStatus::VISIBLE)
+      {
+        ++this->visibleCounts[i];
+      }
+    }
+  }
+
+  // The broadphase, the schedule of the visibility and the caches are
+  // rebuilt from the poses by the next Update().
+  this->candidates.assign(n, std::vector<unsigned int>());
+  this->visibilityPairs.clear();
+  this->visibilitySchedule.clear();
+  this->visibilityIndex = 0;
+  this->broadphaseCountdown = 0;
+  this->refreshCells.assign(n * n, kNotRefreshed);
+  this->linkCache.assign(n * n, LinkCacheEntry());
+
+  this->fidelityScale = _state.fidelity_scale();
+  this->fidelityWallTime = 0;
+  this->fidelitySteps = 0;
+  this->ApplyFidelity();
+  return true;
+}
+
+//////////////////////////////////////////////////
+void CommsModel::Fork(sdf::ElementPtr _overrides)
+{
+  this->WaitUpdate();
+
+  this->seed = ignition::math::Rand::Seed();
+  if (_overrides)
+    this->LoadParameters(_overrides);
+
+  const unsigned int n = this->members.size();
+  this->refreshCells.assign(n * n, kNotRefreshed);
+  this->linkCache.assign(n * n, LinkCacheEntry());
+}
+
+//////////////////////////////////////////////////
+void CommsModel::OnMemory(MemoryReport &_report) const
+{
+  this->WaitUpdate();
+
+  // The pairs, N x N.
+  uint64_t bytes = HeapBytes(this->visibility) + HeapBytes(this->commsStatus) +
+    HeapBytes(this->neighborProbabilities) + HeapBytes(this->linkCache) +
+    HeapBytes(this->visibilityPairs) + HeapBytes(this->visibilitySchedule) +
+    HeapBytes(this->refreshCells);
+
+  // The members.
+  bytes += HeapBytes(this->visibleCounts) + HeapBytes(this->robotCells) +
+    HeapBytes(this->reportedPositions) +
+    HeapBytes(this->dueOutages) + HeapBytes(this->addresses) +
+    HeapBytes(this->members) + HeapBytes(this->outages) +
+    HeapBytes(this->positions) + HeapBytes(this->cells) +
+    HeapBytes(this->neighborVersions) + HeapBytes(this->neighborBits) +
+    HeapBytes(this->scratch) + HeapBytes(this->neighborUpdates) +
+    HeapBytes(this->carriers) + HeapBytes(this->aliases) +
+    this->outageEvents.size() * sizeof(std::pair<double, unsigned int>);
+  for (auto const &list : {&this->candidates, &this->neighborIds,
+         &this->neighborScratch})
+  {
+    bytes += HeapBytes(*list);
+    for (auto const &ids : *list)
+      bytes += HeapBytes(ids);
+  }
+  bytes += HeapBytes(this->fidelityChanges);
+  for (auto const &change : this->fidelityChanges)
+    bytes += HeapBytes(change);
+
+  _report.Add("comms_model", bytes, this->commsStatus.size());
+
+  // The tables are mapped, so they only count once per host. The
+  // decompressed tiles are private to each process.
+  uint64_t mapped = 0, tileBytes = 0, tables = 0, tiles = 0;
+  bool tiled = false;
+  for (const VisibilityLookup *table : this->VisibilityTables())
+  {
+    mapped += table->MappedSize();
+    tables += table->Loaded();
+    tileBytes += table->TileCacheBytes();
+    tiles += table->CachedTiles();
+    tiled = tiled || table->Tiled();
+  }
+  _report.Add("visibility_tables", mapped, tables);
+  if (tiled)
+    _report.Add("visibility_tiles", tileBytes, tiles);
+
+  if (this->scene)
+    this->scene->OnMemory(_report);
+}
+
+//////////////////////////////////////////////////
+bool CommsModel::VisibilityTileStats(uint64_t &_hits,
+    uint64_t &_misses) const
+{
+  _hits = 0;
+  _misses = 0;
+  bool tiled = false;
+  for (const VisibilityLookup *table : this->VisibilityTables())
+  {
+    _hits += table->TileHits();
+    _misses += table->TileMisses();
+    tiled = tiled || table->Tiled();
+  }
+  return tiled;
+}
+
+//////////////////////////////////////////////////
+std::vector<const VisibilityLookup*> CommsModel::VisibilityTables() const
+{
+  std::vector<const VisibilityLookup*> tables = {&this->visibilityTable,
+    &this->obstacleTable};
+  for (auto const &table : this->coarseTables)
+    tables.push_back(table.get());
+  return tables;
+}
+
+//////////////////////////////////////////////////
+CommsModel::~CommsModel()
+{
+  this->StopPipeline();
+}
+
+//////////////////////////////////////////////////
+void CommsModel::Update()
+{
+  // The state of this step was evaluated during the previous one.
+  if (this->pipelined && this->pipelineStarted)
+  {
+    this->WaitUpdate();
+    return;
+  }
+
+  // Read the poses of the swarm, shared with the robots for this step.
+  this->poses->Capture(this->world->GetSimTime());
+  this->stateTime = this->world->GetSimTime();
+  if (this->pipelined)
+  {
+    this->stagedPoses.CopyPoses(*this->poses);
+    this->statePoses = &this->stagedPoses;
+  }
+
+  this->Evaluate();
+}
+
+//////////////////////////////////////////////////
+void CommsModel::StartUpdate()
+{
+  if (!this->pipelined)
+    return;
+
+  // The thread reads a copy of the poses, since the robots may capture the
+  // poses of the next step meanwhile.
+  this->WaitUpdate();
+  this->poses->Capture(this->world->GetSimTime());
+  this->stateTime = this->world->GetSimTime();
+  this->stagedPoses.CopyPoses(*this->poses);
+  this->statePoses = &this->stagedPoses;
+  this->pipelineStarted = true;
+
+  if (!this->pipelineThread.joinable())
+    this->pipelineThread = std::thread(&CommsModel::RunPipeline, this);
+
+  {
+    std::lock_guard<std::mutex> lock(this->pipelineMutex);
+    this->pipelinePending = true;
+  }
+  this->pipelineWake.notify_one();
+}
+
+//////////////////////////////////////////////////
+bool CommsModel::Pipelined() const
+{
+  return this->pipelined;
+}
+
+//////////////////////////////////////////////////
+void CommsModel::PrepareFork()
+{
+  this->StopPipeline();
+}
+
+//////////////////////////////////////////////////
+void CommsModel::WaitUpdate() const
+{
+  if (!this->pipelineThread.joinable())
+    return;
+
+  std::unique_lock<std::mutex> lock(this->pipelineMutex);
+  this->pipelineDone.wait(lock, [this]()
+      {
+        return !this->pipelinePending;
+      });
+}
+
+//////////////////////////////////////////////////
+void CommsModel::StopPipeline()
+{
+  if (!this->pipelineThread.joinable())
+    return;
+
+  this->WaitUpdate();
+  {
+    std::lock_guard<std::mutex> lock(this->pipelineMutex);
+    this->pipelineStopping = true;
+  }
+  this->pipelineWake.notify_one();
+  this->pipelineThread.join();
+  this->pipelineStopping = false;
+}
+
+//////////////////////////////////////////////////
+void CommsModel::RunPipeline()
+{
+  std::unique_lock<std::mutex> lock(this->pipelineMutex);
+  while (true)
+  {
+    this->pipelineWake.wait(lock, [this]()
+        {
+          return this->pipelineStopping || this->pipelinePending;
+        });
+    if (!this->pipelinePending)
+      break;
+
+    lock.unlock();
+    this->Evaluate();
+    lock.lock();
+
+    this->pipelinePending = false;
+    this->pipelineDone.notify_all();
+  }
+}
+
+//////////////////////////////////////////////////
+void CommsModel::Evaluate()
+{
+  // The stages are traced from the pipeline thread too.
+  {
+    ScopedTraceSpan span(this->trace, "comms_carriers");
+    this->UpdateCarriers();
+  }
+
+  // Decide if each member of the swarm enters into a comms outage.
+  {
+    ScopedTraceSpan span(this->trace, "comms_outages");
+    this->UpdateOutages();
+  }
+
+  // Find the pairs of vehicles that can be within range in this cycle.
+  {
+    ScopedTraceSpan span(this->trace, "comms_broadphase");
+    this->UpdateBroadphase();
+  }
+
+  // Update the visibility state between vehicles.
+  // Make sure that this happens after UpdateOutages() and
+  // UpdateBroadphase().
+  {
+    ScopedTraceSpan span(this->trace, "comms_visibility");
+    this->UpdateVisibility();
+  }
+
+  // Update the neighbors list of each member of the swarm.
+  // Make sure that this happens after UpdateVisibility().
+  ScopedTraceSpan span(this->trace, "comms_neighbors");
+  this->UpdateNeighbors();
+}
+
+//////////////////////////////////////////////////
+void CommsModel::FillVisibilityMap(msgs::VisibilityMap &_msg) const
+{
+  const unsigned int n = this->members.size();
+  _msg.Clear();
+  _msg.mutable_row()->Reserve(n);
+  for (unsigned int a = 0; a < n; ++a)
+  {
+    auto row = _msg.add_row();
+    row->set_src(this->addresses[a]);
+    row->mutable_entry()->Reserve(n);
+
+    for (unsigned int b = 0; b < n; ++b)
+    {
+      auto entry = row->add_entry();
+      entry->set_dst(this->addresses[b]);
+      entry->set_status(static_cast<msgs::CommsStatus>(
+            this->commsStatus[this->PairIndex(a, b)]));
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+void CommsModel::FillVisibilityDelta(const bool _keyframe,
+    std::vector<uint8_t> &_last, msgs::VisibilityDelta &_msg) const
+{
+  _msg.Clear();
+  if (_keyframe || _last.size() != this->commsStatus.size())
+  {
+    for (auto const &address : this->addresses)
+      _msg.add_address(address);
+    _msg.set_status(this->commsStatus.data(), this->commsStatus.size());
+    _last = this->commsStatus;
+    return;
+  }
+
+  for (size_t i = 0; i < this->commsStatus.size(); ++i)
+  {
+    if (this->commsStatus[i] == _last[i])
+      continue;
+
+    _msg.add_changed_pair(i);
+    _msg.add_changed_status(
+        static_cast<msgs::CommsStatus>(this->commsStatus[i]));
+    _last[i] = this->commsStatus[i];
+  }
+}
+
+/////////////////////////////////////////////////
+double CommsModel::AvgNeighbors() const
+{
+  int numRobots = 0;
+  int numNeighbors = 0;
+  for (unsigned int i = 0; i < this->members.size(); ++i)
+  {
+    if (this->addresses[i] == "boo")
+      continue;
+
+    numRobots += 1;
+    numNeighbors += this->visibleCounts[i];
+  }
+
+  return numNeighbors / static_cast<double>(numRobots);
+}
+
+//////////////////////////////////////////////////
+int CommsModel::MemberIndex(const std::string &_address) const
+{
+  auto it = std::lower_bound(this->addresses.begin(), this->addresses.end(),
+      _address);
+  if (it == this->addresses.end() || *it != _address)
+    return -1;
+
+  return it - this->addresses.begin();
+}
+
+//////////////////////////////////////////////////
+const SwarmMemberPtr &CommsModel::Member(const unsigned int _index) const
+{
+  return this->members[_index];
+}
+
+//////////////////////////////////////////////////
+const std::string &CommsModel::Address(const unsigned int _index) const
+{
+  return this->addresses[_index];
+}
+
+//////////////////////////////////////////////////
+const std::vector<std::string> &CommsModel::Addresses() const
+{
+  return this->addresses;
+}
+
+//////////////////////////////////////////////////
+const std::vector<ignition::math::Vector3d> &CommsModel::ReportedPositions()
+    const
+{
+  return this->reportedPositions;
+}
+
+//////////////////////////////////////////////////
+const std::vector<unsigned int> &CommsModel::Neighbors(
+    const unsigned int _index) const
+{
+  return this->neighborIds[_index];
+}
+
+//////////////////////////////////////////////////
+const uint64_t *CommsModel::NeighborBits(const unsigned int _index) const
+{
+  return this->neighborBits.data() + _index * this->neighborWords;
+}
+
+//////////////////////////////////////////////////
+size_t CommsModel::NeighborWords() const
+{
+  return this->neighborWords;
+}
+
+//////////////////////////////////////////////////
+void CommsModel::SetNeighborBits(const unsigned int _index, const bool _value)
+{
+  uint64_t *words = this->neighborBits.data() + _index * this->neighborWords;
+  for (const unsigned int j : this->neighborIds[_index])
+  {
+    if (_value)
+      words[j / 64] |= uint64_t(1) << (j % 64);
+    else
+      words[j / 64] &= ~(uint64_t(1) << (j % 64));
+  }
+}
+
+//////////////////////////////////////////////////
+uint64_t CommsModel::NeighborsVersion(const unsigned int _index) const
+{
+  return this->neighborVersions[_index];
+}
+
+//////////////////////////////////////////////////
+Neighbors_M CommsModel::NeighborsMap(const unsigned int _index) const
+{
+  // The indices follow the order of the addresses.
+  Neighbors_M neighbors;
+  for (const unsigned int j : this->neighborIds[_index])
+  {
+    neighbors.emplace_hint(neighbors.end(), this->addresses[j],
+        this->CommsProbability(_index, j));
+  }
+  return neighbors;
+}
+
+//////////////////////////////////////////////////
+double CommsModel::CommsProbability(const unsigned int _src,
+    const unsigned int _dst) const
+{
+  return this->neighborProbabilities[this->PairIndex(_src, _dst)];
+}
+
+//////////////////////////////////////////////////
+void CommsModel::SetOutage(const unsigned int _index, const bool _onOutage)
+{
+  this->members[_index]->onOutage = _onOutage;
+  this->outages[_index] = _onOutage;
+}
+
+//////////////////////////////////////////////////
+void CommsModel::SetCommsStatus(const unsigned int _a, const unsigned int _b,
+    const msgs::CommsStatus _status)
+{
+  uint8_t &status = this->commsStatus[this->PairIndex(_a, _b)];
+  if (status == msgs::CommsStatus::VISIBLE)
+    --this->visibleCounts[_a];
+  if (_status == msgs::CommsStatus::VISIBLE)
+    ++this->visibleCounts[_a];
+  status = static_cast<uint8_t>(_status);
+}
+
+//////////////////////////////////////////////////
+uint32_t CommsModel::MaxDataRate() const
+{
+  return this->commsDataRateMax;
+}
+
+//////////////////////////////////////////////////
+double CommsModel::Latency() const
+{
+  return this->commsLatency;
+}
+
+//////////////////////////////////////////////////
+uint16_t CommsModel::UdpOverhead() const
+{
+  return this->udpOverhead;
+}
+
+//////////////////////////////////////////////////
+void CommsModel::UpdateOutages()
+{
+  const gazebo::common::Time curTime = this->stateTime;
+
+  // In case we reset simulation.
+  if (curTime <= this->lastUpdateTime)
+  {
+    this->lastUpdateTime = curTime;
+    this->ScheduleOutages();
+    return;
+  }
+
+  this->lastUpdateTime = curTime;
+
+  // Collect the outages starting or ending now. The events scheduled while
+  // handling them are due from the next update.
+  this->dueOutages.clear();
+  while (!this->outageEvents.empty() &&
+         this->outageEvents.top().first <= curTime.Double())
+  {
+    this->dueOutages.push_back(this->outageEvents.top().second);
+    this->outageEvents.pop();
+  }
+
+  for (auto const i : this->dueOutages)
+  {
+    auto const &swarmMember = this->members[i];
+
+    if (swarmMember->onOutage)
+    {
+      // The outage finishes.
+      this->SetOutage(i, false);
+      this->RefreshOutOfRangeStatus(i);
+
+      // Debug output.
+      // gzdbg << "[" << curTime << "] Robot " << this->addresses[i]
+      //       << " is back from an outage." << std::endl;
+    }
+    else
+    {
+      this->SetOutage(i, true);
+      this->RefreshOutOfRangeStatus(i);
+
+      // Debug output.
+      // gzdbg << "[" << curTime << "] Robot " << this->addresses[i]
+      //       << " has started an outage." << std::endl;
+
+      // Decide the duration of the outage.
+      if (this->commsOutageDurationMin < 0 ||
+          this->commsOutageDurationMax < 0)
+      {
+        // Permanent outage.
+        swarmMember->onOutageUntil = gazebo::common::Time::Zero;
+      }
+      else
+      {
+        // Temporal outage.
+        swarmMember->onOutageUntil = curTime + this->OutageUniform(i, 1,
+            this->commsOutageDurationMin, this->commsOutageDurationMax);
+      }
+    }
+
+    this->ScheduleOutage(i);
+  }
+}
+
+//////////////////////////////////////////////////
+void CommsModel::SetRemoteState(const unsigned int _index,
+    const ignition::math::Pose3d &_pose, const bool _onOutage)
+{
+  this->WaitUpdate();
+  this->poses->SetPose(_index, _pose);
+
+  if (this->members[_index]->onOutage != _onOutage)
+  {
+    this->SetOutage(_index, _onOutage);
+    this->RefreshOutOfRangeStatus(_index);
+  }
+}
+
+//////////////////////////////////////////////////
+void CommsModel::ScheduleOutages()
+{
+  this->outageEvents = OutageQueue();
+  for (unsigned int i = 0; i < this->members.size(); ++i)
+    this->ScheduleOutage(i);
+}
+
+//////////////////////////////////////////////////
+void CommsModel::ScheduleOutage(const unsigned int _id)
+{
+  auto const &swarmMember = this->members[_id];
+  const double now = this->lastUpdateTime.Double();
+
+  // The outages of the robots simulated elsewhere are decided there.
+  if (!swarmMember->partition.empty())
+    return;
+
+  if (swarmMember->onOutage)
+  {
+    // Permanent outages never finish.
+    if (swarmMember->onOutageUntil != gazebo::common::Time::Zero)
+      this->outageEvents.emplace(swarmMember->onOutageUntil.Double(), _id);
+    return;
+  }
+
+  // Notice that "commsOutageProbability" specifies the probability of going
+  // into a comms outage at each second, so the time until the next outage
+  // follows an exponential distribution with that rate. A probability of 1
+  // starts an outage at the next update.
+  if (ignition::math::equal(this->commsOutageProbability, 1.0))
+    this->outageEvents.emplace(now, _id);
+  else if (this->commsOutageProbability > 0)
+  {
+    const double u = this->OutageUniform(_id, 0, 0.0, 1.0);
+    this->outageEvents.emplace(
+        now - std::log(1.0 - u) / this->commsOutageProbability, _id);
+  }
+}
+
+//////////////////////////////////////////////////
+double CommsModel::OutageUniform(const unsigned int _id,
+    const uint64_t _draw, const double _min, const double _max) const
+{
+  RandomStream stream = RandomStream(this->seed, RandomStream::OUTAGES,
+      RandomStream::MemberKey(this->addresses[_id])).Split(_draw);
+  stream.Seek(static_cast<uint64_t>(this->lastUpdateTime.sec) * 1000000000 +
+      this->lastUpdateTime.nsec);
+  return stream.Uniform(_min, _max);
+}
+
+//////////////////////////////////////////////////
+template <>
+void CommsModel::FillNeighborListUpdaters<kLinkPolicies>(
+    NeighborListUpdater * /*_updaters*/)
+{
+}
+
+//////////////////////////////////////////////////
+template <unsigned int kPolicy>
+void CommsModel::FillNeighborListUpdaters(NeighborListUpdater *_updaters)
+{
+  _updaters[kPolicy] = &CommsModel::UpdateNeighborList<kPolicy>;
+  FillNeighborListUpdaters<kPolicy + 1>(_updaters);
+}
+
+//////////////////////////////////////////////////
+void CommsModel::SelectLinkPolicy()
+{
+  const bool minLimits =
+    this->neighborDistanceMin > 0.0 || this->commsDistanceMin > 0.0;
+  const bool maxLimits =
+    this->neighborDistanceMax >= 0.0 || this->commsDistanceMax >= 0.0;
+  const bool drops =
+    !ignition::math::equal(this->commsDropProbabilityMin, 0.0) ||
+    !ignition::math::equal(this->commsDropProbabilityMax, 0.0);
+
+  const unsigned int policy =
+    treesPolicy(this->neighborDistancePenaltyTree) +
+    3 * treesPolicy(this->commsDistancePenaltyTree) +
+    9 * (minLimits ? 1 : 0) + 18 * (maxLimits ? 1 : 0) + 36 * (drops ? 1 : 0);
+
+  NeighborListUpdater updaters[kLinkPolicies];
+  FillNeighborListUpdaters<0>(updaters);
+  this->updateNeighborList = updaters[policy];
+}
+
+//////////////////////////////////////////////////
+void CommsModel::UpdateNeighbors()
+{
+  const unsigned int n = this->members.size();
+  if (n == 0)
+    return;
+
+  // Update the list of neighbors for each robot. Each robot is updated at
+  // most once per iteration, so the updates are independent.
+  const unsigned int first = this->neighborIndex;
+  const unsigned int count = std::min(this->neighborUpdatesPerCycle, n);
+  if (this->neighborPool)
+  {
+    // The links of the aliases are in the cache entries of their carriers,
+    // so they are updated once the carriers are done.
+    this->neighborPool->Run(count,
+        [this, first, n](const unsigned int _i, const unsigned int _worker)
+        {
+          const unsigned int id = (first + _i) % n;
+          if (this->aliases.empty() || this->carriers[id] < 0)
+          {
+            (this->*this->updateNeighborList)(id,
+                this->neighborScratch[_worker]);
+          }
+        });
+    for (unsigned int i = 0; !this->aliases.empty() && i < count; ++i)
+    {
+      const unsigned int id = (first + i) % n;
+      if (this->carriers[id] >= 0)
+        (this->*this->updateNeighborList)(id, this->neighborScratch[0]);
+    }
+  }
+  else
+  {
+    for (unsigned int i = 0; i < count; ++i)
+    {
+      (this->*this->updateNeighborList)((first + i) % n,
+          this->neighborScratch[0]);
+    }
+  }
+
+  this->neighborIndex = (first + count) % n;
+}
+
+//////////////////////////////////////////////////
+template <unsigned int kPolicy>
+void CommsModel::UpdateNeighborList(const unsigned int _id,
+    std::vector<unsigned int> &_scratch)
+{
+  GZ_ASSERT(_id < this->members.size(), "_id not found in the swarm.");
+
+  auto myPose = this->statePoses->Pose(_id);
+  this->reportedPositions[_id] = myPose.Pos();
+
+  // Only the broadphase candidates can be neighbors. The current neighbors
+  // that are not candidates anymore are removed.
+  const std::vector<unsigned int> &listed = this->neighborIds[_id];
+  const std::vector<unsigned int> &near = this->candidates[_id];
+  _scratch.clear();
+
+  // Each update of a robot draws from its own random streams.
+  ++this->neighborUpdates[_id];
+
+  size_t p = 0;
+  size_t q = 0;
+  while (p < listed.size() || q < near.size())
+  {
+    unsigned int j;
+    if (p == listed.size())
+      j = near[q];
+    else if (q == near.size())
+      j = listed[p];
+    else
+      j = std::min(listed[p], near[q]);
+
+    const bool isListed = p < listed.size() && listed[p] == j;
+    const bool isNear = q < near.size() && near[q] == j;
+    if (isListed)
+      ++p;
+    if (isNear)
+      ++q;
+
+    const size_t pairIndex = this->PairIndex(_id, j);
+    double commsProb = -1.0;
+    if (isNear)
+      commsProb = this->NeighborProbability<kPolicy>(_id, j, myPose.Pos());
+    else
+    {
+      this->SetCommsStatus(_id, j, this->OutOfRangeStatus(_id, j));
+    }
+
+    // Stuff the resulting information into our local representation of this
+    // node; we'll refer back to it later when processing messages sent
+    // between nodes.
+    // Also a message containing the neighbor list (not the probabilities)
+    // will be sent out by the broker, to allow robot controllers to query
+    // the neighbor list.
+    this->neighborProbabilities[pairIndex] = commsProb;
+    if (commsProb >= 0)
+      _scratch.push_back(j);
+  }
+
+  // Each thread only writes the words of the bitsets of its robots.
+  const bool changed = _scratch != listed;
+  if (changed)
+  {
+    ++this->neighborVersions[_id];
+    this->SetNeighborBits(_id, false);
+  }
+  this->neighborIds[_id].swap(_scratch);
+  if (changed)
+    this->SetNeighborBits(_id, true);
+}
+
+//////////////////////////////////////////////////
+template <unsigned int kPolicy>
+double CommsModel::NeighborProbability(const unsigned int _a,
+    const unsigned int _b, const ignition::math::Vector3d &_pos)
+{
+  using Policy = LinkPolicy<kPolicy>;
+
+  const bool outageA = this->outages[_a];
+  const bool outageB = this->outages[_b];
+
+  // Both robots are in an outage.
+  if (outageA && outageB)
+  {
+    this->SetCommsStatus(_a, _b, msgs::CommsStatus::OUTAGE_BOTH);
+    return -1.0;
+  }
+  // I'm in an outage.
+  else if (outageA)
+  {
+    this->SetCommsStatus(_a, _b, msgs::CommsStatus::OUTAGE);
+    return -1.0;
+  }
+  // The other robot is in an outage.
+  else if (outageB)
+  {
+    this->SetCommsStatus(_a, _b, msgs::CommsStatus::OUTAGE_DST);
+    return -1.0;
+  }
+
+  // Do not include myself in the list of neighbors.
+  if (_a == _b)
+  {
+    this->SetCommsStatus(_a, _b, msgs::CommsStatus::VISIBLE);
+    return -1.0;
+  }
+
+  // Check if there's line of sight between the two vehicles.
+  // If there's no line of sight, guess what type of object is in between.
+  const size_t pairIndex = this->PairIndex(_a, _b);
+  if (this->visibility[pairIndex] == 0)
+  {
+    this->SetCommsStatus(_a, _b, msgs::CommsStatus::OBSTACLE);
+    return -1.0;
+  }
+
+  // The obstacles and distances are evaluated again only when one of the
+  // robots moves to another cell of the visibility table.
+  const ignition::math::Vector3d otherPos = this->statePoses->Position(_b);
+  const uint64_t cellA = this->MotionCell(_pos);
+  const uint64_t cellB = this->MotionCell(otherPos);
+  LinkCacheEntry &link = this->linkCache[this->LinkIndex(_a, _b)];
+  if (link.cellA != cellA || link.cellB != cellB)
+  {
+    msgs::CommsStatus status;
+    link.prob = this->LinkGeometry<kPolicy>(_pos, otherPos, status);
+    link.status = static_cast<uint8_t>(status);
+    link.cellA = cellA;
+    link.cellB = cellB;
+  }
+  this->SetCommsStatus(_a, _b, static_cast<msgs::CommsStatus>(link.status));
+
+  double commsProb = link.prob;
+  if (Policy::kDrops && (commsProb > 0.0))
+  {
+    // We made it through the outage, distance, and obstacle filters.
+    // Compute a drop probability between these two nodes for this
+    // time step.
+    commsProb = 1.0 - streamUniform(this->seed,
+      pairIndex, this->neighborUpdates[_a],
+      this->commsDropProbabilityMin,
+      this->commsDropProbabilityMax);
+  }
+
+  return commsProb;
+}
+
+//////////////////////////////////////////////////
+template <unsigned int kPolicy>
+int8_t CommsModel::LinkGeometry(const ignition::math::Vector3d &_posA,
+    const ignition::math::Vector3d &_posB, msgs::CommsStatus &_status)
+{
+  using Policy = LinkPolicy<kPolicy>;
+
+  // Only called for pairs with line of sight over the terrain.
+  bool visible = true;
+  bool treesBlocking;
+  const double dist = _posA.Distance(_posB);
+
+  // Check tree and building interference
+  this->CheckObstacles(_posA, _posB, visible, treesBlocking);
+
+  if (!visible)
+  {
+    _status = msgs::CommsStatus::OBSTACLE;
+    return -1;
+  }
+
+  auto neighborDist = dist;
+  auto commsDist = dist;
+
+  // Apply the neighbor part of the comms model.
+  _status = msgs::CommsStatus::DISTANCE;
+  if (Policy::kNeighborTrees != kTreesIgnored && treesBlocking)
+  {
+    if (Policy::kNeighborTrees == kTreesBlock)
+      return -1;
+    else
+      neighborDist += this->neighborDistancePenaltyTree;
+  }
+
+  if (Policy::kMinLimits && (this->neighborDistanceMin > 0.0) &&
+      (this->neighborDistanceMin > neighborDist))
+  {
+    return -1;
+  }
+  if (Policy::kMaxLimits && (this->neighborDistanceMax >= 0.0) &&
+      (this->neighborDistanceMax < neighborDist))
+  {
+    return -1;
+  }
+
+  // Now apply the comms model to decide if a packet from this neighbor can
+  // arrive, before the random drops.
+  _status = msgs::CommsStatus::VISIBLE;
 
-  // Sanity check: Confirm that the penalty for crossing two lines of trees is
-  // bigger than the maximum neighbor distance.
-  if (this->neighborDistancePenaltyTree * 2 <= this->neighborDistanceMax)
+  if (Policy::kCommsTrees != kTreesIgnored && treesBlocking)
   {
-    std::cerr << "The combination of <neighborDistancePenaltyTree> and "
-              << " <neighborDistanceMax> violates the rule that no more than "
-              << "one line of trees is allowed between vehicles to communicate "
-              << "(2*neighborDistancePenaltyTree > neighborDistanceMax)."
-              << std::endl;
+    if (Policy::kCommsTrees == kTreesBlock)
+      return 0;
+    else
+      commsDist += this->commsDistancePenaltyTree;
   }
+  if (Policy::kMinLimits && (this->commsDistanceMin > 0.0) &&
+      (this->commsDistanceMin > commsDist))
+    return 0;
+  if (Policy::kMaxLimits && (this->commsDistanceMax >= 0.0) &&
+      (this->commsDistanceMax < commsDist))
+    return 0;
+
+  return 1;
+}
 
-  // Sanity check: Confirm that the penalty for crossing two lines of trees is
-  // bigger than the maximum comms distance.
-  if (this->commsDistancePenaltyTree * 2 <= this->commsDistanceMax)
+//////////////////////////////////////////////////
+msgs::CommsStatus CommsModel::OutOfRangeStatus(const unsigned int _a,
+    const unsigned int _b) const
+{
+  const bool outageA = this->outages[_a];
+  const bool outageB = this->outages[_b];
+
+  if (outageA && outageB)
+    return msgs::CommsStatus::OUTAGE_BOTH;
+  else if (outageA)
+    return msgs::CommsStatus::OUTAGE;
+  else if (outageB)
+    return msgs::CommsStatus::OUTAGE_DST;
+  else if (_a == _b)
+    return msgs::CommsStatus::VISIBLE;
+
+  return msgs::CommsStatus::OBSTACLE;
+}
+
+//////////////////////////////////////////////////
+void CommsModel::RefreshOutOfRangeStatus(const unsigned int _id)
+{
+  // The candidates are refreshed by the next UpdateNeighborList().
+  const std::vector<unsigned int> &near = this->candidates[_id];
+  for (unsigned int j = 0; j < this->members.size(); ++j)
   {
-    std::cerr << "The combination of <commsDistancePenaltyTree> and "
-              << " <commsDistanceMax> violates the rule that no more than "
-              << "one line of trees is allowed between vehicles to communicate "
-              << "(2*commsDistancePenaltyTree > commsDistanceMax)."
-              << std::endl;
+    if (std::binary_search(near.begin(), near.end(), j))
+      continue;
+
+    this->SetCommsStatus(_id, j, this->OutOfRangeStatus(_id, j));
+    this->SetCommsStatus(j, _id, this->OutOfRangeStatus(j, _id));
   }
+}
 
-  this->CacheVisibilityPairs();
+//////////////////////////////////////////////////
+void CommsModel::UpdateBroadphase()
+{
+  const unsigned int n = this->members.size();
 
-  // Initialize visibility.
-  for (auto const &robotA : (*this->swarm))
+  // The candidates hold until the end of the cycle as long as no robot
+  // moves more than half of the margin: no pair can then get closer than
+  // the margin, and enter the range without being a candidate.
+  if (this->broadphaseCountdown > 0)
   {
-    auto addressA = robotA.second->address;
-    auto row = this->visibilityMsg.add_row();
-    row->set_src(addressA);
+    --this->broadphaseCountdown;
+    if (this->commsDistanceMax < 0)
+      return;
 
-    for (auto const &robotB : (*this->swarm))
+    bool moved = false;
+    for (unsigned int i = 0; i < n && !moved; ++i)
     {
-      auto addressB = robotB.second->address;
-      this->visibility[std::make_pair(addressA, addressB)] = false;
-
-      // Create a new visibility entry for logging with a VISIBLE status.
-      auto visibilityEntry = row->add_entry();
-      visibilityEntry->set_dst(addressB);
-      visibilityEntry->set_status(msgs::CommsStatus::VISIBLE);
-
-      this->visibilityMsgStatus[addressA][addressB] = visibilityEntry;
+      moved = this->statePoses->Position(i).Distance(this->positions[i]) >
+        0.5 * this->broadphaseMargin;
     }
+    if (!moved)
+      return;
   }
+  this->broadphaseCountdown = this->cycleSteps - 1;
 
-  std::string tableFilename = "/tmp/visibility.dat";
-  struct stat buffer;
-  if (stat(tableFilename.c_str(), &buffer) != 0)
-  {
-    std::cout << "Generating visibility table[/tmp/visibility.dat]\n.";
-    VisibilityTable table;
-    table.Generate();
-  }
+  for (unsigned int i = 0; i < n; ++i)
+    this->positions[i] = this->statePoses->Position(i);
 
-  // Read the visibility table information
-  std::ifstream tableIn(tableFilename, std::ios::binary | std::ios::in);
-  tableIn.read(reinterpret_cast<char*>(&this->visibilityTableMaxY),
-      sizeof(int));
-  tableIn.read(reinterpret_cast<char*>(&this->visibilityTableStepSize),
-      sizeof(int));
-  tableIn.read(reinterpret_cast<char*>(&this->visibilityTableRowSize),
-      sizeof(int));
+  // Robots farther than <comms_distance_max> are never visible, and only
+  // visible robots can be neighbors. With a negative limit nobody is.
+  const double range = this->commsDistanceMax < 0 ? -1.0 :
+    this->commsDistanceMax + this->broadphaseMargin;
+  const double cellSize = std::max(1.0, range);
 
-  while (true)
+  // Hash each robot in a uniform grid of cells as large as the range, so
+  // the candidates of a robot are in the 3x3 cells around it.
+  auto cellKey = [](const int64_t _x, const int64_t _y)
   {
-    uint64_t data;
-    tableIn.read((char*)(&data), sizeof(uint64_t));
-    if (!tableIn.eof())
-      this->visibilityTable.emplace(data);
-    else
-      break;
+    return (static_cast<uint64_t>(static_cast<uint32_t>(_x)) << 32) |
+      static_cast<uint32_t>(_y);
+  };
+  for (unsigned int i = 0; i < n; ++i)
+  {
+    this->cells[i].first = cellKey(
+        static_cast<int64_t>(std::floor(this->positions[i].X() / cellSize)),
+        static_cast<int64_t>(std::floor(this->positions[i].Y() / cellSize)));
+    this->cells[i].second = i;
   }
+  std::sort(this->cells.begin(), this->cells.end());
 
-  // Get all the trees
-  for (auto const &model : this->world->GetModels())
+  // Robots that leave the range of each other are not visible anymore.
+  for (auto const &pair : this->visibilityPairs)
   {
-    if (model->GetName().find("tree") != std::string::npos)
+    if (this->positions[pair.first].Distance(this->positions[pair.second]) >
+        range)
     {
-      this->trees.push_back(model->GetBoundingBox().Ign());
+      this->visibility[this->PairIndex(pair.first, pair.second)] = 0;
+      this->visibility[this->PairIndex(pair.second, pair.first)] = 0;
+      this->refreshCells[this->PairIndex(pair.first, pair.second)] =
+        kNotRefreshed;
+      this->refreshCells[this->PairIndex(pair.second, pair.first)] =
+        kNotRefreshed;
     }
-    else if (model->GetName().find("building") != std::string::npos)
+  }
+
+  this->visibilityPairs.clear();
+  for (unsigned int i = 0; i < n; ++i)
+  {
+    const ignition::math::Vector3d &pos = this->positions[i];
+    const int64_t cx = static_cast<int64_t>(std::floor(pos.X() / cellSize));
+    const int64_t cy = static_cast<int64_t>(std::floor(pos.Y() / cellSize));
+
+    this->scratch.clear();
+    if (range < 0)
+      this->scratch.push_back(i);
+    else
     {
-      this->buildings.push_back(model->GetBoundingBox().Ign());
+      for (int64_t x = cx - 1; x <= cx + 1; ++x)
+      {
+        for (int64_t y = cy - 1; y <= cy + 1; ++y)
+        {
+          const uint64_t key = cellKey(x, y);
+          auto cell = std::lower_bound(this->cells.begin(), this->cells.end(),
+              std::make_pair(key, 0u));
+          for (; cell != this->cells.end() && cell->first == key; ++cell)
+          {
+            if (pos.Distance(this->positions[cell->second]) <= range)
+              this->scratch.push_back(cell->second);
+          }
+        }
+      }
+      std::sort(this->scratch.begin(), this->scratch.end());
     }
-  }
-}
 
-//////////////////////////////////////////////////
-void CommsModel::Update()
-{
-  // Decide if each member of the swarm enters into a comms outage.
-  this->UpdateOutages();
+    // Refresh the logged status of the robots that are not candidates
+    // anymore.
+    for (auto const &j : this->candidates[i])
+    {
+      if (!std::binary_search(this->scratch.begin(), this->scratch.end(), j))
+      {
+        this->SetCommsStatus(i, j, this->OutOfRangeStatus(i, j));
+      }
+    }
+    this->candidates[i].swap(this->scratch);
 
-  // Update the visibility state between vehicles.
-  // Make sure that this happens after UpdateOutages().
-  this->UpdateVisibility();
+    for (auto const &j : this->candidates[i])
+    {
+      if (j > i)
+        this->visibilityPairs.emplace_back(i, j);
+    }
+  }
 
-  // Update the neighbors list of each member of the swarm.
-  // Make sure that this happens after UpdateVisibility().
-  this->UpdateNeighbors();
+  // Spread the visibility updates over the comms cycle. The budget depends
+  // on all the pairs, so the pairs that move are refreshed more often when
+  // others are stationary.
+  this->visibilityUpdatesFull =
+    (this->visibilityPairs.size() + this->cycleSteps - 1) / this->cycleSteps;
+  this->ApplyFidelity();
+  this->ScheduleVisibility();
 }
 
 //////////////////////////////////////////////////
-const msgs::VisibilityMap &CommsModel::VisibilityMap() const
+void CommsModel::ScheduleVisibility()
 {
-  return this->visibilityMsg;
-}
+  for (size_t i = 0; i < this->members.size(); ++i)
+    this->robotCells[i] = this->MotionCell(this->positions[i]);
 
-/////////////////////////////////////////////////
-double CommsModel::AvgNeighbors() const
-{
-  int numRobots = 0;
-  int numNeighbors = 0;
-  for (int i = 0; i < this->visibilityMsg.row_size(); ++i)
+  this->visibilitySchedule.clear();
+  for (unsigned int i = 0; i < this->visibilityPairs.size(); ++i)
   {
-    const msgs::VisibilityRow &row = this->visibilityMsg.row(i);
-    if (row.src() == "boo")
+    auto const &pair = this->visibilityPairs[i];
+    const uint64_t lastA =
+      this->refreshCells[this->PairIndex(pair.first, pair.second)];
+    const uint64_t lastB =
+      this->refreshCells[this->PairIndex(pair.second, pair.first)];
+
+    // The pairs of the aliases are copied from their carriers.
+    if (!this->aliases.empty() && (this->carriers[pair.first] >= 0 ||
+          this->carriers[pair.second] >= 0))
+    {
       continue;
+    }
 
-    numRobots += 1;
-    for (int j = 0; j < row.entry_size(); ++j)
+    // Pairs never computed go first, and stationary pairs are skipped.
+    unsigned int moved = std::numeric_limits<unsigned int>::max();
+    if (lastA != kNotRefreshed && lastB != kNotRefreshed)
     {
-      if (row.entry(j).status() == msgs::CommsStatus::VISIBLE)
-      {
-        numNeighbors += 1;
-      }
+      moved = cellDistance(this->robotCells[pair.first], lastA) +
+        cellDistance(this->robotCells[pair.second], lastB);
+      if (moved == 0)
+        continue;
     }
+    this->visibilitySchedule.emplace_back(moved, i);
   }
 
-  return numNeighbors / static_cast<double>(numRobots);
+  std::sort(this->visibilitySchedule.begin(), this->visibilitySchedule.end(),
+      [](const std::pair<unsigned int, unsigned int> &_a,
+         const std::pair<unsigned int, unsigned int> &_b)
+      {
+        return _a.first > _b.first ||
+          (_a.first == _b.first && _a.second < _b.second);
+      });
+  this->visibilityIndex = 0;
 }
 
 //////////////////////////////////////////////////
-uint32_t CommsModel::MaxDataRate() const
+uint64_t CommsModel::MotionCell(const ignition::math::Vector3d &_pos) const
 {
-  return this->commsDataRateMax;
+  return packCell(
+      static_cast<int64_t>(std::floor(_pos.X() / this->motionCellSize)),
+      static_cast<int64_t>(std::floor(_pos.Y() / this->motionCellSize)),
+      static_cast<int64_t>(std::floor(_pos.Z() / this->motionCellSize)));
 }
 
 //////////////////////////////////////////////////
-uint16_t CommsModel::UdpOverhead() const
+size_t CommsModel::PairIndex(const unsigned int _a,
+    const unsigned int _b) const
 {
-  return this->udpOverhead;
+  return static_cast<size_t>(_a) * this->members.size() + _b;
 }
 
 //////////////////////////////////////////////////
-void CommsModel::UpdateOutages()
+void CommsModel::CacheVisibilityPairs()
 {
-  gazebo::common::Time curTime = this->world->GetSimTime();
-
-  // In case we reset simulation.
-  if (curTime <= this->lastUpdateTime)
+  // Assign an index to each robot.
+  for (auto const &robot : (*this->swarm))
   {
-    this->lastUpdateTime = curTime;
-    return;
+    this->addresses.push_back(robot.first);
+    this->members.push_back(robot.second);
+    this->outages.push_back(robot.second->onOutage);
   }
 
-  // Get elapsed time since the last update.
-  auto dt = curTime - this->lastUpdateTime;
+  // The poses of the robots are read by id from the snapshot.
+  std::vector<gazebo::physics::ModelPtr> models;
+  for (auto const &member : this->members)
+    models.push_back(member->model);
+  this->poses->SetModels(models);
 
-  for (auto const &robot : (*this->swarm))
-  {
-    auto address = robot.first;
-    auto swarmMember = robot.second;
+  const size_t n = this->members.size();
+  this->positions.resize(n);
+  this->robotCells.resize(n);
+  this->cells.resize(n);
 
-    // Check if I am currently on a temporary outage.
-    if (swarmMember->onOutage &&
-        swarmMember->onOutageUntil != gazebo::common::Time::Zero)
-    {
-      // Check if the outage should finish.
-      if (this->world->GetSimTime() >= swarmMember->onOutageUntil)
-      {
-        swarmMember->onOutage = false;
+  const double steps = (1.0 / this->updateRate) /
+    this->world->GetPhysicsEngine()->GetMaxStepSize();
+  this->cycleSteps = std::max(1u, static_cast<unsigned int>(steps));
 
-        // Debug output.
-        // gzdbg << "[" << curTime << "] Robot " << address
-        //       << " is back from an outage." << std::endl;
-      }
-    }
-    else if (!swarmMember->onOutage)
-    {
-      // Check if we should go into an outage.
-      // Notice that "commsOutageProbability" specifies the probability of going
-      // into a comms outage at each second. This probability is adjusted using
-      // the elapsed time since the last call to "UpdateOutages()".
-      if ((ignition::math::equal(this->commsOutageProbability, 1.0)) ||
-          (ignition::math::Rand::DblUniform(0.0, 1.0) <
-           this->commsOutageProbability * dt.Double()))
-      {
-        swarmMember->onOutage = true;
-        // Debug output.
-        // gzdbg << "[" << curTime << "] Robot " << address
-        //       << " has started an outage." << std::endl;
-
-        // Decide the duration of the outage.
-        if (this->commsOutageDurationMin < 0 ||
-            this->commsOutageDurationMax < 0)
-        {
-          // Permanent outage.
-          swarmMember->onOutageUntil = gazebo::common::Time::Zero;
-        }
-        else
-        {
-          // Temporal outage.
-          swarmMember->onOutageUntil = curTime +
-            ignition::math::Rand::DblUniform(
-              this->commsOutageDurationMin,
-              this->commsOutageDurationMax);
-        }
-      }
-    }
+  this->neighborUpdatesFull = this->swarm->size() / steps;
+
+  if (n > 1)
+  {
+    // Make sure that we update at least one element in each update.
+    this->neighborUpdatesFull = std::max(1u, this->neighborUpdatesFull);
   }
+  this->neighborUpdatesPerCycle = this->neighborUpdatesFull;
+}
 
-  this->lastUpdateTime = curTime;
+//////////////////////////////////////////////////
+bool CommsModel::AdaptiveFidelity() const
+{
+  return this->adaptiveFidelity;
 }
 
 //////////////////////////////////////////////////
-void CommsModel::UpdateNeighbors()
+void CommsModel::AdaptFidelity(const double _stepWallTime)
 {
-  unsigned int counter = 0;
+  if (!this->adaptiveFidelity)
+    return;
 
-  // Update the list of neighbors for each robot.
-  while (counter < this->neighborUpdatesPerCycle)
-  {
-    auto const &address = this->addresses.at(this->neighborIndex);
-    this->UpdateNeighborList(address);
+  this->WaitUpdate();
+  this->fidelityWallTime += _stepWallTime;
+  if (++this->fidelitySteps < std::max(kFidelityWindow, this->cycleSteps))
+    return;
 
-    this->neighborIndex = (this->neighborIndex + 1) % this->addresses.size();
-    ++counter;
+  const double wallTime = this->fidelityWallTime / this->fidelitySteps;
+  this->fidelityWallTime = 0;
+  this->fidelitySteps = 0;
+
+  const double target = this->world->GetPhysicsEngine()->GetMaxStepSize() /
+    this->targetRealTimeFactor;
+  const double minScale = std::min(this->visibilityFloor, this->neighborFloor);
+  double scale = this->fidelityScale;
+  if (wallTime > target * (1.0 + kFidelityDegradeMargin))
+    scale = std::max(minScale, scale * kFidelityDecrease);
+  else if (wallTime < target * (1.0 - kFidelityRestoreMargin))
+    scale = std::min(1.0, scale + kFidelityIncrease);
+
+  // Below both floors, the budgets don't change anymore.
+  if (ignition::math::equal(scale, this->fidelityScale))
+    return;
+
+  const double visibilityScale = std::max(this->visibilityFloor, scale);
+  const double neighborScale = std::max(this->neighborFloor, scale);
+  if (this->fidelityScale >= 1.0)
+  {
+    std::cout << "CommsModel: The steps take " << wallTime * 1e3
+              << " ms, over the target of " << target * 1e3 << " ms. "
+              << "Reducing the visibility and neighbor updates." << std::endl;
   }
+  else if (scale >= 1.0)
+    std::cout << "CommsModel: Back to full fidelity." << std::endl;
+  this->fidelityScale = scale;
+  this->ApplyFidelity();
+
+  if (this->fidelityChanges.size() >= kMaxFidelityChanges)
+    this->fidelityChanges.erase(this->fidelityChanges.begin());
+  msgs::CommsFidelity change;
+  change.set_time(this->world->GetSimTime().Double());
+  change.set_visibility_scale(visibilityScale);
+  change.set_neighbor_scale(neighborScale);
+  change.set_step_wall_time(wallTime);
+  change.set_target_wall_time(target);
+  this->fidelityChanges.push_back(change);
 }
 
 //////////////////////////////////////////////////
-void CommsModel::UpdateNeighborList(const std::string &_address)
+bool CommsModel::FidelityChanged() const
 {
-  GZ_ASSERT(this->swarm->find(_address) != this->swarm->end(),
-            "_address not found in the swarm.");
+  return !this->fidelityChanges.empty();
+}
 
-  auto swarmMember = (*this->swarm)[_address];
-  auto myPose = swarmMember->model->GetWorldPose().Ign();
+//////////////////////////////////////////////////
+void CommsModel::TakeFidelityChanges(
+    google::protobuf::RepeatedPtrField<msgs::CommsFidelity> &_changes)
+{
+  for (const auto &change : this->fidelityChanges)
+    _changes.Add()->CopyFrom(change);
+  this->fidelityChanges.clear();
+}
 
-  // Initialize the neighbors list.
-  swarmMember->neighbors.clear();
+//////////////////////////////////////////////////
+void CommsModel::ApplyFidelity()
+{
+  // A budget scaled down keeps at least one update per step, if it had any.
+  auto scaled = [](const unsigned int _full, const double _scale)
+  {
+    if (_full == 0)
+      return 0u;
+    return std::max(1u, static_cast<unsigned int>(std::ceil(_full * _scale)));
+  };
+
+  this->visibilityUpdatesPerCycle = scaled(this->visibilityUpdatesFull,
+      std::max(this->visibilityFloor, this->fidelityScale));
+  this->neighborUpdatesPerCycle = scaled(this->neighborUpdatesFull,
+      std::max(this->neighborFloor, this->fidelityScale));
+}
 
-  // Decide whether this node goes into our neighbor list.
-  for (auto const &member : (*this->swarm))
+//////////////////////////////////////////////////
+void CommsModel::UpdateVisibility()
+{
+  // Scheduled pairs, round robin. A pair is computed again only if one of
+  // its robots changed cell since the last time, so the pairs that move
+  // the most can be computed several times per cycle.
+  const unsigned int scheduled = this->visibilitySchedule.size();
+  unsigned int counter = 0;
+  for (unsigned int visited = 0;
+       visited < scheduled && counter < this->visibilityUpdatesPerCycle;
+       ++visited)
   {
-    // Where is the other node?
-    auto other = member.second;
+    auto const &pair = this->visibilityPairs[
+      this->visibilitySchedule[this->visibilityIndex].second];
+    const size_t keyA = this->PairIndex(pair.first, pair.second);
+    const size_t keyB = this->PairIndex(pair.second, pair.first);
 
-    // Update this visibility entry with a VISIBLE status.
-    auto visibilityEntry = this->visibilityMsgStatus[_address][other->address];
-    visibilityEntry->set_status(msgs::CommsStatus::VISIBLE);
+    this->visibilityIndex = (this->visibilityIndex + 1) % scheduled;
 
-    // Both robots are in an outage.
-    if (swarmMember->onOutage && other->onOutage)
-    {
-      visibilityEntry->set_status(msgs::CommsStatus::OUTAGE_BOTH);
-      continue;
-    }
-    // I'm in an outage.
-    else if (swarmMember->onOutage)
-    {
-      visibilityEntry->set_status(msgs::CommsStatus::OUTAGE);
-      continue;
-    }
-    // The other robot is in an outage.
-    else if (other->onOutage)
+    // The pairs of the aliases are copied from their carriers.
+    if (!this->aliases.empty() && (this->carriers[pair.first] >= 0 ||
+          this->carriers[pair.second] >= 0))
     {
-      visibilityEntry->set_status(msgs::CommsStatus::OUTAGE_DST);
       continue;
     }
 
-    // Do not include myself in the list of neighbors.
-    if (other->address == _address)
-      continue;
-
-    // Check if there's line of sight between the two vehicles.
-    // If there's no line of sight, guess what type of object is in between.
-    auto key = std::make_pair(_address, other->address);
-    GZ_ASSERT(this->visibility.find(key) != this->visibility.end(),
-      "vehicle key not found in visibility");
-
-    bool visible = this->visibility[key];
-    if (!visible)
-    {
-      visibilityEntry->set_status(msgs::CommsStatus::OBSTACLE);
+    auto poseA = this->statePoses->Pose(pair.first);
+    auto poseB = this->statePoses->Pose(pair.second);
+    const uint64_t cellA = this->MotionCell(poseA.Pos());
+    const uint64_t cellB = this->MotionCell(poseB.Pos());
+    if (this->refreshCells[keyA] == cellA && this->refreshCells[keyB] == cellB)
       continue;
-    }
-
-    auto otherPose = other->model->GetWorldPose().Ign();
-    bool treesBlocking;
-    double dist;
-
-    // Check tree and building interference
-    this->CheckObstacles(myPose.Pos(), otherPose.Pos(),
-                         visible, treesBlocking, dist);
 
-    if (!visible)
-    {
-      visibilityEntry->set_status(msgs::CommsStatus::OBSTACLE);
-      continue;
-    }
+    ++counter;
+    this->refreshCells[keyA] = cellA;
+    this->refreshCells[keyB] = cellB;
 
-    auto neighborDist = dist;
-    auto commsDist = dist;
+    if (poseA.Pos().Distance(poseB.Pos()) <= this->commsDistanceMax)
+      this->visibility[keyA] = this->LineOfSight(poseA, poseB);
+    else
+      this->visibility[keyA] = false;
 
-    // Apply the neighbor part of the comms model.
-    if (!ignition::math::equal(this->neighborDistancePenaltyTree, 0.0))
-    {
-      // We're within range.  Check for obstacles (don't want to waste time on
-      // that if we're not within range).
-      if (treesBlocking)
-      {
-        if (this->neighborDistancePenaltyTree < 0.0)
-        {
-          visibilityEntry->set_status(msgs::CommsStatus::DISTANCE);
-          continue;
-        }
-        else
-          neighborDist += this->neighborDistancePenaltyTree;
-      }
-    }
+    // Update the symmetric case.
+    this->visibility[keyB] = this->visibility[keyA];
+  }
 
-    if ((this->neighborDistanceMin > 0.0) &&
-        (this->neighborDistanceMin > neighborDist))
-    {
-      visibilityEntry->set_status(msgs::CommsStatus::DISTANCE);
-      continue;
-    }
-    if ((this->neighborDistanceMax >= 0.0) &&
-        (this->neighborDistanceMax < neighborDist))
-    {
-      visibilityEntry->set_status(msgs::CommsStatus::DISTANCE);
-      continue;
-    }
+  this->AliasVisibility();
+}
 
-    // Now apply the comms model to compute a probability of a packet from
-    // this neighbor arriving successfully.
-    auto commsProb = 1.0;
+//////////////////////////////////////////////////
+void CommsModel::UpdateCarriers()
+{
+  const unsigned int n = this->members.size();
+  if (this->aliases.empty() && this->statePoses->Aliases() == 0 &&
+      this->carriers.size() == n)
+  {
+    return;
+  }
 
-    if ((commsProb > 0.0) &&
-        (!ignition::math::equal(this->commsDistancePenaltyTree, 0.0)))
+  this->carriers.resize(n, -1);
+  this->aliases.clear();
+  for (unsigned int i = 0; i < n; ++i)
+  {
+    const int carrier =
+      i < this->statePoses->Size() ? this->statePoses->Carrier(i) : -1;
+    if (carrier != this->carriers[i])
     {
-      // We're within range.  Check for obstacles (don't want to waste time on
-      // that if we're not within range).
-      if (treesBlocking)
+      this->carriers[i] = carrier;
+      for (unsigned int j = 0; j < n; ++j)
       {
-        if (this->commsDistancePenaltyTree < 0.0)
-          commsProb = 0.0;
-        else
-          commsDist += this->commsDistancePenaltyTree;
+        this->refreshCells[this->PairIndex(i, j)] = kNotRefreshed;
+        this->refreshCells[this->PairIndex(j, i)] = kNotRefreshed;
       }
     }
-    if ((commsProb > 0.0) &&
-        (this->commsDistanceMin > 0.0) &&
-        (this->commsDistanceMin > commsDist))
-      commsProb = 0.0;
-    if ((commsProb > 0.0) &&
-        (this->commsDistanceMax >= 0.0) &&
-        (this->commsDistanceMax < commsDist))
-      commsProb = 0.0;
-
-    if (commsProb > 0.0)
-    {
-      // We made it through the outage, distance, and obstacle filters.
-      // Compute a drop probability between these two nodes for this
-      // time step.
-      commsProb = 1.0 - ignition::math::Rand::DblUniform(
-        this->commsDropProbabilityMin,
-        this->commsDropProbabilityMax);
-    }
 
-    // Stuff the resulting information into our local representation of this
-    // node; we'll refer back to it later when processing messages sent
-    // between nodes.
-    // Also a message containing the neighbor list (not the probabilities)
-    // will be sent out below, to allow robot controllers to query the
-    // neighbor list.
-    swarmMember->neighbors[member.first] = commsProb;
+    if (carrier >= 0)
+      this->aliases.push_back(i);
   }
 }
 
 //////////////////////////////////////////////////
-void CommsModel::CacheVisibilityPairs()
+void CommsModel::AliasVisibility()
 {
-  for (auto const &robotA : (*this->swarm))
+  for (const unsigned int a : this->aliases)
   {
-    auto addressA = robotA.second->address;
-    this->addresses.push_back(addressA);
-    for (auto const &robotB : (*this->swarm))
+    const unsigned int carrier = this->carriers[a];
+    for (const unsigned int j : this->candidates[a])
     {
-      auto addressB = robotB.second->address;
-      std::pair<std::string, std::string> aPair(addressA, addressB);
-      std::pair<std::string, std::string> aPairInverse(addressB, addressA);
-
-      // Do not include this case.
-      if (addressA == addressB)
-        continue;
-
-      // Check if we already have the symmetric pair stored.
-      if (std::find(this->visibilityPairs.begin(), this->visibilityPairs.end(),
-            aPairInverse) != this->visibilityPairs.end())
-      {
+      if (j == a)
         continue;
-      }
 
-      this->visibilityPairs.push_back(aPair);
+      // An alias sees its carrier, and the other aliases of it.
+      const unsigned int other =
+        this->carriers[j] >= 0 ? this->carriers[j] : j;
+      const uint8_t visible = other == carrier ? 1 :
+        this->visibility[this->PairIndex(carrier, other)];
+      this->visibility[this->PairIndex(a, j)] = visible;
+      this->visibility[this->PairIndex(j, a)] = visible;
     }
   }
+}
 
-  this->visibilityUpdatesPerCycle = this->visibilityPairs.size() /
-      ((1.0 / this->updateRate) /
-       this->world->GetPhysicsEngine()->GetMaxStepSize());
-
-  this->neighborUpdatesPerCycle = this->swarm->size() /
-      ((1.0 / this->updateRate) /
-       this->world->GetPhysicsEngine()->GetMaxStepSize());
-
-  if (this->visibilityPairs.size() > 0)
-  {
-    // Make sure that we update at least one element in each update.
-    this->visibilityUpdatesPerCycle = std::max(1u,
-        this->visibilityUpdatesPerCycle);
+//////////////////////////////////////////////////
+size_t CommsModel::LinkIndex(const unsigned int _a,
+    const unsigned int _b) const
+{
+  if (this->aliases.empty())
+    return this->PairIndex(_a, _b);
 
-    this->neighborUpdatesPerCycle = std::max(1u,
-        this->neighborUpdatesPerCycle);
-  }
+  const unsigned int a = this->carriers[_a] >= 0 ? this->carriers[_a] : _a;
+  const unsigned int b = this->carriers[_b] >= 0 ? this->carriers[_b] : _b;
+  return a == b ? this->PairIndex(_a, _b) : this->PairIndex(a, b);
 }
 
 //////////////////////////////////////////////////
-void CommsModel::UpdateVisibility()
+bool CommsModel::LineOfSight(const ignition::math::Pose3d& _p1,
+                             const ignition::math::Pose3d& _p2)
 {
-  unsigned int counter = 0;
-
-  // All combinations between a pair of vehicles.
-  while (counter < this->visibilityUpdatesPerCycle)
+  // The finest level of the table that stores the pair answers it. The
+  // pairs that no level stores are outside of the table.
+  const VisibilityLookup *table = &this->visibilityTable;
+  uint64_t index1 = table->Index(_p1.Pos().X(), _p1.Pos().Y());
+  uint64_t index2 = table->Index(_p2.Pos().X(), _p2.Pos().Y());
+  for (size_t i = 0; i < this->coarseTables.size() &&
+       !table->InRange(index1, index2); ++i)
   {
-    auto const &keyA = this->visibilityPairs.at(this->visibilityIndex);
-    auto addressA = keyA.first;
-    auto addressB = keyA.second;
-    auto keyB = std::make_pair(addressB, addressA);
-
-    this->visibilityIndex =
-      (this->visibilityIndex + 1) % this->visibilityPairs.size();
-    ++counter;
+    table = this->coarseTables[i].get();
+    index1 = table->Index(_p1.Pos().X(), _p1.Pos().Y());
+    index2 = table->Index(_p2.Pos().X(), _p2.Pos().Y());
+  }
+  const bool outside = !table->InRange(index1, index2);
 
-    auto poseA = (*swarm)[addressA]->model->GetWorldPose().Ign();
-    auto poseB = (*swarm)[addressB]->model->GetWorldPose().Ign();
-    if (poseA.Pos().Distance(poseB.Pos()) <= this->commsDistanceMax)
-      this->visibility[keyA] = this->LineOfSight(poseA, poseB);
-    else
-      this->visibility[keyA] = false;
+  // Clearance tables know the altitude of the endpoints.
+  if (!outside && table->Format() == CLEARANCE)
+    return table->Visible(index1, _p1.Pos().Z(), index2, _p2.Pos().Z());
 
-    // Update the symmetric case.
-    this->visibility[keyB] = this->visibility[keyA];
+  const Heightmap &heightmap = this->common.TerrainHeightmap();
+  if (heightmap.Valid())
+  {
+    // The other tables are generated 1 meter above the terrain. Use the
+    // heightmap when there's no table, outside of it, or for vehicles that
+    // are flying above that height.
+    ignition::math::Vector3d p1 = _p1.Pos();
+    ignition::math::Vector3d p2 = _p2.Pos();
+    const double ground1 = heightmap.HeightAt(p1.X(), p1.Y()) + 1;
+    const double ground2 = heightmap.HeightAt(p2.X(), p2.Y()) + 1;
+    if (outside || p1.Z() > ground1 + kFlyingHeight ||
+        p2.Z() > ground2 + kFlyingHeight)
+    {
+      p1.Z(std::max(p1.Z(), ground1));
+      p2.Z(std::max(p2.Z(), ground2));
+      return heightmap.LineOfSight(p1, p2);
+    }
   }
+
+  return outside || table->Visible(index1, index2);
 }
 
 //////////////////////////////////////////////////
-bool CommsModel::LineOfSight(const ignition::math::Pose3d& _p1,
-                             const ignition::math::Pose3d& _p2)
+bool CommsModel::OnGround(const ignition::math::Vector3d &_pos) const
 {
-  int index1 = this->Index(_p1.Pos());
-  int index2 = this->Index(_p2.Pos());
-
-  return
-    this->visibilityTable.find(this->Pair(index1, index2))
-    == this->visibilityTable.end() &&
-    this->visibilityTable.find(this->Pair(index2, index1))
-    == this->visibilityTable.end();
+  const Heightmap &heightmap = this->common.TerrainHeightmap();
+  return !heightmap.Valid() ||
+    _pos.Z() <= heightmap.HeightAt(_pos.X(), _pos.Y()) + 1 + kFlyingHeight;
 }
 
 //////////////////////////////////////////////////
@@ -588,71 +2012,74 @@ void CommsModel::LoadParameters(sdf::ElementPtr _sdf)
       this->commsDataRateMax =
         commsModelElem->Get<double>("comms_data_rate_max");
     }
+    if (commsModelElem->HasElement("comms_latency"))
+    {
+      this->commsLatency = commsModelElem->Get<double>("comms_latency");
+    }
     if (commsModelElem->HasElement("update_rate"))
     {
       this->updateRate = commsModelElem->Get<double>("update_rate");
     }
-  }
-}
-
-/////////////////////////////////////////////////
-uint64_t CommsModel::Pair(const int _a, const int _b)
-{
-  // Szudzik's function
-  return _a >= _b ?  _a * _a + _a + _b : _a + _b * _b;
-}
-
-/////////////////////////////////////////////////
-int CommsModel::Index(const ignition::math::Vector3d &_p)
-{
-  int x = std::round(_p.X() / this->visibilityTableStepSize) *
-    this->visibilityTableStepSize;
+    if (commsModelElem->HasElement("pipelined"))
+      this->pipelined = commsModelElem->Get<bool>("pipelined");
+    if (commsModelElem->HasElement("adaptive_fidelity"))
+    {
+      auto const fidelityElem = commsModelElem->GetElement("adaptive_fidelity");
+      this->adaptiveFidelity = true;
+      if (fidelityElem->HasElement("target_real_time_factor"))
+      {
+        this->targetRealTimeFactor =
+          fidelityElem->Get<double>("target_real_time_factor");
+      }
+      if (fidelityElem->HasElement("visibility_floor"))
+      {
+        this->visibilityFloor =
+          fidelityElem->Get<double>("visibility_floor");
+      }
+      if (fidelityElem->HasElement("neighbor_floor"))
+        this->neighborFloor = fidelityElem->Get<double>("neighbor_floor");
 
-  int y = std::round(_p.Y() / this->visibilityTableStepSize) *
-    this->visibilityTableStepSize;
+      if (this->targetRealTimeFactor <= 0)
+      {
+        std::cerr << "CommsModel: <target_real_time_factor> must be "
+                  << "positive. Using 1.0" << std::endl;
+        this->targetRealTimeFactor = 1.0;
+      }
+      this->visibilityFloor =
+        ignition::math::clamp(this->visibilityFloor, 0.01, 1.0);
+      this->neighborFloor =
+        ignition::math::clamp(this->neighborFloor, 0.01, 1.0);
+    }
+  }
 
-  return ((y + this->visibilityTableMaxY)/ this->visibilityTableStepSize) *
-    this->visibilityTableRowSize +
-    ((x + this->visibilityTableMaxY)/this->visibilityTableStepSize);
+  // Specialize the neighbor updates for these parameters.
+  this->SelectLinkPolicy();
 }
 
 /////////////////////////////////////////////////
 void CommsModel::CheckObstacles(const ignition::math::Vector3d &_posA,
     const ignition::math::Vector3d &_posB,
-    bool &_visible, bool &_treesBlocking, double &_dist)
+    bool &_visible, bool &_treesBlocking)
 {
-  ignition::math::Vector3d origin = _posA;
-  ignition::math::Vector3d dir = (_posB - _posA).Normalize();
-
-  _treesBlocking = false;
-  bool intersects = false;
-  double dist = 0;
-
-  for (auto const &building : this->buildings)
+  // One lookup in the obstacle layer answers for robots on the ground.
+  // Other pairs test the boxes between the two robots the way the layer was
+  // generated, so both give the same classification.
+  unsigned int treeCount;
+  bool building;
+  if (!this->obstacleTable.Loaded() || !this->OnGround(_posA) ||
+      !this->OnGround(_posB) ||
+      !this->obstacleTable.Obstacles(
+        this->obstacleTable.Index(_posA.X(), _posA.Y()),
+        this->obstacleTable.Index(_posB.X(), _posB.Y()), treeCount, building))
   {
-    std::tie(intersects, dist) = building.IntersectDist(origin, dir, 0, 250);
-    if (intersects)
-    {
-      _visible = false;
-      _dist = dist;
-      return;
-    }
+    const unsigned int entry = VisibilityLookup::SegmentObstacles(
+        this->scene->Trees(), this->scene->Buildings(), _posA, _posB);
+    treeCount = entry & VisibilityLookup::kObstacleTrees;
+    building = (entry & VisibilityLookup::kObstacleBuilding) != 0;
   }
 
-  for (auto const &tree : this->trees)
-  {
-    std::tie(intersects, dist) = tree.IntersectDist(origin, dir, 0, 250);
-    if (intersects)
-    {
-      _dist = dist;
-
-      // Not visible if two trees are blocking visibility
-      if (_treesBlocking)
-      {
-        _visible = false;
-        return;
-      }
-      _treesBlocking = true;
-    }
-  }
+  // Any building blocks visibility, and so do two trees.
+  _treesBlocking = treeCount > 0;
+  if (building || treeCount > 1)
+    _visible = false;
 }
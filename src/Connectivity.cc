@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "swarm/Connectivity.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Whether a sorted list holds a value.
+/// \param[in] _list The list.
+/// \param[in] _value The value.
+/// \return True if the value is in the list.
+static bool Holds(const std::vector<unsigned int> &_list,
+    const unsigned int _value)
+{
+  return std::binary_search(_list.begin(), _list.end(), _value);
+}
+
+//////////////////////////////////////////////////
+void Connectivity::Reset(const size_t _size, const int _root)
+{
+  this->outgoing.assign(_size, std::vector<unsigned int>());
+  this->incoming.assign(_size, std::vector<unsigned int>());
+  this->parents.resize(_size);
+  for (size_t i = 0; i < _size; ++i)
+    this->parents[i] = i;
+  this->sizes.assign(_size, 1);
+  this->components = _size;
+  this->root = _root < static_cast<int>(_size) ? _root : -1;
+  this->stale = false;
+  this->searched = false;
+  this->stats = ConnectivityStats();
+}
+
+//////////////////////////////////////////////////
+void Connectivity::SetNeighbors(const unsigned int _id,
+    const std::vector<unsigned int> &_neighbors)
+{
+  std::vector<unsigned int> &listed = this->outgoing[_id];
+  if (listed == _neighbors)
+    return;
+
+  // Go over both sorted lists at once, as in the neighbor updates of the
+  // comms model.
+  size_t p = 0;
+  size_t q = 0;
+  while (p < listed.size() || q < _neighbors.size())
+  {
+    unsigned int j;
+    if (p == listed.size())
+      j = _neighbors[q];
+    else if (q == _neighbors.size())
+      j = listed[p];
+    else
+      j = std::min(listed[p], _neighbors[q]);
+
+    const bool isListed = p < listed.size() && listed[p] == j;
+    const bool isNew = q < _neighbors.size() && _neighbors[q] == j;
+    if (isListed)
+      ++p;
+    if (isNew)
+      ++q;
+
+    std::vector<unsigned int> &heard = this->incoming[j];
+    if (isNew && !isListed)
+    {
+      heard.insert(std::lower_bound(heard.begin(), heard.end(), _id), _id);
+      if (!this->stale && j != _id)
+        this->Union(_id, j);
+    }
+    else if (isListed && !isNew)
+    {
+      heard.erase(std::lower_bound(heard.begin(), heard.end(), _id));
+
+      // The link is kept while _id still hears j.
+      if (!Holds(this->outgoing[j], _id))
+        this->stale = true;
+    }
+  }
+
+  listed = _neighbors;
+  this->searched = false;
+}
+
+//////////////////////////////////////////////////
+size_t Connectivity::Size() const
+{
+  return this->parents.size();
+}
+
+//////////////////////////////////////////////////
+const ConnectivityStats &Connectivity::Stats()
+{
+  if (this->stale)
+    this->Rebuild();
+
+  if (this->searched)
+    return this->stats;
+
+  this->stats.components = this->components;
+  this->stats.largestComponent = 0;
+  this->stats.isolated = 0;
+  for (unsigned int i = 0; i < this->parents.size(); ++i)
+  {
+    if (this->parents[i] == i)
+    {
+      this->stats.largestComponent =
+        std::max(this->stats.largestComponent, this->sizes[i]);
+    }
+    if (this->sizes[this->Find(i)] == 1)
+      ++this->stats.isolated;
+  }
+
+  this->SearchRoot();
+  this->searched = true;
+  return this->stats;
+}
+
+//////////////////////////////////////////////////
+bool Connectivity::Connected(const unsigned int _a, const unsigned int _b)
+{
+  if (this->stale)
+    this->Rebuild();
+  return this->Find(_a) == this->Find(_b);
+}
+
+//////////////////////////////////////////////////
+uint64_t Connectivity::Rebuilds() const
+{
+  return this->rebuilds;
+}
+
+//////////////////////////////////////////////////
+void Connectivity::OnMemory(MemoryReport &_report) const
+{
+  uint64_t bytes = HeapBytes(this->outgoing) + HeapBytes(this->incoming) +
+    HeapBytes(this->parents) + HeapBytes(this->sizes) +
+    HeapBytes(this->hops) + HeapBytes(this->queue);
+  uint64_t links = 0;
+  for (auto const &neighbors : this->outgoing)
+  {
+    bytes += HeapBytes(neighbors);
+    links += neighbors.size();
+  }
+  for (auto const &neighbors : this->incoming)
+    bytes += HeapBytes(neighbors);
+
+  _report.Add("connectivity", bytes, links);
+}
+
+//////////////////////////////////////////////////
+unsigned int Connectivity::Find(unsigned int _id)
+{
+  while (this->parents[_id] != _id)
+  {
+    this->parents[_id] = this->parents[this->parents[_id]];
+    _id = this->parents[_id];
+  }
+  return _id;
+}
+
+//////////////////////////////////////////////////
+void Connectivity::Union(const unsigned int _a, const unsigned int _b)
+{
+  unsigned int a = this->Find(_a);
+  unsigned int b = this->Find(_b);
+  if (a == b)
+    return;
+
+  if (this->sizes[a] < this->sizes[b])
+    std::swap(a, b);
+  this->parents[b] = a;
+  this->sizes[a] += this->sizes[b];
+  --this->components;
+}
+
+//////////////////////////////////////////////////
+void Connectivity::Rebuild()
+{
+  const size_t size = this->parents.size();
+  for (size_t i = 0; i < size; ++i)
+    this->parents[i] = i;
+  this->sizes.assign(size, 1);
+  this->components = size;
+
+  for (unsigned int i = 0; i < size; ++i)
+  {
+    for (const unsigned int j : this->outgoing[i])
+    {
+      if (j != i)
+        this->Union(i, j);
+    }
+  }
+
+  this->stale = false;
+  ++this->rebuilds;
+}
+
+//////////////////////////////////////////////////
+void Connectivity::SearchRoot()
+{
+  this->stats.rootReachable = 0;
+  this->stats.avgHops = 0;
+  this->stats.maxHops = 0;
+  if (this->root < 0)
+    return;
+
+  // Only the component of the root is searched.
+  this->hops.assign(this->parents.size(), -1);
+  this->queue.clear();
+  this->queue.push_back(this->root);
+  this->hops[this->root] = 0;
+
+  uint64_t totalHops = 0;
+  for (size_t head = 0; head < this->queue.size(); ++head)
+  {
+    const unsigned int id = this->queue[head];
+    const int32_t next = this->hops[id] + 1;
+    for (const unsigned int sender : this->incoming[id])
+    {
+      if (this->hops[sender] >= 0)
+        continue;
+
+      this->hops[sender] = next;
+      this->queue.push_back(sender);
+      totalHops += next;
+    }
+  }
+
+  this->stats.rootReachable = this->queue.size() - 1;
+  if (this->stats.rootReachable > 0)
+  {
+    this->stats.avgHops = totalHops /
+      static_cast<double>(this->stats.rootReachable);
+    this->stats.maxHops = this->hops[this->queue.back()];
+  }
+}
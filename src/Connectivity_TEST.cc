@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "gtest/gtest.h"
+#include "swarm/Connectivity.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Check the components and the hops of a small swarm.
+TEST(ConnectivityTest, Components)
+{
+  // 0 is the root. 1 -> 0, 2 -> 1, 3 <-> 4, 5 alone.
+  Connectivity connectivity;
+  connectivity.Reset(6, 0);
+  EXPECT_EQ(connectivity.Size(), 6u);
+  EXPECT_EQ(connectivity.Stats().components, 6u);
+  EXPECT_EQ(connectivity.Stats().isolated, 6u);
+
+  connectivity.SetNeighbors(1, {0});
+  connectivity.SetNeighbors(2, {1});
+  connectivity.SetNeighbors(3, {4});
+  connectivity.SetNeighbors(4, {3});
+
+  ConnectivityStats stats = connectivity.Stats();
+  EXPECT_EQ(stats.components, 3u);
+  EXPECT_EQ(stats.largestComponent, 3u);
+  EXPECT_EQ(stats.isolated, 1u);
+  EXPECT_EQ(stats.rootReachable, 2u);
+  EXPECT_DOUBLE_EQ(stats.avgHops, 1.5);
+  EXPECT_EQ(stats.maxHops, 2u);
+  EXPECT_TRUE(connectivity.Connected(0, 2));
+  EXPECT_FALSE(connectivity.Connected(0, 3));
+  EXPECT_EQ(connectivity.Rebuilds(), 0u);
+
+  // The root only hears 1, so 0 -> 3 doesn't make 3 reach the root.
+  connectivity.SetNeighbors(0, {3});
+  stats = connectivity.Stats();
+  EXPECT_EQ(stats.components, 2u);
+  EXPECT_EQ(stats.largestComponent, 5u);
+  EXPECT_EQ(stats.rootReachable, 2u);
+  EXPECT_EQ(connectivity.Rebuilds(), 0u);
+
+  // One direction of 3 <-> 4 is still there.
+  connectivity.SetNeighbors(3, {});
+  EXPECT_TRUE(connectivity.Connected(3, 4));
+  EXPECT_EQ(connectivity.Rebuilds(), 0u);
+
+  // Removing the last link splits the component.
+  connectivity.SetNeighbors(4, {});
+  stats = connectivity.Stats();
+  EXPECT_EQ(connectivity.Rebuilds(), 1u);
+  EXPECT_EQ(stats.components, 3u);
+  EXPECT_EQ(stats.largestComponent, 4u);
+  EXPECT_EQ(stats.isolated, 2u);
+  EXPECT_FALSE(connectivity.Connected(3, 4));
+
+  // Without a root.
+  connectivity.Reset(3, -1);
+  connectivity.SetNeighbors(0, {1, 2});
+  stats = connectivity.Stats();
+  EXPECT_EQ(stats.components, 1u);
+  EXPECT_EQ(stats.rootReachable, 0u);
+}
+
+//////////////////////////////////////////////////
+/// \brief Compare the tracker with a search from scratch after random
+/// changes of the links.
+TEST(ConnectivityTest, Random)
+{
+  const unsigned int kSize = 40;
+  std::mt19937 rng(7);
+  std::vector<std::vector<unsigned int>> lists(kSize);
+
+  Connectivity connectivity;
+  connectivity.Reset(kSize, 0);
+  for (int step = 0; step < 200; ++step)
+  {
+    // Change the neighbors of a few members.
+    for (int k = 0; k < 3; ++k)
+    {
+      const unsigned int id = rng() % kSize;
+      lists[id].clear();
+      for (unsigned int j = 0; j < kSize; ++j)
+      {
+        if (j != id && rng() % 30 == 0)
+          lists[id].push_back(j);
+      }
+      connectivity.SetNeighbors(id, lists[id]);
+    }
+
+    // Components from scratch.
+    std::vector<int> component(kSize, -1);
+    unsigned int components = 0;
+    for (unsigned int i = 0; i < kSize; ++i)
+    {
+      if (component[i] >= 0)
+        continue;
+
+      std::vector<unsigned int> stack = {i};
+      component[i] = components;
+      while (!stack.empty())
+      {
+        const unsigned int a = stack.back();
+        stack.pop_back();
+        for (unsigned int b = 0; b < kSize; ++b)
+        {
+          const bool linked =
+            std::count(lists[a].begin(), lists[a].end(), b) ||
+            std::count(lists[b].begin(), lists[b].end(), a);
+          if (linked && component[b] < 0)
+          {
+            component[b] = components;
+            stack.push_back(b);
+          }
+        }
+      }
+      ++components;
+    }
+
+    ConnectivityStats stats = connectivity.Stats();
+    ASSERT_EQ(stats.components, components);
+    for (unsigned int i = 1; i < kSize; ++i)
+      EXPECT_EQ(connectivity.Connected(0, i), component[i] == component[0]);
+
+    // Hops to the root from scratch.
+    std::vector<int> hops(kSize, -1);
+    hops[0] = 0;
+    for (unsigned int round = 1; round < kSize; ++round)
+    {
+      for (unsigned int i = 0; i < kSize; ++i)
+      {
+        if (hops[i] >= 0)
+          continue;
+        for (const unsigned int j : lists[i])
+        {
+          if (hops[j] >= 0 && hops[j] < static_cast<int>(round))
+          {
+            hops[i] = round;
+            break;
+          }
+        }
+      }
+    }
+
+    unsigned int reachable = 0;
+    int maxHops = 0;
+    double total = 0;
+    for (unsigned int i = 1; i < kSize; ++i)
+    {
+      if (hops[i] > 0)
+      {
+        ++reachable;
+        total += hops[i];
+        maxHops = std::max(maxHops, hops[i]);
+      }
+    }
+    ASSERT_EQ(stats.rootReachable, reachable);
+    EXPECT_EQ(stats.maxHops, static_cast<unsigned int>(maxHops));
+    if (reachable > 0)
+    {
+      EXPECT_DOUBLE_EQ(stats.avgHops, total / reachable);
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <string>
+#include "gtest/gtest.h"
+#include "swarm/FoundReport.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+TEST(FoundReportTest, RoundTrip)
+{
+  const std::string data = EncodeFoundReport(1.5, -20.25, 1e6, 3.125);
+  EXPECT_EQ(data.size(), kFoundReportSize);
+  EXPECT_TRUE(IsFoundReport(data));
+
+  double x, y, z, t;
+  ASSERT_TRUE(DecodeFoundReport(data, x, y, z, t));
+  EXPECT_DOUBLE_EQ(x, 1.5);
+  EXPECT_DOUBLE_EQ(y, -20.25);
+  EXPECT_DOUBLE_EQ(z, 1e6);
+  EXPECT_DOUBLE_EQ(t, 3.125);
+}
+
+//////////////////////////////////////////////////
+TEST(FoundReportTest, Layout)
+{
+  const std::string data = EncodeFoundReport(1.0, 0, 0, 0);
+
+  // The version and the doubles are little-endian, after the tag.
+  const std::string expected =
+    std::string("SWFOUND\0", 8) +
+    std::string("\x01\x00\x00\x00", 4) +
+    std::string("\x00\x00\x00\x00\x00\x00\xf0\x3f", 8);
+  EXPECT_EQ(data.substr(0, 20), expected);
+}
+
+//////////////////////////////////////////////////
+TEST(FoundReportTest, Invalid)
+{
+  double x, y, z, t;
+  EXPECT_FALSE(IsFoundReport("FOUND 1 2 3 4"));
+  EXPECT_FALSE(DecodeFoundReport("FOUND 1 2 3 4", x, y, z, t));
+  EXPECT_FALSE(DecodeFoundReport("", x, y, z, t));
+
+  std::string data = EncodeFoundReport(1, 2, 3, 4);
+  EXPECT_FALSE(DecodeFoundReport(data.substr(0, data.size() - 1),
+        x, y, z, t));
+
+  // Another version.
+  data[kFoundReportTagSize] = 2;
+  EXPECT_TRUE(IsFoundReport(data));
+  EXPECT_FALSE(DecodeFoundReport(data, x, y, z, t));
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -20,6 +20,14 @@
   #include <Winsock2.h>
 #endif
 
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
 #include <boost/program_options.hpp>
 
 #include "gazebo/gazebo_config.h"
@@ -34,9 +42,28 @@ namespace po = boost::program_options;
 // Register this plugin with the simulator
 GZ_REGISTER_SYSTEM_PLUGIN(GazeboVisualizePlugin)
 
+/// \brief Number of segments of the neighbor circles.
+static const unsigned int kCircleSegments = 64;
+
+/// \brief Entries decoded ahead of the playback.
+static const size_t kMaxQueuedEntries = 256;
+
+/// \brief Frames prepared ahead of the playback.
+static const size_t kMaxQueuedFrames = 64;
+
 /////////////////////////////////////////////
 GazeboVisualizePlugin::~GazeboVisualizePlugin()
 {
+  {
+    std::lock_guard<std::mutex> lock(this->playbackMutex);
+    this->stopPlayback = true;
+  }
+  this->playbackCond.notify_all();
+
+  if (this->readerThread.joinable())
+    this->readerThread.join();
+  if (this->plannerThread.joinable())
+    this->plannerThread.join();
 }
 
 /////////////////////////////////////////////
@@ -65,6 +92,25 @@ void GazeboVisualizePlugin::Load(int /*_argc*/, char ** /*_argv*/)
     std::cout << "Random Seed:    " << header.seed() << std::endl;
     std::cout << std::endl;
   }
+
+  // Did the user set SWARM_LOG_START? Start the playback at that time.
+  char *logStartEnv = std::getenv("SWARM_LOG_START");
+  if (logStartEnv && !this->parser.Seek(std::atof(logStartEnv)))
+  {
+    std::cerr << "No entries after time [" << logStartEnv << "] in ["
+              << logFile << "]" << std::endl;
+  }
+
+  // Did the user set SWARM_LOG_SPEED? Play that many entries per update.
+  char *logSpeedEnv = std::getenv("SWARM_LOG_SPEED");
+  if (logSpeedEnv && std::atoi(logSpeedEnv) > 1)
+    this->playbackSpeed = std::atoi(logSpeedEnv);
+
+  // The log is decoded and the frames are prepared ahead of the playback,
+  // so the update thread only draws them.
+  this->readerThread = std::thread(&GazeboVisualizePlugin::ReadLog, this);
+  this->plannerThread =
+    std::thread(&GazeboVisualizePlugin::PlanFrames, this);
 }
 
 /////////////////////////////////////////////
@@ -82,6 +128,15 @@ void GazeboVisualizePlugin::OnWorldCreated()
 
   this->world = physics::get_world();
 
+  // All the neighbor circles are scaled from the same vertices.
+  this->circleTemplate.clear();
+  for (unsigned int i = 0; i <= kCircleSegments; ++i)
+  {
+    const double t = 2 * M_PI * i / kCircleSegments;
+    this->circleTemplate.push_back(
+        ignition::math::Vector2d(std::cos(t), std::sin(t)));
+  }
+
   // Create our node for communication
   this->node = gazebo::transport::NodePtr(new gazebo::transport::Node());
   this->node->Init();
@@ -93,6 +148,10 @@ void GazeboVisualizePlugin::OnWorldCreated()
 
   this->markerPub->WaitForConnection();
 
+  // Publish a time on this topic to seek the playback.
+  this->seekSub = this->node->Subscribe("~/swarm/log_seek",
+      &GazeboVisualizePlugin::OnSeek, this);
+
   // Get the terrain, if it's present
   gazebo::physics::ModelPtr terrainModel = this->world->GetModel("terrain");
 
@@ -103,6 +162,17 @@ void GazeboVisualizePlugin::OnWorldCreated()
       boost::dynamic_pointer_cast<gazebo::physics::HeightmapShape>(
           terrainModel->GetLink()->GetCollision("collision")->GetShape());
 
+    // The terrain lookups share the implementation of the plugins.
+    const int columns = this->terrain->GetVertexCount().x;
+    const int rows = this->terrain->GetVertexCount().y;
+    std::vector<float> heights(static_cast<size_t>(columns) * rows);
+    for (int y = 0; y < rows; ++y)
+    {
+      for (int x = 0; x < columns; ++x)
+        heights[y * columns + x] = this->terrain->GetHeight(x, y);
+    }
+    this->heightmap.Set(columns, rows, this->terrain->GetSize().Ign(),
+        heights);
   }
   else
     gzerr << "Invalid terrain\n";
@@ -116,11 +186,6 @@ void GazeboVisualizePlugin::VisualizeSearchArea()
   // The namespace of the markers generated in this function.
   std::string markerNS = "area";
 
-  gazebo::msgs::Marker clearMsg;
-  clearMsg.set_ns(markerNS);
-  clearMsg.set_action(gazebo::msgs::Marker::DELETE_ALL);
-  this->markerPub->Publish(clearMsg);
-
   gazebo::msgs::Marker markerMsg;
   markerMsg.set_ns(markerNS);
   markerMsg.set_id(0);
@@ -194,7 +259,22 @@ void GazeboVisualizePlugin::VisualizeSearchArea()
   gazebo::msgs::Set(markerMsg.add_point(), pt4);
   gazebo::msgs::Set(markerMsg.add_point(), pt4Lower);
 
-  this->markerPub->Publish(markerMsg);
+  this->PublishMarker(markerMsg);
+
+  // The cells of each type of terrain are points of a single marker.
+  std::map<TerrainType, gazebo::msgs::Marker> cellMsgs;
+  const std::map<TerrainType, std::string> materials = {
+    {PLAIN, "Gazebo/Red"}, {FOREST, "Gazebo/Green"},
+    {BUILDING, "Gazebo/Black"}};
+  for (auto const &material : materials)
+  {
+    gazebo::msgs::Marker &cellMsg = cellMsgs[material.first];
+    cellMsg.set_ns(markerNS);
+    cellMsg.set_id(10 + material.first);
+    cellMsg.set_action(gazebo::msgs::Marker::ADD_MODIFY);
+    cellMsg.set_type(gazebo::msgs::Marker::POINTS);
+    cellMsg.mutable_material()->mutable_script()->set_name(material.second);
+  }
 
   // get lat/lon bounds
   double stepLon = (this->searchMaxLongitude - this->searchMinLongitude) / 90.0;
@@ -203,7 +283,6 @@ void GazeboVisualizePlugin::VisualizeSearchArea()
   double elevation;
   GazeboVisualizePlugin::TerrainType terrainType;
 
-  int index = 10;
   for (double lat = this->searchMinLatitude; lat < this->searchMaxLatitude;
       lat += stepLat)
   {
@@ -211,22 +290,6 @@ void GazeboVisualizePlugin::VisualizeSearchArea()
     {
       this->MapQuery(lat, lon, elevation, terrainType);
 
-      gazebo::msgs::Marker elevMsg;
-      elevMsg.set_ns(markerNS);
-      elevMsg.set_id(index++);
-      elevMsg.set_action(gazebo::msgs::Marker::ADD_MODIFY);
-      elevMsg.set_type(gazebo::msgs::Marker::SPHERE);
-
-      if (terrainType == PLAIN)
-        elevMsg.mutable_material()->mutable_script()->set_name("Gazebo/Red");
-      else if (terrainType == FOREST)
-        elevMsg.mutable_material()->mutable_script()->set_name("Gazebo/Green");
-      else
-        elevMsg.mutable_material()->mutable_script()->set_name("Gazebo/Black");
-
-      gazebo::msgs::Set(elevMsg.mutable_scale(),
-          ignition::math::Vector3d(10.2, 10.2, 10.2));
-
       ignition::math::Vector3d local =
         this->world->GetSphericalCoordinates()->LocalFromSpherical(
             ignition::math::Vector3d(lat, lon, 0));
@@ -234,12 +297,15 @@ void GazeboVisualizePlugin::VisualizeSearchArea()
       local.Z(elevation -
               this->world->GetSphericalCoordinates()->GetElevationReference());
 
-      gazebo::msgs::Set(elevMsg.mutable_pose(),
-        ignition::math::Pose3d(local, ignition::math::Quaterniond::Identity));
-
-      this->markerPub->Publish(elevMsg);
+      gazebo::msgs::Set(cellMsgs[terrainType].add_point(), local);
     }
   }
+
+  for (auto const &cellMsg : cellMsgs)
+  {
+    if (cellMsg.second.point_size() > 0)
+      this->PublishMarker(cellMsg.second);
+  }
   std::cout << "done!\n";
 
 
@@ -247,199 +313,281 @@ void GazeboVisualizePlugin::VisualizeSearchArea()
 }
 
 /////////////////////////////////////////////
-void GazeboVisualizePlugin::VisualizeMessages(swarm::msgs::LogEntry &_logEntry)
+void GazeboVisualizePlugin::VisualizeMessages(const Frame &_frame)
 {
 #if GAZEBO_MAJOR_VERSION >= 7
   // The namespace of the markers generated in this function.
   std::string markerNS = "messages";
 
-  // Clear visualis in the namespace
-  gazebo::msgs::Marker clearMsg;
-  clearMsg.set_ns(markerNS);
-  clearMsg.set_action(gazebo::msgs::Marker::DELETE_ALL);
-  this->markerPub->Publish(clearMsg);
-
-  int msgIndex = 0;
+  // The lines of all the messages are sent in a single marker.
+  gazebo::msgs::Marker markerMsg;
+  markerMsg.set_ns(markerNS);
+  markerMsg.set_id(0);
+  markerMsg.set_action(gazebo::msgs::Marker::ADD_MODIFY);
+  markerMsg.set_type(gazebo::msgs::Marker::LINE_LIST);
+  markerMsg.mutable_material()->mutable_script()->set_name("Gazebo/Red");
 
-  // Construct map of messages
-  if (_logEntry.has_incoming_msgs())
+  for (auto const &line : _frame.lines)
   {
-    // Process each message received by the broker
-    for (int msg = 0; msg < _logEntry.incoming_msgs().message_size(); ++msg)
-    {
-      // Get the source address
-      std::string src = _logEntry.incoming_msgs().message(msg).src_address();
+    physics::ModelPtr src = this->Model(line.first);
+    physics::ModelPtr dst = this->Model(line.second);
+    if (!src || !dst)
+      continue;
 
-      // Make sure the source address has a dot (the address should be an IP
-      // address).
-      if (src.find('.') == std::string::npos)
-        continue;
+    gazebo::msgs::Set(markerMsg.add_point(), src->GetWorldPose().pos.Ign());
+    gazebo::msgs::Set(markerMsg.add_point(), dst->GetWorldPose().pos.Ign());
+  }
 
-      // Get the physics model
-      std::string srcId = src.substr(src.rfind('.')+1);
-      physics::ModelPtr model = this->world->GetModel("ground_" + srcId);
-      if (!model)
-        continue;
+  if (markerMsg.point_size() > 0)
+    this->PublishMarker(markerMsg);
+  else
+    this->DeleteMarker(markerNS, 0);
+#endif
+}
+
+/////////////////////////////////////////////
+void GazeboVisualizePlugin::VisualizeNeighbors(const Frame &_frame)
+{
+#if GAZEBO_MAJOR_VERSION >= 7
+  // The namespace of the markers generated in this function.
+  std::string markerNS = "neighbors";
+
+  // The circles are sent in a single marker.
+  gazebo::msgs::Marker markerMsg;
+  markerMsg.set_ns(markerNS);
+  markerMsg.set_id(0);
+  markerMsg.set_action(gazebo::msgs::Marker::ADD_MODIFY);
+  markerMsg.set_type(gazebo::msgs::Marker::LINE_LIST);
+  markerMsg.mutable_material()->mutable_script()->set_name("Gazebo/Blue");
 
-      // Create a marker message
-      ignition::math::Vector3d srcPos = model->GetWorldPose().pos.Ign();
-      gazebo::msgs::Marker markerMsg;
-      markerMsg.set_ns(markerNS);
-      markerMsg.set_id(msgIndex);
-      markerMsg.set_action(gazebo::msgs::Marker::ADD_MODIFY);
-      markerMsg.set_type(gazebo::msgs::Marker::LINE_LIST);
-      markerMsg.clear_point();
-      markerMsg.mutable_material()->mutable_script()->set_name("Gazebo/Red");
-
-      // Construct the list of destination addresses
-      std::list<std::string> dst;
-      for (int n = 0;
-          n < _logEntry.incoming_msgs().message(msg).neighbor_size(); ++n)
+  std::vector<ignition::math::Vector3d> positions;
+  for (auto const &c : _frame.circles)
+  {
+    positions.clear();
+    ignition::math::Vector3d sum;
+    for (auto const &name : c)
+    {
+      physics::ModelPtr model = this->Model(name);
+      if (model)
       {
-        std::string dest =
-          _logEntry.incoming_msgs().message(msg).neighbor(n).dst();
-        if (dest.find('.') == std::string::npos)
-          continue;
+        positions.push_back(model->GetWorldPose().pos.Ign());
+        sum += positions.back();
+      }
+    }
 
-        std::string destId = dest.substr(dest.rfind('.') + 1);
-        physics::ModelPtr mdl = this->world->GetModel("ground_" + destId);
-        if (!mdl)
-          continue;
+    ignition::math::Vector3d center = sum;
+    if (!positions.empty())
+      center /= positions.size();
 
-        ignition::math::Vector3d destPos = mdl->GetWorldPose().pos.Ign();
+    double radius = 0;
+    for (auto const &p : positions)
+    {
+      if (p.Distance(center) > radius)
+        radius = p.Distance(center);
+    }
 
-        // Only draw lines for messages that were delivered.
-        if (_logEntry.incoming_msgs().message(msg).neighbor(n).status() ==
-            swarm::msgs::CommsStatus::DELIVERED)
-        {
-          gazebo::msgs::Set(markerMsg.add_point(), srcPos);
-          gazebo::msgs::Set(markerMsg.add_point(), destPos);
-        }
+    if (ignition::math::equal(radius, 0.0))
+      radius = 2.0;
+
+    for (unsigned int i = 0; i < kCircleSegments; ++i)
+    {
+      for (unsigned int j = i; j <= i + 1; ++j)
+      {
+        gazebo::msgs::Set(markerMsg.add_point(),
+            center + ignition::math::Vector3d(
+              radius * this->circleTemplate[j].X(),
+              radius * this->circleTemplate[j].Y(), 20.0));
       }
-      this->markerPub->Publish(markerMsg);
-      ++msgIndex;
     }
   }
+
+  if (markerMsg.point_size() > 0)
+    this->PublishMarker(markerMsg);
+  else
+    this->DeleteMarker(markerNS, 0);
 #endif
 }
 
 /////////////////////////////////////////////
-void GazeboVisualizePlugin::VisualizeNeighbors(swarm::msgs::LogEntry &_logEntry)
+void GazeboVisualizePlugin::PlanFrame(const swarm::msgs::LogEntry &_logEntry,
+    Frame &_frame)
 {
-#if GAZEBO_MAJOR_VERSION >= 7
-  // The namespace of the markers generated in this function.
-  std::string markerNS = "neighbors";
+  // The vehicles are named after the last number of their addresses.
+  auto modelName = [](const std::string &_address)
+  {
+    if (_address.find('.') == std::string::npos)
+      return std::string();
+    return "ground_" + _address.substr(_address.rfind('.') + 1);
+  };
 
-  // Clear visualis in the namespace
-  gazebo::msgs::Marker clearMsg;
-  clearMsg.set_ns(markerNS);
-  clearMsg.set_action(gazebo::msgs::Marker::DELETE_ALL);
-  this->markerPub->Publish(clearMsg);
+  // Lines of the messages delivered by the broker.
+  if (_logEntry.has_incoming_msgs())
+  {
+    for (auto const &msg : _logEntry.incoming_msgs().message())
+    {
+      const std::string src = modelName(msg.src_address());
+      if (src.empty())
+        continue;
 
-  std::list< std::list<std::string> > circles;
+      for (auto const &neighbor : msg.neighbor())
+      {
+        const std::string dst = modelName(neighbor.dst());
+        if (!dst.empty() &&
+            neighbor.status() == swarm::msgs::CommsStatus::DELIVERED)
+        {
+          _frame.lines.push_back(std::make_pair(src, dst));
+        }
+      }
+    }
+  }
 
-  // Construct set of visibility circles
+  // Visibility circles.
   if (_logEntry.has_visibility())
   {
-    for (int row = 0; row < _logEntry.visibility().row_size(); ++row)
+    for (auto const &row : _logEntry.visibility().row())
     {
-      std::string source = _logEntry.visibility().row(row).src();
-      std::list<std::string> vehicles;
-      vehicles.push_back(source);
-      for (int v = 0; v < _logEntry.visibility().row(row).entry_size(); ++v)
+      std::vector<std::string> vehicles;
+      const std::string src = modelName(row.src());
+      if (!src.empty())
+        vehicles.push_back(src);
+
+      for (auto const &entry : row.entry())
       {
-        std::string dst = _logEntry.visibility().row(row).entry(v).dst();
-        if (source != dst &&
-            _logEntry.visibility().row(row).entry(v).status() ==
-            swarm::msgs::CommsStatus::VISIBLE)
+        const std::string dst = modelName(entry.dst());
+        if (row.src() != entry.dst() && !dst.empty() &&
+            entry.status() == swarm::msgs::CommsStatus::VISIBLE)
         {
           vehicles.push_back(dst);
         }
-        else if (_logEntry.visibility().row(row).entry(v).status() ==
-            swarm::msgs::CommsStatus::OUTAGE)
-        {
-          // std::cout << "In outage. src[" << source << "] d[" << dst << "]\n";
-        }
       }
-      circles.push_back(vehicles);
+      _frame.circles.push_back(std::move(vehicles));
     }
   }
+}
+
+/////////////////////////////////////////////
+void GazeboVisualizePlugin::ReadLog()
+{
+  // The entries of the robots are skipped without being parsed.
+  swarm::LogFilter filter;
+  filter.id = "broker";
 
-  int index = 0;
-  for (auto c : circles)
+  bool end = false;
+  while (true)
   {
-    std::vector<ignition::math::Vector3d> positions;
-    ignition::math::Vector3d sum;
-    for (auto v : c)
+    double seek;
+    uint64_t generation;
     {
-      if (v.find('.') == std::string::npos)
-        continue;
-
-      std::string vId = v.substr(v.rfind('.')+1);
-      physics::ModelPtr model = this->world->GetModel("ground_" + vId);
-      if (model)
+      std::unique_lock<std::mutex> lock(this->playbackMutex);
+      this->playbackCond.wait(lock, [this, end]
       {
-        positions.push_back(model->GetWorldPose().pos.Ign());
-        sum += model->GetWorldPose().pos.Ign();
+        return this->stopPlayback || !std::isnan(this->seekTime) ||
+          (!end && this->entries.size() < kMaxQueuedEntries);
+      });
+      if (this->stopPlayback)
+        return;
+
+      // Drop what was decoded before the seek.
+      seek = this->seekTime;
+      this->seekTime = std::numeric_limits<double>::quiet_NaN();
+      if (!std::isnan(seek))
+      {
+        this->entries.clear();
+        this->frames.clear();
+        ++this->playbackGeneration;
       }
+      generation = this->playbackGeneration;
     }
 
-    ignition::math::Vector3d center = sum;
-    if (!positions.empty())
-      center /= positions.size();
-
-    double radius = 0;
-    for (auto const &p : positions)
+    // The time index of the log finds the block to decode from.
+    if (!std::isnan(seek))
     {
-      if (p.Distance(center) > radius)
-        radius = p.Distance(center);
+      end = false;
+      if (!this->parser.Seek(seek))
+        std::cerr << "No entries after time [" << seek << "]" << std::endl;
     }
 
-    if (ignition::math::equal(radius, 0.0))
-      radius = 2.0;
-
-    gazebo::msgs::Marker markerMsg;
-    markerMsg.set_ns(markerNS);
-    markerMsg.set_id(index);
-    markerMsg.set_action(gazebo::msgs::Marker::ADD_MODIFY);
-    markerMsg.set_type(gazebo::msgs::Marker::LINE_LIST);
-    markerMsg.clear_point();
-    gazebo::msgs::Set(markerMsg.mutable_pose(),
-        ignition::math::Pose3d(center, ignition::math::Quaterniond::Identity));
-    markerMsg.mutable_material()->mutable_script()->set_name(
-        "Gazebo/Blue");
-
-    for (double t = 0; t <= 2*M_PI; t+= 0.01)
+    swarm::msgs::LogEntry logEntry;
+    if (!this->parser.Next(logEntry, filter))
     {
-      gazebo::msgs::Set(markerMsg.add_point(),
-          ignition::math::Vector3d(radius * cos(t), radius * sin(t), 20.0));
+      // Wait for a seek at the end of the log.
+      end = true;
+      continue;
     }
-    gazebo::msgs::Set(markerMsg.add_point(),
-          ignition::math::Vector3d(radius * cos(2*M_PI), radius * sin(2*M_PI), 20.0));
 
-    this->markerPub->Publish(markerMsg);
+    // Rebuild the visibility map when it's logged as changes.
+    swarm::msgs::VisibilityMap visibility;
+    if (logEntry.has_visibility_delta() &&
+        this->parser.Visibility(logEntry, visibility))
+    {
+      logEntry.mutable_visibility()->Swap(&visibility);
+    }
 
-    ++index;
+    {
+      std::lock_guard<std::mutex> lock(this->playbackMutex);
+      if (generation == this->playbackGeneration)
+        this->entries.push_back(std::move(logEntry));
+    }
+    this->playbackCond.notify_all();
   }
+}
 
-  /*if (this->circleCount > index)
+/////////////////////////////////////////////
+void GazeboVisualizePlugin::PlanFrames()
+{
+  while (true)
   {
-    for (int i = index; i < this->circleCount; ++i)
+    swarm::msgs::LogEntry logEntry;
+    uint64_t generation;
     {
-      gazebo::msgs::Marker markerMsg;
-      markerMsg.set_ns("neighbors");
-      markerMsg.set_id(i);
-      markerMsg.set_action(gazebo::msgs::Marker::ADD_MODIFY);
-      markerMsg.set_type(gazebo::msgs::Marker::TRIANGLE_FAN);
-      gazebo::msgs::Set(markerMsg.mutable_pose(),
-        ignition::math::Pose3d(0, 0, -100, 0, 0, 0));
-
-      this->markerPub->Publish(markerMsg);
+      std::unique_lock<std::mutex> lock(this->playbackMutex);
+      this->playbackCond.wait(lock, [this]
+      {
+        return this->stopPlayback ||
+          (!this->entries.empty() && this->frames.size() < kMaxQueuedFrames);
+      });
+      if (this->stopPlayback)
+        return;
+
+      logEntry.Swap(&this->entries.front());
+      this->entries.pop_front();
+      generation = this->playbackGeneration;
     }
+    this->playbackCond.notify_all();
+
+    Frame frame;
+    this->PlanFrame(logEntry, frame);
+
+    {
+      std::lock_guard<std::mutex> lock(this->playbackMutex);
+      if (generation == this->playbackGeneration)
+        this->frames.push_back(std::move(frame));
+    }
+    this->playbackCond.notify_all();
   }
-  this->circleCount = index;
-  */
-#endif
+}
+
+/////////////////////////////////////////////
+void GazeboVisualizePlugin::OnSeek(ConstTimePtr &_msg)
+{
+  {
+    std::lock_guard<std::mutex> lock(this->playbackMutex);
+    this->seekTime = gazebo::msgs::Convert(*_msg).Double();
+  }
+  this->playbackCond.notify_all();
+}
+
+/////////////////////////////////////////////
+physics::ModelPtr GazeboVisualizePlugin::Model(const std::string &_name)
+{
+  auto it = this->models.find(_name);
+  if (it != this->models.end())
+    return it->second;
+
+  physics::ModelPtr model = this->world->GetModel(_name);
+  if (model)
+    this->models[_name] = model;
+  return model;
 }
 
 /////////////////////////////////////////////
@@ -447,14 +595,26 @@ void GazeboVisualizePlugin::Update()
 {
   static bool first = true;
 
-  swarm::msgs::LogEntry logEntry;
-  do
+  // The frames are prepared by the playback threads. When playing faster
+  // than the simulation, only the last frame taken is drawn.
+  Frame frame;
+  bool ready = false;
   {
-    this->parser.Next(logEntry);
-  } while (logEntry.id() != "broker");
+    std::lock_guard<std::mutex> lock(this->playbackMutex);
+    for (unsigned int i = 0; i < this->playbackSpeed && !this->frames.empty();
+         ++i)
+    {
+      frame = std::move(this->frames.front());
+      this->frames.pop_front();
+      ready = true;
+    }
+  }
+  if (!ready)
+    return;
+  this->playbackCond.notify_all();
 
-  this->VisualizeMessages(logEntry);
-  this->VisualizeNeighbors(logEntry);
+  this->VisualizeMessages(frame);
+  this->VisualizeNeighbors(frame);
 
   if (first)
   {
@@ -491,7 +651,7 @@ void GazeboVisualizePlugin::CreateLostPersonMarker()
   gazebo::msgs::Set(markerMsg.mutable_pose(),
       ignition::math::Pose3d(0, 0, 50, 0, 0, 0));
 
-  this->markerPub->Publish(markerMsg);
+  this->PublishMarker(markerMsg);
 
   markerMsg.set_id(1);
   markerMsg.set_action(gazebo::msgs::Marker::ADD_MODIFY);
@@ -500,189 +660,51 @@ void GazeboVisualizePlugin::CreateLostPersonMarker()
   gazebo::msgs::Set(markerMsg.add_point(),
       ignition::math::Vector3d(0, 0, -25));
 
-  this->markerPub->Publish(markerMsg);
+  this->PublishMarker(markerMsg);
 #endif
 }
 
-//////////////////////////////////////////////////
-void GazeboVisualizePlugin::TerrainLookup(const ignition::math::Vector3d &_pos,
-    ignition::math::Vector3d &_terrainPos,
-    ignition::math::Vector3d &_norm) const
+#if GAZEBO_MAJOR_VERSION >= 7
+/////////////////////////////////////////////////
+void GazeboVisualizePlugin::PublishMarker(const gazebo::msgs::Marker &_msg)
 {
-  // The robot position in the coordinate frame of the terrain
-  ignition::math::Vector3d robotPos(
-      (this->terrainSize.X() * 0.5 + _pos.X()) / this->terrainScaling.X(),
-      (this->terrainSize.Y() * 0.5 - _pos.Y()) / this->terrainScaling.Y(), 0);
-
-  // Three vertices that define the triangle on which the vehicle rests
-  // The first vertex is closest point on the terrain
-  ignition::math::Vector3d v1(std::round(robotPos.X()),
-      std::round(robotPos.Y()), 0);
-  ignition::math::Vector3d v2 = v1;
-  ignition::math::Vector3d v3 = v1;
-
-  // The second and third vertices are chosen based on how OGRE layouts
-  // the triangle strip.
-  if (static_cast<int>(v1.X()) == static_cast<int>(std::ceil(robotPos.X())) &&
-      static_cast<int>(v1.Y()) == static_cast<int>(std::ceil(robotPos.Y())))
-  {
-    if (static_cast<int>(v1.Y()) % 2 == 0)
-    {
-      v2.Y(v1.Y()-1);
-      v3.X(v1.X()-1);
-    }
-    else
-    {
-      ignition::math::Vector3d b(v1.X()-1, v1.Y(), 0);
-      ignition::math::Vector3d c(v1.X(), v1.Y()-1, 0);
-      if (robotPos.Distance(b) < robotPos.Distance(c))
-      {
-        v3 = b;
-        v2.X(v1.X()-1);
-        v2.Y(v1.Y()-1);
-      }
-      else
-      {
-        v2 = c;
-        v3.X(v1.X()-1);
-        v3.Y(v1.Y()-1);
-      }
-    }
-  }
-  else if (static_cast<int>(v1.X()) ==
-      static_cast<int>(std::floor(robotPos.X())) &&
-      static_cast<int>(v1.Y()) == static_cast<int>(std::ceil(robotPos.Y())))
-  {
-    if (static_cast<int>(v1.Y()) % 2 == 0)
-    {
-      ignition::math::Vector3d b(v1.X()+1, v1.Y(), 0);
-      ignition::math::Vector3d c(v1.X(), v1.Y()-1, 0);
-      if (robotPos.Distance(b) < robotPos.Distance(c))
-      {
-        v2 = b;
-        v3.X(v1.X()+1);
-        v3.Y(v1.Y()-1);
-      }
-      else
-      {
-        v3 = c;
-        v2.X(v1.X()+1);
-        v2.Y(v1.Y()-1);
-      }
-    }
-    else
-    {
-      v2.X(v1.X()+1);
-      v3.Y(v1.Y()-1);
-    }
-  }
-  else if (static_cast<int>(v1.X()) ==
-      static_cast<int>(std::floor(robotPos.X())) &&
-      static_cast<int>(v1.Y()) == static_cast<int>(std::floor(robotPos.Y())))
-  {
-    if (static_cast<int>(v1.Y()) % 2 == 0)
-    {
-      ignition::math::Vector3d b(v1.X()+1, v1.Y(), 0);
-      ignition::math::Vector3d c(v1.X(), v1.Y()+1, 0);
-      if (robotPos.Distance(b) < robotPos.Distance(c))
-      {
-        v2.X(v1.X()+1);
-        v2.Y(v1.Y()+1);
-        v3 = b;
-      }
-      else
-      {
-        v2 = c;
-        v3.X(v1.X()+1);
-        v3.Y(v1.Y()+1);
-      }
-    }
-    else
-    {
-      v2.Y(v1.Y()+1);
-      v3.X(v1.X()+1);
-    }
-  }
-  else
-  {
-    if (static_cast<int>(v1.Y()) % 2 == 0)
-    {
-      v2.X() -= 1;
-      v3.Y() += 1;
-    }
-    else
-    {
-      ignition::math::Vector3d b(v1.X()-1, v1.Y(), 0);
-      ignition::math::Vector3d c(v1.X(), v1.Y()+1, 0);
-      if (robotPos.Distance(b) < robotPos.Distance(c))
-      {
-        v2 = b;
-        v3.X(v1.X()-1);
-        v3.Y(v1.Y()+1);
-      }
-      else
-      {
-        v2.X(v1.X()-1);
-        v2.Y(v1.Y()+1);
-        v3 = c;
-      }
-    }
-  }
-
-  // Get the height at each vertex
-  v1.Z(this->terrain->GetHeight(v1.X(), v1.Y()));
-  v2.Z(this->terrain->GetHeight(v2.X(), v2.Y()));
-  v3.Z(this->terrain->GetHeight(v3.X(), v3.Y()));
-
-  // Display a marker that highlights the vertices currently used to
-  // compute the vehicles height. This is debug code that is very useful
-  // but it requires a version of gazebo with visual markers.
-  //
-  // gazebo::msgs::Marker markerMsg;
-  // markerMsg.set_layer("default");
-  // markerMsg.set_id(0);
-  // markerMsg.set_action(gazebo::msgs::Marker::MODIFY);
-  // markerMsg.set_type(gazebo::msgs::Marker::LINE_STRIP);
+  const std::string key = _msg.ns() + "/" + std::to_string(_msg.id());
+  std::string data = _msg.SerializeAsString();
 
+  auto last = this->lastMarkers.find(key);
+  if (last != this->lastMarkers.end() && last->second == data)
+    return;
 
-  // v1a.Z() += 0.1;
-  // v2a.Z() += 0.1;
-  // v3a.Z() += 0.1;
-  // gazebo::msgs::Set(markerMsg.add_point(), v1a);
-  // gazebo::msgs::Set(markerMsg.add_point(), v2a);
-  // gazebo::msgs::Set(markerMsg.add_point(), v3a);
-  // if (this->markerPub)
-  //   this->markerPub->Publish(markerMsg);
-  // END DEBUG CODE
-
-  ignition::math::Vector3d v1a = v1;
-  ignition::math::Vector3d v2a = v2;
-  ignition::math::Vector3d v3a = v3;
-  v1a.X(v1a.X()*this->terrainScaling.X() - this->terrainSize.X()*0.5);
-  v1a.Y(this->terrainSize.Y()*0.5 - v1a.Y()*this->terrainScaling.Y());
-
-  v2a.X(v2a.X()*this->terrainScaling.X() - this->terrainSize.X()*0.5);
-  v2a.Y(this->terrainSize.Y()*0.5 - v2a.Y()*this->terrainScaling.Y());
-
-  v3a.X(v3a.X()*this->terrainScaling.X() - this->terrainSize.X()*0.5);
-  v3a.Y(this->terrainSize.Y()*0.5 - v3a.Y()*this->terrainScaling.Y());
-
-  _norm = ignition::math::Vector3d::Normal(v1a, v2a, v3a);
-
-  // Triangle normal
-  ignition::math::Vector3d norm = ignition::math::Vector3d::Normal(v1, v2, v3);
-
-  // Ray direction to intersect with triangle
-  ignition::math::Vector3d rayDir(0, 0, -1);
+  this->markerPub->Publish(_msg);
+  this->lastMarkers[key].swap(data);
+}
+#endif
 
-  // Ray start point
-  ignition::math::Vector3d rayPt(robotPos.X(), robotPos.Y(), 1000);
+/////////////////////////////////////////////////
+void GazeboVisualizePlugin::DeleteMarker(const std::string &_ns,
+    const int _id)
+{
+#if GAZEBO_MAJOR_VERSION >= 7
+  const std::string key = _ns + "/" + std::to_string(_id);
+  if (!this->lastMarkers.erase(key))
+    return;
 
-  // Distance from ray start to triangle intersection
-  double intersection = -norm.Dot(rayPt - v1) / norm.Dot(rayDir);
+  gazebo::msgs::Marker markerMsg;
+  markerMsg.set_ns(_ns);
+  markerMsg.set_id(_id);
+  markerMsg.set_action(gazebo::msgs::Marker::DELETE_MARKER);
+  this->markerPub->Publish(markerMsg);
+#endif
+}
 
-  // Height of the terrain
-  _terrainPos = rayPt + intersection * rayDir;
+//////////////////////////////////////////////////
+void GazeboVisualizePlugin::TerrainLookup(const ignition::math::Vector3d &_pos,
+    ignition::math::Vector3d &_terrainPos,
+    ignition::math::Vector3d &_norm) const
+{
+  double height;
+  this->heightmap.Lookup(_pos.X(), _pos.Y(), height, _norm);
+  _terrainPos.Set(_pos.X(), _pos.Y(), height);
 }
 
 //////////////////////////////////////////////////
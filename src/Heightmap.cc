@@ -0,0 +1,463 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "swarm/Heightmap.hh"
+
+using namespace swarm;
+
+/// \brief Scale of the fixed point components of the normals.
+static const float kNormalScale = 32767.0f;
+
+//////////////////////////////////////////////////
+/// \brief Pack the X and Y components of a unit normal.
+/// \param[in] _norm The normal.
+/// \return The packed components.
+static uint32_t packNormal(const ignition::math::Vector3d &_norm)
+{
+  const int16_t x = static_cast<int16_t>(std::lround(_norm.X() * kNormalScale));
+  const int16_t y = static_cast<int16_t>(std::lround(_norm.Y() * kNormalScale));
+  return static_cast<uint16_t>(x) | (static_cast<uint32_t>(
+        static_cast<uint16_t>(y)) << 16);
+}
+
+//////////////////////////////////////////////////
+/// \brief Unpack a normal packed by packNormal().
+/// \param[in] _packed The packed components.
+/// \return The unit normal.
+static ignition::math::Vector3d unpackNormal(const uint32_t _packed)
+{
+  const double x = static_cast<int16_t>(_packed & 0xffff) / kNormalScale;
+  const double y = static_cast<int16_t>(_packed >> 16) / kNormalScale;
+  return ignition::math::Vector3d(x, y,
+      std::sqrt(std::max(0.0, 1.0 - x * x - y * y)));
+}
+
+//////////////////////////////////////////////////
+bool Heightmap::Set(const int _columns, const int _rows,
+    const ignition::math::Vector3d &_size, const std::vector<float> &_heights)
+{
+  if (_columns < 2 || _rows < 2 || _size.X() <= 0 || _size.Y() <= 0 ||
+      _heights.size() != static_cast<size_t>(_columns) * _rows)
+  {
+    std::cerr << "Heightmap::Set() Invalid heightmap of " << _columns << "x"
+              << _rows << " samples" << std::endl;
+    return false;
+  }
+
+  this->columns = _columns;
+  this->rows = _rows;
+  this->size = _size;
+  this->scaleX = _size.X() / (_columns - 1);
+  this->scaleY = _size.Y() / (_rows - 1);
+  this->heights = _heights;
+
+  this->hash = HashSamples(_columns, _rows, _size, this->heights);
+
+  this->BuildCells();
+
+  return true;
+}
+
+//////////////////////////////////////////////////
+uint64_t Heightmap::HashSamples(const int _columns, const int _rows,
+    const ignition::math::Vector3d &_size, const std::vector<float> &_heights)
+{
+  // Hash the heightmap using FNV-1a.
+  uint64_t h = 14695981039346656037ULL;
+  auto hashBytes = [&h](const void *_data, const size_t _count)
+  {
+    const unsigned char *bytes = static_cast<const unsigned char*>(_data);
+    for (size_t i = 0; i < _count; ++i)
+    {
+      h ^= bytes[i];
+      h *= 1099511628211ULL;
+    }
+  };
+
+  const int32_t vertexCount[2] = {_columns, _rows};
+  const double sizeValues[3] = {_size.X(), _size.Y(), _size.Z()};
+  hashBytes(vertexCount, sizeof(vertexCount));
+  hashBytes(sizeValues, sizeof(sizeValues));
+  hashBytes(_heights.data(), _heights.size() * sizeof(float));
+
+  return h;
+}
+
+//////////////////////////////////////////////////
+void Heightmap::BuildCells()
+{
+  const int cellColumns = this->columns - 1;
+  this->cells.resize(static_cast<size_t>(cellColumns) * (this->rows - 1));
+
+  for (int y = 0; y < this->rows - 1; ++y)
+  {
+    for (int x = 0; x < cellColumns; ++x)
+    {
+      const float *row0 = &this->heights[y * this->columns + x];
+      const float *row1 = row0 + this->columns;
+      const double h00 = row0[0];
+      const double h10 = row0[1];
+      const double h01 = row1[0];
+      const double h11 = row1[1];
+
+      // Triangle 0 holds the first sample on the even rows, and triangle 1
+      // the last one on the odd rows.
+      double offset[2], slopeX[2], slopeY[2];
+      if (y % 2 == 0)
+      {
+        offset[0] = h00;
+        slopeX[0] = h10 - h00;
+        slopeY[0] = h11 - h10;
+        offset[1] = h00;
+        slopeX[1] = h11 - h01;
+        slopeY[1] = h01 - h00;
+      }
+      else
+      {
+        offset[0] = h00;
+        slopeX[0] = h10 - h00;
+        slopeY[0] = h01 - h00;
+        offset[1] = h01 + h10 - h11;
+        slopeX[1] = h11 - h01;
+        slopeY[1] = h11 - h10;
+      }
+
+      Cell &cell = this->cells[static_cast<size_t>(y) * cellColumns + x];
+      for (int i = 0; i < 2; ++i)
+      {
+        cell.offset[i] = offset[i];
+        cell.slopeX[i] = slopeX[i];
+        cell.slopeY[i] = slopeY[i];
+
+        // The rows go towards -Y.
+        const ignition::math::Vector3d norm(-slopeX[i] / this->scaleX,
+            slopeY[i] / this->scaleY, 1);
+        cell.normal[i] = packNormal(norm.Normalized());
+      }
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+bool Heightmap::Valid() const
+{
+  return !this->heights.empty();
+}
+
+//////////////////////////////////////////////////
+double Heightmap::HeightAt(const double _x, const double _y) const
+{
+  if (!this->Valid())
+    return 0;
+
+  // Position in samples.
+  const double gx = std::max(0.0, std::min(this->columns - 1.0,
+        (this->size.X() * 0.5 + _x) / this->scaleX));
+  const double gy = std::max(0.0, std::min(this->rows - 1.0,
+        (this->size.Y() * 0.5 - _y) / this->scaleY));
+
+  const int x0 = std::min(static_cast<int>(gx), this->columns - 2);
+  const int y0 = std::min(static_cast<int>(gy), this->rows - 2);
+  const double fx = gx - x0;
+  const double fy = gy - y0;
+
+  const float *row0 = &this->heights[y0 * this->columns + x0];
+  return Interpolate(row0, row0 + this->columns, fx, fy);
+}
+
+//////////////////////////////////////////////////
+double Heightmap::Interpolate(const float *_row0, const float *_row1,
+    const double _fx, const double _fy)
+{
+  return (_row0[0] * (1 - _fx) + _row0[1] * _fx) * (1 - _fy) +
+         (_row1[0] * (1 - _fx) + _row1[1] * _fx) * _fy;
+}
+
+//////////////////////////////////////////////////
+void Heightmap::Lookup(const double _x, const double _y, double &_height,
+    ignition::math::Vector3d &_norm) const
+{
+  if (!this->Valid())
+    return;
+
+  // Position in samples.
+  const double gx = std::max(0.0, std::min(this->columns - 1.0,
+        (this->size.X() * 0.5 + _x) / this->scaleX));
+  const double gy = std::max(0.0, std::min(this->rows - 1.0,
+        (this->size.Y() * 0.5 - _y) / this->scaleY));
+
+  const int x0 = std::min(static_cast<int>(gx), this->columns - 2);
+  const int y0 = std::min(static_cast<int>(gy), this->rows - 2);
+  const double fx = gx - x0;
+  const double fy = gy - y0;
+
+  Surface(this->cells[static_cast<size_t>(y0) * (this->columns - 1) + x0],
+      fx, fy, y0 & 1, _height, _norm);
+}
+
+//////////////////////////////////////////////////
+void Heightmap::Surface(const Cell &_cell, const double _fx,
+    const double _fy, const int _odd, double &_height,
+    ignition::math::Vector3d &_norm)
+{
+  // The diagonal of the cell depends on the parity of the row.
+  const int triangle = (_fy - _fx + _odd * (2 * _fx - 1)) > 0;
+
+  _height = _cell.offset[triangle] + _fx * _cell.slopeX[triangle] +
+    _fy * _cell.slopeY[triangle];
+  _norm = unpackNormal(_cell.normal[triangle]);
+}
+
+//////////////////////////////////////////////////
+void Heightmap::Lookup(const size_t _count, const double *_x,
+    const double *_y, double *_height, ignition::math::Vector3d *_norm) const
+{
+  if (!this->Valid())
+    return;
+
+  size_t i = 0;
+  ignition::math::Vector3d norm;
+
+#ifdef __AVX2__
+  const float *words = reinterpret_cast<const float *>(this->cells.data());
+  const __m256 halfX = _mm256_set1_ps(this->size.X() * 0.5);
+  const __m256 halfY = _mm256_set1_ps(this->size.Y() * 0.5);
+  const __m256 invScaleX = _mm256_set1_ps(1.0 / this->scaleX);
+  const __m256 invScaleY = _mm256_set1_ps(1.0 / this->scaleY);
+  const __m256 lastX = _mm256_set1_ps(this->columns - 1.0f);
+  const __m256 lastY = _mm256_set1_ps(this->rows - 1.0f);
+  const __m256i lastCellX = _mm256_set1_epi32(this->columns - 2);
+  const __m256i lastCellY = _mm256_set1_epi32(this->rows - 2);
+  const __m256i cellColumns = _mm256_set1_epi32(this->columns - 1);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 two = _mm256_set1_ps(2.0f);
+  const __m256 invNormalScale = _mm256_set1_ps(1.0f / kNormalScale);
+
+  alignas(32) float heights8[8];
+  alignas(32) float normX[8];
+  alignas(32) float normY[8];
+  alignas(32) float normZ[8];
+
+  for (; i + 8 <= _count; i += 8)
+  {
+    const __m256 x = _mm256_set_m128(
+        _mm256_cvtpd_ps(_mm256_loadu_pd(_x + i + 4)),
+        _mm256_cvtpd_ps(_mm256_loadu_pd(_x + i)));
+    const __m256 y = _mm256_set_m128(
+        _mm256_cvtpd_ps(_mm256_loadu_pd(_y + i + 4)),
+        _mm256_cvtpd_ps(_mm256_loadu_pd(_y + i)));
+
+    // Position in samples.
+    const __m256 gx = _mm256_max_ps(zero, _mm256_min_ps(lastX,
+          _mm256_mul_ps(_mm256_add_ps(halfX, x), invScaleX)));
+    const __m256 gy = _mm256_max_ps(zero, _mm256_min_ps(lastY,
+          _mm256_mul_ps(_mm256_sub_ps(halfY, y), invScaleY)));
+
+    const __m256i x0 = _mm256_min_epi32(_mm256_cvttps_epi32(gx), lastCellX);
+    const __m256i y0 = _mm256_min_epi32(_mm256_cvttps_epi32(gy), lastCellY);
+    const __m256 fx = _mm256_sub_ps(gx, _mm256_cvtepi32_ps(x0));
+    const __m256 fy = _mm256_sub_ps(gy, _mm256_cvtepi32_ps(y0));
+
+    // The diagonal of the cell depends on the parity of the row.
+    const __m256 odd = _mm256_cvtepi32_ps(
+        _mm256_and_si256(y0, _mm256_set1_epi32(1)));
+    const __m256 side = _mm256_add_ps(_mm256_sub_ps(fy, fx),
+        _mm256_mul_ps(odd, _mm256_sub_ps(_mm256_mul_ps(two, fx), one)));
+    const __m256i triangle = _mm256_srli_epi32(_mm256_castps_si256(
+          _mm256_cmp_ps(side, zero, _CMP_GT_OQ)), 31);
+
+    // Index of the first word of the triangle in the cells.
+    const __m256i cell = _mm256_add_epi32(
+        _mm256_mullo_epi32(y0, cellColumns), x0);
+    const __m256i index = _mm256_add_epi32(_mm256_slli_epi32(cell, 3),
+        triangle);
+
+    const __m256 offset = _mm256_i32gather_ps(words, index, 4);
+    const __m256 slopeX = _mm256_i32gather_ps(words + 2, index, 4);
+    const __m256 slopeY = _mm256_i32gather_ps(words + 4, index, 4);
+    _mm256_store_ps(heights8, _mm256_add_ps(offset, _mm256_add_ps(
+            _mm256_mul_ps(fx, slopeX), _mm256_mul_ps(fy, slopeY))));
+
+    if (_norm)
+    {
+      const __m256i packed = _mm256_i32gather_epi32(
+          reinterpret_cast<const int *>(words + 6), index, 4);
+      const __m256 nx = _mm256_mul_ps(invNormalScale, _mm256_cvtepi32_ps(
+            _mm256_srai_epi32(_mm256_slli_epi32(packed, 16), 16)));
+      const __m256 ny = _mm256_mul_ps(invNormalScale, _mm256_cvtepi32_ps(
+            _mm256_srai_epi32(packed, 16)));
+      const __m256 nz = _mm256_sqrt_ps(_mm256_max_ps(zero, _mm256_sub_ps(one,
+              _mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)))));
+      _mm256_store_ps(normX, nx);
+      _mm256_store_ps(normY, ny);
+      _mm256_store_ps(normZ, nz);
+    }
+
+    for (size_t k = 0; k < 8; ++k)
+    {
+      _height[i + k] = heights8[k];
+      if (_norm)
+        _norm[i + k].Set(normX[k], normY[k], normZ[k]);
+    }
+  }
+#endif
+
+  for (; i < _count; ++i)
+    this->Lookup(_x[i], _y[i], _height[i], _norm ? _norm[i] : norm);
+}
+
+//////////////////////////////////////////////////
+bool Heightmap::LineOfSight(const ignition::math::Vector3d &_p1,
+    const ignition::math::Vector3d &_p2) const
+{
+  double t;
+  return this->Excess(_p1, _p2, true, t) <= 0;
+}
+
+//////////////////////////////////////////////////
+double Heightmap::Clearance(const ignition::math::Vector3d &_p1,
+    const ignition::math::Vector3d &_p2, double &_t) const
+{
+  return this->Excess(_p1, _p2, false, _t);
+}
+
+//////////////////////////////////////////////////
+double Heightmap::Excess(const ignition::math::Vector3d &_p1,
+    const ignition::math::Vector3d &_p2, const bool _firstOnly,
+    double &_t) const
+{
+  _t = 0;
+  if (!this->Valid())
+    return -std::numeric_limits<double>::infinity();
+
+  // Endpoints in samples.
+  const double x1 = (this->size.X() * 0.5 + _p1.X()) / this->scaleX;
+  const double y1 = (this->size.Y() * 0.5 - _p1.Y()) / this->scaleY;
+  const double x2 = (this->size.X() * 0.5 + _p2.X()) / this->scaleX;
+  const double y2 = (this->size.Y() * 0.5 - _p2.Y()) / this->scaleY;
+
+  // Columns are separated by one sample, rows by a full row of samples.
+  double tx, ty;
+  const double excessX = this->Crossings(x1, x2, y1, y2, _p1.Z(), _p2.Z(),
+      this->columns, this->rows, 1, this->columns, _firstOnly, tx);
+  if (_firstOnly && excessX > 0)
+  {
+    _t = tx;
+    return excessX;
+  }
+
+  const double excessY = this->Crossings(y1, y2, x1, x2, _p1.Z(), _p2.Z(),
+      this->rows, this->columns, this->columns, 1, _firstOnly, ty);
+
+  _t = excessX >= excessY ? tx : ty;
+  return std::max(excessX, excessY);
+}
+
+//////////////////////////////////////////////////
+double Heightmap::Crossings(const double _a0, const double _a1,
+    const double _b0, const double _b1, const double _z0, const double _z1,
+    const int _lineCount, const int _lineLength, const int _lineStride,
+    const int _sampleStride, const bool _firstOnly, double &_t) const
+{
+  double result = -std::numeric_limits<double>::infinity();
+  _t = 0;
+
+  const double da = _a1 - _a0;
+  if (std::abs(da) < 1e-9)
+    return result;
+
+  // Grid lines crossed by the segment, within the terrain.
+  const int first = static_cast<int>(std::ceil(
+        std::max(0.0, std::min(_a0, _a1))));
+  const int last = static_cast<int>(std::floor(
+        std::min(_lineCount - 1.0, std::max(_a0, _a1))));
+
+  // Slopes of the segment with respect to the axis.
+  const double db = (_b1 - _b0) / da;
+  const double dz = (_z1 - _z0) / da;
+
+  for (int i = first; i <= last; ++i)
+  {
+    const double s = i - _a0;
+    const double b = _b0 + s * db;
+    if (b < 0 || b > _lineLength - 1)
+      continue;
+
+    // The terrain is linear between two samples of a grid line.
+    const int j = std::min(static_cast<int>(b), _lineLength - 2);
+    const double f = b - j;
+    const float *sample = &this->heights[i * _lineStride + j * _sampleStride];
+    const double height = sample[0] * (1 - f) + sample[_sampleStride] * f;
+
+    const double excess = height - (_z0 + s * dz);
+    if (excess > result)
+    {
+      result = excess;
+      _t = s / da;
+      if (_firstOnly && result > 0)
+        break;
+    }
+  }
+
+  return result;
+}
+
+//////////////////////////////////////////////////
+int Heightmap::Columns() const
+{
+  return this->columns;
+}
+
+//////////////////////////////////////////////////
+int Heightmap::Rows() const
+{
+  return this->rows;
+}
+
+//////////////////////////////////////////////////
+ignition::math::Vector3d Heightmap::Size() const
+{
+  return this->size;
+}
+
+//////////////////////////////////////////////////
+const std::vector<float> &Heightmap::Samples() const
+{
+  return this->heights;
+}
+
+//////////////////////////////////////////////////
+uint64_t Heightmap::Hash() const
+{
+  return this->hash;
+}
+
+//////////////////////////////////////////////////
+size_t Heightmap::MemoryBytes() const
+{
+  return this->heights.capacity() * sizeof(float) +
+    this->cells.capacity() * sizeof(Cell);
+}
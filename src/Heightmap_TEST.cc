@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <random>
+#include <vector>
+#include "gtest/gtest.h"
+#include "swarm/Heightmap.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Create a flat 40x40m terrain of 5x5 samples with a 10m ridge
+/// along x = 0.
+/// \return The heightmap.
+Heightmap MakeRidge()
+{
+  std::vector<float> heights(25, 0.0f);
+  for (int y = 0; y < 5; ++y)
+    heights[y * 5 + 2] = 10.0f;
+
+  Heightmap heightmap;
+  EXPECT_TRUE(heightmap.Set(5, 5, ignition::math::Vector3d(40, 40, 10),
+        heights));
+  return heightmap;
+}
+
+//////////////////////////////////////////////////
+/// \brief Check the interpolated heights.
+TEST(HeightmapTest, HeightAt)
+{
+  Heightmap heightmap = MakeRidge();
+  ASSERT_TRUE(heightmap.Valid());
+  EXPECT_EQ(heightmap.Columns(), 5);
+  EXPECT_EQ(heightmap.Rows(), 5);
+
+  EXPECT_DOUBLE_EQ(heightmap.HeightAt(0, 0), 10);
+  EXPECT_DOUBLE_EQ(heightmap.HeightAt(0, 13), 10);
+  EXPECT_DOUBLE_EQ(heightmap.HeightAt(-5, 0), 5);
+  EXPECT_DOUBLE_EQ(heightmap.HeightAt(2.5, -7), 7.5);
+  EXPECT_DOUBLE_EQ(heightmap.HeightAt(-20, 20), 0);
+
+  // Outside of the terrain, the closest border is used.
+  EXPECT_DOUBLE_EQ(heightmap.HeightAt(-100, 0), 0);
+  EXPECT_DOUBLE_EQ(heightmap.HeightAt(0, 100), 10);
+}
+
+//////////////////////////////////////////////////
+/// \brief Check the line of sight over the ridge.
+TEST(HeightmapTest, LineOfSight)
+{
+  Heightmap heightmap = MakeRidge();
+
+  // Across the ridge.
+  EXPECT_FALSE(heightmap.LineOfSight(ignition::math::Vector3d(-20, 0, 1),
+        ignition::math::Vector3d(20, 0, 1)));
+  EXPECT_FALSE(heightmap.LineOfSight(ignition::math::Vector3d(20, 0, 1),
+        ignition::math::Vector3d(-20, 0, 1)));
+  EXPECT_TRUE(heightmap.LineOfSight(ignition::math::Vector3d(-20, 0, 11),
+        ignition::math::Vector3d(20, 0, 11)));
+  EXPECT_FALSE(heightmap.LineOfSight(ignition::math::Vector3d(-15, -15, 5),
+        ignition::math::Vector3d(15, 15, 5)));
+
+  // One endpoint high enough to see over the ridge.
+  EXPECT_TRUE(heightmap.LineOfSight(ignition::math::Vector3d(-10, 0, 1),
+        ignition::math::Vector3d(10, 0, 30)));
+
+  // On the same side.
+  EXPECT_TRUE(heightmap.LineOfSight(ignition::math::Vector3d(-20, 0, 1),
+        ignition::math::Vector3d(-10, 5, 1)));
+
+  // Along the ridge.
+  EXPECT_TRUE(heightmap.LineOfSight(ignition::math::Vector3d(0, -20, 11),
+        ignition::math::Vector3d(0, 20, 11)));
+  EXPECT_FALSE(heightmap.LineOfSight(ignition::math::Vector3d(0, -20, 9),
+        ignition::math::Vector3d(0, 20, 9)));
+
+  // Outside of the terrain.
+  EXPECT_TRUE(heightmap.LineOfSight(ignition::math::Vector3d(-100, 0, 1),
+        ignition::math::Vector3d(-50, 0, 1)));
+}
+
+//////////////////////////////////////////////////
+/// \brief Check how far the ridge rises above segments.
+TEST(HeightmapTest, Clearance)
+{
+  Heightmap heightmap = MakeRidge();
+
+  double t;
+  EXPECT_DOUBLE_EQ(heightmap.Clearance(ignition::math::Vector3d(-20, 0, 1),
+        ignition::math::Vector3d(20, 0, 1), t), 9);
+  EXPECT_DOUBLE_EQ(t, 0.5);
+
+  EXPECT_DOUBLE_EQ(heightmap.Clearance(ignition::math::Vector3d(-10, 0, 1),
+        ignition::math::Vector3d(20, 0, 1), t), 9);
+  EXPECT_DOUBLE_EQ(t, 1.0 / 3.0);
+
+  // Clear segments have a negative clearance.
+  EXPECT_LT(heightmap.Clearance(ignition::math::Vector3d(-20, 0, 12),
+        ignition::math::Vector3d(20, 0, 12), t), 0);
+}
+
+//////////////////////////////////////////////////
+/// \brief Check the hash and the invalid heightmaps.
+TEST(HeightmapTest, Hash)
+{
+  Heightmap heightmap = MakeRidge();
+  EXPECT_NE(heightmap.Hash(), 0u);
+  EXPECT_EQ(heightmap.Hash(), MakeRidge().Hash());
+
+  std::vector<float> heights(25, 0.0f);
+  Heightmap flat;
+  EXPECT_TRUE(flat.Set(5, 5, ignition::math::Vector3d(40, 40, 10), heights));
+  EXPECT_NE(flat.Hash(), heightmap.Hash());
+
+  Heightmap invalid;
+  EXPECT_FALSE(invalid.Valid());
+  EXPECT_EQ(invalid.Hash(), 0u);
+  EXPECT_TRUE(invalid.LineOfSight(ignition::math::Vector3d(-20, 0, 1),
+        ignition::math::Vector3d(20, 0, 1)));
+  EXPECT_FALSE(invalid.Set(5, 4, ignition::math::Vector3d(40, 40, 10),
+        heights));
+  EXPECT_FALSE(invalid.Set(1, 25, ignition::math::Vector3d(40, 40, 10),
+        heights));
+  EXPECT_FALSE(invalid.Valid());
+}
+
+//////////////////////////////////////////////////
+/// \brief Check that the surface follows the triangles of each row.
+TEST(HeightmapTest, Lookup)
+{
+  // 20x20m terrain of 3x3 samples, with two raised samples: one in the
+  // first row, and one in the last row.
+  std::vector<float> heights(9, 0.0f);
+  heights[1] = 10.0f;
+  heights[7] = 10.0f;
+  Heightmap heightmap;
+  ASSERT_TRUE(heightmap.Set(3, 3, ignition::math::Vector3d(20, 20, 10),
+        heights));
+
+  double height;
+  ignition::math::Vector3d norm;
+
+  // Even rows are split along the diagonal from the first sample, so the
+  // raised sample only lifts the triangle below the diagonal.
+  heightmap.Lookup(-2.5, 7.5, height, norm);
+  EXPECT_NEAR(height, 5, 1e-5);
+  EXPECT_NEAR(norm.Length(), 1, 1e-4);
+  EXPECT_GT(norm.Z(), 0);
+  heightmap.Lookup(-7.5, 2.5, height, norm);
+  EXPECT_NEAR(height, 0, 1e-5);
+  EXPECT_NEAR(norm.Z(), 1, 1e-4);
+
+  // Odd rows are split along the other diagonal.
+  heightmap.Lookup(-2.5, -7.5, height, norm);
+  EXPECT_NEAR(height, 5, 1e-5);
+  heightmap.Lookup(-2.5, -2, height, norm);
+  EXPECT_NEAR(height, 0, 1e-5);
+
+  // The samples, and the closest border outside of the terrain.
+  heightmap.Lookup(0, 10, height, norm);
+  EXPECT_NEAR(height, 10, 1e-5);
+  heightmap.Lookup(0, 100, height, norm);
+  EXPECT_NEAR(height, 10, 1e-5);
+
+  // A sloped plane.
+  for (int y = 0; y < 3; ++y)
+  {
+    for (int x = 0; x < 3; ++x)
+      heights[y * 3 + x] = 0.1 * (x * 10 - 10) + 0.2 * (10 - y * 10) + 3;
+  }
+  ASSERT_TRUE(heightmap.Set(3, 3, ignition::math::Vector3d(20, 20, 10),
+        heights));
+  const ignition::math::Vector3d slope =
+    ignition::math::Vector3d(-0.1, -0.2, 1).Normalize();
+  for (double x = -9.5; x < 10; x += 3)
+  {
+    for (double y = -9.5; y < 10; y += 3)
+    {
+      heightmap.Lookup(x, y, height, norm);
+      EXPECT_NEAR(height, 0.1 * x + 0.2 * y + 3, 1e-5);
+      EXPECT_NEAR(norm.X(), slope.X(), 1e-4);
+      EXPECT_NEAR(norm.Y(), slope.Y(), 1e-4);
+      EXPECT_NEAR(norm.Z(), slope.Z(), 1e-4);
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+/// \brief Check that the batched lookup matches the single one.
+TEST(HeightmapTest, LookupBatch)
+{
+  std::mt19937 rnd(3);
+  std::uniform_real_distribution<float> sample(0, 50);
+  std::vector<float> heights(33 * 17);
+  for (auto &h : heights)
+    h = sample(rnd);
+  Heightmap heightmap;
+  ASSERT_TRUE(heightmap.Set(33, 17, ignition::math::Vector3d(320, 160, 50),
+        heights));
+
+  // Some coordinates are outside of the terrain.
+  const size_t count = 101;
+  std::uniform_real_distribution<double> coordinate(-200, 200);
+  std::vector<double> x(count), y(count), batchHeights(count);
+  std::vector<ignition::math::Vector3d> batchNorms(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    x[i] = coordinate(rnd);
+    y[i] = coordinate(rnd);
+  }
+  heightmap.Lookup(count, x.data(), y.data(), batchHeights.data(),
+      batchNorms.data());
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    double height;
+    ignition::math::Vector3d norm;
+    heightmap.Lookup(x[i], y[i], height, norm);
+    EXPECT_NEAR(batchHeights[i], height, 1e-3);
+    EXPECT_NEAR(batchNorms[i].X(), norm.X(), 1e-4);
+    EXPECT_NEAR(batchNorms[i].Y(), norm.Y(), 1e-4);
+    EXPECT_NEAR(batchNorms[i].Z(), norm.Z(), 1e-4);
+  }
+
+  // Without normals.
+  std::vector<double> onlyHeights(count);
+  heightmap.Lookup(count, x.data(), y.data(), onlyHeights.data(), nullptr);
+  EXPECT_EQ(onlyHeights, batchHeights);
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -17,13 +17,20 @@
 #include <chrono>
 #include <gazebo/gazebo_config.h>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
 #include <gazebo/common/CommonIface.hh>
 #include <gazebo/common/Console.hh>
 #include <gazebo/common/Time.hh>
 #include <ignition/math/Rand.hh>
+#include "msgs/checkpoint.pb.h"
 #include "msgs/log_entry.pb.h"
 #include "msgs/log_header.pb.h"
 #include "swarm/config.hh"
@@ -34,8 +41,30 @@ using namespace swarm;
 //////////////////////////////////////////////////
 Logger *Logger::Instance()
 {
-  static Logger instance;
-  return &instance;
+  return Instance("");
+}
+
+//////////////////////////////////////////////////
+Logger *Logger::Instance(const std::string &_world)
+{
+  using LoggerPtr = std::unique_ptr<Logger, void(*)(Logger*)>;
+  static std::mutex mutex;
+  static std::map<std::string, LoggerPtr> instances;
+  static unsigned int numWorlds = 0;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = instances.find(_world);
+  if (it == instances.end())
+  {
+    LoggerPtr instance(new Logger(), [](Logger *_logger) {delete _logger;});
+
+    // The worlds after the first one write to their own file.
+    if (!_world.empty() && numWorlds++ > 0)
+      instance->fileName = "swarm_" + _world + ".log";
+
+    it = instances.emplace(_world, std::move(instance)).first;
+  }
+  return it->second.get();
 }
 
 //////////////////////////////////////////////////
@@ -48,6 +77,49 @@ Logger::Logger()
   char *logMinEnv = std::getenv("SWARM_LOG_MIN");
   this->min = ((logMinEnv) && (std::string(logMinEnv) == "1"));
   std::cout << "Min[" << this->min << "]\n";
+
+  char *logMinRecordsEnv = std::getenv("SWARM_LOG_MIN_RECORDS");
+  this->records = this->min &&
+    ((logMinRecordsEnv) && (std::string(logMinRecordsEnv) == "1"));
+
+  char *logVisibilityDeltaEnv = std::getenv("SWARM_LOG_VISIBILITY_DELTA");
+  this->visibilityDelta = ((logVisibilityDeltaEnv) &&
+      (std::string(logVisibilityDeltaEnv) == "1"));
+
+  char *logReplayEnv = std::getenv("SWARM_LOG_REPLAY");
+  this->replay = ((logReplayEnv) && (std::string(logReplayEnv) == "1"));
+
+  char *logAsyncEnv = std::getenv("SWARM_LOG_ASYNC");
+  this->async = ((logAsyncEnv) && (std::string(logAsyncEnv) == "1"));
+
+  char *logAsyncDropEnv = std::getenv("SWARM_LOG_ASYNC_DROP");
+  this->dropWhenFull =
+    ((logAsyncDropEnv) && (std::string(logAsyncDropEnv) == "1"));
+
+  char *logCompressEnv = std::getenv("SWARM_LOG_COMPRESS");
+  this->compressed =
+    ((logCompressEnv) && (std::string(logCompressEnv) == "1"));
+
+  char *logAdaptiveEnv = std::getenv("SWARM_LOG_ADAPTIVE");
+  this->adaptive =
+    ((logAdaptiveEnv) && (std::string(logAdaptiveEnv) == "1"));
+
+  char *logRotateSizeEnv = std::getenv("SWARM_LOG_ROTATE_SIZE");
+  if (logRotateSizeEnv && std::atof(logRotateSizeEnv) > 0)
+  {
+    this->rotateSize =
+      static_cast<uint64_t>(std::atof(logRotateSizeEnv) * (1 << 20));
+  }
+
+  char *logRotateTimeEnv = std::getenv("SWARM_LOG_ROTATE_TIME");
+  if (logRotateTimeEnv && std::atof(logRotateTimeEnv) > 0)
+    this->rotateTime = std::atof(logRotateTimeEnv);
+}
+
+//////////////////////////////////////////////////
+Logger::~Logger()
+{
+  this->Close();
 }
 
 /////////////////////////////////////////////////
@@ -76,33 +148,94 @@ void Logger::CreateLogFile(const double _maxStepSize, sdf::ElementPtr _sdf)
     if (!boost::filesystem::exists(this->logCompletePath))
       boost::filesystem::create_directories(this->logCompletePath);
 
-    this->logCompletePath = this->logCompletePath / "swarm.log";
+    this->logCompletePath = this->logCompletePath / this->fileName;
 
     gzmsg << "Logging enabled [" << this->logCompletePath.string()
           << "]" << std::endl;
 
-    // Close an open stream
-    if (this->output.is_open())
-      this->output.close();
+    // Close an open stream, once its entries are written.
+    this->Close();
 
-    // Create the log file.
-    this->output.open(this->logCompletePath.string(),
-      std::ios::out | std::ios::binary);
+    // Read the log periods, overridden by SWARM_LOG_PERIODS.
+    this->logPeriods.clear();
+    this->defaultLogPeriod = 0;
+    this->nextLogTimes.clear();
+    if (_sdf && _sdf->HasElement("log_info"))
+    {
+      auto const &logElem = _sdf->GetElement("log_info");
+      if (logElem->HasElement("log_period"))
+      {
+        auto periodElem = logElem->GetElement("log_period");
+        while (periodElem)
+        {
+          const double period = periodElem->Get<double>();
+          if (periodElem->HasAttribute("client"))
+          {
+            this->logPeriods[
+              periodElem->GetAttribute("client")->GetAsString()] = period;
+          }
+          else
+            this->defaultLogPeriod = period;
+          periodElem = periodElem->GetNextElement("log_period");
+        }
+      }
+    }
+
+    const char *logPeriodsEnv = std::getenv("SWARM_LOG_PERIODS");
+    if (logPeriodsEnv)
+      this->SetLogPeriods(logPeriodsEnv);
 
     // Fill the header.
     this->FillHeader(_maxStepSize, _sdf);
+    this->summary = RunSummary(this->header);
+    this->summaryPath = RunSummaryPath(this->FilePath());
 
-    // Write the length of the header to be serialized.
-    int32_t size = this->header.ByteSize();
-    this->output.write(reinterpret_cast<char*>(&size), sizeof(size));
-
-    if (!this->header.SerializeToOstream(&this->output))
-    {
-      std::cerr << "Failed to write header into disk." << std::endl;
+    // Create the log file, or the first chunk of a rotated log.
+    this->chunkIndex = 0;
+    this->chunkBytes = 0;
+    this->chunkStart = -1;
+    this->OpenFile(0);
+    if (!this->output.is_open())
       return;
-    }
-    this->output.flush();
+    this->OpenRecords(0);
+    this->fileOpen = true;
+
+    if (this->async)
+      this->writer = std::thread(&Logger::RunWriter, this);
+  }
+}
+
+//////////////////////////////////////////////////
+void Logger::OpenFile(const uint32_t _chunk)
+{
+  this->CloseFile();
+
+  this->fileIndex = _chunk;
+  const std::string path = this->ChunkPath(_chunk);
+  this->output.open(path, std::ios::out | std::ios::binary);
+  if (!this->output.is_open())
+  {
+    std::cerr << "Failed to create log file [" << path << "]" << std::endl;
+    return;
   }
+
+  if (this->compressed)
+    this->output.write(kLogBlockMagic, kLogMagicSize);
+
+  // Each chunk of a rotated log knows its index.
+  if (this->rotateSize > 0 || this->rotateTime > 0)
+    this->header.set_chunk(_chunk);
+
+  // Write the length of the header to be serialized.
+  int32_t size = this->header.ByteSize();
+  this->output.write(reinterpret_cast<char*>(&size), sizeof(size));
+
+  if (!this->header.SerializeToOstream(&this->output))
+  {
+    std::cerr << "Failed to write header into disk." << std::endl;
+    return;
+  }
+  this->output.flush();
 }
 
 //////////////////////////////////////////////////
@@ -111,6 +244,26 @@ std::string Logger::FilePath() const
   return this->logCompletePath.string();
 }
 
+//////////////////////////////////////////////////
+std::string Logger::ChunkPath(const uint32_t _chunk) const
+{
+  if (_chunk == 0)
+    return this->FilePath();
+
+  // E.g. swarm.0001.log.
+  char index[16];
+  std::snprintf(index, sizeof(index), ".%04u", _chunk);
+  auto path = this->logCompletePath;
+  const std::string extension = path.extension().string();
+  return path.replace_extension().string() + index + extension;
+}
+
+//////////////////////////////////////////////////
+uint32_t Logger::Chunk() const
+{
+  return this->chunkIndex;
+}
+
 //////////////////////////////////////////////////
 bool Logger::Register(const std::string &_id, const Loggable *_client)
 {
@@ -135,28 +288,141 @@ bool Logger::Unregister(const std::string &_id)
     return false;
   }
 
+  this->nextLogTimes.erase(_id);
   return true;
 }
 
+//////////////////////////////////////////////////
+bool Logger::Enabled() const
+{
+  return this->enabled && this->fileOpen;
+}
+
+//////////////////////////////////////////////////
+bool Logger::Minimal() const
+{
+  return this->min;
+}
+
+//////////////////////////////////////////////////
+bool Logger::VisibilityDelta() const
+{
+  return this->visibilityDelta;
+}
+
+//////////////////////////////////////////////////
+bool Logger::Replay() const
+{
+  return this->replay;
+}
+
+//////////////////////////////////////////////////
+double Logger::LogPeriod(const std::string &_id) const
+{
+  auto it = this->logPeriods.find(_id);
+  if (it != this->logPeriods.end())
+    return it->second;
+  return this->defaultLogPeriod;
+}
+
+//////////////////////////////////////////////////
+bool Logger::Adaptive() const
+{
+  return this->adaptive;
+}
+
+//////////////////////////////////////////////////
+bool Logger::LogDue(const std::string &_id, const Loggable &_client,
+    const double _simTime)
+{
+  const double period = this->LogPeriod(_id);
+  if (period <= 0)
+    return true;
+
+  // Tolerate the rounding of the simulation time, so a period multiple of
+  // the step size is honored exactly.
+  const double kTolerance = 1e-9;
+  auto it = this->nextLogTimes.find(_id);
+  if (it == this->nextLogTimes.end())
+    it = this->nextLogTimes.emplace(_id, _simTime).first;
+
+  // The simulation time went backwards, e.g. after a reset.
+  if (_simTime < it->second - period)
+    it->second = _simTime;
+
+  if (_simTime + kTolerance >= it->second)
+  {
+    // Keep the average rate when the period isn't a multiple of the step
+    // size, but don't catch up after a pause.
+    it->second += period;
+    if (it->second + kTolerance <= _simTime)
+      it->second = _simTime + period;
+    return true;
+  }
+
+  return this->adaptive && _client.LogChanged();
+}
+
+//////////////////////////////////////////////////
+void Logger::SetLogPeriods(const std::string &_periods)
+{
+  std::istringstream stream(_periods);
+  std::string item;
+  while (std::getline(stream, item, ','))
+  {
+    const size_t equal = item.find('=');
+    std::string id = "*";
+    std::string value = item;
+    if (equal != std::string::npos)
+    {
+      id = item.substr(0, equal);
+      value = item.substr(equal + 1);
+    }
+
+    char *end = nullptr;
+    const double period = std::strtod(value.c_str(), &end);
+    if (value.empty() || *end != '\0')
+    {
+      std::cerr << "Logger: Invalid log period [" << item
+                << "] in SWARM_LOG_PERIODS" << std::endl;
+      continue;
+    }
+
+    if (id == "*")
+      this->defaultLogPeriod = period;
+    else
+      this->logPeriods[id] = period;
+  }
+}
+
 //////////////////////////////////////////////////
 void Logger::Update(const double _simTime)
 {
-  if (!this->output.is_open() || !this->enabled)
+  if (!this->fileOpen || !this->enabled)
     return;
 
-  // Fill the simulation time of the log entry.
+  // Start a new chunk of a rotated log once the current one is full, so
+  // the entries of this update all go to the new one.
+  if (this->chunkStart < 0)
+    this->chunkStart = _simTime;
+  else if ((this->rotateSize > 0 && this->chunkBytes >= this->rotateSize) ||
+      (this->rotateTime > 0 &&
+       _simTime - this->chunkStart >= this->rotateTime - 1e-9))
+  {
+    this->Rotate();
+    this->chunkStart = _simTime;
+  }
+
+  // Fill the simulation time of the log entry. The entries are filled in
+  // place, and keep their memory from one update to the next.
+  this->updated.clear();
   for (const auto &kv : this->clients)
   {
-    auto id = kv.first;
+    auto const &id = kv.first;
     auto client = kv.second;
 
     if (this->min)
     {
-      msgs::LogEntryMin logEntryMsg;
-
-      // The logger sets some fields.
-      logEntryMsg.set_time(_simTime);
-
       if (!client)
       {
         std::cerr << "Logger::Update() error: Client [" << id
@@ -165,20 +431,45 @@ void Logger::Update(const double _simTime)
         continue;
       }
 
+      if (!this->LogDue(id, *client, _simTime))
+        continue;
+
+      msgs::LogEntryMin &logEntryMsg = this->logMin[id];
+      logEntryMsg.Clear();
+
+      // The logger sets some fields.
+      logEntryMsg.set_time(_simTime);
+
       // The client sets some fields.
       client->OnLogMin(logEntryMsg);
 
-      // We save the logEntry in memory.
-      this->logMin[id] = logEntryMsg;
+      // The scalars go into the records, and the rest into the log. The
+      // summary adds them up as swarmlog reads them back.
+      if (this->records)
+      {
+        LogMinRecord record;
+        if (TakeRecord(logEntryMsg, record))
+        {
+          this->recordOutput.write(reinterpret_cast<const char*>(&record),
+              sizeof(record));
+          this->summary.AddStep(record);
+          this->summary.UpdateDuration(record.time);
+        }
+        if (logEntryMsg.boo_report_size() == 0 &&
+            !logEntryMsg.has_timings() &&
+            logEntryMsg.comms_fidelity_size() == 0 &&
+            !logEntryMsg.has_connectivity())
+        {
+          continue;
+        }
+      }
+      else
+        this->summary.AddStep(RunSummary::Record(logEntryMsg));
+      this->summary.AddEntry(logEntryMsg);
+      this->updated.push_back(&logEntryMsg);
     }
     else
     {
-      msgs::LogEntry logEntryMsg;
-
-      // The logger sets some fields.
-      logEntryMsg.set_id(id);
-      logEntryMsg.set_time(_simTime);
-
       if (!client)
       {
         std::cerr << "Logger::Update() error: Client [" << id
@@ -187,53 +478,506 @@ void Logger::Update(const double _simTime)
         continue;
       }
 
+      if (!this->LogDue(id, *client, _simTime))
+        continue;
+
+      msgs::LogEntry &logEntryMsg = this->log[id];
+      logEntryMsg.Clear();
+
+      // The logger sets some fields.
+      logEntryMsg.set_id(id);
+      logEntryMsg.set_time(_simTime);
+
       // The client sets some fields.
       client->OnLog(logEntryMsg);
-
-      // We save the logEntry in memory.
-      this->log[id] = logEntryMsg;
+      this->updated.push_back(&logEntryMsg);
     }
   }
 
+  if (this->updated.empty())
+    return;
+
+  // The background thread writes the chunks into disk, or the chunks are
+  // compressed into blocks.
+  if (this->writer.joinable() || this->compressed)
+  {
+    if (this->chunk.entries == 0)
+      this->chunk.time = _simTime;
+
+    for (const auto entry : this->updated)
+      this->Append(*entry);
+
+    if (this->chunk.data.size() >= kChunkSize)
+      this->Submit();
+    return;
+  }
+
   // Flush the log into disk.
   if (this->min)
-  {
     std::cout << "flush\n";
-    for (const auto &logPair : this->logMin)
-    {
-      // Write the length of the message to be serialized.
-      int32_t size = logPair.second.ByteSize();
-      this->output.write(reinterpret_cast<char*>(&size), sizeof(size));
+  for (const auto entry : this->updated)
+  {
+    // Write the length of the message to be serialized.
+    int32_t size = entry->ByteSize();
+    this->output.write(reinterpret_cast<char*>(&size), sizeof(size));
+    this->chunkBytes += sizeof(size) + size;
 
-      if (!logPair.second.SerializeToOstream(&this->output))
-      {
-        std::cerr << "Failed to write log into disk." << std::endl;
-        return;
-      }
+    if (!entry->SerializeToOstream(&this->output))
+    {
+      std::cerr << "Failed to write log into disk." << std::endl;
+      return;
     }
   }
-  else
+
+  this->output.flush();
+}
+
+//////////////////////////////////////////////////
+void Logger::Append(const google::protobuf::MessageLite &_entry)
+{
+  // The same format as the synchronous log: the size, then the entry.
+  const int32_t size = _entry.ByteSize();
+  const size_t offset = this->chunk.data.size();
+  this->chunk.data.resize(offset + sizeof(size) + size);
+  char *data = &this->chunk.data[offset];
+  std::memcpy(data, &size, sizeof(size));
+  _entry.SerializeWithCachedSizesToArray(
+      reinterpret_cast<google::protobuf::uint8 *>(data + sizeof(size)));
+  ++this->chunk.entries;
+  this->chunkBytes += sizeof(size) + size;
+}
+
+//////////////////////////////////////////////////
+void Logger::Submit()
+{
+  if (!this->writer.joinable())
+  {
+    this->WriteChunk(this->chunk);
+    this->chunk.data.clear();
+    this->chunk.entries = 0;
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(this->writerMutex);
+  if (this->queued.size() >= kMaxQueuedChunks)
   {
-    for (const auto &logPair : this->log)
+    // The chunk that starts the next chunk of a rotated log is kept.
+    if (this->dropWhenFull && !this->chunk.rotate)
     {
-      // Write the length of the message to be serialized.
-      int32_t size = logPair.second.ByteSize();
-      this->output.write(reinterpret_cast<char*>(&size), sizeof(size));
+      ++this->droppedChunks;
+      this->chunk.data.clear();
+      this->chunk.entries = 0;
+      return;
+    }
+
+    ++this->stalls;
+    this->chunkWritten.wait(lock, [this]()
+        {
+          return this->queued.size() < kMaxQueuedChunks;
+        });
+  }
+
+  this->queued.push_back(std::move(this->chunk));
+  this->chunk = LogChunk();
+  if (!this->spare.empty())
+  {
+    this->chunk.data.swap(this->spare.back());
+    this->spare.pop_back();
+  }
+  this->chunkQueued.notify_one();
+}
+
+//////////////////////////////////////////////////
+void Logger::RunWriter()
+{
+  std::unique_lock<std::mutex> lock(this->writerMutex);
+  while (true)
+  {
+    this->chunkQueued.wait(lock, [this]()
+        {
+          return this->stopping || !this->queued.empty();
+        });
+    if (this->queued.empty())
+      break;
+
+    LogChunk block = std::move(this->queued.front());
+    this->queued.pop_front();
+    const bool last = this->queued.empty();
+    this->writing = true;
+    lock.unlock();
+
+    if (!block.data.empty())
+      this->WriteChunk(block);
+    if (block.rotate)
+      this->OpenFile(this->fileIndex + 1);
+    else if (last)
+      this->output.flush();
+
+    block.data.clear();
+    lock.lock();
+    this->spare.push_back(std::move(block.data));
+    this->writing = false;
+    this->chunkWritten.notify_all();
+  }
+}
+
+//////////////////////////////////////////////////
+void Logger::Flush()
+{
+  if (!this->fileOpen)
+    return;
+
+  if (!this->writer.joinable())
+  {
+    if (!this->chunk.data.empty())
+      this->Submit();
+    this->output.flush();
+    this->recordOutput.flush();
+    this->flushedOffset = static_cast<uint64_t>(this->output.tellp());
+    return;
+  }
+
+  this->recordOutput.flush();
+
+  if (!this->chunk.data.empty())
+    this->Submit();
 
-      if (!logPair.second.SerializeToOstream(&this->output))
+  // The background thread flushes the file once the queue is empty.
+  std::unique_lock<std::mutex> lock(this->writerMutex);
+  this->chunkWritten.wait(lock, [this]()
       {
-        std::cerr << "Failed to write log into disk." << std::endl;
-        return;
-      }
+        return this->queued.empty() && !this->writing;
+      });
+  this->flushedOffset = static_cast<uint64_t>(this->output.tellp());
+}
+
+//////////////////////////////////////////////////
+void Logger::OnSave(msgs::CheckpointPart &_part) const
+{
+  msgs::LoggerState *state = _part.mutable_logger();
+  if (this->fileOpen)
+    state->set_path(this->FilePath());
+  state->set_chunk(this->chunkIndex);
+  state->set_offset(this->flushedOffset);
+  for (auto const &next : this->nextLogTimes)
+  {
+    msgs::LogPeriod *period = state->add_period();
+    period->set_client(next.first);
+    period->set_next(next.second);
+  }
+  if (this->min)
+    state->mutable_summary()->CopyFrom(this->summary.Totals());
+}
+
+//////////////////////////////////////////////////
+bool Logger::OnRestore(const msgs::CheckpointPart &_part)
+{
+  if (!_part.has_logger())
+    return false;
+
+  this->nextLogTimes.clear();
+  for (auto const &period : _part.logger().period())
+    this->nextLogTimes[period.client()] = period.next();
+  if (_part.logger().has_summary())
+    this->summary.Restore(_part.logger().summary());
+  return true;
+}
+
+//////////////////////////////////////////////////
+void Logger::OnMemory(MemoryReport &_report) const
+{
+  uint64_t bytes = HeapBytes(this->log) + HeapBytes(this->logMin) +
+    HeapBytes(this->updated) + HeapBytes(this->logPeriods) +
+    HeapBytes(this->nextLogTimes) + HeapBytes(this->clients);
+  uint64_t elements = this->log.size() + this->logMin.size();
+  for (auto const &entry : this->log)
+    bytes += HeapBytes(entry.first) + HeapBytes(entry.second);
+  for (auto const &entry : this->logMin)
+    bytes += HeapBytes(entry.first) + HeapBytes(entry.second);
+
+  // The queued chunks are moved by the background thread, and the blocks
+  // are only stable while it's not writing one.
+  std::lock_guard<std::mutex> lock(this->writerMutex);
+  bytes += HeapBytes(this->chunk.data) + HeapBytes(this->queued) +
+    HeapBytes(this->spare);
+  elements += this->chunk.entries;
+  for (auto const &queuedChunk : this->queued)
+  {
+    bytes += HeapBytes(queuedChunk.data);
+    elements += queuedChunk.entries;
+  }
+  if (!this->writing)
+  {
+    bytes += HeapBytes(this->blocks) + HeapBytes(this->compressedChunk);
+    elements += this->blocks.size();
+  }
+
+  _report.Add("logger", bytes, elements);
+}
+
+//////////////////////////////////////////////////
+void Logger::StopWriter()
+{
+  if (!this->writer.joinable())
+    return;
+
+  this->Flush();
+  {
+    std::lock_guard<std::mutex> lock(this->writerMutex);
+    this->stopping = true;
+  }
+  this->chunkQueued.notify_one();
+  this->writer.join();
+  this->stopping = false;
+}
+
+//////////////////////////////////////////////////
+void Logger::Rotate()
+{
+  ++this->chunkIndex;
+  this->chunkBytes = 0;
+
+  // The records are written by Update(), so they start the new chunk now.
+  this->OpenRecords(this->chunkIndex);
+
+  // The background thread starts the new chunk once the entries queued
+  // for the current one are written.
+  if (this->writer.joinable())
+  {
+    this->chunk.rotate = true;
+    this->Submit();
+    return;
+  }
+
+  if (!this->chunk.data.empty())
+    this->Submit();
+  this->OpenFile(this->chunkIndex);
+}
+
+//////////////////////////////////////////////////
+void Logger::WriteChunk(const LogChunk &_chunk)
+{
+  if (!this->compressed)
+  {
+    this->output.write(_chunk.data.data(), _chunk.data.size());
+    if (!this->output)
+      std::cerr << "Failed to write log into disk." << std::endl;
+    return;
+  }
+
+  if (!CompressLogBlock(_chunk.data, this->compressedChunk))
+  {
+    std::cerr << "Failed to compress log block." << std::endl;
+    return;
+  }
+
+  LogBlockInfo info;
+  info.offset = static_cast<uint64_t>(this->output.tellp());
+  info.time = _chunk.time;
+  info.entries = _chunk.entries;
+
+  const uint32_t compressedSize = this->compressedChunk.size();
+  const uint32_t rawSize = _chunk.data.size();
+  this->output.write(reinterpret_cast<const char*>(&compressedSize),
+      sizeof(compressedSize));
+  this->output.write(reinterpret_cast<const char*>(&rawSize),
+      sizeof(rawSize));
+  this->output.write(reinterpret_cast<const char*>(&info.time),
+      sizeof(info.time));
+  this->output.write(reinterpret_cast<const char*>(&info.entries),
+      sizeof(info.entries));
+  this->output.write(this->compressedChunk.data(), compressedSize);
+  if (!this->output)
+  {
+    std::cerr << "Failed to write log into disk." << std::endl;
+    return;
+  }
+
+  this->blocks.push_back(info);
+}
+
+//////////////////////////////////////////////////
+void Logger::Close()
+{
+  if (!this->fileOpen)
+    return;
+
+  this->StopWriter();
+  this->Flush();
+  this->CloseFile();
+  this->recordOutput.close();
+  this->fileOpen = false;
+
+  // The summary of the run, once its last entries are written.
+  if (this->min)
+    this->summary.Write(this->summaryPath);
+}
+
+//////////////////////////////////////////////////
+void Logger::PrepareFork()
+{
+  if (!this->fileOpen)
+    return;
+
+  this->StopWriter();
+  this->Flush();
+}
+
+//////////////////////////////////////////////////
+void Logger::ResumeFork(const std::string &_dir)
+{
+  if (!this->fileOpen)
+    return;
+
+  if (!_dir.empty())
+  {
+    // The blocks and the index belong to the log of the parent.
+    this->blocks.clear();
+    this->output.close();
+
+    this->logCompletePath = boost::filesystem::path(_dir);
+    if (!boost::filesystem::exists(this->logCompletePath))
+      boost::filesystem::create_directories(this->logCompletePath);
+    this->logCompletePath = this->logCompletePath / this->fileName;
+
+    gzmsg << "Logging enabled [" << this->logCompletePath.string()
+          << "]" << std::endl;
+
+    this->chunkIndex = 0;
+    this->chunkBytes = 0;
+    this->chunkStart = -1;
+    this->OpenFile(0);
+    if (!this->output.is_open())
+    {
+      this->fileOpen = false;
+      return;
     }
+    this->OpenRecords(0);
+
+    // The new log only has the entries after the fork.
+    this->summary = RunSummary(this->header);
+    this->summaryPath = RunSummaryPath(this->FilePath());
   }
 
-  this->output.flush();
+  if (this->async)
+    this->writer = std::thread(&Logger::RunWriter, this);
+}
+
+//////////////////////////////////////////////////
+void Logger::CloseFile()
+{
+  if (!this->output.is_open())
+    return;
+
+  if (this->compressed)
+  {
+    // The index of the blocks, found from the end of the file.
+    const uint64_t indexOffset = static_cast<uint64_t>(this->output.tellp());
+    const uint32_t count = this->blocks.size();
+    this->output.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (const auto &info : this->blocks)
+    {
+      this->output.write(reinterpret_cast<const char*>(&info.offset),
+          sizeof(info.offset));
+      this->output.write(reinterpret_cast<const char*>(&info.time),
+          sizeof(info.time));
+      this->output.write(reinterpret_cast<const char*>(&info.entries),
+          sizeof(info.entries));
+    }
+    this->output.write(reinterpret_cast<const char*>(&indexOffset),
+        sizeof(indexOffset));
+    this->output.write(kLogIndexMagic, kLogMagicSize);
+    this->blocks.clear();
+  }
+
+  this->output.close();
+}
+
+//////////////////////////////////////////////////
+void Logger::OpenRecords(const uint32_t _chunk)
+{
+  if (!this->records)
+    return;
+
+  this->recordOutput.close();
+  const std::string path = LogRecordPath(this->ChunkPath(_chunk));
+  this->recordOutput.open(path, std::ios::out | std::ios::binary);
+  if (!this->recordOutput.is_open())
+  {
+    std::cerr << "Failed to create log records [" << path << "]"
+              << std::endl;
+    return;
+  }
+
+  const uint32_t recordSize = sizeof(LogMinRecord);
+  const uint32_t reserved = 0;
+  this->recordOutput.write(kLogRecordMagic, 8);
+  this->recordOutput.write(reinterpret_cast<const char*>(&recordSize),
+      sizeof(recordSize));
+  this->recordOutput.write(reinterpret_cast<const char*>(&reserved),
+      sizeof(reserved));
+}
+
+//////////////////////////////////////////////////
+bool Logger::TakeRecord(msgs::LogEntryMin &_entry, LogMinRecord &_record)
+{
+  if (!_entry.has_num_unicast() && !_entry.has_num_broadcast() &&
+      !_entry.has_num_multicast() && !_entry.has_bytes_sent() &&
+      !_entry.has_msgs_delivered() && !_entry.has_avg_neighbors() &&
+      !_entry.has_potential_recipients())
+  {
+    return false;
+  }
+
+  _record.time = _entry.time();
+  _record.numUnicast = _entry.num_unicast();
+  _record.numBroadcast = _entry.num_broadcast();
+  _record.numMulticast = _entry.num_multicast();
+  _record.bytesSent = _entry.bytes_sent();
+  _record.msgsDelivered = _entry.msgs_delivered();
+  _record.potentialRecipients = _entry.potential_recipients();
+  _record.avgNeighbors = _entry.avg_neighbors();
+
+  _entry.clear_num_unicast();
+  _entry.clear_num_broadcast();
+  _entry.clear_num_multicast();
+  _entry.clear_bytes_sent();
+  _entry.clear_msgs_delivered();
+  _entry.clear_potential_recipients();
+  _entry.clear_avg_neighbors();
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool Logger::Async() const
+{
+  return this->async;
+}
+
+//////////////////////////////////////////////////
+bool Logger::Compressed() const
+{
+  return this->compressed;
+}
+
+//////////////////////////////////////////////////
+uint64_t Logger::Stalls() const
+{
+  std::lock_guard<std::mutex> lock(this->writerMutex);
+  return this->stalls;
+}
+
+//////////////////////////////////////////////////
+uint64_t Logger::DroppedChunks() const
+{
+  std::lock_guard<std::mutex> lock(this->writerMutex);
+  return this->droppedChunks;
 }
 
 /////////////////////////////////////////////////
 void Logger::Reset()
 {
+  this->nextLogTimes.clear();
 }
 
 /////////////////////////////////////////////////
@@ -243,6 +987,8 @@ void Logger::FillHeader(const double _maxStepSize, sdf::ElementPtr _sdf)
   this->header.set_swarm_version(SWARM_HASH_VERSION);
   this->header.set_gazebo_version(GAZEBO_VERSION_FULL);
   this->header.set_seed(ignition::math::Rand::Seed());
+  if (this->records)
+    this->header.set_records(true);
 
   if (_sdf && _sdf->HasElement("log_info"))
   {
@@ -299,4 +1045,5 @@ void Logger::FillHeader(const double _maxStepSize, sdf::ElementPtr _sdf)
     this->header.set_team_name(std::string(teamNameEnv));
 
   this->header.set_time_step(_maxStepSize);
+  this->header.set_minimal(this->min);
 }
@@ -16,11 +16,19 @@
 */
 
 #include <stdlib.h>  // setenv
+#include <sys/wait.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
 #include "gtest/gtest.h"
+#include "msgs/log_entry_min.pb.h"
 #include "msgs/log_entry.pb.h"
 #include "msgs/log_header.pb.h"
 #include "swarm/Logger.hh"
 #include "swarm/LogParser.hh"
+#include "swarm/LogRecords.hh"
+#include "swarm/RunSummary.hh"
 
 using namespace swarm;
 
@@ -65,7 +73,12 @@ TEST(LoggerTest, Log)
   LogClient client2("#2");
   EXPECT_TRUE(logger2->Register(client2.id, &client2));
 
+  // Nothing is written until the log file is created.
+  EXPECT_FALSE(logger->Enabled());
+  EXPECT_FALSE(logger->Minimal());
+
   logger->CreateLogFile(0.01, nullptr);
+  EXPECT_TRUE(logger->Enabled());
 
   // Generate some log data.
   msgs::LogEntry logEntry;
@@ -82,6 +95,8 @@ TEST(LoggerTest, Log)
   EXPECT_TRUE(logParser.Header(header));
   EXPECT_NE(header.swarm_version(), "unknown");
   EXPECT_NE(header.gazebo_version(), "");
+  EXPECT_TRUE(header.has_minimal());
+  EXPECT_FALSE(logParser.Minimal());
   EXPECT_TRUE(logParser.Next(logEntry));
   EXPECT_EQ(logEntry.id(), client1.id);
   logEntry.Clear();
@@ -103,6 +118,683 @@ TEST(LoggerTest, Log)
   EXPECT_FALSE(logger2->Unregister(client2.id));
 }
 
+//////////////////////////////////////////////////
+/// \brief Check that each world has its own logger.
+TEST(LoggerTest, Worlds)
+{
+  Logger *loggerA = Logger::Instance("worldA");
+  Logger *loggerB = Logger::Instance("worldB");
+  EXPECT_NE(loggerA, loggerB);
+  EXPECT_EQ(loggerA, Logger::Instance("worldA"));
+  EXPECT_EQ(Logger::Instance(), Logger::Instance(""));
+
+  LogClient client("#1");
+  EXPECT_TRUE(loggerA->Register(client.id, &client));
+  EXPECT_FALSE(loggerB->Unregister(client.id));
+  EXPECT_TRUE(loggerA->Unregister(client.id));
+}
+
+//////////////////////////////////////////////////
+/// \brief Create a log written by the background thread, and check that
+/// all the entries are in order.
+TEST(LoggerTest, Async)
+{
+  setenv("SWARM_LOG_ASYNC", "1", 1);
+  Logger *logger = Logger::Instance("async");
+  unsetenv("SWARM_LOG_ASYNC");
+  EXPECT_TRUE(logger->Async());
+
+  LogClient client1("#1");
+  LogClient client2("#2");
+  EXPECT_TRUE(logger->Register(client1.id, &client1));
+  EXPECT_TRUE(logger->Register(client2.id, &client2));
+
+  logger->CreateLogFile(0.01, nullptr);
+  EXPECT_TRUE(logger->Enabled());
+
+  // Enough entries to fill more than one chunk.
+  const int kUpdates = 50000;
+  for (int i = 0; i < kUpdates; ++i)
+    logger->Update(i * 0.01);
+  logger->Flush();
+  EXPECT_EQ(logger->DroppedChunks(), 0u);
+
+  // Parse the log.
+  auto filePath = logger->FilePath();
+  msgs::LogHeader header;
+  msgs::LogEntry logEntry;
+  LogParser logParser(filePath);
+  EXPECT_TRUE(logParser.Header(header));
+  for (int i = 0; i < kUpdates; ++i)
+  {
+    for (auto const &id : {client1.id, client2.id})
+    {
+      logEntry.Clear();
+      ASSERT_TRUE(logParser.Next(logEntry));
+      EXPECT_EQ(logEntry.id(), id);
+      EXPECT_DOUBLE_EQ(logEntry.time(), i * 0.01);
+    }
+  }
+  logEntry.Clear();
+  EXPECT_FALSE(logParser.Next(logEntry));
+
+  // Seek in the flat format.
+  EXPECT_FALSE(logParser.Compressed());
+  EXPECT_TRUE(logParser.Seek(kUpdates / 2 * 0.01));
+  ASSERT_TRUE(logParser.Next(logEntry));
+  EXPECT_EQ(logEntry.id(), client1.id);
+  EXPECT_DOUBLE_EQ(logEntry.time(), kUpdates / 2 * 0.01);
+
+  // Remove the log file.
+  auto parentPath = boost::filesystem::path(filePath).parent_path();
+  EXPECT_TRUE(boost::filesystem::remove_all(parentPath));
+
+  EXPECT_TRUE(logger->Unregister(client1.id));
+  EXPECT_TRUE(logger->Unregister(client2.id));
+}
+
+//////////////////////////////////////////////////
+/// \brief Create a log in the block format, and check that it's read in
+/// order and seeks to any simulation time, with and without its index.
+TEST(LoggerTest, Compressed)
+{
+  setenv("SWARM_LOG_COMPRESS", "1", 1);
+  Logger *logger = Logger::Instance("compressed");
+  unsetenv("SWARM_LOG_COMPRESS");
+  EXPECT_TRUE(logger->Compressed());
+
+  LogClient client1("#1");
+  LogClient client2("#2");
+  EXPECT_TRUE(logger->Register(client1.id, &client1));
+  EXPECT_TRUE(logger->Register(client2.id, &client2));
+
+  logger->CreateLogFile(0.01, nullptr);
+  EXPECT_TRUE(logger->Enabled());
+
+  // Enough entries to fill several blocks.
+  const int kUpdates = 50000;
+  for (int i = 0; i < kUpdates; ++i)
+    logger->Update(i * 0.01);
+
+  auto filePath = logger->FilePath();
+  for (int pass = 0; pass < 2; ++pass)
+  {
+    // The first pass reads the log without the index, and the second one
+    // once the log is closed.
+    if (pass == 0)
+      logger->Flush();
+    else
+    {
+      logger->Close();
+      EXPECT_FALSE(logger->Enabled());
+    }
+
+    msgs::LogHeader header;
+    msgs::LogEntry logEntry;
+    LogParser logParser(filePath);
+    EXPECT_TRUE(logParser.Header(header));
+    EXPECT_TRUE(logParser.Compressed());
+    EXPECT_GT(logParser.Blocks().size(), 1u);
+
+    for (int i = 0; i < kUpdates; ++i)
+    {
+      for (auto const &id : {client1.id, client2.id})
+      {
+        logEntry.Clear();
+        ASSERT_TRUE(logParser.Next(logEntry));
+        EXPECT_EQ(logEntry.id(), id);
+        EXPECT_DOUBLE_EQ(logEntry.time(), i * 0.01);
+      }
+    }
+    logEntry.Clear();
+    EXPECT_FALSE(logParser.Next(logEntry));
+
+    // Seek backward and forward, to the first entry of each time.
+    for (int i : {kUpdates - 1, 0, kUpdates / 3, kUpdates / 2, 1})
+    {
+      EXPECT_TRUE(logParser.Seek(i * 0.01));
+      logEntry.Clear();
+      ASSERT_TRUE(logParser.Next(logEntry));
+      EXPECT_EQ(logEntry.id(), client1.id);
+      EXPECT_DOUBLE_EQ(logEntry.time(), i * 0.01);
+    }
+
+    // Seek between two times.
+    EXPECT_TRUE(logParser.Seek((kUpdates / 4 + 0.5) * 0.01));
+    logEntry.Clear();
+    ASSERT_TRUE(logParser.Next(logEntry));
+    EXPECT_DOUBLE_EQ(logEntry.time(), (kUpdates / 4 + 1) * 0.01);
+
+    // Seek after the end.
+    EXPECT_FALSE(logParser.Seek(kUpdates * 0.01));
+    EXPECT_FALSE(logParser.Next(logEntry));
+
+    // Iterate over the entries of a client in a time window.
+    LogFilter filter;
+    filter.id = client2.id;
+    filter.minTime = 100 * 0.01;
+    filter.maxTime = 200 * 0.01;
+    EXPECT_TRUE(logParser.Seek(0));
+    int count = 0;
+    for (const msgs::LogEntry &entry : logParser.Entries(filter))
+    {
+      EXPECT_EQ(entry.id(), client2.id);
+      EXPECT_DOUBLE_EQ(entry.time(), (100 + count) * 0.01);
+      ++count;
+    }
+    EXPECT_EQ(count, 101);
+
+    // Both clients, in a shorter window.
+    filter.id.clear();
+    filter.ids = {client1.id, client2.id};
+    filter.maxTime = 109 * 0.01;
+    EXPECT_TRUE(logParser.Seek(filter.minTime));
+    count = 0;
+    for (const msgs::LogEntry &entry : logParser.Entries(filter))
+    {
+      EXPECT_EQ(entry.id(), count % 2 == 0 ? client1.id : client2.id);
+      ++count;
+    }
+    EXPECT_EQ(count, 20);
+  }
+
+  // Remove the log file.
+  auto parentPath = boost::filesystem::path(filePath).parent_path();
+  EXPECT_TRUE(boost::filesystem::remove_all(parentPath));
+
+  EXPECT_TRUE(logger->Unregister(client1.id));
+  EXPECT_TRUE(logger->Unregister(client2.id));
+}
+
+//////////////////////////////////////////////////
+/// \brief A loggable class with the visibility of two robots, logged as
+/// a keyframe every three entries and the changes in between.
+class VisibilityClient : public swarm::Loggable
+{
+  // Documentation inherited.
+  void OnLog(msgs::LogEntry &_logEntry) const
+  {
+    auto delta = _logEntry.mutable_visibility_delta();
+    if (this->entries++ % 3 == 0)
+    {
+      delta->add_address("a");
+      delta->add_address("b");
+      delta->set_status(std::string(4, msgs::CommsStatus::VISIBLE));
+    }
+    else
+    {
+      // The pair (a, b) alternates between both states.
+      delta->add_changed_pair(1);
+      delta->add_changed_status(this->entries % 3 == 2 ?
+          msgs::CommsStatus::OBSTACLE : msgs::CommsStatus::VISIBLE);
+    }
+  }
+
+  /// \brief Number of entries logged.
+  private: mutable int entries = 0;
+};
+
+//////////////////////////////////////////////////
+/// \brief Check that the visibility map is rebuilt from the changes and
+/// the keyframes.
+TEST(LoggerTest, VisibilityDelta)
+{
+  Logger *logger = Logger::Instance("delta");
+  VisibilityClient client;
+  EXPECT_TRUE(logger->Register("broker", &client));
+  logger->CreateLogFile(0.01, nullptr);
+  for (int i = 0; i < 6; ++i)
+    logger->Update(i);
+  logger->Flush();
+
+  auto filePath = logger->FilePath();
+  LogParser logParser(filePath);
+  msgs::LogEntry logEntry;
+  msgs::VisibilityMap map;
+  for (int i = 0; i < 6; ++i)
+  {
+    ASSERT_TRUE(logParser.Next(logEntry));
+    ASSERT_TRUE(logParser.Visibility(logEntry, map));
+    ASSERT_EQ(map.row_size(), 2);
+    EXPECT_EQ(map.row(0).src(), "a");
+    ASSERT_EQ(map.row(0).entry_size(), 2);
+    EXPECT_EQ(map.row(0).entry(1).dst(), "b");
+    EXPECT_EQ(map.row(0).entry(1).status(), i % 3 == 1 ?
+        msgs::CommsStatus::OBSTACLE : msgs::CommsStatus::VISIBLE);
+    EXPECT_EQ(map.row(1).entry(0).status(), msgs::CommsStatus::VISIBLE);
+  }
+
+  // A seek replays the changes since the keyframe.
+  EXPECT_TRUE(logParser.Seek(4));
+  ASSERT_TRUE(logParser.Next(logEntry));
+  ASSERT_TRUE(logParser.Visibility(logEntry, map));
+  ASSERT_EQ(map.row_size(), 2);
+  EXPECT_EQ(map.row(0).entry(1).status(), msgs::CommsStatus::OBSTACLE);
+
+  // The unparsed entries track the visibility of the skipped ones too.
+  LogFilter filter;
+  filter.minTime = 1;
+  EXPECT_TRUE(logParser.Seek(0));
+  const char *record;
+  int32_t size;
+  bool skippedDelta;
+  ASSERT_TRUE(logParser.NextSerialized(record, size, filter, skippedDelta));
+  EXPECT_TRUE(skippedDelta);
+  ASSERT_TRUE(logEntry.ParseFromArray(record, size));
+  EXPECT_DOUBLE_EQ(logEntry.time(), 1);
+  msgs::VisibilityDelta keyframe;
+  ASSERT_TRUE(logParser.VisibilityKeyframe(keyframe));
+  ASSERT_EQ(keyframe.address_size(), 2);
+  EXPECT_EQ(keyframe.address(1), "b");
+  ASSERT_EQ(keyframe.status().size(), 4u);
+  EXPECT_EQ(keyframe.status()[1], msgs::CommsStatus::OBSTACLE);
+  ASSERT_TRUE(logParser.NextSerialized(record, size, filter, skippedDelta));
+  EXPECT_FALSE(skippedDelta);
+
+  // Remove the log file.
+  auto parentPath = boost::filesystem::path(filePath).parent_path();
+  EXPECT_TRUE(boost::filesystem::remove_all(parentPath));
+  EXPECT_TRUE(logger->Unregister("broker"));
+}
+
+//////////////////////////////////////////////////
+/// \brief A loggable class that reports a change when asked to.
+class ChangeClient : public swarm::Loggable
+{
+  // Documentation inherited.
+  void OnLog(msgs::LogEntry &/*_logEntry*/) const
+  {
+    this->changed = false;
+  }
+
+  // Documentation inherited.
+  bool LogChanged() const
+  {
+    return this->changed;
+  }
+
+  /// \brief True when the client has something new to log.
+  public: mutable bool changed = false;
+};
+
+//////////////////////////////////////////////////
+/// \brief Check that each client is logged at its own period, and that the
+/// changes are logged before the period elapses with adaptive logging.
+TEST(LoggerTest, Periods)
+{
+  setenv("SWARM_LOG_ADAPTIVE", "1", 1);
+  Logger *logger = Logger::Instance("periods");
+  unsetenv("SWARM_LOG_ADAPTIVE");
+  EXPECT_TRUE(logger->Adaptive());
+
+  ChangeClient fast;
+  ChangeClient slow;
+  ChangeClient event;
+  EXPECT_TRUE(logger->Register("fast", &fast));
+  EXPECT_TRUE(logger->Register("slow", &slow));
+  EXPECT_TRUE(logger->Register("event", &event));
+
+  setenv("SWARM_LOG_PERIODS", "slow=0.05,event=1,bad=x", 1);
+  logger->CreateLogFile(0.01, nullptr);
+  unsetenv("SWARM_LOG_PERIODS");
+  EXPECT_DOUBLE_EQ(logger->LogPeriod("fast"), 0);
+  EXPECT_DOUBLE_EQ(logger->LogPeriod("slow"), 0.05);
+  EXPECT_DOUBLE_EQ(logger->LogPeriod("event"), 1);
+  EXPECT_DOUBLE_EQ(logger->LogPeriod("bad"), 0);
+
+  // One second of simulation, with a change of the event client at 0.5.
+  const int kUpdates = 100;
+  for (int i = 0; i < kUpdates; ++i)
+  {
+    event.changed = (i == 50);
+    logger->Update(i * 0.01);
+  }
+  logger->Flush();
+
+  auto filePath = logger->FilePath();
+  LogParser logParser(filePath);
+  msgs::LogEntry logEntry;
+  std::map<std::string, std::vector<double>> times;
+  while (logParser.Next(logEntry))
+  {
+    times[logEntry.id()].push_back(logEntry.time());
+    logEntry.Clear();
+  }
+
+  EXPECT_EQ(times["fast"].size(), static_cast<size_t>(kUpdates));
+  ASSERT_EQ(times["slow"].size(), 20u);
+  for (size_t i = 0; i < times["slow"].size(); ++i)
+    EXPECT_NEAR(times["slow"][i], i * 0.05, 1e-9);
+  ASSERT_EQ(times["event"].size(), 2u);
+  EXPECT_DOUBLE_EQ(times["event"][0], 0);
+  EXPECT_DOUBLE_EQ(times["event"][1], 0.5);
+
+  // Remove the log file.
+  auto parentPath = boost::filesystem::path(filePath).parent_path();
+  EXPECT_TRUE(boost::filesystem::remove_all(parentPath));
+  EXPECT_TRUE(logger->Unregister("fast"));
+  EXPECT_TRUE(logger->Unregister("slow"));
+  EXPECT_TRUE(logger->Unregister("event"));
+}
+
+//////////////////////////////////////////////////
+/// \brief A minimal loggable class with the scalars of the broker.
+class CommsClient : public swarm::Loggable
+{
+  // Documentation inherited.
+  void OnLogMin(msgs::LogEntryMin &_logEntry) const
+  {
+    ++this->updates;
+    _logEntry.set_num_unicast(this->updates);
+    _logEntry.set_bytes_sent(10 * this->updates);
+    _logEntry.set_avg_neighbors(0.5 * this->updates);
+  }
+
+  /// \brief Number of entries logged.
+  public: mutable int updates = 0;
+};
+
+//////////////////////////////////////////////////
+/// \brief A minimal loggable class reporting the lost person now and then.
+class ReportClient : public swarm::Loggable
+{
+  // Documentation inherited.
+  void OnLogMin(msgs::LogEntryMin &_logEntry) const
+  {
+    if (this->updates++ % 10 != 0)
+      return;
+
+    msgs::BooReport *report = _logEntry.add_boo_report();
+    report->set_time_seen(_logEntry.time());
+    report->mutable_pos_seen()->set_x(1);
+    report->mutable_pos_seen()->set_y(2);
+    report->mutable_pos_seen()->set_z(3);
+    report->set_succeed(true);
+  }
+
+  /// \brief Number of updates.
+  public: mutable int updates = 0;
+};
+
+//////////////////////////////////////////////////
+/// \brief Check that the scalars of a minimal log are written as records,
+/// and that only the reports of the BOO stay in the log.
+TEST(LoggerTest, Records)
+{
+  setenv("SWARM_LOG_MIN", "1", 1);
+  setenv("SWARM_LOG_MIN_RECORDS", "1", 1);
+  Logger *logger = Logger::Instance("records");
+  unsetenv("SWARM_LOG_MIN");
+  unsetenv("SWARM_LOG_MIN_RECORDS");
+  EXPECT_TRUE(logger->Minimal());
+
+  CommsClient broker;
+  ReportClient boo;
+  EXPECT_TRUE(logger->Register("broker", &broker));
+  EXPECT_TRUE(logger->Register("boo", &boo));
+  logger->CreateLogFile(0.01, nullptr);
+
+  const int kUpdates = 100;
+  for (int i = 0; i < kUpdates; ++i)
+    logger->Update(i * 0.01);
+  logger->Flush();
+
+  auto filePath = logger->FilePath();
+  LogRecords records(LogRecordPath(filePath));
+  ASSERT_EQ(records.Size(), static_cast<size_t>(kUpdates));
+  for (int i = 0; i < kUpdates; ++i)
+  {
+    EXPECT_DOUBLE_EQ(records[i].time, i * 0.01);
+    EXPECT_EQ(records[i].numUnicast, i + 1);
+    EXPECT_EQ(records[i].bytesSent, 10 * (i + 1));
+    EXPECT_EQ(records[i].msgsDelivered, 0);
+    EXPECT_DOUBLE_EQ(records[i].avgNeighbors, 0.5 * (i + 1));
+  }
+  EXPECT_EQ(records.Find(0.5), 50u);
+  EXPECT_EQ(records.Find(10), records.Size());
+
+  LogParser logParser(filePath);
+  msgs::LogHeader header;
+  ASSERT_TRUE(logParser.Header(header));
+  EXPECT_TRUE(header.records());
+
+  msgs::LogEntryMin entry;
+  const char *record;
+  int32_t size;
+  int reports = 0;
+  while (logParser.NextSerialized(record, size))
+  {
+    ASSERT_TRUE(entry.ParseFromArray(record, size));
+    EXPECT_FALSE(entry.has_num_unicast());
+    ASSERT_EQ(entry.boo_report_size(), 1);
+    EXPECT_NEAR(entry.time(), reports * 0.1, 1e-9);
+    ++reports;
+  }
+  EXPECT_EQ(reports, kUpdates / 10);
+  logger->Close();
+
+  // Remove the log file.
+  auto parentPath = boost::filesystem::path(filePath).parent_path();
+  EXPECT_TRUE(boost::filesystem::remove_all(parentPath));
+  EXPECT_TRUE(logger->Unregister("broker"));
+  EXPECT_TRUE(logger->Unregister("boo"));
+}
+
+//////////////////////////////////////////////////
+/// \brief Check that a minimal log writes the summary of the run when it's
+/// closed.
+TEST(LoggerTest, Summary)
+{
+  setenv("SWARM_LOG_MIN", "1", 1);
+  setenv("SWARM_LOG_MIN_RECORDS", "1", 1);
+  Logger *logger = Logger::Instance("summary");
+  unsetenv("SWARM_LOG_MIN");
+  unsetenv("SWARM_LOG_MIN_RECORDS");
+
+  CommsClient broker;
+  ReportClient boo;
+  EXPECT_TRUE(logger->Register("broker", &broker));
+  EXPECT_TRUE(logger->Register("boo", &boo));
+  logger->CreateLogFile(0.01, nullptr);
+
+  const int kUpdates = 100;
+  for (int i = 0; i < kUpdates; ++i)
+    logger->Update(i * 0.01);
+
+  auto filePath = logger->FilePath();
+  const std::string summaryPath = RunSummaryPath(filePath);
+  EXPECT_FALSE(boost::filesystem::exists(summaryPath));
+  logger->Close();
+
+  LogParser logParser(filePath);
+  msgs::LogHeader header;
+  ASSERT_TRUE(logParser.Header(header));
+
+  msgs::RunSummary totals;
+  ASSERT_TRUE(RunSummary::Read(summaryPath, totals));
+  EXPECT_EQ(totals.timestamp(), header.timestamp());
+  EXPECT_DOUBLE_EQ(totals.time_step(), 0.01);
+  EXPECT_EQ(totals.steps(), static_cast<uint64_t>(kUpdates));
+  EXPECT_EQ(totals.msgs_sent(), static_cast<uint64_t>(kUpdates *
+        (kUpdates + 1) / 2));
+  EXPECT_TRUE(totals.succeed());
+  EXPECT_EQ(totals.wrong_reports(), 0u);
+  EXPECT_NEAR(totals.end_time(), (kUpdates - 1) * 0.01, 1e-9);
+
+  // Remove the log file.
+  auto parentPath = boost::filesystem::path(filePath).parent_path();
+  EXPECT_TRUE(boost::filesystem::remove_all(parentPath));
+  EXPECT_TRUE(logger->Unregister("broker"));
+  EXPECT_TRUE(logger->Unregister("boo"));
+}
+
+//////////////////////////////////////////////////
+/// \brief Check that a log rotated on time is split into complete logs,
+/// each one with the header and the entries of its own second.
+TEST(LoggerTest, RotateTime)
+{
+  setenv("SWARM_LOG_ROTATE_TIME", "1", 1);
+  Logger *logger = Logger::Instance("rotate_time");
+  unsetenv("SWARM_LOG_ROTATE_TIME");
+
+  LogClient client("#1");
+  EXPECT_TRUE(logger->Register(client.id, &client));
+  logger->CreateLogFile(0.01, nullptr);
+  EXPECT_EQ(logger->Chunk(), 0u);
+
+  const int kUpdates = 350;
+  for (int i = 0; i < kUpdates; ++i)
+    logger->Update(i * 0.01);
+  logger->Flush();
+  EXPECT_EQ(logger->Chunk(), 3u);
+  EXPECT_EQ(logger->ChunkPath(0), logger->FilePath());
+
+  int count = 0;
+  for (uint32_t chunk = 0; chunk <= logger->Chunk(); ++chunk)
+  {
+    LogParser logParser(logger->ChunkPath(chunk));
+    msgs::LogHeader header;
+    ASSERT_TRUE(logParser.Header(header));
+    EXPECT_EQ(header.chunk(), chunk);
+
+    msgs::LogEntry logEntry;
+    while (logParser.Next(logEntry))
+    {
+      EXPECT_DOUBLE_EQ(logEntry.time(), count * 0.01);
+      EXPECT_GE(logEntry.time(), chunk - 1e-6);
+      EXPECT_LT(logEntry.time(), chunk + 1 - 1e-6);
+      ++count;
+    }
+  }
+  EXPECT_EQ(count, kUpdates);
+
+  // Remove the log file.
+  auto parentPath = boost::filesystem::path(logger->FilePath()).parent_path();
+  EXPECT_TRUE(boost::filesystem::remove_all(parentPath));
+  EXPECT_TRUE(logger->Unregister(client.id));
+}
+
+//////////////////////////////////////////////////
+/// \brief Check that a compressed log rotated on size by the background
+/// thread never splits an update between two chunks.
+TEST(LoggerTest, RotateSize)
+{
+  setenv("SWARM_LOG_ASYNC", "1", 1);
+  setenv("SWARM_LOG_COMPRESS", "1", 1);
+  setenv("SWARM_LOG_ROTATE_SIZE", "0.5", 1);
+  Logger *logger = Logger::Instance("rotate_size");
+  unsetenv("SWARM_LOG_ASYNC");
+  unsetenv("SWARM_LOG_COMPRESS");
+  unsetenv("SWARM_LOG_ROTATE_SIZE");
+
+  LogClient client1("#1");
+  LogClient client2("#2");
+  EXPECT_TRUE(logger->Register(client1.id, &client1));
+  EXPECT_TRUE(logger->Register(client2.id, &client2));
+  logger->CreateLogFile(0.01, nullptr);
+
+  const int kUpdates = 50000;
+  for (int i = 0; i < kUpdates; ++i)
+    logger->Update(i * 0.01);
+  logger->Flush();
+  EXPECT_GT(logger->Chunk(), 1u);
+
+  int count = 0;
+  for (uint32_t chunk = 0; chunk <= logger->Chunk(); ++chunk)
+  {
+    LogParser logParser(logger->ChunkPath(chunk));
+    msgs::LogHeader header;
+    ASSERT_TRUE(logParser.Header(header));
+    EXPECT_TRUE(logParser.Compressed());
+    EXPECT_EQ(header.chunk(), chunk);
+
+    msgs::LogEntry logEntry;
+    while (logParser.Next(logEntry))
+    {
+      EXPECT_EQ(logEntry.id(), count % 2 == 0 ? client1.id : client2.id);
+      EXPECT_DOUBLE_EQ(logEntry.time(), count / 2 * 0.01);
+      ++count;
+    }
+  }
+  EXPECT_EQ(count, 2 * kUpdates);
+
+  // Remove the log file.
+  auto parentPath = boost::filesystem::path(logger->FilePath()).parent_path();
+  EXPECT_TRUE(boost::filesystem::remove_all(parentPath));
+  EXPECT_TRUE(logger->Unregister(client1.id));
+  EXPECT_TRUE(logger->Unregister(client2.id));
+}
+
+//////////////////////////////////////////////////
+/// \brief Fork a process while logging: the parent continues its log and
+/// the child writes the rest of its run into its own one.
+TEST(LoggerTest, Fork)
+{
+  setenv("SWARM_LOG_ASYNC", "1", 1);
+  setenv("SWARM_LOG_COMPRESS", "1", 1);
+  Logger *logger = Logger::Instance("fork");
+  unsetenv("SWARM_LOG_ASYNC");
+  unsetenv("SWARM_LOG_COMPRESS");
+
+  LogClient client("#1");
+  EXPECT_TRUE(logger->Register(client.id, &client));
+  logger->CreateLogFile(0.01, nullptr);
+
+  const int kUpdates = 100;
+  for (int i = 0; i < kUpdates; ++i)
+    logger->Update(i * 0.01);
+
+  const std::string parentPath = logger->FilePath();
+  const std::string childDir =
+    boost::filesystem::path(parentPath).parent_path().string() + "/replica";
+
+  logger->PrepareFork();
+  const pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0)
+  {
+    logger->ResumeFork(childDir);
+    for (int i = kUpdates; i < 2 * kUpdates; ++i)
+      logger->Update(i * 0.01);
+    logger->Close();
+    _exit(0);
+  }
+
+  logger->ResumeFork("");
+  for (int i = kUpdates; i < 2 * kUpdates; ++i)
+    logger->Update(i * 0.01);
+  logger->Close();
+  EXPECT_EQ(logger->FilePath(), parentPath);
+
+  int status;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(WEXITSTATUS(status), 0);
+
+  // The log of the parent has the whole run, and the one of the child
+  // starts at the fork.
+  const std::string childPath = childDir + "/" +
+    boost::filesystem::path(parentPath).filename().string();
+  for (auto const &path : {parentPath, childPath})
+  {
+    LogParser logParser(path);
+    msgs::LogHeader header;
+    ASSERT_TRUE(logParser.Header(header));
+    msgs::LogEntry logEntry;
+    int i = path == parentPath ? 0 : kUpdates;
+    while (logParser.Next(logEntry))
+    {
+      EXPECT_DOUBLE_EQ(logEntry.time(), i * 0.01);
+      ++i;
+    }
+    EXPECT_EQ(i, 2 * kUpdates);
+  }
+
+  auto parentDir = boost::filesystem::path(parentPath).parent_path();
+  EXPECT_TRUE(boost::filesystem::remove_all(parentDir));
+  EXPECT_TRUE(logger->Unregister(client.id));
+}
+
 //////////////////////////////////////////////////
 int main(int argc, char **argv)
 {
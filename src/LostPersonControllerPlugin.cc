@@ -22,15 +22,6 @@ using namespace swarm;
 
 GZ_REGISTER_MODEL_PLUGIN(LostPersonControllerPlugin)
 
-//////////////////////////////////////////////////
-LostPersonControllerPlugin::LostPersonControllerPlugin()
-  : LostPersonPlugin(),
-    latitude(0.0),
-    longitude(0.0),
-    altitude(0.0)
-{
-}
-
 //////////////////////////////////////////////////
 void LostPersonControllerPlugin::Load(sdf::ElementPtr _sdf)
 {
@@ -49,6 +40,48 @@ void LostPersonControllerPlugin::Load(sdf::ElementPtr _sdf)
   // Set the update period
   if (_sdf->HasElement("update_period"))
     this->updatePeriod = _sdf->Get<double>("update_period");
+
+  // Precompute the transitional probabilities over the search area
+  if (_sdf->HasElement("precompute_transitions"))
+    this->precomputeTransitions = _sdf->Get<bool>("precompute_transitions");
+
+  if (this->precomputeTransitions && !this->BuildTransitionField())
+  {
+    gzwarn << "Unable to precompute the transitions of the lost person, "
+           << "they will be computed from the map" << std::endl;
+  }
+}
+
+//////////////////////////////////////////////////
+bool LostPersonControllerPlugin::BuildTransitionField()
+{
+  // Distance walked in an update period, as in Update() (m).
+  const double distance = this->updatePeriod.Double() * velocityMagnitude;
+
+  return this->transitionField.Build(this->common.SearchMinLatitude(),
+      this->common.SearchMaxLatitude(), this->common.SearchMinLongitude(),
+      this->common.SearchMaxLongitude(), distance, degreeThreshold,
+      slopeMeans, topographyMeans,
+      [this](const double _lat, const double _lon, double &_height,
+             TerrainType &_type)
+      {
+        return this->MapQuery(_lat, _lon, _height, _type);
+      });
+}
+
+//////////////////////////////////////////////////
+bool LostPersonControllerPlugin::FieldTransition()
+{
+  size_t node;
+  if (!this->transitionField.Node(latitude, longitude, node))
+    return false;
+
+  double randomNumber = ((double) rand() / (RAND_MAX));
+  double dLat, dLon;
+  this->transitionField.Offset(
+      this->transitionField.Move(node, randomNumber), dLat, dLon);
+  MoveToPosition(latitude, longitude, latitude + dLat, longitude + dLon);
+  return true;
 }
 
 //////////////////////////////////////////////////
@@ -79,6 +112,15 @@ void LostPersonControllerPlugin::Update(const gazebo::common::UpdateInfo &_info)
       this->velocity.X() *= -1;
     }
 
+    // Use the precomputed probabilities if possible.
+    if (this->FieldTransition())
+    {
+      this->prevUpdate = _info.simTime;
+      this->model->SetLinearVel(this->velocity);
+      this->model->SetAngularVel(ignition::math::Vector3d(0, 0, 0));
+      return;
+    }
+
     if(MapQuery(latitude, longitude, altitude, curType) == false)
     {
      // printf("\n\n We're NOT inside the search area.\n\n");
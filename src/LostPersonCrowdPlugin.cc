@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <functional>
+#include <gazebo/common/Assert.hh>
+#include <gazebo/physics/physics.hh>
+#include <ignition/math/Rand.hh>
+#include "swarm/LostPersonCrowdPlugin.hh"
+
+using namespace swarm;
+
+GZ_REGISTER_WORLD_PLUGIN(LostPersonCrowdPlugin)
+
+/// \brief Maximum slope of a level move (degrees), as in
+/// LostPersonControllerPlugin.
+static const double kSlopeThreshold = 2;
+
+/// \brief Probabilities of a level, down and up move, as in
+/// LostPersonControllerPlugin.
+static const double kSlopeMeans[3] = {.4, .4, .2};
+
+/// \brief Probabilities of moving between types of terrain, as in
+/// LostPersonControllerPlugin.
+static const double kTopographyMeans[3][3] =
+  {{.3, .2, .5}, {.3, .2, .5}, {.3, .1, .6}};
+
+//////////////////////////////////////////////////
+LostPersonCrowdPlugin::~LostPersonCrowdPlugin()
+{
+  gazebo::event::Events::DisconnectWorldUpdateBegin(this->updateConnection);
+}
+
+//////////////////////////////////////////////////
+void LostPersonCrowdPlugin::Load(gazebo::physics::WorldPtr _world,
+    sdf::ElementPtr _sdf)
+{
+  GZ_ASSERT(_world, "LostPersonCrowdPlugin world pointer is NULL");
+  GZ_ASSERT(_sdf, "LostPersonCrowdPlugin sdf pointer is NULL");
+
+  this->world = _world;
+  this->common.SetWorld(this->world);
+
+  if (_sdf->HasElement("model_prefix"))
+    this->modelPrefix = _sdf->Get<std::string>("model_prefix");
+
+  if (_sdf->HasElement("update_period"))
+    this->updatePeriod = _sdf->Get<double>("update_period");
+
+  if (_sdf->HasElement("speed"))
+    this->speed = _sdf->Get<double>("speed");
+
+  if (!_sdf->HasElement("swarm_search_area") ||
+      !this->common.LoadSearchArea(_sdf->GetElement("swarm_search_area")))
+  {
+    gzerr << "LostPersonCrowdPlugin::Load() error: Unable to find the "
+          << "<swarm_search_area> parameter" << std::endl;
+    return;
+  }
+
+  sdf::ElementPtr worldSDF = _sdf->GetParent();
+  if (!worldSDF ||
+      !this->common.LoadSphericalCoordinates(
+        worldSDF->GetElement("spherical_coordinates")))
+  {
+    gzerr << "Unable to load spherical coordinates\n";
+  }
+
+  this->rndEngine = std::default_random_engine(ignition::math::Rand::Seed());
+
+  // The lost people may be loaded after the plugin, they're collected by
+  // the first update.
+  this->updateConnection = gazebo::event::Events::ConnectWorldUpdateBegin(
+      std::bind(&LostPersonCrowdPlugin::Update, this, std::placeholders::_1));
+}
+
+//////////////////////////////////////////////////
+void LostPersonCrowdPlugin::Reset()
+{
+  this->prevUpdate = 0.0;
+  this->rndEngine = std::default_random_engine(ignition::math::Rand::Seed());
+}
+
+//////////////////////////////////////////////////
+size_t LostPersonCrowdPlugin::Size() const
+{
+  return this->models.size();
+}
+
+//////////////////////////////////////////////////
+bool LostPersonCrowdPlugin::LoadCrowd()
+{
+  this->initialized = true;
+
+  for (auto const &model : this->world->GetModels())
+  {
+    if (model->GetName().compare(0, this->modelPrefix.size(),
+          this->modelPrefix) == 0)
+    {
+      this->models.push_back(model);
+      this->halfHeights.push_back(
+          model->GetBoundingBox().GetZLength() * 0.5);
+    }
+  }
+
+  const size_t count = this->models.size();
+  if (count == 0)
+  {
+    gzerr << "LostPersonCrowdPlugin: No model named [" << this->modelPrefix
+          << "*]" << std::endl;
+    return false;
+  }
+
+  this->xs.resize(count);
+  this->ys.resize(count);
+  this->lats.resize(count);
+  this->lons.resize(count);
+  this->draws.resize(count);
+  this->moves.resize(count);
+
+  const double minLat = this->common.SearchMinLatitude();
+  const double maxLat = this->common.SearchMaxLatitude();
+  const double minLon = this->common.SearchMinLongitude();
+  const double maxLon = this->common.SearchMaxLongitude();
+
+  // Every node is queried once, and the nodes are shared by the crowd.
+  if (!this->field.Build(minLat, maxLat, minLon, maxLon,
+        this->speed * this->updatePeriod.Double(), kSlopeThreshold,
+        kSlopeMeans, kTopographyMeans,
+        [this](const double _lat, const double _lon, double &_height,
+               TerrainType &_type)
+        {
+          return this->common.MapQuery(_lat, _lon, _height, _type);
+        }))
+  {
+    gzerr << "LostPersonCrowdPlugin: Unable to build the transition field"
+          << std::endl;
+  }
+
+  // The velocity of each move, from the center of the search area.
+  const TangentPlane &projection = this->common.Projection();
+  if (!projection.Valid())
+  {
+    gzerr << "LostPersonCrowdPlugin: Invalid spherical coordinates"
+          << std::endl;
+    return false;
+  }
+
+  const double midLat = (minLat + maxLat) * 0.5;
+  const double midLon = (minLon + maxLon) * 0.5;
+  double x0, y0;
+  projection.Project(midLat, midLon, x0, y0);
+  this->center.Set(x0, y0, 0);
+
+  for (int i = 0; i < TransitionField::kMoves; ++i)
+  {
+    double dLat, dLon, x, y;
+    this->field.Offset(i, dLat, dLon);
+    projection.Project(midLat + dLat, midLon + dLon, x, y);
+    ignition::math::Vector3d dir(x - x0, y - y0, 0);
+    if (dir != ignition::math::Vector3d::Zero)
+      dir = dir.Normalize() * this->speed;
+    this->moveVelocities[i] = dir;
+  }
+
+  gzmsg << "LostPersonCrowdPlugin: Driving " << count << " lost people"
+        << std::endl;
+  return true;
+}
+
+//////////////////////////////////////////////////
+void LostPersonCrowdPlugin::Update(const gazebo::common::UpdateInfo &_info)
+{
+  if (!this->initialized && !this->LoadCrowd())
+    return;
+
+  if (this->models.empty())
+    return;
+
+  if (_info.simTime - this->prevUpdate > this->updatePeriod)
+  {
+    this->Walk();
+    this->prevUpdate = _info.simTime;
+  }
+
+  this->AdjustPoses();
+}
+
+//////////////////////////////////////////////////
+void LostPersonCrowdPlugin::Walk()
+{
+  const size_t count = this->models.size();
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    const ignition::math::Vector3d pos =
+      this->models[i]->GetWorldPose().Ign().Pos();
+    this->xs[i] = pos.X();
+    this->ys[i] = pos.Y();
+  }
+
+  this->common.Projection().Unproject(count, this->xs.data(),
+      this->ys.data(), this->lats.data(), this->lons.data());
+
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  for (size_t i = 0; i < count; ++i)
+    this->draws[i] = uniform(this->rndEngine);
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    size_t node;
+    this->moves[i] = this->field.Node(this->lats[i], this->lons[i], node) ?
+      this->field.Move(node, this->draws[i]) : -1;
+  }
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    ignition::math::Vector3d velocity;
+    if (this->moves[i] >= 0)
+      velocity = this->moveVelocities[this->moves[i]];
+    else
+    {
+      // Out of the field: walk back to the center of the search area.
+      velocity.Set(this->center.X() - this->xs[i],
+          this->center.Y() - this->ys[i], 0);
+      if (velocity != ignition::math::Vector3d::Zero)
+        velocity = velocity.Normalize() * this->speed;
+    }
+
+    this->models[i]->SetLinearVel(velocity);
+    this->models[i]->SetAngularVel(ignition::math::Vector3d::Zero);
+  }
+}
+
+//////////////////////////////////////////////////
+void LostPersonCrowdPlugin::AdjustPoses()
+{
+  const Heightmap &heightmap = this->common.TerrainHeightmap();
+  if (!heightmap.Valid())
+    return;
+
+  for (size_t i = 0; i < this->models.size(); ++i)
+  {
+    ignition::math::Pose3d pose = this->models[i]->GetWorldPose().Ign();
+    pose.Pos().Z(heightmap.HeightAt(pose.Pos().X(), pose.Pos().Y()) +
+        this->halfHeights[i]);
+    this->models[i]->SetRelativePose(pose);
+  }
+}
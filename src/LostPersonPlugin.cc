@@ -56,20 +56,9 @@ void LostPersonPlugin::Load(gazebo::physics::ModelPtr _model,
 
   // We assume that the physics step size will not change during simulation.
   this->world = this->model->GetWorld();
+  // The terrain comes from the index of the world, shared with the robots.
   this->common.SetWorld(this->world);
 
-  // Get the terrain, if it's present
-  gazebo::physics::ModelPtr terrainModel =
-    this->model->GetWorld()->GetModel("terrain");
-
-  // Load some info about the terrain.
-  if (terrainModel)
-  {
-    this->common.SetTerrain(
-        boost::dynamic_pointer_cast<gazebo::physics::HeightmapShape>(
-          terrainModel->GetLink()->GetCollision("collision")->GetShape()));
-  }
-
   this->common.LoadSearchArea(_sdf->GetElement("swarm_search_area"));
 
   sdf::ElementPtr modelSDF = _sdf->GetParent();
@@ -152,6 +141,10 @@ void LostPersonPlugin::AdjustPose()
   ignition::math::Vector3d terrainPos;
   this->common.TerrainLookup(pose.Pos(), terrainPos, norm);
 
+  // Page in the terrain ahead of the vehicle before it gets there.
+  this->common.PrefetchTerrain(pose.Pos(),
+      this->model->GetWorldLinearVel().Ign());
+
   ignition::math::Vector3d euler = pose.Rot().Euler();
 
   // Project normal onto xy plane
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "swarm/MemoryAccounting.hh"
+
+using namespace swarm;
+
+std::atomic<uint32_t> MemoryAccounting::signals(0);
+
+//////////////////////////////////////////////////
+void MemoryReport::Add(const std::string &_subsystem, const uint64_t _bytes,
+    const uint64_t _elements)
+{
+  Usage &usage = this->subsystems[_subsystem];
+  usage.bytes += _bytes;
+  usage.elements += _elements;
+}
+
+//////////////////////////////////////////////////
+const std::map<std::string, MemoryReport::Usage> &
+MemoryReport::Subsystems() const
+{
+  return this->subsystems;
+}
+
+//////////////////////////////////////////////////
+MemoryReport::Usage MemoryReport::Total() const
+{
+  Usage total;
+  for (auto const &subsystem : this->subsystems)
+  {
+    total.bytes += subsystem.second.bytes;
+    total.elements += subsystem.second.elements;
+  }
+  return total;
+}
+
+//////////////////////////////////////////////////
+void MemoryReport::Print(std::ostream &_out) const
+{
+  auto line = [&_out](const std::string &_name, const Usage &_usage)
+  {
+    _out << "  " << std::left << std::setw(20) << _name << std::right
+         << std::fixed << std::setprecision(3) << std::setw(12)
+         << _usage.bytes / 1048576.0 << " MB " << std::setw(12)
+         << _usage.elements << " elements" << std::endl;
+  };
+
+  for (auto const &subsystem : this->subsystems)
+    line(subsystem.first, subsystem.second);
+  line("total", this->Total());
+}
+
+//////////////////////////////////////////////////
+MemoryAccounting *MemoryAccounting::Instance(const std::string &_world)
+{
+  static std::mutex instancesMutex;
+  static std::map<std::string, std::unique_ptr<MemoryAccounting>> instances;
+
+  std::lock_guard<std::mutex> lock(instancesMutex);
+  std::unique_ptr<MemoryAccounting> &instance = instances[_world];
+  if (!instance)
+    instance.reset(new MemoryAccounting());
+  return instance.get();
+}
+
+//////////////////////////////////////////////////
+bool MemoryAccounting::Register(const std::string &_id,
+    const MemoryAccountable *_client)
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->clients.emplace(_id, _client).second;
+}
+
+//////////////////////////////////////////////////
+bool MemoryAccounting::Unregister(const std::string &_id)
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->clients.erase(_id) > 0;
+}
+
+//////////////////////////////////////////////////
+MemoryReport MemoryAccounting::Collect() const
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  MemoryReport report;
+  for (auto const &client : this->clients)
+    client.second->OnMemory(report);
+  return report;
+}
+
+//////////////////////////////////////////////////
+bool MemoryAccounting::Enabled()
+{
+  const char *reportEnv = std::getenv("SWARM_MEMORY_REPORT");
+  return reportEnv && std::string(reportEnv) == "1";
+}
+
+//////////////////////////////////////////////////
+void MemoryAccounting::InstallSignalHandler()
+{
+  static std::once_flag installed;
+  std::call_once(installed, []()
+      {
+        std::signal(SIGUSR1, &MemoryAccounting::OnSignal);
+      });
+}
+
+//////////////////////////////////////////////////
+bool MemoryAccounting::SignalPending()
+{
+  const uint32_t received = signals.load();
+  if (received == this->handledSignals)
+    return false;
+
+  this->handledSignals = received;
+  return true;
+}
+
+//////////////////////////////////////////////////
+void MemoryAccounting::OnSignal(int /*_signal*/)
+{
+  // Only the counter is touched, which is safe in a signal handler.
+  signals.fetch_add(1);
+}
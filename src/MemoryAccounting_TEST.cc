@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <csignal>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "msgs/datagram.pb.h"
+#include "swarm/MemoryAccounting.hh"
+
+using namespace swarm;
+
+/// \brief A client holding a vector of doubles.
+class VectorClient : public MemoryAccountable
+{
+  /// \brief Constructor.
+  /// \param[in] _subsystem Subsystem of the client.
+  /// \param[in] _size Number of doubles.
+  public: VectorClient(const std::string &_subsystem, const size_t _size)
+    : subsystem(_subsystem), values(_size)
+  {
+  }
+
+  // Documentation inherited.
+  public: virtual void OnMemory(MemoryReport &_report) const
+  {
+    _report.Add(this->subsystem, HeapBytes(this->values),
+        this->values.size());
+  }
+
+  /// \brief Subsystem of the client.
+  private: std::string subsystem;
+
+  /// \brief The doubles.
+  private: std::vector<double> values;
+};
+
+//////////////////////////////////////////////////
+TEST(MemoryAccountingTest, Report)
+{
+  MemoryReport report;
+  EXPECT_TRUE(report.Subsystems().empty());
+  EXPECT_EQ(0u, report.Total().bytes);
+
+  report.Add("robots", 100, 2);
+  report.Add("robots", 50, 1);
+  report.Add("broker", 1000, 10);
+
+  ASSERT_EQ(2u, report.Subsystems().size());
+  EXPECT_EQ(150u, report.Subsystems().at("robots").bytes);
+  EXPECT_EQ(3u, report.Subsystems().at("robots").elements);
+  EXPECT_EQ(1150u, report.Total().bytes);
+  EXPECT_EQ(13u, report.Total().elements);
+
+  std::ostringstream out;
+  report.Print(out);
+  EXPECT_NE(std::string::npos, out.str().find("broker"));
+  EXPECT_NE(std::string::npos, out.str().find("robots"));
+  EXPECT_NE(std::string::npos, out.str().find("total"));
+}
+
+//////////////////////////////////////////////////
+TEST(MemoryAccountingTest, HeapBytes)
+{
+  EXPECT_EQ(0u, HeapBytes(std::string("short")));
+  const std::string longString(100, 'x');
+  EXPECT_GT(HeapBytes(longString), 100u);
+
+  std::vector<uint32_t> v;
+  v.reserve(8);
+  EXPECT_EQ(8 * sizeof(uint32_t), HeapBytes(v));
+
+  std::vector<std::string> strings = {longString, "short"};
+  EXPECT_GE(HeapBytes(strings),
+      2 * sizeof(std::string) + HeapBytes(longString));
+
+  std::map<int, double> m = {{1, 1.0}, {2, 2.0}};
+  EXPECT_EQ(2 * (sizeof(std::pair<const int, double>) +
+        MemoryReport::kMapNodeOverhead), HeapBytes(m));
+
+  // The payload of a message is on the heap.
+  msgs::Datagram msg;
+  const uint64_t empty = HeapBytes(msg);
+  msg.set_data(std::string(1000, 'x'));
+  EXPECT_GE(HeapBytes(msg), empty + 1000);
+
+  std::vector<std::shared_ptr<msgs::Datagram>> shared = {
+    std::make_shared<msgs::Datagram>(msg), nullptr};
+  EXPECT_GE(SharedMessagesBytes(shared), HeapBytes(shared) + 1000);
+}
+
+//////////////////////////////////////////////////
+TEST(MemoryAccountingTest, Collect)
+{
+  MemoryAccounting *memory = MemoryAccounting::Instance("collect");
+  EXPECT_EQ(memory, MemoryAccounting::Instance("collect"));
+  EXPECT_NE(memory, MemoryAccounting::Instance("other"));
+
+  VectorClient robot1("robots", 10);
+  VectorClient robot2("robots", 20);
+  VectorClient broker("broker", 5);
+  EXPECT_TRUE(memory->Register("192.168.2.1", &robot1));
+  EXPECT_TRUE(memory->Register("192.168.2.2", &robot2));
+  EXPECT_TRUE(memory->Register("broker", &broker));
+  EXPECT_FALSE(memory->Register("broker", &broker));
+
+  MemoryReport report = memory->Collect();
+  ASSERT_EQ(2u, report.Subsystems().size());
+  EXPECT_EQ(30 * sizeof(double), report.Subsystems().at("robots").bytes);
+  EXPECT_EQ(30u, report.Subsystems().at("robots").elements);
+  EXPECT_EQ(5u, report.Subsystems().at("broker").elements);
+
+  EXPECT_TRUE(memory->Unregister("192.168.2.2"));
+  EXPECT_FALSE(memory->Unregister("192.168.2.2"));
+  report = memory->Collect();
+  EXPECT_EQ(10u, report.Subsystems().at("robots").elements);
+
+  EXPECT_TRUE(memory->Unregister("192.168.2.1"));
+  EXPECT_TRUE(memory->Unregister("broker"));
+  EXPECT_TRUE(memory->Collect().Subsystems().empty());
+}
+
+//////////////////////////////////////////////////
+TEST(MemoryAccountingTest, Signal)
+{
+  MemoryAccounting *world1 = MemoryAccounting::Instance("signal1");
+  MemoryAccounting *world2 = MemoryAccounting::Instance("signal2");
+  MemoryAccounting::InstallSignalHandler();
+  MemoryAccounting::InstallSignalHandler();
+  EXPECT_FALSE(world1->SignalPending());
+
+  // Each world handles the signal once.
+  std::raise(SIGUSR1);
+  EXPECT_TRUE(world1->SignalPending());
+  EXPECT_FALSE(world1->SignalPending());
+  EXPECT_TRUE(world2->SignalPending());
+  EXPECT_FALSE(world2->SignalPending());
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "msgs/datagram.pb.h"
+#include "swarm/MessagePool.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Check that released messages are cleared and reused.
+TEST(MessagePoolTest, Reuse)
+{
+  MessagePool<msgs::Datagram> pool;
+  EXPECT_EQ(pool.Capacity(), MessagePool<msgs::Datagram>::kDefaultCapacity);
+
+  std::shared_ptr<msgs::Datagram> msg = pool.Make();
+  msg->set_src_address("192.168.2.1");
+  msg->set_data(std::string(1000, 'x'));
+  const msgs::Datagram *address = msg.get();
+  EXPECT_EQ(pool.Allocated(), 1u);
+  EXPECT_EQ(pool.Idle(), 0u);
+
+  // The last pointer gives the message back.
+  std::shared_ptr<msgs::Datagram> copy = msg;
+  msg.reset();
+  EXPECT_EQ(pool.Idle(), 0u);
+  copy.reset();
+  EXPECT_EQ(pool.Idle(), 1u);
+  EXPECT_GE(pool.IdleBytes(), 1000u);
+
+  msg = pool.Make();
+  EXPECT_EQ(msg.get(), address);
+  EXPECT_FALSE(msg->has_src_address());
+  EXPECT_TRUE(msg->data().empty());
+  EXPECT_EQ(pool.Reused(), 1u);
+  EXPECT_EQ(pool.Allocated(), 1u);
+
+  // Copies.
+  msg->set_dst_port(4100);
+  std::shared_ptr<msgs::Datagram> other = pool.Make(*msg);
+  EXPECT_NE(other.get(), msg.get());
+  EXPECT_EQ(other->dst_port(), 4100u);
+  EXPECT_EQ(pool.Allocated(), 2u);
+}
+
+//////////////////////////////////////////////////
+/// \brief Check the number of idle messages kept.
+TEST(MessagePoolTest, Capacity)
+{
+  MessagePool<msgs::Datagram> pool;
+  pool.SetCapacity(2);
+
+  std::vector<std::shared_ptr<msgs::Datagram>> msgs;
+  for (int i = 0; i < 4; ++i)
+    msgs.push_back(pool.Make());
+  msgs.clear();
+  EXPECT_EQ(pool.Idle(), 2u);
+
+  pool.SetCapacity(1);
+  EXPECT_EQ(pool.Capacity(), 1u);
+  EXPECT_EQ(pool.Idle(), 1u);
+}
+
+//////////////////////////////////////////////////
+/// \brief Check messages released by other threads and after the pool.
+TEST(MessagePoolTest, Threads)
+{
+  std::shared_ptr<msgs::Datagram> last;
+  {
+    MessagePool<msgs::Datagram> pool;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+      threads.emplace_back([&pool]()
+          {
+            for (int i = 0; i < 1000; ++i)
+            {
+              std::shared_ptr<msgs::Datagram> msg = pool.Make();
+              msg->set_data("payload");
+            }
+          });
+    }
+    for (auto &thread : threads)
+      thread.join();
+    EXPECT_EQ(pool.Reused() + pool.Allocated(), 4000u);
+    EXPECT_LE(pool.Allocated(), 4u);
+
+    last = pool.Make();
+  }
+
+  // The message outlives its pool.
+  last->set_data("still valid");
+  last.reset();
+}
+
+//////////////////////////////////////////////////
+/// \brief Check the factories declared by the msgs generator.
+TEST(MessagePoolTest, Generated)
+{
+  msgs::DatagramPtr msg = msgs::NewDatagram();
+  ASSERT_TRUE(msg != nullptr);
+  msg->set_dst_address("broker");
+  msgs::DatagramPtr copy = msgs::NewDatagram(*msg);
+  EXPECT_EQ(copy->dst_address(), "broker");
+  EXPECT_GE(msgs::DatagramPool::Instance().Allocated(), 1u);
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "swarm/ModelGrid.hh"
+
+using namespace swarm;
+
+/// \brief Boxes that overlap more cells than this are kept apart.
+static const int64_t kMaxCells = 64;
+
+//////////////////////////////////////////////////
+ModelGrid::ModelGrid(const double _cellSize)
+  : cellSize(_cellSize > 0 ? _cellSize : 10.0)
+{
+}
+
+//////////////////////////////////////////////////
+void ModelGrid::Clear()
+{
+  for (auto &cell : this->cells)
+    cell.second.clear();
+  this->large.clear();
+  this->count = 0;
+}
+
+//////////////////////////////////////////////////
+int32_t ModelGrid::Cell(const double _value) const
+{
+  const double limit = std::numeric_limits<int32_t>::max() - 1;
+  return static_cast<int32_t>(
+      std::max(-limit, std::min(limit, std::floor(_value / this->cellSize))));
+}
+
+//////////////////////////////////////////////////
+uint64_t ModelGrid::Key(const int32_t _x, const int32_t _y)
+{
+  return (static_cast<uint64_t>(static_cast<uint32_t>(_x)) << 32) |
+    static_cast<uint32_t>(_y);
+}
+
+//////////////////////////////////////////////////
+void ModelGrid::Add(const unsigned int _id, const ignition::math::Box &_box)
+{
+  ++this->count;
+
+  const int32_t minX = this->Cell(_box.Min().X());
+  const int32_t maxX = this->Cell(_box.Max().X());
+  const int32_t minY = this->Cell(_box.Min().Y());
+  const int32_t maxY = this->Cell(_box.Max().Y());
+  const int64_t columns = static_cast<int64_t>(maxX) - minX + 1;
+  const int64_t rows = static_cast<int64_t>(maxY) - minY + 1;
+  if (columns <= 0 || rows <= 0 || columns * rows > kMaxCells)
+  {
+    this->large.push_back(_id);
+    return;
+  }
+
+  for (int32_t x = minX; x <= maxX; ++x)
+  {
+    for (int32_t y = minY; y <= maxY; ++y)
+      this->cells[Key(x, y)].push_back(_id);
+  }
+}
+
+//////////////////////////////////////////////////
+size_t ModelGrid::Size() const
+{
+  return this->count;
+}
+
+//////////////////////////////////////////////////
+double ModelGrid::CellSize() const
+{
+  return this->cellSize;
+}
+
+//////////////////////////////////////////////////
+void ModelGrid::Query(const ignition::math::Box &_region,
+    std::vector<unsigned int> &_ids) const
+{
+  _ids.assign(this->large.begin(), this->large.end());
+
+  const int32_t minX = this->Cell(_region.Min().X());
+  const int32_t maxX = this->Cell(_region.Max().X());
+  const int32_t minY = this->Cell(_region.Min().Y());
+  const int32_t maxY = this->Cell(_region.Max().Y());
+  const int64_t columns = static_cast<int64_t>(maxX) - minX + 1;
+  const int64_t rows = static_cast<int64_t>(maxY) - minY + 1;
+
+  if (columns > 0 && rows > 0)
+  {
+    if (columns * rows <= static_cast<int64_t>(this->cells.size()))
+    {
+      for (int32_t x = minX; x <= maxX; ++x)
+      {
+        for (int32_t y = minY; y <= maxY; ++y)
+        {
+          auto it = this->cells.find(Key(x, y));
+          if (it != this->cells.end())
+            _ids.insert(_ids.end(), it->second.begin(), it->second.end());
+        }
+      }
+    }
+    else
+    {
+      // The region covers more cells than the grid has, so go through the
+      // cells of the grid instead.
+      for (auto const &cell : this->cells)
+      {
+        const int32_t x = static_cast<int32_t>(cell.first >> 32);
+        const int32_t y = static_cast<int32_t>(cell.first & 0xFFFFFFFFu);
+        if (x >= minX && x <= maxX && y >= minY && y <= maxY)
+          _ids.insert(_ids.end(), cell.second.begin(), cell.second.end());
+      }
+    }
+  }
+
+  std::sort(_ids.begin(), _ids.end());
+  _ids.erase(std::unique(_ids.begin(), _ids.end()), _ids.end());
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <vector>
+#include <ignition/math/Box.hh>
+#include "gtest/gtest.h"
+#include "swarm/ModelGrid.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Check the boxes returned by the region queries.
+TEST(ModelGridTest, Query)
+{
+  ModelGrid grid(10);
+  grid.Add(0, ignition::math::Box(1, 1, 0, 2, 2, 1));
+  grid.Add(1, ignition::math::Box(-15, 5, 0, -12, 8, 1));
+  // Across four cells.
+  grid.Add(2, ignition::math::Box(8, 8, 0, 12, 12, 1));
+  // Far away.
+  grid.Add(3, ignition::math::Box(500, 500, 0, 501, 501, 1));
+  // Spans too many cells, returned by every query.
+  grid.Add(4, ignition::math::Box(-1000, -1000, 0, 1000, 1000, 10));
+  EXPECT_EQ(grid.Size(), 5u);
+
+  std::vector<unsigned int> ids;
+  grid.Query(ignition::math::Box(0, 0, 0, 5, 5, 5), ids);
+  EXPECT_EQ(ids, std::vector<unsigned int>({0, 2, 4}));
+
+  grid.Query(ignition::math::Box(11, 11, 0, 19, 19, 5), ids);
+  EXPECT_EQ(ids, std::vector<unsigned int>({2, 4}));
+
+  grid.Query(ignition::math::Box(-20, 0, 0, 15, 15, 5), ids);
+  EXPECT_EQ(ids, std::vector<unsigned int>({0, 1, 2, 4}));
+
+  // A region larger than the grid.
+  grid.Query(ignition::math::Box(-5000, -5000, 0, 5000, 5000, 5), ids);
+  EXPECT_EQ(ids, std::vector<unsigned int>({0, 1, 2, 3, 4}));
+
+  grid.Query(ignition::math::Box(200, -200, 0, 210, -190, 5), ids);
+  EXPECT_EQ(ids, std::vector<unsigned int>({4}));
+
+  grid.Clear();
+  EXPECT_EQ(grid.Size(), 0u);
+  grid.Add(7, ignition::math::Box(501, 501, 0, 502, 502, 1));
+  grid.Query(ignition::math::Box(0, 0, 0, 5, 5, 5), ids);
+  EXPECT_TRUE(ids.empty());
+  grid.Query(ignition::math::Box(495, 495, 0, 505, 505, 5), ids);
+  EXPECT_EQ(ids, std::vector<unsigned int>({7}));
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,610 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <gazebo/common/Console.hh>
+#include <gazebo/common/Plugin.hh>
+#include <gazebo/msgs/msgs.hh>
+#include <gazebo/transport/transport.hh>
+#include <ignition/math/Angle.hh>
+#include <ignition/math/Quaternion.hh>
+#include <ignition/math/Vector3.hh>
+#include "swarm/NativeControllerPlugin.hh"
+
+using namespace swarm;
+
+GZ_REGISTER_MODEL_PLUGIN(NativeControllerPlugin)
+
+/// \brief SIGHUPs received by the process.
+static std::atomic<uint32_t> reloadSignals(0);
+
+//////////////////////////////////////////////////
+/// \brief Handler of SIGHUP. Only the counter is touched, which is safe in
+/// a signal handler.
+/// \param[in] _signal The signal.
+static void OnReloadSignal(int /*_signal*/)
+{
+  reloadSignals.fetch_add(1);
+}
+
+namespace swarm
+{
+  /// \brief A controller library, shared by the robots that load the same
+  /// path. The robots lock its mutex to use it.
+  class ControllerLibrary
+  {
+    /// \brief Identifies a version of the file of the library.
+    public: struct Fingerprint
+    {
+      /// \brief Inode of the file, which changes if it's replaced.
+      public: ino_t inode = 0;
+
+      /// \brief Size of the file.
+      public: off_t size = 0;
+
+      /// \brief Modification time of the file.
+      public: time_t mtime = 0;
+
+      /// \brief Whether two fingerprints are the same.
+      /// \param[in] _other The other fingerprint.
+      /// \return True if they are the same.
+      public: bool operator==(const Fingerprint &_other) const
+      {
+        return this->inode == _other.inode && this->size == _other.size &&
+          this->mtime == _other.mtime;
+      }
+    };
+
+    /// \brief Constructor. The library is loaded by Open().
+    /// \param[in] _path Path of the library.
+    /// \param[in] _watch Whether the changes of the file reload it.
+    public: ControllerLibrary(const std::string &_path, const bool _watch)
+      : path(_path), watch(_watch)
+    {
+      this->handledSignals = reloadSignals.load();
+
+      // The reset requests go through the topic of the reset button, so
+      // the world resets between two steps.
+      this->node.reset(new gazebo::transport::Node());
+      this->node->Init();
+      this->resetPub =
+        this->node->Advertise<gazebo::msgs::WorldControl>("~/world_control");
+    }
+
+    /// \brief Destructor. Unloads the library.
+    public: ~ControllerLibrary()
+    {
+      this->Close();
+    }
+
+    /// \brief Get the library of a path, shared by the robots.
+    /// \param[in] _path Path of the library.
+    /// \param[in] _watch Whether the changes of the file reload it, if the
+    /// library isn't loaded yet.
+    /// \return The library, loaded if possible.
+    public: static std::shared_ptr<ControllerLibrary> Acquire(
+                const std::string &_path, const bool _watch)
+    {
+      static std::mutex mutex;
+      static std::map<std::string, std::weak_ptr<ControllerLibrary>>
+        libraries;
+
+      std::lock_guard<std::mutex> lock(mutex);
+      std::shared_ptr<ControllerLibrary> library = libraries[_path].lock();
+      if (!library)
+      {
+        static std::once_flag installed;
+        std::call_once(installed, []()
+            {
+              std::signal(SIGHUP, &OnReloadSignal);
+            });
+
+        library = std::make_shared<ControllerLibrary>(_path, _watch);
+        library->Open();
+        libraries[_path] = library;
+      }
+      return library;
+    }
+
+    /// \brief Load a copy of the file of the library.
+    /// \return True if the library provides a controller.
+    public: bool Open()
+    {
+      this->Close();
+
+      // The version of the file that is copied.
+      if (!this->Stat(this->loaded))
+      {
+        gzerr << "Unable to find the controller library [" << this->path
+              << "]" << std::endl;
+        return false;
+      }
+      this->seen = this->loaded;
+
+      // The copy gets its own name, so the loader doesn't return the
+      // previous version, and the file can be rebuilt while it's mapped.
+      char copy[] = "/tmp/swarm_controller_XXXXXX";
+      const int fd = mkstemp(copy);
+      if (fd < 0)
+      {
+        gzerr << "Unable to copy the controller library [" << this->path
+              << "]" << std::endl;
+        return false;
+      }
+      close(fd);
+      {
+        std::ifstream in(this->path, std::ios::binary);
+        std::ofstream out(copy, std::ios::binary | std::ios::trunc);
+        out << in.rdbuf();
+      }
+
+      this->handle = dlopen(copy, RTLD_NOW | RTLD_LOCAL);
+      std::remove(copy);
+      if (!this->handle)
+      {
+        gzerr << "Unable to load the controller library [" << this->path
+              << "]: " << dlerror() << std::endl;
+        return false;
+      }
+
+      auto entry = reinterpret_cast<SwarmControllerEntry>(
+          dlsym(this->handle, SWARM_CONTROLLER_SYMBOL));
+      this->controller = entry ? entry() : nullptr;
+      if (!this->controller ||
+          this->controller->version > SWARM_CONTROLLER_ABI_VERSION ||
+          !this->controller->create || !this->controller->update ||
+          !this->controller->destroy)
+      {
+        gzerr << "The library [" << this->path << "] doesn't export a "
+              << "controller of version " << SWARM_CONTROLLER_ABI_VERSION
+              << " or older with " << SWARM_CONTROLLER_SYMBOL << "()"
+              << std::endl;
+        this->Close();
+        return false;
+      }
+
+      ++this->loads;
+      gzmsg << "Loaded the controller library [" << this->path << "] ("
+            << this->loads << ")" << std::endl;
+      return true;
+    }
+
+    /// \brief Unload the library. No controller of the library is left.
+    public: void Close()
+    {
+      if (this->handle)
+        dlclose(this->handle);
+      this->handle = nullptr;
+      this->controller = nullptr;
+    }
+
+    /// \brief Whether the library should be reloaded: a SIGHUP arrived, or
+    /// the file changed and stayed the same for a check. The file is
+    /// checked at most once per second of wall time.
+    /// \return True if the library should be reloaded.
+    public: bool Changed()
+    {
+      const uint32_t received = reloadSignals.load();
+      if (received != this->handledSignals)
+      {
+        this->handledSignals = received;
+        return true;
+      }
+
+      if (!this->watch)
+        return false;
+
+      const auto now = std::chrono::steady_clock::now();
+      if (now < this->nextCheck)
+        return false;
+      this->nextCheck = now + std::chrono::seconds(1);
+
+      // A file being written changes between checks.
+      Fingerprint current;
+      if (!this->Stat(current) || current == this->loaded)
+        return false;
+      const bool stable = current == this->seen;
+      this->seen = current;
+      return stable;
+    }
+
+    /// \brief Request a reset of the world.
+    public: void RequestReset()
+    {
+      gazebo::msgs::WorldControl msg;
+      msg.mutable_reset()->set_all(true);
+      this->resetPub->Publish(msg);
+    }
+
+    /// \brief Get the fingerprint of the file.
+    /// \param[out] _fingerprint The fingerprint.
+    /// \return True if the file exists.
+    private: bool Stat(Fingerprint &_fingerprint) const
+    {
+      struct stat st;
+      if (stat(this->path.c_str(), &st) != 0)
+        return false;
+
+      _fingerprint.inode = st.st_ino;
+      _fingerprint.size = st.st_size;
+      _fingerprint.mtime = st.st_mtime;
+      return true;
+    }
+
+    /// \brief Protects the library and its counters.
+    public: std::mutex mutex;
+
+    /// \brief Path of the library.
+    public: const std::string path;
+
+    /// \brief Whether the changes of the file reload the library.
+    public: const bool watch;
+
+    /// \brief Handle of the loaded copy, or null.
+    public: void *handle = nullptr;
+
+    /// \brief Functions of the controller, or null if not loaded.
+    public: const SwarmController *controller = nullptr;
+
+    /// \brief Number of controllers created from the loaded library.
+    public: unsigned int instances = 0;
+
+    /// \brief Whether a reset of the world was requested to reload the
+    /// library.
+    public: bool reloadPending = false;
+
+    /// \brief Number of times the library was loaded.
+    public: unsigned int loads = 0;
+
+    /// \brief Version of the file that was loaded.
+    private: Fingerprint loaded;
+
+    /// \brief Version of the file in the last check.
+    private: Fingerprint seen;
+
+    /// \brief SIGHUPs handled by the library.
+    private: uint32_t handledSignals = 0;
+
+    /// \brief Next check of the file.
+    private: std::chrono::steady_clock::time_point nextCheck;
+
+    /// \brief Node of the reset requests.
+    private: gazebo::transport::NodePtr node;
+
+    /// \brief Publisher of the reset requests.
+    private: gazebo::transport::PublisherPtr resetPub;
+  };
+
+  /// \brief The functions of SwarmRobotApi, on a NativeControllerPlugin.
+  struct NativeControllerApi
+  {
+    /// \brief Get the plugin of a robot.
+    /// \param[in] _robot The robot.
+    /// \return The plugin.
+    static NativeControllerPlugin *Plugin(SwarmRobot *_robot)
+    {
+      return reinterpret_cast<NativeControllerPlugin*>(_robot);
+    }
+
+    /// \brief Get the plugin of a robot.
+    /// \param[in] _robot The robot.
+    /// \return The plugin.
+    static const NativeControllerPlugin *Plugin(const SwarmRobot *_robot)
+    {
+      return reinterpret_cast<const NativeControllerPlugin*>(_robot);
+    }
+
+    /// \sa SwarmRobotApi::host
+    static const char *Host(const SwarmRobot *_robot)
+    {
+      return Plugin(_robot)->hostAddress.c_str();
+    }
+
+    /// \sa SwarmRobotApi::type
+    static int Type(const SwarmRobot *_robot)
+    {
+      return static_cast<int>(Plugin(_robot)->Type());
+    }
+
+    /// \sa SwarmRobotApi::bind
+    static int Bind(SwarmRobot *_robot, const char *_address,
+        uint32_t _port)
+    {
+      NativeControllerPlugin *plugin = Plugin(_robot);
+      const std::string endPoint =
+        std::string(_address) + ":" + std::to_string(_port);
+      if (plugin->boundEndPoints.count(endPoint))
+        return 1;
+
+      if (!plugin->Bind(&NativeControllerPlugin::OnDataReceived, plugin,
+            _address, _port))
+      {
+        return 0;
+      }
+      plugin->boundEndPoints.insert(endPoint);
+      return 1;
+    }
+
+    /// \sa SwarmRobotApi::send_to
+    static int SendTo(SwarmRobot *_robot, const void *_data, size_t _size,
+        const char *_dstAddress, uint32_t _port)
+    {
+      return Plugin(_robot)->SendTo(
+          std::string(static_cast<const char*>(_data), _size), _dstAddress,
+          _port);
+    }
+
+    /// \sa SwarmRobotApi::set_linear_velocity
+    static int SetLinearVelocity(SwarmRobot *_robot, double _x, double _y,
+        double _z)
+    {
+      return Plugin(_robot)->SetLinearVelocity(_x, _y, _z);
+    }
+
+    /// \sa SwarmRobotApi::set_angular_velocity
+    static int SetAngularVelocity(SwarmRobot *_robot, double _x, double _y,
+        double _z)
+    {
+      return Plugin(_robot)->SetAngularVelocity(_x, _y, _z);
+    }
+
+    /// \sa SwarmRobotApi::pose
+    static int Pose(const SwarmRobot *_robot, double *_latitude,
+        double *_longitude, double *_altitude)
+    {
+      return Plugin(_robot)->Pose(*_latitude, *_longitude, *_altitude);
+    }
+
+    /// \sa SwarmRobotApi::imu
+    static int Imu(const SwarmRobot *_robot, double _linVel[3],
+        double _angVel[3], double _orientation[4])
+    {
+      ignition::math::Vector3d linVel;
+      ignition::math::Vector3d angVel;
+      ignition::math::Quaterniond orientation;
+      if (!Plugin(_robot)->Imu(linVel, angVel, orientation))
+        return 0;
+
+      for (int i = 0; i < 3; ++i)
+      {
+        _linVel[i] = linVel[i];
+        _angVel[i] = angVel[i];
+      }
+      _orientation[0] = orientation.W();
+      _orientation[1] = orientation.X();
+      _orientation[2] = orientation.Y();
+      _orientation[3] = orientation.Z();
+      return 1;
+    }
+
+    /// \sa SwarmRobotApi::bearing
+    static int Bearing(const SwarmRobot *_robot, double *_bearing)
+    {
+      ignition::math::Angle bearing;
+      if (!Plugin(_robot)->Bearing(bearing))
+        return 0;
+
+      *_bearing = bearing.Radian();
+      return 1;
+    }
+
+    /// \sa SwarmRobotApi::neighbors
+    static size_t Neighbors(const SwarmRobot *_robot,
+        const char **_addresses, size_t _capacity)
+    {
+      const std::vector<std::string> &neighbors =
+        Plugin(_robot)->NeighborsView();
+      for (size_t i = 0; i < neighbors.size() && i < _capacity; ++i)
+        _addresses[i] = neighbors[i].c_str();
+      return neighbors.size();
+    }
+
+    /// \sa SwarmRobotApi::battery_capacity
+    static double BatteryCapacity(const SwarmRobot *_robot)
+    {
+      return Plugin(_robot)->BatteryCapacity();
+    }
+
+    /// \sa SwarmRobotApi::launch
+    static void Launch(SwarmRobot *_robot)
+    {
+      Plugin(_robot)->Launch();
+    }
+
+    /// \sa SwarmRobotApi::dock
+    static int Dock(SwarmRobot *_robot, const char *_vehicle)
+    {
+      return Plugin(_robot)->Dock(_vehicle);
+    }
+
+    /// \sa SwarmRobotApi::wait
+    static void Wait(SwarmRobot *_robot, uint32_t _events, int _port,
+        double _simTime)
+    {
+      NativeControllerPlugin *plugin = Plugin(_robot);
+      if (_events & SWARM_WAKE_MESSAGE)
+        plugin->WaitForMessage(_port);
+      if (_events & SWARM_WAKE_TIME)
+        plugin->WaitUntil(_simTime);
+      if (_events & SWARM_WAKE_NEIGHBORS)
+        plugin->WaitForNeighbors();
+      if (_events & SWARM_WAKE_SENSORS)
+        plugin->WaitForSensors();
+    }
+
+    /// \sa SwarmRobotApi::woken_by
+    static uint32_t WokenBy(const SwarmRobot *_robot)
+    {
+      return Plugin(_robot)->WokenBy();
+    }
+  };
+}
+
+const SwarmRobotApi NativeControllerPlugin::kApi =
+{
+  SWARM_CONTROLLER_ABI_VERSION,
+  &NativeControllerApi::Host,
+  &NativeControllerApi::Type,
+  &NativeControllerApi::Bind,
+  &NativeControllerApi::SendTo,
+  &NativeControllerApi::SetLinearVelocity,
+  &NativeControllerApi::SetAngularVelocity,
+  &NativeControllerApi::Pose,
+  &NativeControllerApi::Imu,
+  &NativeControllerApi::Bearing,
+  &NativeControllerApi::Neighbors,
+  &NativeControllerApi::BatteryCapacity,
+  &NativeControllerApi::Launch,
+  &NativeControllerApi::Dock,
+  &NativeControllerApi::Wait,
+  &NativeControllerApi::WokenBy
+};
+
+//////////////////////////////////////////////////
+NativeControllerPlugin::NativeControllerPlugin()
+  : RobotPlugin()
+{
+}
+
+//////////////////////////////////////////////////
+NativeControllerPlugin::~NativeControllerPlugin()
+{
+  if (!this->library)
+    return;
+
+  std::lock_guard<std::mutex> lock(this->library->mutex);
+  this->Destroy();
+}
+
+//////////////////////////////////////////////////
+void NativeControllerPlugin::Load(sdf::ElementPtr _sdf)
+{
+  this->hostAddress = this->Host();
+
+  std::string path;
+  if (_sdf->HasElement("controller_library"))
+    path = _sdf->Get<std::string>("controller_library");
+  else if (const char *pathEnv = std::getenv("SWARM_CONTROLLER_LIBRARY"))
+    path = pathEnv;
+
+  if (path.empty())
+  {
+    gzerr << "[" << this->hostAddress << "] No controller library: set "
+          << "<controller_library> or SWARM_CONTROLLER_LIBRARY" << std::endl;
+    return;
+  }
+
+  bool watch = true;
+  if (_sdf->HasElement("reload_on_change"))
+    watch = _sdf->Get<bool>("reload_on_change");
+
+  this->library = ControllerLibrary::Acquire(path, watch);
+}
+
+//////////////////////////////////////////////////
+void NativeControllerPlugin::Reset()
+{
+  RobotPlugin::Reset();
+
+  if (!this->library)
+    return;
+
+  // The controllers start over after every reset, and the last one of the
+  // old library reloads it.
+  std::lock_guard<std::mutex> lock(this->library->mutex);
+  this->Destroy();
+  if (this->library->reloadPending && this->library->instances == 0)
+  {
+    this->library->reloadPending = false;
+    this->library->Open();
+  }
+}
+
+//////////////////////////////////////////////////
+void NativeControllerPlugin::Update(const gazebo::common::UpdateInfo &_info)
+{
+  if (!this->library)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(this->library->mutex);
+    if (!this->library->reloadPending && this->library->Changed())
+    {
+      gzmsg << "The controller library [" << this->library->path
+            << "] changed. Resetting the world to reload it." << std::endl;
+      this->library->reloadPending = true;
+      this->library->RequestReset();
+    }
+
+    // The controllers of the old library wait for the reset.
+    if (this->library->reloadPending)
+      return;
+
+    if (!this->instance)
+      this->Create();
+  }
+
+  if (this->instance)
+    this->controller->update(this->instance, _info.simTime.Double());
+}
+
+//////////////////////////////////////////////////
+void NativeControllerPlugin::Create()
+{
+  if (!this->library->controller)
+    return;
+
+  this->controller = this->library->controller;
+  this->instance = this->controller->create(&kApi,
+      reinterpret_cast<SwarmRobot*>(this));
+  if (this->instance)
+    ++this->library->instances;
+}
+
+//////////////////////////////////////////////////
+void NativeControllerPlugin::Destroy()
+{
+  if (!this->instance)
+    return;
+
+  this->controller->destroy(this->instance);
+  this->instance = nullptr;
+  this->controller = nullptr;
+  --this->library->instances;
+}
+
+//////////////////////////////////////////////////
+void NativeControllerPlugin::OnDataReceived(const std::string &_srcAddress,
+    const std::string &_dstAddress, const uint32_t _dstPort,
+    const std::string &_data)
+{
+  if (!this->instance || !this->controller->on_message)
+    return;
+
+  this->controller->on_message(this->instance, _srcAddress.c_str(),
+      _dstAddress.c_str(), _dstPort, _data.data(), _data.size());
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <gazebo/common/Plugin.hh>
+#include "swarm/NoOpControllerPlugin.hh"
+
+using namespace swarm;
+
+GZ_REGISTER_MODEL_PLUGIN(NoOpControllerPlugin)
+
+//////////////////////////////////////////////////
+NoOpControllerPlugin::NoOpControllerPlugin()
+  : RobotPlugin()
+{
+}
+
+//////////////////////////////////////////////////
+void NoOpControllerPlugin::Load(sdf::ElementPtr /*_sdf*/)
+{
+}
+
+//////////////////////////////////////////////////
+void NoOpControllerPlugin::Update(const gazebo::common::UpdateInfo &/*_info*/)
+{
+}
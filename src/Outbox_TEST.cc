@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "swarm/Outbox.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Check that the values are drained once, including the ones that
+/// didn't fit in the ring.
+TEST(OutboxTest, Drain)
+{
+  Outbox<int> outbox(5);
+  EXPECT_EQ(outbox.Capacity(), 8u);
+
+  std::deque<int> values;
+  EXPECT_EQ(outbox.Drain(values), 0u);
+
+  for (int lap = 0; lap < 3; ++lap)
+  {
+    for (int i = 0; i < 20; ++i)
+      outbox.Push(i);
+
+    values.clear();
+    EXPECT_EQ(outbox.Drain(values), 20u);
+    std::sort(values.begin(), values.end());
+    for (int i = 0; i < 20; ++i)
+      EXPECT_EQ(values[i], i);
+
+    EXPECT_EQ(outbox.Drain(values), 0u);
+  }
+}
+
+//////////////////////////////////////////////////
+/// \brief Check that the values pushed together are drained in order, in
+/// the ring or in the overflow list.
+TEST(OutboxTest, PushRange)
+{
+  Outbox<int> outbox(8);
+
+  std::vector<int> batch = {0, 1, 2, 3, 4};
+  outbox.Push(batch.begin(), batch.end());
+  outbox.Push(batch.begin(), batch.begin());
+
+  std::vector<int> values;
+  EXPECT_EQ(outbox.Drain(values), 5u);
+  EXPECT_EQ(values, batch);
+
+  // Across the end of the ring.
+  outbox.Push(batch.begin(), batch.end());
+  values.clear();
+  EXPECT_EQ(outbox.Drain(values), 5u);
+  EXPECT_EQ(values, batch);
+
+  // Doesn't fit in the free slots, or in the whole ring.
+  outbox.Push(7);
+  outbox.Push(8);
+  outbox.Push(9);
+  outbox.Push(10);
+  outbox.Push(batch.begin(), batch.end());
+  std::vector<int> large(20);
+  for (size_t i = 0; i < large.size(); ++i)
+    large[i] = 100 + static_cast<int>(i);
+  outbox.Push(large.begin(), large.end());
+
+  values.clear();
+  EXPECT_EQ(outbox.Drain(values), 29u);
+  std::vector<int> expected = {7, 8, 9, 10, 0, 1, 2, 3, 4};
+  expected.insert(expected.end(), large.begin(), large.end());
+  EXPECT_EQ(values, expected);
+}
+
+//////////////////////////////////////////////////
+/// \brief Check concurrent producers with a consumer draining meanwhile.
+TEST(OutboxTest, Threads)
+{
+  const int kThreads = 4;
+  const int kValues = 20000;
+  Outbox<int> outbox(64);
+
+  std::atomic<int> running(kThreads);
+  std::vector<std::thread> producers;
+  for (int t = 0; t < kThreads; ++t)
+  {
+    producers.push_back(std::thread([&outbox, &running, t]()
+        {
+          for (int i = 0; i < kValues; ++i)
+            outbox.Push(t * kValues + i);
+          --running;
+        }));
+  }
+
+  std::vector<int> values;
+  while (running > 0)
+    outbox.Drain(values);
+
+  for (auto &producer : producers)
+    producer.join();
+  outbox.Drain(values);
+
+  ASSERT_EQ(values.size(), static_cast<size_t>(kThreads * kValues));
+  std::sort(values.begin(), values.end());
+  for (int i = 0; i < kThreads * kValues; ++i)
+    EXPECT_EQ(values[i], i);
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,469 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "swarm/PartitionLink.hh"
+
+using namespace swarm;
+
+/// \brief Size of the data of each shared memory ring (bytes).
+static const uint64_t kRingBytes = 4 << 20;
+
+/// \brief Largest payload of a UDP datagram (bytes).
+static const size_t kChunkBytes = 60000;
+
+/// \brief First field of the header of each UDP datagram.
+static const uint32_t kChunkMagic = 0x53574d50;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+    "The shared memory rings need lock free 64 bit atomics");
+
+/// \brief Layout of a ring in shared memory, written by a single sender
+/// and read by a single receiver. A segment filled with zeros is an empty
+/// ring. Each frame is stored as its size (4 bytes) followed by its bytes.
+struct SharedRing
+{
+  /// \brief Position of the next byte to read, updated by the receiver.
+  std::atomic<uint64_t> head;
+
+  /// \brief Keeps head and tail on different cache lines.
+  char padding[56];
+
+  /// \brief Position of the next byte to write, updated by the sender.
+  std::atomic<uint64_t> tail;
+
+  /// \brief Keeps the tail away from the data.
+  char tailPadding[56];
+
+  /// \brief The frames, wrapped around.
+  char data[kRingBytes];
+};
+
+/// \brief Map the shared memory segment of a ring, creating it if needed.
+/// \param[in] _name Name of the segment.
+/// \return The ring, or nullptr on error.
+static SharedRing *mapRing(const std::string &_name)
+{
+  const int fd = shm_open(_name.c_str(), O_RDWR | O_CREAT, 0600);
+  if (fd < 0)
+  {
+    std::cerr << "PartitionLink: Unable to open shared memory [" << _name
+              << "]: " << std::strerror(errno) << std::endl;
+    return nullptr;
+  }
+
+  void *addr = MAP_FAILED;
+  if (ftruncate(fd, sizeof(SharedRing)) == 0)
+  {
+    addr = mmap(nullptr, sizeof(SharedRing), PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+  }
+  close(fd);
+
+  if (addr == MAP_FAILED)
+  {
+    std::cerr << "PartitionLink: Unable to map shared memory [" << _name
+              << "]: " << std::strerror(errno) << std::endl;
+    return nullptr;
+  }
+  return static_cast<SharedRing *>(addr);
+}
+
+/// \brief Copy bytes into a ring, wrapping around its end.
+/// \param[in] _ring The ring.
+/// \param[in] _pos Position of the first byte.
+/// \param[in] _bytes The bytes.
+/// \param[in] _size Number of bytes.
+static void ringWrite(SharedRing *_ring, const uint64_t _pos,
+    const void *_bytes, const size_t _size)
+{
+  const size_t offset = _pos % kRingBytes;
+  const size_t first = std::min(_size, kRingBytes - offset);
+  std::memcpy(_ring->data + offset, _bytes, first);
+  std::memcpy(_ring->data, static_cast<const char *>(_bytes) + first,
+      _size - first);
+}
+
+/// \brief Copy bytes out of a ring, wrapping around its end.
+/// \param[in] _ring The ring.
+/// \param[in] _pos Position of the first byte.
+/// \param[out] _bytes The bytes.
+/// \param[in] _size Number of bytes.
+static void ringRead(const SharedRing *_ring, const uint64_t _pos,
+    void *_bytes, const size_t _size)
+{
+  const size_t offset = _pos % kRingBytes;
+  const size_t first = std::min(_size, kRingBytes - offset);
+  std::memcpy(_bytes, _ring->data + offset, first);
+  std::memcpy(static_cast<char *>(_bytes) + first, _ring->data,
+      _size - first);
+}
+
+/// \brief Link through shared memory rings, one for each ordered pair of
+/// partitions. The segments are named "/swarm_<sender>_<receiver>", and
+/// unlinked by the receiver when it closes.
+class SharedMemoryLink : public PartitionLink
+{
+  /// \brief Class destructor.
+  public: virtual ~SharedMemoryLink()
+  {
+    for (auto const &ring : this->outgoing)
+      munmap(ring.second, sizeof(SharedRing));
+
+    for (auto const &ring : this->incoming)
+    {
+      munmap(ring.second, sizeof(SharedRing));
+      shm_unlink(ring.first.c_str());
+    }
+  }
+
+  /// \brief Map the rings from and to each peer.
+  /// \param[in] _name Name of the local partition.
+  /// \param[in] _peers Names of the peers.
+  /// \return False if a ring can't be mapped.
+  public: bool Open(const std::string &_name,
+                    const std::map<std::string, std::string> &_peers)
+  {
+    for (auto const &peer : _peers)
+    {
+      SharedRing *out = mapRing("/swarm_" + _name + "_" + peer.first);
+      if (!out)
+        return false;
+      this->outgoing[peer.first] = out;
+
+      const std::string inName = "/swarm_" + peer.first + "_" + _name;
+      SharedRing *in = mapRing(inName);
+      if (!in)
+        return false;
+      this->incoming.emplace_back(inName, in);
+
+      // Discard the frames left by a previous run.
+      in->head.store(in->tail.load(std::memory_order_acquire),
+          std::memory_order_release);
+    }
+    return true;
+  }
+
+  // Documentation inherited.
+  public: virtual bool Send(const std::string &_peer,
+                            const std::string &_frame)
+  {
+    auto it = this->outgoing.find(_peer);
+    if (it == this->outgoing.end() || _frame.size() > UINT32_MAX)
+      return false;
+
+    SharedRing *ring = it->second;
+    const uint64_t size = sizeof(uint32_t) + _frame.size();
+    const uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    const uint64_t head = ring->head.load(std::memory_order_acquire);
+    if (tail - head + size > kRingBytes)
+      return false;
+
+    const uint32_t length = static_cast<uint32_t>(_frame.size());
+    ringWrite(ring, tail, &length, sizeof(length));
+    ringWrite(ring, tail + sizeof(length), _frame.data(), _frame.size());
+    ring->tail.store(tail + size, std::memory_order_release);
+    return true;
+  }
+
+  // Documentation inherited.
+  public: virtual void Receive(std::vector<std::string> &_frames)
+  {
+    for (auto const &entry : this->incoming)
+    {
+      SharedRing *ring = entry.second;
+      uint64_t head = ring->head.load(std::memory_order_relaxed);
+      const uint64_t tail = ring->tail.load(std::memory_order_acquire);
+      while (tail - head >= sizeof(uint32_t))
+      {
+        uint32_t length;
+        ringRead(ring, head, &length, sizeof(length));
+        if (tail - head - sizeof(length) < length)
+        {
+          // Corrupted ring, e.g. written by a sender of a previous run.
+          head = tail;
+          break;
+        }
+
+        std::string frame(length, '\0');
+        ringRead(ring, head + sizeof(length), &frame[0], length);
+        _frames.push_back(std::move(frame));
+        head += sizeof(length) + length;
+      }
+      ring->head.store(head, std::memory_order_release);
+    }
+  }
+
+  /// \brief Ring to each peer.
+  private: std::map<std::string, SharedRing *> outgoing;
+
+  /// \brief Name of the segment and ring from each peer.
+  private: std::vector<std::pair<std::string, SharedRing *>> incoming;
+};
+
+/// \brief Link through UDP. Each frame is split into datagrams of at
+/// most kChunkBytes, with a header holding the sequence number of the
+/// frame, the index of the datagram and the number of datagrams.
+class UdpLink : public PartitionLink
+{
+  /// \brief Size of the header of each datagram.
+  private: static const size_t kHeaderBytes = 12;
+
+  /// \brief Class destructor.
+  public: virtual ~UdpLink()
+  {
+    if (this->socket >= 0)
+      close(this->socket);
+  }
+
+  /// \brief Open the socket and resolve the addresses of the peers.
+  /// \param[in] _peers "host:port" of each peer.
+  /// \param[in] _port Local port.
+  /// \return False if the socket can't be opened or an address is wrong.
+  public: bool Open(const std::map<std::string, std::string> &_peers,
+                    const uint16_t _port)
+  {
+    this->socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (this->socket < 0)
+    {
+      std::cerr << "PartitionLink: Unable to open a UDP socket: "
+                << std::strerror(errno) << std::endl;
+      return false;
+    }
+
+    // Frames are read once per cycle, so they must be buffered meanwhile.
+    int bufferSize = 8 << 20;
+    setsockopt(this->socket, SOL_SOCKET, SO_RCVBUF, &bufferSize,
+        sizeof(bufferSize));
+    fcntl(this->socket, F_SETFL, O_NONBLOCK);
+
+    sockaddr_in local;
+    std::memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = htons(_port);
+    if (bind(this->socket, reinterpret_cast<sockaddr *>(&local),
+          sizeof(local)) != 0)
+    {
+      std::cerr << "PartitionLink: Unable to bind UDP port [" << _port
+                << "]: " << std::strerror(errno) << std::endl;
+      return false;
+    }
+
+    for (auto const &peer : _peers)
+    {
+      const size_t colon = peer.second.rfind(':');
+      if (colon == std::string::npos)
+      {
+        std::cerr << "PartitionLink: Invalid address [" << peer.second
+                  << "] for peer [" << peer.first << "]. Use host:port"
+                  << std::endl;
+        return false;
+      }
+
+      addrinfo hints;
+      std::memset(&hints, 0, sizeof(hints));
+      hints.ai_family = AF_INET;
+      hints.ai_socktype = SOCK_DGRAM;
+      addrinfo *result = nullptr;
+      if (getaddrinfo(peer.second.substr(0, colon).c_str(),
+            peer.second.substr(colon + 1).c_str(), &hints, &result) != 0 ||
+          !result)
+      {
+        std::cerr << "PartitionLink: Unable to resolve [" << peer.second
+                  << "] for peer [" << peer.first << "]" << std::endl;
+        return false;
+      }
+
+      std::memcpy(&this->peers[peer.first], result->ai_addr,
+          sizeof(sockaddr_in));
+      freeaddrinfo(result);
+    }
+    return true;
+  }
+
+  // Documentation inherited.
+  public: virtual bool Send(const std::string &_peer,
+                            const std::string &_frame)
+  {
+    auto it = this->peers.find(_peer);
+    if (it == this->peers.end())
+      return false;
+
+    const size_t count =
+      std::max<size_t>(1, (_frame.size() + kChunkBytes - 1) / kChunkBytes);
+    if (count > UINT16_MAX)
+      return false;
+
+    const uint32_t seq = this->nextSeq++;
+    bool sent = true;
+    for (size_t index = 0; index < count; ++index)
+    {
+      const size_t offset = index * kChunkBytes;
+      const size_t size = std::min(kChunkBytes, _frame.size() - offset);
+
+      const uint32_t header[3] = {htonl(kChunkMagic), htonl(seq),
+        htonl(static_cast<uint32_t>((index << 16) | count))};
+      std::memcpy(this->buffer, header, kHeaderBytes);
+      std::memcpy(this->buffer + kHeaderBytes, _frame.data() + offset, size);
+
+      if (sendto(this->socket, this->buffer, kHeaderBytes + size, 0,
+            reinterpret_cast<const sockaddr *>(&it->second),
+            sizeof(it->second)) < 0)
+      {
+        sent = false;
+      }
+    }
+    return sent;
+  }
+
+  // Documentation inherited.
+  public: virtual void Receive(std::vector<std::string> &_frames)
+  {
+    while (true)
+    {
+      sockaddr_in source;
+      socklen_t sourceSize = sizeof(source);
+      const ssize_t size = recvfrom(this->socket, this->buffer,
+          sizeof(this->buffer), 0, reinterpret_cast<sockaddr *>(&source),
+          &sourceSize);
+      if (size < 0)
+        return;
+      if (size < static_cast<ssize_t>(kHeaderBytes))
+        continue;
+
+      uint32_t header[3];
+      std::memcpy(header, this->buffer, kHeaderBytes);
+      const uint32_t seq = ntohl(header[1]);
+      const uint32_t index = ntohl(header[2]) >> 16;
+      const uint32_t count = ntohl(header[2]) & 0xffff;
+      if (ntohl(header[0]) != kChunkMagic || index >= count)
+        continue;
+
+      // Only the last frame of each peer is assembled. The datagrams of
+      // older frames are ignored.
+      const uint64_t key = (uint64_t(source.sin_addr.s_addr) << 16) |
+        source.sin_port;
+      Assembly &assembly = this->assemblies[key];
+      if (assembly.chunks.empty() ||
+          static_cast<int32_t>(seq - assembly.seq) > 0)
+      {
+        assembly.seq = seq;
+        assembly.received = 0;
+        assembly.chunks.assign(count, std::string());
+        assembly.have.assign(count, false);
+        assembly.done = false;
+      }
+      if (seq != assembly.seq || assembly.done ||
+          count != assembly.chunks.size() || assembly.have[index])
+      {
+        continue;
+      }
+
+      assembly.chunks[index].assign(this->buffer + kHeaderBytes,
+          size - kHeaderBytes);
+      assembly.have[index] = true;
+      if (++assembly.received < count)
+        continue;
+
+      std::string frame;
+      for (auto const &chunk : assembly.chunks)
+        frame += chunk;
+      _frames.push_back(std::move(frame));
+      assembly.done = true;
+    }
+  }
+
+  /// \brief A frame being received.
+  private: struct Assembly
+  {
+    /// \brief Sequence number of the frame.
+    uint32_t seq = 0;
+
+    /// \brief Payload of the datagrams, by index.
+    std::vector<std::string> chunks;
+
+    /// \brief Whether each datagram was received.
+    std::vector<bool> have;
+
+    /// \brief Number of datagrams received.
+    uint32_t received = 0;
+
+    /// \brief Whether the frame was already delivered.
+    bool done = false;
+  };
+
+  /// \brief The UDP socket.
+  private: int socket = -1;
+
+  /// \brief Address of each peer.
+  private: std::map<std::string, sockaddr_in> peers;
+
+  /// \brief Sequence number of the next frame sent.
+  private: uint32_t nextSeq = 0;
+
+  /// \brief Frame being received from each source address and port.
+  private: std::map<uint64_t, Assembly> assemblies;
+
+  /// \brief Buffer of a datagram.
+  private: char buffer[kHeaderBytes + kChunkBytes];
+};
+
+//////////////////////////////////////////////////
+std::unique_ptr<PartitionLink> PartitionLink::Create(
+    const std::string &_transport, const std::string &_name,
+    const std::map<std::string, std::string> &_peers, const uint16_t _port)
+{
+  if (_transport == "shm")
+  {
+    SharedMemoryLink *link = new SharedMemoryLink();
+    std::unique_ptr<PartitionLink> result(link);
+    if (link->Open(_name, _peers))
+      return result;
+  }
+  else if (_transport == "udp")
+  {
+    UdpLink *link = new UdpLink();
+    std::unique_ptr<PartitionLink> result(link);
+    if (link->Open(_peers, _port))
+      return result;
+  }
+  else
+  {
+    std::cerr << "PartitionLink: Unknown transport [" << _transport
+              << "]. Use shm or udp" << std::endl;
+  }
+  return nullptr;
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <unistd.h>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "swarm/PartitionLink.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Receive frames until the expected number arrived or a timeout.
+/// \param[in] _link The link.
+/// \param[in] _count Number of frames expected.
+/// \return The frames received.
+static std::vector<std::string> receive(PartitionLink &_link,
+    const size_t _count)
+{
+  std::vector<std::string> frames;
+  for (int i = 0; i < 200 && frames.size() < _count; ++i)
+  {
+    _link.Receive(frames);
+    if (frames.size() < _count)
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return frames;
+}
+
+//////////////////////////////////////////////////
+/// \brief Exchange frames of several sizes between two partitions.
+/// \param[in] _transport Transport of the links.
+static void exchange(const std::string &_transport)
+{
+  const std::string suffix = std::to_string(getpid());
+  const std::string nameA = "testA" + suffix;
+  const std::string nameB = "testB" + suffix;
+  const uint16_t portA = 20000 + getpid() % 20000;
+  const uint16_t portB = portA + 1;
+
+  auto linkA = PartitionLink::Create(_transport, nameA,
+      {{nameB, "127.0.0.1:" + std::to_string(portB)}}, portA);
+  auto linkB = PartitionLink::Create(_transport, nameB,
+      {{nameA, "127.0.0.1:" + std::to_string(portA)}}, portB);
+  ASSERT_TRUE(linkA != nullptr);
+  ASSERT_TRUE(linkB != nullptr);
+
+  // Empty, small and multi datagram frames.
+  const std::vector<std::string> sent =
+    {"", "frame", std::string(150000, 'x') + "end"};
+  for (auto const &frame : sent)
+    EXPECT_TRUE(linkA->Send(nameB, frame));
+
+  EXPECT_EQ(receive(*linkB, sent.size()), sent);
+
+  std::vector<std::string> none;
+  linkA->Receive(none);
+  EXPECT_TRUE(none.empty());
+
+  EXPECT_TRUE(linkB->Send(nameA, "reply"));
+  EXPECT_EQ(receive(*linkA, 1), std::vector<std::string>({"reply"}));
+
+  // Unknown peers.
+  EXPECT_FALSE(linkA->Send("unknown", "frame"));
+}
+
+//////////////////////////////////////////////////
+TEST(PartitionLinkTest, SharedMemory)
+{
+  exchange("shm");
+}
+
+//////////////////////////////////////////////////
+TEST(PartitionLinkTest, Udp)
+{
+  exchange("udp");
+}
+
+//////////////////////////////////////////////////
+TEST(PartitionLinkTest, Errors)
+{
+  const std::map<std::string, std::string> noPeers;
+  EXPECT_TRUE(PartitionLink::Create("tcp", "a", noPeers, 0) == nullptr);
+  EXPECT_TRUE(PartitionLink::Create("udp", "a", {{"b", "localhost"}}, 0) ==
+      nullptr);
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <sstream>
+#include <string>
+#include "gtest/gtest.h"
+#include "msgs/datagram.pb.h"
+#include "swarm/PayloadView.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Check that the views point to the characters of the datagrams.
+TEST(PayloadViewTest, Datagram)
+{
+  msgs::Datagram msg;
+  msg.set_src_address("192.168.2.1");
+  msg.set_data(std::string("a\0b", 3));
+
+  const PayloadView src(msg.src_address());
+  const PayloadView data(msg.data());
+  EXPECT_EQ(src.Data(), msg.src_address().data());
+  EXPECT_EQ(src.Size(), 11u);
+  EXPECT_EQ(src, PayloadView("192.168.2.1"));
+  EXPECT_NE(src, PayloadView("192.168.2.2"));
+  EXPECT_EQ(data.Size(), 3u);
+  EXPECT_EQ(data[1], '\0');
+  EXPECT_EQ(data.Str(), msg.data());
+
+  std::ostringstream out;
+  out << src;
+  EXPECT_EQ(out.str(), "192.168.2.1");
+
+  const PayloadView empty;
+  EXPECT_TRUE(empty.Empty());
+  EXPECT_EQ(empty, PayloadView(msg.dst_address()));
+  EXPECT_EQ(empty.Str(), "");
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
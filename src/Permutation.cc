@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include "swarm/Permutation.hh"
+
+using namespace swarm;
+
+/// \brief Mix the bits of a value (splitmix64 finalizer).
+/// \param[in] _value The value.
+/// \return The mixed value.
+static uint64_t Mix(uint64_t _value)
+{
+  _value = (_value ^ (_value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  _value = (_value ^ (_value >> 27)) * 0x94d049bb133111ebULL;
+  return _value ^ (_value >> 31);
+}
+
+//////////////////////////////////////////////////
+void Permutation::Reset(const uint32_t _size, const uint64_t _seed)
+{
+  this->size = _size;
+  this->counter = 0;
+
+  this->halfBits = 1;
+  while ((uint64_t(1) << (2 * this->halfBits)) < _size)
+    ++this->halfBits;
+  this->halfMask = (uint64_t(1) << this->halfBits) - 1;
+  this->domain = uint64_t(1) << (2 * this->halfBits);
+
+  uint64_t state = _seed;
+  for (auto &key : this->keys)
+  {
+    state += 0x9e3779b97f4a7c15ULL;
+    key = Mix(state);
+  }
+
+  // A Feistel network only produces even permutations of its domain. The
+  // rotation by a random offset makes half of them odd.
+  state += 0x9e3779b97f4a7c15ULL;
+  this->offset = Mix(state);
+}
+
+//////////////////////////////////////////////////
+bool Permutation::Next(uint32_t &_index)
+{
+  while (this->counter < this->domain)
+  {
+    const uint64_t value =
+      this->Encrypt((this->counter++ + this->offset) & (this->domain - 1));
+    if (value < this->size)
+    {
+      _index = static_cast<uint32_t>(value);
+      return true;
+    }
+  }
+  return false;
+}
+
+//////////////////////////////////////////////////
+uint64_t Permutation::Encrypt(const uint64_t _value) const
+{
+  uint64_t left = _value >> this->halfBits;
+  uint64_t right = _value & this->halfMask;
+  for (const uint64_t key : this->keys)
+  {
+    const uint64_t next = left ^ (Mix(right ^ key) & this->halfMask);
+    left = right;
+    right = next;
+  }
+  return (left << this->halfBits) | right;
+}
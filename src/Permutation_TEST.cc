@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <vector>
+#include "gtest/gtest.h"
+#include "swarm/Permutation.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Check that every index is visited once.
+TEST(PermutationTest, Indices)
+{
+  Permutation permutation;
+  uint32_t index;
+  EXPECT_FALSE(permutation.Next(index));
+
+  for (uint32_t size = 0; size < 300; ++size)
+  {
+    permutation.Reset(size, size * 7919);
+
+    std::vector<int> visits(size, 0);
+    while (permutation.Next(index))
+    {
+      ASSERT_LT(index, size);
+      ++visits[index];
+    }
+
+    for (const int visit : visits)
+      EXPECT_EQ(visit, 1);
+    EXPECT_FALSE(permutation.Next(index));
+  }
+}
+
+//////////////////////////////////////////////////
+/// \brief Check that each index is equally likely in each position.
+TEST(PermutationTest, Fairness)
+{
+  const uint32_t kSize = 5;
+  const int kTrials = 50000;
+  int counts[kSize][kSize] = {};
+
+  Permutation permutation;
+  for (int trial = 0; trial < kTrials; ++trial)
+  {
+    permutation.Reset(kSize, trial);
+    uint32_t index;
+    for (uint32_t position = 0; permutation.Next(index); ++position)
+      ++counts[position][index];
+  }
+
+  // The expected count is 10000, with a deviation close to 90.
+  for (uint32_t position = 0; position < kSize; ++position)
+  {
+    for (uint32_t index = 0; index < kSize; ++index)
+      EXPECT_NEAR(counts[position][index], kTrials / kSize, 500);
+  }
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
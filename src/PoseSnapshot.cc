@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <gazebo/physics/Model.hh>
+
+#include "swarm/PoseSnapshot.hh"
+
+using namespace swarm;
+
+namespace
+{
+  /// \brief Whether two numbers have the same bits.
+  /// \param[in] _a A number.
+  /// \param[in] _b Another number.
+  /// \return True if the numbers are the same.
+  bool sameBits(const double _a, const double _b)
+  {
+    return std::memcmp(&_a, &_b, sizeof(_a)) == 0;
+  }
+}
+
+//////////////////////////////////////////////////
+PoseSnapshot *PoseSnapshot::Instance()
+{
+  return Instance("");
+}
+
+//////////////////////////////////////////////////
+PoseSnapshot *PoseSnapshot::Instance(const std::string &_world)
+{
+  static std::mutex mutex;
+  static std::map<std::string, std::unique_ptr<PoseSnapshot>> instances;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  std::unique_ptr<PoseSnapshot> &instance = instances[_world];
+  if (!instance)
+    instance.reset(new PoseSnapshot());
+  return instance.get();
+}
+
+//////////////////////////////////////////////////
+void PoseSnapshot::SetModels(
+    const std::vector<gazebo::physics::ModelPtr> &_models)
+{
+  this->models = _models;
+  ++this->version;
+  this->ids.clear();
+  for (size_t i = 0; i < this->models.size(); ++i)
+  {
+    if (this->models[i])
+      this->ids[this->models[i]->GetName()] = static_cast<int>(i);
+  }
+
+  for (auto &coordinates : this->position)
+    coordinates.assign(this->models.size(), 0.0);
+  for (auto &components : this->orientation)
+    components.assign(this->models.size(), 0.0);
+  this->carriers.assign(this->models.size(), -1);
+  this->aliases = 0;
+
+  this->captured = false;
+}
+
+//////////////////////////////////////////////////
+void PoseSnapshot::Capture(const gazebo::common::Time &_simTime)
+{
+  if (this->Captured(_simTime))
+    return;
+
+  for (size_t i = 0; i < this->models.size(); ++i)
+  {
+    if (this->models[i] && this->carriers[i] < 0)
+      this->SetPose(i, this->models[i]->GetWorldPose().Ign());
+  }
+
+  // The aliases are where their carriers are.
+  if (this->aliases > 0)
+  {
+    for (size_t i = 0; i < this->carriers.size(); ++i)
+    {
+      if (this->carriers[i] >= 0)
+        this->SetPose(i, this->Pose(this->carriers[i]));
+    }
+  }
+
+  this->captureTime = _simTime;
+  this->captured = true;
+}
+
+//////////////////////////////////////////////////
+void PoseSnapshot::SetPose(const unsigned int _id,
+    const ignition::math::Pose3d &_pose)
+{
+  this->position[0][_id] = _pose.Pos().X();
+  this->position[1][_id] = _pose.Pos().Y();
+  this->position[2][_id] = _pose.Pos().Z();
+  this->orientation[0][_id] = _pose.Rot().W();
+  this->orientation[1][_id] = _pose.Rot().X();
+  this->orientation[2][_id] = _pose.Rot().Y();
+  this->orientation[3][_id] = _pose.Rot().Z();
+}
+
+//////////////////////////////////////////////////
+void PoseSnapshot::SetCarrier(const unsigned int _id, const int _carrier)
+{
+  if (_id >= this->carriers.size() ||
+      _carrier >= static_cast<int>(this->carriers.size()) ||
+      (_carrier >= 0 && this->carriers[_carrier] >= 0) ||
+      _carrier == static_cast<int>(_id))
+  {
+    return;
+  }
+
+  int &carrier = this->carriers[_id];
+  if (carrier < 0 && _carrier >= 0)
+    ++this->aliases;
+  else if (carrier >= 0 && _carrier < 0)
+    --this->aliases;
+  carrier = _carrier;
+}
+
+//////////////////////////////////////////////////
+int PoseSnapshot::Carrier(const unsigned int _id) const
+{
+  return _id < this->carriers.size() ? this->carriers[_id] : -1;
+}
+
+//////////////////////////////////////////////////
+size_t PoseSnapshot::Aliases() const
+{
+  return this->aliases;
+}
+
+//////////////////////////////////////////////////
+void PoseSnapshot::CopyPoses(const PoseSnapshot &_other)
+{
+  if (this->version != _other.version || this->models.empty())
+  {
+    this->models = _other.models;
+    this->ids = _other.ids;
+    this->version = _other.version;
+  }
+
+  for (int i = 0; i < 3; ++i)
+    this->position[i] = _other.position[i];
+  for (int i = 0; i < 4; ++i)
+    this->orientation[i] = _other.orientation[i];
+  this->carriers = _other.carriers;
+  this->aliases = _other.aliases;
+  this->captureTime = _other.captureTime;
+  this->captured = _other.captured;
+}
+
+//////////////////////////////////////////////////
+bool PoseSnapshot::Captured(const gazebo::common::Time &_simTime) const
+{
+  return this->captured && this->captureTime == _simTime;
+}
+
+//////////////////////////////////////////////////
+int PoseSnapshot::Id(const std::string &_name) const
+{
+  auto it = this->ids.find(_name);
+  return it == this->ids.end() ? -1 : it->second;
+}
+
+//////////////////////////////////////////////////
+uint64_t PoseSnapshot::Version() const
+{
+  return this->version;
+}
+
+//////////////////////////////////////////////////
+size_t PoseSnapshot::Size() const
+{
+  return this->models.size();
+}
+
+//////////////////////////////////////////////////
+ignition::math::Vector3d PoseSnapshot::Position(const unsigned int _id) const
+{
+  return ignition::math::Vector3d(this->position[0][_id],
+      this->position[1][_id], this->position[2][_id]);
+}
+
+//////////////////////////////////////////////////
+ignition::math::Quaterniond PoseSnapshot::Orientation(
+    const unsigned int _id) const
+{
+  return ignition::math::Quaterniond(this->orientation[0][_id],
+      this->orientation[1][_id], this->orientation[2][_id],
+      this->orientation[3][_id]);
+}
+
+//////////////////////////////////////////////////
+ignition::math::Pose3d PoseSnapshot::Pose(const unsigned int _id) const
+{
+  return ignition::math::Pose3d(this->Position(_id), this->Orientation(_id));
+}
+
+//////////////////////////////////////////////////
+bool PoseSnapshot::Same(const ignition::math::Pose3d &_a,
+    const ignition::math::Pose3d &_b)
+{
+  return sameBits(_a.Pos().X(), _b.Pos().X()) &&
+    sameBits(_a.Pos().Y(), _b.Pos().Y()) &&
+    sameBits(_a.Pos().Z(), _b.Pos().Z()) &&
+    sameBits(_a.Rot().W(), _b.Rot().W()) &&
+    sameBits(_a.Rot().X(), _b.Rot().X()) &&
+    sameBits(_a.Rot().Y(), _b.Rot().Y()) &&
+    sameBits(_a.Rot().Z(), _b.Rot().Z());
+}
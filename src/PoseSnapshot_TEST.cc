@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <vector>
+#include <gazebo/physics/PhysicsTypes.hh>
+#include <ignition/math/Pose3.hh>
+#include "gtest/gtest.h"
+#include "swarm/PoseSnapshot.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Check that a copy keeps the poses and the carriers of the
+/// snapshot, and not the changes made to it afterwards.
+TEST(PoseSnapshotTest, CopyPoses)
+{
+  // Robots without model, as if simulated by another partition.
+  PoseSnapshot snapshot;
+  snapshot.SetModels(std::vector<gazebo::physics::ModelPtr>(3));
+  const ignition::math::Pose3d pose(1, 2, 3, 0.1, 0.2, 0.3);
+  snapshot.SetPose(0, pose);
+  snapshot.SetPose(1, ignition::math::Pose3d(-4, 5, 6, 0, 0, 1));
+  snapshot.SetCarrier(2, 1);
+
+  PoseSnapshot copy;
+  copy.CopyPoses(snapshot);
+  EXPECT_EQ(copy.Size(), 3u);
+  EXPECT_EQ(copy.Version(), snapshot.Version());
+  EXPECT_TRUE(PoseSnapshot::Same(copy.Pose(0), pose));
+  EXPECT_TRUE(PoseSnapshot::Same(copy.Pose(1), snapshot.Pose(1)));
+  EXPECT_EQ(copy.Carrier(2), 1);
+  EXPECT_EQ(copy.Aliases(), 1u);
+
+  // The copy doesn't follow the snapshot.
+  snapshot.SetPose(0, ignition::math::Pose3d(7, 8, 9, 0, 0, 0));
+  snapshot.SetCarrier(2, -1);
+  EXPECT_TRUE(PoseSnapshot::Same(copy.Pose(0), pose));
+  EXPECT_EQ(copy.Carrier(2), 1);
+
+  // The models change with the version.
+  snapshot.SetModels(std::vector<gazebo::physics::ModelPtr>(5));
+  copy.CopyPoses(snapshot);
+  EXPECT_EQ(copy.Size(), 5u);
+  EXPECT_EQ(copy.Version(), snapshot.Version());
+  EXPECT_EQ(copy.Aliases(), 0u);
+  EXPECT_EQ(copy.Carrier(2), -1);
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <fcntl.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "swarm/PythonChannel.hh"
+
+using namespace swarm;
+
+/// \brief Layout of the shared memory segment. A segment filled with zeros
+/// has no robots.
+struct PythonSegment
+{
+  /// \brief State of the step.
+  PythonHeader header;
+
+  /// \brief Posted by the plugin to start a step of each worker.
+  sem_t start[kPythonMaxWorkers];
+
+  /// \brief Posted by each worker at the end of its step.
+  sem_t done[kPythonMaxWorkers];
+
+  /// \brief The robots.
+  PythonRobot robots[kPythonMaxRobots];
+};
+
+/// \brief Map the shared memory segment.
+/// \param[in] _name Name of the segment.
+/// \param[in] _create True to create the segment, filled with zeros.
+/// \return The segment, or nullptr on error.
+static PythonSegment *mapSegment(const std::string &_name,
+    const bool _create)
+{
+  const std::string name = "/swarm_python_" + _name;
+  const int fd = shm_open(name.c_str(),
+      _create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0600);
+  if (fd < 0)
+  {
+    std::cerr << "PythonChannel: Unable to open shared memory [" << name
+              << "]: " << std::strerror(errno) << std::endl;
+    return nullptr;
+  }
+
+  struct stat info;
+  void *addr = MAP_FAILED;
+  if ((!_create || ftruncate(fd, sizeof(PythonSegment)) == 0) &&
+      fstat(fd, &info) == 0 &&
+      static_cast<size_t>(info.st_size) == sizeof(PythonSegment))
+  {
+    addr = mmap(nullptr, sizeof(PythonSegment), PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+  }
+  close(fd);
+
+  if (addr == MAP_FAILED)
+  {
+    std::cerr << "PythonChannel: Unable to map shared memory [" << name
+              << "]: " << std::strerror(errno) << std::endl;
+    if (_create)
+      shm_unlink(name.c_str());
+    return nullptr;
+  }
+  return static_cast<PythonSegment *>(addr);
+}
+
+//////////////////////////////////////////////////
+PythonQueueWriter::PythonQueueWriter(PythonQueue &_queue)
+  : queue(_queue)
+{
+}
+
+//////////////////////////////////////////////////
+void PythonQueueWriter::Add(const void *_data, const uint32_t _size)
+{
+  if (this->overflow ||
+      kPythonQueueSize - this->queue.size - this->size < _size)
+  {
+    this->overflow = true;
+    return;
+  }
+  std::memcpy(this->queue.data + this->queue.size + this->size, _data,
+      _size);
+  this->size += _size;
+}
+
+//////////////////////////////////////////////////
+void PythonQueueWriter::Add(const uint32_t _value)
+{
+  this->Add(&_value, sizeof(_value));
+}
+
+//////////////////////////////////////////////////
+void PythonQueueWriter::Add(const double _value)
+{
+  this->Add(&_value, sizeof(_value));
+}
+
+//////////////////////////////////////////////////
+void PythonQueueWriter::Add(const std::string &_value)
+{
+  this->Add(static_cast<uint32_t>(_value.size()));
+  this->Add(_value.data(), _value.size());
+}
+
+//////////////////////////////////////////////////
+bool PythonQueueWriter::End()
+{
+  const bool added = !this->overflow;
+  if (added)
+    this->queue.size += this->size;
+  this->size = 0;
+  this->overflow = false;
+  return added;
+}
+
+//////////////////////////////////////////////////
+PythonQueueReader::PythonQueueReader(const PythonQueue &_queue)
+  : queue(_queue)
+{
+}
+
+//////////////////////////////////////////////////
+bool PythonQueueReader::Done() const
+{
+  return this->pos >= this->queue.size;
+}
+
+//////////////////////////////////////////////////
+bool PythonQueueReader::Read(void *_data, const uint32_t _size)
+{
+  if (this->queue.size > kPythonQueueSize ||
+      this->queue.size - this->pos < _size)
+  {
+    this->pos = this->queue.size;
+    return false;
+  }
+  std::memcpy(_data, this->queue.data + this->pos, _size);
+  this->pos += _size;
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool PythonQueueReader::Read(uint32_t &_value)
+{
+  return this->Read(&_value, sizeof(_value));
+}
+
+//////////////////////////////////////////////////
+bool PythonQueueReader::Read(double &_value)
+{
+  return this->Read(&_value, sizeof(_value));
+}
+
+//////////////////////////////////////////////////
+bool PythonQueueReader::Read(std::string &_value)
+{
+  uint32_t size;
+  if (!this->Read(size) || this->queue.size - this->pos < size)
+  {
+    this->pos = this->queue.size;
+    return false;
+  }
+  _value.assign(
+      reinterpret_cast<const char *>(this->queue.data + this->pos), size);
+  this->pos += size;
+  return true;
+}
+
+//////////////////////////////////////////////////
+PythonChannel::PythonChannel(const std::string &_name, void *_segment,
+    const bool _owner)
+  : name(_name),
+    segment(_segment),
+    owner(_owner)
+{
+}
+
+//////////////////////////////////////////////////
+PythonChannel::~PythonChannel()
+{
+  PythonSegment *seg = static_cast<PythonSegment *>(this->segment);
+  if (this->owner)
+  {
+    for (uint32_t i = 0; i < kPythonMaxWorkers; ++i)
+    {
+      sem_destroy(&seg->start[i]);
+      sem_destroy(&seg->done[i]);
+    }
+  }
+  munmap(this->segment, sizeof(PythonSegment));
+  if (this->owner)
+    shm_unlink(("/swarm_python_" + this->name).c_str());
+}
+
+//////////////////////////////////////////////////
+std::unique_ptr<PythonChannel> PythonChannel::Create(
+    const std::string &_name, const uint32_t _workers)
+{
+  if (_workers == 0 || _workers > kPythonMaxWorkers)
+  {
+    std::cerr << "PythonChannel: Invalid number of workers [" << _workers
+              << "]. Use 1 to " << kPythonMaxWorkers << std::endl;
+    return nullptr;
+  }
+
+  PythonSegment *seg = mapSegment(_name, true);
+  if (!seg)
+    return nullptr;
+
+  for (uint32_t i = 0; i < kPythonMaxWorkers; ++i)
+  {
+    sem_init(&seg->start[i], 1, 0);
+    sem_init(&seg->done[i], 1, 0);
+  }
+  seg->header.version = kPythonChannelVersion;
+  seg->header.numWorkers = _workers;
+  seg->header.magic = kPythonChannelMagic;
+
+  return std::unique_ptr<PythonChannel>(new PythonChannel(_name, seg, true));
+}
+
+//////////////////////////////////////////////////
+std::unique_ptr<PythonChannel> PythonChannel::Open(const std::string &_name)
+{
+  PythonSegment *seg = mapSegment(_name, false);
+  if (!seg)
+    return nullptr;
+
+  if (seg->header.magic != kPythonChannelMagic ||
+      seg->header.version != kPythonChannelVersion)
+  {
+    std::cerr << "PythonChannel: Shared memory [" << _name << "] has an "
+              << "unknown layout" << std::endl;
+    munmap(seg, sizeof(PythonSegment));
+    return nullptr;
+  }
+
+  return std::unique_ptr<PythonChannel>(
+      new PythonChannel(_name, seg, false));
+}
+
+//////////////////////////////////////////////////
+PythonHeader &PythonChannel::Header()
+{
+  return static_cast<PythonSegment *>(this->segment)->header;
+}
+
+//////////////////////////////////////////////////
+PythonRobot &PythonChannel::Robot(const uint32_t _index)
+{
+  return static_cast<PythonSegment *>(this->segment)->robots[_index];
+}
+
+//////////////////////////////////////////////////
+void PythonChannel::Start(const uint32_t _worker)
+{
+  sem_post(&static_cast<PythonSegment *>(this->segment)->start[_worker]);
+}
+
+//////////////////////////////////////////////////
+void PythonChannel::WaitStart(const uint32_t _worker)
+{
+  sem_t *sem = &static_cast<PythonSegment *>(this->segment)->start[_worker];
+  while (sem_wait(sem) != 0 && errno == EINTR)
+    continue;
+}
+
+//////////////////////////////////////////////////
+void PythonChannel::Done(const uint32_t _worker)
+{
+  sem_post(&static_cast<PythonSegment *>(this->segment)->done[_worker]);
+}
+
+//////////////////////////////////////////////////
+bool PythonChannel::WaitDone(const uint32_t _worker, const double _timeout)
+{
+  timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  double sec;
+  const double frac = std::modf(_timeout, &sec);
+  deadline.tv_sec += static_cast<time_t>(sec);
+  deadline.tv_nsec += static_cast<long>(frac * 1e9);
+  if (deadline.tv_nsec >= 1000000000L)
+  {
+    deadline.tv_sec += 1;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  sem_t *sem = &static_cast<PythonSegment *>(this->segment)->done[_worker];
+  int res;
+  while ((res = sem_timedwait(sem, &deadline)) != 0 && errno == EINTR)
+    continue;
+  return res == 0;
+}
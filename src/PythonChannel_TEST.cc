@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cstring>
+#include <memory>
+#include <string>
+#include "gtest/gtest.h"
+#include "swarm/PythonChannel.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+TEST(PythonChannelTest, Queue)
+{
+  std::unique_ptr<PythonQueue> queue(new PythonQueue());
+  queue->size = 0;
+
+  PythonQueueWriter writer(*queue);
+  writer.Add(static_cast<uint32_t>(PYTHON_SEND_TO));
+  writer.Add(std::string("hello"));
+  writer.Add(0.25);
+  EXPECT_TRUE(writer.End());
+  writer.Add(std::string(""));
+  EXPECT_TRUE(writer.End());
+
+  // A record that doesn't fit is dropped whole.
+  const uint32_t size = queue->size;
+  writer.Add(static_cast<uint32_t>(PYTHON_GZMSG));
+  writer.Add(std::string(kPythonQueueSize, 'a'));
+  EXPECT_FALSE(writer.End());
+  EXPECT_EQ(queue->size, size);
+
+  PythonQueueReader reader(*queue);
+  uint32_t command;
+  std::string text;
+  double value;
+  EXPECT_FALSE(reader.Done());
+  EXPECT_TRUE(reader.Read(command));
+  EXPECT_EQ(command, static_cast<uint32_t>(PYTHON_SEND_TO));
+  EXPECT_TRUE(reader.Read(text));
+  EXPECT_EQ(text, "hello");
+  EXPECT_TRUE(reader.Read(value));
+  EXPECT_DOUBLE_EQ(value, 0.25);
+  EXPECT_TRUE(reader.Read(text));
+  EXPECT_EQ(text, "");
+  EXPECT_TRUE(reader.Done());
+  EXPECT_FALSE(reader.Read(command));
+}
+
+//////////////////////////////////////////////////
+TEST(PythonChannelTest, Lockstep)
+{
+  const std::string name = "test" + std::to_string(getpid());
+  auto channel = PythonChannel::Create(name, 2);
+  ASSERT_TRUE(channel != nullptr);
+  EXPECT_EQ(channel->Header().numWorkers, 2u);
+
+  channel->Header().numRobots = 2;
+  std::strcpy(channel->Robot(0).name, "robot0");
+  std::strcpy(channel->Robot(1).name, "robot1");
+
+  // Each worker copies the simulation time of two steps to the outbox of
+  // its robot.
+  for (uint32_t worker = 0; worker < 2; ++worker)
+  {
+    const pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0)
+    {
+      auto child = PythonChannel::Open(name);
+      if (!child)
+        _exit(1);
+      while (true)
+      {
+        child->WaitStart(worker);
+        if (child->Header().stop)
+          break;
+        PythonQueueWriter writer(child->Robot(worker).outbox);
+        writer.Add(child->Header().simTime);
+        writer.Add(std::string(child->Robot(worker).name));
+        writer.End();
+        child->Done(worker);
+      }
+      _exit(0);
+    }
+  }
+
+  for (int step = 1; step <= 2; ++step)
+  {
+    channel->Header().simTime = step;
+    channel->Start(0);
+    channel->Start(1);
+    EXPECT_TRUE(channel->WaitDone(0, 5.0));
+    EXPECT_TRUE(channel->WaitDone(1, 5.0));
+  }
+
+  for (uint32_t i = 0; i < 2; ++i)
+  {
+    PythonQueueReader reader(channel->Robot(i).outbox);
+    for (int step = 1; step <= 2; ++step)
+    {
+      double time;
+      std::string robot;
+      EXPECT_TRUE(reader.Read(time));
+      EXPECT_DOUBLE_EQ(time, step);
+      EXPECT_TRUE(reader.Read(robot));
+      EXPECT_EQ(robot, "robot" + std::to_string(i));
+    }
+    EXPECT_TRUE(reader.Done());
+  }
+
+  // Nothing to wait for.
+  EXPECT_FALSE(channel->WaitDone(0, 0.05));
+
+  channel->Header().stop = 1;
+  channel->Start(0);
+  channel->Start(1);
+  int status;
+  while (wait(&status) > 0)
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+}
+
+//////////////////////////////////////////////////
+TEST(PythonChannelTest, Errors)
+{
+  EXPECT_TRUE(PythonChannel::Create("a", 0) == nullptr);
+  EXPECT_TRUE(PythonChannel::Create("a", kPythonMaxWorkers + 1) == nullptr);
+  EXPECT_TRUE(PythonChannel::Open("missing" + std::to_string(getpid())) ==
+      nullptr);
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
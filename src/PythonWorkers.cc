@@ -0,0 +1,416 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <gazebo/common/Console.hh>
+#include <ignition/math/Angle.hh>
+#include <ignition/math/Pose3.hh>
+#include <ignition/math/Quaternion.hh>
+#include <ignition/math/Vector2.hh>
+#include <ignition/math/Vector3.hh>
+
+#include "swarm/PythonWorkers.hh"
+#include "swarm/RobotPlugin.hh"
+
+using namespace swarm;
+
+/// \brief Time between checks that a worker is still running (s).
+static const double kWorkerPollTime = 1.0;
+
+/// \brief Time given to the workers to exit when they're stopped (s).
+static const double kWorkerStopTime = 5.0;
+
+/// \brief Copy a string to a field of the channel, padded with zeros.
+/// \param[in] _value The string. Longer strings are truncated.
+/// \param[out] _field The field.
+/// \param[in] _size Size of the field.
+static void copyName(const std::string &_value, char *_field,
+    const size_t _size)
+{
+  std::strncpy(_field, _value.c_str(), _size - 1);
+  _field[_size - 1] = '\0';
+}
+
+//////////////////////////////////////////////////
+PythonWorkers::PythonWorkers(std::unique_ptr<PythonChannel> _channel)
+  : channel(std::move(_channel))
+{
+}
+
+//////////////////////////////////////////////////
+PythonWorkers::~PythonWorkers()
+{
+  this->channel->Header().stop = 1;
+  for (uint32_t i = 0; i < this->pids.size(); ++i)
+  {
+    if (this->pids[i] > 0)
+      this->channel->Start(i);
+  }
+
+  for (const pid_t pid : this->pids)
+  {
+    if (pid <= 0)
+      continue;
+
+    const auto deadline = std::chrono::steady_clock::now() +
+      std::chrono::duration<double>(kWorkerStopTime);
+    while (waitpid(pid, nullptr, WNOHANG) == 0)
+    {
+      if (std::chrono::steady_clock::now() > deadline)
+      {
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+std::unique_ptr<PythonWorkers> PythonWorkers::Create(
+    const unsigned int _workers, const std::string &_module,
+    const std::string &_load, const std::string &_update,
+    const std::string &_onDataReceived)
+{
+  const std::string name = std::to_string(getpid());
+  std::unique_ptr<PythonChannel> channel =
+    PythonChannel::Create(name, _workers);
+  if (!channel)
+    return nullptr;
+
+  std::unique_ptr<PythonWorkers> workers(
+      new PythonWorkers(std::move(channel)));
+
+  const char *exe = std::getenv("SWARM_PYTHON_WORKER");
+  const std::string executable = exe ? exe : "swarm_python_worker";
+
+  gzmsg << "Starting " << _workers << " Python workers" << std::endl;
+  for (unsigned int i = 0; i < _workers; ++i)
+  {
+    // Build the arguments before forking, so the child only calls exec.
+    const std::string index = std::to_string(i);
+    std::vector<const char *> args = {executable.c_str(), name.c_str(),
+      index.c_str(), _module.c_str(), _load.c_str(), _update.c_str(),
+      _onDataReceived.c_str(), nullptr};
+
+    const pid_t pid = fork();
+    if (pid == 0)
+    {
+      execvp(args[0], const_cast<char * const *>(args.data()));
+      std::perror(("Unable to run " + executable).c_str());
+      _exit(127);
+    }
+    if (pid < 0)
+    {
+      gzerr << "Unable to start Python worker " << i << ": "
+            << std::strerror(errno) << std::endl;
+      return nullptr;
+    }
+    workers->pids.push_back(pid);
+  }
+  return workers;
+}
+
+//////////////////////////////////////////////////
+bool PythonWorkers::Add(RobotPlugin *_robot)
+{
+  if (this->indices.find(_robot) != this->indices.end())
+    return true;
+
+  if (this->robots.size() >= kPythonMaxRobots)
+  {
+    gzerr << "Too many robots for the Python workers, the largest number is "
+          << kPythonMaxRobots << std::endl;
+    return false;
+  }
+
+  const uint32_t index = this->robots.size();
+  this->indices[_robot] = index;
+  this->robots.push_back(_robot);
+  this->Fill(index);
+  return true;
+}
+
+//////////////////////////////////////////////////
+void PythonWorkers::Remove(RobotPlugin *_robot)
+{
+  auto it = this->indices.find(_robot);
+  if (it == this->indices.end())
+    return;
+
+  this->robots[it->second] = nullptr;
+  this->channel->Robot(it->second).name[0] = '\0';
+  this->indices.erase(it);
+}
+
+//////////////////////////////////////////////////
+void PythonWorkers::Receive(RobotPlugin *_robot,
+    const std::string &_srcAddress, const std::string &_dstAddress,
+    const uint32_t _dstPort, const std::string &_data)
+{
+  auto it = this->indices.find(_robot);
+  if (it == this->indices.end())
+    return;
+
+  PythonQueueWriter writer(this->channel->Robot(it->second).inbox);
+  writer.Add(_srcAddress);
+  writer.Add(_dstAddress);
+  writer.Add(_dstPort);
+  writer.Add(_data);
+  if (!writer.End() && !this->dropReported)
+  {
+    gzwarn << "[" << _robot->Host() << "] The inbox of the Python worker is "
+           << "full, dropping messages" << std::endl;
+    this->dropReported = true;
+  }
+}
+
+//////////////////////////////////////////////////
+void PythonWorkers::Step(const gazebo::common::UpdateInfo &_info)
+{
+  PythonHeader &header = this->channel->Header();
+  header.simTime = _info.simTime.Double();
+  header.realTime = _info.realTime.Double();
+  copyName(_info.worldName, header.worldName, kPythonNameSize);
+  header.numRobots = this->robots.size();
+
+  for (uint32_t i = 0; i < this->robots.size(); ++i)
+  {
+    if (this->robots[i])
+      this->Fill(i);
+  }
+
+  for (uint32_t i = 0; i < this->pids.size(); ++i)
+  {
+    if (this->pids[i] > 0)
+      this->channel->Start(i);
+  }
+  for (uint32_t i = 0; i < this->pids.size(); ++i)
+  {
+    if (this->pids[i] > 0)
+      this->Wait(i);
+  }
+
+  for (uint32_t i = 0; i < this->robots.size(); ++i)
+  {
+    if (this->robots[i])
+      this->Apply(i);
+    this->channel->Robot(i).inbox.size = 0;
+    this->channel->Robot(i).outbox.size = 0;
+  }
+}
+
+//////////////////////////////////////////////////
+void PythonWorkers::Wait(const uint32_t _worker)
+{
+  while (!this->channel->WaitDone(_worker, kWorkerPollTime))
+  {
+    int status;
+    if (waitpid(this->pids[_worker], &status, WNOHANG) != 0)
+    {
+      gzerr << "Python worker " << _worker << " exited, its robots won't "
+            << "be updated anymore" << std::endl;
+      this->pids[_worker] = -1;
+      return;
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+void PythonWorkers::Fill(const uint32_t _index)
+{
+  RobotPlugin *robot = this->robots[_index];
+  PythonRobot &slot = this->channel->Robot(_index);
+
+  copyName(robot->Name(), slot.name, kPythonNameSize);
+  copyName(robot->Host(), slot.host, kPythonNameSize);
+
+  switch (robot->Type())
+  {
+    case RobotPlugin::GROUND:
+      copyName("ground", slot.type, sizeof(slot.type));
+      break;
+    case RobotPlugin::ROTOR:
+      copyName("rotor", slot.type, sizeof(slot.type));
+      break;
+    case RobotPlugin::FIXED_WING:
+      copyName("fixed_wing", slot.type, sizeof(slot.type));
+      break;
+    case RobotPlugin::BOO:
+      copyName("boo", slot.type, sizeof(slot.type));
+      break;
+    default:
+      copyName("", slot.type, sizeof(slot.type));
+  }
+
+  switch (robot->Terrain())
+  {
+    case PLAIN:
+      copyName("plain", slot.terrain, sizeof(slot.terrain));
+      break;
+    case FOREST:
+      copyName("forest", slot.terrain, sizeof(slot.terrain));
+      break;
+    case BUILDING:
+      copyName("building", slot.terrain, sizeof(slot.terrain));
+      break;
+    default:
+      copyName("", slot.terrain, sizeof(slot.terrain));
+  }
+
+  robot->SearchArea(slot.searchArea[0], slot.searchArea[1],
+      slot.searchArea[2], slot.searchArea[3]);
+  robot->BooPose(slot.booPose[0], slot.booPose[1]);
+  const ignition::math::Vector2d dir = robot->LostPersonDir();
+  slot.lostPersonDir[0] = dir.X();
+  slot.lostPersonDir[1] = dir.Y();
+  robot->Pose(slot.pose[0], slot.pose[1], slot.pose[2]);
+
+  ignition::math::Vector3d linVel, angVel;
+  ignition::math::Quaterniond orient;
+  robot->Imu(linVel, angVel, orient);
+  slot.imu[0] = linVel.X();
+  slot.imu[1] = linVel.Y();
+  slot.imu[2] = linVel.Z();
+  slot.imu[3] = angVel.X();
+  slot.imu[4] = angVel.Y();
+  slot.imu[5] = angVel.Z();
+  slot.imu[6] = orient.X();
+  slot.imu[7] = orient.Y();
+  slot.imu[8] = orient.Z();
+
+  ignition::math::Angle bearing;
+  robot->Bearing(bearing);
+  slot.bearing = bearing.Radian();
+  slot.docked = robot->IsDocked();
+
+  ImageData img;
+  robot->Image(img);
+  slot.numObjects = 0;
+  for (auto const &obj : img.objects)
+  {
+    if (slot.numObjects == kPythonMaxObjects)
+      break;
+    PythonObject &object = slot.objects[slot.numObjects++];
+    const ignition::math::Pose3d pose = robot->CameraToWorld(obj.second);
+    copyName(obj.first, object.name, kPythonNameSize);
+    object.x = pose.Pos().X();
+    object.y = pose.Pos().Y();
+    object.z = pose.Pos().Z();
+  }
+
+  slot.neighbors.size = 0;
+  PythonQueueWriter writer(slot.neighbors);
+  for (const std::string &neighbor : robot->Neighbors())
+  {
+    writer.Add(neighbor);
+    if (!writer.End())
+      break;
+  }
+}
+
+//////////////////////////////////////////////////
+void PythonWorkers::Apply(const uint32_t _index)
+{
+  PythonQueueReader reader(this->channel->Robot(_index).outbox);
+  while (!reader.Done())
+  {
+    uint32_t target, command;
+    if (!reader.Read(target) || !reader.Read(command))
+      break;
+
+    RobotPlugin *robot =
+      target < this->robots.size() ? this->robots[target] : nullptr;
+    std::string text, address;
+    uint32_t port;
+    double x, y, z;
+    bool valid = true;
+    switch (command)
+    {
+      case PYTHON_BIND:
+        valid = reader.Read(address) && reader.Read(port);
+        if (valid && robot)
+        {
+          robot->Bind(&RobotPlugin::OnDataReceivedPython, robot, address,
+              port);
+        }
+        break;
+      case PYTHON_LINEAR_VELOCITY:
+        valid = reader.Read(x) && reader.Read(y) && reader.Read(z);
+        if (valid && robot)
+          robot->SetLinearVelocity(x, y, z);
+        break;
+      case PYTHON_ANGULAR_VELOCITY:
+        valid = reader.Read(x) && reader.Read(y) && reader.Read(z);
+        if (valid && robot)
+          robot->SetAngularVelocity(x, y, z);
+        break;
+      case PYTHON_SEND_TO:
+        valid = reader.Read(text) && reader.Read(address) &&
+          reader.Read(port);
+        if (valid && robot)
+          robot->SendTo(text, address, port);
+        break;
+      case PYTHON_LAUNCH:
+        if (robot)
+          robot->Launch();
+        break;
+      case PYTHON_DOCK:
+        valid = reader.Read(address);
+        if (valid && robot)
+          robot->Dock(address);
+        break;
+      case PYTHON_GZMSG:
+        valid = reader.Read(text);
+        if (valid)
+          gzmsg << text << std::endl;
+        break;
+      case PYTHON_GZERR:
+        valid = reader.Read(text);
+        if (valid)
+          gzerr << text << std::endl;
+        break;
+      case PYTHON_GZLOG:
+        valid = reader.Read(text);
+        if (valid)
+          gzlog << text << std::endl;
+        break;
+      default:
+        valid = false;
+    }
+
+    if (!valid)
+    {
+      gzerr << "Invalid command [" << command << "] from the Python worker"
+            << std::endl;
+      break;
+    }
+  }
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <cmath>
+#include <string>
+
+#include "swarm/RandomStream.hh"
+
+using namespace swarm;
+
+/// \brief Mix the bits of a value (splitmix64 finalizer).
+/// \param[in] _value The value.
+/// \return The mixed value.
+static uint64_t Mix(uint64_t _value)
+{
+  _value = (_value ^ (_value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  _value = (_value ^ (_value >> 27)) * 0x94d049bb133111ebULL;
+  return _value ^ (_value >> 31);
+}
+
+/// \brief Set the key of a stream from 64 bits.
+/// \param[in] _bits The bits.
+/// \param[out] _key The key.
+static void SetKey(const uint64_t _bits, uint32_t _key[2])
+{
+  _key[0] = static_cast<uint32_t>(_bits);
+  _key[1] = static_cast<uint32_t>(_bits >> 32);
+}
+
+//////////////////////////////////////////////////
+RandomStream::RandomStream(const uint64_t _seed, const Subsystem _subsystem,
+    const uint64_t _member)
+{
+  SetKey(Mix(Mix(Mix(_seed) ^ _subsystem) ^ _member), this->key);
+}
+
+//////////////////////////////////////////////////
+RandomStream RandomStream::Split(const uint64_t _id) const
+{
+  const uint64_t bits = (uint64_t(this->key[1]) << 32) | this->key[0];
+  RandomStream stream;
+  SetKey(Mix(bits ^ Mix(_id + 0x9e3779b97f4a7c15ULL)), stream.key);
+  return stream;
+}
+
+//////////////////////////////////////////////////
+uint64_t RandomStream::MemberKey(const std::string &_name)
+{
+  // FNV-1a, as std::hash may change with the library.
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const char c : _name)
+  {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+//////////////////////////////////////////////////
+void RandomStream::Seek(const uint64_t _block)
+{
+  this->block = _block;
+  this->counter = 0;
+  this->used = 4;
+}
+
+//////////////////////////////////////////////////
+uint64_t RandomStream::Block() const
+{
+  return this->block;
+}
+
+//////////////////////////////////////////////////
+uint64_t RandomStream::Position() const
+{
+  return this->counter * 4 - (4 - this->used);
+}
+
+//////////////////////////////////////////////////
+RandomStream::result_type RandomStream::operator()()
+{
+  if (this->used == 4)
+    this->Refill();
+  return this->words[this->used++];
+}
+
+//////////////////////////////////////////////////
+uint64_t RandomStream::Bits64()
+{
+  const uint64_t high = (*this)();
+  return (high << 32) | (*this)();
+}
+
+//////////////////////////////////////////////////
+double RandomStream::Uniform()
+{
+  return (this->Bits64() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+//////////////////////////////////////////////////
+double RandomStream::Uniform(const double _min, const double _max)
+{
+  return _min + (_max - _min) * this->Uniform();
+}
+
+//////////////////////////////////////////////////
+int RandomStream::IntUniform(const int _min, const int _max)
+{
+  const double range = static_cast<double>(_max) - _min + 1;
+  const int value = _min + static_cast<int>(this->Uniform() * range);
+  return value > _max ? _max : value;
+}
+
+//////////////////////////////////////////////////
+double RandomStream::Normal(const double _mean, const double _stdDev)
+{
+  // 1 - u is in (0, 1], so the logarithm is finite.
+  const double radius = std::sqrt(-2.0 * std::log(1.0 - this->Uniform()));
+  return _mean + _stdDev * radius * std::cos(2 * M_PI * this->Uniform());
+}
+
+//////////////////////////////////////////////////
+void RandomStream::Uniform(const size_t _count, const double _min,
+    const double _max, double *_out)
+{
+  for (size_t i = 0; i < _count; ++i)
+    _out[i] = this->Uniform(_min, _max);
+}
+
+//////////////////////////////////////////////////
+void RandomStream::Normal(const size_t _count, const double _mean,
+    const double _stdDev, double *_out)
+{
+  for (size_t i = 0; i < _count; i += 2)
+  {
+    const double radius =
+      _stdDev * std::sqrt(-2.0 * std::log(1.0 - this->Uniform()));
+    const double angle = 2 * M_PI * this->Uniform();
+    _out[i] = _mean + radius * std::cos(angle);
+    if (i + 1 < _count)
+      _out[i + 1] = _mean + radius * std::sin(angle);
+  }
+}
+
+//////////////////////////////////////////////////
+void RandomStream::Philox(const uint32_t _counter[4],
+    const uint32_t _key[2], uint32_t _out[4])
+{
+  uint32_t c0 = _counter[0], c1 = _counter[1];
+  uint32_t c2 = _counter[2], c3 = _counter[3];
+  uint32_t k0 = _key[0], k1 = _key[1];
+  for (int round = 0; round < 10; ++round)
+  {
+    const uint64_t p0 = uint64_t(0xD2511F53u) * c0;
+    const uint64_t p1 = uint64_t(0xCD9E8D57u) * c2;
+    const uint32_t next0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+    const uint32_t next2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+    c1 = static_cast<uint32_t>(p1);
+    c3 = static_cast<uint32_t>(p0);
+    c0 = next0;
+    c2 = next2;
+    k0 += 0x9E3779B9u;
+    k1 += 0xBB67AE85u;
+  }
+  _out[0] = c0;
+  _out[1] = c1;
+  _out[2] = c2;
+  _out[3] = c3;
+}
+
+//////////////////////////////////////////////////
+void RandomStream::Refill()
+{
+  const uint32_t value[4] = {
+    static_cast<uint32_t>(this->counter),
+    static_cast<uint32_t>(this->counter >> 32),
+    static_cast<uint32_t>(this->block),
+    static_cast<uint32_t>(this->block >> 32)};
+  Philox(value, this->key, this->words);
+  ++this->counter;
+  this->used = 0;
+}
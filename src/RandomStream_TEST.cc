@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+#include "gtest/gtest.h"
+#include "swarm/RandomStream.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Check the generator against the known answers of Random123.
+TEST(RandomStreamTest, Philox)
+{
+  uint32_t out[4];
+  {
+    const uint32_t counter[4] = {0, 0, 0, 0};
+    const uint32_t key[2] = {0, 0};
+    RandomStream::Philox(counter, key, out);
+    EXPECT_EQ(out[0], 0x6627e8d5u);
+    EXPECT_EQ(out[1], 0xe169c58du);
+    EXPECT_EQ(out[2], 0xbc57ac4cu);
+    EXPECT_EQ(out[3], 0x9b00dbd8u);
+  }
+  {
+    const uint32_t counter[4] =
+      {0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu};
+    const uint32_t key[2] = {0xffffffffu, 0xffffffffu};
+    RandomStream::Philox(counter, key, out);
+    EXPECT_EQ(out[0], 0x408f276du);
+    EXPECT_EQ(out[1], 0x41c83b0eu);
+    EXPECT_EQ(out[2], 0xa20bc7c6u);
+    EXPECT_EQ(out[3], 0x6d5451fdu);
+  }
+  {
+    const uint32_t counter[4] =
+      {0x243f6a88u, 0x85a308d3u, 0x13198a2eu, 0x03707344u};
+    const uint32_t key[2] = {0xa4093822u, 0x299f31d0u};
+    RandomStream::Philox(counter, key, out);
+    EXPECT_EQ(out[0], 0xd16cfe09u);
+    EXPECT_EQ(out[1], 0x94fdccebu);
+    EXPECT_EQ(out[2], 0x5001e420u);
+    EXPECT_EQ(out[3], 0x24126ea1u);
+  }
+}
+
+//////////////////////////////////////////////////
+/// \brief Check that the numbers only depend on the key and the position.
+TEST(RandomStreamTest, Streams)
+{
+  const uint64_t robot = RandomStream::MemberKey("192.168.2.1");
+  EXPECT_EQ(robot, RandomStream::MemberKey("192.168.2.1"));
+  EXPECT_NE(robot, RandomStream::MemberKey("192.168.2.2"));
+
+  RandomStream a(7, RandomStream::SENSORS, robot);
+  RandomStream b(7, RandomStream::SENSORS, robot);
+  RandomStream other(7, RandomStream::CAMERA, robot);
+
+  // Interleaving the draws, or drawing from other streams, doesn't change
+  // the numbers.
+  a.Seek(100);
+  std::vector<double> first;
+  for (int i = 0; i < 10; ++i)
+  {
+    first.push_back(a.Uniform());
+    other.Uniform();
+  }
+  EXPECT_EQ(a.Block(), 100u);
+  EXPECT_EQ(a.Position(), 20u);
+
+  b.Seek(99);
+  b.Normal(0, 1);
+  b.Seek(100);
+  for (int i = 0; i < 10; ++i)
+    EXPECT_EQ(b.Uniform(), first[i]);
+
+  // Other blocks, subsystems, members and seeds give other numbers.
+  a.Seek(101);
+  EXPECT_NE(a.Uniform(), first[0]);
+  other.Seek(100);
+  EXPECT_NE(other.Uniform(), first[0]);
+  RandomStream c(8, RandomStream::SENSORS, robot);
+  c.Seek(100);
+  EXPECT_NE(c.Uniform(), first[0]);
+  RandomStream split = a.Split(1);
+  split.Seek(100);
+  EXPECT_NE(split.Uniform(), first[0]);
+  EXPECT_NE(split.Uniform(), a.Split(2).Uniform());
+
+  // The batches give the same numbers as the single draws.
+  std::vector<double> batch(10);
+  b.Seek(100);
+  b.Uniform(batch.size(), 0, 1, batch.data());
+  EXPECT_EQ(batch, first);
+}
+
+//////////////////////////////////////////////////
+/// \brief Check the distributions.
+TEST(RandomStreamTest, Distributions)
+{
+  RandomStream stream(3, RandomStream::DISPATCH);
+  const size_t kCount = 100000;
+
+  std::vector<double> values(kCount);
+  stream.Uniform(kCount, -2, 4, values.data());
+  EXPECT_GE(*std::min_element(values.begin(), values.end()), -2);
+  EXPECT_LT(*std::max_element(values.begin(), values.end()), 4);
+  double mean = std::accumulate(values.begin(), values.end(), 0.0) / kCount;
+  EXPECT_NEAR(mean, 1, 0.05);
+
+  stream.Normal(kCount, 5, 2, values.data());
+  mean = std::accumulate(values.begin(), values.end(), 0.0) / kCount;
+  double variance = 0;
+  for (const double value : values)
+    variance += (value - mean) * (value - mean) / kCount;
+  EXPECT_NEAR(mean, 5, 0.05);
+  EXPECT_NEAR(std::sqrt(variance), 2, 0.05);
+
+  mean = 0;
+  for (size_t i = 0; i < kCount; ++i)
+    mean += stream.Normal(0, 1) / kCount;
+  EXPECT_NEAR(mean, 0, 0.05);
+
+  std::vector<int> counts(3, 0);
+  for (size_t i = 0; i < kCount; ++i)
+  {
+    const int value = stream.IntUniform(1, 3);
+    ASSERT_GE(value, 1);
+    ASSERT_LE(value, 3);
+    ++counts[value - 1];
+  }
+  for (const int count : counts)
+    EXPECT_NEAR(count, kCount / 3.0, kCount * 0.01);
+
+  // Shuffles.
+  std::vector<int> order(20);
+  std::iota(order.begin(), order.end(), 0);
+  std::vector<int> shuffled = order;
+  stream.Seek(5);
+  std::shuffle(shuffled.begin(), shuffled.end(), stream);
+  EXPECT_NE(shuffled, order);
+  std::vector<int> again = order;
+  stream.Seek(5);
+  std::shuffle(again.begin(), again.end(), stream);
+  EXPECT_EQ(again, shuffled);
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
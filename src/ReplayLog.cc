@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "msgs/log_entry.pb.h"
+#include "swarm/Helpers.hh"
+#include "swarm/LogParser.hh"
+#include "swarm/ReplayLog.hh"
+
+using namespace swarm;
+
+constexpr double ReplayLog::kVelocityTolerance;
+constexpr double ReplayLog::kTimeTolerance;
+
+//////////////////////////////////////////////////
+ReplayLog *ReplayLog::Instance(const std::string &_world)
+{
+  static std::mutex mutex;
+  static std::map<std::string, std::unique_ptr<ReplayLog>> instances;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  std::unique_ptr<ReplayLog> &instance = instances[_world];
+  if (!instance)
+    instance.reset(new ReplayLog());
+  return instance.get();
+}
+
+//////////////////////////////////////////////////
+bool ReplayLog::Load(const std::string &_path)
+{
+  if (this->loadCalled)
+    return this->loaded;
+  this->loadCalled = true;
+
+  LogParser parser;
+  if (!parser.Load(_path))
+  {
+    std::cerr << "ReplayLog::Load() error: Unable to open [" << _path << "]"
+              << std::endl;
+    return false;
+  }
+
+  if (parser.Minimal())
+  {
+    std::cerr << "ReplayLog::Load() error: [" << _path << "] is a minimal "
+              << "log, without the entries of the robots" << std::endl;
+    return false;
+  }
+
+  // Only the entries of the robots logged with SWARM_LOG_REPLAY=1 have a
+  // step time.
+  msgs::LogEntry entry;
+  while (parser.Next(entry))
+  {
+    if (entry.has_step_time())
+      this->Add(entry);
+  }
+
+  if (this->entries.empty())
+  {
+    std::cerr << "ReplayLog::Load() error: [" << _path << "] has no entries "
+              << "to replay. Was it logged with SWARM_ROBOT_LOG=1 and "
+              << "SWARM_LOG_REPLAY=1?" << std::endl;
+    return false;
+  }
+
+  this->loaded = true;
+  return true;
+}
+
+//////////////////////////////////////////////////
+void ReplayLog::Add(const msgs::LogEntry &_entry)
+{
+  std::vector<msgs::LogEntry> &robotEntries = this->entries[_entry.id()];
+
+  // The entries of a log come in order, so they are usually appended.
+  auto it = std::upper_bound(robotEntries.begin(), robotEntries.end(),
+      _entry.step_time(),
+      [](const double _time, const msgs::LogEntry &_other)
+      {
+        return _time < _other.step_time();
+      });
+  robotEntries.insert(it, _entry);
+
+  if (_entry.step_time() > this->endTime)
+    this->endTime = _entry.step_time();
+}
+
+//////////////////////////////////////////////////
+bool ReplayLog::Has(const std::string &_id) const
+{
+  return this->entries.find(_id) != this->entries.end();
+}
+
+//////////////////////////////////////////////////
+const msgs::LogEntry *ReplayLog::Find(const std::string &_id,
+    const double _time) const
+{
+  auto robotEntries = this->entries.find(_id);
+  if (robotEntries == this->entries.end())
+    return nullptr;
+
+  const std::vector<msgs::LogEntry> &v = robotEntries->second;
+  auto it = std::lower_bound(v.begin(), v.end(), _time - kTimeTolerance,
+      [](const msgs::LogEntry &_entry, const double _t)
+      {
+        return _entry.step_time() < _t;
+      });
+  if (it == v.end() || it->step_time() > _time + kTimeTolerance)
+    return nullptr;
+  return &*it;
+}
+
+//////////////////////////////////////////////////
+double ReplayLog::EndTime() const
+{
+  return this->endTime;
+}
+
+//////////////////////////////////////////////////
+bool ReplayLog::Check(const msgs::LogEntry &_entry,
+    const ignition::math::Vector3d &_linVel,
+    const ignition::math::Vector3d &_angVel,
+    const std::vector<DatagramPtr> &_sent)
+{
+  Result &result = this->results[_entry.id()];
+  ++result.steps;
+
+  // The velocities are logged as requested, so they only differ by the
+  // rounding of the computations of the controller.
+  bool actionsMatch = true;
+  if (_entry.has_actions())
+  {
+    const auto &linvel = _entry.actions().linvel();
+    const auto &angvel = _entry.actions().angvel();
+    actionsMatch =
+      std::abs(linvel.x() - _linVel.X()) <= kVelocityTolerance &&
+      std::abs(linvel.y() - _linVel.Y()) <= kVelocityTolerance &&
+      std::abs(linvel.z() - _linVel.Z()) <= kVelocityTolerance &&
+      std::abs(angvel.x() - _angVel.X()) <= kVelocityTolerance &&
+      std::abs(angvel.y() - _angVel.Y()) <= kVelocityTolerance &&
+      std::abs(angvel.z() - _angVel.Z()) <= kVelocityTolerance;
+  }
+  if (!actionsMatch)
+  {
+    ++result.actionMismatches;
+    std::ostringstream what;
+    what << "velocities [" << _linVel << "] [" << _angVel << "], logged ["
+         << _entry.actions().linvel().x() << " "
+         << _entry.actions().linvel().y() << " "
+         << _entry.actions().linvel().z() << "] ["
+         << _entry.actions().angvel().x() << " "
+         << _entry.actions().angvel().y() << " "
+         << _entry.actions().angvel().z() << "]";
+    Mismatch(result, _entry.step_time(), what.str());
+  }
+
+  // The messages are compared in the order they were sent.
+  bool msgsMatch = static_cast<size_t>(_entry.sent_size()) == _sent.size();
+  for (size_t i = 0; msgsMatch && i < _sent.size(); ++i)
+  {
+    const msgs::Datagram &logged = _entry.sent(static_cast<int>(i));
+    msgsMatch = logged.dst_address() == _sent[i]->dst_address() &&
+      logged.dst_port() == _sent[i]->dst_port() &&
+      logged.data() == _sent[i]->data();
+  }
+  if (!msgsMatch)
+  {
+    ++result.msgMismatches;
+    std::ostringstream what;
+    what << _sent.size() << " messages sent, " << _entry.sent_size()
+         << " logged";
+    Mismatch(result, _entry.step_time(), what.str());
+  }
+
+  return actionsMatch && msgsMatch;
+}
+
+//////////////////////////////////////////////////
+void ReplayLog::Mismatch(Result &_result, const double _time,
+    const std::string &_what)
+{
+  if (_result.firstMismatchTime >= 0)
+    return;
+
+  _result.firstMismatchTime = _time;
+  _result.firstMismatch = _what;
+}
+
+//////////////////////////////////////////////////
+const std::map<std::string, ReplayLog::Result> &ReplayLog::Results() const
+{
+  return this->results;
+}
+
+//////////////////////////////////////////////////
+bool ReplayLog::Passed() const
+{
+  bool compared = false;
+  for (auto const &result : this->results)
+  {
+    if (result.second.actionMismatches > 0 || result.second.msgMismatches > 0)
+      return false;
+    compared = compared || result.second.steps > 0;
+  }
+  return compared;
+}
+
+//////////////////////////////////////////////////
+void ReplayLog::Report(std::ostream &_out) const
+{
+  uint64_t steps = 0;
+  for (auto const &result : this->results)
+  {
+    const Result &r = result.second;
+    _out << result.first << ": " << r.steps << " steps, "
+         << r.actionMismatches << " with other velocities, "
+         << r.msgMismatches << " with other messages";
+    if (r.firstMismatchTime >= 0)
+    {
+      _out << ", first at " << r.firstMismatchTime << " s: "
+           << r.firstMismatch;
+    }
+    _out << std::endl;
+
+    steps += r.steps;
+  }
+
+  _out << "Replayed " << this->results.size() << " robots, " << steps
+       << " steps until " << this->endTime << " s: "
+       << (this->Passed() ? "PASSED" : "FAILED") << std::endl;
+}
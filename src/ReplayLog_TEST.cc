@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <ignition/math/Vector3.hh>
+#include "gtest/gtest.h"
+#include "msgs/datagram.pb.h"
+#include "msgs/log_entry.pb.h"
+#include "swarm/ReplayLog.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Build the entry of a step of a robot.
+/// \param[in] _id Address of the robot.
+/// \param[in] _time Simulation time of the step.
+/// \param[in] _linVelX Linear velocity requested along X.
+/// \return The entry.
+static msgs::LogEntry stepEntry(const std::string &_id, const double _time,
+    const double _linVelX)
+{
+  msgs::LogEntry entry;
+  entry.set_id(_id);
+  entry.set_time(_time);
+  entry.set_step_time(_time);
+  auto linvel = entry.mutable_actions()->mutable_linvel();
+  linvel->set_x(_linVelX);
+  linvel->set_y(0);
+  linvel->set_z(0);
+  auto angvel = entry.mutable_actions()->mutable_angvel();
+  angvel->set_x(0);
+  angvel->set_y(0);
+  angvel->set_z(0);
+  return entry;
+}
+
+//////////////////////////////////////////////////
+TEST(ReplayLogTest, Find)
+{
+  ReplayLog *replay = ReplayLog::Instance("find");
+  EXPECT_EQ(replay, ReplayLog::Instance("find"));
+  EXPECT_NE(replay, ReplayLog::Instance("other"));
+
+  // The entries are kept in order of step time.
+  replay->Add(stepEntry("192.168.2.1", 0.02, 2));
+  replay->Add(stepEntry("192.168.2.1", 0.01, 1));
+  replay->Add(stepEntry("192.168.2.2", 0.01, 3));
+
+  EXPECT_TRUE(replay->Has("192.168.2.1"));
+  EXPECT_FALSE(replay->Has("192.168.2.3"));
+  EXPECT_DOUBLE_EQ(0.02, replay->EndTime());
+
+  const msgs::LogEntry *entry = replay->Find("192.168.2.1", 0.01 + 1e-9);
+  ASSERT_NE(nullptr, entry);
+  EXPECT_DOUBLE_EQ(1, entry->actions().linvel().x());
+  entry = replay->Find("192.168.2.1", 0.02);
+  ASSERT_NE(nullptr, entry);
+  EXPECT_DOUBLE_EQ(2, entry->actions().linvel().x());
+
+  EXPECT_EQ(nullptr, replay->Find("192.168.2.1", 0.015));
+  EXPECT_EQ(nullptr, replay->Find("192.168.2.1", 0.03));
+  EXPECT_EQ(nullptr, replay->Find("192.168.2.3", 0.01));
+}
+
+//////////////////////////////////////////////////
+TEST(ReplayLogTest, Check)
+{
+  ReplayLog *replay = ReplayLog::Instance("check");
+  EXPECT_FALSE(replay->Passed());
+
+  msgs::LogEntry entry = stepEntry("192.168.2.1", 0.01, 1);
+  msgs::Datagram *logged = entry.add_sent();
+  logged->set_src_address("192.168.2.1");
+  logged->set_dst_address("broadcast");
+  logged->set_dst_port(4100);
+  logged->set_data("hello");
+
+  auto msg = std::make_shared<msgs::Datagram>(*logged);
+  std::vector<DatagramPtr> sent = {msg};
+  EXPECT_TRUE(replay->Check(entry, ignition::math::Vector3d(1, 0, 0),
+        ignition::math::Vector3d::Zero, sent));
+  EXPECT_TRUE(replay->Passed());
+
+  // Other velocities.
+  entry.set_step_time(0.02);
+  EXPECT_FALSE(replay->Check(entry, ignition::math::Vector3d(1.1, 0, 0),
+        ignition::math::Vector3d::Zero, sent));
+
+  // Another payload, and a message less.
+  entry.set_step_time(0.03);
+  msg->set_data("bye");
+  EXPECT_FALSE(replay->Check(entry, ignition::math::Vector3d(1, 0, 0),
+        ignition::math::Vector3d::Zero, sent));
+  EXPECT_FALSE(replay->Check(entry, ignition::math::Vector3d(1, 0, 0),
+        ignition::math::Vector3d::Zero, {}));
+
+  const ReplayLog::Result &result = replay->Results().at("192.168.2.1");
+  EXPECT_EQ(4u, result.steps);
+  EXPECT_EQ(1u, result.actionMismatches);
+  EXPECT_EQ(2u, result.msgMismatches);
+  EXPECT_DOUBLE_EQ(0.02, result.firstMismatchTime);
+  EXPECT_FALSE(replay->Passed());
+
+  std::ostringstream report;
+  replay->Report(report);
+  EXPECT_NE(std::string::npos, report.str().find("FAILED"));
+}
+
+//////////////////////////////////////////////////
+TEST(ReplayLogTest, LoadMissing)
+{
+  ReplayLog *replay = ReplayLog::Instance("missing");
+  EXPECT_FALSE(replay->Load("/tmp/replay_log_test_missing.log"));
+
+  // Only the first call reads the log.
+  EXPECT_FALSE(replay->Load("/tmp/replay_log_test_missing.log"));
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -15,9 +15,14 @@
  *
 */
 
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 #include <ignition/math/Helpers.hh>
 
@@ -26,9 +31,13 @@
 #include <gazebo/common/Console.hh>
 #include <gazebo/common/Plugin.hh>
 #include <gazebo/math/Vector2i.hh>
+#include <gazebo/msgs/msgs.hh>
 #include <gazebo/transport/transport.hh>
 #include <gazebo/physics/physics.hh>
+#include "msgs/checkpoint.pb.h"
 #include "msgs/log_entry.pb.h"
+#include "swarm/FoundReport.hh"
+#include "swarm/ReplayLog.hh"
 #include "swarm/RobotPlugin.hh"
 
 using namespace swarm;
@@ -39,6 +48,10 @@ GZ_REGISTER_MODEL_PLUGIN(RobotPlugin)
   #include <Python.h>
   extern PyMethodDef EmbMethods[];
   extern std::unordered_map<std::string, RobotPlugin*> robotPointers;
+  extern std::vector<RobotPlugin*> robotOrder;
+  extern void add_batch_constants(PyObject *module);
+  extern bool update_all(PyObject *func,
+      const gazebo::common::UpdateInfo &info);
 #endif
 
 // Allocate storage for static class member
@@ -48,6 +61,9 @@ void *RobotPlugin::pModule = NULL;
 void *RobotPlugin::pDict = NULL;
 void *RobotPlugin::pUpdateFunc = NULL;
 void *RobotPlugin::pOnDataReceivedFunc = NULL;
+void *RobotPlugin::pUpdateAllFunc = NULL;
+gazebo::common::Time RobotPlugin::pStepTime(-1.0);
+std::unique_ptr<PythonWorkers> RobotPlugin::pWorkers;
 
 //////////////////////////////////////////////////
 RobotPlugin::RobotPlugin()
@@ -66,9 +82,19 @@ RobotPlugin::RobotPlugin()
 //////////////////////////////////////////////////
 RobotPlugin::~RobotPlugin()
 {
-  gazebo::event::Events::DisconnectWorldUpdateBegin(this->updateConnection);
+  if (this->executor)
+    this->executor->Remove(this);
   this->broker->Unregister(this->Host());
   this->logger->Unregister(this->Host());
+  if (this->checkpointer)
+    this->checkpointer->Unregister(this->Host());
+  if (this->memory)
+    this->memory->Unregister(this->Host());
+  if (this->pWorkers)
+  {
+    std::lock_guard<std::mutex> lock(this->pMutex);
+    this->pWorkers->Remove(this);
+  }
 }
 
 //////////////////////////////////////////////////
@@ -79,8 +105,25 @@ void RobotPlugin::Load(sdf::ElementPtr /*_sdf*/)
 bool RobotPlugin::LoadPython(const std::string &_module,
                              const std::string &_load,
                              const std::string &_update,
-                             const std::string &_onDataReceived)
+                             const std::string &_onDataReceived,
+                             const std::string &_updateAll)
 {
+  // Run the controllers in worker processes, if requested.
+  const char *workersEnv = std::getenv("SWARM_PYTHON_WORKERS");
+  const int workers = workersEnv ? std::atoi(workersEnv) : 0;
+  if (workers > 0)
+  {
+    std::lock_guard<std::mutex> lock(this->pMutex);
+    if (!this->pWorkers)
+    {
+      this->pWorkers = PythonWorkers::Create(workers, _module, _load,
+          _update, _onDataReceived);
+      if (!this->pWorkers)
+        return false;
+    }
+    return this->pWorkers->Add(this);
+  }
+
 #ifndef SWARM_PYTHON_API
   gzerr << "Swarm was built without Python API support; "
     "can't initialize Python for robot " << this->address << std::endl;
@@ -91,7 +134,7 @@ bool RobotPlugin::LoadPython(const std::string &_module,
   {
     gzmsg << "Initializing Python" << std::endl;
     Py_Initialize();
-    Py_InitModule("swarm", EmbMethods);
+    add_batch_constants(Py_InitModule("swarm", EmbMethods));
 
     // Import user's module
     PyObject* pName = PyString_FromString(_module.c_str());
@@ -121,10 +164,24 @@ bool RobotPlugin::LoadPython(const std::string &_module,
       PyErr_Print();
       return false;
     }
+    // Optional batched update function.
+    if(!_updateAll.empty())
+    {
+      this->pUpdateAllFunc =
+        (void*)PyObject_GetAttrString((PyObject*)this->pModule,
+                                      _updateAll.c_str());
+      if(this->pUpdateAllFunc == NULL)
+      {
+        PyErr_Print();
+        return false;
+      }
+    }
     this->pInitialized = true;
   }
 
   // Put this robot in the list used by Python
+  if(robotPointers.find(this->Name()) == robotPointers.end())
+    robotOrder.push_back(this);
   robotPointers[this->Name()] = this;
 
   // Call the given load method once for every robot
@@ -154,14 +211,31 @@ bool RobotPlugin::LoadPython(const std::string &_module,
 //////////////////////////////////////////////////
 void RobotPlugin::UpdatePython(const gazebo::common::UpdateInfo & _info)
 {
+  // The first robot updated in a step runs all the workers.
+  if (this->pWorkers)
+  {
+    std::lock_guard<std::mutex> lock(this->pMutex);
+    if (FirstPythonUpdate(_info))
+      this->pWorkers->Step(_info);
+    return;
+  }
+
 #ifndef SWARM_PYTHON_API
   gzerr << "Swarm was built without Python API support; "
     "can't call Python Update for robot " << this->address << std::endl;
-  return false;
 #else
   std::lock_guard<std::mutex> lock(this->pMutex);
   if(!this->pInitialized)
     return;
+
+  // The first robot updated in a step updates all of them at once.
+  if(this->pUpdateAllFunc != NULL)
+  {
+    if(FirstPythonUpdate(_info))
+      update_all((PyObject*)this->pUpdateAllFunc, _info);
+    return;
+  }
+
   PyObject *pArgs = PyTuple_New(4);
   // Robot address
   PyTuple_SetItem(pArgs, 0, PyString_FromString(this->Name().c_str()));
@@ -177,17 +251,34 @@ void RobotPlugin::UpdatePython(const gazebo::common::UpdateInfo & _info)
 #endif
 }
 
+//////////////////////////////////////////////////
+bool RobotPlugin::FirstPythonUpdate(const gazebo::common::UpdateInfo &_info)
+{
+  if (_info.simTime == pStepTime)
+    return false;
+
+  pStepTime = _info.simTime;
+  return true;
+}
+
 //////////////////////////////////////////////////
 void RobotPlugin::OnDataReceivedPython(const std::string &_srcAddress,
                                        const std::string &_dstAddress,
                                        const uint32_t _dstPort,
                                        const std::string &_data)
 {
+  // Passed to the worker in the next step.
+  if (this->pWorkers)
+  {
+    std::lock_guard<std::mutex> lock(this->pMutex);
+    this->pWorkers->Receive(this, _srcAddress, _dstAddress, _dstPort, _data);
+    return;
+  }
+
 #ifndef SWARM_PYTHON_API
   gzerr << "Swarm was built without Python API support; "
     "can't call Python OnDataReceivedPython for robot " <<
     this->address << std::endl;
-  return false;
 #else
   if(!this->pInitialized)
     return;
@@ -221,22 +312,122 @@ bool RobotPlugin::SendTo(const std::string &_data,
     return false;
   }
 
-  msgs::Datagram msg;
-  msg.set_src_address(this->Host());
-  msg.set_dst_address(_dstAddress);
-  msg.set_dst_port(_port);
-  msg.set_data(_data);
+  // The message is taken once from the pool, and shared by the broker
+  // queue and all the recipients.
+  auto msg = msgs::NewDatagram();
+  msg->set_src_address(this->Host());
+  msg->set_dst_address(_dstAddress);
+  msg->set_dst_port(_port);
+  msg->set_data(_data);
+
+  // Endpoints are interned when they are bound. Messages to the endpoints
+  // that nobody has bound yet are resolved by the broker.
+  EndPointId dstEndPoint;
+  if (this->broker->Find(_dstAddress, _port, dstEndPoint))
+    msg->set_dst_endpoint(dstEndPoint);
+
+  // The messages of a replayed controller are compared with the log
+  // instead of sent.
+  if (this->recordReplay || this->replayLog)
+    this->replaySent.push_back(msg);
+  if (this->replayLog)
+    return true;
+
+  // Controllers running on the pool of threads queue their messages, and
+  // the executor pushes them in address order.
+  if (this->deferEffects)
+  {
+    this->deferredMsgs.push_back(std::move(msg));
+    return true;
+  }
 
   // The neighbors list will be included in the broker.
-  this->broker->Push(msg);
+  this->broker->Push(std::move(msg));
+
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool RobotPlugin::SendFound(const ignition::math::Vector3d &_pos,
+    const double _time)
+{
+  return this->SendTo(
+      EncodeFoundReport(_pos.X(), _pos.Y(), _pos.Z(), _time), this->kBoo,
+      this->kBooPort);
+}
+
+//////////////////////////////////////////////////
+bool RobotPlugin::SendBatch(const std::vector<OutgoingMessage> &_msgs)
+{
+  // Restrict the maximum size of the messages, before sending any.
+  for (auto const &outgoing : _msgs)
+  {
+    if (!outgoing.data || outgoing.data->size() > this->kMtu)
+    {
+      gzerr << "[" << this->Host() << "] RobotPlugin::SendBatch() error: "
+            << "Payload size (" << (outgoing.data ? outgoing.data->size() : 0)
+            << ") is greater than the maximum allowed (" << this->kMtu
+            << ") or missing" << std::endl;
+      return false;
+    }
+  }
+
+  this->outgoingBatch.clear();
+  const std::string host = this->Host();
+  for (auto const &outgoing : _msgs)
+  {
+    auto msg = msgs::NewDatagram();
+    msg->set_src_address(host);
+    msg->set_dst_address(outgoing.dstAddress);
+    msg->set_dst_port(outgoing.port);
+    msg->set_data(*outgoing.data);
+
+    EndPointId dstEndPoint;
+    if (this->broker->Find(outgoing.dstAddress, outgoing.port, dstEndPoint))
+      msg->set_dst_endpoint(dstEndPoint);
+
+    this->outgoingBatch.push_back(std::move(msg));
+  }
+
+  // The messages of a replayed controller are compared with the log, as in
+  // SendTo().
+  if (this->recordReplay || this->replayLog)
+  {
+    this->replaySent.insert(this->replaySent.end(),
+        this->outgoingBatch.begin(), this->outgoingBatch.end());
+  }
+
+  if (!this->replayLog && this->deferEffects)
+  {
+    for (auto &msg : this->outgoingBatch)
+      this->deferredMsgs.push_back(std::move(msg));
+  }
+  else if (!this->replayLog)
+    this->broker->Push(this->outgoingBatch);
+  this->outgoingBatch.clear();
 
   return true;
 }
 
+//////////////////////////////////////////////////
+void RobotPlugin::ApplyDeferredEffects()
+{
+  for (auto &msg : this->deferredMsgs)
+    this->broker->Push(std::move(msg));
+  this->deferredMsgs.clear();
+
+  if (this->deferredCamera)
+  {
+    this->deferredCamera = false;
+    this->SetCameraOrientation(this->deferredPitch, this->deferredYaw);
+  }
+}
+
 //////////////////////////////////////////////////
 bool RobotPlugin::SetLinearVelocity(const ignition::math::Vector3d &_velocity)
 {
-  if (this->capacity <= 0 || (this->type == ROTOR && this->rotorDocked))
+  if (this->BatteryCapacity() <= 0 ||
+      (this->type == ROTOR && this->rotorDocked))
     return false;
 
   this->targetLinVel = _velocity;
@@ -254,7 +445,8 @@ bool RobotPlugin::SetLinearVelocity(const double _x, const double _y,
 //////////////////////////////////////////////////
 bool RobotPlugin::SetAngularVelocity(const ignition::math::Vector3d &_velocity)
 {
-  if (this->capacity <= 0 || (this->type == ROTOR && this->rotorDocked))
+  if (this->BatteryCapacity() <= 0 ||
+      (this->type == ROTOR && this->rotorDocked))
     return false;
 
   this->targetAngVel = _velocity;
@@ -271,21 +463,75 @@ bool RobotPlugin::SetAngularVelocity(const double _x, const double _y,
 //////////////////////////////////////////////////
 void RobotPlugin::UpdateSensors()
 {
-  gazebo::common::Time curTime = this->world->GetSimTime();
-  auto dt = (curTime - this->lastSensorUpdateTime).Double();
-  if (dt < 0)
+  this->sensorTime = this->world->GetSimTime();
+  this->sensorIterations = this->world->GetIterations();
+
+  // The noise of each robot and step is drawn from its own streams, so it
+  // doesn't depend on the thread or the order of the robots.
+  const uint64_t seed = ignition::math::Rand::Seed();
+  this->sensorNoise =
+    RandomStream(seed, RandomStream::SENSORS, this->randomKey);
+  this->cameraNoise =
+    RandomStream(seed, RandomStream::CAMERA, this->randomKey);
+
+  // The velocities decide whether the battery recharges, so they're read
+  // even when the IMU isn't.
+  if (this->imu)
   {
-    // Probably we had a reset.
-    this->lastSensorUpdateTime = curTime;
-    return;
+    this->linearVelocityNoNoise = this->model->GetRelativeLinearVel().Ign();
+    this->angularVelocityNoNoise = this->model->GetRelativeAngularVel().Ign();
   }
 
-  // Update based on sensorsUpdateRate.
-  if (dt < (1.0 / this->sensorsUpdateRate))
+  this->pendingSensors = ALL_SENSORS;
+  if (!this->lazySensors)
+  {
+    this->Sense(ALL_SENSORS);
     return;
+  }
+
+  // The camera index is shared, so the parallel controllers find it
+  // captured.
+  if (this->camera && this->cameraIndex && this->parallelController)
+    this->cameraIndex->Capture(this->sensorTime);
+}
+
+//////////////////////////////////////////////////
+void RobotPlugin::Sense(const uint8_t _sensors)
+{
+  const uint8_t due = this->pendingSensors & _sensors;
+  this->pendingSensors &= ~due;
+
+  if (due & GPS_SENSOR)
+    this->SenseGps();
+  if (due & IMU_SENSOR)
+    this->SenseImu();
+  if (due & BEARING_SENSOR)
+    this->SenseBearing((due & IMU_SENSOR) != 0);
+  if (due & CAMERA_SENSOR)
+    this->SenseCamera();
+}
+
+//////////////////////////////////////////////////
+void RobotPlugin::SettleSensors()
+{
+  if (this->pendingSensors & this->usedSensors)
+    this->Sense(this->usedSensors);
+}
 
-  this->lastSensorUpdateTime = curTime;
+//////////////////////////////////////////////////
+void RobotPlugin::Observe(const uint8_t _sensors) const
+{
+  this->usedSensors |= _sensors;
 
+  // The observations belong to the sensor update of the period, they're
+  // only computed late.
+  if (this->pendingSensors & _sensors)
+    const_cast<RobotPlugin *>(this)->Sense(_sensors);
+}
+
+//////////////////////////////////////////////////
+void RobotPlugin::SenseGps()
+{
   if (this->gps)
   {
     this->observedLatitude = this->gps->Latitude().Degree();
@@ -296,26 +542,43 @@ void RobotPlugin::UpdateSensors()
     this->observedAltitude = this->gps->GetAltitude();
 #endif
   }
+}
 
+//////////////////////////////////////////////////
+void RobotPlugin::SenseImu()
+{
   if (this->imu)
   {
-    this->linearVelocityNoNoise = this->model->GetRelativeLinearVel().Ign();
-    this->angularVelocityNoNoise = this->model->GetRelativeAngularVel().Ign();
-
+    this->sensorNoise.Seek(this->sensorIterations);
+    double noise[3];
+    this->sensorNoise.Normal(3, 0, 0.0002, noise);
     this->observedlinVel = this->linearVelocityNoNoise +
-      ignition::math::Vector3d(
-          ignition::math::Rand::DblNormal(0, 0.0002),
-          ignition::math::Rand::DblNormal(0, 0.0002),
-          ignition::math::Rand::DblNormal(0, 0.0002));
+      ignition::math::Vector3d(noise[0], noise[1], noise[2]);
 
     this->observedAngVel = this->imu->AngularVelocity();
     this->observedOrient = this->imu->Orientation();
   }
+}
+
+//////////////////////////////////////////////////
+void RobotPlugin::SenseBearing(const bool _afterImu)
+{
+  // The compass draws its noise after the IMU, whichever is computed
+  // first.
+  if (!_afterImu)
+  {
+    this->sensorNoise.Seek(this->sensorIterations);
+    if (this->imu)
+    {
+      double noise[3];
+      this->sensorNoise.Normal(3, 0, 0.0002, noise);
+    }
+  }
 
   // Get the Yaw angle of the model in Gazebo world coordinates.
   this->observedBearing = ignition::math::Angle(
-      this->model->GetWorldPose().rot.GetAsEuler().z +
-      ignition::math::Rand::DblNormal(0, 0.035));
+      this->WorldPose(this->model, this->poseId).Rot().Euler().Z() +
+      this->sensorNoise.Normal(0, 0.035));
 
   // A "0" bearing value means that the model is facing North.
   // North is aligned with the Gazebo Y axis, so we should add an offset of
@@ -326,64 +589,171 @@ void RobotPlugin::UpdateSensors()
   // to use 0,2*PI.
   if (this->observedBearing.Radian() < 0)
     this->observedBearing = ignition::math::Angle::TwoPi +this->observedBearing;
+}
 
-  // Update camera.
-  this->img.objects.clear();
-  if (this->camera)
+//////////////////////////////////////////////////
+void RobotPlugin::SenseCamera()
+{
+  this->detections.clear();
+  if (!this->camera)
+    return;
+
+  this->cameraNoise.Seek(this->sensorIterations);
+  if (this->cameraIndex)
+  {
+    this->cameraIndex->Capture(this->world->GetSimTime());
+    this->cameraIndex->Observe(
+        this->camera->Pose() + this->cameraParent->GetWorldPose().Ign(),
+        this->camera->Near(), this->camera->Far(),
+        this->camera->HorizontalFOV(), this->camera->AspectRatio(),
+        this->modelId, this->cameraObjects);
+  }
+  else
   {
-    ignition::math::Pose3d myPose = this->model->GetWorldPose().Ign();
     gazebo::msgs::LogicalCameraImage logicalImg = this->camera->Image();
-
-    // Process each object, and add noise
-    for (auto const imgModel : logicalImg.model())
+    this->cameraObjects.clear();
+    for (auto const &imgModel : logicalImg.model())
     {
       // Skip ground plane model
       if (imgModel.name() == "ground_plane")
         continue;
 
-      // Pose of the detected model
-      ignition::math::Pose3d p = gazebo::msgs::ConvertIgn(imgModel.pose());
+      this->cameraObjects.push_back(CameraObject(
+            this->CameraModelId(imgModel.name()),
+            gazebo::msgs::ConvertIgn(imgModel.pose())));
+    }
+  }
+
+  // Process each object, and add noise
+  for (auto const &object : this->cameraObjects)
+  {
+    // Pose of the detected model
+    ignition::math::Pose3d p = object.second;
 
-      // Distance to the detected model
-      double dist = p.Pos().Length();
+    // Distance to the detected model
+    double dist = p.Pos().Length();
 
-      // Normalized (to the camera's frustum) squared distance
-      double distSquaredNormalized = std::pow(dist, 2) /
-        std::pow(this->camera->Far(), 2);
+    // Normalized (to the camera's frustum) squared distance
+    double distSquaredNormalized = std::pow(dist, 2) /
+      std::pow(this->camera->Far(), 2);
 
-      // A percentage of the time we get a false negative
-      if (ignition::math::Rand::DblUniform(
-            this->cameraFalseNegativeProbMin,
-            this->cameraFalseNegativeProbMax) < distSquaredNormalized)
-      {
-        continue;
-      }
+    // A percentage of the time we get a false negative
+    if (this->cameraNoise.Uniform(
+          this->cameraFalseNegativeProbMin,
+          this->cameraFalseNegativeProbMax) < distSquaredNormalized)
+    {
+      continue;
+    }
+
+    // Compute amount of possible position noise.
+    double posError = this->cameraMaxPositionError * distSquaredNormalized;
+
+    // Add noise to the position of the model.
+    double noise[3];
+    this->cameraNoise.Uniform(3, -posError, posError, noise);
+    p.Pos().X() += noise[0];
+    p.Pos().Y() += noise[1];
+    p.Pos().Z() += noise[2];
+
+    // Handle false positives.
+    this->UpdateFalsePositives(object.first, p, distSquaredNormalized,
+        this->sensorTime);
+  }
+}
+
+//////////////////////////////////////////////////
+void RobotPlugin::RecordStep()
+{
+  this->replayStepTime = this->world->GetSimTime().Double();
+
+  // The messages delivered before a step are claimed by it, whether the
+  // broker delivers them before or after the executor in each step. So are
+  // the replies of the callbacks, sent since the previous step.
+  this->replayDelivered.insert(this->replayDelivered.end(),
+      this->replayPending.begin(), this->replayPending.end());
+  this->replayPending.clear();
+
+  if (this->replayNeighborsVersion != this->neighborsVersion)
+  {
+    this->replayNeighbors = this->neighbors;
+    this->replayNeighborsVersion = this->neighborsVersion;
+  }
+}
+
+//////////////////////////////////////////////////
+void RobotPlugin::ReplayStep()
+{
+  const msgs::LogEntry *entry = this->replayLog->Find(this->Host(),
+      this->world->GetSimTime().Double());
+
+  // Deliver the messages of the step first, so the replies of the
+  // callbacks count in the previous step, as in the log.
+  if (entry)
+  {
+    for (auto const &datagram : entry->delivered())
+    {
+      auto index = this->callbackIndices.find(datagram.dst_address() + ":" +
+          std::to_string(datagram.dst_port()));
+      this->OnMsgReceived(msgs::NewDatagram(datagram),
+          index != this->callbackIndices.end() ?
+          index->second : this->callbacks.size());
+    }
+  }
 
-      // Compute amount of possible position noise.
-      double posError = this->cameraMaxPositionError * distSquaredNormalized;
+  // Compare the previous step before the executor clears the velocities.
+  if (this->replayEntry)
+  {
+    this->replayLog->Check(*this->replayEntry, this->targetLinVel,
+        this->targetAngVel, this->replaySent);
+  }
+  this->replaySent.clear();
+  this->replayEntry = entry;
 
-      // Add noise to the position of the model.
-      p.Pos().X() += ignition::math::Rand::DblUniform(-posError, posError);
-      p.Pos().Y() += ignition::math::Rand::DblUniform(-posError, posError);
-      p.Pos().Z() += ignition::math::Rand::DblUniform(-posError, posError);
+  if (!entry)
+    return;
 
-      // Handle false positives.
-      this->UpdateFalsePositives(imgModel.name(), p, distSquaredNormalized,
-          curTime);
+  if (entry->has_sensors())
+  {
+    const msgs::Sensors &sensors = entry->sensors();
+    this->observedLatitude = sensors.gps().latitude();
+    this->observedLongitude = sensors.gps().longitude();
+    this->observedAltitude = sensors.gps().altitude();
+    this->observedlinVel = gazebo::msgs::ConvertIgn(sensors.imu().linvel());
+    this->observedAngVel = gazebo::msgs::ConvertIgn(sensors.imu().angvel());
+    this->observedOrient =
+      gazebo::msgs::ConvertIgn(sensors.imu().orientation());
+    this->observedBearing = ignition::math::Angle(sensors.bearing());
+    this->pendingSensors = 0;
+
+    this->detections.clear();
+    for (auto const &obj : sensors.image().object())
+    {
+      this->detections.push_back(CameraObject(
+            this->CameraModelId(obj.name()),
+            gazebo::msgs::ConvertIgn(obj.pose())));
     }
   }
+
+  // The neighbors only change when the broker would notify them.
+  if (static_cast<int>(this->neighbors.size()) != entry->neighbor_size() ||
+      !std::equal(this->neighbors.begin(), this->neighbors.end(),
+        entry->neighbor().begin()))
+  {
+    this->OnNeighborsReceived(std::vector<std::string>(
+          entry->neighbor().begin(), entry->neighbor().end()));
+  }
 }
 
 //////////////////////////////////////////////////
 void RobotPlugin::UpdateLinearVelocity()
 {
-  if (this->capacity <= 0 || (this->type == ROTOR && this->rotorDocked) ||
-      this->type == BOO)
+  if (this->BatteryCapacity() <= 0 ||
+      (this->type == ROTOR && this->rotorDocked) || this->type == BOO)
   {
     return;
   }
 
-  auto myPose = this->model->GetWorldPose().Ign();
+  auto myPose = this->WorldPose(this->model, this->poseId);
 
   ignition::math::Vector3d linearVel;
   double limitFactor = 1.0;
@@ -440,8 +810,8 @@ void RobotPlugin::UpdateLinearVelocity()
 //////////////////////////////////////////////////
 void RobotPlugin::UpdateAngularVelocity()
 {
-  if (this->capacity <= 0 || (this->type == ROTOR && this->rotorDocked) ||
-      this->type == BOO)
+  if (this->BatteryCapacity() <= 0 ||
+      (this->type == ROTOR && this->rotorDocked) || this->type == BOO)
   {
     return;
   }
@@ -476,10 +846,12 @@ void RobotPlugin::UpdateAngularVelocity()
         double yawRate = 0.0;
 
         // Current orientation as Euler angles
+        this->Observe(IMU_SENSOR);
         ignition::math::Vector3d rpy = this->observedOrient.Euler();
 
         // Current pose
-        ignition::math::Pose3d pose = this->model->GetWorldPose().Ign();
+        ignition::math::Pose3d pose =
+          this->WorldPose(this->model, this->poseId);
 
         // don't allow pitch or roll larger than 40 degrees, enforce by
         // clamping rate (this is not clamping the angles -- it is zeroing the
@@ -523,10 +895,40 @@ void RobotPlugin::UpdateAngularVelocity()
   };
 }
 
+//////////////////////////////////////////////////
+void RobotPlugin::IntegratePose()
+{
+  const ignition::math::Vector3d linVel =
+    this->model->GetWorldLinearVel().Ign();
+  const ignition::math::Vector3d angVel =
+    this->model->GetWorldAngularVel().Ign();
+  if (linVel == ignition::math::Vector3d::Zero &&
+      angVel == ignition::math::Vector3d::Zero)
+  {
+    return;
+  }
+
+  // The fixed wings set their orientation in UpdateAngularVelocity(), so
+  // the pose is read from the model instead of the snapshot.
+  ignition::math::Pose3d pose = this->model->GetWorldPose().Ign();
+  pose.Pos() += linVel * this->maxStepSize;
+
+  const double angle = angVel.Length() * this->maxStepSize;
+  if (angle > 0)
+  {
+    pose.Rot() = ignition::math::Quaterniond(angVel.Normalized(), angle) *
+      pose.Rot();
+    pose.Rot().Normalize();
+  }
+
+  this->model->SetWorldPose(pose);
+}
+
 //////////////////////////////////////////////////
 bool RobotPlugin::Imu(ignition::math::Vector3d &_linVel,
   ignition::math::Vector3d &_angVel, ignition::math::Quaterniond &_orient) const
 {
+  this->Observe(IMU_SENSOR);
   _linVel = this->observedlinVel;
   _angVel = this->observedAngVel;
   _orient = this->observedOrient;
@@ -536,6 +938,7 @@ bool RobotPlugin::Imu(ignition::math::Vector3d &_linVel,
 //////////////////////////////////////////////////
 bool RobotPlugin::Bearing(ignition::math::Angle &_bearing) const
 {
+  this->Observe(BEARING_SENSOR);
   _bearing = this->observedBearing;
   return true;
 }
@@ -549,7 +952,7 @@ bool RobotPlugin::BooPose(double &_latitude, double &_longitude) const
   // Convert gazebo pose to lat/lon
   ignition::math::Vector3d spherical =
     this->world->GetSphericalCoordinates()->SphericalFromLocal(
-        this->boo->GetWorldPose().Ign().Pos());
+        this->WorldPose(this->boo, this->booPoseId).Pos());
 
   _latitude = spherical.X();
   _longitude = spherical.Y();
@@ -569,6 +972,7 @@ bool RobotPlugin::Pose(double &_latitude,
     return false;
   }
 
+  this->Observe(GPS_SENSOR);
   _latitude = this->observedLatitude;
   _longitude = this->observedLongitude;
   _altitude = this->observedAltitude;
@@ -585,7 +989,10 @@ bool RobotPlugin::Image(ImageData &_img) const
     return false;
   }
 
-  _img = this->img;
+  this->Observe(CAMERA_SENSOR);
+  _img.objects.clear();
+  for (auto const &detection : this->detections)
+    _img.objects[this->CameraModelName(detection.first)] = detection.second;
 
   return true;
 }
@@ -609,6 +1016,13 @@ bool RobotPlugin::MapQuery(const double _lat, const double _lon,
   return this->common.MapQuery(_lat, _lon, _height, _type);
 }
 
+//////////////////////////////////////////////////
+size_t RobotPlugin::MapQuery(const size_t _count, const double *_lat,
+    const double *_lon, double *_height, TerrainType *_type, bool *_valid)
+{
+  return this->common.MapQuery(_count, _lat, _lon, _height, _type, _valid);
+}
+
 //////////////////////////////////////////////////
 std::string RobotPlugin::Host() const
 {
@@ -621,6 +1035,127 @@ std::vector<std::string> RobotPlugin::Neighbors() const
   return this->neighbors;
 }
 
+//////////////////////////////////////////////////
+const std::vector<std::string> &RobotPlugin::NeighborsView() const
+{
+  return this->neighbors;
+}
+
+//////////////////////////////////////////////////
+uint64_t RobotPlugin::NeighborsVersion() const
+{
+  return this->neighborsVersion;
+}
+
+//////////////////////////////////////////////////
+std::vector<RobotPlugin::NearbyNeighbor> RobotPlugin::NearbyNeighbors(
+    const double _radius) const
+{
+  return this->ClosestNeighbors(_radius, this->neighbors.size());
+}
+
+//////////////////////////////////////////////////
+std::vector<RobotPlugin::NearbyNeighbor> RobotPlugin::KNearestNeighbors(
+    const unsigned int _k) const
+{
+  return this->ClosestNeighbors(std::numeric_limits<double>::infinity(), _k);
+}
+
+//////////////////////////////////////////////////
+void RobotPlugin::WaitForMessage(const int _port)
+{
+  if (this->executor)
+    this->executor->Wait(this->executorSlot, WAKE_MESSAGE, _port, 0);
+}
+
+//////////////////////////////////////////////////
+void RobotPlugin::WaitUntil(const double _simTime)
+{
+  if (this->executor)
+    this->executor->Wait(this->executorSlot, WAKE_TIME, -1, _simTime);
+}
+
+//////////////////////////////////////////////////
+void RobotPlugin::WaitForNeighbors()
+{
+  if (this->executor)
+    this->executor->Wait(this->executorSlot, WAKE_NEIGHBORS, -1, 0);
+}
+
+//////////////////////////////////////////////////
+void RobotPlugin::WaitForSensors()
+{
+  if (this->executor)
+    this->executor->Wait(this->executorSlot, WAKE_SENSORS, -1, 0);
+}
+
+//////////////////////////////////////////////////
+unsigned int RobotPlugin::WokenBy() const
+{
+  if (!this->executor)
+    return 0;
+  return this->executor->WokenBy(this->executorSlot);
+}
+
+//////////////////////////////////////////////////
+std::vector<RobotPlugin::NearbyNeighbor> RobotPlugin::ClosestNeighbors(
+    const double _radius, const size_t _k) const
+{
+  std::vector<NearbyNeighbor> result;
+  const std::vector<ignition::math::Vector3d> &positions =
+    this->broker->Positions();
+  if (positions.empty() || this->neighbors.empty() || _k == 0)
+    return result;
+
+  // The neighbors are looked up in the broker once per list.
+  if (this->neighborMembersVersion != this->neighborsVersion ||
+      this->brokerMembersVersion != this->broker->MembersVersion() ||
+      this->neighborMembers.size() != this->neighbors.size())
+  {
+    this->neighborMembers.resize(this->neighbors.size());
+    for (size_t i = 0; i < this->neighbors.size(); ++i)
+      this->neighborMembers[i] = this->broker->MemberIndex(this->neighbors[i]);
+    this->neighborMembersVersion = this->neighborsVersion;
+    this->brokerMembersVersion = this->broker->MembersVersion();
+  }
+
+  // The neighbors are a subset of the broadphase candidates of the robot,
+  // so only they are measured.
+  const ignition::math::Vector3d myPos =
+    this->WorldPose(this->model, this->poseId).Pos();
+  std::vector<std::pair<double, size_t>> inRange;
+  inRange.reserve(this->neighbors.size());
+  for (size_t i = 0; i < this->neighbors.size(); ++i)
+  {
+    const int member = this->neighborMembers[i];
+    if (member < 0 || static_cast<size_t>(member) >= positions.size())
+      continue;
+
+    const double distance = myPos.Distance(positions[member]);
+    if (distance <= _radius)
+      inRange.emplace_back(distance, i);
+  }
+
+  const size_t count = std::min(_k, inRange.size());
+  std::partial_sort(inRange.begin(), inRange.begin() + count, inRange.end());
+
+  result.resize(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    const size_t neighbor = inRange[i].second;
+    const ignition::math::Vector3d spherical =
+      this->world->GetSphericalCoordinates()->SphericalFromLocal(
+          positions[this->neighborMembers[neighbor]]);
+    result[i].address = this->neighbors[neighbor];
+    result[i].latitude = spherical.X();
+    result[i].longitude = spherical.Y();
+    result[i].altitude = spherical.Z();
+    result[i].distance = inRange[i].first;
+  }
+
+  return result;
+}
+
 //////////////////////////////////////////////////
 void RobotPlugin::Update(const gazebo::common::UpdateInfo & /*_info*/)
 {
@@ -654,7 +1189,8 @@ bool RobotPlugin::Dock(const std::string &_vehicle)
     return false;
   }
 
-  if (m->GetWorldPose().pos.Distance(this->model->GetWorldPose().pos) <=
+  if (m->GetWorldPose().Ign().Pos().Distance(
+        this->WorldPose(this->model, this->poseId).Pos()) <=
       this->rotorDockingDistance)
   {
     this->SetLinearVelocity(0, 0, 0);
@@ -676,74 +1212,68 @@ bool RobotPlugin::IsDocked() const {
 }
 
 //////////////////////////////////////////////////
-void RobotPlugin::UpdateTerrainType()
+bool RobotPlugin::Restless() const
 {
-  gazebo::common::Time curTime = this->world->GetSimTime();
-  double dt = (curTime - this->lastTerrainUpdateTime).Double();
-  if (dt < 0)
-  {
-    // Probably we had a reset.
-    this->lastTerrainUpdateTime = curTime;
-    return;
-  }
-
-  // Update based on sensorsUpdateRate.
-  if (dt < (1.0 / this->terrainUpdateRate))
-  {
-    return;
-  }
-
-  this->lastTerrainUpdateTime = curTime;
+  if (this->type == ROTOR && this->rotorDocked)
+    return true;
 
-  // Get current terrain type
-  this->terrainType = this->common.TerrainAtPos(
-      this->model->GetWorldPose().pos.Ign());
+  return this->BatteryCapacity() > 0 &&
+    (this->targetLinVel != ignition::math::Vector3d::Zero ||
+     this->targetAngVel != ignition::math::Vector3d::Zero);
 }
 
 //////////////////////////////////////////////////
-void RobotPlugin::Loop(const gazebo::common::UpdateInfo &_info)
+void RobotPlugin::UpdateTerrainType()
 {
-  // Update the terrain type.
-  this->UpdateTerrainType();
-
   // Get current terrain type
   this->terrainType = this->common.TerrainAtPos(
-      this->model->GetWorldPose().pos.Ign());
-
-  // Update the state of the battery
-  this->UpdateBattery();
+      this->WorldPose(this->model, this->poseId).Pos());
+}
 
-  // Only update sensors if we have enough juice
-  if (this->capacity > 0)
+//////////////////////////////////////////////////
+void RobotPlugin::UpdatePoseIds()
+{
+  // Find our id and the id of the BOO when the snapshot has them.
+  if (this->posesVersion != this->poses->Version())
   {
-    this->UpdateSensors();
-    this->SetLinearVelocity(0, 0, 0);
-    this->SetAngularVelocity(0, 0, 0);
+    // The ids change when the swarm changes, e.g. when the robots of
+    // another partition join it.
+    this->posesVersion = this->poses->Version();
+    this->poseId = -1;
+    this->booPoseId = -1;
+    this->dockPoseId = -1;
   }
+  if (this->poseId < 0)
+    this->poseId = this->poses->Id(this->model->GetName());
+  if (this->boo && this->booPoseId < 0)
+    this->booPoseId = this->poses->Id(this->boo->GetName());
 
-  // Check whether give the team controller an update.
-  gazebo::common::Time curTime = this->world->GetSimTime();
-  auto dt = (curTime - this->lastControllerUpdateTime).Double();
-  if (dt < 0)
-  {
-    // Probably we had a reset.
-    this->lastControllerUpdateTime = curTime;
+  if (this->poseId < 0)
     return;
-  }
 
-  // Update based on controllerUpdateRate.
-  if (dt >= (1.0 / this->controllerUpdateRate))
+  // A docked rotor is an alias of its carrier in the snapshot, so the comms
+  // model reuses the links of the carrier.
+  const bool docked = this->type == ROTOR && this->rotorDocked &&
+    this->rotorDockVehicle;
+  if (docked && (this->dockPoseId < 0 ||
+        this->dockPoseModel != this->rotorDockVehicle))
   {
-    this->lastControllerUpdateTime = curTime;
-    this->Update(_info);
+    this->dockPoseModel = this->rotorDockVehicle;
+    this->dockPoseId = this->poses->Id(this->rotorDockVehicle->GetName());
   }
+  const int carrier = docked ? this->dockPoseId : -1;
+  if (this->poses->Carrier(this->poseId) != carrier)
+    this->poses->SetCarrier(this->poseId, carrier);
+}
 
-  // Apply the controller's actions to the simulation.
-  this->UpdateLinearVelocity();
-  this->UpdateAngularVelocity();
+//////////////////////////////////////////////////
+ignition::math::Pose3d RobotPlugin::WorldPose(
+    const gazebo::physics::ModelPtr &_model, const int _id) const
+{
+  if (_id >= 0 && this->poses->Captured(this->world->GetSimTime()))
+    return this->poses->Pose(_id);
 
-  // Adjust pose as necessary.
-  this->AdjustPose();
+  return _model->GetWorldPose().Ign();
 }
 
 //////////////////////////////////////////////////
@@ -752,8 +1282,26 @@ void RobotPlugin::AdjustPose()
   if (!this->common.Terrain() || !this->model)
     return;
 
-  // Get the pose of the vehicle
-  ignition::math::Pose3d pose = this->model->GetWorldPose().Ign();
+  // A docked rotor follows its carrier, without looking up the terrain.
+  if (this->type == ROTOR && this->rotorDocked)
+  {
+    this->model->SetWorldPose(this->rotorDockVehicle->GetWorldPose());
+    return;
+  }
+
+  ignition::math::Pose3d pose;
+  if (this->ConstrainPose(pose))
+    this->model->SetWorldPose(pose);
+}
+
+//////////////////////////////////////////////////
+bool RobotPlugin::ConstrainPose(ignition::math::Pose3d &_pose)
+{
+  // Get the pose of the vehicle. In kinematic mode it was integrated
+  // during this step, after the snapshot.
+  const ignition::math::Pose3d current = this->WorldPose(this->model,
+      this->kinematic ? -1 : this->poseId);
+  ignition::math::Pose3d pose = current;
 
   // Constrain X position to the terrain boundaries
   pose.Pos().X(ignition::math::clamp(pose.Pos().X(),
@@ -769,6 +1317,10 @@ void RobotPlugin::AdjustPose()
   ignition::math::Vector3d terrainPos;
   this->common.TerrainLookup(pose.Pos(), terrainPos, norm);
 
+  // Page in the terrain ahead of the vehicle before it gets there.
+  this->common.PrefetchTerrain(pose.Pos(),
+      this->model->GetWorldLinearVel().Ign());
+
   // Constrain each type of robot
   switch (this->Type())
   {
@@ -796,41 +1348,26 @@ void RobotPlugin::AdjustPose()
         // Add half the height of the vehicle
         pose.Pos().Z(terrainPos.Z() + this->modelHeight2);
         pose.Rot().Euler(roll, pitch, pose.Rot().Euler().Z());
-
-        // Set the pose.
-        this->model->SetRelativePose(pose);
         break;
       }
     case ROTOR:
       {
-        if (!this->rotorDocked)
-        {
-          if (pose.Pos().Z() < terrainPos.Z() + this->modelHeight2)
-          {
-            pose.Pos().Z(terrainPos.Z() + this->modelHeight2);
-
-            // Set the pose.
-            this->model->SetWorldPose(pose);
-          }
-        }
-        else
-        {
-          this->model->SetWorldPose(this->rotorDockVehicle->GetWorldPose());
-        }
+        if (pose.Pos().Z() < terrainPos.Z() + this->modelHeight2)
+          pose.Pos().Z(terrainPos.Z() + this->modelHeight2);
         break;
       }
     case FIXED_WING:
       {
         if (pose.Pos().Z() < terrainPos.Z() + this->modelHeight2)
-        {
           pose.Pos().Z(terrainPos.Z() + this->modelHeight2);
-
-          // Set the pose.
-          this->model->SetWorldPose(pose);
-        }
         break;
       }
   };
+
+  // The poses left as they are aren't set, so gazebo doesn't propagate
+  // them.
+  _pose = pose;
+  return !PoseSnapshot::Same(pose, current);
 }
 
 //////////////////////////////////////////////////
@@ -849,7 +1386,17 @@ void RobotPlugin::Load(gazebo::physics::ModelPtr _model,
 
   // We assume that the physics step size will not change during simulation.
   this->world = this->model->GetWorld();
+  // The models and the terrain come from the index of the world, shared
+  // by all the robots.
   this->common.SetWorld(this->world);
+  this->scene = this->common.Scene();
+
+  // Each world has its own broker, logger and poses.
+  this->broker = Broker::Instance(this->world->GetName());
+  this->logger = Logger::Instance(this->world->GetName());
+  this->checkpointer = Checkpointer::Instance(this->world->GetName());
+  this->memory = MemoryAccounting::Instance(this->world->GetName());
+  this->poses = PoseSnapshot::Instance(this->world->GetName());
   this->maxStepSize = this->world->GetPhysicsEngine()->GetMaxStepSize();
 
   // We assume the BOO is named "boo".
@@ -860,18 +1407,6 @@ void RobotPlugin::Load(gazebo::physics::ModelPtr _model,
     gzwarn << "No base of operations (BOO) found.\n";
   }
 
-  // Get the terrain, if it's present
-  gazebo::physics::ModelPtr terrainModel =
-    this->model->GetWorld()->GetModel("terrain");
-
-  // Load some info about the terrain.
-  if (terrainModel)
-  {
-    this->common.SetTerrain(
-        boost::dynamic_pointer_cast<gazebo::physics::HeightmapShape>(
-          terrainModel->GetLink()->GetCollision("collision")->GetShape()));
-  }
-
 
   // Load battery information
   if (_sdf->HasElement("battery"))
@@ -911,10 +1446,77 @@ void RobotPlugin::Load(gazebo::physics::ModelPtr _model,
   if (_sdf->HasElement("controller_update_rate"))
     this->controllerUpdateRate = _sdf->Get<float>("controller_update_rate");
 
+  // Opt-in to run the controller on the pool of threads of the executor.
+  if (_sdf->HasElement("parallel_controller"))
+    this->parallelController = _sdf->Get<bool>("parallel_controller");
+
+  // Opt-in to compute the observations on first access.
+  if (_sdf->HasElement("lazy_sensors"))
+    this->lazySensors = _sdf->Get<bool>("lazy_sensors");
+
+  // Maximum number of controller updates of the swarm in a step.
+  if (_sdf->HasElement("controller_budget"))
+    this->controllerBudget = _sdf->Get<unsigned int>("controller_budget");
+
+  // Wall time allowed to each update of the controller, and what happens
+  // when it's exceeded. The BOO isn't metered.
+  if (_sdf->HasElement("controller_time_budget"))
+  {
+    this->controllerTimeBudget =
+      std::max(0.0, _sdf->Get<double>("controller_time_budget"));
+  }
+  const char *timeBudgetEnv = std::getenv("SWARM_CONTROLLER_TIME_BUDGET");
+  if (timeBudgetEnv && std::string(timeBudgetEnv) != "")
+    this->controllerTimeBudget = std::max(0.0, std::atof(timeBudgetEnv));
+  std::string overrunPolicy = "none";
+  if (_sdf->HasElement("controller_overrun_policy"))
+    overrunPolicy = _sdf->Get<std::string>("controller_overrun_policy");
+  const char *overrunPolicyEnv = std::getenv("SWARM_CONTROLLER_OVERRUN_POLICY");
+  if (overrunPolicyEnv && std::string(overrunPolicyEnv) != "")
+    overrunPolicy = overrunPolicyEnv;
+  if (!SwarmExecutor::ParseOverrunPolicy(overrunPolicy,
+        this->controllerOverrunPolicy))
+  {
+    gzerr << "Unknown controller overrun policy[" << overrunPolicy
+          << "], using none.\n";
+  }
+  if (_sdf->HasElement("controller_overrun_limit"))
+  {
+    this->controllerOverrunLimit = std::max(1u,
+        _sdf->Get<unsigned int>("controller_overrun_limit"));
+  }
+  if (this->type == BOO)
+  {
+    this->controllerTimeBudget = 0;
+    this->controllerOverrunPolicy = SwarmExecutor::OVERRUN_NONE;
+  }
+
+  // Integrate the pose instead of simulating the dynamics, if requested.
+  if (_sdf->HasElement("kinematic"))
+    this->kinematic = _sdf->Get<bool>("kinematic");
+  const char *kinematicEnv = std::getenv("SWARM_KINEMATIC");
+  if (kinematicEnv && std::string(kinematicEnv) == "1")
+    this->kinematic = true;
+  const char *replayEnv = std::getenv("SWARM_REPLAY");
+  if (replayEnv && std::string(replayEnv) != "")
+    this->kinematic = true;
+  if (this->type == BOO)
+    this->kinematic = false;
+
   // Collide with nothing
   for (auto &link : this->model->GetLinks())
+  {
     link->SetCollideMode("none");
 
+    // A disabled body keeps its velocities, but the physics engine doesn't
+    // integrate it.
+    if (this->kinematic)
+    {
+      link->SetGravityMode(false);
+      link->SetEnabled(false);
+    }
+  }
+
   // Read the robot address.
   if (!_sdf->HasElement("address"))
   {
@@ -923,6 +1525,25 @@ void RobotPlugin::Load(gazebo::physics::ModelPtr _model,
   }
 
   this->address = _sdf->Get<std::string>("address");
+  this->randomKey = RandomStream::MemberKey(this->address);
+
+  // Replay the controller from a log, if it has the entries of the robot.
+  if (replayEnv && std::string(replayEnv) != "" && this->type != BOO)
+  {
+    ReplayLog *replay = ReplayLog::Instance(this->world->GetName());
+    if (!replay->Load(replayEnv))
+    {
+      gzerr << "[" << this->address << "] Unable to replay the log ["
+            << replayEnv << "]\n";
+    }
+    else if (!replay->Has(this->address))
+    {
+      gzwarn << "[" << this->address << "] Not logged in [" << replayEnv
+             << "], the controller isn't replayed\n";
+    }
+    else
+      this->replayLog = replay;
+  }
 
   // We treat the BOO specially; it's a robot, but doesn't have any sensors.
   if (this->address != "boo")
@@ -955,6 +1576,17 @@ void RobotPlugin::Load(gazebo::physics::ModelPtr _model,
       gzwarn << "No camera sensor found on robot with address "
         << this->address << std::endl;
     }
+    else if (_sdf->HasElement("camera_backend") &&
+        _sdf->Get<std::string>("camera_backend") == "index")
+    {
+      // Test the frustum against the camera index of the world, and stop
+      // the sensor from testing every model of the world.
+      this->cameraParent = this->world->GetEntity(this->camera->ParentName());
+      if (!this->cameraParent)
+        this->cameraParent = this->model;
+      this->cameraIndex = CameraIndex::Instance(this->world);
+      this->camera->SetActive(false);
+    }
 
     // Get the gps sensor
     if (_sdf->HasElement("gps"))
@@ -999,6 +1631,17 @@ void RobotPlugin::Load(gazebo::physics::ModelPtr _model,
       gzwarn << "No IMU sensor found on robot with address "
         << this->address << std::endl;
     }
+
+    // The observations of a replayed robot come from the log.
+    if (this->replayLog)
+    {
+      if (this->camera)
+        this->camera->SetActive(false);
+      if (this->gps)
+        this->gps->SetActive(false);
+      if (this->imu)
+        this->imu->SetActive(false);
+    }
   }
 
   // Get the search area size, which is a child of the plugin
@@ -1062,12 +1705,21 @@ void RobotPlugin::Load(gazebo::physics::ModelPtr _model,
   // Register this plugin in the broker.
   this->broker->Register(this->Host(), this);
 
+  // Register this plugin in the checkpoints and the memory accounting.
+  this->checkpointer->Register(this->Host(), this);
+  this->memory->Register(this->Host(), this);
+
   // Register this plugin in the logger.
   char *robotLogEnableEnv = std::getenv("SWARM_ROBOT_LOG");
   if (this->type == BOO ||
       ((robotLogEnableEnv) && (std::string(robotLogEnableEnv) == "1")))
   {
     this->logger->Register(this->Host(), this);
+
+    // The BOO logs its own entries.
+    this->recordReplay = this->type != BOO && !this->replayLog &&
+      this->logger->Enabled() && !this->logger->Minimal() &&
+      this->logger->Replay();
   }
 
   // Call the Load() method from the derived plugin.
@@ -1081,17 +1733,9 @@ void RobotPlugin::Load(gazebo::physics::ModelPtr _model,
   // this->gzNode->Advertise<gazebo::msgs::Marker>("~/marker");
   // END DEBUG CODE
 
-  // Get all the model names, and add every name expect this->model to
-  // a list. This list is used to compute false positives in the image
-  // data
-  for (auto const &worldModel : this->world->GetModels())
-  {
-    if (worldModel->GetName() != this->model->GetName() &&
-        worldModel->GetName() != "ground_plane")
-    {
-      this->modelNames.push_back(worldModel->GetName());
-    }
-  }
+  // Every model of the index except this one can be a false positive in
+  // the image data.
+  this->modelId = this->scene->ModelId(this->model->GetName());
 
   gazebo::physics::ModelPtr lostPerson = this->world->GetModel("lost_person");
   if (lostPerson && this->boo)
@@ -1116,45 +1760,99 @@ void RobotPlugin::Load(gazebo::physics::ModelPtr _model,
     this->lostPersonInitDir *= 0.5;
   }
 
-  // Listen to the update event broadcasted every simulation iteration.
-  this->updateConnection = gazebo::event::Events::ConnectWorldUpdateBegin(
-      std::bind(&RobotPlugin::Loop, this, std::placeholders::_1));
-
   // Get starting camera pitch and yaw.
   this->CameraOrientation(this->cameraStartPitch, this->cameraStartYaw);
 
-  auto offset =
-    ignition::math::Rand::DblUniform(0, 1.0 / this->sensorsUpdateRate);
-  this->lastSensorUpdateTime = this->world->GetSimTime() - offset;
+  // The executor of the world steps this robot with the rest of the swarm
+  // every simulation iteration.
+  SwarmExecutor::Instance(this->world->GetName())->Add(this);
+}
+
+//////////////////////////////////////////////////
+bool RobotPlugin::BindEndPoints(const std::string &_address,
+    const int _port, const Callback_t &_cb)
+{
+  // Sanity check: Make sure that you use your local address or multicast.
+  if ((_address != this->kMulticast) && (_address != this->Host()))
+  {
+    gzerr << "[" << this->Host() << "] Bind() error: Address ["
+          << _address << "] is not your local address" << std::endl;
+    return false;
+  }
+
+  // Mapping the "unicast socket" to a topic name.
+  const auto unicastEndPoint = _address + ":" + std::to_string(_port);
 
-  // Cache forest and building bounding boxes
-  for (auto const &mdl : this->world->GetModels())
+  if (!this->broker->Bind(this->Host(), this, unicastEndPoint,
+        this->callbacks.size()))
   {
-    if (mdl->GetName().find("tree") != std::string::npos ||
-        mdl->GetName().find("building") != std::string::npos)
+    return false;
+  }
+
+  // Register the user callback. The broker passes its index back with
+  // each message.
+  this->callbackIndices[unicastEndPoint] = this->callbacks.size();
+  this->callbacks.push_back(_cb);
+
+  // Only enable broadcast if the address is a regular unicast address.
+  if (_address != this->kMulticast)
+  {
+    const std::string bcastEndPoint = "broadcast:" + std::to_string(_port);
+
+    if (!this->broker->Bind(this->Host(), this, bcastEndPoint,
+          this->callbacks.size()))
     {
-      this->boundingBoxes.push_back(mdl->GetBoundingBox().Ign());
+      return false;
     }
+
+    // Register the user callback for the broadcast endpoint.
+    this->callbackIndices[bcastEndPoint] = this->callbacks.size();
+    this->callbacks.push_back(_cb);
   }
+
+  return true;
 }
 
 //////////////////////////////////////////////////
-void RobotPlugin::OnMsgReceived(const msgs::Datagram &_msg) const
+void RobotPlugin::OnMsgReceived(const DatagramPtr &_msg,
+    const unsigned int _callback) const
 {
-  const std::string topic = _msg.dst_address() + ":" +
-      std::to_string(_msg.dst_port());
-
-  std::map<std::string, Callback_t>::const_iterator iter =
-    this->callbacks.find(topic);
-  if (iter == this->callbacks.end())
+  if (_callback >= this->callbacks.size())
   {
     gzerr << "[" << this->Host() << "] RobotPlugin::OnMsgReceived(): "
-          << "Address [" << topic << "] not found" << std::endl;
+          << "Address [" << _msg->dst_address() << ":" << _msg->dst_port()
+          << "] not found" << std::endl;
     return;
   }
 
-  iter->second(_msg.src_address(), _msg.dst_address(),
-              _msg.dst_port(), _msg.data());
+  if (this->recordReplay)
+    this->replayPending.push_back(_msg);
+
+  if (this->executor)
+    this->executor->Wake(this->executorSlot, WAKE_MESSAGE, _msg->dst_port());
+
+  const Callback_t &callback = this->callbacks[_callback];
+  if (!callback)
+  {
+    this->batchInbox.push_back(_msg);
+    return;
+  }
+
+  callback(_msg->src_address(), _msg->dst_address(), _msg->dst_port(),
+      _msg->data());
+}
+
+//////////////////////////////////////////////////
+void RobotPlugin::DeliverBatch()
+{
+  if (this->batchInbox.empty())
+    return;
+
+  // The callback may send messages, and receive them in the next batch.
+  std::swap(this->batch, this->batchInbox);
+  if (this->batchCallback)
+    this->batchCallback(this->batch);
+  this->batch.clear();
 }
 
 //////////////////////////////////////////////////
@@ -1162,6 +1860,10 @@ void RobotPlugin::OnNeighborsReceived(
   const std::vector<std::string> &_neighbors)
 {
   this->neighbors = _neighbors;
+  ++this->neighborsVersion;
+
+  if (this->executor)
+    this->executor->Wake(this->executorSlot, WAKE_NEIGHBORS);
 }
 
 //////////////////////////////////////////////////
@@ -1178,42 +1880,23 @@ std::string RobotPlugin::Name() const
 
 
 /////////////////////////////////////////////////
-void RobotPlugin::UpdateBattery()
+bool RobotPlugin::Recharging() const
 {
-  if (this->model->GetName() == "boo")
-    return;
-
   double distToBOO = IGN_DBL_MAX;
 
   if (this->boo)
   {
-    distToBOO = this->model->GetWorldPose().pos.Distance(
-        this->boo->GetWorldPose().pos);
+    distToBOO = this->WorldPose(this->model, this->poseId).Pos().Distance(
+        this->WorldPose(this->boo, this->booPoseId).Pos());
   }
 
-  // Check to see if the robot is in a recharge state:
+  // The robot is in a recharge state when:
   //    - Near the BOO
   //    - Not moving
-  if ((distToBOO < this->booRechargeDistance &&
+  return (distToBOO < this->booRechargeDistance &&
       this->linearVelocityNoNoise == ignition::math::Vector3d::Zero &&
       this->angularVelocityNoNoise == ignition::math::Vector3d::Zero) ||
-      (this->type == ROTOR && this->rotorDocked))
-  {
-    // The amount of the capacity recharged.
-    double mAhRecharged = (this->consumption * (this->consumptionFactor*4) *
-        (this->world->GetPhysicsEngine()->GetMaxStepSize() / 3600.0));
-
-    this->capacity = std::min(this->capacity + mAhRecharged,
-                              this->startCapacity);
-  }
-  else
-  {
-    // The amount of the capacity consumed.
-    double mAhConsumed = (this->consumption * this->consumptionFactor *
-        (this->world->GetPhysicsEngine()->GetMaxStepSize() / 3600.0));
-
-    this->capacity = std::max(0.0, this->capacity - mAhConsumed);
-  }
+      (this->type == ROTOR && this->rotorDocked);
 }
 
 /////////////////////////////////////////////////
@@ -1225,6 +1908,9 @@ double RobotPlugin::BatteryStartCapacity() const
 /////////////////////////////////////////////////
 double RobotPlugin::BatteryCapacity() const
 {
+  // Once registered, the executor steps the battery.
+  if (this->executor)
+    return this->executor->BatteryCapacity(this->executorSlot);
   return this->capacity;
 }
 
@@ -1243,32 +1929,41 @@ double RobotPlugin::BatteryConsumptionFactor() const
 /////////////////////////////////////////////////
 double RobotPlugin::ExpectedBatteryLife() const
 {
-  return ((this->capacity / this->consumption) * this->consumptionFactor) *
-    3600;
+  return ((this->BatteryCapacity() / this->consumption) *
+      this->consumptionFactor) * 3600;
 }
 
 /////////////////////////////////////////////////
 ignition::math::Pose3d RobotPlugin::CameraToWorld(
   const ignition::math::Pose3d &_poseinCamera) const
 {
-  auto poseInWorld = _poseinCamera + this->model->GetWorldPose().Ign();
+  auto poseInWorld =
+    _poseinCamera + this->WorldPose(this->model, this->poseId);
   return poseInWorld;
 }
 
 /////////////////////////////////////////////////
 void RobotPlugin::OnLog(msgs::LogEntry &_logEntry) const
 {
+  // The logger clears and refills the same entry at each step, and a
+  // cleared message keeps its sub-messages, so they are filled in place
+  // and not allocated again.
+  msgs::Sensors *sensors = _logEntry.mutable_sensors();
+
+  // The logged robots read all their sensors.
+  this->Observe(ALL_SENSORS);
+
   // Fill the last GPS observation.
-  msgs::Gps *obsGps = new msgs::Gps();
+  msgs::Gps *obsGps = sensors->mutable_gps();
   obsGps->set_latitude(this->observedLatitude);
   obsGps->set_longitude(this->observedLongitude);
   obsGps->set_altitude(this->observedAltitude);
 
   // Fill the last IMU observation.
-  gazebo::msgs::Vector3d *obsVlin = new gazebo::msgs::Vector3d();
-  gazebo::msgs::Vector3d *obsVang = new gazebo::msgs::Vector3d();
-  gazebo::msgs::Quaternion *obsOrient = new gazebo::msgs::Quaternion();
-  msgs::Imu *obsImu = new msgs::Imu();
+  msgs::Imu *obsImu = sensors->mutable_imu();
+  gazebo::msgs::Vector3d *obsVlin = obsImu->mutable_linvel();
+  gazebo::msgs::Vector3d *obsVang = obsImu->mutable_angvel();
+  gazebo::msgs::Quaternion *obsOrient = obsImu->mutable_orientation();
   obsVlin->set_x(this->observedlinVel.X());
   obsVlin->set_y(this->observedlinVel.Y());
   obsVlin->set_z(this->observedlinVel.Z());
@@ -1279,38 +1974,52 @@ void RobotPlugin::OnLog(msgs::LogEntry &_logEntry) const
   obsOrient->set_y(this->observedOrient.Y());
   obsOrient->set_z(this->observedOrient.Z());
   obsOrient->set_w(this->observedOrient.W());
-  obsImu->set_allocated_linvel(obsVlin);
-  obsImu->set_allocated_angvel(obsVang);
-  obsImu->set_allocated_orientation(obsOrient);
 
-  // Fill the camera observation.
-  msgs::ImageData *obsImage = new msgs::ImageData();
-  for (const auto imgObj : this->img.objects)
+  // Fill the camera observation, sorted by name as in Image(). The last
+  // detection of a name wins.
+  msgs::ImageData *obsImage = sensors->mutable_image();
+  this->logObjects.clear();
+  for (auto const &detection : this->detections)
+  {
+    this->logObjects.emplace_back(&this->CameraModelName(detection.first),
+        &detection.second);
+  }
+  typedef std::pair<const std::string *, const ignition::math::Pose3d *>
+    LogObject;
+  std::stable_sort(this->logObjects.begin(), this->logObjects.end(),
+      [](const LogObject &_a, const LogObject &_b)
+      {
+        return *_a.first < *_b.first;
+      });
+  for (size_t i = 0; i < this->logObjects.size(); ++i)
   {
+    if (i + 1 < this->logObjects.size() &&
+        *this->logObjects[i + 1].first == *this->logObjects[i].first)
+    {
+      continue;
+    }
+
+    const ignition::math::Pose3d &pose = *this->logObjects[i].second;
     msgs::ObjPose *obj = obsImage->add_object();
-    obj->set_name(imgObj.first);
-    obj->mutable_pose()->mutable_position()->set_x(imgObj.second.Pos().X());
-    obj->mutable_pose()->mutable_position()->set_y(imgObj.second.Pos().Y());
-    obj->mutable_pose()->mutable_position()->set_z(imgObj.second.Pos().Z());
-    obj->mutable_pose()->mutable_orientation()->set_x(imgObj.second.Rot().X());
-    obj->mutable_pose()->mutable_orientation()->set_y(imgObj.second.Rot().Y());
-    obj->mutable_pose()->mutable_orientation()->set_z(imgObj.second.Rot().Z());
-    obj->mutable_pose()->mutable_orientation()->set_w(imgObj.second.Rot().W());
-  }
-
-  msgs::Sensors *sensors = new msgs::Sensors();
-  sensors->set_allocated_gps(obsGps);
-  sensors->set_allocated_imu(obsImu);
+    obj->set_name(*this->logObjects[i].first);
+    auto position = obj->mutable_pose()->mutable_position();
+    position->set_x(pose.Pos().X());
+    position->set_y(pose.Pos().Y());
+    position->set_z(pose.Pos().Z());
+    auto orientation = obj->mutable_pose()->mutable_orientation();
+    orientation->set_x(pose.Rot().X());
+    orientation->set_y(pose.Rot().Y());
+    orientation->set_z(pose.Rot().Z());
+    orientation->set_w(pose.Rot().W());
+  }
+
   sensors->set_bearing(this->observedBearing.Radian());
-  sensors->set_allocated_image(obsImage);
   sensors->set_battery_capacity(this->BatteryCapacity());
 
-  // Fill the sensor information of the log entry.
-  _logEntry.set_allocated_sensors(sensors);
-
   // Fill the actions.
-  gazebo::msgs::Vector3d *targetVlin = new gazebo::msgs::Vector3d();
-  gazebo::msgs::Vector3d *targetVang = new gazebo::msgs::Vector3d();
+  msgs::Actions *actions = _logEntry.mutable_actions();
+  gazebo::msgs::Vector3d *targetVlin = actions->mutable_linvel();
+  gazebo::msgs::Vector3d *targetVang = actions->mutable_angvel();
   targetVlin->set_x(this->targetLinVel.X());
   targetVlin->set_y(this->targetLinVel.Y());
   targetVlin->set_z(this->targetLinVel.Z());
@@ -1318,19 +2027,203 @@ void RobotPlugin::OnLog(msgs::LogEntry &_logEntry) const
   targetVang->set_y(this->targetAngVel.Y());
   targetVang->set_z(this->targetAngVel.Z());
 
-  msgs::Actions *actions = new msgs::Actions();
-  actions->set_allocated_linvel(targetVlin);
-  actions->set_allocated_angvel(targetVang);
-
-  _logEntry.set_allocated_actions(actions);
-
   // Fill the Gazebo model name.
   _logEntry.set_model_name(this->model->GetName());
+
+  // Fill the wall time of the controller.
+  if (this->executor)
+  {
+    this->executor->FillControllerTiming(this->executorSlot,
+        *_logEntry.mutable_controller_timing());
+  }
+
+  // Fill what the replay needs since the previous entry.
+  if (!this->recordReplay)
+    return;
+
+  _logEntry.set_step_time(this->replayStepTime);
+  for (auto const &msg : this->replayDelivered)
+    *_logEntry.add_delivered() = *msg;
+  for (auto const &msg : this->replaySent)
+    *_logEntry.add_sent() = *msg;
+  for (auto const &neighbor : this->replayNeighbors)
+    _logEntry.add_neighbor(neighbor);
+  this->replayDelivered.clear();
+  this->replaySent.clear();
+}
+
+//////////////////////////////////////////////////
+void RobotPlugin::OnSave(msgs::CheckpointPart &_part) const
+{
+  // The observations of the period are saved as computed now, which the
+  // simulation then keeps too, so it goes on as the restored one.
+  if (this->pendingSensors)
+    const_cast<RobotPlugin *>(this)->Sense(ALL_SENSORS);
+
+  msgs::RobotState *state = _part.mutable_robot();
+  if (this->usedSensors)
+    state->set_sensors_used(this->usedSensors);
+  state->set_docked(this->rotorDocked);
+  if (this->rotorDockVehicle)
+    state->set_dock_vehicle(this->rotorDockVehicle->GetName());
+
+  msgs::Gps *gpsState = state->mutable_gps();
+  gpsState->set_latitude(this->observedLatitude);
+  gpsState->set_longitude(this->observedLongitude);
+  gpsState->set_altitude(this->observedAltitude);
+
+  msgs::Imu *imuState = state->mutable_imu();
+  gazebo::msgs::Set(imuState->mutable_linvel(), this->observedlinVel);
+  gazebo::msgs::Set(imuState->mutable_angvel(), this->observedAngVel);
+  gazebo::msgs::Set(imuState->mutable_orientation(), this->observedOrient);
+  state->set_bearing(this->observedBearing.Radian());
+
+  // The detections keep their order, which decides the duplicates.
+  for (auto const &detection : this->detections)
+  {
+    msgs::ObjPose *obj = state->mutable_image()->add_object();
+    obj->set_name(this->CameraModelName(detection.first));
+    gazebo::msgs::Set(obj->mutable_pose(), detection.second);
+  }
+
+  gazebo::msgs::Set(state->mutable_linear_vel_no_noise(),
+      this->linearVelocityNoNoise);
+  gazebo::msgs::Set(state->mutable_angular_vel_no_noise(),
+      this->angularVelocityNoNoise);
+  state->set_terrain(static_cast<uint32_t>(this->terrainType));
+
+  if (this->camera)
+  {
+    double pitch = 0;
+    double yaw = 0;
+    this->CameraOrientation(pitch, yaw);
+    state->set_camera_pitch(pitch);
+    state->set_camera_yaw(yaw);
+  }
+
+  for (auto const &data : this->camFalsePositiveModels)
+  {
+    msgs::FalsePositive *falsePositive = state->add_false_positive();
+    falsePositive->set_model(this->CameraModelName(data.model));
+    falsePositive->set_enabled_until(data.enabledUntil.Double());
+    falsePositive->set_false_positive_model(
+        this->CameraModelName(data.falsePositiveModel));
+  }
+
+  for (auto const &neighbor : this->neighbors)
+    state->add_neighbor(neighbor);
+
+  gazebo::msgs::Set(state->mutable_target_lin_vel(), this->targetLinVel);
+  gazebo::msgs::Set(state->mutable_target_ang_vel(), this->targetAngVel);
+
+  this->OnSaveController(_part);
+}
+
+//////////////////////////////////////////////////
+bool RobotPlugin::OnRestore(const msgs::CheckpointPart &_part)
+{
+  if (!_part.has_robot())
+    return false;
+
+  const msgs::RobotState &state = _part.robot();
+  this->rotorDocked = state.docked();
+  this->rotorDockVehicle.reset();
+  if (state.has_dock_vehicle())
+  {
+    this->rotorDockVehicle = this->world->GetModel(state.dock_vehicle());
+    if (!this->rotorDockVehicle)
+    {
+      gzerr << "[" << this->Host() << "] Unable to get dock vehicle["
+            << state.dock_vehicle() << "]\n";
+      this->rotorDocked = false;
+    }
+  }
+
+  this->observedLatitude = state.gps().latitude();
+  this->observedLongitude = state.gps().longitude();
+  this->observedAltitude = state.gps().altitude();
+  this->observedlinVel = gazebo::msgs::ConvertIgn(state.imu().linvel());
+  this->observedAngVel = gazebo::msgs::ConvertIgn(state.imu().angvel());
+  this->observedOrient = gazebo::msgs::ConvertIgn(state.imu().orientation());
+  this->observedBearing = ignition::math::Angle(state.bearing());
+  this->pendingSensors = 0;
+  this->usedSensors = static_cast<uint8_t>(state.sensors_used());
+
+  this->detections.clear();
+  for (auto const &obj : state.image().object())
+  {
+    this->detections.push_back(CameraObject(this->CameraModelId(obj.name()),
+          gazebo::msgs::ConvertIgn(obj.pose())));
+  }
+
+  this->linearVelocityNoNoise =
+    gazebo::msgs::ConvertIgn(state.linear_vel_no_noise());
+  this->angularVelocityNoNoise =
+    gazebo::msgs::ConvertIgn(state.angular_vel_no_noise());
+  this->terrainType = static_cast<TerrainType>(state.terrain());
+
+  if (this->camera && state.has_camera_pitch() && state.has_camera_yaw())
+    this->SetCameraOrientation(state.camera_pitch(), state.camera_yaw());
+
+  this->camFalsePositiveModels.clear();
+  for (auto const &falsePositive : state.false_positive())
+  {
+    FalsePositiveData data;
+    data.model = this->CameraModelId(falsePositive.model());
+    data.enabledUntil = falsePositive.enabled_until();
+    data.falsePositiveModel =
+      this->CameraModelId(falsePositive.false_positive_model());
+    this->camFalsePositiveModels.push_back(data);
+  }
+
+  this->targetLinVel = gazebo::msgs::ConvertIgn(state.target_lin_vel());
+  this->targetAngVel = gazebo::msgs::ConvertIgn(state.target_ang_vel());
+
+  this->OnNeighborsReceived(std::vector<std::string>(
+        state.neighbor().begin(), state.neighbor().end()));
+
+  return this->OnRestoreController(_part);
+}
+
+//////////////////////////////////////////////////
+void RobotPlugin::OnMemory(MemoryReport &_report) const
+{
+  // The messages delivered are shared with the broker until they arrive.
+  uint64_t bytes = HeapBytes(this->neighbors) +
+    HeapBytes(this->replayNeighbors) + HeapBytes(this->extraModelNames) +
+    HeapBytes(this->callbacks) + HeapBytes(this->callbackIndices) +
+    HeapBytes(this->cameraObjects) + HeapBytes(this->detections) +
+    HeapBytes(this->logObjects) + HeapBytes(this->camFalsePositiveModels) +
+    SharedMessagesBytes(this->batchInbox) + SharedMessagesBytes(this->batch) +
+    SharedMessagesBytes(this->outgoingBatch) +
+    SharedMessagesBytes(this->deferredMsgs) +
+    SharedMessagesBytes(this->replayPending) +
+    SharedMessagesBytes(this->replayDelivered) +
+    SharedMessagesBytes(this->replaySent);
+  const uint64_t elements = this->neighbors.size() +
+    this->cameraObjects.size() + this->detections.size() +
+    this->camFalsePositiveModels.size() + this->batchInbox.size() +
+    this->outgoingBatch.size() + this->deferredMsgs.size() +
+    this->replayPending.size() + this->replayDelivered.size() +
+    this->replaySent.size();
+
+  _report.Add(this->type == BOO ? "boo" : "robots", bytes, elements);
+  this->OnMemoryController(_report);
 }
 
 /////////////////////////////////////////////////
 void RobotPlugin::SetCameraOrientation(const double _pitch, const double _yaw)
 {
+  // The camera is shared with the sensor thread of Gazebo, so controllers
+  // running on the pool of threads set it when they finish.
+  if (this->deferEffects)
+  {
+    this->deferredCamera = true;
+    this->deferredPitch = _pitch;
+    this->deferredYaw = _yaw;
+    return;
+  }
+
   // Lock pitch to +/- 90 degrees
   double pitch = ignition::math::clamp(_pitch, -IGN_PI_2, IGN_PI_2);
 
@@ -1390,60 +2283,115 @@ void RobotPlugin::Reset()
 
   // Reset battery
   this->capacity = this->startCapacity;
+  if (this->executor)
+    this->executor->SetBatteryCapacity(this->executorSlot, this->capacity);
 
   // Set camera starting pitch and yaw
   this->SetCameraOrientation(this->cameraStartPitch, this->cameraStartYaw);
 
   // Clear information about false positives.
   this->camFalsePositiveModels.clear();
+  this->pendingSensors = 0;
+  this->usedSensors = 0;
+}
+
+//////////////////////////////////////////////////
+int RobotPlugin::CameraModelId(const std::string &_name)
+{
+  const int id = this->scene->ModelId(_name);
+  if (id >= 0)
+    return id;
+
+  const int count = static_cast<int>(this->scene->ModelNames().size());
+  for (size_t i = 0; i < this->extraModelNames.size(); ++i)
+  {
+    if (this->extraModelNames[i] == _name)
+      return count + static_cast<int>(i);
+  }
+  this->extraModelNames.push_back(_name);
+  return count + static_cast<int>(this->extraModelNames.size()) - 1;
 }
 
 //////////////////////////////////////////////////
-void RobotPlugin::UpdateFalsePositives(const std::string &_model,
+const std::string &RobotPlugin::CameraModelName(const int _id) const
+{
+  const std::vector<std::string> &names = this->scene->ModelNames();
+  if (_id < static_cast<int>(names.size()))
+    return names[_id];
+  return this->extraModelNames[_id - names.size()];
+}
+
+//////////////////////////////////////////////////
+void RobotPlugin::Detect(const int _id, const ignition::math::Pose3d &_pose)
+{
+  for (auto &detection : this->detections)
+  {
+    if (detection.first == _id)
+    {
+      detection.second = _pose;
+      return;
+    }
+  }
+  this->detections.push_back(CameraObject(_id, _pose));
+}
+
+//////////////////////////////////////////////////
+void RobotPlugin::UpdateFalsePositives(const int _model,
     const ignition::math::Pose3d &_p, const double _normalizedDist,
     const gazebo::common::Time &_curTime)
 {
   // Check if we are currently on a false positive period for this model.
-  if (this->camFalsePositiveModels.find(_model) !=
-      this->camFalsePositiveModels.end())
+  auto falsePositive = std::find_if(this->camFalsePositiveModels.begin(),
+      this->camFalsePositiveModels.end(),
+      [_model](const FalsePositiveData &_data)
+      {
+        return _data.model == _model;
+      });
+  if (falsePositive != this->camFalsePositiveModels.end())
   {
-    auto &falsePositiveInfo = this->camFalsePositiveModels[_model];
-
     // Check if the false positive should finish.
-    if (_curTime >= falsePositiveInfo.enabledUntil)
+    if (_curTime >= falsePositive->enabledUntil)
     {
-      this->camFalsePositiveModels.erase(_model);
-      this->img.objects[_model] = _p;
+      *falsePositive = this->camFalsePositiveModels.back();
+      this->camFalsePositiveModels.pop_back();
+      this->Detect(_model, _p);
     }
     else
-      this->img.objects[falsePositiveInfo.falsePositiveModel] = _p;
+      this->Detect(falsePositive->falsePositiveModel, _p);
   }
   else
   {
+    // The models that can replace this one, all but this robot.
+    const int candidates =
+      static_cast<int>(this->scene->ModelNames().size()) -
+      (this->modelId >= 0 ? 1 : 0);
+
     // A percentage of the time we get a false positive for the lost person.
-    if (ignition::math::Rand::DblUniform(
+    if (candidates > 0 && this->cameraNoise.Uniform(
           this->cameraFalsePositiveProbMin,
           this->cameraFalsePositiveProbMax) < _normalizedDist)
     {
-      // Randomly choose a model name.
-      auto cameraFalsePositiveModelName = this->modelNames[
-        ignition::math::Rand::IntUniform(0, this->modelNames.size()-1)];
+      // Randomly choose a model, skipping this robot.
+      int candidate = this->cameraNoise.IntUniform(0, candidates - 1);
+      if (this->modelId >= 0 && candidate >= this->modelId)
+        ++candidate;
 
       FalsePositiveData fpData;
+      fpData.model = _model;
 
       // Set the duration of the false positive.
-      fpData.enabledUntil = _curTime + ignition::math::Rand::DblUniform(
+      fpData.enabledUntil = _curTime + this->cameraNoise.Uniform(
           this->cameraFalsePositiveDurationMin,
           this->cameraFalsePositiveDurationMax);
 
       // Set the model that will replace the real observed model.
-      fpData.falsePositiveModel = cameraFalsePositiveModelName;
+      fpData.falsePositiveModel = candidate;
 
-      this->camFalsePositiveModels[_model] = fpData;
+      this->camFalsePositiveModels.push_back(fpData);
 
-      this->img.objects[cameraFalsePositiveModelName] = _p;
+      this->Detect(candidate, _p);
     }
     else
-      this->img.objects[_model] = _p;
+      this->Detect(_model, _p);
   }
 }
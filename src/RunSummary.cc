@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "swarm/RunSummary.hh"
+
+using namespace swarm;
+
+/// \brief Simulation time between two steps when the header doesn't have
+/// it (s).
+static const double kDefaultTimeStep = 0.1;
+
+//////////////////////////////////////////////////
+std::string swarm::RunSummaryPath(const std::string &_logPath)
+{
+  const size_t slash = _logPath.rfind('/');
+  const size_t dot = _logPath.rfind('.');
+  if (dot == std::string::npos ||
+      (slash != std::string::npos && dot < slash))
+  {
+    return _logPath + ".summary";
+  }
+  return _logPath.substr(0, dot) + ".summary";
+}
+
+//////////////////////////////////////////////////
+RunSummary::RunSummary()
+{
+  this->totals.set_timestamp(0);
+  this->totals.set_time_step(kDefaultTimeStep);
+}
+
+//////////////////////////////////////////////////
+RunSummary::RunSummary(const msgs::LogHeader &_header)
+  : RunSummary()
+{
+  this->totals.set_timestamp(_header.timestamp());
+  if (_header.has_time_step() && _header.time_step() > 0)
+    this->totals.set_time_step(_header.time_step());
+}
+
+//////////////////////////////////////////////////
+LogMinRecord RunSummary::Record(const msgs::LogEntryMin &_entry)
+{
+  LogMinRecord record;
+  record.time = _entry.time();
+  record.numUnicast = _entry.num_unicast();
+  record.numBroadcast = _entry.num_broadcast();
+  record.numMulticast = _entry.num_multicast();
+  record.bytesSent = _entry.bytes_sent();
+  record.msgsDelivered = _entry.msgs_delivered();
+  record.potentialRecipients = _entry.potential_recipients();
+  record.avgNeighbors = _entry.avg_neighbors();
+  return record;
+}
+
+//////////////////////////////////////////////////
+StepRates RunSummary::AddStep(const LogMinRecord &_step)
+{
+  const double timeStep = this->totals.time_step();
+  const int msgSent =
+      _step.numUnicast + _step.numBroadcast + _step.numMulticast;
+
+  StepRates rates;
+  rates.msgFreq = msgSent / timeStep;
+  rates.dataRate = (_step.bytesSent * 8) / timeStep;
+  if (_step.potentialRecipients > 0)
+  {
+    rates.dropRatio = (_step.potentialRecipients - _step.msgsDelivered) /
+        static_cast<double>(_step.potentialRecipients);
+  }
+
+  msgs::RunSummary &t = this->totals;
+  t.set_steps(t.steps() + 1);
+  t.set_msgs_sent(t.msgs_sent() + msgSent);
+  t.set_unicast_sent(t.unicast_sent() + _step.numUnicast);
+  t.set_broadcast_sent(t.broadcast_sent() + _step.numBroadcast);
+  t.set_multicast_sent(t.multicast_sent() + _step.numMulticast);
+  t.set_total_msg_freq(t.total_msg_freq() + rates.msgFreq);
+  t.set_total_drop_ratio(t.total_drop_ratio() + rates.dropRatio);
+  t.set_total_data_rate(t.total_data_rate() + rates.dataRate);
+  t.set_total_neighbors(t.total_neighbors() + _step.avgNeighbors);
+  return rates;
+}
+
+//////////////////////////////////////////////////
+void RunSummary::AddEntry(const msgs::LogEntryMin &_entry)
+{
+  // The connectivity is only logged when it changes, so each value holds
+  // until the next one.
+  if (_entry.has_connectivity())
+  {
+    AddConnectivity(_entry.time(), this->totals);
+    this->totals.mutable_connectivity()->CopyFrom(_entry.connectivity());
+  }
+
+  if (_entry.has_timings())
+  {
+    const msgs::StepTimings &timings = _entry.timings();
+    msgs::StepTimings *total = this->totals.mutable_timings();
+    total->set_steps(total->steps() + timings.steps());
+    total->set_comms_model(total->comms_model() + timings.comms_model());
+    total->set_notify_neighbors(
+        total->notify_neighbors() + timings.notify_neighbors());
+    total->set_dispatch(total->dispatch() + timings.dispatch());
+    total->set_delivery(total->delivery() + timings.delivery());
+    total->set_logger(total->logger() + timings.logger());
+    total->set_poses(total->poses() + timings.poses());
+    total->set_sensors(total->sensors() + timings.sensors());
+    total->set_controllers(total->controllers() + timings.controllers());
+    total->set_actuation(total->actuation() + timings.actuation());
+  }
+
+  for (const auto &report : _entry.boo_report())
+    this->AddBooReport(report);
+  this->UpdateDuration(_entry.time());
+}
+
+//////////////////////////////////////////////////
+void RunSummary::AddBooReport(const msgs::BooReport &_report)
+{
+  if (_report.succeed())
+    this->totals.set_succeed(true);
+  else
+    this->totals.set_wrong_reports(this->totals.wrong_reports() + 1);
+}
+
+//////////////////////////////////////////////////
+void RunSummary::UpdateDuration(const double _time)
+{
+  if (!this->totals.succeed())
+    this->totals.set_duration(_time);
+  this->totals.set_end_time(std::max(this->totals.end_time(), _time));
+}
+
+//////////////////////////////////////////////////
+msgs::RunSummary RunSummary::Totals() const
+{
+  msgs::RunSummary summary = this->totals;
+  AddConnectivity(summary.end_time(), summary);
+  return summary;
+}
+
+//////////////////////////////////////////////////
+void RunSummary::Restore(const msgs::RunSummary &_totals)
+{
+  // The totals go on into the log of this summary.
+  const uint64_t timestamp = this->totals.timestamp();
+  this->totals.CopyFrom(_totals);
+  this->totals.set_timestamp(timestamp);
+}
+
+//////////////////////////////////////////////////
+bool RunSummary::Write(const std::string &_path) const
+{
+  // The summary replaces the previous one at once, so it's never read
+  // partially written.
+  const std::string tmpPath = _path + ".tmp";
+  {
+    std::ofstream out(tmpPath, std::ios::out | std::ios::binary);
+    if (!out || !this->Totals().SerializeToOstream(&out))
+    {
+      std::cerr << "Unable to write the summary of the run [" << _path
+                << "]" << std::endl;
+      return false;
+    }
+  }
+  if (std::rename(tmpPath.c_str(), _path.c_str()) != 0)
+  {
+    std::cerr << "Unable to write the summary of the run [" << _path
+              << "]" << std::endl;
+    std::remove(tmpPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool RunSummary::Read(const std::string &_path, msgs::RunSummary &_totals)
+{
+  std::ifstream in(_path, std::ios::in | std::ios::binary);
+  return in && _totals.ParseFromIstream(&in);
+}
+
+//////////////////////////////////////////////////
+void RunSummary::AddConnectivity(const double _time,
+    msgs::RunSummary &_totals)
+{
+  if (_totals.has_connectivity() && _time > _totals.connectivity_time())
+  {
+    const double elapsed = _time - _totals.connectivity_time();
+    const msgs::ConnectivityStats &connectivity = _totals.connectivity();
+    _totals.set_total_components(_totals.total_components() +
+        elapsed * connectivity.components());
+    _totals.set_total_boo_reachable(_totals.total_boo_reachable() +
+        elapsed * connectivity.boo_reachable());
+    _totals.set_total_hops(_totals.total_hops() +
+        elapsed * connectivity.avg_hops());
+    _totals.set_connectivity_span(_totals.connectivity_span() + elapsed);
+  }
+  _totals.set_connectivity_time(std::max(_totals.connectivity_time(), _time));
+}
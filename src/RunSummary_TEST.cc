@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <unistd.h>
+#include <cstdio>
+#include <string>
+#include "gtest/gtest.h"
+#include "swarm/RunSummary.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Get a header of a log.
+/// \return The header.
+static msgs::LogHeader testHeader()
+{
+  msgs::LogHeader header;
+  header.set_timestamp(1234);
+  header.set_swarm_version("test");
+  header.set_gazebo_version("test");
+  header.set_seed(1);
+  header.set_time_step(0.5);
+  return header;
+}
+
+//////////////////////////////////////////////////
+/// \brief Check the path of the summary of a log.
+TEST(RunSummaryTest, Path)
+{
+  EXPECT_EQ(RunSummaryPath("/tmp/run/swarm.log"), "/tmp/run/swarm.summary");
+  EXPECT_EQ(RunSummaryPath("swarm_world_2.log"), "swarm_world_2.summary");
+  EXPECT_EQ(RunSummaryPath("/tmp/run.1/swarm"), "/tmp/run.1/swarm.summary");
+}
+
+//////////////////////////////////////////////////
+/// \brief Check the totals of the comms of the steps.
+TEST(RunSummaryTest, Steps)
+{
+  RunSummary summary(testHeader());
+
+  LogMinRecord step;
+  step.numUnicast = 2;
+  step.numBroadcast = 1;
+  step.bytesSent = 100;
+  step.potentialRecipients = 4;
+  step.msgsDelivered = 3;
+  step.avgNeighbors = 1.5;
+  const StepRates rates = summary.AddStep(step);
+  EXPECT_DOUBLE_EQ(rates.msgFreq, 6);
+  EXPECT_DOUBLE_EQ(rates.dataRate, 1600);
+  EXPECT_DOUBLE_EQ(rates.dropRatio, 0.25);
+
+  // A step without recipients drops nothing.
+  summary.AddStep(LogMinRecord());
+
+  const msgs::RunSummary totals = summary.Totals();
+  EXPECT_EQ(totals.timestamp(), 1234u);
+  EXPECT_EQ(totals.steps(), 2u);
+  EXPECT_EQ(totals.msgs_sent(), 3u);
+  EXPECT_EQ(totals.unicast_sent(), 2u);
+  EXPECT_EQ(totals.broadcast_sent(), 1u);
+  EXPECT_EQ(totals.multicast_sent(), 0u);
+  EXPECT_DOUBLE_EQ(totals.total_msg_freq(), 6);
+  EXPECT_DOUBLE_EQ(totals.total_drop_ratio(), 0.25);
+  EXPECT_DOUBLE_EQ(totals.total_neighbors(), 1.5);
+}
+
+//////////////////////////////////////////////////
+/// \brief Check the reports of the BOO, the timings and the connectivity
+/// of the entries.
+TEST(RunSummaryTest, Entries)
+{
+  RunSummary summary(testHeader());
+
+  msgs::LogEntryMin entry;
+  entry.set_time(1);
+  entry.mutable_connectivity()->set_components(2);
+  entry.mutable_connectivity()->set_avg_hops(1);
+  entry.mutable_timings()->set_steps(10);
+  entry.mutable_timings()->set_controllers(500);
+  summary.AddEntry(entry);
+
+  entry.Clear();
+  entry.set_time(3);
+  entry.mutable_connectivity()->set_components(1);
+  auto *report = entry.add_boo_report();
+  report->set_time_seen(2);
+  report->mutable_pos_seen()->set_x(0);
+  report->mutable_pos_seen()->set_y(0);
+  report->mutable_pos_seen()->set_z(0);
+  report->set_succeed(false);
+  summary.AddEntry(entry);
+
+  entry.Clear();
+  entry.set_time(4);
+  entry.add_boo_report()->CopyFrom(*report);
+  entry.mutable_boo_report(0)->set_succeed(true);
+  entry.mutable_timings()->set_steps(10);
+  entry.mutable_timings()->set_controllers(300);
+  summary.AddEntry(entry);
+
+  // The run goes on until the teardown.
+  summary.UpdateDuration(5);
+
+  const msgs::RunSummary totals = summary.Totals();
+  EXPECT_TRUE(totals.succeed());
+  EXPECT_EQ(totals.wrong_reports(), 1u);
+  EXPECT_DOUBLE_EQ(totals.duration(), 3);
+  EXPECT_DOUBLE_EQ(totals.end_time(), 5);
+  EXPECT_EQ(totals.timings().steps(), 20);
+  EXPECT_EQ(totals.timings().controllers(), 800);
+
+  // Two components during 2 s, then one during 2 s.
+  EXPECT_DOUBLE_EQ(totals.connectivity_span(), 4);
+  EXPECT_DOUBLE_EQ(totals.total_components(), 6);
+  EXPECT_DOUBLE_EQ(totals.total_hops(), 2);
+
+  // Getting the totals again doesn't count the connectivity twice.
+  EXPECT_DOUBLE_EQ(summary.Totals().total_components(), 6);
+}
+
+//////////////////////////////////////////////////
+/// \brief Check that the totals are written, read back and continued.
+TEST(RunSummaryTest, WriteRestore)
+{
+  RunSummary summary(testHeader());
+  LogMinRecord step;
+  step.numMulticast = 5;
+  summary.AddStep(step);
+  summary.UpdateDuration(2);
+
+  const std::string path =
+    "/tmp/run_summary_test_" + std::to_string(getpid()) + ".summary";
+  ASSERT_TRUE(summary.Write(path));
+
+  msgs::RunSummary totals;
+  ASSERT_TRUE(RunSummary::Read(path, totals));
+  EXPECT_EQ(totals.multicast_sent(), 5u);
+  EXPECT_DOUBLE_EQ(totals.duration(), 2);
+  EXPECT_DOUBLE_EQ(totals.time_step(), 0.5);
+  std::remove(path.c_str());
+  EXPECT_FALSE(RunSummary::Read(path, totals));
+
+  // A restored summary keeps the timestamp of its own log.
+  msgs::LogHeader header = testHeader();
+  header.set_timestamp(5678);
+  RunSummary restored(header);
+  restored.Restore(totals);
+  restored.AddStep(step);
+  EXPECT_EQ(restored.Totals().timestamp(), 5678u);
+  EXPECT_EQ(restored.Totals().multicast_sent(), 10u);
+  EXPECT_EQ(restored.Totals().steps(), 2u);
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
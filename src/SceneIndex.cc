@@ -0,0 +1,361 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <sys/stat.h>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <string>
+#include <gazebo/common/Console.hh>
+#include <gazebo/physics/physics.hh>
+#include "swarm/SceneIndex.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Copy the height samples of a terrain.
+/// \param[in] _terrain The terrain.
+/// \return The heights, in the layout of Heightmap.
+static std::vector<float> samplesOf(
+    gazebo::physics::HeightmapShapePtr _terrain)
+{
+  const int columns = _terrain->GetVertexCount().x;
+  const int rows = _terrain->GetVertexCount().y;
+  std::vector<float> heights(static_cast<size_t>(columns) * rows);
+  for (int y = 0; y < rows; ++y)
+  {
+    for (int x = 0; x < columns; ++x)
+      heights[y * columns + x] = _terrain->GetHeight(x, y);
+  }
+  return heights;
+}
+
+//////////////////////////////////////////////////
+std::shared_ptr<const SceneIndex> SceneIndex::Instance(
+    gazebo::physics::WorldPtr _world)
+{
+  static std::mutex mutex;
+  static std::map<std::string, std::shared_ptr<const SceneIndex>> indices;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &index = indices[_world->GetName()];
+  if (index)
+    return index;
+
+  auto newIndex = std::make_shared<SceneIndex>();
+  gazebo::physics::ModelPtr terrainModel = _world->GetModel("terrain");
+  if (terrainModel)
+  {
+    newIndex->SetTerrain(
+        boost::dynamic_pointer_cast<gazebo::physics::HeightmapShape>(
+          terrainModel->GetLink()->GetCollision("collision")->GetShape()));
+  }
+
+  // The boxes come from the cache, if any, so only the names are read
+  // from the models. The cache is ignored if it doesn't have a box for
+  // each tree and building.
+  newIndex->LoadCache(_world);
+  auto addModels = [&_world, &newIndex]()
+  {
+    for (auto const &model : _world->GetModels())
+    {
+      newIndex->AddModel(model->GetName(), newIndex->cache ?
+          ignition::math::Box() : model->GetBoundingBox().Ign());
+    }
+  };
+  addModels();
+
+  if (newIndex->cache)
+  {
+    std::vector<ignition::math::Box> treeBoxes = newIndex->cache->TreeBoxes();
+    std::vector<ignition::math::Box> buildingBoxes =
+      newIndex->cache->BuildingBoxes();
+    if (treeBoxes.size() == newIndex->treeBoxes.size() &&
+        buildingBoxes.size() == newIndex->buildingBoxes.size())
+    {
+      newIndex->treeBoxes.swap(treeBoxes);
+      newIndex->buildingBoxes.swap(buildingBoxes);
+    }
+    else
+    {
+      gzwarn << "The world cache [" << newIndex->cachePath << "] doesn't "
+             << "match the models, ignoring it" << std::endl;
+      newIndex->cache = nullptr;
+      newIndex->modelNames.clear();
+      newIndex->modelIds.clear();
+      newIndex->treeBoxes.clear();
+      newIndex->buildingBoxes.clear();
+      addModels();
+    }
+  }
+
+  newIndex->Build();
+
+  gzmsg << "Scene index of world [" << _world->GetName() << "]: "
+        << newIndex->ModelNames().size() << " models, "
+        << newIndex->TreeBoxes().size() << " trees, "
+        << newIndex->BuildingBoxes().size() << " buildings"
+        << (newIndex->cache ? " (cached)" : "") << std::endl;
+
+  index = newIndex;
+  return index;
+}
+
+//////////////////////////////////////////////////
+void SceneIndex::AddModel(const std::string &_name,
+    const ignition::math::Box &_box)
+{
+  if (_name == "ground_plane" || this->modelIds.count(_name) > 0)
+    return;
+
+  this->modelIds[_name] = static_cast<int>(this->modelNames.size());
+  this->modelNames.push_back(_name);
+
+  if (_name.find("tree") != std::string::npos)
+    this->treeBoxes.push_back(_box);
+  else if (_name.find("building") != std::string::npos)
+    this->buildingBoxes.push_back(_box);
+}
+
+//////////////////////////////////////////////////
+void SceneIndex::SetTerrain(gazebo::physics::HeightmapShapePtr _terrain)
+{
+  this->terrain = _terrain;
+  this->tiles = nullptr;
+  this->heightmap = Heightmap();
+  this->heightmapLoaded = false;
+  if (!this->terrain)
+  {
+    this->terrainSize = ignition::math::Vector3d::Zero;
+    this->heightmapLoaded = true;
+    return;
+  }
+
+  this->terrainSize = this->terrain->GetSize().Ign();
+
+  const char *tilesPath = std::getenv("SWARM_TERRAIN_TILES");
+  if (tilesPath && *tilesPath)
+  {
+    const int columns = this->terrain->GetVertexCount().x;
+    const int rows = this->terrain->GetVertexCount().y;
+
+    struct stat buffer;
+    if (stat(tilesPath, &buffer) != 0)
+    {
+      this->LoadHeightmap();
+      gzmsg << "Writing the terrain tiles [" << tilesPath << "]" << std::endl;
+      TerrainTiles::Write(this->heightmap, tilesPath);
+    }
+
+    // The samples are hashed without building the cells, to check that
+    // the tiles were written from this terrain.
+    this->tiles = TerrainTiles::Open(tilesPath);
+    if (this->tiles && (this->tiles->Columns() != columns ||
+          this->tiles->Rows() != rows ||
+          this->tiles->Size() != this->terrainSize ||
+          this->tiles->Hash() != (this->heightmapLoaded ?
+            this->heightmap.Hash() : Heightmap::HashSamples(columns, rows,
+              this->terrainSize, samplesOf(this->terrain)))))
+    {
+      gzerr << "The terrain tiles [" << tilesPath << "] belong to another "
+            << "terrain, ignoring them" << std::endl;
+      this->tiles = nullptr;
+    }
+
+    const char *cacheEnv = std::getenv("SWARM_TERRAIN_TILE_CACHE");
+    const int cacheSize = cacheEnv ? std::atoi(cacheEnv) : 0;
+    if (this->tiles && cacheSize > 0)
+      this->tiles->SetCacheSize(cacheSize);
+  }
+
+  // Without tiles, keep a copy of the samples, used by the terrain
+  // lookups, the analytic line of sight tests and to identify the terrain.
+  if (!this->tiles)
+    this->LoadHeightmap();
+}
+
+//////////////////////////////////////////////////
+void SceneIndex::LoadCache(gazebo::physics::WorldPtr _world)
+{
+  const char *cacheEnv = std::getenv("SWARM_WORLD_CACHE");
+  if (!cacheEnv || !*cacheEnv)
+    return;
+
+  this->cachePath = cacheEnv;
+  this->cacheHash = WorldCache::HashWorld(_world->GetSDF()->ToString(""),
+      this->terrain ? this->TerrainHash() : 0);
+
+  struct stat buffer;
+  if (stat(this->cachePath.c_str(), &buffer) != 0)
+    return;
+
+  auto newCache = std::make_shared<WorldCache>();
+  if (!newCache->Load(this->cachePath))
+    return;
+
+  if (newCache->Hash() != this->cacheHash)
+  {
+    gzmsg << "The world cache [" << this->cachePath << "] belongs to "
+          << "another world, it will be rewritten" << std::endl;
+    return;
+  }
+
+  this->cache = newCache;
+}
+
+//////////////////////////////////////////////////
+std::shared_ptr<const WorldCache> SceneIndex::Cache() const
+{
+  return this->cache;
+}
+
+//////////////////////////////////////////////////
+void SceneIndex::StoreCache(const TerrainRaster &_raster) const
+{
+  if (this->cachePath.empty() || this->cache)
+    return;
+
+  gzmsg << "Writing the world cache [" << this->cachePath << "]"
+        << std::endl;
+  WorldCache::Write(this->cachePath, this->cacheHash, this->treeBoxes,
+      this->buildingBoxes, _raster);
+}
+
+//////////////////////////////////////////////////
+void SceneIndex::LoadHeightmap() const
+{
+  std::lock_guard<std::mutex> lock(this->heightmapMutex);
+  if (this->heightmapLoaded)
+    return;
+
+  this->heightmap.Set(this->terrain->GetVertexCount().x,
+      this->terrain->GetVertexCount().y, this->terrainSize,
+      samplesOf(this->terrain));
+  this->heightmapLoaded = true;
+}
+
+//////////////////////////////////////////////////
+void SceneIndex::Build()
+{
+  this->trees.Build(this->treeBoxes);
+  this->buildings.Build(this->buildingBoxes);
+}
+
+//////////////////////////////////////////////////
+const std::vector<std::string> &SceneIndex::ModelNames() const
+{
+  return this->modelNames;
+}
+
+//////////////////////////////////////////////////
+int SceneIndex::ModelId(const std::string &_name) const
+{
+  auto it = this->modelIds.find(_name);
+  return it != this->modelIds.end() ? it->second : -1;
+}
+
+//////////////////////////////////////////////////
+const std::vector<ignition::math::Box> &SceneIndex::TreeBoxes() const
+{
+  return this->treeBoxes;
+}
+
+//////////////////////////////////////////////////
+const std::vector<ignition::math::Box> &SceneIndex::BuildingBoxes() const
+{
+  return this->buildingBoxes;
+}
+
+//////////////////////////////////////////////////
+const BoxHierarchy &SceneIndex::Trees() const
+{
+  return this->trees;
+}
+
+//////////////////////////////////////////////////
+const BoxHierarchy &SceneIndex::Buildings() const
+{
+  return this->buildings;
+}
+
+//////////////////////////////////////////////////
+gazebo::physics::HeightmapShapePtr SceneIndex::Terrain() const
+{
+  return this->terrain;
+}
+
+//////////////////////////////////////////////////
+const ignition::math::Vector3d &SceneIndex::TerrainSize() const
+{
+  return this->terrainSize;
+}
+
+//////////////////////////////////////////////////
+const Heightmap &SceneIndex::TerrainHeightmap() const
+{
+  if (!this->heightmapLoaded)
+    this->LoadHeightmap();
+
+  return this->heightmap;
+}
+
+//////////////////////////////////////////////////
+std::shared_ptr<const TerrainTiles> SceneIndex::TerrainTileStore() const
+{
+  return this->tiles;
+}
+
+//////////////////////////////////////////////////
+uint64_t SceneIndex::TerrainHash() const
+{
+  return this->tiles ? this->tiles->Hash() : this->TerrainHeightmap().Hash();
+}
+
+//////////////////////////////////////////////////
+void SceneIndex::TerrainLookup(const size_t _count, const double *_x,
+    const double *_y, double *_height, ignition::math::Vector3d *_norm) const
+{
+  if (this->tiles)
+    this->tiles->Lookup(_count, _x, _y, _height, _norm);
+  else
+    this->heightmap.Lookup(_count, _x, _y, _height, _norm);
+}
+
+//////////////////////////////////////////////////
+void SceneIndex::PrefetchTerrain(const ignition::math::Vector3d &_pos,
+    const double _radius) const
+{
+  if (this->tiles)
+    this->tiles->Prefetch(_pos, _radius);
+}
+
+//////////////////////////////////////////////////
+void SceneIndex::OnMemory(MemoryReport &_report) const
+{
+  _report.Add("scene_index",
+      HeapBytes(this->modelNames) + HeapBytes(this->modelIds) +
+      HeapBytes(this->treeBoxes) + HeapBytes(this->buildingBoxes) +
+      this->trees.MemoryBytes() + this->buildings.MemoryBytes() +
+      (this->heightmapLoaded ? this->heightmap.MemoryBytes() : 0),
+      this->modelNames.size() + this->trees.Size() + this->buildings.Size());
+
+  if (this->tiles)
+  {
+    _report.Add("terrain_tiles", this->tiles->CacheBytes(),
+        this->tiles->CachedTiles());
+  }
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <string>
+#include <vector>
+#include <ignition/math/Box.hh>
+#include <ignition/math/Vector3.hh>
+#include "gtest/gtest.h"
+#include "swarm/SceneIndex.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Check the names and the boxes of the models in the index.
+TEST(SceneIndexTest, Models)
+{
+  SceneIndex index;
+  index.AddModel("ground_plane", ignition::math::Box(-100, -100, -1,
+        100, 100, 0));
+  index.AddModel("terrain", ignition::math::Box(-50, -50, 0, 50, 50, 10));
+  index.AddModel("tree_1", ignition::math::Box(-1, 9, 0, 1, 11, 8));
+  index.AddModel("ground_1", ignition::math::Box(0, 0, 0, 1, 1, 1));
+  index.AddModel("building_1", ignition::math::Box(19, -1, 0, 21, 1, 20));
+  index.AddModel("tree_2", ignition::math::Box(-1, 19, 0, 1, 21, 8));
+
+  // A model with the same name is ignored.
+  index.AddModel("tree_1", ignition::math::Box(5, 5, 0, 6, 6, 1));
+  index.Build();
+
+  const std::vector<std::string> names =
+    {"terrain", "tree_1", "ground_1", "building_1", "tree_2"};
+  EXPECT_EQ(index.ModelNames(), names);
+  for (size_t i = 0; i < names.size(); ++i)
+    EXPECT_EQ(index.ModelId(names[i]), static_cast<int>(i));
+  EXPECT_EQ(index.ModelId("ground_plane"), -1);
+  EXPECT_EQ(index.ModelId("unknown"), -1);
+
+  ASSERT_EQ(index.TreeBoxes().size(), 2u);
+  EXPECT_EQ(index.TreeBoxes()[0], ignition::math::Box(-1, 9, 0, 1, 11, 8));
+  ASSERT_EQ(index.BuildingBoxes().size(), 1u);
+  EXPECT_EQ(index.Trees().Size(), 2u);
+  EXPECT_EQ(index.Buildings().Size(), 1u);
+
+  // A ray along Y crosses both trees, and one along X the building.
+  double dist = 0;
+  EXPECT_EQ(index.Trees().Intersect(ignition::math::Vector3d(0, 0, 1),
+        ignition::math::Vector3d(0, 1, 0), 0, 250, 2, dist), 2u);
+  EXPECT_EQ(index.Buildings().Intersect(ignition::math::Vector3d(0, 0, 1),
+        ignition::math::Vector3d(1, 0, 0), 0, 250, 1, dist), 1u);
+  EXPECT_NEAR(dist, 19, 1e-6);
+
+  // No terrain.
+  EXPECT_FALSE(index.Terrain());
+  EXPECT_FALSE(index.TerrainHeightmap().Valid());
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
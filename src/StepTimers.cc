@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "swarm/StepTimers.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+StepTimers *StepTimers::Instance(const std::string &_world)
+{
+  static std::mutex mutex;
+  static std::map<std::string, std::unique_ptr<StepTimers>> instances;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  std::unique_ptr<StepTimers> &instance = instances[_world];
+  if (!instance)
+  {
+    instance.reset(new StepTimers());
+    instance->trace = StepTrace::Instance(_world);
+  }
+  return instance.get();
+}
+
+//////////////////////////////////////////////////
+const char *StepTimers::Name(const StepTimer _timer)
+{
+  static const char *kNames[TIMER_COUNT] =
+  {
+    "comms_model",
+    "notify_neighbors",
+    "dispatch",
+    "delivery",
+    "logger",
+    "poses",
+    "sensors",
+    "controllers",
+    "actuation"
+  };
+  return _timer < TIMER_COUNT ? kNames[_timer] : "";
+}
+
+//////////////////////////////////////////////////
+StepTimers::StepTimers()
+  : startTicks(Now()),
+    startTime(std::chrono::steady_clock::now())
+{
+#ifndef SWARM_NO_STEP_TIMERS
+  const char *timersEnv = std::getenv("SWARM_STEP_TIMERS");
+  this->enabled = timersEnv && std::string(timersEnv) == "1";
+#endif
+}
+
+//////////////////////////////////////////////////
+uint32_t StepTimers::Collect(uint64_t _ns[TIMER_COUNT])
+{
+  // The rate of the time stamp counter is measured over the whole run, so
+  // the conversion gets more accurate as the simulation goes.
+  double nsPerTick = 1.0;
+#if defined(__x86_64__) || defined(__i386__)
+  const uint64_t elapsedTicks = Now() - this->startTicks;
+  const double elapsedNs = std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now() - this->startTime).count();
+  if (elapsedTicks > 0)
+    nsPerTick = elapsedNs / elapsedTicks;
+#endif
+
+  for (int i = 0; i < TIMER_COUNT; ++i)
+  {
+    _ns[i] = static_cast<uint64_t>(this->ticks[i] * nsPerTick);
+    this->ticks[i] = 0;
+  }
+
+  const uint32_t counted = this->steps;
+  this->steps = 0;
+  return counted;
+}
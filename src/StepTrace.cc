@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "swarm/StepTrace.hh"
+
+using namespace swarm;
+
+std::atomic<uint32_t> StepTrace::signals(0);
+
+//////////////////////////////////////////////////
+/// \brief Write a string as a JSON string.
+/// \param[out] _out The stream.
+/// \param[in] _s The string.
+static void WriteJsonString(std::ostream &_out, const std::string &_s)
+{
+  _out << '"';
+  for (const char c : _s)
+  {
+    if (c == '"' || c == '\\')
+      _out << '\\' << c;
+    else if (static_cast<unsigned char>(c) < 0x20)
+      _out << ' ';
+    else
+      _out << c;
+  }
+  _out << '"';
+}
+
+//////////////////////////////////////////////////
+StepTrace *StepTrace::Instance(const std::string &_world)
+{
+  static std::mutex mutex;
+  static std::map<std::string, std::unique_ptr<StepTrace>> instances;
+
+#ifdef SWARM_NO_STEP_TIMERS
+  const char *prefixEnv = nullptr;
+#else
+  const char *prefixEnv = std::getenv("SWARM_STEP_TRACE");
+#endif
+  if (!prefixEnv || std::string(prefixEnv).empty())
+    return nullptr;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  std::unique_ptr<StepTrace> &instance = instances[_world];
+  if (!instance)
+  {
+    size_t capacity = 65536;
+    if (const char *spansEnv = std::getenv("SWARM_STEP_TRACE_SPANS"))
+      capacity = std::max(1L, std::atol(spansEnv));
+
+    double thresholdMs = 0;
+    const char *thresholdEnv = std::getenv("SWARM_STEP_TRACE_THRESHOLD");
+    if (thresholdEnv)
+      thresholdMs = std::max(0.0, std::atof(thresholdEnv));
+
+    // Several worlds in a process write their own files.
+    std::string prefix = prefixEnv;
+    if (instances.size() > 1)
+      prefix += "-" + _world;
+
+    instance.reset(new StepTrace(capacity, thresholdMs, prefix));
+    std::signal(SIGUSR2, &StepTrace::OnSignal);
+  }
+  return instance.get();
+}
+
+//////////////////////////////////////////////////
+StepTrace::StepTrace(const size_t _capacity, const double _thresholdMs,
+    const std::string &_prefix)
+  : ring(std::max<size_t>(1, _capacity)),
+    threshold(static_cast<int64_t>(_thresholdMs * 1e6)),
+    prefix(_prefix),
+    step(0),
+    handledSignals(signals.load()),
+    startTime(std::chrono::steady_clock::now())
+{
+}
+
+//////////////////////////////////////////////////
+int32_t StepTrace::Label(const std::string &_name)
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  auto inserted = this->labelIds.insert(
+      std::make_pair(_name, static_cast<int32_t>(this->labels.size())));
+  if (inserted.second)
+    this->labels.push_back(_name);
+  return inserted.first->second;
+}
+
+//////////////////////////////////////////////////
+void StepTrace::Record(const char *_name, const int32_t _label,
+    const int64_t _start, const int64_t _end)
+{
+  Span span;
+  span.name = _name;
+  span.label = _label;
+  span.thread = ThreadNumber();
+  span.step = this->step.load(std::memory_order_relaxed);
+  span.start = _start;
+  span.end = _end;
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->ring[this->recorded % this->ring.size()] = span;
+  ++this->recorded;
+}
+
+//////////////////////////////////////////////////
+void StepTrace::BeginStep(const uint64_t _step)
+{
+  this->step.store(_step, std::memory_order_relaxed);
+  this->stepStart = this->Now();
+}
+
+//////////////////////////////////////////////////
+void StepTrace::EndStep()
+{
+  if (this->stepStart < 0)
+    return;
+
+  const int64_t end = this->Now();
+  this->Record("step", -1, this->stepStart, end);
+
+  const uint32_t received = signals.load();
+  if (received != this->handledSignals)
+  {
+    this->handledSignals = received;
+    this->Dump("SIGUSR2");
+    return;
+  }
+
+  // The slow steps in a row are written once per ring.
+  const bool overwritten =
+    !this->dumped || this->Recorded() - this->dumpedAt >= this->ring.size();
+  if (this->threshold > 0 && end - this->stepStart > this->threshold &&
+      overwritten)
+  {
+    this->Dump("step " + std::to_string(this->step.load()) + " took " +
+        std::to_string((end - this->stepStart) / 1e6) + " ms");
+  }
+}
+
+//////////////////////////////////////////////////
+std::vector<StepTrace::Span> StepTrace::Spans() const
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  const size_t size = this->ring.size();
+  const uint64_t first = this->recorded > size ? this->recorded - size : 0;
+
+  std::vector<Span> spans;
+  spans.reserve(this->recorded - first);
+  for (uint64_t i = first; i < this->recorded; ++i)
+    spans.push_back(this->ring[i % size]);
+  return spans;
+}
+
+//////////////////////////////////////////////////
+void StepTrace::Write(std::ostream &_out) const
+{
+  const std::vector<Span> spans = this->Spans();
+  std::vector<std::string> names;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    names = this->labels;
+  }
+
+  // Complete events, in microseconds.
+  _out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  _out << std::fixed << std::setprecision(3);
+  for (size_t i = 0; i < spans.size(); ++i)
+  {
+    const Span &span = spans[i];
+    _out << (i > 0 ? ",\n" : "\n") << "{\"name\":";
+    WriteJsonString(_out, span.name);
+    _out << ",\"cat\":\"swarm\",\"ph\":\"X\",\"ts\":" << span.start / 1e3
+         << ",\"dur\":" << (span.end - span.start) / 1e3
+         << ",\"pid\":0,\"tid\":" << span.thread
+         << ",\"args\":{\"step\":" << span.step;
+    if (span.label >= 0 && static_cast<size_t>(span.label) < names.size())
+    {
+      _out << ",\"label\":";
+      WriteJsonString(_out, names[span.label]);
+    }
+    _out << "}}";
+  }
+  _out << "\n]}\n";
+}
+
+//////////////////////////////////////////////////
+bool StepTrace::Dump(const std::string &_reason)
+{
+  const std::string path =
+    this->prefix + "-" + std::to_string(this->files++) + ".json";
+  std::ofstream out(path);
+  if (out)
+    this->Write(out);
+  if (!out)
+  {
+    std::cerr << "StepTrace::Dump() Unable to write [" << path << "]"
+              << std::endl;
+    return false;
+  }
+
+  this->dumpedAt = this->Recorded();
+  this->dumped = true;
+  std::cout << "Step trace written to [" << path << "] (" << _reason << ")"
+            << std::endl;
+  return true;
+}
+
+//////////////////////////////////////////////////
+uint64_t StepTrace::Recorded() const
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->recorded;
+}
+
+//////////////////////////////////////////////////
+void StepTrace::OnSignal(int /*_signal*/)
+{
+  // Only the counter is touched, which is safe in a signal handler.
+  signals.fetch_add(1);
+}
+
+//////////////////////////////////////////////////
+uint32_t StepTrace::ThreadNumber()
+{
+  static std::atomic<uint32_t> threads(0);
+  static thread_local const uint32_t number = threads.fetch_add(1);
+  return number;
+}
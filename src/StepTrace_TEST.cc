@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <unistd.h>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "gtest/gtest.h"
+#include "swarm/StepTrace.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Get a path for a temporary file of the test.
+/// \param[in] _name Name of the file.
+/// \return The path.
+static std::string tmpPath(const std::string &_name)
+{
+  return "/tmp/step_trace_test_" + std::to_string(getpid()) + "_" + _name;
+}
+
+//////////////////////////////////////////////////
+/// \brief Check that the ring keeps the last spans, in order.
+TEST(StepTraceTest, Ring)
+{
+  StepTrace trace(4, 0, tmpPath("ring"));
+  EXPECT_EQ(trace.Label("uav_1"), 0);
+  EXPECT_EQ(trace.Label("uav_2"), 1);
+  EXPECT_EQ(trace.Label("uav_1"), 0);
+
+  trace.BeginStep(7);
+  for (int i = 0; i < 6; ++i)
+    trace.Record("controller", i % 2, i * 10, i * 10 + 5);
+  EXPECT_EQ(trace.Recorded(), 6u);
+
+  const std::vector<StepTrace::Span> spans = trace.Spans();
+  ASSERT_EQ(spans.size(), 4u);
+  for (size_t i = 0; i < spans.size(); ++i)
+  {
+    EXPECT_EQ(spans[i].start, static_cast<int64_t>(i + 2) * 10);
+    EXPECT_EQ(spans[i].end - spans[i].start, 5);
+    EXPECT_EQ(spans[i].step, 7u);
+    EXPECT_EQ(spans[i].label, static_cast<int32_t>(i % 2));
+  }
+
+  // The spans of the other threads get their own number.
+  uint32_t mainThread = spans[0].thread;
+  std::thread worker([&trace]()
+      {
+        trace.Record("comms_visibility", -1, 100, 200);
+      });
+  worker.join();
+  EXPECT_NE(trace.Spans().back().thread, mainThread);
+}
+
+//////////////////////////////////////////////////
+/// \brief Check the Chrome trace events.
+TEST(StepTraceTest, Write)
+{
+  StepTrace trace(16, 0, tmpPath("write"));
+  const int32_t label = trace.Label("ground_\"1\"");
+  trace.BeginStep(3);
+  trace.Record("poses", -1, 1000, 3500);
+  trace.Record("controller", label, 4000, 4500);
+
+  std::ostringstream out;
+  trace.Write(out);
+  const std::string json = out.str();
+  EXPECT_EQ(json.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["), 0u);
+  EXPECT_NE(json.find("{\"name\":\"poses\",\"cat\":\"swarm\",\"ph\":\"X\","
+        "\"ts\":1.000,\"dur\":2.500,\"pid\":0,\"tid\":"), std::string::npos);
+  EXPECT_NE(json.find("\"args\":{\"step\":3}}"), std::string::npos);
+  EXPECT_NE(json.find("\"args\":{\"step\":3,\"label\":\"ground_\\\"1\\\"\"}}"),
+      std::string::npos);
+  EXPECT_EQ(json.substr(json.size() - 4), "\n]}\n");
+}
+
+//////////////////////////////////////////////////
+/// \brief Check that a slow step writes the ring once.
+TEST(StepTraceTest, SlowStep)
+{
+  const std::string prefix = tmpPath("slow");
+  StepTrace trace(64, 0.001, prefix);
+
+  // Steps over a microsecond.
+  for (int step = 0; step < 3; ++step)
+  {
+    trace.BeginStep(step);
+    trace.Record("logger", -1, trace.Now(), trace.Now() + 10);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    trace.EndStep();
+  }
+
+  std::ifstream first(prefix + "-0.json");
+  EXPECT_TRUE(first.good());
+  std::ifstream second(prefix + "-1.json");
+  EXPECT_FALSE(second.good());
+
+  std::stringstream contents;
+  contents << first.rdbuf();
+  EXPECT_NE(contents.str().find("\"name\":\"step\""), std::string::npos);
+  std::remove((prefix + "-0.json").c_str());
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
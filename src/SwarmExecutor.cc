@@ -0,0 +1,868 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <gazebo/common/Console.hh>
+#include <gazebo/physics/physics.hh>
+#include "swarm/RobotPlugin.hh"
+#include "swarm/SwarmExecutor.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Move the last value of a vector to a slot, and drop it.
+/// \param[in,out] _values The vector.
+/// \param[in] _slot The slot.
+template <typename T>
+static void moveLast(std::vector<T> &_values, const size_t _slot)
+{
+  _values[_slot] = _values.back();
+  _values.pop_back();
+}
+
+/// \brief What happens to the pose of a robot at the end of a step.
+enum PoseCommit : uint8_t
+{
+  /// \brief The pose is left as it is.
+  POSE_KEPT = 0,
+
+  /// \brief The pose is set to the adjusted pose.
+  POSE_ADJUSTED = 1,
+
+  /// \brief The pose is set to the pose of the carrier.
+  POSE_FOLLOWED = 2
+};
+
+//////////////////////////////////////////////////
+SwarmExecutor *SwarmExecutor::Instance(const std::string &_world)
+{
+  static std::mutex mutex;
+  static std::map<std::string, std::unique_ptr<SwarmExecutor>> instances;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  std::unique_ptr<SwarmExecutor> &instance = instances[_world];
+  if (!instance)
+    instance.reset(new SwarmExecutor());
+  return instance.get();
+}
+
+//////////////////////////////////////////////////
+bool SwarmExecutor::ParseOverrunPolicy(const std::string &_name,
+    OverrunPolicy &_policy)
+{
+  if (_name == "none")
+    _policy = OVERRUN_NONE;
+  else if (_name == "skip")
+    _policy = OVERRUN_SKIP;
+  else if (_name == "throttle")
+    _policy = OVERRUN_THROTTLE;
+  else
+    return false;
+  return true;
+}
+
+//////////////////////////////////////////////////
+void SwarmExecutor::Add(RobotPlugin *_robot)
+{
+  _robot->executor = this;
+  _robot->executorSlot = this->robots.size();
+  this->robots.push_back(_robot);
+  this->poses = _robot->poses;
+  this->timers = StepTimers::Instance(_robot->world->GetName());
+
+  // The physics step size doesn't change during the simulation, so the
+  // battery changes by the same amount every step while the robot stays
+  // charging or not. The BOO doesn't use its battery.
+  if (_robot->maxStepSize > 0)
+    this->stepSize = _robot->maxStepSize;
+  const double hours = this->stepSize / 3600.0;
+  const bool boo = _robot->model->GetName() == "boo";
+  this->capacity.push_back(_robot->capacity);
+  this->startCapacity.push_back(_robot->startCapacity);
+  this->drain.push_back(boo ? 0 :
+      _robot->consumption * _robot->consumptionFactor * hours);
+  this->recharge.push_back(boo ? 0 :
+      _robot->consumption * (_robot->consumptionFactor * 4) * hours);
+  this->charging.push_back(0);
+  this->batteryFrom.push_back(this->batterySteps);
+  this->depletedAt.push_back(0);
+  this->ScheduleDepletion(this->robots.size() - 1);
+
+  // An update is due every period, the first step after 1 / _rate s, and
+  // each robot takes the next step of the period.
+  auto schedule = [this](const double _rate, std::vector<uint32_t> &_period,
+      std::vector<uint32_t> &_phase)
+  {
+    const double steps = _rate > 0 ?
+      std::ceil(1.0 / (_rate * this->stepSize) - 1e-6) : 1.0;
+    const uint32_t period = static_cast<uint32_t>(std::min(
+          std::max(steps, 1.0),
+          static_cast<double>(std::numeric_limits<uint32_t>::max())));
+    _period.push_back(period);
+    _phase.push_back(static_cast<uint32_t>(this->added % period));
+  };
+  schedule(_robot->sensorsUpdateRate, this->sensorPeriod, this->sensorPhase);
+  schedule(_robot->terrainUpdateRate, this->terrainPeriod,
+      this->terrainPhase);
+  schedule(_robot->controllerUpdateRate, this->controllerPeriod,
+      this->controllerPhase);
+  this->pending.push_back(0);
+  this->asleep.push_back(0);
+  this->waitEvents.push_back(0);
+  this->waitPort.push_back(-1);
+  this->waitTime.push_back(0);
+  this->firedEvents.push_back(0);
+  this->wokenBy.push_back(0);
+  StepTrace *trace = this->timers->Trace();
+  this->traceLabel.push_back(trace ? trace->Label(_robot->address) : -1);
+  this->sleepPose.push_back(ignition::math::Pose3d());
+  this->adjustedPose.push_back(ignition::math::Pose3d());
+  this->poseCommit.push_back(POSE_KEPT);
+  ++this->added;
+
+  this->timeBudget.push_back(_robot->controllerTimeBudget);
+  this->overrunPolicy.push_back(_robot->controllerOverrunPolicy);
+  this->overrunLimit.push_back(_robot->controllerOverrunLimit);
+  this->overrunStreak.push_back(0);
+  this->overrunDebt.push_back(0);
+  this->disabled.push_back(0);
+  this->controllerUpdates.push_back(0);
+  this->controllerOverruns.push_back(0);
+  this->controllerSkipped.push_back(0);
+  this->controllerWallTime.push_back(0);
+  this->controllerMaxWallTime.push_back(0);
+
+  // The smallest budget requested by the robots applies to the swarm.
+  if (_robot->controllerBudget > 0 &&
+      (this->budget == 0 || _robot->controllerBudget < this->budget))
+  {
+    this->budget = _robot->controllerBudget;
+  }
+
+  if (!this->updateConnection)
+  {
+    this->updateConnection = gazebo::event::Events::ConnectWorldUpdateBegin(
+        std::bind(&SwarmExecutor::Step, this, std::placeholders::_1));
+    this->checkpointer = Checkpointer::Instance(_robot->world->GetName());
+    this->checkpointer->Register("executor", this);
+    this->memory = MemoryAccounting::Instance(_robot->world->GetName());
+    this->memory->Register("executor", this);
+  }
+}
+
+//////////////////////////////////////////////////
+void SwarmExecutor::Remove(RobotPlugin *_robot)
+{
+  if (_robot->executor != this)
+    return;
+
+  // Move the last robot to the slot.
+  const size_t slot = _robot->executorSlot;
+  const size_t last = this->robots.size() - 1;
+  this->robots[slot] = this->robots[last];
+  this->robots[slot]->executorSlot = slot;
+  this->robots.pop_back();
+
+  // The robot keeps its capacity.
+  _robot->capacity = this->BatteryCapacity(slot);
+  _robot->executor = nullptr;
+
+  moveLast(this->capacity, slot);
+  moveLast(this->startCapacity, slot);
+  moveLast(this->drain, slot);
+  moveLast(this->recharge, slot);
+  moveLast(this->charging, slot);
+  moveLast(this->batteryFrom, slot);
+  moveLast(this->depletedAt, slot);
+  moveLast(this->sensorPeriod, slot);
+  moveLast(this->sensorPhase, slot);
+  moveLast(this->terrainPeriod, slot);
+  moveLast(this->terrainPhase, slot);
+  moveLast(this->controllerPeriod, slot);
+  moveLast(this->controllerPhase, slot);
+  moveLast(this->pending, slot);
+  moveLast(this->asleep, slot);
+  moveLast(this->waitEvents, slot);
+  moveLast(this->waitPort, slot);
+  moveLast(this->waitTime, slot);
+  moveLast(this->firedEvents, slot);
+  moveLast(this->wokenBy, slot);
+  moveLast(this->traceLabel, slot);
+  moveLast(this->sleepPose, slot);
+  moveLast(this->adjustedPose, slot);
+  moveLast(this->poseCommit, slot);
+  moveLast(this->timeBudget, slot);
+  moveLast(this->overrunPolicy, slot);
+  moveLast(this->overrunLimit, slot);
+  moveLast(this->overrunStreak, slot);
+  moveLast(this->overrunDebt, slot);
+  moveLast(this->disabled, slot);
+  moveLast(this->controllerUpdates, slot);
+  moveLast(this->controllerOverruns, slot);
+  moveLast(this->controllerSkipped, slot);
+  moveLast(this->controllerWallTime, slot);
+  moveLast(this->controllerMaxWallTime, slot);
+
+  this->waiting.erase(
+      std::remove(this->waiting.begin(), this->waiting.end(), slot),
+      this->waiting.end());
+  std::replace(this->waiting.begin(), this->waiting.end(), last, slot);
+
+  if (this->robots.empty())
+  {
+    gazebo::event::Events::DisconnectWorldUpdateBegin(
+        this->updateConnection);
+    this->updateConnection.reset();
+    this->checkpointer->Unregister("executor");
+    this->memory->Unregister("executor");
+  }
+}
+
+//////////////////////////////////////////////////
+size_t SwarmExecutor::Size() const
+{
+  return this->robots.size();
+}
+
+//////////////////////////////////////////////////
+double SwarmExecutor::BatteryCapacity(const size_t _slot) const
+{
+  // The consumption is constant while the robot doesn't start or stop
+  // charging.
+  const uint64_t steps = this->batterySteps - this->batteryFrom[_slot];
+  if (steps == 0)
+    return this->capacity[_slot];
+
+  if (this->charging[_slot])
+  {
+    return std::min(this->capacity[_slot] + this->recharge[_slot] * steps,
+        this->startCapacity[_slot]);
+  }
+
+  if (this->batterySteps >= this->depletedAt[_slot])
+    return 0.0;
+  return std::max(0.0, this->capacity[_slot] - this->drain[_slot] * steps);
+}
+
+//////////////////////////////////////////////////
+void SwarmExecutor::SetBatteryCapacity(const size_t _slot,
+    const double _capacity)
+{
+  this->capacity[_slot] = _capacity;
+  this->batteryFrom[_slot] = this->batterySteps;
+  this->ScheduleDepletion(_slot);
+}
+
+//////////////////////////////////////////////////
+void SwarmExecutor::ScheduleDepletion(const size_t _slot)
+{
+  const double current = this->capacity[_slot];
+  const double rate = this->charging[_slot] ? 0 : this->drain[_slot];
+  if (this->charging[_slot] && this->recharge[_slot] > 0)
+    this->depletedAt[_slot] = std::numeric_limits<uint64_t>::max();
+  else if (current <= 0)
+    this->depletedAt[_slot] = this->batteryFrom[_slot];
+  else if (rate <= 0 || current / rate >= 1e18)
+    this->depletedAt[_slot] = std::numeric_limits<uint64_t>::max();
+  else
+  {
+    this->depletedAt[_slot] = this->batteryFrom[_slot] +
+      static_cast<uint64_t>(std::ceil(current / rate));
+  }
+}
+
+//////////////////////////////////////////////////
+unsigned int SwarmExecutor::Budget() const
+{
+  return this->budget;
+}
+
+//////////////////////////////////////////////////
+void SwarmExecutor::SetBudget(const unsigned int _budget)
+{
+  this->budget = _budget;
+}
+
+//////////////////////////////////////////////////
+size_t SwarmExecutor::Waiting() const
+{
+  return this->waiting.size();
+}
+
+//////////////////////////////////////////////////
+void SwarmExecutor::FillControllerTiming(const size_t _slot,
+    msgs::ControllerTiming &_timing) const
+{
+  _timing.set_budget(this->timeBudget[_slot]);
+  _timing.set_updates(this->controllerUpdates[_slot]);
+  _timing.set_overruns(this->controllerOverruns[_slot]);
+  _timing.set_skipped(this->controllerSkipped[_slot]);
+  _timing.set_wall_time(this->controllerWallTime[_slot]);
+  _timing.set_max_wall_time(this->controllerMaxWallTime[_slot]);
+}
+
+//////////////////////////////////////////////////
+void SwarmExecutor::OnSave(msgs::CheckpointPart &_part) const
+{
+  msgs::ExecutorState *state = _part.mutable_executor();
+  state->set_last_step(this->lastStep);
+  for (size_t i = 0; i < this->robots.size(); ++i)
+  {
+    state->add_address(this->robots[i]->address);
+    state->add_capacity(this->BatteryCapacity(i));
+    state->add_charging(this->charging[i] != 0);
+    state->add_pending(this->pending[i] != 0);
+    state->add_asleep(this->asleep[i] != 0);
+    state->add_wait_events(this->waitEvents[i]);
+    state->add_wait_port(this->waitPort[i]);
+    state->add_wait_time(this->waitTime[i]);
+    state->add_fired_events(this->firedEvents[i]);
+  }
+  for (const size_t i : this->waiting)
+    state->add_waiting(this->robots[i]->address);
+}
+
+//////////////////////////////////////////////////
+bool SwarmExecutor::OnRestore(const msgs::CheckpointPart &_part)
+{
+  const msgs::ExecutorState &state = _part.executor();
+  if (!_part.has_executor() || state.capacity_size() != state.address_size() ||
+      state.charging_size() != state.address_size() ||
+      state.pending_size() != state.address_size())
+  {
+    return false;
+  }
+
+  std::map<std::string, size_t> slots;
+  for (size_t i = 0; i < this->robots.size(); ++i)
+    slots[this->robots[i]->address] = i;
+
+  // The robots missing from the checkpoint keep their state.
+  bool restored = static_cast<size_t>(state.address_size()) ==
+    this->robots.size();
+  for (int k = 0; k < state.address_size(); ++k)
+  {
+    auto slot = slots.find(state.address(k));
+    if (slot == slots.end())
+    {
+      restored = false;
+      continue;
+    }
+    this->charging[slot->second] = state.charging(k);
+    this->SetBatteryCapacity(slot->second, state.capacity(k));
+    this->pending[slot->second] = state.pending(k);
+
+    // The robots fell asleep where they are restored.
+    this->asleep[slot->second] =
+      k < state.asleep_size() && state.asleep(k);
+    if (this->asleep[slot->second])
+    {
+      this->sleepPose[slot->second] =
+        this->robots[slot->second]->model->GetWorldPose().Ign();
+    }
+
+    // The checkpoints without the waits resume every controller.
+    const bool waits = k < state.wait_events_size() &&
+      k < state.wait_port_size() && k < state.wait_time_size() &&
+      k < state.fired_events_size();
+    this->waitEvents[slot->second] = waits ? state.wait_events(k) : 0;
+    this->waitPort[slot->second] = waits ? state.wait_port(k) : -1;
+    this->waitTime[slot->second] = waits ? state.wait_time(k) : 0;
+    this->firedEvents[slot->second] = waits ? state.fired_events(k) : 0;
+  }
+
+  this->waiting.clear();
+  for (auto const &address : state.waiting())
+  {
+    auto slot = slots.find(address);
+    if (slot != slots.end())
+      this->waiting.push_back(slot->second);
+  }
+
+  this->lastStep = state.last_step();
+  return restored;
+}
+
+//////////////////////////////////////////////////
+void SwarmExecutor::OnMemory(MemoryReport &_report) const
+{
+  const uint64_t bytes = HeapBytes(this->robots) +
+    HeapBytes(this->capacity) + HeapBytes(this->startCapacity) +
+    HeapBytes(this->drain) + HeapBytes(this->recharge) +
+    HeapBytes(this->charging) + HeapBytes(this->batteryFrom) +
+    HeapBytes(this->depletedAt) + HeapBytes(this->sensorPeriod) +
+    HeapBytes(this->sensorPhase) + HeapBytes(this->terrainPeriod) +
+    HeapBytes(this->terrainPhase) + HeapBytes(this->controllerPeriod) +
+    HeapBytes(this->controllerPhase) + HeapBytes(this->pending) +
+    HeapBytes(this->asleep) + HeapBytes(this->waitEvents) +
+    HeapBytes(this->waitPort) + HeapBytes(this->waitTime) +
+    HeapBytes(this->firedEvents) + HeapBytes(this->wokenBy) +
+    HeapBytes(this->traceLabel) +
+    HeapBytes(this->sleepPose) +
+    HeapBytes(this->adjustedPose) + HeapBytes(this->poseCommit) +
+    HeapBytes(this->waiting) + HeapBytes(this->due) +
+    HeapBytes(this->parallelDue) + HeapBytes(this->timeBudget) +
+    HeapBytes(this->overrunPolicy) + HeapBytes(this->overrunLimit) +
+    HeapBytes(this->overrunStreak) + HeapBytes(this->overrunDebt) +
+    HeapBytes(this->disabled) + HeapBytes(this->controllerUpdates) +
+    HeapBytes(this->controllerOverruns) + HeapBytes(this->controllerSkipped) +
+    HeapBytes(this->controllerWallTime) +
+    HeapBytes(this->controllerMaxWallTime);
+  _report.Add("executor", bytes, this->robots.size());
+}
+
+//////////////////////////////////////////////////
+void SwarmExecutor::Wait(const size_t _slot, const unsigned int _events,
+    const int _port, const double _simTime)
+{
+  const uint8_t awaited = this->waitEvents[_slot];
+  if (_events & RobotPlugin::WAKE_MESSAGE)
+  {
+    if (!(awaited & RobotPlugin::WAKE_MESSAGE))
+      this->waitPort[_slot] = _port;
+    else if (this->waitPort[_slot] != _port)
+      this->waitPort[_slot] = -1;
+  }
+  if (_events & RobotPlugin::WAKE_TIME)
+  {
+    this->waitTime[_slot] = (awaited & RobotPlugin::WAKE_TIME) ?
+      std::min(this->waitTime[_slot], _simTime) : _simTime;
+  }
+  this->waitEvents[_slot] = awaited | static_cast<uint8_t>(_events);
+}
+
+//////////////////////////////////////////////////
+void SwarmExecutor::Wake(const size_t _slot, const unsigned int _event,
+    const int _port)
+{
+  if (!(this->waitEvents[_slot] & _event))
+    return;
+
+  if (_event == RobotPlugin::WAKE_MESSAGE && this->waitPort[_slot] >= 0 &&
+      _port != this->waitPort[_slot])
+  {
+    return;
+  }
+
+  this->firedEvents[_slot] |= static_cast<uint8_t>(_event);
+}
+
+//////////////////////////////////////////////////
+unsigned int SwarmExecutor::WokenBy(const size_t _slot) const
+{
+  return this->wokenBy[_slot];
+}
+
+//////////////////////////////////////////////////
+bool SwarmExecutor::Resume(const size_t _slot, const double _simTime)
+{
+  const uint8_t awaited = this->waitEvents[_slot];
+  if (!awaited)
+  {
+    this->wokenBy[_slot] = 0;
+    return true;
+  }
+
+  // Half a step absorbs the rounding of the simulation time.
+  if ((awaited & RobotPlugin::WAKE_TIME) &&
+      _simTime >= this->waitTime[_slot] - this->stepSize / 2)
+  {
+    this->firedEvents[_slot] |= RobotPlugin::WAKE_TIME;
+  }
+
+  if (!this->firedEvents[_slot])
+    return false;
+
+  this->wokenBy[_slot] = this->firedEvents[_slot];
+  this->waitEvents[_slot] = 0;
+  this->firedEvents[_slot] = 0;
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool SwarmExecutor::Due(const uint64_t _step, const uint32_t _period,
+    const uint32_t _phase)
+{
+  return (_step + _phase) % _period == 0;
+}
+
+//////////////////////////////////////////////////
+void SwarmExecutor::UpdateBatteries()
+{
+  // The capacity is only computed again when a robot starts or stops
+  // charging. Otherwise it follows from the steps since then.
+  for (size_t i = 0; i < this->robots.size(); ++i)
+  {
+    const uint8_t now = this->robots[i]->Recharging();
+    if (now != this->charging[i])
+    {
+      const double current = this->BatteryCapacity(i);
+      this->charging[i] = now;
+      this->SetBatteryCapacity(i, current);
+    }
+  }
+
+  ++this->batterySteps;
+}
+
+//////////////////////////////////////////////////
+void SwarmExecutor::UpdateParallel(const gazebo::common::UpdateInfo &_info)
+{
+  if (!this->pool)
+    this->pool.reset(new WorkerPool(0));
+
+  for (const size_t i : this->parallelDue)
+    this->robots[i]->deferEffects = true;
+
+  // The workers take the next controller as they finish the previous one,
+  // so the slow controllers don't hold back the others.
+  this->pool->Run(static_cast<unsigned int>(this->parallelDue.size()),
+      [this, &_info](const unsigned int _index, const unsigned int)
+      {
+        this->RunController(this->parallelDue[_index], _info);
+      });
+
+  // Apply the effects in address order, so they don't depend on which
+  // thread ran each controller.
+  std::sort(this->parallelDue.begin(), this->parallelDue.end(),
+      [this](const size_t _a, const size_t _b)
+      {
+        return this->robots[_a]->address < this->robots[_b]->address;
+      });
+  for (const size_t i : this->parallelDue)
+  {
+    this->robots[i]->deferEffects = false;
+    this->robots[i]->ApplyDeferredEffects();
+  }
+}
+
+//////////////////////////////////////////////////
+bool SwarmExecutor::SkipController(const size_t _slot)
+{
+  if (this->disabled[_slot])
+  {
+    ++this->controllerSkipped[_slot];
+    return true;
+  }
+
+  // Each update skipped repays one budget.
+  if (this->overrunDebt[_slot] > 0)
+  {
+    this->overrunDebt[_slot] =
+      std::max(0.0, this->overrunDebt[_slot] - this->timeBudget[_slot]);
+    ++this->controllerSkipped[_slot];
+    return true;
+  }
+
+  return false;
+}
+
+//////////////////////////////////////////////////
+void SwarmExecutor::RunController(const size_t _slot,
+    const gazebo::common::UpdateInfo &_info)
+{
+  auto start = std::chrono::steady_clock::now();
+  {
+    ScopedTraceSpan span(this->timers->Trace(), "controller",
+        this->traceLabel[_slot]);
+    this->robots[_slot]->Update(_info);
+  }
+  const double wallTime = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+
+  // Each parallel controller has its own slot.
+  this->AccountController(_slot, wallTime);
+}
+
+//////////////////////////////////////////////////
+void SwarmExecutor::AccountController(const size_t _slot,
+    const double _wallTime)
+{
+  ++this->controllerUpdates[_slot];
+  this->controllerWallTime[_slot] += _wallTime;
+  this->controllerMaxWallTime[_slot] =
+    std::max(this->controllerMaxWallTime[_slot], _wallTime);
+
+  const double allowed = this->timeBudget[_slot];
+  if (allowed <= 0)
+    return;
+
+  if (_wallTime <= allowed)
+  {
+    this->overrunStreak[_slot] = 0;
+    return;
+  }
+
+  ++this->controllerOverruns[_slot];
+  ++this->overrunStreak[_slot];
+  if (this->overrunStreak[_slot] < this->overrunLimit[_slot])
+    return;
+
+  switch (this->overrunPolicy[_slot])
+  {
+    case OVERRUN_SKIP:
+      this->disabled[_slot] = 1;
+      gzerr << "[" << this->robots[_slot]->address << "] The controller "
+            << "took " << _wallTime << " s, over its budget of " << allowed
+            << " s in " << this->overrunStreak[_slot] << " updates in a "
+            << "row. It isn't updated anymore." << std::endl;
+      break;
+    case OVERRUN_THROTTLE:
+      this->overrunDebt[_slot] += _wallTime - allowed;
+      break;
+    default:
+      break;
+  }
+}
+
+//////////////////////////////////////////////////
+void SwarmExecutor::UpdateControllers(const gazebo::common::UpdateInfo &_info,
+    const uint64_t _step)
+{
+  // The controllers left over by the budget go first. The ones waiting
+  // for events only count once they resume.
+  this->due.clear();
+  std::swap(this->due, this->waiting);
+  const double simTime = _info.simTime.Double();
+  for (size_t i = 0; i < this->robots.size(); ++i)
+  {
+    if (!this->pending[i] &&
+        Due(_step, this->controllerPeriod[i], this->controllerPhase[i]) &&
+        this->Resume(i, simTime))
+    {
+      this->pending[i] = 1;
+      this->due.push_back(i);
+    }
+  }
+
+  if (this->budget > 0 && this->due.size() > this->budget)
+  {
+    this->waiting.assign(this->due.begin() + this->budget, this->due.end());
+    this->due.resize(this->budget);
+  }
+
+  // The parallel controllers run together once the others are done.
+  this->parallelDue.clear();
+  for (const size_t i : this->due)
+  {
+    this->pending[i] = 0;
+    if (this->SkipController(i))
+      continue;
+    if (this->robots[i]->parallelController)
+      this->parallelDue.push_back(i);
+    else
+      this->RunController(i, _info);
+  }
+  if (!this->parallelDue.empty())
+    this->UpdateParallel(_info);
+}
+
+//////////////////////////////////////////////////
+void SwarmExecutor::Step(const gazebo::common::UpdateInfo &_info)
+{
+  if (this->robots.empty())
+    return;
+
+  const size_t n = this->robots.size();
+  const uint64_t step = static_cast<uint64_t>(
+      std::llround(std::max(0.0, _info.simTime.Double()) / this->stepSize));
+
+  // The steps go back when the simulation is reset.
+  const bool reset = step < this->lastStep;
+  this->lastStep = step;
+  if (reset)
+  {
+    this->waiting.clear();
+    std::fill(this->pending.begin(), this->pending.end(), 0);
+    std::fill(this->asleep.begin(), this->asleep.end(), 0);
+    std::fill(this->waitEvents.begin(), this->waitEvents.end(), 0);
+    std::fill(this->firedEvents.begin(), this->firedEvents.end(), 0);
+    std::fill(this->wokenBy.begin(), this->wokenBy.end(), 0);
+  }
+
+  // Read the poses of the swarm once per step, and the terrain under the
+  // robots due.
+  {
+    ScopedStepTimer timer(this->timers, TIMER_POSES);
+    this->poses->Capture(_info.simTime);
+    for (size_t i = 0; i < n; ++i)
+    {
+      RobotPlugin *robot = this->robots[i];
+      robot->UpdatePoseIds();
+
+      // A robot moved while asleep wakes up.
+      if (this->asleep[i] && (robot->poseId < 0 ||
+            !PoseSnapshot::Same(this->poses->Pose(robot->poseId),
+              this->sleepPose[i])))
+      {
+        this->asleep[i] = 0;
+      }
+
+      if (!this->asleep[i] &&
+          Due(step, this->terrainPeriod[i], this->terrainPhase[i]))
+      {
+        robot->UpdateTerrainType();
+      }
+    }
+
+    this->UpdateBatteries();
+  }
+
+  // Only update sensors if we have enough juice.
+  {
+    ScopedStepTimer timer(this->timers, TIMER_SENSORS);
+    for (size_t i = 0; i < n; ++i)
+    {
+      // The replayed robots get their observations and messages from the
+      // log, whatever their battery.
+      RobotPlugin *robot = this->robots[i];
+      if (robot->replayLog && !reset)
+        robot->ReplayStep();
+      else if (robot->recordReplay && !reset)
+        robot->RecordStep();
+
+      if (this->batterySteps >= this->depletedAt[i])
+        continue;
+
+      // The replayed observations follow the sensor period of the run.
+      if (!reset && Due(step, this->sensorPeriod[i], this->sensorPhase[i]))
+      {
+        if (!robot->replayLog)
+        {
+          ScopedTraceSpan span(this->timers->Trace(), "robot_sensors",
+              this->traceLabel[i]);
+          robot->UpdateSensors();
+        }
+        this->Wake(i, RobotPlugin::WAKE_SENSORS);
+      }
+      robot->SetLinearVelocity(0, 0, 0);
+      robot->SetAngularVelocity(0, 0, 0);
+    }
+  }
+
+  // After a reset, the controllers start again in the next step.
+  if (reset)
+    return;
+
+  {
+    ScopedStepTimer timer(this->timers, TIMER_CONTROLLERS);
+
+    // The messages of the endpoints bound in a batch arrive together.
+    for (RobotPlugin *robot : this->robots)
+      robot->DeliverBatch();
+
+    this->UpdateControllers(_info, step);
+  }
+
+  // The lazy sensors the controllers read are computed before the world
+  // moves.
+  {
+    ScopedStepTimer timer(this->timers, TIMER_SENSORS);
+    for (RobotPlugin *robot : this->robots)
+      robot->SettleSensors();
+  }
+
+  ScopedStepTimer timer(this->timers, TIMER_ACTUATION);
+
+  // The robots commanded to move, or docked, wake up.
+  for (size_t i = 0; i < n; ++i)
+  {
+    if (this->asleep[i] && this->robots[i]->Restless())
+      this->asleep[i] = 0;
+  }
+
+  // Apply the controllers' actions to the simulation.
+  for (size_t i = 0; i < n; ++i)
+  {
+    if (this->asleep[i])
+      continue;
+    this->robots[i]->UpdateLinearVelocity();
+    this->robots[i]->UpdateAngularVelocity();
+  }
+
+  // Move the kinematic robots, which the physics engine doesn't.
+  for (size_t i = 0; i < n; ++i)
+  {
+    if (!this->asleep[i] && this->robots[i]->kinematic)
+      this->robots[i]->IntegratePose();
+  }
+
+  // Constrain the poses to the terrain, without setting them yet.
+  for (size_t i = 0; i < n; ++i)
+  {
+    RobotPlugin *robot = this->robots[i];
+    this->poseCommit[i] = POSE_KEPT;
+    if (this->asleep[i] || !robot->common.Terrain() || !robot->model)
+      continue;
+
+    if (robot->type == RobotPlugin::ROTOR && robot->rotorDocked)
+      this->poseCommit[i] = POSE_FOLLOWED;
+    else if (robot->ConstrainPose(this->adjustedPose[i]))
+      this->poseCommit[i] = POSE_ADJUSTED;
+  }
+
+  // Set the poses that change in a single pass, then move the docked
+  // rotors where their carriers now are.
+  for (size_t i = 0; i < n; ++i)
+  {
+    if (this->poseCommit[i] == POSE_ADJUSTED)
+      this->robots[i]->model->SetWorldPose(this->adjustedPose[i]);
+  }
+  for (size_t i = 0; i < n; ++i)
+  {
+    if (this->poseCommit[i] == POSE_FOLLOWED)
+    {
+      RobotPlugin *robot = this->robots[i];
+      robot->model->SetWorldPose(robot->rotorDockVehicle->GetWorldPose());
+    }
+  }
+
+  // Let the robots left still sleep.
+  for (size_t i = 0; i < n; ++i)
+  {
+    if (!this->asleep[i])
+      this->Sleep(i);
+  }
+}
+
+//////////////////////////////////////////////////
+void SwarmExecutor::Sleep(const size_t _slot)
+{
+  RobotPlugin *robot = this->robots[_slot];
+  if (robot->poseId < 0 || robot->Restless() ||
+      robot->model->GetWorldLinearVel().Ign() !=
+        ignition::math::Vector3d::Zero ||
+      robot->model->GetWorldAngularVel().Ign() !=
+        ignition::math::Vector3d::Zero)
+  {
+    return;
+  }
+
+  const ignition::math::Pose3d pose = robot->model->GetWorldPose().Ign();
+  if (!PoseSnapshot::Same(pose, this->poses->Pose(robot->poseId)))
+    return;
+
+  this->asleep[_slot] = 1;
+  this->sleepPose[_slot] = pose;
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <cmath>
+#include "swarm/TangentPlane.hh"
+
+using namespace swarm;
+
+/// \brief Number of Newton steps of Unproject().
+static const int kNewtonSteps = 3;
+
+//////////////////////////////////////////////////
+/// \brief Evaluate a quadratic polynomial.
+/// \param[in] _c Coefficients.
+/// \param[in] _u Latitude offset.
+/// \param[in] _v Longitude offset.
+/// \return The value.
+static inline double evaluate(const double *_c, const double _u,
+    const double _v)
+{
+  return _c[0] + _u * (_c[1] + _c[3] * _u + _c[5] * _v) +
+    _v * (_c[2] + _c[4] * _v);
+}
+
+//////////////////////////////////////////////////
+bool TangentPlane::Fit(const double _lat, const double _lon,
+    const Conversion &_conversion, const double _step)
+{
+  this->det = 0;
+  if (!(_step > 0))
+    return false;
+
+  this->lat0 = _lat;
+  this->lon0 = _lon;
+
+  const double h = _step;
+  const ignition::math::Vector3d p00 = _conversion(_lat, _lon);
+  const ignition::math::Vector3d pu1 = _conversion(_lat + h, _lon);
+  const ignition::math::Vector3d pu0 = _conversion(_lat - h, _lon);
+  const ignition::math::Vector3d pv1 = _conversion(_lat, _lon + h);
+  const ignition::math::Vector3d pv0 = _conversion(_lat, _lon - h);
+  const ignition::math::Vector3d p11 = _conversion(_lat + h, _lon + h);
+  const ignition::math::Vector3d p10 = _conversion(_lat + h, _lon - h);
+  const ignition::math::Vector3d p01 = _conversion(_lat - h, _lon + h);
+  const ignition::math::Vector3d p0m = _conversion(_lat - h, _lon - h);
+
+  for (int i = 0; i < 2; ++i)
+  {
+    auto f = [i](const ignition::math::Vector3d &_p)
+    {
+      return i == 0 ? _p.X() : _p.Y();
+    };
+    double *c = i == 0 ? this->x : this->y;
+    c[0] = f(p00);
+    c[1] = (f(pu1) - f(pu0)) / (2 * h);
+    c[2] = (f(pv1) - f(pv0)) / (2 * h);
+    c[3] = (f(pu1) - 2 * f(p00) + f(pu0)) / (2 * h * h);
+    c[4] = (f(pv1) - 2 * f(p00) + f(pv0)) / (2 * h * h);
+    c[5] = (f(p11) - f(p10) - f(p01) + f(p0m)) / (4 * h * h);
+  }
+
+  this->det = this->x[1] * this->y[2] - this->x[2] * this->y[1];
+  return std::isfinite(this->det) && this->det != 0;
+}
+
+//////////////////////////////////////////////////
+bool TangentPlane::Valid() const
+{
+  return this->det != 0;
+}
+
+//////////////////////////////////////////////////
+void TangentPlane::Project(const double _lat, const double _lon,
+    double &_x, double &_y) const
+{
+  const double u = _lat - this->lat0;
+  const double v = _lon - this->lon0;
+  _x = evaluate(this->x, u, v);
+  _y = evaluate(this->y, u, v);
+}
+
+//////////////////////////////////////////////////
+void TangentPlane::Project(const size_t _count, const double *_lat,
+    const double *_lon, double *_x, double *_y) const
+{
+  // Copies, so the loop doesn't reload the coefficients after each store.
+  const double lat00 = this->lat0;
+  const double lon00 = this->lon0;
+  double cx[6], cy[6];
+  for (int i = 0; i < 6; ++i)
+  {
+    cx[i] = this->x[i];
+    cy[i] = this->y[i];
+  }
+
+  for (size_t i = 0; i < _count; ++i)
+  {
+    const double u = _lat[i] - lat00;
+    const double v = _lon[i] - lon00;
+    _x[i] = evaluate(cx, u, v);
+    _y[i] = evaluate(cy, u, v);
+  }
+}
+
+//////////////////////////////////////////////////
+void TangentPlane::Unproject(const double _x, const double _y,
+    double &_lat, double &_lon) const
+{
+  if (this->det == 0)
+  {
+    _lat = this->lat0;
+    _lon = this->lon0;
+    return;
+  }
+
+  // Start from the inverse of the linear terms.
+  const double dx = _x - this->x[0];
+  const double dy = _y - this->y[0];
+  double u = (this->y[2] * dx - this->x[2] * dy) / this->det;
+  double v = (this->x[1] * dy - this->y[1] * dx) / this->det;
+
+  for (int step = 0; step < kNewtonSteps; ++step)
+  {
+    const double rx = evaluate(this->x, u, v) - _x;
+    const double ry = evaluate(this->y, u, v) - _y;
+    const double xu = this->x[1] + 2 * this->x[3] * u + this->x[5] * v;
+    const double xv = this->x[2] + 2 * this->x[4] * v + this->x[5] * u;
+    const double yu = this->y[1] + 2 * this->y[3] * u + this->y[5] * v;
+    const double yv = this->y[2] + 2 * this->y[4] * v + this->y[5] * u;
+    const double d = xu * yv - xv * yu;
+    if (d == 0)
+      break;
+    u -= (yv * rx - xv * ry) / d;
+    v -= (xu * ry - yu * rx) / d;
+  }
+
+  _lat = this->lat0 + u;
+  _lon = this->lon0 + v;
+}
+
+//////////////////////////////////////////////////
+void TangentPlane::Unproject(const size_t _count, const double *_x,
+    const double *_y, double *_lat, double *_lon) const
+{
+  for (size_t i = 0; i < _count; ++i)
+    this->Unproject(_x[i], _y[i], _lat[i], _lon[i]);
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <cmath>
+#include <vector>
+#include <ignition/math/Vector3.hh>
+#include "gtest/gtest.h"
+#include "swarm/TangentPlane.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Exact conversion from WGS84 coordinates to the East-North plane
+/// of an origin, rotated by a heading, as SphericalCoordinates does.
+/// \param[in] _lat0 Latitude of the origin (degrees).
+/// \param[in] _lon0 Longitude of the origin (degrees).
+/// \param[in] _heading Heading of the world (radians).
+/// \return The conversion.
+static TangentPlane::Conversion enuConversion(const double _lat0,
+    const double _lon0, const double _heading)
+{
+  auto ecef = [](const double _lat, const double _lon)
+  {
+    const double a = 6378137.0;
+    const double e2 = 6.69437999014e-3;
+    const double phi = _lat * M_PI / 180;
+    const double lambda = _lon * M_PI / 180;
+    const double n = a / std::sqrt(1 - e2 * std::sin(phi) * std::sin(phi));
+    return ignition::math::Vector3d(n * std::cos(phi) * std::cos(lambda),
+        n * std::cos(phi) * std::sin(lambda),
+        n * (1 - e2) * std::sin(phi));
+  };
+
+  return [=](const double _lat, const double _lon)
+  {
+    const ignition::math::Vector3d d = ecef(_lat, _lon) - ecef(_lat0, _lon0);
+    const double phi = _lat0 * M_PI / 180;
+    const double lambda = _lon0 * M_PI / 180;
+    const double east = -std::sin(lambda) * d.X() + std::cos(lambda) * d.Y();
+    const double north = -std::sin(phi) * std::cos(lambda) * d.X() -
+      std::sin(phi) * std::sin(lambda) * d.Y() + std::cos(phi) * d.Z();
+    return ignition::math::Vector3d(
+        std::cos(_heading) * east - std::sin(_heading) * north,
+        std::sin(_heading) * east + std::cos(_heading) * north, 0);
+  };
+}
+
+//////////////////////////////////////////////////
+/// \brief Maximum error of the projection in a square around the origin.
+/// \param[in] _lat0 Latitude of the origin (degrees).
+/// \param[in] _heading Heading of the world (radians).
+/// \param[in] _distance Half the side of the square (m).
+/// \return The maximum error (m).
+static double maxError(const double _lat0, const double _heading,
+    const double _distance)
+{
+  const double lon0 = -120.7;
+  auto conversion = enuConversion(_lat0, lon0, _heading);
+  TangentPlane plane;
+  EXPECT_TRUE(plane.Fit(_lat0, lon0, conversion));
+
+  const double dLat = _distance / 111000;
+  const double dLon = dLat / std::cos(_lat0 * M_PI / 180);
+  double error = 0;
+  for (int i = -10; i <= 10; ++i)
+  {
+    for (int j = -10; j <= 10; ++j)
+    {
+      const double lat = _lat0 + dLat * i / 10;
+      const double lon = lon0 + dLon * j / 10;
+      const ignition::math::Vector3d exact = conversion(lat, lon);
+      double x, y;
+      plane.Project(lat, lon, x, y);
+      error = std::max(error, std::hypot(x - exact.X(), y - exact.Y()));
+    }
+  }
+  return error;
+}
+
+//////////////////////////////////////////////////
+/// \brief The documented error bounds.
+TEST(TangentPlaneTest, ErrorBounds)
+{
+  for (const double lat : {0.0, 35.7, 59.9, -45.0})
+  {
+    for (const double heading : {0.0, 0.6})
+    {
+      EXPECT_LT(maxError(lat, heading, 2000), 1e-3) << lat;
+      EXPECT_LT(maxError(lat, heading, 5000), 1e-2) << lat;
+      EXPECT_LT(maxError(lat, heading, 10000), 6e-2) << lat;
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+/// \brief The inverse, and the batched calls.
+TEST(TangentPlaneTest, Unproject)
+{
+  TangentPlane plane;
+  EXPECT_FALSE(plane.Valid());
+  ASSERT_TRUE(plane.Fit(35.7, -120.7, enuConversion(35.7, -120.7, 0.3)));
+  EXPECT_TRUE(plane.Valid());
+
+  std::vector<double> lats, lons;
+  for (int i = -5; i <= 5; ++i)
+  {
+    lats.push_back(35.7 + i * 0.004);
+    lons.push_back(-120.7 - i * 0.003);
+  }
+
+  const size_t count = lats.size();
+  std::vector<double> xs(count), ys(count), lats2(count), lons2(count);
+  plane.Project(count, lats.data(), lons.data(), xs.data(), ys.data());
+  plane.Unproject(count, xs.data(), ys.data(), lats2.data(), lons2.data());
+  for (size_t i = 0; i < count; ++i)
+  {
+    double x, y;
+    plane.Project(lats[i], lons[i], x, y);
+    EXPECT_DOUBLE_EQ(x, xs[i]);
+    EXPECT_DOUBLE_EQ(y, ys[i]);
+    EXPECT_NEAR(lats2[i], lats[i], 1e-10);
+    EXPECT_NEAR(lons2[i], lons[i], 1e-10);
+  }
+
+  // The origin.
+  double x, y;
+  plane.Project(35.7, -120.7, x, y);
+  EXPECT_NEAR(x, 0, 1e-9);
+  EXPECT_NEAR(y, 0, 1e-9);
+
+  // A degenerate conversion.
+  EXPECT_FALSE(plane.Fit(0, 0, [](const double, const double)
+        {
+          return ignition::math::Vector3d(1, 2, 0);
+        }));
+  EXPECT_FALSE(plane.Valid());
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,522 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "swarm/Telemetry.hh"
+
+using namespace swarm;
+
+static_assert(sizeof(TelemetryRobot) == 80,
+    "The layout of TelemetryRobot is part of the telemetry format");
+static_assert(sizeof(TelemetryHeader) == 72,
+    "The layout of TelemetryHeader is part of the telemetry format");
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+    "The telemetry segment needs lock free 64 bit atomics");
+
+/// \brief Number of snapshots kept in the shared memory segment. A reader
+/// has the time of kTelemetrySlots - 1 snapshots to copy one.
+static const uint64_t kTelemetrySlots = 4;
+
+/// \brief A snapshot in shared memory, guarded by its sequence number.
+struct TelemetrySlot
+{
+  /// \brief Sequence number of the snapshot, 0 while it's written.
+  std::atomic<uint64_t> seq;
+
+  /// \brief Keeps the sequence number away from the snapshot.
+  char padding[56];
+
+  /// \brief The snapshot.
+  TelemetryFrame frame;
+};
+
+/// \brief Layout of the shared memory segment, written by the publisher.
+/// A segment filled with zeros has no snapshots.
+struct TelemetrySegment
+{
+  /// \brief Sequence number of the last snapshot published.
+  std::atomic<uint64_t> latest;
+
+  /// \brief Keeps the sequence number away from the slots.
+  char padding[56];
+
+  /// \brief The last snapshots, by sequence number modulo kTelemetrySlots.
+  TelemetrySlot slots[kTelemetrySlots];
+};
+
+/// \brief Size of a snapshot with some robots.
+/// \param[in] _robots Number of robots.
+/// \return Size in bytes.
+static size_t frameBytes(const uint32_t _robots)
+{
+  return sizeof(TelemetryHeader) + _robots * sizeof(TelemetryRobot);
+}
+
+/// \brief Map the shared memory segment, creating it if needed, so the
+/// publisher and the readers may start in any order.
+/// \param[in] _name Name of the telemetry.
+/// \return The segment, or nullptr on error.
+static TelemetrySegment *mapSegment(const std::string &_name)
+{
+  const std::string name = "/swarm_telemetry_" + _name;
+  const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0600);
+  if (fd < 0)
+  {
+    std::cerr << "Telemetry: Unable to open shared memory [" << name
+              << "]: " << std::strerror(errno) << std::endl;
+    return nullptr;
+  }
+
+  void *addr = MAP_FAILED;
+  if (ftruncate(fd, sizeof(TelemetrySegment)) == 0)
+  {
+    addr = mmap(nullptr, sizeof(TelemetrySegment), PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+  }
+  close(fd);
+
+  if (addr == MAP_FAILED)
+  {
+    std::cerr << "Telemetry: Unable to map shared memory [" << name
+              << "]: " << std::strerror(errno) << std::endl;
+    return nullptr;
+  }
+  return static_cast<TelemetrySegment *>(addr);
+}
+
+/// \brief Resolve a "host:port" address.
+/// \param[in] _address The address.
+/// \param[out] _addr The resolved address.
+/// \return False if the address is wrong or can't be resolved.
+static bool resolve(const std::string &_address, sockaddr_in &_addr)
+{
+  const size_t colon = _address.rfind(':');
+  if (colon == std::string::npos)
+  {
+    std::cerr << "Telemetry: Invalid address [" << _address
+              << "]. Use host:port" << std::endl;
+    return false;
+  }
+
+  addrinfo hints;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo *result = nullptr;
+  if (getaddrinfo(_address.substr(0, colon).c_str(),
+        _address.substr(colon + 1).c_str(), &hints, &result) != 0 || !result)
+  {
+    std::cerr << "Telemetry: Unable to resolve [" << _address << "]"
+              << std::endl;
+    return false;
+  }
+
+  std::memcpy(&_addr, result->ai_addr, sizeof(sockaddr_in));
+  freeaddrinfo(result);
+  return true;
+}
+
+/// \brief Publisher in shared memory. The segment is kept when the
+/// publisher closes, so the readers see the last snapshot of a run.
+class SharedMemoryPublisher : public TelemetryPublisher
+{
+  /// \brief Class destructor.
+  public: virtual ~SharedMemoryPublisher()
+  {
+    if (this->segment)
+      munmap(this->segment, sizeof(TelemetrySegment));
+  }
+
+  /// \brief Map the segment.
+  /// \param[in] _name Name of the telemetry.
+  /// \return False if the segment can't be mapped.
+  public: bool Open(const std::string &_name)
+  {
+    this->segment = mapSegment(_name);
+    return this->segment != nullptr;
+  }
+
+  // Documentation inherited.
+  public: virtual bool Publish(TelemetryFrame &_frame)
+  {
+    // Continue the sequence of a previous run, so the readers see the
+    // new snapshots as newer.
+    const uint64_t seq =
+      this->segment->latest.load(std::memory_order_relaxed) + 1;
+    TelemetrySlot &slot = this->segment->slots[seq % kTelemetrySlots];
+
+    const uint32_t robots =
+      std::min(_frame.header.numRobots, kTelemetryMaxRobots);
+    _frame.header.magic = kTelemetryMagic;
+    _frame.header.version = kTelemetryVersion;
+    _frame.header.seq = seq;
+    _frame.header.numRobots = robots;
+    _frame.header.firstRobot = 0;
+    _frame.header.chunkRobots = robots;
+
+    slot.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(&slot.frame, &_frame, frameBytes(robots));
+    slot.seq.store(seq, std::memory_order_release);
+    this->segment->latest.store(seq, std::memory_order_release);
+    return true;
+  }
+
+  /// \brief The segment.
+  private: TelemetrySegment *segment = nullptr;
+};
+
+/// \brief Reader of the shared memory segment.
+class SharedMemoryReader : public TelemetryReader
+{
+  /// \brief Class destructor.
+  public: virtual ~SharedMemoryReader()
+  {
+    if (this->segment)
+      munmap(this->segment, sizeof(TelemetrySegment));
+  }
+
+  /// \brief Map the segment.
+  /// \param[in] _name Name of the telemetry.
+  /// \return False if the segment can't be mapped.
+  public: bool Open(const std::string &_name)
+  {
+    this->segment = mapSegment(_name);
+    return this->segment != nullptr;
+  }
+
+  // Documentation inherited.
+  public: virtual bool Read(TelemetryFrame &_frame)
+  {
+    // The publisher never waits, so a slot may be overwritten while it's
+    // copied. The copy is retried with the new last snapshot.
+    for (int attempt = 0; attempt < 4; ++attempt)
+    {
+      const uint64_t seq =
+        this->segment->latest.load(std::memory_order_acquire);
+      if (seq == 0 || seq == this->lastSeq)
+        return false;
+
+      const TelemetrySlot &slot = this->segment->slots[seq % kTelemetrySlots];
+      if (slot.seq.load(std::memory_order_acquire) != seq)
+        continue;
+
+      std::memcpy(&_frame.header, &slot.frame.header, sizeof(_frame.header));
+      const uint32_t robots =
+        std::min(_frame.header.numRobots, kTelemetryMaxRobots);
+      std::memcpy(_frame.robots, slot.frame.robots,
+          robots * sizeof(TelemetryRobot));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.seq.load(std::memory_order_relaxed) != seq)
+        continue;
+
+      this->lastSeq = seq;
+      return true;
+    }
+    return false;
+  }
+
+  /// \brief The segment.
+  private: TelemetrySegment *segment = nullptr;
+
+  /// \brief Sequence number of the last snapshot read.
+  private: uint64_t lastSeq = 0;
+};
+
+/// \brief Publisher through UDP.
+class UdpPublisher : public TelemetryPublisher
+{
+  /// \brief Class destructor.
+  public: virtual ~UdpPublisher()
+  {
+    if (this->socket >= 0)
+      close(this->socket);
+  }
+
+  /// \brief Open the socket and resolve the destination.
+  /// \param[in] _address "host:port" of the destination.
+  /// \return False if the socket can't be opened or the address is wrong.
+  public: bool Open(const std::string &_address)
+  {
+    if (!resolve(_address, this->destination))
+      return false;
+
+    this->socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (this->socket < 0)
+    {
+      std::cerr << "Telemetry: Unable to open a UDP socket: "
+                << std::strerror(errno) << std::endl;
+      return false;
+    }
+    fcntl(this->socket, F_SETFL, O_NONBLOCK);
+
+    // Let readers on this host receive the multicast snapshots.
+    const unsigned char loop = 1;
+    setsockopt(this->socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop,
+        sizeof(loop));
+    return true;
+  }
+
+  // Documentation inherited.
+  public: virtual bool Publish(TelemetryFrame &_frame)
+  {
+    const uint32_t robots =
+      std::min(_frame.header.numRobots, kTelemetryMaxRobots);
+    _frame.header.magic = kTelemetryMagic;
+    _frame.header.version = kTelemetryVersion;
+    _frame.header.seq = ++this->seq;
+    _frame.header.numRobots = robots;
+
+    bool sent = true;
+    uint32_t first = 0;
+    do
+    {
+      const uint32_t count = std::min(robots - first, kTelemetryUdpRobots);
+      _frame.header.firstRobot = first;
+      _frame.header.chunkRobots = count;
+
+      std::memcpy(this->buffer, &_frame.header, sizeof(_frame.header));
+      std::memcpy(this->buffer + sizeof(_frame.header), _frame.robots + first,
+          count * sizeof(TelemetryRobot));
+      if (sendto(this->socket, this->buffer, frameBytes(count), 0,
+            reinterpret_cast<const sockaddr *>(&this->destination),
+            sizeof(this->destination)) < 0)
+      {
+        sent = false;
+      }
+      first += count;
+    } while (first < robots);
+    return sent;
+  }
+
+  /// \brief The UDP socket.
+  private: int socket = -1;
+
+  /// \brief Destination of the snapshots.
+  private: sockaddr_in destination;
+
+  /// \brief Sequence number of the last snapshot.
+  private: uint64_t seq = 0;
+
+  /// \brief Buffer of a datagram.
+  private: char buffer[sizeof(TelemetryHeader) +
+                       kTelemetryUdpRobots * sizeof(TelemetryRobot)];
+};
+
+/// \brief Reader of the UDP snapshots. The datagrams of a snapshot are
+/// assembled in a pending frame, and the datagrams of older snapshots are
+/// ignored.
+class UdpReader : public TelemetryReader
+{
+  /// \brief Class destructor.
+  public: virtual ~UdpReader()
+  {
+    if (this->socket >= 0)
+      close(this->socket);
+  }
+
+  /// \brief Open the socket, and join the multicast group.
+  /// \param[in] _address "host:port" to listen on.
+  /// \return False if the socket can't be opened or the address is wrong.
+  public: bool Open(const std::string &_address)
+  {
+    sockaddr_in addr;
+    if (!resolve(_address, addr))
+      return false;
+
+    this->socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (this->socket < 0)
+    {
+      std::cerr << "Telemetry: Unable to open a UDP socket: "
+                << std::strerror(errno) << std::endl;
+      return false;
+    }
+    fcntl(this->socket, F_SETFL, O_NONBLOCK);
+
+    // Several dashboards may listen to the same group.
+    const int reuse = 1;
+    setsockopt(this->socket, SOL_SOCKET, SO_REUSEADDR, &reuse,
+        sizeof(reuse));
+
+    sockaddr_in local;
+    std::memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = addr.sin_port;
+    if (bind(this->socket, reinterpret_cast<sockaddr *>(&local),
+          sizeof(local)) != 0)
+    {
+      std::cerr << "Telemetry: Unable to bind UDP port ["
+                << ntohs(addr.sin_port) << "]: " << std::strerror(errno)
+                << std::endl;
+      return false;
+    }
+
+    if (IN_MULTICAST(ntohl(addr.sin_addr.s_addr)))
+    {
+      ip_mreq group;
+      group.imr_multiaddr = addr.sin_addr;
+      group.imr_interface.s_addr = htonl(INADDR_ANY);
+      if (setsockopt(this->socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &group,
+            sizeof(group)) != 0)
+      {
+        std::cerr << "Telemetry: Unable to join multicast group ["
+                  << _address << "]: " << std::strerror(errno) << std::endl;
+        return false;
+      }
+    }
+
+    this->pending.reset(new TelemetryFrame());
+    return true;
+  }
+
+  // Documentation inherited.
+  public: virtual bool Read(TelemetryFrame &_frame)
+  {
+    bool complete = false;
+    while (true)
+    {
+      const ssize_t size = recv(this->socket, this->buffer,
+          sizeof(this->buffer), 0);
+      if (size < 0)
+        break;
+      if (size < static_cast<ssize_t>(sizeof(TelemetryHeader)))
+        continue;
+
+      TelemetryHeader header;
+      std::memcpy(&header, this->buffer, sizeof(header));
+      if (header.magic != kTelemetryMagic ||
+          header.version != kTelemetryVersion ||
+          header.numRobots > kTelemetryMaxRobots ||
+          header.firstRobot + header.chunkRobots > header.numRobots ||
+          size != static_cast<ssize_t>(frameBytes(header.chunkRobots)) ||
+          header.seq <= this->lastSeq)
+      {
+        continue;
+      }
+
+      if (header.seq != this->pending->header.seq)
+      {
+        if (header.seq < this->pending->header.seq)
+          continue;
+        this->pending->header = header;
+        this->received = 0;
+      }
+
+      std::memcpy(this->pending->robots + header.firstRobot,
+          this->buffer + sizeof(header),
+          header.chunkRobots * sizeof(TelemetryRobot));
+      this->received += header.chunkRobots;
+      if (this->received < header.numRobots)
+        continue;
+
+      _frame.header = header;
+      _frame.header.firstRobot = 0;
+      _frame.header.chunkRobots = header.numRobots;
+      std::memcpy(_frame.robots, this->pending->robots,
+          header.numRobots * sizeof(TelemetryRobot));
+      this->lastSeq = header.seq;
+      complete = true;
+    }
+    return complete;
+  }
+
+  /// \brief The UDP socket.
+  private: int socket = -1;
+
+  /// \brief Snapshot being received.
+  private: std::unique_ptr<TelemetryFrame> pending;
+
+  /// \brief Number of robots of the pending snapshot received.
+  private: uint32_t received = 0;
+
+  /// \brief Sequence number of the last snapshot read.
+  private: uint64_t lastSeq = 0;
+
+  /// \brief Buffer of a datagram.
+  private: char buffer[sizeof(TelemetryHeader) +
+                       kTelemetryUdpRobots * sizeof(TelemetryRobot)];
+};
+
+//////////////////////////////////////////////////
+std::unique_ptr<TelemetryPublisher> TelemetryPublisher::Create(
+    const std::string &_transport, const std::string &_name,
+    const std::string &_address)
+{
+  if (_transport == "shm")
+  {
+    SharedMemoryPublisher *publisher = new SharedMemoryPublisher();
+    std::unique_ptr<TelemetryPublisher> result(publisher);
+    if (publisher->Open(_name))
+      return result;
+  }
+  else if (_transport == "udp")
+  {
+    UdpPublisher *publisher = new UdpPublisher();
+    std::unique_ptr<TelemetryPublisher> result(publisher);
+    if (publisher->Open(_address))
+      return result;
+  }
+  else
+  {
+    std::cerr << "Telemetry: Unknown transport [" << _transport
+              << "]. Use shm or udp" << std::endl;
+  }
+  return nullptr;
+}
+
+//////////////////////////////////////////////////
+std::unique_ptr<TelemetryReader> TelemetryReader::Create(
+    const std::string &_transport, const std::string &_name,
+    const std::string &_address)
+{
+  if (_transport == "shm")
+  {
+    SharedMemoryReader *reader = new SharedMemoryReader();
+    std::unique_ptr<TelemetryReader> result(reader);
+    if (reader->Open(_name))
+      return result;
+  }
+  else if (_transport == "udp")
+  {
+    UdpReader *reader = new UdpReader();
+    std::unique_ptr<TelemetryReader> result(reader);
+    if (reader->Open(_address))
+      return result;
+  }
+  else
+  {
+    std::cerr << "Telemetry: Unknown transport [" << _transport
+              << "]. Use shm or udp" << std::endl;
+  }
+  return nullptr;
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include "gtest/gtest.h"
+#include "swarm/Telemetry.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Fill a snapshot.
+/// \param[in] _time Simulation time.
+/// \param[in] _robots Number of robots.
+/// \param[out] _frame The snapshot.
+static void fill(const double _time, const uint32_t _robots,
+    TelemetryFrame &_frame)
+{
+  std::memset(&_frame.header, 0, sizeof(_frame.header));
+  _frame.header.simTime = _time;
+  _frame.header.numUnicast = 3;
+  _frame.header.avgNeighbors = 1.5;
+  _frame.header.numRobots = _robots;
+  for (uint32_t i = 0; i < _robots; ++i)
+  {
+    std::memset(&_frame.robots[i], 0, sizeof(TelemetryRobot));
+    std::snprintf(_frame.robots[i].address, kTelemetryAddressSize,
+        "192.168.2.%u", i);
+    _frame.robots[i].x = i;
+    _frame.robots[i].battery = 100.0 - i;
+    _frame.robots[i].neighbors = i % 5;
+  }
+}
+
+//////////////////////////////////////////////////
+/// \brief Read a snapshot until it arrives or a timeout.
+/// \param[in] _reader The reader.
+/// \param[out] _frame The snapshot.
+/// \return True if a snapshot was read.
+static bool read(TelemetryReader &_reader, TelemetryFrame &_frame)
+{
+  for (int i = 0; i < 200; ++i)
+  {
+    if (_reader.Read(_frame))
+      return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return false;
+}
+
+//////////////////////////////////////////////////
+/// \brief Publish snapshots and check that the last one is read.
+/// \param[in] _transport Transport of the telemetry.
+/// \param[in] _robots Number of robots of the snapshots.
+static void publish(const std::string &_transport, const uint32_t _robots)
+{
+  const std::string name = "test" + std::to_string(getpid());
+  const std::string address =
+    "127.0.0.1:" + std::to_string(20000 + getpid() % 20000);
+
+  auto reader = TelemetryReader::Create(_transport, name, address);
+  auto publisher = TelemetryPublisher::Create(_transport, name, address);
+  ASSERT_TRUE(reader != nullptr);
+  ASSERT_TRUE(publisher != nullptr);
+
+  std::unique_ptr<TelemetryFrame> frame(new TelemetryFrame());
+  std::unique_ptr<TelemetryFrame> received(new TelemetryFrame());
+  EXPECT_FALSE(reader->Read(*received));
+
+  fill(1.0, _robots, *frame);
+  EXPECT_TRUE(publisher->Publish(*frame));
+  ASSERT_TRUE(read(*reader, *received));
+  EXPECT_EQ(received->header.magic, kTelemetryMagic);
+  EXPECT_EQ(received->header.version, kTelemetryVersion);
+  EXPECT_DOUBLE_EQ(received->header.simTime, 1.0);
+  EXPECT_EQ(received->header.numUnicast, 3);
+  EXPECT_DOUBLE_EQ(received->header.avgNeighbors, 1.5);
+  ASSERT_EQ(received->header.numRobots, _robots);
+  for (uint32_t i = 0; i < _robots; ++i)
+  {
+    EXPECT_EQ(std::string(received->robots[i].address),
+        "192.168.2." + std::to_string(i));
+    EXPECT_DOUBLE_EQ(received->robots[i].x, i);
+    EXPECT_DOUBLE_EQ(received->robots[i].battery, 100.0 - i);
+    EXPECT_EQ(received->robots[i].neighbors, i % 5);
+  }
+
+  // Nothing new.
+  EXPECT_FALSE(reader->Read(*received));
+
+  // With shared memory, a reader that falls behind gets the last snapshot.
+  fill(2.0, _robots, *frame);
+  EXPECT_TRUE(publisher->Publish(*frame));
+  fill(3.0, _robots, *frame);
+  EXPECT_TRUE(publisher->Publish(*frame));
+  ASSERT_TRUE(read(*reader, *received));
+  if (_transport == "shm")
+    EXPECT_DOUBLE_EQ(received->header.simTime, 3.0);
+  else
+    EXPECT_GE(received->header.simTime, 2.0);
+
+  if (_transport == "shm")
+    shm_unlink(("/swarm_telemetry_" + name).c_str());
+}
+
+//////////////////////////////////////////////////
+TEST(TelemetryTest, SharedMemory)
+{
+  publish("shm", 10);
+}
+
+//////////////////////////////////////////////////
+TEST(TelemetryTest, Udp)
+{
+  // More robots than fit in a datagram.
+  publish("udp", kTelemetryUdpRobots + 10);
+}
+
+//////////////////////////////////////////////////
+TEST(TelemetryTest, Errors)
+{
+  EXPECT_TRUE(TelemetryPublisher::Create("tcp", "a", "") == nullptr);
+  EXPECT_TRUE(TelemetryPublisher::Create("udp", "a", "localhost") == nullptr);
+  EXPECT_TRUE(TelemetryReader::Create("tcp", "a", "") == nullptr);
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
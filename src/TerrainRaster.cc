@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <cmath>
+#include "swarm/TerrainRaster.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+void TerrainRaster::Reset(const ignition::math::Vector3d &_min,
+    const ignition::math::Vector3d &_max, const double _cellSize)
+{
+  this->minX = _min.X();
+  this->minY = _min.Y();
+  this->cellSize = _cellSize;
+  this->columns = _max.X() > _min.X() ?
+    static_cast<unsigned int>(std::ceil((_max.X() - _min.X()) / _cellSize)) :
+    0;
+  this->rows = _max.Y() > _min.Y() ?
+    static_cast<unsigned int>(std::ceil((_max.Y() - _min.Y()) / _cellSize)) :
+    0;
+  this->cells.assign(static_cast<size_t>(this->columns) * this->rows,
+      Cell{0, 0, kEmpty});
+}
+
+//////////////////////////////////////////////////
+void TerrainRaster::Add(const ignition::math::Vector3d &_min,
+    const ignition::math::Vector3d &_max, const Classifier &_classify)
+{
+  if (this->cells.empty())
+    return;
+
+  // Range of cells overlapped by the footprint.
+  auto first = [this](const double _value, const double _origin,
+      const unsigned int _count)
+  {
+    const double index = std::floor((_value - _origin) / this->cellSize);
+    return static_cast<int>(std::max(0.0, std::min(index, _count - 1.0)));
+  };
+  const int x0 = first(_min.X(), this->minX, this->columns);
+  const int x1 = first(_max.X(), this->minX, this->columns);
+  const int y0 = first(_min.Y(), this->minY, this->rows);
+  const int y1 = first(_max.Y(), this->minY, this->rows);
+
+  for (int y = y0; y <= y1; ++y)
+  {
+    for (int x = x0; x <= x1; ++x)
+    {
+      Cell &cell = this->cells[static_cast<size_t>(y) * this->columns + x];
+      if (cell.type == kEmpty)
+      {
+        cell.zMin = _min.Z();
+        cell.zMax = _max.Z();
+      }
+      else
+      {
+        cell.zMin = std::min(cell.zMin, static_cast<float>(_min.Z()));
+        cell.zMax = std::max(cell.zMax, static_cast<float>(_max.Z()));
+      }
+
+      if (cell.type != kEmpty && cell.type != TerrainType::PLAIN)
+        continue;
+
+      // Classify the point of the footprint closest to the center.
+      const ignition::math::Vector3d point(
+          std::max(_min.X(), std::min(_max.X(),
+              this->minX + (x + 0.5) * this->cellSize)),
+          std::max(_min.Y(), std::min(_max.Y(),
+              this->minY + (y + 0.5) * this->cellSize)),
+          _max.Z());
+      cell.type = static_cast<uint8_t>(_classify(point));
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+TerrainType TerrainRaster::At(const ignition::math::Vector3d &_pos) const
+{
+  const double x = std::floor((_pos.X() - this->minX) / this->cellSize);
+  const double y = std::floor((_pos.Y() - this->minY) / this->cellSize);
+  if (x < 0 || y < 0 || x >= this->columns || y >= this->rows)
+    return TerrainType::PLAIN;
+
+  const Cell &cell = this->cells[static_cast<size_t>(y) * this->columns +
+    static_cast<size_t>(x)];
+  if (cell.type == kEmpty || _pos.Z() < cell.zMin || _pos.Z() > cell.zMax)
+    return TerrainType::PLAIN;
+
+  return static_cast<TerrainType>(cell.type);
+}
+
+//////////////////////////////////////////////////
+unsigned int TerrainRaster::Columns() const
+{
+  return this->columns;
+}
+
+//////////////////////////////////////////////////
+unsigned int TerrainRaster::Rows() const
+{
+  return this->rows;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <ignition/math/Vector3.hh>
+#include "gtest/gtest.h"
+#include "swarm/TerrainRaster.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Check the type of terrain around a tree and a building.
+TEST(TerrainRasterTest, At)
+{
+  TerrainRaster raster;
+  raster.Reset(ignition::math::Vector3d(-10, -10, 0),
+      ignition::math::Vector3d(10, 5, 0), 1.0);
+  EXPECT_EQ(raster.Columns(), 20u);
+  EXPECT_EQ(raster.Rows(), 15u);
+
+  // A tree whose canopy only covers x > 0.
+  int calls = 0;
+  raster.Add(ignition::math::Vector3d(-2, -2, 0),
+      ignition::math::Vector3d(2, 2, 8),
+      [&calls](const ignition::math::Vector3d &_pos)
+      {
+        ++calls;
+        EXPECT_DOUBLE_EQ(_pos.Z(), 8);
+        return _pos.X() > 0 ? TerrainType::FOREST : TerrainType::PLAIN;
+      });
+  EXPECT_EQ(calls, 25);
+
+  EXPECT_EQ(raster.At(ignition::math::Vector3d(1.5, 0, 1)),
+      TerrainType::FOREST);
+  EXPECT_EQ(raster.At(ignition::math::Vector3d(-1.5, 0, 1)),
+      TerrainType::PLAIN);
+
+  // Above the tree.
+  EXPECT_EQ(raster.At(ignition::math::Vector3d(1.5, 0, 9)),
+      TerrainType::PLAIN);
+
+  // A building overlapping the tree keeps the forest cells.
+  raster.Add(ignition::math::Vector3d(-1.5, -1.5, 0),
+      ignition::math::Vector3d(6, 1, 10),
+      [](const ignition::math::Vector3d &)
+      {
+        return TerrainType::BUILDING;
+      });
+  EXPECT_EQ(raster.At(ignition::math::Vector3d(1.5, 0, 9)),
+      TerrainType::FOREST);
+  EXPECT_EQ(raster.At(ignition::math::Vector3d(-1.5, 0, 9)),
+      TerrainType::BUILDING);
+  EXPECT_EQ(raster.At(ignition::math::Vector3d(5.5, 0.5, 2)),
+      TerrainType::BUILDING);
+
+  // Outside of the area and the boxes.
+  EXPECT_EQ(raster.At(ignition::math::Vector3d(5.5, 4, 2)),
+      TerrainType::PLAIN);
+  EXPECT_EQ(raster.At(ignition::math::Vector3d(50, 0, 2)),
+      TerrainType::PLAIN);
+  EXPECT_EQ(raster.At(ignition::math::Vector3d(0, -50, 2)),
+      TerrainType::PLAIN);
+
+  // Empty raster.
+  raster.Reset(ignition::math::Vector3d::Zero,
+      ignition::math::Vector3d::Zero, 1.0);
+  EXPECT_EQ(raster.At(ignition::math::Vector3d::Zero), TerrainType::PLAIN);
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,691 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+#include "swarm/TerrainTiles.hh"
+
+using namespace swarm;
+
+static_assert(sizeof(TerrainTilesHeader) == 64,
+    "TerrainTilesHeader must keep the tile offsets 8 byte aligned");
+
+const int TerrainTiles::kDefaultTileSize;
+const size_t TerrainTiles::kDefaultCacheSize;
+
+//////////////////////////////////////////////////
+TerrainTiles::TerrainTiles()
+{
+  std::memset(&this->header, 0, sizeof(this->header));
+  this->prefetchThread = std::thread(&TerrainTiles::RunPrefetch, this);
+}
+
+//////////////////////////////////////////////////
+TerrainTiles::~TerrainTiles()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stop = true;
+  }
+  this->pendingCondition.notify_all();
+  this->prefetchThread.join();
+
+  this->Unload();
+}
+
+//////////////////////////////////////////////////
+std::shared_ptr<TerrainTiles> TerrainTiles::Open(const std::string &_filename)
+{
+  static std::mutex openMutex;
+  static std::map<std::string, std::weak_ptr<TerrainTiles>> opened;
+
+  std::lock_guard<std::mutex> lock(openMutex);
+  std::shared_ptr<TerrainTiles> tiles = opened[_filename].lock();
+  if (tiles)
+    return tiles;
+
+  tiles = std::make_shared<TerrainTiles>();
+  if (!tiles->Load(_filename))
+    return nullptr;
+
+  opened[_filename] = tiles;
+  return tiles;
+}
+
+//////////////////////////////////////////////////
+bool TerrainTiles::Write(const Heightmap &_heightmap,
+    const std::string &_filename, const int _tileSize)
+{
+  if (!_heightmap.Valid() || _tileSize <= 0)
+  {
+    std::cerr << "TerrainTiles::Write() Invalid heightmap or tile size ["
+              << _tileSize << "]" << std::endl;
+    return false;
+  }
+
+  const int cellColumns = _heightmap.Columns() - 1;
+  const int cellRows = _heightmap.Rows() - 1;
+
+  TerrainTilesHeader tiles;
+  std::memset(&tiles, 0, sizeof(tiles));
+  tiles.magic = kMagic;
+  tiles.version = kVersion;
+  tiles.columns = _heightmap.Columns();
+  tiles.rows = _heightmap.Rows();
+  tiles.tileSize = _tileSize;
+  tiles.tileColumns = (cellColumns + _tileSize - 1) / _tileSize;
+  tiles.tileRows = (cellRows + _tileSize - 1) / _tileSize;
+  tiles.size[0] = _heightmap.Size().X();
+  tiles.size[1] = _heightmap.Size().Y();
+  tiles.size[2] = _heightmap.Size().Z();
+  tiles.hash = _heightmap.Hash();
+
+  // The offsets are written once the tiles are compressed.
+  const uint64_t tileCount =
+    static_cast<uint64_t>(tiles.tileColumns) * tiles.tileRows;
+  std::vector<uint64_t> offsets(tileCount + 1, 0);
+
+  const std::string tmpFilename = _filename + ".tmp." +
+    std::to_string(getpid());
+  std::fstream out(tmpFilename, std::ios::out | std::ios::binary);
+  out.write(reinterpret_cast<const char*>(&tiles), sizeof(tiles));
+  out.write(reinterpret_cast<const char*>(offsets.data()),
+      offsets.size() * sizeof(uint64_t));
+
+  std::vector<char> raw;
+  std::string compressed;
+  uint64_t offset = sizeof(tiles) + offsets.size() * sizeof(uint64_t);
+  for (int tileRow = 0; out && tileRow < tiles.tileRows; ++tileRow)
+  {
+    for (int tileColumn = 0; out && tileColumn < tiles.tileColumns;
+         ++tileColumn)
+    {
+      const int firstColumn = tileColumn * _tileSize;
+      const int firstRow = tileRow * _tileSize;
+      const int width = std::min(_tileSize, cellColumns - firstColumn);
+      const int height = std::min(_tileSize, cellRows - firstRow);
+      const size_t cellBytes = static_cast<size_t>(width) * height *
+        sizeof(Heightmap::Cell);
+
+      // The cells, then the samples around them.
+      raw.resize(cellBytes + static_cast<size_t>(width + 1) * (height + 1) *
+          sizeof(float));
+      char *cells = raw.data();
+      float *samples = reinterpret_cast<float *>(raw.data() + cellBytes);
+      for (int y = 0; y < height; ++y)
+      {
+        std::memcpy(cells, &_heightmap.cells[static_cast<size_t>(
+              firstRow + y) * cellColumns + firstColumn],
+            width * sizeof(Heightmap::Cell));
+        cells += width * sizeof(Heightmap::Cell);
+      }
+      for (int y = 0; y <= height; ++y)
+      {
+        std::memcpy(samples, &_heightmap.heights[static_cast<size_t>(
+              firstRow + y) * tiles.columns + firstColumn],
+            (width + 1) * sizeof(float));
+        samples += width + 1;
+      }
+
+      uLongf size = compressBound(raw.size());
+      compressed.resize(size);
+      if (compress2(reinterpret_cast<Bytef *>(&compressed[0]), &size,
+            reinterpret_cast<const Bytef *>(raw.data()), raw.size(),
+            Z_BEST_COMPRESSION) != Z_OK)
+      {
+        out.setstate(std::ios::failbit);
+        break;
+      }
+
+      const uint64_t tile =
+        static_cast<uint64_t>(tileRow) * tiles.tileColumns + tileColumn;
+      offsets[tile] = offset;
+      out.write(compressed.data(), size);
+      offset += size;
+    }
+  }
+  offsets[tileCount] = offset;
+
+  out.seekp(sizeof(tiles));
+  out.write(reinterpret_cast<const char*>(offsets.data()),
+      offsets.size() * sizeof(uint64_t));
+  out.close();
+
+  if (!out || std::rename(tmpFilename.c_str(), _filename.c_str()) != 0)
+  {
+    std::cerr << "TerrainTiles::Write() Unable to write [" << _filename
+              << "]" << std::endl;
+    std::remove(tmpFilename.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool TerrainTiles::Load(const std::string &_filename)
+{
+  this->Unload();
+
+  int fd = open(_filename.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    std::cerr << "TerrainTiles::Load() Unable to open ["
+              << _filename << "]" << std::endl;
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      st.st_size < static_cast<off_t>(sizeof(TerrainTilesHeader)))
+  {
+    std::cerr << "TerrainTiles::Load() Invalid terrain tiles ["
+              << _filename << "]" << std::endl;
+    close(fd);
+    return false;
+  }
+
+  void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+  // The mapping keeps its own reference to the file.
+  close(fd);
+
+  if (addr == MAP_FAILED)
+  {
+    std::cerr << "TerrainTiles::Load() Unable to map ["
+              << _filename << "]: " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  this->data = static_cast<const char*>(addr);
+  this->dataSize = st.st_size;
+  std::memcpy(&this->header, this->data, sizeof(this->header));
+
+  const TerrainTilesHeader &tiles = this->header;
+  const int64_t tileSize = tiles.tileSize;
+  const uint64_t tileCount =
+    static_cast<uint64_t>(std::max(0, tiles.tileColumns)) *
+    static_cast<uint64_t>(std::max(0, tiles.tileRows));
+  const uint64_t indexEnd = sizeof(TerrainTilesHeader) +
+    (tileCount + 1) * sizeof(uint64_t);
+
+  bool result = true;
+  if (tiles.magic != kMagic)
+  {
+    std::cerr << "TerrainTiles::Load() [" << _filename << "] is not a "
+              << "terrain tiles file" << std::endl;
+    result = false;
+  }
+  else if (tiles.version != kVersion)
+  {
+    std::cerr << "TerrainTiles::Load() Unsupported version ["
+              << tiles.version << "] in [" << _filename << "]" << std::endl;
+    result = false;
+  }
+  else if (tiles.columns < 2 || tiles.rows < 2 || tileSize <= 0 ||
+      !(tiles.size[0] > 0) || !(tiles.size[1] > 0) ||
+      tiles.tileColumns != (tiles.columns - 1 + tileSize - 1) / tileSize ||
+      tiles.tileRows != (tiles.rows - 1 + tileSize - 1) / tileSize ||
+      this->dataSize < indexEnd)
+  {
+    std::cerr << "TerrainTiles::Load() Corrupt header in ["
+              << _filename << "]" << std::endl;
+    result = false;
+  }
+  else
+  {
+    // The compressed tiles follow the offsets, in order, up to the end of
+    // the file.
+    const uint64_t *tileOffsets = reinterpret_cast<const uint64_t*>(
+        this->data + sizeof(TerrainTilesHeader));
+    if (tileOffsets[0] != indexEnd ||
+        tileOffsets[tileCount] != this->dataSize ||
+        !std::is_sorted(tileOffsets, tileOffsets + tileCount + 1))
+    {
+      std::cerr << "TerrainTiles::Load() Corrupt tile offsets in ["
+                << _filename << "]" << std::endl;
+      result = false;
+    }
+    else
+      this->offsets = tileOffsets;
+  }
+
+  if (!result)
+  {
+    this->Unload();
+    return false;
+  }
+
+  // The same computations as Heightmap::Set(), so the lookups match.
+  this->scaleX = tiles.size[0] / (tiles.columns - 1);
+  this->scaleY = tiles.size[1] / (tiles.rows - 1);
+
+  // The tiles are read at random.
+  madvise(addr, this->dataSize, MADV_RANDOM);
+
+  return true;
+}
+
+//////////////////////////////////////////////////
+void TerrainTiles::Unload()
+{
+  std::unique_lock<std::mutex> lock(this->mutex);
+
+  // The prefetching may be reading the mapped file.
+  this->pending.clear();
+  this->pendingSet.clear();
+  this->idleCondition.wait(lock, [this] {return !this->prefetchBusy;});
+
+  if (this->data)
+    munmap(const_cast<char*>(this->data), this->dataSize);
+
+  this->data = nullptr;
+  this->dataSize = 0;
+  this->offsets = nullptr;
+  std::memset(&this->header, 0, sizeof(this->header));
+  this->cache.clear();
+  this->cacheIndex.clear();
+  this->hits = 0;
+  this->misses = 0;
+  this->prefetched = 0;
+  this->tileError = false;
+}
+
+//////////////////////////////////////////////////
+bool TerrainTiles::Valid() const
+{
+  return this->offsets != nullptr;
+}
+
+//////////////////////////////////////////////////
+const TerrainTilesHeader &TerrainTiles::Header() const
+{
+  return this->header;
+}
+
+//////////////////////////////////////////////////
+int TerrainTiles::Columns() const
+{
+  return this->header.columns;
+}
+
+//////////////////////////////////////////////////
+int TerrainTiles::Rows() const
+{
+  return this->header.rows;
+}
+
+//////////////////////////////////////////////////
+ignition::math::Vector3d TerrainTiles::Size() const
+{
+  return ignition::math::Vector3d(this->header.size[0],
+      this->header.size[1], this->header.size[2]);
+}
+
+//////////////////////////////////////////////////
+uint64_t TerrainTiles::Hash() const
+{
+  return this->header.hash;
+}
+
+//////////////////////////////////////////////////
+uint64_t TerrainTiles::Locate(const double _x, const double _y,
+    int &_cellX, int &_cellY, double &_fx, double &_fy, int &_odd) const
+{
+  const int columns = this->header.columns;
+  const int rows = this->header.rows;
+
+  // Position in samples, as in Heightmap::Lookup().
+  const double gx = std::max(0.0, std::min(columns - 1.0,
+        (this->header.size[0] * 0.5 + _x) / this->scaleX));
+  const double gy = std::max(0.0, std::min(rows - 1.0,
+        (this->header.size[1] * 0.5 - _y) / this->scaleY));
+
+  const int x0 = std::min(static_cast<int>(gx), columns - 2);
+  const int y0 = std::min(static_cast<int>(gy), rows - 2);
+  _fx = gx - x0;
+  _fy = gy - y0;
+  _odd = y0 & 1;
+
+  const int tileSize = this->header.tileSize;
+  const int tileColumn = x0 / tileSize;
+  const int tileRow = y0 / tileSize;
+  _cellX = x0 - tileColumn * tileSize;
+  _cellY = y0 - tileRow * tileSize;
+  return static_cast<uint64_t>(tileRow) * this->header.tileColumns +
+    tileColumn;
+}
+
+//////////////////////////////////////////////////
+double TerrainTiles::HeightAt(const double _x, const double _y) const
+{
+  if (!this->Valid())
+    return 0;
+
+  int cellX, cellY, odd;
+  double fx, fy;
+  std::shared_ptr<const Tile> tile =
+    this->TileAt(this->Locate(_x, _y, cellX, cellY, fx, fy, odd));
+  if (!tile)
+    return 0;
+
+  const float *row0 = &tile->heights[cellY * (tile->width + 1) + cellX];
+  return Heightmap::Interpolate(row0, row0 + tile->width + 1, fx, fy);
+}
+
+//////////////////////////////////////////////////
+void TerrainTiles::Lookup(const double _x, const double _y, double &_height,
+    ignition::math::Vector3d &_norm) const
+{
+  this->Lookup(1, &_x, &_y, &_height, &_norm);
+}
+
+//////////////////////////////////////////////////
+void TerrainTiles::Lookup(const size_t _count, const double *_x,
+    const double *_y, double *_height, ignition::math::Vector3d *_norm) const
+{
+  if (!this->Valid())
+    return;
+
+  uint64_t lastIndex = 0;
+  std::shared_ptr<const Tile> tile;
+  ignition::math::Vector3d norm;
+  for (size_t i = 0; i < _count; ++i)
+  {
+    int cellX, cellY, odd;
+    double fx, fy;
+    const uint64_t index =
+      this->Locate(_x[i], _y[i], cellX, cellY, fx, fy, odd);
+    if (i == 0 || index != lastIndex)
+    {
+      tile = this->TileAt(index);
+      lastIndex = index;
+    }
+
+    ignition::math::Vector3d &outNorm = _norm ? _norm[i] : norm;
+    if (!tile)
+    {
+      _height[i] = 0;
+      outNorm = ignition::math::Vector3d::UnitZ;
+      continue;
+    }
+
+    Heightmap::Surface(tile->cells[cellY * tile->width + cellX], fx, fy,
+        odd, _height[i], outNorm);
+  }
+}
+
+//////////////////////////////////////////////////
+void TerrainTiles::Prefetch(const ignition::math::Vector3d &_pos,
+    const double _radius) const
+{
+  if (!this->Valid())
+    return;
+
+  // Tiles covered by the square around the position.
+  int firstX, firstY, lastX, lastY, odd;
+  double fx, fy;
+  const uint64_t first = this->Locate(_pos.X() - _radius, _pos.Y() + _radius,
+      firstX, firstY, fx, fy, odd);
+  const uint64_t last = this->Locate(_pos.X() + _radius, _pos.Y() - _radius,
+      lastX, lastY, fx, fy, odd);
+  const uint64_t tileColumns = this->header.tileColumns;
+
+  bool queued = false;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (uint64_t row = first / tileColumns; row <= last / tileColumns;
+         ++row)
+    {
+      for (uint64_t column = first % tileColumns;
+           column <= last % tileColumns; ++column)
+      {
+        const uint64_t tile = row * tileColumns + column;
+        auto it = this->cacheIndex.find(tile);
+        if (it != this->cacheIndex.end())
+        {
+          this->cache.splice(this->cache.begin(), this->cache, it->second);
+        }
+        else if (this->pendingSet.insert(tile).second)
+        {
+          this->pending.push_back(tile);
+          queued = true;
+        }
+      }
+    }
+  }
+
+  if (queued)
+    this->pendingCondition.notify_one();
+}
+
+//////////////////////////////////////////////////
+size_t TerrainTiles::PendingPrefetches() const
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->pending.size() + (this->prefetchBusy ? 1 : 0);
+}
+
+//////////////////////////////////////////////////
+void TerrainTiles::RunPrefetch()
+{
+  std::unique_lock<std::mutex> lock(this->mutex);
+  while (true)
+  {
+    this->pendingCondition.wait(lock,
+        [this] {return this->stop || !this->pending.empty();});
+    if (this->stop)
+      return;
+
+    const uint64_t tile = this->pending.front();
+    this->pending.pop_front();
+    this->pendingSet.erase(tile);
+
+    // A lookup may have needed the tile first.
+    if (this->cacheIndex.count(tile) > 0)
+      continue;
+
+    this->prefetchBusy = true;
+    lock.unlock();
+    std::shared_ptr<const Tile> decompressed = this->Decompress(tile);
+    lock.lock();
+    this->prefetchBusy = false;
+
+    if (decompressed && this->cacheIndex.count(tile) == 0)
+    {
+      ++this->prefetched;
+      this->Insert(tile, decompressed);
+    }
+    this->idleCondition.notify_all();
+  }
+}
+
+//////////////////////////////////////////////////
+std::shared_ptr<const TerrainTiles::Tile> TerrainTiles::TileAt(
+    const uint64_t _tile) const
+{
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    // Consecutive queries usually come from the same robot, and so from
+    // the same tile.
+    if (!this->cache.empty() && this->cache.front().tile == _tile)
+    {
+      ++this->hits;
+      return this->cache.front().data;
+    }
+
+    auto it = this->cacheIndex.find(_tile);
+    if (it != this->cacheIndex.end())
+    {
+      ++this->hits;
+      this->cache.splice(this->cache.begin(), this->cache, it->second);
+      return this->cache.front().data;
+    }
+
+    ++this->misses;
+  }
+
+  // Other lookups go on while the tile is decompressed.
+  std::shared_ptr<const Tile> decompressed = this->Decompress(_tile);
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (!decompressed)
+  {
+    if (!this->tileError)
+    {
+      std::cerr << "TerrainTiles: Unable to decompress tile " << _tile
+                << ", it's reported as flat ground" << std::endl;
+    }
+    this->tileError = true;
+    return nullptr;
+  }
+
+  return this->Insert(_tile, decompressed);
+}
+
+//////////////////////////////////////////////////
+std::shared_ptr<const TerrainTiles::Tile> TerrainTiles::Decompress(
+    const uint64_t _tile) const
+{
+  // The tiles on the last row and column of tiles can be smaller.
+  const int tileSize = this->header.tileSize;
+  const int tileRow = static_cast<int>(_tile / this->header.tileColumns);
+  const int tileColumn = static_cast<int>(_tile % this->header.tileColumns);
+  const int width = std::min(tileSize,
+      this->header.columns - 1 - tileColumn * tileSize);
+  const int height = std::min(tileSize,
+      this->header.rows - 1 - tileRow * tileSize);
+
+  auto tile = std::make_shared<Tile>();
+  tile->width = width;
+  tile->cells.resize(static_cast<size_t>(width) * height);
+  tile->heights.resize(static_cast<size_t>(width + 1) * (height + 1));
+
+  const size_t cellBytes = tile->cells.size() * sizeof(Heightmap::Cell);
+  const uLongf rawSize = cellBytes + tile->heights.size() * sizeof(float);
+  std::vector<Bytef> raw(rawSize);
+  uLongf size = rawSize;
+  const uint64_t begin = this->offsets[_tile];
+  if (uncompress(raw.data(), &size,
+        reinterpret_cast<const Bytef *>(this->data + begin),
+        this->offsets[_tile + 1] - begin) != Z_OK || size != rawSize)
+  {
+    return nullptr;
+  }
+
+  std::memcpy(tile->cells.data(), raw.data(), cellBytes);
+  std::memcpy(tile->heights.data(), raw.data() + cellBytes,
+      rawSize - cellBytes);
+  return tile;
+}
+
+//////////////////////////////////////////////////
+std::shared_ptr<const TerrainTiles::Tile> TerrainTiles::Insert(
+    const uint64_t _tile, const std::shared_ptr<const Tile> &_data) const
+{
+  auto it = this->cacheIndex.find(_tile);
+  if (it != this->cacheIndex.end())
+  {
+    this->cache.splice(this->cache.begin(), this->cache, it->second);
+    return this->cache.front().data;
+  }
+
+  this->cache.push_front(CachedTile{_tile, _data});
+  this->cacheIndex[_tile] = this->cache.begin();
+  this->TrimCache();
+  return _data;
+}
+
+//////////////////////////////////////////////////
+void TerrainTiles::TrimCache() const
+{
+  while (this->cache.size() > this->cacheSize)
+  {
+    this->cacheIndex.erase(this->cache.back().tile);
+    this->cache.pop_back();
+  }
+}
+
+//////////////////////////////////////////////////
+void TerrainTiles::SetCacheSize(const size_t _tiles)
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->cacheSize = std::max<size_t>(1, _tiles);
+  this->TrimCache();
+}
+
+//////////////////////////////////////////////////
+size_t TerrainTiles::CacheSize() const
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->cacheSize;
+}
+
+//////////////////////////////////////////////////
+size_t TerrainTiles::CachedTiles() const
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->cache.size();
+}
+
+//////////////////////////////////////////////////
+uint64_t TerrainTiles::CacheBytes() const
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  uint64_t bytes = 0;
+  for (auto const &cached : this->cache)
+  {
+    bytes += sizeof(Tile) +
+      cached.data->cells.capacity() * sizeof(Heightmap::Cell) +
+      cached.data->heights.capacity() * sizeof(float);
+  }
+  return bytes;
+}
+
+//////////////////////////////////////////////////
+uint64_t TerrainTiles::Hits() const
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->hits;
+}
+
+//////////////////////////////////////////////////
+uint64_t TerrainTiles::Misses() const
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->misses;
+}
+
+//////////////////////////////////////////////////
+uint64_t TerrainTiles::Prefetched() const
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  return this->prefetched;
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "swarm/TerrainTiles.hh"
+
+using namespace swarm;
+
+/// \brief Path of the temporary tiles used by the tests.
+static const std::string kTilesPath = "/tmp/swarm_terrain_TEST.tiles";
+
+//////////////////////////////////////////////////
+/// \brief Create a rolling 300x200m terrain of 61x41 samples.
+/// \return The heightmap.
+Heightmap MakeHills()
+{
+  const int columns = 61;
+  const int rows = 41;
+  std::vector<float> heights(columns * rows);
+  for (int y = 0; y < rows; ++y)
+  {
+    for (int x = 0; x < columns; ++x)
+    {
+      heights[y * columns + x] = static_cast<float>(
+          10 * std::sin(x * 0.3) * std::cos(y * 0.2) + 0.1 * x);
+    }
+  }
+
+  Heightmap heightmap;
+  EXPECT_TRUE(heightmap.Set(columns, rows,
+        ignition::math::Vector3d(300, 200, 20), heights));
+  return heightmap;
+}
+
+//////////////////////////////////////////////////
+/// \brief Check that the tiles answer like the heightmap.
+TEST(TerrainTilesTest, Lookup)
+{
+  Heightmap heightmap = MakeHills();
+  std::remove(kTilesPath.c_str());
+  ASSERT_TRUE(TerrainTiles::Write(heightmap, kTilesPath, 16));
+
+  std::shared_ptr<TerrainTiles> tiles = TerrainTiles::Open(kTilesPath);
+  ASSERT_TRUE(tiles != nullptr);
+  EXPECT_EQ(tiles, TerrainTiles::Open(kTilesPath));
+  EXPECT_EQ(tiles->Columns(), heightmap.Columns());
+  EXPECT_EQ(tiles->Rows(), heightmap.Rows());
+  EXPECT_EQ(tiles->Size(), heightmap.Size());
+  EXPECT_EQ(tiles->Hash(), heightmap.Hash());
+  EXPECT_EQ(tiles->Header().tileColumns, 4);
+  EXPECT_EQ(tiles->Header().tileRows, 3);
+
+  // Points inside and around the terrain, including the borders of the
+  // tiles.
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<double> xs(-160, 160), ys(-110, 110);
+  std::vector<double> x = {-150, 150, 0, -70, -70.01, -69.99};
+  std::vector<double> y = {100, -100, 0, 20, 20, -20};
+  while (x.size() < 500)
+  {
+    x.push_back(xs(gen));
+    y.push_back(ys(gen));
+  }
+
+  std::vector<double> heights(x.size());
+  std::vector<ignition::math::Vector3d> norms(x.size());
+  tiles->Lookup(x.size(), x.data(), y.data(), heights.data(), norms.data());
+  for (size_t i = 0; i < x.size(); ++i)
+  {
+    double expectedHeight, height;
+    ignition::math::Vector3d expectedNorm, norm;
+    heightmap.Lookup(x[i], y[i], expectedHeight, expectedNorm);
+    tiles->Lookup(x[i], y[i], height, norm);
+    EXPECT_EQ(height, expectedHeight) << x[i] << " " << y[i];
+    EXPECT_EQ(norm, expectedNorm) << x[i] << " " << y[i];
+    EXPECT_EQ(heights[i], expectedHeight) << x[i] << " " << y[i];
+    EXPECT_EQ(norms[i], expectedNorm) << x[i] << " " << y[i];
+    EXPECT_EQ(tiles->HeightAt(x[i], y[i]), heightmap.HeightAt(x[i], y[i]));
+  }
+  EXPECT_EQ(tiles->CachedTiles(), 12u);
+  EXPECT_EQ(tiles->Misses(), 12u);
+  EXPECT_GT(tiles->Hits(), 0u);
+  EXPECT_GT(tiles->CacheBytes(), 12 * 16 * 16 * sizeof(float));
+
+  // A smaller cache drops the least recently used tiles.
+  tiles->SetCacheSize(2);
+  EXPECT_EQ(tiles->CacheSize(), 2u);
+  EXPECT_EQ(tiles->CachedTiles(), 2u);
+}
+
+//////////////////////////////////////////////////
+/// \brief Check that the tiles around a position are decompressed in the
+/// background.
+TEST(TerrainTilesTest, Prefetch)
+{
+  std::remove(kTilesPath.c_str());
+  ASSERT_TRUE(TerrainTiles::Write(MakeHills(), kTilesPath, 16));
+
+  TerrainTiles tiles;
+  ASSERT_TRUE(tiles.Load(kTilesPath));
+  EXPECT_EQ(tiles.CacheSize(), TerrainTiles::kDefaultCacheSize);
+
+  // Tiles are 80m wide, the position is close to the corner of four.
+  tiles.Prefetch(ignition::math::Vector3d(-70, 20, 0), 5);
+  for (int i = 0; i < 1000 && tiles.PendingPrefetches() > 0; ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  EXPECT_EQ(tiles.PendingPrefetches(), 0u);
+  EXPECT_EQ(tiles.Prefetched(), 4u);
+  EXPECT_EQ(tiles.CachedTiles(), 4u);
+
+  // The lookups find them in the cache.
+  double height;
+  ignition::math::Vector3d norm;
+  tiles.Lookup(-72, 22, height, norm);
+  tiles.Lookup(-68, 18, height, norm);
+  EXPECT_EQ(tiles.Misses(), 0u);
+  EXPECT_EQ(tiles.Hits(), 2u);
+
+  // Cached tiles aren't queued again.
+  tiles.Prefetch(ignition::math::Vector3d(-70, 20, 0), 5);
+  EXPECT_EQ(tiles.PendingPrefetches(), 0u);
+}
+
+//////////////////////////////////////////////////
+/// \brief Check that invalid files are rejected.
+TEST(TerrainTilesTest, Invalid)
+{
+  TerrainTiles tiles;
+  EXPECT_FALSE(tiles.Valid());
+  EXPECT_FALSE(tiles.Load("/tmp/swarm_terrain_TEST_missing.tiles"));
+  EXPECT_FALSE(TerrainTiles::Write(Heightmap(), kTilesPath));
+
+  // Nothing is written without tiles.
+  double height = 5;
+  ignition::math::Vector3d norm;
+  tiles.Lookup(0, 0, height, norm);
+  EXPECT_EQ(height, 5);
+  EXPECT_EQ(tiles.HeightAt(0, 0), 0);
+
+  std::remove(kTilesPath.c_str());
+  ASSERT_TRUE(TerrainTiles::Write(MakeHills(), kTilesPath, 16));
+
+  // Truncated.
+  {
+    std::ifstream in(kTilesPath, std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(in)),
+        std::istreambuf_iterator<char>());
+    std::ofstream out(kTilesPath, std::ios::binary | std::ios::trunc);
+    out.write(contents.data(), contents.size() - 10);
+  }
+  EXPECT_FALSE(tiles.Load(kTilesPath));
+  EXPECT_EQ(TerrainTiles::Open(kTilesPath), nullptr);
+
+  // A corrupt tile reads as flat ground.
+  std::remove(kTilesPath.c_str());
+  ASSERT_TRUE(TerrainTiles::Write(MakeHills(), kTilesPath, 16));
+  {
+    std::fstream file(kTilesPath,
+        std::ios::in | std::ios::out | std::ios::binary);
+    uint64_t offset;
+    file.seekg(sizeof(TerrainTilesHeader));
+    file.read(reinterpret_cast<char *>(&offset), sizeof(offset));
+    file.seekp(offset);
+    file.write("corrupt", 7);
+  }
+  ASSERT_TRUE(tiles.Load(kTilesPath));
+  tiles.Lookup(-150, 100, height, norm);
+  EXPECT_EQ(height, 0);
+  EXPECT_EQ(norm, ignition::math::Vector3d::UnitZ);
+  EXPECT_EQ(tiles.CachedTiles(), 0u);
+
+  std::remove(kTilesPath.c_str());
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
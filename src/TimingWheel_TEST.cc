@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "gtest/gtest.h"
+#include "swarm/TimingWheel.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Check that each value is collected at its tick, in every level.
+TEST(TimingWheelTest, Advance)
+{
+  TimingWheel<uint64_t> wheel(10);
+  EXPECT_EQ(wheel.Now(), 10u);
+  EXPECT_EQ(wheel.Size(), 0u);
+
+  const std::vector<uint64_t> ticks =
+    {11, 12, 73, 74, 4105, 4106, 262154, 1 << 24, (1 << 24) + 1,
+     uint64_t(1) << 30};
+  for (auto it = ticks.rbegin(); it != ticks.rend(); ++it)
+    wheel.Schedule(*it, *it);
+  EXPECT_EQ(wheel.Size(), ticks.size());
+
+  std::vector<uint64_t> due;
+  for (const uint64_t tick : ticks)
+  {
+    wheel.Advance(tick - 1, due);
+    EXPECT_TRUE(due.empty());
+
+    wheel.Advance(tick, due);
+    EXPECT_EQ(due, std::vector<uint64_t>({tick}));
+    due.clear();
+  }
+  EXPECT_EQ(wheel.Size(), 0u);
+}
+
+//////////////////////////////////////////////////
+/// \brief Check that the values already due are collected by the next
+/// Advance(), and that Clear() drops everything.
+TEST(TimingWheelTest, Late)
+{
+  TimingWheel<int> wheel(100);
+  wheel.Schedule(100, 1);
+  wheel.Schedule(50, 2);
+  wheel.Schedule(101, 3);
+
+  std::vector<int> due;
+  wheel.Advance(100, due);
+  EXPECT_EQ(due, std::vector<int>({1, 2}));
+
+  due.clear();
+  wheel.Advance(105, due);
+  EXPECT_EQ(due, std::vector<int>({3}));
+
+  wheel.Schedule(200, 4);
+  wheel.Clear(0);
+  EXPECT_EQ(wheel.Now(), 0u);
+  EXPECT_EQ(wheel.Size(), 0u);
+
+  due.clear();
+  wheel.Advance(300, due);
+  EXPECT_TRUE(due.empty());
+}
+
+//////////////////////////////////////////////////
+/// \brief Schedule random values while advancing one tick at a time, and
+/// compare with the expected ticks.
+TEST(TimingWheelTest, Random)
+{
+  std::mt19937 rnd(7);
+  std::uniform_int_distribution<uint64_t> delay(0, 10000);
+
+  TimingWheel<uint64_t> wheel;
+  std::vector<uint64_t> due;
+  size_t collected = 0;
+  for (uint64_t tick = 1; tick <= 30000; ++tick)
+  {
+    for (int i = 0; i < 3; ++i)
+    {
+      const uint64_t at = wheel.Now() + delay(rnd);
+      wheel.Schedule(at, at);
+    }
+
+    due.clear();
+    wheel.Advance(tick, due);
+    // The values due at the previous tick were scheduled late.
+    for (const uint64_t at : due)
+      EXPECT_TRUE(at == tick || at + 1 == tick);
+    collected += due.size();
+  }
+  EXPECT_EQ(collected + wheel.Size(), 90000u);
+}
+
+//////////////////////////////////////////////////
+/// \brief Visit the values of every level, the overflow list and the late
+/// values, and rebuild an identical wheel from them.
+TEST(TimingWheelTest, ForEach)
+{
+  TimingWheel<uint64_t> wheel(100);
+  const uint64_t ticks[] = {90, 101, 150, 5000, 300000, 100000000};
+  for (const uint64_t tick : ticks)
+    wheel.Schedule(tick, tick);
+
+  TimingWheel<uint64_t> copy(wheel.Now());
+  uint64_t sum = 0;
+  wheel.ForEach([&](const uint64_t _tick, const uint64_t &_value)
+      {
+        EXPECT_EQ(_tick, _value);
+        sum += _value;
+        copy.Schedule(_tick, _value);
+      });
+  EXPECT_EQ(sum, 90u + 101u + 150u + 5000u + 300000u + 100000000u);
+  EXPECT_EQ(copy.Size(), wheel.Size());
+
+  std::vector<uint64_t> due;
+  std::vector<uint64_t> copyDue;
+  wheel.Advance(100000000, due);
+  copy.Advance(100000000, copyDue);
+  EXPECT_EQ(due, copyDue);
+  EXPECT_EQ(due.size(), 6u);
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
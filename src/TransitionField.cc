@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <cmath>
+#include <iostream>
+#include "swarm/TransitionField.hh"
+
+using namespace swarm;
+
+/// \brief Radius of the earth used by the lost person walk (m).
+static const double kEarthRadius = 6378100.0;
+
+/// \brief Offset of the neighbor at each bearing (0, 60, ..., 300 degrees),
+/// in rows (the latitude) and columns (the longitude).
+static const double kLatOffsets[6] = {1, 0.5, -0.5, -1, -0.5, 0.5};
+static const int kLonOffsets[6] = {0, 1, 1, 0, -1, -1};
+
+//////////////////////////////////////////////////
+bool TransitionField::Build(const double _minLat, const double _maxLat,
+    const double _minLon, const double _maxLon, const double _spacing,
+    const double _slopeThreshold, const double _slopeMeans[3],
+    const double _topographyMeans[3][3], const MapQuery &_query)
+{
+  this->cumulative.clear();
+  this->columns = this->rows = 0;
+
+  if (!(_spacing > 0) || !(_maxLat > _minLat) || !(_maxLon > _minLon))
+    return false;
+
+  const double midLat = (_minLat + _maxLat) * 0.5 * M_PI / 180;
+  this->minLat = _minLat;
+  this->minLon = _minLon;
+  this->latStep = (_spacing / kEarthRadius) * 180 / M_PI;
+  this->lonStep = this->latStep * std::sqrt(3.0) * 0.5 / std::cos(midLat);
+
+  const double colsD = std::floor((_maxLon - _minLon) / this->lonStep) + 1;
+  const double rowsD = std::floor((_maxLat - _minLat) / this->latStep) + 1;
+  if (colsD * rowsD > kMaxNodes)
+  {
+    std::cerr << "TransitionField::Build() The field would have "
+              << colsD * rowsD << " nodes, the maximum is " << kMaxNodes
+              << std::endl;
+    return false;
+  }
+
+  const int cols = static_cast<int>(colsD);
+  const int rws = static_cast<int>(rowsD);
+  const size_t count = static_cast<size_t>(cols) * static_cast<size_t>(rws);
+
+  // Query the map once per node. The last node of an odd column can be
+  // outside of the search area.
+  std::vector<double> heights(count);
+  std::vector<TerrainType> types(count);
+  std::vector<bool> valid(count);
+  for (int c = 0; c < cols; ++c)
+  {
+    for (int r = 0; r < rws; ++r)
+    {
+      const size_t node = static_cast<size_t>(c) * rws + r;
+      const double lat = _minLat + (r + (c % 2 ? 0.5 : 0.0)) * this->latStep;
+      const double lon = _minLon + c * this->lonStep;
+      valid[node] = lat <= _maxLat &&
+        _query(lat, lon, heights[node], types[node]);
+    }
+  }
+
+  const double altitudeThreshold =
+    std::tan(_slopeThreshold * M_PI / 180) * _spacing;
+
+  this->cumulative.resize(count);
+  for (int c = 0; c < cols; ++c)
+  {
+    for (int r = 0; r < rws; ++r)
+    {
+      const size_t node = static_cast<size_t>(c) * rws + r;
+      std::array<double, kMoves> &probs = this->cumulative[node];
+      probs.fill(0);
+      if (!valid[node])
+        continue;
+
+      // The probabilities of the moves out of the search area are 0.
+      for (int i = 0; i < 6; ++i)
+      {
+        const int nc = c + kLonOffsets[i];
+        const int nr = static_cast<int>(std::floor(r + kLatOffsets[i] +
+              (c % 2 ? 0.5 : 0.0) - (nc % 2 ? 0.5 : 0.0) + 0.5));
+        if (nc < 0 || nc >= cols || nr < 0 || nr >= rws)
+          continue;
+
+        const size_t neighbor = static_cast<size_t>(nc) * rws + nr;
+        if (!valid[neighbor])
+          continue;
+
+        double altProb;
+        const double diff = heights[node] - heights[neighbor];
+        if (std::abs(diff) < altitudeThreshold)
+          altProb = _slopeMeans[0];
+        else if (diff < 0)
+          altProb = _slopeMeans[2];
+        else
+          altProb = _slopeMeans[1];
+
+        probs[i] = _topographyMeans[types[node]][types[neighbor]] * altProb;
+      }
+      probs[6] = _slopeMeans[0] * _topographyMeans[types[node]][types[node]];
+
+      double sum = 0;
+      for (double &prob : probs)
+      {
+        sum += prob;
+        prob = sum;
+      }
+
+      if (sum > 0)
+      {
+        for (double &prob : probs)
+          prob /= sum;
+        probs[6] = 1;
+      }
+    }
+  }
+
+  this->columns = cols;
+  this->rows = rws;
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool TransitionField::Valid() const
+{
+  return !this->cumulative.empty();
+}
+
+//////////////////////////////////////////////////
+bool TransitionField::Node(const double _lat, const double _lon,
+    size_t &_node) const
+{
+  if (this->cumulative.empty())
+    return false;
+
+  const int c = static_cast<int>(
+      std::floor((_lon - this->minLon) / this->lonStep + 0.5));
+  if (c < 0 || c >= this->columns)
+    return false;
+
+  const int r = static_cast<int>(std::floor((_lat - this->minLat) /
+        this->latStep - (c % 2 ? 0.5 : 0.0) + 0.5));
+  if (r < 0 || r >= this->rows)
+    return false;
+
+  _node = static_cast<size_t>(c) * this->rows + r;
+  return this->cumulative[_node][kMoves - 1] > 0;
+}
+
+//////////////////////////////////////////////////
+int TransitionField::Move(const size_t _node, const double _random) const
+{
+  const std::array<double, kMoves> &probs = this->cumulative[_node];
+  for (int i = 0; i < kMoves; ++i)
+  {
+    if (_random <= probs[i])
+      return i;
+  }
+  return kMoves - 1;
+}
+
+//////////////////////////////////////////////////
+double TransitionField::Probability(const size_t _node, const int _move) const
+{
+  const std::array<double, kMoves> &probs = this->cumulative[_node];
+  return _move == 0 ? probs[0] : probs[_move] - probs[_move - 1];
+}
+
+//////////////////////////////////////////////////
+void TransitionField::Offset(const int _move, double &_lat,
+    double &_lon) const
+{
+  if (_move < 0 || _move >= 6)
+  {
+    _lat = _lon = 0;
+    return;
+  }
+
+  _lat = kLatOffsets[_move] * this->latStep;
+  _lon = kLonOffsets[_move] * this->lonStep;
+}
+
+//////////////////////////////////////////////////
+int TransitionField::Columns() const
+{
+  return this->columns;
+}
+
+//////////////////////////////////////////////////
+int TransitionField::Rows() const
+{
+  return this->rows;
+}
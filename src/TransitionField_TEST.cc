@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <cmath>
+#include "gtest/gtest.h"
+#include "swarm/TransitionField.hh"
+
+using namespace swarm;
+
+static const double kSlopeMeans[3] = {.4, .4, .2};
+static const double kTopographyMeans[3][3] =
+  {{.3, .2, .5}, {.3, .2, .5}, {.3, .1, .6}};
+
+//////////////////////////////////////////////////
+/// \brief A flat plain: every move inside the area is equally likely.
+TEST(TransitionFieldTest, Flat)
+{
+  TransitionField field;
+  ASSERT_TRUE(field.Build(-0.001, 0.001, -0.001, 0.001, 10, 2,
+        kSlopeMeans, kTopographyMeans,
+        [](const double, const double, double &_height, TerrainType &_type)
+        {
+          _height = 0;
+          _type = PLAIN;
+          return true;
+        }));
+  ASSERT_TRUE(field.Valid());
+  EXPECT_GT(field.Columns(), 2);
+  EXPECT_GT(field.Rows(), 2);
+
+  // A node in the middle.
+  size_t node;
+  ASSERT_TRUE(field.Node(0, 0, node));
+  for (int i = 0; i < TransitionField::kMoves; ++i)
+    EXPECT_NEAR(field.Probability(node, i), 1.0 / 7, 1e-9);
+  EXPECT_EQ(field.Move(node, 0), 0);
+  EXPECT_EQ(field.Move(node, 0.5), 3);
+  EXPECT_EQ(field.Move(node, 1), 6);
+
+  // The first node can't move south or west.
+  ASSERT_TRUE(field.Node(-0.001, -0.001, node));
+  EXPECT_GT(field.Probability(node, 0), 0);
+  EXPECT_DOUBLE_EQ(field.Probability(node, 3), 0);
+  EXPECT_DOUBLE_EQ(field.Probability(node, 4), 0);
+  EXPECT_DOUBLE_EQ(field.Probability(node, 5), 0);
+
+  // Outside of the area.
+  EXPECT_FALSE(field.Node(0.01, 0, node));
+  EXPECT_FALSE(field.Node(0, -0.01, node));
+
+  // The neighbors are at the spacing.
+  double lat, lon;
+  field.Offset(0, lat, lon);
+  EXPECT_DOUBLE_EQ(lon, 0);
+  EXPECT_NEAR(lat * M_PI / 180 * 6378100, 10, 1e-6);
+  field.Offset(1, lat, lon);
+  EXPECT_NEAR(lat * M_PI / 180 * 6378100, 5, 1e-6);
+  EXPECT_GT(lon, 0);
+  field.Offset(6, lat, lon);
+  EXPECT_DOUBLE_EQ(lat, 0);
+  EXPECT_DOUBLE_EQ(lon, 0);
+}
+
+//////////////////////////////////////////////////
+/// \brief A slope to the north, and a forest to the east.
+TEST(TransitionFieldTest, Terrain)
+{
+  TransitionField field;
+  ASSERT_TRUE(field.Build(-0.001, 0.001, -0.001, 0.001, 10, 2,
+        kSlopeMeans, kTopographyMeans,
+        [](const double _lat, const double _lon, double &_height,
+           TerrainType &_type)
+        {
+          _height = _lat * 100000;
+          _type = _lon > 0.00005 ? FOREST : PLAIN;
+          return true;
+        }));
+
+  size_t node;
+  ASSERT_TRUE(field.Node(0, 0, node));
+
+  // Up, down, and staying in the plain.
+  const double p0 = field.Probability(node, 0);
+  const double p3 = field.Probability(node, 3);
+  const double p6 = field.Probability(node, 6);
+  EXPECT_NEAR(p0 / p6, (.3 * .2) / (.3 * .4), 1e-9);
+  EXPECT_NEAR(p3 / p6, (.3 * .4) / (.3 * .4), 1e-9);
+
+  // Up into the forest.
+  EXPECT_NEAR(field.Probability(node, 1) / p6, (.2 * .2) / (.3 * .4), 1e-9);
+}
+
+//////////////////////////////////////////////////
+/// \brief The nodes outside of the map, and the errors.
+TEST(TransitionFieldTest, Invalid)
+{
+  TransitionField field;
+  auto northOnly = [](const double _lat, const double, double &_height,
+                      TerrainType &_type)
+  {
+    _height = 0;
+    _type = PLAIN;
+    return _lat > 0;
+  };
+  ASSERT_TRUE(field.Build(-0.001, 0.001, -0.001, 0.001, 10, 2,
+        kSlopeMeans, kTopographyMeans, northOnly));
+
+  size_t node;
+  EXPECT_FALSE(field.Node(-0.0005, 0, node));
+  ASSERT_TRUE(field.Node(0.0005, 0, node));
+  EXPECT_NEAR(field.Probability(node, 6), 1.0 / 7, 1e-9);
+
+  // Empty area, and too many nodes.
+  EXPECT_FALSE(field.Build(0, 0, 0, 1, 10, 2, kSlopeMeans, kTopographyMeans,
+        northOnly));
+  EXPECT_FALSE(field.Valid());
+  EXPECT_FALSE(field.Build(-1, 1, -1, 1, 1, 2, kSlopeMeans, kTopographyMeans,
+        northOnly));
+  EXPECT_FALSE(field.Valid());
+  EXPECT_FALSE(field.Node(0, 0, node));
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,533 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef SWARM_OPENCL
+  #define CL_TARGET_OPENCL_VERSION 120
+  #ifdef __APPLE__
+    #include <OpenCL/opencl.h>
+  #else
+    #include <CL/cl.h>
+  #endif
+#endif
+
+#include "swarm/Heightmap.hh"
+#include "swarm/VisibilityGpu.hh"
+#include "swarm/VisibilityLookup.hh"
+
+using namespace swarm;
+
+#ifdef SWARM_OPENCL
+/// \brief Kernel of the stencil tables. HeightAt() and Crosses() follow
+/// Heightmap::HeightAt() and Heightmap::Crossings() operation by operation.
+static const char *kStencilSource = R"(
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#pragma OPENCL FP_CONTRACT OFF
+
+__constant sampler_t kSampler = CLK_NORMALIZED_COORDS_FALSE |
+  CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+
+typedef struct
+{
+  double sizeX, sizeY, scaleX, scaleY;
+  int columns, rows;
+} Terrain;
+
+double Sample(read_only image2d_t samples, const int column, const int row)
+{
+  return read_imagef(samples, kSampler, (int2)(column, row)).x;
+}
+
+double HeightAt(read_only image2d_t samples, const Terrain t,
+    const double x, const double y)
+{
+  const double gx = fmax(0.0, fmin(t.columns - 1.0,
+        (t.sizeX * 0.5 + x) / t.scaleX));
+  const double gy = fmax(0.0, fmin(t.rows - 1.0,
+        (t.sizeY * 0.5 - y) / t.scaleY));
+
+  const int x0 = min((int)gx, t.columns - 2);
+  const int y0 = min((int)gy, t.rows - 2);
+  const double fx = gx - x0;
+  const double fy = gy - y0;
+
+  return (Sample(samples, x0, y0) * (1 - fx) +
+          Sample(samples, x0 + 1, y0) * fx) * (1 - fy) +
+         (Sample(samples, x0, y0 + 1) * (1 - fx) +
+          Sample(samples, x0 + 1, y0 + 1) * fx) * fy;
+}
+
+bool Crosses(read_only image2d_t samples, const double a0, const double a1,
+    const double b0, const double b1, const double z0, const double z1,
+    const int lineCount, const int lineLength, const bool alongColumns)
+{
+  const double da = a1 - a0;
+  if (fabs(da) < 1e-9)
+    return false;
+
+  const int first = (int)ceil(fmax(0.0, fmin(a0, a1)));
+  const int last = (int)floor(fmin(lineCount - 1.0, fmax(a0, a1)));
+  const double db = (b1 - b0) / da;
+  const double dz = (z1 - z0) / da;
+
+  for (int i = first; i <= last; ++i)
+  {
+    const double s = i - a0;
+    const double b = b0 + s * db;
+    if (b < 0 || b > lineLength - 1)
+      continue;
+
+    const int j = min((int)b, lineLength - 2);
+    const double f = b - j;
+    const double height = alongColumns ?
+      Sample(samples, i, j) * (1 - f) + Sample(samples, i, j + 1) * f :
+      Sample(samples, j, i) * (1 - f) + Sample(samples, j + 1, i) * f;
+
+    if (height - (z0 + s * dz) > 0)
+      return true;
+  }
+
+  return false;
+}
+
+__kernel void Stencil(read_only image2d_t samples, const double sizeX,
+    const double sizeY, const double scaleX, const double scaleY,
+    const int sampleColumns, const int sampleRows, const int minX,
+    const int minY, const int stepSize, const int columns, const int rows,
+    const int firstRow, __global const int2 *offsets, const int bitCount,
+    const int wordsPerCell, __local uint *bits, __global ulong *out)
+{
+  const Terrain t = {sizeX, sizeY, scaleX, scaleY, sampleColumns,
+    sampleRows};
+  const int cell = get_group_id(0);
+  const int x = minX + (cell % columns) * stepSize;
+  const int y = minY + (firstRow + cell / columns) * stepSize;
+  const int maxX = minX + (columns - 1) * stepSize;
+  const int maxY = minY + (rows - 1) * stepSize;
+
+  for (int i = get_local_id(0); i < 2 * wordsPerCell; i += get_local_size(0))
+    bits[i] = 0;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  const double z = HeightAt(samples, t, x, y) + 1;
+  const double sx1 = (t.sizeX * 0.5 + x) / t.scaleX;
+  const double sy1 = (t.sizeY * 0.5 - y) / t.scaleY;
+  for (int bit = get_local_id(0); bit < bitCount; bit += get_local_size(0))
+  {
+    const int x2 = x + offsets[bit].x * stepSize;
+    const int y2 = y + offsets[bit].y * stepSize;
+    if (x2 < minX || x2 > maxX || y2 > maxY)
+      continue;
+
+    const double z2 = HeightAt(samples, t, x2, y2) + 1;
+    const double sx2 = (t.sizeX * 0.5 + x2) / t.scaleX;
+    const double sy2 = (t.sizeY * 0.5 - y2) / t.scaleY;
+    if (Crosses(samples, sx1, sx2, sy1, sy2, z, z2, t.columns, t.rows,
+          true) ||
+        Crosses(samples, sy1, sy2, sx1, sx2, z, z2, t.rows, t.columns,
+          false))
+    {
+      atomic_or(&bits[bit / 32], 1u << (bit % 32));
+    }
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (int i = get_local_id(0); i < wordsPerCell; i += get_local_size(0))
+  {
+    out[(size_t)cell * wordsPerCell + i] =
+      (ulong)bits[2 * i] | ((ulong)bits[2 * i + 1] << 32);
+  }
+}
+)";
+#endif
+
+/// \brief OpenCL objects of a device, and the terrain uploaded to it.
+struct VisibilityGpu::Device
+{
+#ifdef SWARM_OPENCL
+  /// \brief Release the objects.
+  ~Device()
+  {
+    if (this->out)
+      clReleaseMemObject(this->out);
+    if (this->offsets)
+      clReleaseMemObject(this->offsets);
+    if (this->samples)
+      clReleaseMemObject(this->samples);
+    if (this->kernel)
+      clReleaseKernel(this->kernel);
+    if (this->program)
+      clReleaseProgram(this->program);
+    if (this->queue)
+      clReleaseCommandQueue(this->queue);
+    if (this->context)
+      clReleaseContext(this->context);
+  }
+
+  /// \brief The context.
+  cl_context context = nullptr;
+
+  /// \brief Queue of the kernels and transfers.
+  cl_command_queue queue = nullptr;
+
+  /// \brief The compiled kernel source.
+  cl_program program = nullptr;
+
+  /// \brief The Stencil kernel.
+  cl_kernel kernel = nullptr;
+
+  /// \brief Image of the heightmap samples.
+  cl_mem samples = nullptr;
+
+  /// \brief Offset of each bit of the stencil, as (dx, dy) pairs.
+  cl_mem offsets = nullptr;
+
+  /// \brief Words computed by the kernel.
+  cl_mem out = nullptr;
+
+  /// \brief Size of out (bytes).
+  size_t outSize = 0;
+
+  /// \brief Work items of a group.
+  size_t localSize = 1;
+#endif
+
+  /// \brief Name of the device.
+  std::string name;
+
+  /// \brief Radius of the stencil (cells).
+  int radius = 0;
+
+  /// \brief Number of offsets of the stencil.
+  int bitCount = 0;
+
+  /// \brief Size of the terrain, along X and Y (m).
+  double sizeX = 0, sizeY = 0;
+
+  /// \brief Distance between two samples, along X and Y (m).
+  double scaleX = 0, scaleY = 0;
+
+  /// \brief Number of samples along X and Y.
+  int columns = 0, rows = 0;
+};
+
+//////////////////////////////////////////////////
+VisibilityGpu::VisibilityGpu()
+{
+}
+
+//////////////////////////////////////////////////
+VisibilityGpu::~VisibilityGpu()
+{
+}
+
+//////////////////////////////////////////////////
+bool VisibilityGpu::Available()
+{
+#ifdef SWARM_OPENCL
+  return true;
+#else
+  return false;
+#endif
+}
+
+//////////////////////////////////////////////////
+std::string VisibilityGpu::DeviceName() const
+{
+  return this->device ? this->device->name : "";
+}
+
+//////////////////////////////////////////////////
+bool VisibilityGpu::Load(const Heightmap &_heightmap, const int _radius)
+{
+  this->device.reset();
+
+#ifndef SWARM_OPENCL
+  (void)_heightmap;
+  (void)_radius;
+  std::cerr << "Swarm was built without OpenCL, visibility tables are "
+            << "generated on the CPU" << std::endl;
+  return false;
+#else
+  if (!_heightmap.Valid())
+    return false;
+
+  // GPUs first, then the other devices, in the order of the platforms.
+  cl_uint platformCount = 0;
+  clGetPlatformIDs(0, nullptr, &platformCount);
+  std::vector<cl_platform_id> platforms(platformCount);
+  if (platformCount == 0 ||
+      clGetPlatformIDs(platformCount, platforms.data(), nullptr) != CL_SUCCESS)
+  {
+    std::cerr << "No OpenCL platform found" << std::endl;
+    return false;
+  }
+
+  std::vector<cl_device_id> gpus, others;
+  for (auto platform : platforms)
+  {
+    cl_uint deviceCount = 0;
+    clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 0, nullptr, &deviceCount);
+    std::vector<cl_device_id> devices(deviceCount);
+    if (deviceCount == 0 || clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL,
+          deviceCount, devices.data(), nullptr) != CL_SUCCESS)
+    {
+      continue;
+    }
+
+    for (auto id : devices)
+    {
+      cl_device_type type = 0;
+      clGetDeviceInfo(id, CL_DEVICE_TYPE, sizeof(type), &type, nullptr);
+      (type & CL_DEVICE_TYPE_GPU ? gpus : others).push_back(id);
+    }
+  }
+  gpus.insert(gpus.end(), others.begin(), others.end());
+
+  size_t index = 0;
+  const char *deviceEnv = std::getenv("SWARM_VISIBILITY_GPU_DEVICE");
+  if (deviceEnv)
+    index = std::strtoul(deviceEnv, nullptr, 10);
+  if (index >= gpus.size())
+  {
+    std::cerr << "OpenCL device " << index << " not found, "
+              << gpus.size() << " available" << std::endl;
+    return false;
+  }
+  cl_device_id id = gpus[index];
+
+  auto deviceString = [id](const cl_device_info _info)
+  {
+    size_t size = 0;
+    clGetDeviceInfo(id, _info, 0, nullptr, &size);
+    std::string value(size, '\0');
+    clGetDeviceInfo(id, _info, size, &value[0], nullptr);
+    return std::string(value.c_str());
+  };
+
+  std::unique_ptr<Device> dev(new Device());
+  dev->name = deviceString(CL_DEVICE_NAME);
+  dev->radius = _radius;
+  dev->sizeX = _heightmap.Size().X();
+  dev->sizeY = _heightmap.Size().Y();
+  dev->columns = _heightmap.Columns();
+  dev->rows = _heightmap.Rows();
+  // Same expressions as Heightmap::Set().
+  dev->scaleX = dev->sizeX / (dev->columns - 1);
+  dev->scaleY = dev->sizeY / (dev->rows - 1);
+
+  cl_bool images = CL_FALSE;
+  size_t maxWidth = 0, maxHeight = 0;
+  clGetDeviceInfo(id, CL_DEVICE_IMAGE_SUPPORT, sizeof(images), &images,
+      nullptr);
+  clGetDeviceInfo(id, CL_DEVICE_IMAGE2D_MAX_WIDTH, sizeof(maxWidth),
+      &maxWidth, nullptr);
+  clGetDeviceInfo(id, CL_DEVICE_IMAGE2D_MAX_HEIGHT, sizeof(maxHeight),
+      &maxHeight, nullptr);
+  if (deviceString(CL_DEVICE_EXTENSIONS).find("cl_khr_fp64") ==
+      std::string::npos || !images ||
+      maxWidth < static_cast<size_t>(dev->columns) ||
+      maxHeight < static_cast<size_t>(dev->rows))
+  {
+    std::cerr << "OpenCL device [" << dev->name << "] lacks double "
+              << "precision or images of " << dev->columns << "x"
+              << dev->rows << " samples" << std::endl;
+    return false;
+  }
+
+  cl_int err = CL_SUCCESS;
+  dev->context = clCreateContext(nullptr, 1, &id, nullptr, nullptr, &err);
+  if (err == CL_SUCCESS)
+    dev->queue = clCreateCommandQueue(dev->context, id, 0, &err);
+  if (err == CL_SUCCESS)
+  {
+    dev->program = clCreateProgramWithSource(dev->context, 1,
+        &kStencilSource, nullptr, &err);
+  }
+  if (err == CL_SUCCESS)
+  {
+    err = clBuildProgram(dev->program, 1, &id, "", nullptr, nullptr);
+    if (err != CL_SUCCESS)
+    {
+      size_t size = 0;
+      clGetProgramBuildInfo(dev->program, id, CL_PROGRAM_BUILD_LOG, 0,
+          nullptr, &size);
+      std::string log(size, '\0');
+      clGetProgramBuildInfo(dev->program, id, CL_PROGRAM_BUILD_LOG, size,
+          &log[0], nullptr);
+      std::cerr << "Unable to build the visibility kernel:\n" << log
+                << std::endl;
+    }
+  }
+  if (err == CL_SUCCESS)
+    dev->kernel = clCreateKernel(dev->program, "Stencil", &err);
+
+  // The heightmap is uploaded once, as a texture.
+  if (err == CL_SUCCESS)
+  {
+    cl_image_format format = {CL_R, CL_FLOAT};
+    cl_image_desc desc = {};
+    desc.image_type = CL_MEM_OBJECT_IMAGE2D;
+    desc.image_width = dev->columns;
+    desc.image_height = dev->rows;
+    dev->samples = clCreateImage(dev->context,
+        CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &format, &desc,
+        const_cast<float*>(_heightmap.Samples().data()), &err);
+  }
+
+  // The offsets of the bits, see VisibilityLookup::StencilLayout().
+  if (err == CL_SUCCESS)
+  {
+    const std::vector<int> layout =
+      VisibilityLookup::StencilLayout(_radius, dev->bitCount);
+    std::vector<cl_int> offsets(2 * dev->bitCount);
+    const int width = 2 * _radius + 1;
+    for (int dy = 0; dy <= _radius; ++dy)
+    {
+      for (int dx = -_radius; dx <= _radius; ++dx)
+      {
+        const int bit = layout[dy * width + dx + _radius];
+        if (bit >= 0)
+        {
+          offsets[2 * bit] = dx;
+          offsets[2 * bit + 1] = dy;
+        }
+      }
+    }
+    dev->offsets = clCreateBuffer(dev->context,
+        CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+        offsets.size() * sizeof(cl_int), offsets.data(), &err);
+  }
+
+  if (err == CL_SUCCESS)
+  {
+    err = clGetKernelWorkGroupInfo(dev->kernel, id,
+        CL_KERNEL_WORK_GROUP_SIZE, sizeof(dev->localSize), &dev->localSize,
+        nullptr);
+    dev->localSize = std::max<size_t>(1,
+        std::min<size_t>(dev->localSize, 256));
+  }
+
+  if (err != CL_SUCCESS)
+  {
+    std::cerr << "Unable to set up OpenCL device [" << dev->name
+              << "], error " << err << std::endl;
+    return false;
+  }
+
+  std::cout << "Visibility kernel on OpenCL device [" << dev->name << "]"
+            << std::endl;
+  this->device = std::move(dev);
+  return true;
+#endif
+}
+
+//////////////////////////////////////////////////
+bool VisibilityGpu::Stencil(const VisibilityTableHeader &_header,
+    const int _firstRow, const int _rowCount, std::vector<uint64_t> &_out)
+{
+  if (!this->device || _header.format != STENCIL ||
+      _header.radius != this->device->radius ||
+      _header.wordsPerCell != VisibilityLookup::WordsPerCell(STENCIL,
+        this->device->bitCount))
+  {
+    return false;
+  }
+
+#ifndef SWARM_OPENCL
+  (void)_firstRow;
+  (void)_rowCount;
+  (void)_out;
+  return false;
+#else
+  Device &dev = *this->device;
+  const size_t cells = static_cast<size_t>(_rowCount) * _header.columns;
+  const size_t bytes = cells * _header.wordsPerCell * sizeof(uint64_t);
+  if (cells == 0)
+    return true;
+
+  cl_int err = CL_SUCCESS;
+  if (bytes > dev.outSize)
+  {
+    if (dev.out)
+      clReleaseMemObject(dev.out);
+    dev.out = clCreateBuffer(dev.context, CL_MEM_WRITE_ONLY, bytes, nullptr,
+        &err);
+    dev.outSize = err == CL_SUCCESS ? bytes : 0;
+    if (err != CL_SUCCESS)
+      dev.out = nullptr;
+  }
+
+  cl_uint arg = 0;
+  auto setArg = [&dev, &err, &arg](const size_t _size, const void *_value)
+  {
+    if (err == CL_SUCCESS)
+      err = clSetKernelArg(dev.kernel, arg++, _size, _value);
+  };
+  setArg(sizeof(cl_mem), &dev.samples);
+  setArg(sizeof(double), &dev.sizeX);
+  setArg(sizeof(double), &dev.sizeY);
+  setArg(sizeof(double), &dev.scaleX);
+  setArg(sizeof(double), &dev.scaleY);
+  setArg(sizeof(cl_int), &dev.columns);
+  setArg(sizeof(cl_int), &dev.rows);
+  setArg(sizeof(cl_int), &_header.minX);
+  setArg(sizeof(cl_int), &_header.minY);
+  setArg(sizeof(cl_int), &_header.stepSize);
+  setArg(sizeof(cl_int), &_header.columns);
+  setArg(sizeof(cl_int), &_header.rows);
+  setArg(sizeof(cl_int), &_firstRow);
+  setArg(sizeof(cl_mem), &dev.offsets);
+  setArg(sizeof(cl_int), &dev.bitCount);
+  setArg(sizeof(cl_int), &_header.wordsPerCell);
+  setArg(2 * _header.wordsPerCell * sizeof(cl_uint), nullptr);
+  setArg(sizeof(cl_mem), &dev.out);
+
+  // One work group per cell.
+  const size_t globalSize = cells * dev.localSize;
+  if (err == CL_SUCCESS)
+  {
+    err = clEnqueueNDRangeKernel(dev.queue, dev.kernel, 1, nullptr,
+        &globalSize, &dev.localSize, 0, nullptr, nullptr);
+  }
+
+  const size_t start = _out.size();
+  _out.resize(start + cells * _header.wordsPerCell);
+  if (err == CL_SUCCESS)
+  {
+    err = clEnqueueReadBuffer(dev.queue, dev.out, CL_TRUE, 0, bytes,
+        _out.data() + start, 0, nullptr, nullptr);
+  }
+
+  if (err != CL_SUCCESS)
+  {
+    std::cerr << "OpenCL device [" << dev.name << "] failed, error " << err
+              << std::endl;
+    _out.resize(start);
+    return false;
+  }
+
+  return true;
+#endif
+}
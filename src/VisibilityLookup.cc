@@ -0,0 +1,827 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <zlib.h>
+
+#include "swarm/BoxHierarchy.hh"
+#include "swarm/VisibilityLookup.hh"
+
+using namespace swarm;
+
+static_assert(sizeof(VisibilityTableHeader) == 48,
+    "VisibilityTableHeader must keep the table data 8 byte aligned");
+static_assert(sizeof(VisibilityTilesHeader) == 72,
+    "VisibilityTilesHeader must keep the tile offsets 8 byte aligned");
+
+const int VisibilityLookup::kFinestStepSize;
+const int VisibilityLookup::kLevelFactor;
+const size_t VisibilityLookup::kDefaultTileCache;
+const uint64_t VisibilityLookup::kOutside;
+
+//////////////////////////////////////////////////
+/// \brief Part of the name of a table that depends on its step.
+/// \param[in] _stepSize Distance between two cells (m).
+/// \return Empty for the finest level, "_s<step>" otherwise.
+static std::string StepSuffix(const int _stepSize)
+{
+  if (_stepSize == VisibilityLookup::kFinestStepSize)
+    return "";
+
+  return "_s" + std::to_string(_stepSize);
+}
+const unsigned int VisibilityLookup::kObstacleTrees;
+const unsigned int VisibilityLookup::kObstacleBuilding;
+
+//////////////////////////////////////////////////
+VisibilityLookup::VisibilityLookup()
+{
+  std::memset(&this->header, 0, sizeof(this->header));
+  std::memset(&this->tilesHeader, 0, sizeof(this->tilesHeader));
+}
+
+//////////////////////////////////////////////////
+VisibilityLookup::~VisibilityLookup()
+{
+  this->Unload();
+}
+
+//////////////////////////////////////////////////
+bool VisibilityLookup::Load(const std::string &_filename)
+{
+  this->Unload();
+
+  int fd = open(_filename.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    std::cerr << "VisibilityLookup::Load() Unable to open ["
+              << _filename << "]" << std::endl;
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      st.st_size < static_cast<off_t>(sizeof(VisibilityTableHeader)))
+  {
+    std::cerr << "VisibilityLookup::Load() Invalid visibility table ["
+              << _filename << "]" << std::endl;
+    close(fd);
+    return false;
+  }
+
+  void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+  // The mapping keeps its own reference to the file.
+  close(fd);
+
+  if (addr == MAP_FAILED)
+  {
+    std::cerr << "VisibilityLookup::Load() Unable to map ["
+              << _filename << "]: " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  this->data = static_cast<const char*>(addr);
+  this->dataSize = st.st_size;
+
+  // Tiled tables start with their own header, followed by the header of
+  // the table.
+  int32_t magic;
+  std::memcpy(&magic, this->data, sizeof(magic));
+  const bool tiled = magic == kTilesMagic;
+  if (tiled && this->dataSize >= sizeof(VisibilityTilesHeader))
+  {
+    std::memcpy(&this->tilesHeader, this->data, sizeof(this->tilesHeader));
+    this->header = this->tilesHeader.table;
+  }
+  else
+    std::memcpy(&this->header, this->data, sizeof(this->header));
+
+  bool result = true;
+  if (tiled && this->dataSize < sizeof(VisibilityTilesHeader))
+  {
+    std::cerr << "VisibilityLookup::Load() Corrupt header in ["
+              << _filename << "]" << std::endl;
+    result = false;
+  }
+  else if (tiled && this->tilesHeader.version != kTilesVersion)
+  {
+    std::cerr << "VisibilityLookup::Load() Unsupported tiled version ["
+              << this->tilesHeader.version << "] in [" << _filename << "]"
+              << std::endl;
+    result = false;
+  }
+  else if (this->header.magic != kMagic)
+  {
+    std::cerr << "VisibilityLookup::Load() [" << _filename << "] is not a "
+              << "visibility table, or was generated by an older version. "
+              << "Please remove the file and generate it again." << std::endl;
+    result = false;
+  }
+  else if (this->header.version != kVersion)
+  {
+    std::cerr << "VisibilityLookup::Load() Unsupported version ["
+              << this->header.version << "] in [" << _filename << "]"
+              << std::endl;
+    result = false;
+  }
+  else if (this->header.stepSize <= 0 || this->header.columns <= 0 ||
+      this->header.rows <= 0 || this->header.radius <= 0)
+  {
+    std::cerr << "VisibilityLookup::Load() Corrupt header in ["
+              << _filename << "]" << std::endl;
+    result = false;
+  }
+  else
+  {
+    this->cellCount =
+      static_cast<uint64_t>(this->header.columns) * this->header.rows;
+
+    if (this->header.format == STENCIL || this->header.format == CLEARANCE ||
+        this->header.format == OBSTACLES)
+    {
+      result = tiled ? this->LoadTiles(_filename) : this->LoadCells(_filename);
+    }
+    else if (this->header.format == KEYS && !tiled)
+      result = this->LoadKeys(_filename);
+    else
+    {
+      std::cerr << "VisibilityLookup::Load() Unsupported format ["
+                << this->header.format << "] in [" << _filename << "]"
+                << std::endl;
+      result = false;
+    }
+  }
+
+  if (!result)
+  {
+    this->Unload();
+    return false;
+  }
+
+  // From now on, the table is accessed randomly.
+  madvise(addr, this->dataSize, MADV_RANDOM);
+
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool VisibilityLookup::LoadKeys(const std::string &_filename)
+{
+  const size_t size = this->dataSize - sizeof(VisibilityTableHeader);
+  if (size % sizeof(uint64_t) != 0)
+  {
+    std::cerr << "VisibilityLookup::Load() Invalid visibility table ["
+              << _filename << "]" << std::endl;
+    return false;
+  }
+
+  this->keys = reinterpret_cast<const uint64_t*>(
+      this->data + sizeof(VisibilityTableHeader));
+  this->keyCount = size / sizeof(uint64_t);
+
+  if (!std::is_sorted(this->keys, this->keys + this->keyCount))
+  {
+    std::cerr << "VisibilityLookup::Load() The keys in [" << _filename
+              << "] are not sorted." << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool VisibilityLookup::LoadCells(const std::string &_filename)
+{
+  int bitCount = 0;
+  this->stencilLayout = StencilLayout(this->header.radius, bitCount);
+
+  if (this->header.wordsPerCell != WordsPerCell(this->Format(), bitCount) ||
+      this->dataSize != sizeof(VisibilityTableHeader) +
+        this->cellCount * this->header.wordsPerCell * sizeof(uint64_t))
+  {
+    std::cerr << "VisibilityLookup::Load() Corrupt stencil table ["
+              << _filename << "]" << std::endl;
+    return false;
+  }
+
+  this->cells = reinterpret_cast<const uint64_t*>(
+      this->data + sizeof(VisibilityTableHeader));
+
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool VisibilityLookup::LoadTiles(const std::string &_filename)
+{
+  int bitCount = 0;
+  this->stencilLayout = StencilLayout(this->header.radius, bitCount);
+
+  const VisibilityTilesHeader &tiles = this->tilesHeader;
+  const int64_t tileSize = tiles.tileSize;
+  const uint64_t tileCount =
+    static_cast<uint64_t>(std::max(0, tiles.tileColumns)) *
+    static_cast<uint64_t>(std::max(0, tiles.tileRows));
+  const uint64_t indexEnd = sizeof(VisibilityTilesHeader) +
+    (tileCount + 1) * sizeof(uint64_t);
+
+  if (this->header.wordsPerCell != WordsPerCell(this->Format(), bitCount) ||
+      tileSize <= 0 ||
+      tiles.tileColumns != (this->header.columns + tileSize - 1) / tileSize ||
+      tiles.tileRows != (this->header.rows + tileSize - 1) / tileSize ||
+      this->dataSize < indexEnd)
+  {
+    std::cerr << "VisibilityLookup::Load() Corrupt tiled table ["
+              << _filename << "]" << std::endl;
+    return false;
+  }
+
+  // The compressed tiles follow the offsets, in order, up to the end of
+  // the file.
+  const uint64_t *offsets = reinterpret_cast<const uint64_t*>(
+      this->data + sizeof(VisibilityTilesHeader));
+  if (offsets[0] != indexEnd || offsets[tileCount] != this->dataSize ||
+      !std::is_sorted(offsets, offsets + tileCount + 1))
+  {
+    std::cerr << "VisibilityLookup::Load() Corrupt tile offsets in ["
+              << _filename << "]" << std::endl;
+    return false;
+  }
+
+  this->tileOffsets = offsets;
+
+  return true;
+}
+
+//////////////////////////////////////////////////
+void VisibilityLookup::Unload()
+{
+  if (this->data)
+    munmap(const_cast<char*>(this->data), this->dataSize);
+
+  this->data = nullptr;
+  this->dataSize = 0;
+  this->keys = nullptr;
+  this->keyCount = 0;
+  this->cells = nullptr;
+  this->cellCount = 0;
+  this->tileOffsets = nullptr;
+
+  std::lock_guard<std::mutex> lock(this->tileMutex);
+  this->tileCache.clear();
+  this->tileIndex.clear();
+  this->tileHits = 0;
+  this->tileMisses = 0;
+  this->tileError = false;
+}
+
+//////////////////////////////////////////////////
+bool VisibilityLookup::Loaded() const
+{
+  return this->data != nullptr;
+}
+
+//////////////////////////////////////////////////
+bool VisibilityLookup::Visible(const uint64_t _index1,
+    const uint64_t _index2) const
+{
+  if (_index1 == kOutside || _index2 == kOutside)
+    return true;
+
+  const uint64_t a = std::min(_index1, _index2);
+  const uint64_t b = std::max(_index1, _index2);
+
+  if (this->header.format == CLEARANCE)
+    return this->ClearanceVisible(a, -HUGE_VAL, b, -HUGE_VAL);
+
+  if (this->header.format == OBSTACLES)
+  {
+    const int entry = this->ObstacleEntry(a, b);
+    return entry < 0 || ((entry & kObstacleBuilding) == 0 &&
+        static_cast<unsigned int>(entry & kObstacleTrees) < 2);
+  }
+
+  if (this->HasCells())
+    return this->StencilVisible(a, b);
+
+  return this->KeysVisible(a, b);
+}
+
+//////////////////////////////////////////////////
+bool VisibilityLookup::Visible(const uint64_t _index1, const double _z1,
+    const uint64_t _index2, const double _z2) const
+{
+  if (this->header.format != CLEARANCE || !this->HasCells())
+    return this->Visible(_index1, _index2);
+
+  if (_index1 == kOutside || _index2 == kOutside)
+    return true;
+
+  if (_index1 <= _index2)
+    return this->ClearanceVisible(_index1, _z1, _index2, _z2);
+
+  return this->ClearanceVisible(_index2, _z2, _index1, _z1);
+}
+
+//////////////////////////////////////////////////
+bool VisibilityLookup::Obstacles(const uint64_t _index1,
+    const uint64_t _index2, unsigned int &_trees, bool &_building) const
+{
+  if (this->header.format != OBSTACLES || !this->HasCells() ||
+      _index1 == kOutside || _index2 == kOutside)
+  {
+    return false;
+  }
+
+  const int entry = this->ObstacleEntry(std::min(_index1, _index2),
+      std::max(_index1, _index2));
+  if (entry < 0)
+    return false;
+
+  _trees = entry & kObstacleTrees;
+  _building = (entry & kObstacleBuilding) != 0;
+  return true;
+}
+
+//////////////////////////////////////////////////
+unsigned int VisibilityLookup::SegmentObstacles(const BoxHierarchy &_trees,
+    const BoxHierarchy &_buildings, const ignition::math::Vector3d &_p1,
+    const ignition::math::Vector3d &_p2)
+{
+  const double length = _p1.Distance(_p2);
+  if (length <= 0)
+    return 0;
+
+  // Only the segment is tested, so the entry is the same for both
+  // orderings of the ends.
+  const ignition::math::Vector3d dir = (_p2 - _p1) / length;
+  double dist;
+
+  unsigned int entry = _trees.Intersect(_p1, dir, 0, length, 2, dist);
+  if (_buildings.Intersect(_p1, dir, 0, length, 1, dist) > 0)
+    entry |= kObstacleBuilding;
+
+  return entry;
+}
+
+//////////////////////////////////////////////////
+bool VisibilityLookup::InRange(const uint64_t _index1,
+    const uint64_t _index2) const
+{
+  if (!this->data || _index1 >= this->cellCount ||
+      _index2 >= this->cellCount)
+  {
+    return false;
+  }
+
+  const int64_t columns = this->header.columns;
+  const int64_t radius = this->header.radius;
+  const int64_t dy = static_cast<int64_t>(_index2 / columns) -
+    static_cast<int64_t>(_index1 / columns);
+  const int64_t dx = static_cast<int64_t>(_index2 % columns) -
+    static_cast<int64_t>(_index1 % columns);
+
+  return dx * dx + dy * dy <= radius * radius;
+}
+
+//////////////////////////////////////////////////
+uint64_t VisibilityLookup::Index(const double _x, const double _y) const
+{
+  if (!this->data)
+    return kOutside;
+
+  const int step = this->header.stepSize;
+  const double column = std::round((_x - this->header.minX) / step);
+  const double row = std::round((_y - this->header.minY) / step);
+
+  // Also rejects NaN coordinates.
+  if (!(column >= 0 && column < this->header.columns &&
+        row >= 0 && row < this->header.rows))
+  {
+    return kOutside;
+  }
+
+  return static_cast<uint64_t>(row) * this->header.columns +
+    static_cast<uint64_t>(column);
+}
+
+//////////////////////////////////////////////////
+uint64_t VisibilityLookup::KeyCount() const
+{
+  return this->keyCount;
+}
+
+//////////////////////////////////////////////////
+VisibilityTableFormat VisibilityLookup::Format() const
+{
+  return static_cast<VisibilityTableFormat>(this->header.format);
+}
+
+//////////////////////////////////////////////////
+const VisibilityTableHeader &VisibilityLookup::Header() const
+{
+  return this->header;
+}
+
+//////////////////////////////////////////////////
+int VisibilityLookup::StepSize() const
+{
+  return this->header.stepSize;
+}
+
+//////////////////////////////////////////////////
+int VisibilityLookup::RowSize() const
+{
+  return this->header.columns;
+}
+
+//////////////////////////////////////////////////
+uint64_t VisibilityLookup::TerrainHash() const
+{
+  return this->header.terrainHash;
+}
+
+//////////////////////////////////////////////////
+size_t VisibilityLookup::MappedSize() const
+{
+  return this->dataSize;
+}
+
+//////////////////////////////////////////////////
+bool VisibilityLookup::Tiled() const
+{
+  return this->tileOffsets != nullptr;
+}
+
+//////////////////////////////////////////////////
+void VisibilityLookup::SetTileCacheSize(const size_t _tiles)
+{
+  std::lock_guard<std::mutex> lock(this->tileMutex);
+  this->tileCacheSize = std::max<size_t>(1, _tiles);
+  this->TrimTileCache();
+}
+
+//////////////////////////////////////////////////
+size_t VisibilityLookup::TileCacheSize() const
+{
+  std::lock_guard<std::mutex> lock(this->tileMutex);
+  return this->tileCacheSize;
+}
+
+//////////////////////////////////////////////////
+size_t VisibilityLookup::CachedTiles() const
+{
+  std::lock_guard<std::mutex> lock(this->tileMutex);
+  return this->tileCache.size();
+}
+
+//////////////////////////////////////////////////
+uint64_t VisibilityLookup::TileCacheBytes() const
+{
+  std::lock_guard<std::mutex> lock(this->tileMutex);
+  uint64_t bytes = 0;
+  for (auto const &cached : this->tileCache)
+    bytes += cached.words.capacity() * sizeof(uint64_t);
+  return bytes;
+}
+
+//////////////////////////////////////////////////
+uint64_t VisibilityLookup::TileHits() const
+{
+  std::lock_guard<std::mutex> lock(this->tileMutex);
+  return this->tileHits;
+}
+
+//////////////////////////////////////////////////
+uint64_t VisibilityLookup::TileMisses() const
+{
+  std::lock_guard<std::mutex> lock(this->tileMutex);
+  return this->tileMisses;
+}
+
+//////////////////////////////////////////////////
+std::string VisibilityLookup::CacheDirectory()
+{
+  const char *cacheEnv = std::getenv("SWARM_VISIBILITY_CACHE");
+  if (cacheEnv && std::strlen(cacheEnv) > 0)
+    return cacheEnv;
+
+  const char *homePath = std::getenv("HOME");
+  if (!homePath)
+    homePath = "/tmp";
+
+  return std::string(homePath) + "/.swarm/visibility";
+}
+
+//////////////////////////////////////////////////
+std::string VisibilityLookup::CachePath(const uint64_t _terrainHash,
+    const int _minX, const int _minY, const int _maxX, const int _maxY,
+    const int _stepSize)
+{
+  // The finest level keeps the names of the tables without levels.
+  char name[128];
+  std::snprintf(name, sizeof(name), "visibility_%016llx_%d_%d_%d_%d%s.dat",
+      static_cast<unsigned long long>(_terrainHash),
+      _minX, _minY, _maxX, _maxY, StepSuffix(_stepSize).c_str());
+
+  return CacheDirectory() + "/" + name;
+}
+
+//////////////////////////////////////////////////
+std::string VisibilityLookup::ObstaclesCachePath(const uint64_t _terrainHash,
+    const uint64_t _obstaclesHash, const int _minX, const int _minY,
+    const int _maxX, const int _maxY, const int _stepSize)
+{
+  char name[128];
+  std::snprintf(name, sizeof(name),
+      "obstacles_%016llx_%016llx_%d_%d_%d_%d%s.dat",
+      static_cast<unsigned long long>(_terrainHash),
+      static_cast<unsigned long long>(_obstaclesHash),
+      _minX, _minY, _maxX, _maxY, StepSuffix(_stepSize).c_str());
+
+  return CacheDirectory() + "/" + name;
+}
+
+//////////////////////////////////////////////////
+std::string VisibilityLookup::TilesFilename(const std::string &_table)
+{
+  const std::string extension = ".dat";
+  if (_table.size() >= extension.size() &&
+      _table.compare(_table.size() - extension.size(), extension.size(),
+        extension) == 0)
+  {
+    return _table.substr(0, _table.size() - extension.size()) + ".tiles";
+  }
+
+  return _table + ".tiles";
+}
+
+//////////////////////////////////////////////////
+uint64_t VisibilityLookup::Pair(const uint64_t _a, const uint64_t _b)
+{
+  // Szudzik's function
+  return _a >= _b ?  _a * _a + _a + _b : _a + _b * _b;
+}
+
+//////////////////////////////////////////////////
+bool VisibilityLookup::KeysVisible(const uint64_t _a, const uint64_t _b) const
+{
+  if (this->keyCount == 0)
+    return true;
+
+  const uint64_t key = Pair(_a, _b);
+
+  // Branchless lower bound. The comparison is usually compiled to a
+  // conditional move.
+  const uint64_t *base = this->keys;
+  uint64_t n = this->keyCount;
+  while (n > 1)
+  {
+    const uint64_t half = n / 2;
+    base = (base[half] <= key) ? base + half : base;
+    n -= half;
+  }
+
+  return *base != key;
+}
+
+//////////////////////////////////////////////////
+bool VisibilityLookup::HasCells() const
+{
+  return this->cells || this->tileOffsets;
+}
+
+//////////////////////////////////////////////////
+uint64_t VisibilityLookup::CellWord(const uint64_t _index,
+    const int _word) const
+{
+  if (this->cells)
+    return this->cells[_index * this->header.wordsPerCell + _word];
+
+  // The tiles on the last row and column of tiles can be smaller.
+  const uint64_t columns = this->header.columns;
+  const uint64_t tileSize = this->tilesHeader.tileSize;
+  const uint64_t row = _index / columns;
+  const uint64_t column = _index % columns;
+  const uint64_t tileRow = row / tileSize;
+  const uint64_t tileColumn = column / tileSize;
+  const uint64_t width = std::min(tileSize, columns - tileColumn * tileSize);
+  const uint64_t offset = ((row - tileRow * tileSize) * width + column -
+      tileColumn * tileSize) * this->header.wordsPerCell + _word;
+
+  std::lock_guard<std::mutex> lock(this->tileMutex);
+  const uint64_t *words =
+    this->TileWords(tileRow * this->tilesHeader.tileColumns + tileColumn);
+
+  // The cells of a corrupt tile are reported as visible.
+  return words ? words[offset] : 0;
+}
+
+//////////////////////////////////////////////////
+const uint64_t *VisibilityLookup::TileWords(const uint64_t _tile) const
+{
+  // Consecutive queries usually come from the same robot, and so from the
+  // same tile.
+  if (!this->tileCache.empty() && this->tileCache.front().tile == _tile)
+  {
+    ++this->tileHits;
+    return this->tileCache.front().words.data();
+  }
+
+  auto it = this->tileIndex.find(_tile);
+  if (it != this->tileIndex.end())
+  {
+    ++this->tileHits;
+    this->tileCache.splice(this->tileCache.begin(), this->tileCache,
+        it->second);
+    return this->tileCache.front().words.data();
+  }
+
+  ++this->tileMisses;
+
+  // Once the cache is full, the least recently used tile gives its buffer
+  // to the new one.
+  if (this->tileCache.size() >= this->tileCacheSize)
+  {
+    this->tileIndex.erase(this->tileCache.back().tile);
+    this->tileCache.splice(this->tileCache.begin(), this->tileCache,
+        std::prev(this->tileCache.end()));
+  }
+  else
+    this->tileCache.emplace_front();
+
+  const uint64_t tileSize = this->tilesHeader.tileSize;
+  const uint64_t tileRow = _tile / this->tilesHeader.tileColumns;
+  const uint64_t tileColumn = _tile % this->tilesHeader.tileColumns;
+  const uint64_t width = std::min<uint64_t>(tileSize,
+      this->header.columns - tileColumn * tileSize);
+  const uint64_t height = std::min<uint64_t>(tileSize,
+      this->header.rows - tileRow * tileSize);
+
+  CachedTile &cached = this->tileCache.front();
+  cached.words.resize(width * height * this->header.wordsPerCell);
+  const uLongf rawSize = cached.words.size() * sizeof(uint64_t);
+  uLongf size = rawSize;
+  const uint64_t begin = this->tileOffsets[_tile];
+  if (uncompress(reinterpret_cast<Bytef *>(cached.words.data()), &size,
+        reinterpret_cast<const Bytef *>(this->data + begin),
+        this->tileOffsets[_tile + 1] - begin) != Z_OK || size != rawSize)
+  {
+    if (!this->tileError)
+    {
+      std::cerr << "VisibilityLookup: Unable to decompress tile " << _tile
+                << ", its cells are reported as visible" << std::endl;
+    }
+    this->tileError = true;
+    this->tileCache.pop_front();
+    return nullptr;
+  }
+
+  cached.tile = _tile;
+  this->tileIndex[_tile] = this->tileCache.begin();
+  return cached.words.data();
+}
+
+//////////////////////////////////////////////////
+void VisibilityLookup::TrimTileCache() const
+{
+  while (this->tileCache.size() > this->tileCacheSize)
+  {
+    this->tileIndex.erase(this->tileCache.back().tile);
+    this->tileCache.pop_back();
+  }
+}
+
+//////////////////////////////////////////////////
+int VisibilityLookup::StencilBit(const uint64_t _a, const uint64_t _b) const
+{
+  if (_b >= this->cellCount)
+    return -1;
+
+  const int64_t columns = this->header.columns;
+  const int64_t radius = this->header.radius;
+  const int64_t dy = static_cast<int64_t>(_b / columns) -
+    static_cast<int64_t>(_a / columns);
+  const int64_t dx = static_cast<int64_t>(_b % columns) -
+    static_cast<int64_t>(_a % columns);
+
+  if (dy > radius || dx > radius || dx < -radius)
+    return -1;
+
+  return this->stencilLayout[dy * (2 * radius + 1) + dx + radius];
+}
+
+//////////////////////////////////////////////////
+bool VisibilityLookup::StencilVisible(const uint64_t _a,
+    const uint64_t _b) const
+{
+  const int bit = this->StencilBit(_a, _b);
+  if (bit < 0)
+    return true;
+
+  return ((this->CellWord(_a, bit / 64) >> (bit % 64)) & 1u) == 0;
+}
+
+//////////////////////////////////////////////////
+bool VisibilityLookup::ClearanceVisible(const uint64_t _a, const double _za,
+    const uint64_t _b, const double _zb) const
+{
+  const int bit = this->StencilBit(_a, _b);
+  if (bit < 0)
+    return true;
+
+  const unsigned int entry = static_cast<unsigned int>(
+      (this->CellWord(_a, 1 + bit / 4) >> ((bit % 4) * 16)) & 0xffffu);
+
+  // Visible 1 meter above the ground, and so at any height above it.
+  const unsigned int excess = entry >> 8;
+  if (excess == 0)
+    return true;
+
+  // How much each endpoint is above the reference points of the table.
+  float groundA, groundB;
+  const uint32_t bitsA = static_cast<uint32_t>(this->CellWord(_a, 0));
+  const uint32_t bitsB = static_cast<uint32_t>(this->CellWord(_b, 0));
+  std::memcpy(&groundA, &bitsA, sizeof(groundA));
+  std::memcpy(&groundB, &bitsB, sizeof(groundB));
+  const double raiseA = std::max(0.0, _za - groundA - 1.0);
+  const double raiseB = std::max(0.0, _zb - groundB - 1.0);
+
+  // The segment went under the terrain at t, check how much it was
+  // raised there.
+  const double t = (entry & 0xffu) / 255.0;
+  return raiseA * (1 - t) + raiseB * t >= excess;
+}
+
+//////////////////////////////////////////////////
+int VisibilityLookup::ObstacleEntry(const uint64_t _a,
+    const uint64_t _b) const
+{
+  const int bit = this->StencilBit(_a, _b);
+  if (bit < 0)
+    return -1;
+
+  return static_cast<int>((this->CellWord(_a, bit / 16) >>
+        ((bit % 16) * 4)) & 0xfu);
+}
+
+//////////////////////////////////////////////////
+int VisibilityLookup::WordsPerCell(const VisibilityTableFormat _format,
+    const int _bitCount)
+{
+  if (_format == STENCIL)
+    return (_bitCount + 63) / 64;
+
+  if (_format == CLEARANCE)
+    return 1 + (_bitCount + 3) / 4;
+
+  if (_format == OBSTACLES)
+    return (_bitCount + 15) / 16;
+
+  return 0;
+}
+
+//////////////////////////////////////////////////
+std::vector<int> VisibilityLookup::StencilLayout(const int _radius,
+    int &_bitCount)
+{
+  const int width = 2 * _radius + 1;
+  std::vector<int> layout((_radius + 1) * width, -1);
+
+  _bitCount = 0;
+  for (int dy = 0; dy <= _radius; ++dy)
+  {
+    for (int dx = -_radius; dx <= _radius; ++dx)
+    {
+      if ((dy > 0 || dx > 0) && dx * dx + dy * dy <= _radius * _radius)
+        layout[dy * width + dx + _radius] = _bitCount++;
+    }
+  }
+
+  return layout;
+}
@@ -0,0 +1,386 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <stdlib.h>  // setenv
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include "gtest/gtest.h"
+#include "swarm/VisibilityLookup.hh"
+
+using namespace swarm;
+
+/// \brief Path of the temporary table used by the tests.
+static const std::string kTablePath = "/tmp/swarm_visibility_TEST.dat";
+
+//////////////////////////////////////////////////
+/// \brief Create the header of a square table.
+/// \param[in] _format Table format.
+/// \param[in] _maxY Maximum Y value of the table.
+/// \param[in] _stepSize Distance between cells.
+/// \param[in] _radius Radius of the stencil (cells).
+/// \param[in] _wordsPerCell Number of stencil words per cell.
+/// \return The table header.
+VisibilityTableHeader MakeHeader(const VisibilityTableFormat _format,
+    const int _maxY, const int _stepSize, const int _radius,
+    const int _wordsPerCell)
+{
+  VisibilityTableHeader header;
+  header.magic = VisibilityLookup::kMagic;
+  header.version = VisibilityLookup::kVersion;
+  header.format = _format;
+  header.stepSize = _stepSize;
+  header.minX = -_maxY;
+  header.minY = -_maxY;
+  header.columns = 2 * _maxY / _stepSize + 1;
+  header.rows = header.columns;
+  header.radius = _radius;
+  header.wordsPerCell = _wordsPerCell;
+  header.terrainHash = 1234;
+  return header;
+}
+
+//////////////////////////////////////////////////
+/// \brief Write a visibility table with the given header and data.
+/// \param[in] _header Table header.
+/// \param[in] _data Keys of the blocked pairs or stencil words.
+void WriteTable(const VisibilityTableHeader &_header,
+    const std::vector<uint64_t> &_data)
+{
+  std::ofstream out(kTablePath, std::ios::out | std::ios::binary);
+  out.write(reinterpret_cast<const char*>(&_header), sizeof(_header));
+  out.write(reinterpret_cast<const char*>(_data.data()),
+      _data.size() * sizeof(uint64_t));
+}
+
+//////////////////////////////////////////////////
+/// \brief Check the queries on a small table.
+TEST(VisibilityLookupTest, Visible)
+{
+  // Cells 3-5 and 7-2 are blocked.
+  WriteTable(MakeHeader(KEYS, 100, 10, 25, 0),
+      {VisibilityLookup::Pair(3, 5), VisibilityLookup::Pair(2, 7)});
+
+  VisibilityLookup lookup;
+  EXPECT_FALSE(lookup.Loaded());
+  EXPECT_TRUE(lookup.Visible(3, 5));
+
+  ASSERT_TRUE(lookup.Load(kTablePath));
+  EXPECT_TRUE(lookup.Loaded());
+  EXPECT_EQ(lookup.Format(), KEYS);
+  EXPECT_EQ(lookup.Header().minY, -100);
+  EXPECT_EQ(lookup.StepSize(), 10);
+  EXPECT_EQ(lookup.RowSize(), 21);
+  EXPECT_EQ(lookup.TerrainHash(), 1234u);
+  EXPECT_EQ(lookup.KeyCount(), 2u);
+
+  // Both orderings of a blocked pair are blocked.
+  EXPECT_FALSE(lookup.Visible(3, 5));
+  EXPECT_FALSE(lookup.Visible(5, 3));
+  EXPECT_FALSE(lookup.Visible(2, 7));
+  EXPECT_FALSE(lookup.Visible(7, 2));
+
+  EXPECT_TRUE(lookup.Visible(3, 4));
+  EXPECT_TRUE(lookup.Visible(0, 1));
+  EXPECT_TRUE(lookup.Visible(100, 200));
+
+  // Indices are rounded to the nearest cell.
+  EXPECT_EQ(lookup.Index(-100, -100), 0u);
+  EXPECT_EQ(lookup.Index(-96, -100), 0u);
+  EXPECT_EQ(lookup.Index(-94, -100), 1u);
+  EXPECT_EQ(lookup.Index(-100, -90), 21u);
+
+  lookup.Unload();
+  EXPECT_FALSE(lookup.Loaded());
+  EXPECT_TRUE(lookup.Visible(3, 5));
+
+  std::remove(kTablePath.c_str());
+}
+
+//////////////////////////////////////////////////
+/// \brief Tables with unsorted keys or bad sizes are rejected.
+TEST(VisibilityLookupTest, Invalid)
+{
+  VisibilityLookup lookup;
+  EXPECT_FALSE(lookup.Load("/__bad__/path/visibility.dat"));
+
+  WriteTable(MakeHeader(KEYS, 100, 10, 25, 0),
+      {VisibilityLookup::Pair(2, 7), VisibilityLookup::Pair(3, 5)});
+  EXPECT_FALSE(lookup.Load(kTablePath));
+  EXPECT_FALSE(lookup.Loaded());
+
+  // Bad step size.
+  auto header = MakeHeader(KEYS, 100, 10, 25, 0);
+  header.stepSize = 0;
+  WriteTable(header, {});
+  EXPECT_FALSE(lookup.Load(kTablePath));
+
+  // Unknown version.
+  header = MakeHeader(KEYS, 100, 10, 25, 0);
+  header.version = VisibilityLookup::kVersion + 1;
+  WriteTable(header, {});
+  EXPECT_FALSE(lookup.Load(kTablePath));
+
+  // Tables without a header, from older versions.
+  {
+    std::ofstream out(kTablePath, std::ios::out | std::ios::binary);
+    int32_t oldHeader[3] = {100, 10, 21};
+    out.write(reinterpret_cast<const char*>(oldHeader), sizeof(oldHeader));
+    for (uint64_t key = 0; key < 8; ++key)
+      out.write(reinterpret_cast<const char*>(&key), sizeof(key));
+  }
+  EXPECT_FALSE(lookup.Load(kTablePath));
+
+  std::remove(kTablePath.c_str());
+}
+
+//////////////////////////////////////////////////
+/// \brief Check the queries on a small stencil table.
+TEST(VisibilityLookupTest, Stencil)
+{
+  // A 5x5 grid with a stencil of radius 2.
+  const int radius = 2;
+  const int rowSize = 5;
+  const auto header = MakeHeader(STENCIL, 20, 10, radius, 1);
+  int bitCount = 0;
+  auto layout = VisibilityLookup::StencilLayout(radius, bitCount);
+
+  // Offsets (1,0), (2,0), (-1,1), (0,1), (1,1) and (0,2).
+  EXPECT_EQ(bitCount, 6);
+  EXPECT_EQ(layout[0 * 5 + 0 + radius], -1);
+  EXPECT_EQ(layout[0 * 5 + 1 + radius], 0);
+  EXPECT_EQ(layout[2 * 5 + 2 + radius], -1);
+
+  // Block cell 6 (1, 1) with cell 12 (2, 2): offset (1, 1).
+  const int words = 1;
+  std::vector<uint64_t> cells(rowSize * rowSize * words, 0u);
+  cells[6] |= uint64_t(1) << layout[1 * 5 + 1 + radius];
+
+  WriteTable(header, cells);
+
+  VisibilityLookup lookup;
+  ASSERT_TRUE(lookup.Load(kTablePath));
+  EXPECT_EQ(lookup.Format(), STENCIL);
+  EXPECT_EQ(lookup.RowSize(), rowSize);
+
+  EXPECT_FALSE(lookup.Visible(6, 12));
+  EXPECT_FALSE(lookup.Visible(12, 6));
+  EXPECT_TRUE(lookup.Visible(6, 7));
+  EXPECT_TRUE(lookup.Visible(7, 13));
+
+  // Pairs outside of the stencil are visible.
+  EXPECT_TRUE(lookup.Visible(0, 24));
+  EXPECT_TRUE(lookup.Visible(6, 6));
+
+  // Truncated files are rejected.
+  WriteTable(header, {});
+  EXPECT_FALSE(lookup.Load(kTablePath));
+
+  std::remove(kTablePath.c_str());
+}
+
+//////////////////////////////////////////////////
+/// \brief Check the altitude-aware queries on a small clearance table.
+TEST(VisibilityLookupTest, Clearance)
+{
+  // A 5x5 grid with a stencil of radius 2: 6 offsets in 3 words per cell.
+  const int radius = 2;
+  int bitCount = 0;
+  auto layout = VisibilityLookup::StencilLayout(radius, bitCount);
+  const int words = VisibilityLookup::WordsPerCell(CLEARANCE, bitCount);
+  EXPECT_EQ(words, 3);
+  EXPECT_EQ(VisibilityLookup::WordsPerCell(STENCIL, bitCount), 1);
+  EXPECT_EQ(VisibilityLookup::WordsPerCell(KEYS, bitCount), 0);
+
+  // The terrain rises 10m above the segment between cell 6 and cell 12,
+  // at the middle. The ground of cell 12 is at 5m.
+  std::vector<uint64_t> cells(25 * words, 0u);
+  const float ground = 5.0f;
+  uint32_t groundBits;
+  std::memcpy(&groundBits, &ground, sizeof(groundBits));
+  cells[12 * words] = groundBits;
+
+  const int bit = layout[1 * 5 + 1 + radius];
+  cells[6 * words + 1 + bit / 4] |= uint64_t((10 << 8) | 128) <<
+    ((bit % 4) * 16);
+
+  WriteTable(MakeHeader(CLEARANCE, 20, 10, radius, words), cells);
+
+  VisibilityLookup lookup;
+  ASSERT_TRUE(lookup.Load(kTablePath));
+  EXPECT_EQ(lookup.Format(), CLEARANCE);
+
+  // Without heights, the points are 1 meter above the ground.
+  EXPECT_FALSE(lookup.Visible(6, 12));
+  EXPECT_TRUE(lookup.Visible(6, 7));
+  EXPECT_FALSE(lookup.Visible(6, 1, 12, 6));
+  EXPECT_FALSE(lookup.Visible(6, -10, 12, -10));
+
+  // Raising both endpoints by 10m clears the terrain.
+  EXPECT_TRUE(lookup.Visible(6, 11, 12, 16));
+  EXPECT_TRUE(lookup.Visible(12, 16, 6, 11));
+  EXPECT_FALSE(lookup.Visible(6, 11, 12, 11));
+
+  // Raising one endpoint only needs about twice the height.
+  EXPECT_TRUE(lookup.Visible(6, 22, 12, 6));
+  EXPECT_FALSE(lookup.Visible(6, 19, 12, 6));
+  EXPECT_TRUE(lookup.Visible(12, 6, 6, 22));
+
+  // Pairs outside of the stencil are visible at any height.
+  EXPECT_TRUE(lookup.Visible(0, -10, 24, -10));
+
+  // The number of words must match the format.
+  WriteTable(MakeHeader(CLEARANCE, 20, 10, radius, 1), cells);
+  EXPECT_FALSE(lookup.Load(kTablePath));
+
+  std::remove(kTablePath.c_str());
+}
+
+//////////////////////////////////////////////////
+/// \brief Check the queries on a small obstacle table.
+TEST(VisibilityLookupTest, Obstacles)
+{
+  // A 5x5 grid with a stencil of radius 2: 6 offsets in 1 word per cell.
+  const int radius = 2;
+  int bitCount = 0;
+  auto layout = VisibilityLookup::StencilLayout(radius, bitCount);
+  const int words = VisibilityLookup::WordsPerCell(OBSTACLES, bitCount);
+  EXPECT_EQ(words, 1);
+
+  // One tree between cells 6 and 7, two between cells 6 and 12, and a
+  // building between cells 6 and 11.
+  std::vector<uint64_t> cells(25 * words, 0u);
+  auto setEntry = [&](const int _dx, const int _dy, const uint64_t _entry)
+  {
+    const int bit = layout[_dy * 5 + _dx + radius];
+    cells[6 * words + bit / 16] |= _entry << ((bit % 16) * 4);
+  };
+  setEntry(1, 0, 1);
+  setEntry(1, 1, 2);
+  setEntry(0, 1, VisibilityLookup::kObstacleBuilding | 1);
+
+  WriteTable(MakeHeader(OBSTACLES, 20, 10, radius, words), cells);
+
+  VisibilityLookup lookup;
+  ASSERT_TRUE(lookup.Load(kTablePath));
+  EXPECT_EQ(lookup.Format(), OBSTACLES);
+
+  unsigned int trees = 0;
+  bool building = true;
+  EXPECT_TRUE(lookup.Obstacles(6, 7, trees, building));
+  EXPECT_EQ(trees, 1u);
+  EXPECT_FALSE(building);
+
+  // Both orderings of a pair have the same entry.
+  EXPECT_TRUE(lookup.Obstacles(12, 6, trees, building));
+  EXPECT_EQ(trees, 2u);
+  EXPECT_FALSE(building);
+
+  EXPECT_TRUE(lookup.Obstacles(6, 11, trees, building));
+  EXPECT_EQ(trees, 1u);
+  EXPECT_TRUE(building);
+
+  EXPECT_TRUE(lookup.Obstacles(6, 8, trees, building));
+  EXPECT_EQ(trees, 0u);
+  EXPECT_FALSE(building);
+
+  // A building or two trees block the line of sight.
+  EXPECT_TRUE(lookup.Visible(6, 7));
+  EXPECT_FALSE(lookup.Visible(6, 12));
+  EXPECT_FALSE(lookup.Visible(11, 6));
+
+  // Pairs that are not stored are left to the caller.
+  EXPECT_FALSE(lookup.Obstacles(0, 24, trees, building));
+  EXPECT_FALSE(lookup.Obstacles(6, VisibilityLookup::kOutside, trees,
+        building));
+  EXPECT_TRUE(lookup.Visible(0, 24));
+
+  // Other formats don't store obstacles.
+  WriteTable(MakeHeader(STENCIL, 20, 10, radius, 1), cells);
+  ASSERT_TRUE(lookup.Load(kTablePath));
+  EXPECT_FALSE(lookup.Obstacles(6, 7, trees, building));
+
+  std::remove(kTablePath.c_str());
+}
+
+//////////////////////////////////////////////////
+/// \brief Tables that cover part of the world ignore the terrain outside.
+TEST(VisibilityLookupTest, Outside)
+{
+  // 3 columns and 2 rows, starting at (100, 200). Cells 0-4 are blocked.
+  auto header = MakeHeader(KEYS, 100, 10, 25, 0);
+  header.minX = 100;
+  header.minY = 200;
+  header.columns = 3;
+  header.rows = 2;
+  WriteTable(header, {VisibilityLookup::Pair(0, 4)});
+
+  VisibilityLookup lookup;
+  EXPECT_EQ(lookup.Index(100, 200), VisibilityLookup::kOutside);
+  ASSERT_TRUE(lookup.Load(kTablePath));
+
+  EXPECT_EQ(lookup.Index(100, 200), 0u);
+  EXPECT_EQ(lookup.Index(110, 210), 4u);
+  EXPECT_EQ(lookup.Index(120, 210), 5u);
+  EXPECT_FALSE(lookup.Visible(lookup.Index(100, 200), lookup.Index(110, 210)));
+
+  EXPECT_EQ(lookup.Index(94, 200), VisibilityLookup::kOutside);
+  EXPECT_EQ(lookup.Index(126, 200), VisibilityLookup::kOutside);
+  EXPECT_EQ(lookup.Index(100, 194), VisibilityLookup::kOutside);
+  EXPECT_EQ(lookup.Index(100, 216), VisibilityLookup::kOutside);
+  EXPECT_EQ(lookup.Index(-1e9, 1e9), VisibilityLookup::kOutside);
+
+  EXPECT_TRUE(lookup.Visible(0, VisibilityLookup::kOutside));
+  EXPECT_TRUE(lookup.Visible(VisibilityLookup::kOutside, 4));
+
+  std::remove(kTablePath.c_str());
+}
+
+//////////////////////////////////////////////////
+/// \brief Tables are stored in the cache directory, keyed by terrain hash
+/// and covered area.
+TEST(VisibilityLookupTest, CachePath)
+{
+  setenv("SWARM_VISIBILITY_CACHE", "/tmp/swarm_cache", 1);
+  EXPECT_EQ(VisibilityLookup::CacheDirectory(), "/tmp/swarm_cache");
+  EXPECT_EQ(VisibilityLookup::CachePath(0xabcdef, -100, -200, 300, 400),
+      "/tmp/swarm_cache/visibility_0000000000abcdef_-100_-200_300_400.dat");
+  EXPECT_NE(VisibilityLookup::CachePath(1, 0, 0, 10, 10),
+      VisibilityLookup::CachePath(2, 0, 0, 10, 10));
+  EXPECT_NE(VisibilityLookup::CachePath(1, 0, 0, 10, 10),
+      VisibilityLookup::CachePath(1, 0, 0, 20, 10));
+  EXPECT_EQ(VisibilityLookup::CachePath(0xabcdef, -100, -200, 300, 400, 40),
+      "/tmp/swarm_cache/visibility_0000000000abcdef_-100_-200_300_400_s40"
+      ".dat");
+  EXPECT_EQ(VisibilityLookup::CachePath(1, 0, 0, 10, 10),
+      VisibilityLookup::CachePath(1, 0, 0, 10, 10,
+        VisibilityLookup::kFinestStepSize));
+  EXPECT_EQ(VisibilityLookup::ObstaclesCachePath(0xabcdef, 0x12, -100, -200,
+        300, 400), "/tmp/swarm_cache/obstacles_0000000000abcdef_"
+      "0000000000000012_-100_-200_300_400.dat");
+  EXPECT_NE(VisibilityLookup::ObstaclesCachePath(1, 1, 0, 0, 10, 10),
+      VisibilityLookup::ObstaclesCachePath(1, 2, 0, 0, 10, 10));
+  unsetenv("SWARM_VISIBILITY_CACHE");
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
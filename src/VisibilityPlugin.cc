@@ -14,6 +14,8 @@
  * limitations under the License.
  *
 */
+#include <algorithm>
+#include <cstdlib>
 #include <fstream>
 #include <sys/stat.h>
 
@@ -47,6 +49,80 @@ void VisibilityPlugin::Init()
 /////////////////////////////////////////////
 void VisibilityPlugin::OnWorldCreated()
 {
-  swarm::VisibilityTable table;
-  table.Generate();
+  // The number of generation threads can be set with the
+  // SWARM_VISIBILITY_THREADS environment variable. By default, one thread
+  // per hardware core is used.
+  unsigned int threads = 0;
+  char *threadsEnv = std::getenv("SWARM_VISIBILITY_THREADS");
+  if (threadsEnv && std::atoi(threadsEnv) > 0)
+    threads = std::atoi(threadsEnv);
+
+  // SWARM_VISIBILITY_FORMAT=keys generates the older list of blocked keys
+  // instead of a stencil table, SWARM_VISIBILITY_FORMAT=clearance an
+  // altitude-aware table, and SWARM_VISIBILITY_FORMAT=obstacles the layer of
+  // trees and buildings of the world.
+  swarm::VisibilityTableFormat format = swarm::STENCIL;
+  char *formatEnv = std::getenv("SWARM_VISIBILITY_FORMAT");
+  if (formatEnv && std::string(formatEnv) == "keys")
+    format = swarm::KEYS;
+  else if (formatEnv && std::string(formatEnv) == "clearance")
+    format = swarm::CLEARANCE;
+  else if (formatEnv && std::string(formatEnv) == "obstacles")
+    format = swarm::OBSTACLES;
+
+  // SWARM_VISIBILITY_BACKEND=heightmap tests the line of sight on the
+  // heightmap samples instead of casting rays, and
+  // SWARM_VISIBILITY_BACKEND=gpu runs the same tests on an OpenCL device.
+  swarm::VisibilityTableBackend backend = swarm::RAY_BACKEND;
+  char *backendEnv = std::getenv("SWARM_VISIBILITY_BACKEND");
+  if (backendEnv && std::string(backendEnv) == "gpu")
+    backend = swarm::GPU_BACKEND;
+  else if ((backendEnv && std::string(backendEnv) == "heightmap") ||
+      format == swarm::CLEARANCE)
+  {
+    backend = swarm::HEIGHTMAP_BACKEND;
+  }
+
+  // SWARM_VISIBILITY_SHARD=<i>/<n> only generates shard i of n, to be
+  // merged with swarm_visibility_merge.
+  int shardIndex = 0;
+  int shardCount = 1;
+  char *shardEnv = std::getenv("SWARM_VISIBILITY_SHARD");
+  if (shardEnv && !swarm::VisibilityTable::ParseShard(shardEnv, shardIndex,
+        shardCount))
+  {
+    gzerr << "Invalid SWARM_VISIBILITY_SHARD [" << shardEnv
+          << "], expected <index>/<count>\n";
+    return;
+  }
+
+  // SWARM_VISIBILITY_GPU_VALIDATE=<n> compares n cells computed by the GPU
+  // with the CPU.
+  char *validateEnv = std::getenv("SWARM_VISIBILITY_GPU_VALIDATE");
+  const int validation = validateEnv ? std::max(0, std::atoi(validateEnv)) : 0;
+
+  // SWARM_VISIBILITY_TILES=<n> also writes the table split into compressed
+  // tiles of n x n cells.
+  char *tilesEnv = std::getenv("SWARM_VISIBILITY_TILES");
+  const int tileSize = tilesEnv ? std::max(0, std::atoi(tilesEnv)) : 0;
+
+  // SWARM_VISIBILITY_LEVELS=<n> generates the n finest levels of the table,
+  // the coarser ones storing the pairs farther apart than 250m.
+  int levels = 1;
+  char *levelsEnv = std::getenv("SWARM_VISIBILITY_LEVELS");
+  if (levelsEnv)
+  {
+    levels = std::max(1, std::min(swarm::VisibilityTable::kMaxLevels,
+          std::atoi(levelsEnv)));
+  }
+
+  for (int level = 0; level < levels; ++level)
+  {
+    swarm::VisibilityTable table;
+    table.SetLevel(level);
+    table.SetShard(shardIndex, shardCount);
+    table.SetGpuValidation(validation);
+    table.SetTileSize(tileSize);
+    table.Generate(threads, format, backend);
+  }
 }
@@ -14,161 +14,1135 @@
  * limitations under the License.
  *
 */
-#include <fstream>
+#include <fcntl.h>
+#include <sys/file.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <bitset>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
+#include <zlib.h>
+#include <boost/filesystem.hpp>
 #include "gazebo/physics/physics.hh"
+#include "swarm/Common.hh"
+#include "swarm/SceneIndex.hh"
+#include "swarm/VisibilityGpu.hh"
+#include "swarm/VisibilityLookup.hh"
 #include "swarm/VisibilityTable.hh"
+#include "swarm/WorkerPool.hh"
 
 using namespace swarm;
 
+const int VisibilityTable::kFinestRange;
+const int VisibilityTable::kMaxLevels;
+const int VisibilityTable::kMaxRange;
+const int32_t VisibilityTable::kShardMagic;
+const int32_t VisibilityTable::kShardVersion;
+const size_t VisibilityTable::kMergeBlockWords;
+const uint64_t VisibilityTable::kMaxReportedCells;
+
+/// \brief Exclusive lock on a file of the cache, held while a table is
+/// generated. The lock is released when the process exits, even if it
+/// crashes.
+class CacheLock
+{
+  /// \brief Wait for the lock.
+  /// \param[in] _filename The lock file, created if needed.
+  public: explicit CacheLock(const std::string &_filename)
+  {
+    this->fd = open(_filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (this->fd >= 0)
+    {
+      while (flock(this->fd, LOCK_EX) != 0 && errno == EINTR)
+        continue;
+    }
+  }
+
+  /// \brief Release the lock.
+  public: ~CacheLock()
+  {
+    if (this->fd >= 0)
+      close(this->fd);
+  }
+
+  /// \brief The lock file, or -1 if it couldn't be opened. The table is
+  /// generated without the lock in that case.
+  private: int fd;
+};
+
 /////////////////////////////////////////////
 VisibilityTable::VisibilityTable()
 {
-  this->range = {-20000, 20000};
-  this->stepSize = 10;
-  this->maxY = this->range[1];
-  this->rowSize = (this->range[1] - this->range[0]) / this->stepSize + 1;
+  this->stepSize = VisibilityLookup::kFinestStepSize;
+  this->minX = this->minY = -kMaxRange;
+  this->maxX = this->maxY = kMaxRange;
+  this->columns = this->rows = 2 * kMaxRange / this->stepSize + 1;
+  this->radius = kFinestRange / this->stepSize;
+
+  this->stencilLayout =
+    VisibilityLookup::StencilLayout(this->radius, this->bitCount);
+  this->wordsPerCell =
+    VisibilityLookup::WordsPerCell(this->format, this->bitCount);
+}
+
+/////////////////////////////////////////////
+bool VisibilityTable::SetLevel(const int _level)
+{
+  if (_level < 0 || _level >= kMaxLevels)
+    return false;
+
+  // The radius stays the same number of cells.
+  this->level = _level;
+  this->stepSize = LevelStepSize(_level);
+  this->columns = this->rows = 2 * kMaxRange / this->stepSize + 1;
+  return true;
+}
+
+/////////////////////////////////////////////
+int VisibilityTable::Level() const
+{
+  return this->level;
+}
+
+/////////////////////////////////////////////
+int VisibilityTable::LevelStepSize(const int _level)
+{
+  int step = VisibilityLookup::kFinestStepSize;
+  for (int i = 0; i < _level; ++i)
+    step *= VisibilityLookup::kLevelFactor;
+  return step;
+}
+
+/////////////////////////////////////////////
+double VisibilityTable::LevelRange(const int _level)
+{
+  return static_cast<double>(kFinestRange) /
+    VisibilityLookup::kFinestStepSize * LevelStepSize(_level);
+}
+
+/////////////////////////////////////////////
+void VisibilityTable::SetArea(const Common &_common)
+{
+  ignition::math::Vector3d searchMin, searchMax;
+  if (_common.SearchAreaBounds(searchMin, searchMax))
+  {
+    this->SetArea(_common.TerrainHash(), _common.TerrainSize(), searchMin,
+        searchMax);
+  }
+  else
+    this->SetArea(_common.TerrainHash(), _common.TerrainSize());
+}
+
+/////////////////////////////////////////////
+void VisibilityTable::SetArea(const uint64_t _terrainHash,
+    const ignition::math::Vector3d &_terrainSize)
+{
+  this->SetBounds(_terrainHash, _terrainSize * -0.5, _terrainSize * 0.5);
+}
+
+/////////////////////////////////////////////
+void VisibilityTable::SetArea(const uint64_t _terrainHash,
+    const ignition::math::Vector3d &_terrainSize,
+    const ignition::math::Vector3d &_searchMin,
+    const ignition::math::Vector3d &_searchMax)
+{
+  ignition::math::Vector3d areaMin = _terrainSize * -0.5;
+  ignition::math::Vector3d areaMax = _terrainSize * 0.5;
+
+  // Robots at the border of the search area can talk to robots up to
+  // one radius away.
+  const double margin = this->radius * this->stepSize;
+  areaMin.Max(_searchMin - ignition::math::Vector3d(margin, margin, 0));
+  areaMax.Min(_searchMax + ignition::math::Vector3d(margin, margin, 0));
+
+  this->SetBounds(_terrainHash, areaMin, areaMax);
+}
+
+/////////////////////////////////////////////
+void VisibilityTable::SetBounds(const uint64_t _terrainHash,
+    const ignition::math::Vector3d &_min, const ignition::math::Vector3d &_max)
+{
+  this->terrainHash = _terrainHash;
+
+  // Snap to the grid, growing the area, and limit the size of the file.
+  auto snap = [this](const double _value, const bool _up)
+  {
+    double cells = _value / this->stepSize;
+    cells = _up ? std::ceil(cells) : std::floor(cells);
+    return std::max(-kMaxRange,
+        std::min(kMaxRange, static_cast<int>(cells) * this->stepSize));
+  };
+
+  this->minX = snap(_min.X(), false);
+  this->minY = snap(_min.Y(), false);
+  this->maxX = std::max(this->minX, snap(_max.X(), true));
+  this->maxY = std::max(this->minY, snap(_max.Y(), true));
+  this->columns = (this->maxX - this->minX) / this->stepSize + 1;
+  this->rows = (this->maxY - this->minY) / this->stepSize + 1;
+}
+
+/////////////////////////////////////////////
+std::string VisibilityTable::Filename() const
+{
+  return VisibilityLookup::CachePath(this->terrainHash, this->minX,
+      this->minY, this->maxX, this->maxY, this->stepSize);
+}
+
+/////////////////////////////////////////////
+std::string VisibilityTable::ObstaclesFilename(
+    const uint64_t _obstaclesHash) const
+{
+  return VisibilityLookup::ObstaclesCachePath(this->terrainHash,
+      _obstaclesHash, this->minX, this->minY, this->maxX, this->maxY,
+      this->stepSize);
+}
+
+/////////////////////////////////////////////
+void VisibilityTable::SetObstacles(
+    const std::vector<ignition::math::Box> &_trees,
+    const std::vector<ignition::math::Box> &_buildings)
+{
+  this->trees.Build(_trees);
+  this->buildings.Build(_buildings);
+  this->obstaclesHash = ObstaclesHash(_trees, _buildings);
+}
+
+/////////////////////////////////////////////
+uint64_t VisibilityTable::ObstaclesHash(
+    const std::vector<ignition::math::Box> &_trees,
+    const std::vector<ignition::math::Box> &_buildings)
+{
+  // FNV-1a, like Heightmap::Hash().
+  uint64_t h = 14695981039346656037ULL;
+  auto hashBytes = [&h](const void *_data, const size_t _count)
+  {
+    const unsigned char *bytes = static_cast<const unsigned char*>(_data);
+    for (size_t i = 0; i < _count; ++i)
+    {
+      h ^= bytes[i];
+      h *= 1099511628211ULL;
+    }
+  };
+
+  for (auto const *boxes : {&_trees, &_buildings})
+  {
+    const uint64_t count = boxes->size();
+    hashBytes(&count, sizeof(count));
+    for (auto const &box : *boxes)
+    {
+      const double bounds[6] = {box.Min().X(), box.Min().Y(), box.Min().Z(),
+                                box.Max().X(), box.Max().Y(), box.Max().Z()};
+      hashBytes(bounds, sizeof(bounds));
+    }
+  }
+
+  return h;
+}
+
+/////////////////////////////////////////////
+void VisibilityTable::SetGpuValidation(const unsigned int _cells)
+{
+  this->gpuValidation = _cells;
+}
+
+/////////////////////////////////////////////
+bool VisibilityTable::SetShard(const int _index, const int _count)
+{
+  if (_count < 1 || _index < 0 || _index >= _count)
+    return false;
+
+  this->shardIndex = _index;
+  this->shardCount = _count;
+  return true;
+}
+
+/////////////////////////////////////////////
+void VisibilityTable::SetTileSize(const int _tileSize)
+{
+  this->tileSize = std::max(0, _tileSize);
+}
+
+/////////////////////////////////////////////
+bool VisibilityTable::ParseShard(const std::string &_spec, int &_index,
+    int &_count)
+{
+  int index, count;
+  char extra;
+  if (std::sscanf(_spec.c_str(), "%d/%d%c", &index, &count, &extra) != 2 ||
+      count < 1 || index < 0 || index >= count)
+  {
+    return false;
+  }
+
+  _index = index;
+  _count = count;
+  return true;
+}
+
+/////////////////////////////////////////////
+std::string VisibilityTable::ShardFilename(const std::string &_table,
+    const int _index, const int _count)
+{
+  return _table + ".shard-" + std::to_string(_index) + "-of-" +
+    std::to_string(_count);
 }
 
 /////////////////////////////////////////////
-void VisibilityTable::Generate()
+bool VisibilityTable::MergeShards(const std::vector<std::string> &_shards,
+    const std::string &_output)
 {
-  std::string outFilename = "/tmp/visibility.dat";
+  if (_shards.empty())
+  {
+    std::cerr << "No visibility table shards to merge" << std::endl;
+    return false;
+  }
+
+  // Read and validate the header of every shard. The structs have no
+  // padding, and the writer clears them, so they compare as bytes.
+  std::vector<VisibilityShardHeader> headers(_shards.size());
+  std::vector<int> byIndex(_shards.size(), -1);
+  for (size_t i = 0; i < _shards.size(); ++i)
+  {
+    VisibilityShardHeader &header = headers[i];
+    std::ifstream in(_shards[i], std::ios::binary);
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        header.magic != kShardMagic || header.version != kShardVersion ||
+        header.index < 0 || header.index >= header.count ||
+        header.rowCount < 0 || header.table.magic != VisibilityLookup::kMagic ||
+        header.table.version != VisibilityLookup::kVersion)
+    {
+      std::cerr << "[" << _shards[i] << "] is not a visibility table shard"
+                << std::endl;
+      return false;
+    }
+
+    boost::system::error_code ec;
+    const uint64_t size = boost::filesystem::file_size(_shards[i], ec);
+    const uint64_t rowWords = static_cast<uint64_t>(header.table.columns) *
+      header.table.wordsPerCell;
+    if (ec || size != sizeof(header) + header.wordCount * sizeof(uint64_t) ||
+        (header.table.format != KEYS &&
+         header.wordCount != header.rowCount * rowWords))
+    {
+      std::cerr << "[" << _shards[i] << "] is truncated" << std::endl;
+      return false;
+    }
+
+    if (header.count != headers[0].count ||
+        header.obstaclesHash != headers[0].obstaclesHash ||
+        std::memcmp(&header.table, &headers[0].table,
+          sizeof(header.table)) != 0)
+    {
+      std::cerr << "[" << _shards[i] << "] is a shard of another table than ["
+                << _shards[0] << "]" << std::endl;
+      return false;
+    }
+
+    if (header.count != static_cast<int>(_shards.size()))
+    {
+      std::cerr << "The table has " << header.count << " shards, "
+                << _shards.size() << " given" << std::endl;
+      return false;
+    }
+
+    if (byIndex[header.index] >= 0)
+    {
+      std::cerr << "[" << _shards[i] << "] and ["
+                << _shards[byIndex[header.index]] << "] are both shard "
+                << header.index << std::endl;
+      return false;
+    }
+    byIndex[header.index] = static_cast<int>(i);
+  }
+
+  // The shards must cover every row once, in order.
+  const VisibilityTableHeader &table = headers[0].table;
+  int nextRow = 0;
+  for (int index : byIndex)
+  {
+    const VisibilityShardHeader &header = headers[index];
+    if (header.firstRow != nextRow)
+    {
+      std::cerr << "[" << _shards[index] << "] starts at row "
+                << header.firstRow << " instead of " << nextRow << std::endl;
+      return false;
+    }
+    nextRow += header.rowCount;
+  }
+  if (nextRow != table.rows)
+  {
+    std::cerr << "The shards cover " << nextRow << " rows of "
+              << table.rows << std::endl;
+    return false;
+  }
+
+  std::string outFilename = _output;
+  if (outFilename.empty())
+  {
+    const int maxX = table.minX + (table.columns - 1) * table.stepSize;
+    const int maxY = table.minY + (table.rows - 1) * table.stepSize;
+    outFilename = table.format == OBSTACLES ?
+      VisibilityLookup::ObstaclesCachePath(table.terrainHash,
+          headers[0].obstaclesHash, table.minX, table.minY, maxX, maxY,
+          table.stepSize) :
+      VisibilityLookup::CachePath(table.terrainHash, table.minX, table.minY,
+          maxX, maxY, table.stepSize);
+  }
+
+  const boost::filesystem::path parent =
+    boost::filesystem::path(outFilename).parent_path();
+  if (!parent.empty())
+    boost::filesystem::create_directories(parent);
+
+  CacheLock lock(outFilename + ".lock");
 
   struct stat buffer;
   if (stat(outFilename.c_str(), &buffer) == 0)
   {
-    printf("/tmp/visibility.dat already exists, skipping\n");
-    return;
+    printf("%s already exists, skipping\n", outFilename.c_str());
+    return true;
+  }
+
+  std::string tmpFilename = outFilename + ".tmp." +
+    std::to_string(getpid());
+  std::fstream out(tmpFilename, std::ios::out | std::ios::binary);
+  out.write(reinterpret_cast<const char*>(&table), sizeof(table));
+
+  // Stencil rows are copied in order, a block at a time. Keys are sorted
+  // again, like Build() does for a single run.
+  std::vector<uint64_t> words(kMergeBlockWords);
+  std::vector<uint64_t> allKeys;
+  bool readAll = true;
+  for (int index : byIndex)
+  {
+    std::ifstream in(_shards[index], std::ios::binary);
+    in.seekg(sizeof(VisibilityShardHeader));
+    uint64_t remaining = headers[index].wordCount;
+    while (readAll && remaining > 0)
+    {
+      const size_t count = static_cast<size_t>(
+          std::min<uint64_t>(remaining, words.size()));
+      readAll = static_cast<bool>(in.read(
+            reinterpret_cast<char*>(words.data()), count * sizeof(uint64_t)));
+      remaining -= count;
+
+      if (table.format != KEYS)
+      {
+        out.write(reinterpret_cast<const char*>(words.data()),
+            count * sizeof(uint64_t));
+      }
+      else
+        allKeys.insert(allKeys.end(), words.begin(), words.begin() + count);
+    }
+  }
+
+  if (table.format == KEYS)
+  {
+    std::sort(allKeys.begin(), allKeys.end());
+    allKeys.erase(std::unique(allKeys.begin(), allKeys.end()),
+        allKeys.end());
+    out.write(reinterpret_cast<const char*>(allKeys.data()),
+        allKeys.size() * sizeof(uint64_t));
   }
 
-  std::map<uint64_t, int> visibilityMap;
-  std::map<uint64_t, double> heights;
+  out.close();
+  if (!readAll || !out ||
+      std::rename(tmpFilename.c_str(), outFilename.c_str()) != 0)
+  {
+    std::cerr << "Unable to write the visibility table [" << outFilename
+              << "]" << std::endl;
+    std::remove(tmpFilename.c_str());
+    return false;
+  }
 
-  std::fstream out(outFilename, std::ios::out | std::ios::binary);
+  std::cout << "Merged " << _shards.size() << " shards into "
+            << outFilename << std::endl;
+  return true;
+}
 
-  // This ray will be used in LineOfSight() for checking obstacles
-  // between a pair of vehicles.
-  if (!this->ray)
+/////////////////////////////////////////////
+bool VisibilityTable::WriteTiles(const std::string &_table,
+    const int _tileSize, const std::string &_output)
+{
+  if (_tileSize <= 0)
   {
-    gazebo::physics::WorldPtr world = gazebo::physics::get_world();
-    this->ray = boost::dynamic_pointer_cast<gazebo::physics::RayShape>(
-        world->GetPhysicsEngine()->CreateShape("ray",
-          gazebo::physics::CollisionPtr()));
+    std::cerr << "Invalid tile size [" << _tileSize << "]" << std::endl;
+    return false;
   }
 
-  // Cache height values for efficiency.
-  for (int y = this->range[0]; y <= this->range[1]; y += this->stepSize)
+  // Validate the table before reading its cells.
+  VisibilityLookup lookup;
+  if (!lookup.Load(_table))
+    return false;
+
+  if (lookup.Tiled() || lookup.Format() == KEYS)
   {
-    for (int x = this->range[0]; x <= this->range[1]; x += this->stepSize)
+    std::cerr << "Only the stencil, clearance and obstacle tables can be "
+              << "split into tiles" << std::endl;
+    return false;
+  }
+  const VisibilityTableHeader table = lookup.Header();
+  lookup.Unload();
+
+  const std::string outFilename = _output.empty() ?
+    VisibilityLookup::TilesFilename(_table) : _output;
+  const boost::filesystem::path parent =
+    boost::filesystem::path(outFilename).parent_path();
+  if (!parent.empty())
+    boost::filesystem::create_directories(parent);
+
+  CacheLock lock(outFilename + ".lock");
+
+  struct stat buffer;
+  if (stat(outFilename.c_str(), &buffer) == 0)
+  {
+    printf("%s already exists, skipping\n", outFilename.c_str());
+    return true;
+  }
+
+  VisibilityTilesHeader tiles;
+  std::memset(&tiles, 0, sizeof(tiles));
+  tiles.magic = VisibilityLookup::kTilesMagic;
+  tiles.version = VisibilityLookup::kTilesVersion;
+  tiles.tileSize = _tileSize;
+  tiles.tileColumns = (table.columns + _tileSize - 1) / _tileSize;
+  tiles.tileRows = (table.rows + _tileSize - 1) / _tileSize;
+  tiles.table = table;
+
+  // The offsets are written once the tiles are compressed.
+  const uint64_t tileCount =
+    static_cast<uint64_t>(tiles.tileColumns) * tiles.tileRows;
+  std::vector<uint64_t> offsets(tileCount + 1, 0);
+
+  std::string tmpFilename = outFilename + ".tmp." +
+    std::to_string(getpid());
+  std::fstream out(tmpFilename, std::ios::out | std::ios::binary);
+  out.write(reinterpret_cast<const char*>(&tiles), sizeof(tiles));
+  out.write(reinterpret_cast<const char*>(offsets.data()),
+      offsets.size() * sizeof(uint64_t));
+
+  // Each row of a tile is a contiguous run of words of the table.
+  std::ifstream in(_table, std::ios::binary);
+  const uint64_t columns = table.columns;
+  const uint64_t wordsPerCell = table.wordsPerCell;
+  std::vector<uint64_t> words;
+  std::string compressed;
+  uint64_t offset = sizeof(tiles) + offsets.size() * sizeof(uint64_t);
+  bool result = true;
+  for (int tileRow = 0; result && tileRow < tiles.tileRows; ++tileRow)
+  {
+    for (int tileColumn = 0; result && tileColumn < tiles.tileColumns;
+         ++tileColumn)
     {
-      heights[this->Index(x, y)] =  this->HeightAt(x, y);
+      const uint64_t firstRow = static_cast<uint64_t>(tileRow) * _tileSize;
+      const uint64_t firstColumn =
+        static_cast<uint64_t>(tileColumn) * _tileSize;
+      const uint64_t width = std::min<uint64_t>(_tileSize,
+          columns - firstColumn);
+      const uint64_t height = std::min<uint64_t>(_tileSize,
+          table.rows - firstRow);
+      const uint64_t rowWords = width * wordsPerCell;
+
+      words.resize(height * rowWords);
+      for (uint64_t y = 0; result && y < height; ++y)
+      {
+        in.seekg(sizeof(VisibilityTableHeader) + ((firstRow + y) * columns +
+              firstColumn) * wordsPerCell * sizeof(uint64_t));
+        result = static_cast<bool>(in.read(
+              reinterpret_cast<char*>(&words[y * rowWords]),
+              rowWords * sizeof(uint64_t)));
+      }
+
+      // The tiles are compressed once, so the smallest output is worth
+      // the time.
+      const uLong rawSize = words.size() * sizeof(uint64_t);
+      uLongf size = compressBound(rawSize);
+      compressed.resize(size);
+      result = result && compress2(reinterpret_cast<Bytef *>(&compressed[0]),
+          &size, reinterpret_cast<const Bytef *>(words.data()), rawSize,
+          Z_BEST_COMPRESSION) == Z_OK;
+      out.write(compressed.data(), size);
+
+      offsets[static_cast<uint64_t>(tileRow) * tiles.tileColumns +
+        tileColumn] = offset;
+      offset += size;
     }
   }
+  offsets[tileCount] = offset;
+  out.seekp(sizeof(tiles));
+  out.write(reinterpret_cast<const char*>(offsets.data()),
+      offsets.size() * sizeof(uint64_t));
 
-  // Save info about the visibility table
-  out.write(reinterpret_cast<const char*>(&this->range[1]), sizeof(int));
-  out.write(reinterpret_cast<const char*>(&this->stepSize), sizeof(int));
-  out.write(reinterpret_cast<const char*>(&this->rowSize), sizeof(int));
+  out.close();
+  if (!result || !out ||
+      std::rename(tmpFilename.c_str(), outFilename.c_str()) != 0)
+  {
+    std::cerr << "Unable to write the tiled visibility table ["
+              << outFilename << "]" << std::endl;
+    std::remove(tmpFilename.c_str());
+    return false;
+  }
+
+  std::cout << "Tiled visibility table at: " << outFilename << " ("
+            << tileCount << " tiles of " << _tileSize << "x" << _tileSize
+            << " cells, " << offset << " bytes)" << std::endl;
+  return true;
+}
+
+/////////////////////////////////////////////
+bool VisibilityTable::Generate(const unsigned int _threads,
+    const VisibilityTableFormat _format,
+    const VisibilityTableBackend _backend)
+{
+  gazebo::physics::WorldPtr world = gazebo::physics::get_world();
+
+  // The table is stored in the cache, keyed by the hash of the terrain.
+  gazebo::physics::ModelPtr terrainModel = world->GetModel("terrain");
+  if (!terrainModel)
+  {
+    gzerr << "No terrain model found, a visibility table is not needed\n";
+    return false;
+  }
+
+  Common common;
+  common.SetWorld(world);
+
+  common.LoadWorldSearchArea(world->GetSDF());
+  this->SetArea(common);
+
+  // The obstacle layer is generated from the trees and buildings of the
+  // scene index, like CommsModel uses them. Their rays would hit the trees,
+  // so the terrain always comes from the heightmap.
+  if (_format == OBSTACLES)
+  {
+    const std::shared_ptr<const SceneIndex> scene = common.Scene();
+    this->SetObstacles(scene->TreeBoxes(), scene->BuildingBoxes());
+
+    std::cout << "Obstacle layer of " << scene->TreeBoxes().size()
+              << " trees and " << scene->BuildingBoxes().size()
+              << " buildings" << std::endl;
+  }
+
+  if (_backend != RAY_BACKEND || _format == OBSTACLES)
+  {
+    return this->Generate(common.TerrainHeightmap(), _threads, _format,
+        _backend);
+  }
+
+  unsigned int threadCount = _threads;
+  if (threadCount == 0)
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+  // Each worker thread gets its own ray, used in HeightAt() and
+  // LineOfSight(). The rays are created here because the physics engine
+  // is not safe to modify from multiple threads. The casts still share the
+  // collision space of the engine, so this backend may not scale with the
+  // threads like the heightmap one does.
+  std::vector<gazebo::physics::RayShapePtr> rays;
+  for (unsigned int i = 0; i < threadCount; ++i)
+  {
+    rays.push_back(boost::dynamic_pointer_cast<gazebo::physics::RayShape>(
+        world->GetPhysicsEngine()->CreateShape("ray",
+          gazebo::physics::CollisionPtr())));
+  }
+
+  this->heightmap = nullptr;
+  return this->Build(rays, _format);
+}
+
+/////////////////////////////////////////////
+bool VisibilityTable::Generate(const Heightmap &_heightmap,
+    const unsigned int _threads, const VisibilityTableFormat _format,
+    const VisibilityTableBackend _backend)
+{
+  if (!_heightmap.Valid())
+  {
+    std::cerr << "Invalid heightmap, unable to generate a visibility table"
+              << std::endl;
+    return false;
+  }
+
+  unsigned int threadCount = _threads;
+  if (threadCount == 0)
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+  // The GPU only computes stencil tables, the other formats and the
+  // validation stay on the CPU.
+  VisibilityGpu device;
+  this->gpu = nullptr;
+  if (_backend == GPU_BACKEND && _format != STENCIL)
+  {
+    std::cout << "The GPU backend only generates stencil tables, using the "
+              << "heightmap backend" << std::endl;
+  }
+  else if (_backend == GPU_BACKEND && device.Load(_heightmap, this->radius))
+    this->gpu = &device;
+
+  // The heightmap is queried directly, the workers don't need rays.
+  this->terrainHash = _heightmap.Hash();
+  this->heightmap = &_heightmap;
+  bool result = this->Build(
+      std::vector<gazebo::physics::RayShapePtr>(threadCount), _format);
+  this->heightmap = nullptr;
+  this->gpu = nullptr;
+
+  return result;
+}
+
+/////////////////////////////////////////////
+bool VisibilityTable::Build(
+    const std::vector<gazebo::physics::RayShapePtr> &_rays,
+    const VisibilityTableFormat _format)
+{
+  std::string tableFilename = _format == OBSTACLES ?
+    this->ObstaclesFilename(this->obstaclesHash) : this->Filename();
+
+  // A shard only computes its band of rows, and is written next to the
+  // table.
+  const bool sharded = this->shardCount > 1;
+  std::string outFilename = sharded ? ShardFilename(tableFilename,
+      this->shardIndex, this->shardCount) : tableFilename;
+  const int firstRow = static_cast<int>(
+      static_cast<int64_t>(this->rows) * this->shardIndex / this->shardCount);
+  const int endRow = static_cast<int>(static_cast<int64_t>(this->rows) *
+      (this->shardIndex + 1) / this->shardCount);
+
+  boost::filesystem::create_directories(
+      VisibilityLookup::CacheDirectory());
+
+  // The processes started together on a node generate the table once: the
+  // others wait for the lock, and then find the complete table.
+  CacheLock lock(outFilename + ".lock");
+
+  struct stat buffer;
+  if (stat(outFilename.c_str(), &buffer) == 0 ||
+      (sharded && stat(tableFilename.c_str(), &buffer) == 0))
+  {
+    printf("%s already exists, skipping\n", outFilename.c_str());
+    return sharded || _format == KEYS || this->tileSize == 0 ||
+      WriteTiles(outFilename, this->tileSize);
+  }
+
+  // The table is written to a temporary file, that is renamed once it's
+  // complete. Other processes will never map a partial table.
+  std::string tmpFilename = outFilename + ".tmp." +
+    std::to_string(getpid());
+
+  if (_format == CLEARANCE && !this->heightmap)
+  {
+    gzerr << "The clearance format requires the heightmap backend\n";
+    return false;
+  }
+
+  if (_format == OBSTACLES && !this->heightmap)
+  {
+    gzerr << "The obstacles format requires the heightmap backend\n";
+    return false;
+  }
+
+  this->format = _format;
+  this->wordsPerCell =
+    VisibilityLookup::WordsPerCell(this->format, this->bitCount);
+  const unsigned int threadCount = _rays.size();
+
+  std::fstream out(tmpFilename, std::ios::out | std::ios::binary);
+
+  std::cout << "Generating visibility table of [" << this->minX << ", "
+    << this->minY << "] x [" << this->maxX << ", " << this->maxY
+    << "] using " << threadCount << " threads and the "
+    << (this->gpu ? "GPU" : this->heightmap ? "heightmap" : "ray")
+    << " backend\n";
+  if (sharded)
+  {
+    std::cout << "Shard " << this->shardIndex << " of " << this->shardCount
+      << ": rows [" << firstRow << ", " << endRow << ")\n";
+  }
 
   // Used to compute time required to compute the visibility table
   auto startTime =
     std::chrono::system_clock::now().time_since_epoch();
 
-  ignition::math::Vector3d startPos, endPos;
-
-  // These two variables are used to compute percent complete
-  double div = std::pow(this->rowSize, 2);
-  uint64_t count = 0;
+  // Save info about the visibility table
+  VisibilityTableHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.magic = VisibilityLookup::kMagic;
+  header.version = VisibilityLookup::kVersion;
+  header.format = this->format;
+  header.stepSize = this->stepSize;
+  header.minX = this->minX;
+  header.minY = this->minY;
+  header.columns = this->columns;
+  header.rows = this->rows;
+  header.radius = this->radius;
+  header.wordsPerCell = this->wordsPerCell;
+  header.terrainHash = this->terrainHash;
 
-  // Iterate over the possible y values.
-  for (int y = this->range[0]; y <= this->range[1]; y += this->stepSize)
+  // The header of a shard is written again once its words are counted.
+  VisibilityShardHeader shardHeader;
+  std::memset(&shardHeader, 0, sizeof(shardHeader));
+  shardHeader.magic = kShardMagic;
+  shardHeader.version = kShardVersion;
+  shardHeader.index = this->shardIndex;
+  shardHeader.count = this->shardCount;
+  shardHeader.firstRow = firstRow;
+  shardHeader.rowCount = endRow - firstRow;
+  shardHeader.obstaclesHash = this->obstaclesHash;
+  shardHeader.table = header;
+  if (sharded)
   {
-    // Iterate over the possible x values.
-    for (int x = this->range[0]; x <= this->range[1];
-         x += this->stepSize, count++)
-    {
-      // Output percent complete
-      printf("\r%04.2f %% ", (count/div)*100);
+    out.write(reinterpret_cast<const char*>(&shardHeader),
+        sizeof(shardHeader));
+  }
+  else
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
 
-      // Get the  index of the (x, y) coordinate
-      unsigned int index = this->Index(x, y);
+  // Only a sliding window of height rows is kept, in a ring buffer: the
+  // pairs of a row end at most one radius later, so each chunk of rows
+  // needs the heights of its rows and of the next radius rows. Each chunk
+  // computes the rows missing from the window, overwriting those before
+  // the chunk, and then its bands. The bands are written in order, which
+  // keeps the output byte-identical to a serial run. Peak memory depends
+  // on the width of the table and on the number of threads, not on the
+  // number of rows. Keys are gathered and sorted at the end.
+  WorkerPool pool(threadCount);
+  const int chunkRows = kRowsPerBand * static_cast<int>(threadCount);
+  this->heightRows = std::min(this->rows, chunkRows + this->radius);
+  this->heights.assign(
+      static_cast<size_t>(this->columns) * this->heightRows, 0.0);
+  int heightEndRow = firstRow;
 
-      startPos.Set(x, y, heights[index]);
+  std::vector<std::vector<uint64_t>> bands(threadCount);
+  std::vector<uint64_t> allKeys;
 
-      // The inner loops checks visibility from startPos to endPos
-      for (int y2 = y; y2 <= this->range[1] && y2 <= y+250;
-           y2 += this->stepSize)
-      {
-        endPos.Y(y2);
-        int rx = this->range[0];
-        if (y2 == y)
-          rx = x;
+  // Cells of the validation sample, evenly spread over the rows generated.
+  uint64_t validationStride = 0;
+  uint64_t validatedCells = 0, differentCells = 0, totalDifferentBits = 0;
+  if (this->gpu && this->gpuValidation > 0)
+  {
+    validationStride = std::max<uint64_t>(1,
+        static_cast<uint64_t>(endRow - firstRow) * this->columns /
+        this->gpuValidation);
+  }
+  for (int chunkRow = firstRow; chunkRow < endRow; chunkRow += chunkRows)
+  {
+    const int chunkEndRow = std::min(chunkRow + chunkRows, endRow);
 
-        for (int x2 = rx; x2 <= this->range[1] && x2 <= rx+250;
-             x2 += this->stepSize)
+    // Each task fills a whole row, so no two workers write to the same
+    // element.
+    const int heightRow = heightEndRow;
+    heightEndRow = std::min(this->rows, chunkEndRow + this->radius);
+    pool.Run(heightEndRow - heightRow,
+        [this, &_rays, heightRow](const unsigned int _index,
+          const unsigned int _worker)
         {
+          int y = this->minY + (heightRow + _index) * this->stepSize;
+          for (int x = this->minX; x <= this->maxX; x += this->stepSize)
+          {
+            this->heights[this->HeightIndex(x, y)] =
+              this->HeightAt(_rays[_worker], x, y);
+          }
+        });
 
-          // Get the index of the (x2, y2) coordinate
-          unsigned int index2 = this->Index(x2, y2);
-          double dist = sqrt((x2-x)*(x2-x) + (y2-y)*(y2-y));
-
-          // Skip values that are too far away, of if x,y == x2,y2
-          if (dist > 250 || index == index2)
-            continue;
+    // The GPU computes the whole chunk as a single band. If it fails, the
+    // rest of the table is generated on the CPU.
+    int bandCount =
+      (chunkEndRow - chunkRow + kRowsPerBand - 1) / kRowsPerBand;
+    bands[0].clear();
+    const bool onGpu = this->gpu &&
+      this->gpu->Stencil(header, chunkRow, chunkEndRow - chunkRow, bands[0]);
+    if (this->gpu && !onGpu)
+    {
+      gzerr << "The GPU failed, generating the rest of the table on the "
+            << "CPU\n";
+      this->gpu = nullptr;
+    }
 
-          endPos.X(x2);
-          endPos.Z(heights[index2]);
+    if (onGpu)
+      bandCount = 1;
+    else
+    {
+      pool.Run(bandCount,
+          [this, &_rays, &bands, chunkRow, chunkEndRow](
+            const unsigned int _band, const unsigned int _worker)
+          {
+            bands[_band].clear();
+            int bandRow = chunkRow + static_cast<int>(_band) * kRowsPerBand;
+            int bandEndRow = std::min(bandRow + kRowsPerBand, chunkEndRow);
+            for (int row = bandRow; row < bandEndRow; ++row)
+            {
+              this->GenerateRow(this->minY + row * this->stepSize,
+                  _rays[_worker], bands[_band]);
+            }
+          });
+    }
 
-          bool visible = this->LineOfSight(startPos, endPos);
+    // Validation: the cells of the sample that fall in the chunk are
+    // generated again on the CPU, and their words compared.
+    if (onGpu && validationStride > 0)
+    {
+      const uint64_t chunkCell =
+        static_cast<uint64_t>(chunkRow - firstRow) * this->columns;
+      const uint64_t chunkEndCell =
+        static_cast<uint64_t>(chunkEndRow - firstRow) * this->columns;
+      std::vector<uint64_t> sample;
+      for (uint64_t cell = (chunkCell + validationStride - 1) /
+             validationStride * validationStride; cell < chunkEndCell;
+           cell += validationStride)
+      {
+        sample.push_back(cell - chunkCell);
+      }
 
-          // Only store values that are not visible
-          if (!visible)
+      std::vector<size_t> differentBits(sample.size(), 0);
+      const std::vector<uint64_t> &gpuWords = bands[0];
+      pool.Run(sample.size(),
+          [this, &_rays, &sample, &differentBits, &gpuWords, chunkRow](
+            const unsigned int _index, const unsigned int _worker)
           {
-            uint64_t value = this->Pair(index, index2);
-            out.write(reinterpret_cast<const char*>(&value),
-                sizeof(uint64_t));
-          }
+            const uint64_t cell = sample[_index];
+            std::vector<uint64_t> cpuWords;
+            this->GenerateCell(
+                this->minX + static_cast<int>(cell % this->columns) *
+                  this->stepSize,
+                this->minY + (chunkRow + static_cast<int>(
+                    cell / this->columns)) * this->stepSize,
+                _rays[_worker], cpuWords);
+            for (int i = 0; i < this->wordsPerCell; ++i)
+            {
+              differentBits[_index] += std::bitset<64>(cpuWords[i] ^
+                  gpuWords[cell * this->wordsPerCell + i]).count();
+            }
+          });
+
+      for (size_t i = 0; i < sample.size(); ++i)
+      {
+        ++validatedCells;
+        if (differentBits[i] == 0)
+          continue;
+
+        ++differentCells;
+        totalDifferentBits += differentBits[i];
+        if (differentCells <= kMaxReportedCells)
+        {
+          const uint64_t cell = sample[i] + chunkCell;
+          std::cerr << "\nGPU and CPU differ by " << differentBits[i]
+                    << " bits at cell ["
+                    << this->minX + static_cast<int>(cell % this->columns) *
+                       this->stepSize << ", "
+                    << this->minY + (firstRow + static_cast<int>(
+                         cell / this->columns)) * this->stepSize << "]";
         }
       }
     }
+
+    for (int band = 0; band < bandCount; ++band)
+    {
+      const std::vector<uint64_t> &words = bands[band];
+      if (this->format != KEYS)
+      {
+        out.write(reinterpret_cast<const char*>(words.data()),
+            words.size() * sizeof(uint64_t));
+        shardHeader.wordCount += words.size();
+      }
+      else
+        allKeys.insert(allKeys.end(), words.begin(), words.end());
+    }
+
+    // Output percent complete
+    printf("\r%04.2f %% ",
+        (chunkEndRow - firstRow) * 100.0 / (endRow - firstRow));
+    fflush(stdout);
+  }
+
+  if (this->format == KEYS)
+  {
+    // Sort the keys, so VisibilityLookup can binary search the file.
+    std::sort(allKeys.begin(), allKeys.end());
+    allKeys.erase(std::unique(allKeys.begin(), allKeys.end()),
+        allKeys.end());
+    out.write(reinterpret_cast<const char*>(allKeys.data()),
+        allKeys.size() * sizeof(uint64_t));
+    shardHeader.wordCount = allKeys.size();
+  }
+
+  if (sharded)
+  {
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&shardHeader),
+        sizeof(shardHeader));
   }
+
+  if (validationStride > 0)
+  {
+    std::cout << "\nGPU validation: " << validatedCells << " cells compared "
+      << "with the CPU, " << differentCells << " differ by "
+      << totalDifferentBits << " bits";
+  }
+
   auto endTime = std::chrono::system_clock::now().time_since_epoch();
 
   auto duration = endTime - startTime;
   std::cout << "\nLookup table created in "
     << std::chrono::duration_cast<std::chrono::seconds>(duration).count()
     << " seconds\n";
-  std::cout << "Visibility table at: " << outFilename << std::endl;
 
   out.close();
+  if (differentCells > 0)
+  {
+    gzerr << "The GPU table differs from the CPU one, discarding it\n";
+    std::remove(tmpFilename.c_str());
+    return false;
+  }
+
+  if (!out || std::rename(tmpFilename.c_str(), outFilename.c_str()) != 0)
+  {
+    gzerr << "Unable to write the visibility table [" << outFilename
+          << "]\n";
+    std::remove(tmpFilename.c_str());
+    return false;
+  }
+
+  std::cout << "Visibility table at: " << outFilename << std::endl;
+  return sharded || _format == KEYS || this->tileSize == 0 ||
+    WriteTiles(outFilename, this->tileSize);
+}
+
+/////////////////////////////////////////////
+void VisibilityTable::GenerateRow(const int _y,
+    gazebo::physics::RayShapePtr _ray, std::vector<uint64_t> &_out) const
+{
+  // Iterate over the possible x values.
+  for (int x = this->minX; x <= this->maxX; x += this->stepSize)
+    this->GenerateCell(x, _y, _ray, _out);
+}
+
+/////////////////////////////////////////////
+void VisibilityTable::GenerateCell(const int _x, const int _y,
+    gazebo::physics::RayShapePtr _ray, std::vector<uint64_t> &_out) const
+{
+  ignition::math::Vector3d startPos, endPos;
+  const int width = 2 * this->radius + 1;
+
+  // Get the index of the (x, y) coordinate
+  uint64_t index = this->Index(_x, _y);
+
+  startPos.Set(_x, _y, this->heights[this->HeightIndex(_x, _y)]);
+
+  // Stencil words of this cell.
+  size_t cellStart = _out.size();
+  if (this->format != KEYS)
+    _out.resize(cellStart + this->wordsPerCell, 0u);
+
+  // The first word of a clearance cell is the height of the ground.
+  if (this->format == CLEARANCE)
+  {
+    const float ground = startPos.Z() - 1;
+    uint32_t groundBits;
+    std::memcpy(&groundBits, &ground, sizeof(groundBits));
+    _out[cellStart] = groundBits;
+  }
+
+  // The inner loops checks visibility from startPos to every endPos of
+  // the stencil. Cells outside of the range are skipped.
+  for (int dy = 0; dy <= this->radius; ++dy)
+  {
+    int y2 = _y + dy * this->stepSize;
+    if (y2 > this->maxY)
+      break;
+
+    endPos.Y(y2);
+    for (int dx = -this->radius; dx <= this->radius; ++dx)
+    {
+      int bit = this->stencilLayout[dy * width + dx + this->radius];
+      int x2 = _x + dx * this->stepSize;
+      if (bit < 0 || x2 < this->minX || x2 > this->maxX)
+        continue;
+
+      // Get the index of the (x2, y2) coordinate
+      uint64_t index2 = this->Index(x2, y2);
+
+      endPos.X(x2);
+      endPos.Z(this->heights[this->HeightIndex(x2, y2)]);
+
+      if (this->format == OBSTACLES)
+      {
+        const unsigned int entry = VisibilityLookup::SegmentObstacles(
+            this->trees, this->buildings, startPos, endPos);
+        _out[cellStart + bit / 16] |= uint64_t(entry) << ((bit % 16) * 4);
+        continue;
+      }
+
+      if (this->format == CLEARANCE)
+      {
+        // Store how far the terrain rises above the segment, and where.
+        double t;
+        const double excess =
+          this->heightmap->Clearance(startPos, endPos, t);
+        if (excess > 0)
+        {
+          const uint64_t entry =
+            (std::min(255u, static_cast<unsigned int>(std::ceil(excess)))
+             << 8) | static_cast<unsigned int>(std::round(t * 255));
+          _out[cellStart + 1 + bit / 4] |= entry << ((bit % 4) * 16);
+        }
+        continue;
+      }
+
+      // Only store values that are not visible. The smallest index goes
+      // first, as expected by VisibilityLookup.
+      if (!this->LineOfSight(_ray, startPos, endPos))
+      {
+        if (this->format == STENCIL)
+          _out[cellStart + bit / 64] |= uint64_t(1) << (bit % 64);
+        else
+          _out.push_back(VisibilityLookup::Pair(index, index2));
+      }
+    }
+  }
 }
 
 //////////////////////////////////////////////////
-bool VisibilityTable::LineOfSight(const ignition::math::Vector3d &_p1,
-                                   const ignition::math::Vector3d &_p2)
+bool VisibilityTable::LineOfSight(gazebo::physics::RayShapePtr _ray,
+    const ignition::math::Vector3d &_p1,
+    const ignition::math::Vector3d &_p2) const
 {
+  if (this->heightmap)
+    return this->heightmap->LineOfSight(_p1, _p2);
+
   std::string firstEntity;
   double dist;
 
-  this->ray->SetPoints(_p1, _p2);
-  this->ray->GetIntersection(dist, firstEntity);
+  _ray->SetPoints(_p1, _p2);
+  _ray->GetIntersection(dist, firstEntity);
 
   return firstEntity.empty();
 }
 
 /////////////////////////////////////////////////
-double VisibilityTable::HeightAt(const double _x, const double _y) const
+double VisibilityTable::HeightAt(gazebo::physics::RayShapePtr _ray,
+    const double _x, const double _y) const
 {
+  if (this->heightmap)
+    return this->heightmap->HeightAt(_x, _y) + 1;
+
   double dist;
   std::string ent;
 
   // Get the height of the terrain at the specified point
-  this->ray->SetPoints(
+  _ray->SetPoints(
       ignition::math::Vector3d(_x, _y, 1000),
       ignition::math::Vector3d(_x, _y, 0));
-  this->ray->GetIntersection(dist, ent);
+  _ray->GetIntersection(dist, ent);
 
   // Add a little offset so that the ray test don't start/end in the
   // terrain.
@@ -176,15 +1150,16 @@ double VisibilityTable::HeightAt(const double _x, const double _y) const
 }
 
 /////////////////////////////////////////////////
-uint64_t VisibilityTable::Pair(uint64_t _a, uint64_t _b)
+uint64_t VisibilityTable::Index(int _x, int _y) const
 {
-  // Szudzik's function
-  return _a >= _b ?  _a * _a + _a + _b : _a + _b * _b;
+  return static_cast<uint64_t>((_y - this->minY) / this->stepSize) *
+    this->columns + (_x - this->minX) / this->stepSize;
 }
 
 /////////////////////////////////////////////////
-uint64_t VisibilityTable::Index(int _x, int _y)
+size_t VisibilityTable::HeightIndex(int _x, int _y) const
 {
-  return ((_y + this->maxY)/this->stepSize) * this->rowSize +
-    ((_x + this->maxY)/this->stepSize);
+  const int row = (_y - this->minY) / this->stepSize;
+  return static_cast<size_t>(row % this->heightRows) * this->columns +
+    (_x - this->minX) / this->stepSize;
 }
@@ -0,0 +1,520 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include "gtest/gtest.h"
+#include "swarm/BoxHierarchy.hh"
+#include "swarm/Heightmap.hh"
+#include "swarm/VisibilityLookup.hh"
+#include "swarm/VisibilityTable.hh"
+
+using namespace swarm;
+
+/// \brief Cache directory used by the tests.
+static const char *kCache = "/tmp/swarm_visibility_table_test";
+
+//////////////////////////////////////////////////
+/// \brief Create a flat 400x400m terrain of 9x9 samples with a 30m ridge
+/// along x = 0.
+/// \return The heightmap.
+Heightmap MakeRidge()
+{
+  std::vector<float> heights(81, 0.0f);
+  for (int y = 0; y < 9; ++y)
+    heights[y * 9 + 4] = 30.0f;
+
+  Heightmap heightmap;
+  EXPECT_TRUE(heightmap.Set(9, 9, ignition::math::Vector3d(400, 400, 30),
+        heights));
+  return heightmap;
+}
+
+//////////////////////////////////////////////////
+/// \brief Read a whole file.
+/// \param[in] _path Path of the file.
+/// \return The bytes of the file.
+std::string ReadFile(const std::string &_path)
+{
+  std::ifstream in(_path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in),
+      std::istreambuf_iterator<char>());
+}
+
+//////////////////////////////////////////////////
+/// \brief Generate the shards of a table.
+/// \param[in] _heightmap The terrain.
+/// \param[in] _format Format of the table.
+/// \param[in] _count Number of shards.
+/// \return The paths of the shards.
+std::vector<std::string> GenerateShards(const Heightmap &_heightmap,
+    const VisibilityTableFormat _format, const int _count)
+{
+  std::vector<std::string> shards;
+  for (int i = 0; i < _count; ++i)
+  {
+    VisibilityTable table;
+    table.SetArea(_heightmap.Hash(), _heightmap.Size());
+    EXPECT_TRUE(table.SetShard(i, _count));
+    EXPECT_TRUE(table.Generate(_heightmap, 2, _format));
+    shards.push_back(
+        VisibilityTable::ShardFilename(table.Filename(), i, _count));
+  }
+  return shards;
+}
+
+//////////////////////////////////////////////////
+/// \brief The window of heights doesn't change the table: a single thread
+/// keeps fewer rows than the table has, eight threads all of them.
+TEST(VisibilityTableTest, HeightWindow)
+{
+  setenv("SWARM_VISIBILITY_CACHE", kCache, 1);
+  const Heightmap heightmap = MakeRidge();
+
+  for (auto format : {STENCIL, CLEARANCE})
+  {
+    std::string expected;
+    for (unsigned int threads : {8u, 1u, 3u})
+    {
+      boost::filesystem::remove_all(kCache);
+      VisibilityTable table;
+      table.SetArea(heightmap.Hash(), heightmap.Size());
+      ASSERT_TRUE(table.Generate(heightmap, threads, format));
+      if (expected.empty())
+        expected = ReadFile(table.Filename());
+      else
+        EXPECT_EQ(expected, ReadFile(table.Filename())) << threads;
+    }
+  }
+
+  boost::filesystem::remove_all(kCache);
+  unsetenv("SWARM_VISIBILITY_CACHE");
+}
+
+//////////////////////////////////////////////////
+/// \brief The GPU backend writes the same table as the CPU, and falls
+/// back to the CPU without OpenCL or a device.
+TEST(VisibilityTableTest, GpuBackend)
+{
+  setenv("SWARM_VISIBILITY_CACHE", kCache, 1);
+  const Heightmap heightmap = MakeRidge();
+
+  boost::filesystem::remove_all(kCache);
+  VisibilityTable cpu;
+  cpu.SetArea(heightmap.Hash(), heightmap.Size());
+  ASSERT_TRUE(cpu.Generate(heightmap, 2, STENCIL, HEIGHTMAP_BACKEND));
+  const std::string expected = ReadFile(cpu.Filename());
+
+  boost::filesystem::remove_all(kCache);
+  VisibilityTable gpu;
+  gpu.SetArea(heightmap.Hash(), heightmap.Size());
+  gpu.SetGpuValidation(100);
+  ASSERT_TRUE(gpu.Generate(heightmap, 2, STENCIL, GPU_BACKEND));
+  EXPECT_EQ(expected, ReadFile(gpu.Filename()));
+
+  // Other formats are generated on the CPU.
+  boost::filesystem::remove_all(kCache);
+  EXPECT_TRUE(gpu.Generate(heightmap, 2, CLEARANCE, GPU_BACKEND));
+
+  boost::filesystem::remove_all(kCache);
+  unsetenv("SWARM_VISIBILITY_CACHE");
+}
+
+//////////////////////////////////////////////////
+/// \brief Merged shards are identical to a table generated in a single
+/// run, whatever the number of shards.
+TEST(VisibilityTableTest, MergeShards)
+{
+  setenv("SWARM_VISIBILITY_CACHE", kCache, 1);
+  const Heightmap heightmap = MakeRidge();
+
+  for (auto format : {STENCIL, KEYS})
+  {
+    boost::filesystem::remove_all(kCache);
+    VisibilityTable table;
+    table.SetArea(heightmap.Hash(), heightmap.Size());
+    ASSERT_TRUE(table.Generate(heightmap, 2, format));
+    const std::string expected = ReadFile(table.Filename());
+    ASSERT_FALSE(expected.empty());
+
+    // More shards than rows leaves some of them empty.
+    for (int count : {1, 3, 7, 50})
+    {
+      boost::filesystem::remove_all(kCache);
+      std::vector<std::string> shards =
+        GenerateShards(heightmap, format, count);
+      if (count == 1)
+      {
+        EXPECT_EQ(expected, ReadFile(table.Filename()));
+        continue;
+      }
+
+      EXPECT_FALSE(boost::filesystem::exists(table.Filename()));
+      std::reverse(shards.begin(), shards.end());
+      EXPECT_TRUE(VisibilityTable::MergeShards(shards));
+      EXPECT_EQ(expected, ReadFile(table.Filename())) << count << " shards";
+
+      VisibilityLookup lookup;
+      EXPECT_TRUE(lookup.Load(table.Filename()));
+    }
+  }
+
+  boost::filesystem::remove_all(kCache);
+  unsetenv("SWARM_VISIBILITY_CACHE");
+}
+
+//////////////////////////////////////////////////
+/// \brief Incomplete or mismatched shards are not merged.
+TEST(VisibilityTableTest, InvalidShards)
+{
+  setenv("SWARM_VISIBILITY_CACHE", kCache, 1);
+  boost::filesystem::remove_all(kCache);
+  const Heightmap heightmap = MakeRidge();
+  const std::string output = std::string(kCache) + "/merged.dat";
+
+  EXPECT_FALSE(VisibilityTable::MergeShards({}, output));
+
+  // A missing shard.
+  std::vector<std::string> shards = GenerateShards(heightmap, STENCIL, 3);
+  EXPECT_FALSE(VisibilityTable::MergeShards({shards[0], shards[2]}, output));
+
+  // The same shard twice.
+  EXPECT_FALSE(VisibilityTable::MergeShards(
+        {shards[0], shards[1], shards[1]}, output));
+
+  // A shard of another format, from another cache since both formats
+  // share the same path.
+  setenv("SWARM_VISIBILITY_CACHE", (std::string(kCache) + "/keys").c_str(),
+      1);
+  std::vector<std::string> keys = GenerateShards(heightmap, KEYS, 3);
+  setenv("SWARM_VISIBILITY_CACHE", kCache, 1);
+  EXPECT_FALSE(VisibilityTable::MergeShards({shards[0], shards[1], keys[2]},
+        output));
+
+  // A truncated shard.
+  boost::filesystem::resize_file(shards[1],
+      boost::filesystem::file_size(shards[1]) - 8);
+  EXPECT_FALSE(VisibilityTable::MergeShards(shards, output));
+
+  // Not a shard.
+  EXPECT_FALSE(VisibilityTable::MergeShards({output}, output));
+  EXPECT_FALSE(boost::filesystem::exists(output));
+
+  int index, count;
+  EXPECT_TRUE(VisibilityTable::ParseShard("2/8", index, count));
+  EXPECT_EQ(2, index);
+  EXPECT_EQ(8, count);
+  EXPECT_FALSE(VisibilityTable::ParseShard("8/8", index, count));
+  EXPECT_FALSE(VisibilityTable::ParseShard("-1/8", index, count));
+  EXPECT_FALSE(VisibilityTable::ParseShard("1/0", index, count));
+  EXPECT_FALSE(VisibilityTable::ParseShard("1/8x", index, count));
+  EXPECT_FALSE(VisibilityTable::ParseShard("1", index, count));
+
+  VisibilityTable table;
+  EXPECT_FALSE(table.SetShard(3, 3));
+  EXPECT_TRUE(table.SetShard(0, 1));
+
+  boost::filesystem::remove_all(kCache);
+  unsetenv("SWARM_VISIBILITY_CACHE");
+}
+
+//////////////////////////////////////////////////
+/// \brief The coarser levels store the pairs farther apart than the range
+/// of the finest level.
+TEST(VisibilityTableTest, Levels)
+{
+  setenv("SWARM_VISIBILITY_CACHE", kCache, 1);
+  boost::filesystem::remove_all(kCache);
+  const Heightmap heightmap = MakeRidge();
+
+  EXPECT_EQ(10, VisibilityTable::LevelStepSize(0));
+  EXPECT_EQ(160, VisibilityTable::LevelStepSize(2));
+  EXPECT_DOUBLE_EQ(250, VisibilityTable::LevelRange(0));
+  EXPECT_DOUBLE_EQ(1000, VisibilityTable::LevelRange(1));
+
+  VisibilityTable fine;
+  fine.SetArea(heightmap.Hash(), heightmap.Size());
+  ASSERT_TRUE(fine.Generate(heightmap, 2, STENCIL));
+
+  VisibilityTable coarse;
+  EXPECT_FALSE(coarse.SetLevel(-1));
+  EXPECT_FALSE(coarse.SetLevel(VisibilityTable::kMaxLevels));
+  ASSERT_TRUE(coarse.SetLevel(1));
+  EXPECT_EQ(1, coarse.Level());
+  coarse.SetArea(heightmap.Hash(), heightmap.Size());
+  EXPECT_NE(fine.Filename(), coarse.Filename());
+  ASSERT_TRUE(coarse.Generate(heightmap, 2, STENCIL));
+
+  VisibilityLookup fineLookup, coarseLookup;
+  ASSERT_TRUE(fineLookup.Load(fine.Filename()));
+  ASSERT_TRUE(coarseLookup.Load(coarse.Filename()));
+  EXPECT_EQ(40, coarseLookup.StepSize());
+  EXPECT_EQ(fineLookup.Header().radius, coarseLookup.Header().radius);
+
+  // Corners of the terrain, 560m apart, only stored by the coarse level.
+  const uint64_t fine1 = fineLookup.Index(-200, -200);
+  const uint64_t fine2 = fineLookup.Index(200, 200);
+  const uint64_t coarse1 = coarseLookup.Index(-200, -200);
+  const uint64_t coarse2 = coarseLookup.Index(200, 200);
+  EXPECT_FALSE(fineLookup.InRange(fine1, fine2));
+  EXPECT_TRUE(coarseLookup.InRange(coarse1, coarse2));
+  EXPECT_FALSE(coarseLookup.Visible(coarse1, coarse2));
+  EXPECT_FALSE(coarseLookup.InRange(coarse1, VisibilityLookup::kOutside));
+
+  // Both sides of the ridge, on the same side, and the same cell.
+  EXPECT_FALSE(coarseLookup.Visible(coarseLookup.Index(-160, 0),
+        coarseLookup.Index(160, 0)));
+  EXPECT_TRUE(coarseLookup.Visible(coarseLookup.Index(-200, -200),
+        coarseLookup.Index(-40, 200)));
+  EXPECT_TRUE(coarseLookup.InRange(coarse1, coarse1));
+
+  boost::filesystem::remove_all(kCache);
+  unsetenv("SWARM_VISIBILITY_CACHE");
+}
+
+//////////////////////////////////////////////////
+/// \brief Tiled tables answer the same queries as the table they were
+/// split from, whatever the size of the tiles and of the cache.
+TEST(VisibilityTableTest, Tiles)
+{
+  setenv("SWARM_VISIBILITY_CACHE", kCache, 1);
+  const Heightmap heightmap = MakeRidge();
+
+  for (auto format : {STENCIL, CLEARANCE})
+  {
+    boost::filesystem::remove_all(kCache);
+    VisibilityTable table;
+    table.SetArea(heightmap.Hash(), heightmap.Size());
+    ASSERT_TRUE(table.Generate(heightmap, 2, format));
+
+    VisibilityLookup full;
+    ASSERT_TRUE(full.Load(table.Filename()));
+    EXPECT_FALSE(full.Tiled());
+    const uint64_t cells =
+      static_cast<uint64_t>(full.RowSize()) * full.Header().rows;
+
+    // Tiles of a single cell, tiles that don't divide the rows, and a
+    // single tile.
+    for (int tileSize : {1, 3, 1000})
+    {
+      const std::string output = std::string(kCache) + "/tiles_" +
+        std::to_string(tileSize) + ".tiles";
+      ASSERT_TRUE(VisibilityTable::WriteTiles(table.Filename(), tileSize,
+            output));
+
+      VisibilityLookup tiled;
+      tiled.SetTileCacheSize(2);
+      ASSERT_TRUE(tiled.Load(output));
+      EXPECT_TRUE(tiled.Tiled());
+      EXPECT_EQ(format, tiled.Format());
+      EXPECT_EQ(0, std::memcmp(&full.Header(), &tiled.Header(),
+            sizeof(VisibilityTableHeader)));
+
+      // Every pair within a few rows, in both orders.
+      const uint64_t span = 3 * full.RowSize();
+      for (uint64_t a = 0; a < cells; ++a)
+      {
+        for (uint64_t b = a < span ? 0 : a - span;
+             b < std::min(cells, a + span); ++b)
+        {
+          ASSERT_EQ(full.Visible(a, b), tiled.Visible(a, b)) << a << " " << b;
+          ASSERT_EQ(full.Visible(a, 20.0, b, 5.0),
+              tiled.Visible(a, 20.0, b, 5.0)) << a << " " << b;
+        }
+      }
+
+      EXPECT_GT(tiled.TileMisses(), 0u);
+      EXPECT_GT(tiled.TileHits(), 0u);
+      EXPECT_LE(tiled.CachedTiles(), 2u);
+      EXPECT_GT(tiled.TileCacheBytes(), 0u);
+
+      tiled.SetTileCacheSize(1);
+      EXPECT_EQ(1u, tiled.CachedTiles());
+      tiled.Unload();
+      EXPECT_EQ(0u, tiled.CachedTiles());
+      EXPECT_EQ(0u, tiled.TileMisses());
+    }
+
+    // The default path is next to the table, and is kept once written.
+    table.SetTileSize(4);
+    EXPECT_TRUE(table.Generate(heightmap, 2, format));
+    VisibilityLookup tiled;
+    EXPECT_TRUE(tiled.Load(VisibilityLookup::TilesFilename(
+            table.Filename())));
+    EXPECT_TRUE(tiled.Tiled());
+  }
+
+  boost::filesystem::remove_all(kCache);
+  unsetenv("SWARM_VISIBILITY_CACHE");
+}
+
+//////////////////////////////////////////////////
+/// \brief Invalid tiled tables are not loaded, and the cells of a corrupt
+/// tile are visible.
+TEST(VisibilityTableTest, InvalidTiles)
+{
+  setenv("SWARM_VISIBILITY_CACHE", kCache, 1);
+  boost::filesystem::remove_all(kCache);
+  const Heightmap heightmap = MakeRidge();
+  const std::string output = std::string(kCache) + "/invalid.tiles";
+
+  EXPECT_EQ("/a/visibility_1.tiles",
+      VisibilityLookup::TilesFilename("/a/visibility_1.dat"));
+  EXPECT_EQ("table.tiles", VisibilityLookup::TilesFilename("table"));
+
+  // Only tables with cells can be tiled, once.
+  VisibilityTable keys;
+  keys.SetArea(heightmap.Hash(), heightmap.Size());
+  ASSERT_TRUE(keys.Generate(heightmap, 2, KEYS));
+  EXPECT_FALSE(VisibilityTable::WriteTiles(keys.Filename(), 4, output));
+  EXPECT_FALSE(VisibilityTable::WriteTiles(keys.Filename() + ".missing", 4,
+        output));
+
+  boost::filesystem::remove_all(kCache);
+  VisibilityTable table;
+  table.SetArea(heightmap.Hash(), heightmap.Size());
+  ASSERT_TRUE(table.Generate(heightmap, 2, STENCIL));
+  EXPECT_FALSE(VisibilityTable::WriteTiles(table.Filename(), 0, output));
+  ASSERT_TRUE(VisibilityTable::WriteTiles(table.Filename(), 1000, output));
+  EXPECT_FALSE(VisibilityTable::WriteTiles(output, 4,
+        std::string(kCache) + "/twice.tiles"));
+
+  // A pair of cells on both sides of the ridge.
+  VisibilityLookup full;
+  ASSERT_TRUE(full.Load(table.Filename()));
+  const uint64_t a = full.Index(-100, 0);
+  const uint64_t b = full.Index(100, 0);
+  ASSERT_FALSE(full.Visible(a, b));
+
+  // Damage the single tile.
+  const std::string original = ReadFile(output);
+  std::string bytes = original;
+  bytes[bytes.size() - 4] ^= 0x55;
+  std::ofstream(output, std::ios::binary).write(bytes.data(), bytes.size());
+  VisibilityLookup tiled;
+  ASSERT_TRUE(tiled.Load(output));
+  EXPECT_TRUE(tiled.Visible(a, b));
+  EXPECT_EQ(0u, tiled.CachedTiles());
+
+  // Truncated.
+  std::ofstream(output, std::ios::binary).write(original.data(),
+      original.size() - 1);
+  EXPECT_FALSE(tiled.Load(output));
+
+  // Another version.
+  bytes = original;
+  bytes[4] = 9;
+  std::ofstream(output, std::ios::binary).write(bytes.data(), bytes.size());
+  EXPECT_FALSE(tiled.Load(output));
+
+  boost::filesystem::remove_all(kCache);
+  unsetenv("SWARM_VISIBILITY_CACHE");
+}
+
+//////////////////////////////////////////////////
+/// \brief The obstacle layer and the boxes it was generated from classify
+/// the pairs the same way: only the obstacles between the two cells count,
+/// not the ones beyond the second cell.
+TEST(VisibilityTableTest, Obstacles)
+{
+  setenv("SWARM_VISIBILITY_CACHE", kCache, 1);
+  boost::filesystem::remove_all(kCache);
+  const Heightmap heightmap = MakeRidge();
+
+  // Two trees along y = 0, and a building along y = 50, on the flat side
+  // of the ridge.
+  const std::vector<ignition::math::Box> treeBoxes = {
+    ignition::math::Box(84, -1, 0, 86, 1, 20),
+    ignition::math::Box(134, -1, 0, 136, 1, 20)};
+  const std::vector<ignition::math::Box> buildingBoxes = {
+    ignition::math::Box(130, 45, 0, 140, 55, 20)};
+
+  VisibilityTable table;
+  table.SetObstacles(treeBoxes, buildingBoxes);
+  table.SetArea(heightmap.Hash(), heightmap.Size());
+  ASSERT_TRUE(table.Generate(heightmap, 2, OBSTACLES));
+
+  VisibilityLookup lookup;
+  ASSERT_TRUE(lookup.Load(table.ObstaclesFilename(
+        VisibilityTable::ObstaclesHash(treeBoxes, buildingBoxes))));
+  EXPECT_EQ(lookup.Format(), OBSTACLES);
+
+  BoxHierarchy trees;
+  trees.Build(treeBoxes);
+  BoxHierarchy buildings;
+  buildings.Build(buildingBoxes);
+
+  // Pairs of cells and the entry expected for them.
+  struct Pair
+  {
+    double x1, y1, x2, y2;
+    unsigned int entry;
+  };
+  const std::vector<Pair> pairs = {
+    // A tree beyond the second cell only.
+    {90, 0, 110, 0, 0},
+    {110, 0, 90, 0, 0},
+    // A tree in front of the second cell, and another one beyond it.
+    {60, 0, 110, 0, 1},
+    {110, 0, 60, 0, 1},
+    // Both trees in between.
+    {60, 0, 160, 0, 2},
+    // A building beyond the second cell, then in between.
+    {60, 50, 110, 50, 0},
+    {60, 50, 160, 50, VisibilityLookup::kObstacleBuilding}};
+
+  for (auto const &pair : pairs)
+  {
+    const ignition::math::Vector3d p1(pair.x1, pair.y1,
+        heightmap.HeightAt(pair.x1, pair.y1) + 1);
+    const ignition::math::Vector3d p2(pair.x2, pair.y2,
+        heightmap.HeightAt(pair.x2, pair.y2) + 1);
+    const unsigned int entry =
+      VisibilityLookup::SegmentObstacles(trees, buildings, p1, p2);
+    EXPECT_EQ(pair.entry, entry) << p1 << " " << p2;
+
+    unsigned int treeCount = 0;
+    bool building = false;
+    ASSERT_TRUE(lookup.Obstacles(lookup.Index(pair.x1, pair.y1),
+          lookup.Index(pair.x2, pair.y2), treeCount, building));
+    EXPECT_EQ(entry & VisibilityLookup::kObstacleTrees, treeCount)
+      << p1 << " " << p2;
+    EXPECT_EQ((entry & VisibilityLookup::kObstacleBuilding) != 0, building)
+      << p1 << " " << p2;
+  }
+
+  // The ends of a segment of zero length don't cross anything.
+  EXPECT_EQ(0u, VisibilityLookup::SegmentObstacles(trees, buildings,
+        ignition::math::Vector3d(85, 0, 1),
+        ignition::math::Vector3d(85, 0, 1)));
+
+  boost::filesystem::remove_all(kCache);
+  unsetenv("SWARM_VISIBILITY_CACHE");
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <pthread.h>
+#include <algorithm>
+#include <mutex>
+#include <set>
+
+#include "swarm/WorkerPool.hh"
+
+using namespace swarm;
+
+namespace
+{
+  /// \brief Protects the pools, held from the start to the end of a fork().
+  std::mutex &poolsMutex()
+  {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  /// \brief Every pool alive.
+  std::set<WorkerPool *> &pools()
+  {
+    static std::set<WorkerPool *> alive;
+    return alive;
+  }
+}
+
+//////////////////////////////////////////////////
+WorkerPool::WorkerPool(const unsigned int _workers)
+  : workers(_workers), next(0)
+{
+  if (this->workers == 0)
+    this->workers = std::max(1u, std::thread::hardware_concurrency());
+
+  static std::once_flag registered;
+  std::call_once(registered, []()
+      {
+        pthread_atfork(&WorkerPool::OnForkPrepare, &WorkerPool::OnForkResume,
+                       &WorkerPool::OnForkResume);
+      });
+
+  std::lock_guard<std::mutex> lock(poolsMutex());
+  pools().insert(this);
+  this->StartThreads();
+}
+
+//////////////////////////////////////////////////
+WorkerPool::~WorkerPool()
+{
+  std::lock_guard<std::mutex> lock(poolsMutex());
+  pools().erase(this);
+  this->StopThreads();
+}
+
+//////////////////////////////////////////////////
+void WorkerPool::StartThreads()
+{
+  for (unsigned int i = 1; i < this->workers; ++i)
+    this->threads.push_back(std::thread(&WorkerPool::Work, this, i));
+}
+
+//////////////////////////////////////////////////
+void WorkerPool::StopThreads()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stop = true;
+  }
+  this->wake.notify_all();
+
+  for (auto &thread : this->threads)
+    thread.join();
+  this->threads.clear();
+
+  // The threads started again wait for the next loop.
+  this->stop = false;
+  this->generation = 0;
+}
+
+//////////////////////////////////////////////////
+void WorkerPool::OnForkPrepare()
+{
+  poolsMutex().lock();
+  for (WorkerPool *pool : pools())
+    pool->StopThreads();
+}
+
+//////////////////////////////////////////////////
+void WorkerPool::OnForkResume()
+{
+  for (WorkerPool *pool : pools())
+    pool->StartThreads();
+  poolsMutex().unlock();
+}
+
+//////////////////////////////////////////////////
+unsigned int WorkerPool::Size() const
+{
+  return this->workers;
+}
+
+//////////////////////////////////////////////////
+void WorkerPool::Run(const unsigned int _count, const Task &_task)
+{
+  if (_count == 0)
+    return;
+
+  // Small loops don't need to wake the threads.
+  if (this->threads.empty() || _count == 1)
+  {
+    for (unsigned int i = 0; i < _count; ++i)
+      _task(i, 0);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->task = &_task;
+    this->count = _count;
+    this->next = 0;
+    this->busy = this->threads.size();
+    ++this->generation;
+  }
+  this->wake.notify_all();
+
+  this->RunIterations(0);
+
+  std::unique_lock<std::mutex> lock(this->mutex);
+  this->done.wait(lock, [this]() {return this->busy == 0;});
+  this->task = nullptr;
+}
+
+//////////////////////////////////////////////////
+void WorkerPool::Work(const unsigned int _worker)
+{
+  uint64_t seen = 0;
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->wake.wait(lock, [this, &seen]()
+          {
+            return this->stop || this->generation != seen;
+          });
+
+      if (this->stop)
+        return;
+      seen = this->generation;
+    }
+
+    this->RunIterations(_worker);
+
+    bool last;
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      last = --this->busy == 0;
+    }
+    if (last)
+      this->done.notify_one();
+  }
+}
+
+//////////////////////////////////////////////////
+void WorkerPool::RunIterations(const unsigned int _worker)
+{
+  for (unsigned int i = this->next++; i < this->count; i = this->next++)
+    (*this->task)(i, _worker);
+}
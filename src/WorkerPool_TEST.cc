@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <vector>
+#include "gtest/gtest.h"
+#include "swarm/WorkerPool.hh"
+
+using namespace swarm;
+
+//////////////////////////////////////////////////
+/// \brief Check that each iteration runs once, on a valid worker.
+TEST(WorkerPoolTest, Run)
+{
+  WorkerPool pool(4);
+  EXPECT_EQ(pool.Size(), 4u);
+
+  for (unsigned int count = 0; count < 200; count += 7)
+  {
+    std::vector<std::atomic<int>> runs(count);
+    for (auto &run : runs)
+      run = 0;
+
+    std::atomic<bool> validWorkers(true);
+    pool.Run(count, [&](const unsigned int _index, const unsigned int _worker)
+        {
+          ++runs[_index];
+          if (_worker >= 4)
+            validWorkers = false;
+        });
+
+    EXPECT_TRUE(validWorkers);
+    for (auto const &run : runs)
+      EXPECT_EQ(run, 1);
+  }
+}
+
+//////////////////////////////////////////////////
+/// \brief Check the pool without worker threads.
+TEST(WorkerPoolTest, SingleWorker)
+{
+  WorkerPool pool(1);
+  EXPECT_EQ(pool.Size(), 1u);
+
+  std::vector<unsigned int> order;
+  pool.Run(5, [&](const unsigned int _index, const unsigned int _worker)
+      {
+        EXPECT_EQ(_worker, 0u);
+        order.push_back(_index);
+      });
+
+  EXPECT_EQ(order, std::vector<unsigned int>({0, 1, 2, 3, 4}));
+
+  WorkerPool defaultPool(0);
+  EXPECT_GE(defaultPool.Size(), 1u);
+}
+
+//////////////////////////////////////////////////
+/// \brief Check that the pool keeps working in both processes after a
+/// fork().
+TEST(WorkerPoolTest, Fork)
+{
+  WorkerPool pool(4);
+  auto sum = [&pool]()
+  {
+    std::atomic<unsigned int> total(0);
+    std::atomic<bool> valid(true);
+    pool.Run(100, [&](const unsigned int _index, const unsigned int _worker)
+        {
+          total += _index;
+          if (_worker >= 4)
+            valid = false;
+        });
+    return valid ? total.load() : 0u;
+  };
+  EXPECT_EQ(sum(), 4950u);
+
+  const pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0)
+    _exit(sum() == 4950u && pool.Size() == 4u ? 0 : 1);
+
+  EXPECT_EQ(sum(), 4950u);
+  int status;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(WEXITSTATUS(status), 0);
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "swarm/WorldCache.hh"
+
+using namespace swarm;
+
+static_assert(sizeof(WorldCacheHeader) == 64,
+    "WorldCacheHeader must keep the boxes 8 byte aligned");
+
+/// \brief Size of a box in the file: its minimum and maximum corners.
+static const size_t kBoxBytes = 6 * sizeof(double);
+
+//////////////////////////////////////////////////
+WorldCache::~WorldCache()
+{
+  this->Unload();
+}
+
+//////////////////////////////////////////////////
+uint64_t WorldCache::HashWorld(const std::string &_world,
+    const uint64_t _terrainHash)
+{
+  uint64_t h = 14695981039346656037ULL;
+  auto hashBytes = [&h](const void *_data, const size_t _count)
+  {
+    const unsigned char *bytes = static_cast<const unsigned char*>(_data);
+    for (size_t i = 0; i < _count; ++i)
+    {
+      h ^= bytes[i];
+      h *= 1099511628211ULL;
+    }
+  };
+
+  hashBytes(_world.data(), _world.size());
+  hashBytes(&_terrainHash, sizeof(_terrainHash));
+
+  return h;
+}
+
+//////////////////////////////////////////////////
+bool WorldCache::Write(const std::string &_filename, const uint64_t _hash,
+    const std::vector<ignition::math::Box> &_trees,
+    const std::vector<ignition::math::Box> &_buildings,
+    const TerrainRaster &_raster)
+{
+  WorldCacheHeader world;
+  std::memset(&world, 0, sizeof(world));
+  world.magic = kMagic;
+  world.version = kVersion;
+  world.hash = _hash;
+  world.trees = _trees.size();
+  world.buildings = _buildings.size();
+  world.rasterMin[0] = _raster.minX;
+  world.rasterMin[1] = _raster.minY;
+  world.cellSize = _raster.cellSize;
+  world.columns = _raster.columns;
+  world.rows = _raster.rows;
+
+  const std::string tmpFilename = _filename + ".tmp." +
+    std::to_string(getpid());
+  std::fstream out(tmpFilename, std::ios::out | std::ios::binary);
+  out.write(reinterpret_cast<const char*>(&world), sizeof(world));
+
+  for (auto const *boxes : {&_trees, &_buildings})
+  {
+    for (auto const &box : *boxes)
+    {
+      const double corners[6] = {box.Min().X(), box.Min().Y(),
+        box.Min().Z(), box.Max().X(), box.Max().Y(), box.Max().Z()};
+      out.write(reinterpret_cast<const char*>(corners), sizeof(corners));
+    }
+  }
+
+  out.write(reinterpret_cast<const char*>(_raster.cells.data()),
+      _raster.cells.size() * sizeof(TerrainRaster::Cell));
+  out.close();
+
+  if (!out || std::rename(tmpFilename.c_str(), _filename.c_str()) != 0)
+  {
+    std::cerr << "WorldCache::Write() Unable to write [" << _filename
+              << "]" << std::endl;
+    std::remove(tmpFilename.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+//////////////////////////////////////////////////
+bool WorldCache::Load(const std::string &_filename)
+{
+  this->Unload();
+
+  int fd = open(_filename.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    std::cerr << "WorldCache::Load() Unable to open ["
+              << _filename << "]" << std::endl;
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      st.st_size < static_cast<off_t>(sizeof(WorldCacheHeader)))
+  {
+    std::cerr << "WorldCache::Load() Invalid world cache ["
+              << _filename << "]" << std::endl;
+    close(fd);
+    return false;
+  }
+
+  void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+  // The mapping keeps its own reference to the file.
+  close(fd);
+
+  if (addr == MAP_FAILED)
+  {
+    std::cerr << "WorldCache::Load() Unable to map ["
+              << _filename << "]: " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  this->data = static_cast<const char*>(addr);
+  this->dataSize = st.st_size;
+  std::memcpy(&this->header, this->data, sizeof(this->header));
+
+  // The boxes and the cells fill the rest of the file.
+  const WorldCacheHeader &world = this->header;
+  const uint64_t expected = sizeof(WorldCacheHeader) +
+    (world.trees + world.buildings) * kBoxBytes +
+    static_cast<uint64_t>(world.columns) * world.rows *
+    sizeof(TerrainRaster::Cell);
+
+  bool result = true;
+  if (world.magic != kMagic)
+  {
+    std::cerr << "WorldCache::Load() [" << _filename << "] is not a "
+              << "world cache file" << std::endl;
+    result = false;
+  }
+  else if (world.version != kVersion)
+  {
+    std::cerr << "WorldCache::Load() Unsupported version ["
+              << world.version << "] in [" << _filename << "]" << std::endl;
+    result = false;
+  }
+  else if (world.trees > this->dataSize || world.buildings > this->dataSize ||
+      world.columns > this->dataSize || world.rows > this->dataSize ||
+      !(world.cellSize > 0) || expected != this->dataSize)
+  {
+    std::cerr << "WorldCache::Load() Corrupt world cache ["
+              << _filename << "]" << std::endl;
+    result = false;
+  }
+
+  if (!result)
+  {
+    this->Unload();
+    return false;
+  }
+
+  return true;
+}
+
+//////////////////////////////////////////////////
+uint64_t WorldCache::Hash() const
+{
+  return this->header.hash;
+}
+
+//////////////////////////////////////////////////
+std::vector<ignition::math::Box> WorldCache::TreeBoxes() const
+{
+  return this->Boxes(0, this->header.trees);
+}
+
+//////////////////////////////////////////////////
+std::vector<ignition::math::Box> WorldCache::BuildingBoxes() const
+{
+  return this->Boxes(this->header.trees, this->header.buildings);
+}
+
+//////////////////////////////////////////////////
+std::vector<ignition::math::Box> WorldCache::Boxes(const uint64_t _first,
+    const uint64_t _count) const
+{
+  std::vector<ignition::math::Box> boxes;
+  if (!this->data)
+    return boxes;
+
+  boxes.reserve(_count);
+  const char *box = this->data + sizeof(WorldCacheHeader) + _first * kBoxBytes;
+  for (uint64_t i = 0; i < _count; ++i, box += kBoxBytes)
+  {
+    double corners[6];
+    std::memcpy(corners, box, sizeof(corners));
+    boxes.push_back(ignition::math::Box(corners[0], corners[1], corners[2],
+          corners[3], corners[4], corners[5]));
+  }
+  return boxes;
+}
+
+//////////////////////////////////////////////////
+void WorldCache::Raster(TerrainRaster &_raster) const
+{
+  if (!this->data)
+    return;
+
+  const WorldCacheHeader &world = this->header;
+  _raster.minX = world.rasterMin[0];
+  _raster.minY = world.rasterMin[1];
+  _raster.cellSize = world.cellSize;
+  _raster.columns = world.columns;
+  _raster.rows = world.rows;
+  _raster.cells.resize(static_cast<size_t>(world.columns) * world.rows);
+  std::memcpy(_raster.cells.data(), this->data + sizeof(WorldCacheHeader) +
+      (world.trees + world.buildings) * kBoxBytes,
+      _raster.cells.size() * sizeof(TerrainRaster::Cell));
+}
+
+//////////////////////////////////////////////////
+void WorldCache::Unload()
+{
+  if (this->data)
+    munmap(const_cast<char*>(this->data), this->dataSize);
+
+  this->data = nullptr;
+  this->dataSize = 0;
+  std::memset(&this->header, 0, sizeof(this->header));
+}
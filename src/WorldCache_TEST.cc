@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <ignition/math/Box.hh>
+#include <ignition/math/Vector3.hh>
+#include "gtest/gtest.h"
+#include "swarm/WorldCache.hh"
+
+using namespace swarm;
+
+/// \brief Path of the temporary cache used by the tests.
+static const std::string kCachePath = "/tmp/swarm_world_TEST.cache";
+
+//////////////////////////////////////////////////
+/// \brief Check that the cache gives back the boxes and the raster.
+TEST(WorldCacheTest, Roundtrip)
+{
+  const std::vector<ignition::math::Box> trees = {
+    ignition::math::Box(-2, -2, 0, 2, 2, 8),
+    ignition::math::Box(10, 3, 0, 12, 5, 6.5)};
+  const std::vector<ignition::math::Box> buildings = {
+    ignition::math::Box(-1.5, -1.5, 0, 6, 1, 10)};
+
+  TerrainRaster raster;
+  raster.Reset(ignition::math::Vector3d(-10, -10, 0),
+      ignition::math::Vector3d(15, 5, 0), 1.0);
+  raster.Add(trees[0].Min(), trees[0].Max(),
+      [](const ignition::math::Vector3d &_pos)
+      {
+        return _pos.X() > 0 ? TerrainType::FOREST : TerrainType::PLAIN;
+      });
+  raster.Add(buildings[0].Min(), buildings[0].Max(),
+      [](const ignition::math::Vector3d &)
+      {
+        return TerrainType::BUILDING;
+      });
+
+  const uint64_t hash = WorldCache::HashWorld("<world/>", 42);
+  EXPECT_EQ(hash, WorldCache::HashWorld("<world/>", 42));
+  EXPECT_NE(hash, WorldCache::HashWorld("<world/>", 43));
+  EXPECT_NE(hash, WorldCache::HashWorld("<world />", 42));
+
+  std::remove(kCachePath.c_str());
+  ASSERT_TRUE(WorldCache::Write(kCachePath, hash, trees, buildings, raster));
+
+  WorldCache cache;
+  ASSERT_TRUE(cache.Load(kCachePath));
+  EXPECT_EQ(cache.Hash(), hash);
+  EXPECT_EQ(cache.TreeBoxes(), trees);
+  EXPECT_EQ(cache.BuildingBoxes(), buildings);
+
+  TerrainRaster cached;
+  cache.Raster(cached);
+  EXPECT_EQ(cached.Columns(), raster.Columns());
+  EXPECT_EQ(cached.Rows(), raster.Rows());
+  for (double x = -12; x < 17; x += 0.5)
+  {
+    for (double y = -12; y < 7; y += 0.5)
+    {
+      for (double z : {1.0, 9.0, 11.0})
+      {
+        const ignition::math::Vector3d pos(x, y, z);
+        EXPECT_EQ(cached.At(pos), raster.At(pos));
+      }
+    }
+  }
+  EXPECT_EQ(cached.At(ignition::math::Vector3d(1.5, 0, 1)),
+      TerrainType::FOREST);
+
+  std::remove(kCachePath.c_str());
+}
+
+//////////////////////////////////////////////////
+/// \brief Check that the invalid files are rejected.
+TEST(WorldCacheTest, Invalid)
+{
+  WorldCache cache;
+  EXPECT_FALSE(cache.Load("/tmp/swarm_world_TEST_missing.cache"));
+  EXPECT_EQ(cache.Hash(), 0u);
+  EXPECT_TRUE(cache.TreeBoxes().empty());
+
+  // Nothing is copied without a file.
+  TerrainRaster raster;
+  raster.Reset(ignition::math::Vector3d(0, 0, 0),
+      ignition::math::Vector3d(4, 4, 0), 1.0);
+  cache.Raster(raster);
+  EXPECT_EQ(raster.Columns(), 4u);
+
+  // Truncated.
+  std::remove(kCachePath.c_str());
+  ASSERT_TRUE(WorldCache::Write(kCachePath, 7,
+        {ignition::math::Box(0, 0, 0, 1, 1, 1)}, {}, raster));
+  {
+    std::ifstream in(kCachePath, std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(in)),
+        std::istreambuf_iterator<char>());
+    std::ofstream out(kCachePath, std::ios::binary | std::ios::trunc);
+    out.write(contents.data(), contents.size() - 10);
+  }
+  EXPECT_FALSE(cache.Load(kCachePath));
+
+  // Not a cache.
+  {
+    std::ofstream out(kCachePath, std::ios::binary | std::ios::trunc);
+    out << std::string(128, 'x');
+  }
+  EXPECT_FALSE(cache.Load(kCachePath));
+
+  std::remove(kCachePath.c_str());
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -15,7 +15,13 @@
  *
 */
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "swarm/RobotPlugin.hh"
 
@@ -26,6 +32,44 @@ using namespace swarm;
 // Track the robot pointers
 std::unordered_map<std::string, RobotPlugin*> robotPointers;
 
+// Robots in the order of the rows of the batched update.
+std::vector<RobotPlugin*> robotOrder;
+
+// Columns of a row of observations of the batched update.
+enum BatchObservation
+{
+  OBS_LATITUDE = 0,
+  OBS_LONGITUDE = 1,
+  OBS_ALTITUDE = 2,
+  OBS_LIN_VEL = 3,
+  OBS_ANG_VEL = 6,
+  OBS_ORIENTATION = 9,
+  OBS_BEARING = 13,
+  OBS_BATTERY = 14,
+  OBS_NEIGHBORS = 15,
+  OBS_DOCKED = 16,
+  OBS_SIZE = 17
+};
+
+// Columns of a row of actions of the batched update.
+enum BatchAction
+{
+  ACT_LIN_VEL = 0,
+  ACT_ANG_VEL = 3,
+  ACT_SIZE = 6
+};
+
+// Memory behind the buffers of the batched update, one row per robot.
+// It only moves when a robot is added.
+static std::vector<double> batchObservations;
+static std::vector<double> batchActions;
+
+// Python objects passed to the batched update, rebuilt when a robot is
+// added.
+static PyObject *batchNames = NULL;
+static PyObject *batchObservationsBuffer = NULL;
+static PyObject *batchActionsBuffer = NULL;
+
 static RobotPlugin*
 get_robot_pointer(const std::string &addr)
 {
@@ -43,20 +87,84 @@ get_robot_pointer(const std::string &addr)
     return it->second;
 }
 
+static RobotPlugin*
+get_robot(PyObject *robot)
+{
+  char err_buf[1024];
+  if(PyInt_Check(robot))
+  {
+    // A handle returned by handle().
+    const long index = PyInt_AsLong(robot);
+    if(index < 0 || index >= static_cast<long>(robotOrder.size()))
+    {
+      snprintf(err_buf, sizeof(err_buf), "Unknown robot handle: %ld", index);
+      PyErr_SetString(PyExc_RuntimeError, err_buf);
+      return NULL;
+    }
+    return robotOrder[index];
+  }
+  else if(PyString_Check(robot))
+    return get_robot_pointer(std::string(PyString_AsString(robot)));
+
+  PyErr_SetString(PyExc_TypeError, "robot must be an address or a handle");
+  return NULL;
+}
+
+// Copy values to a writable buffer of doubles given by the caller, e.g. a
+// numpy array, and return it.
+static PyObject *
+fill_buffer(PyObject *out, const double *values, const size_t size)
+{
+  void *data;
+  Py_ssize_t len;
+  if(PyObject_AsWriteBuffer(out, &data, &len) != 0)
+    return NULL;
+  if(static_cast<size_t>(len) < size * sizeof(double))
+  {
+    PyErr_SetString(PyExc_ValueError, "output buffer is too small");
+    return NULL;
+  }
+  std::memcpy(data, values, size * sizeof(double));
+  Py_INCREF(out);
+  return out;
+}
+
+/**
+ * Python function for: handle of a robot, which can be passed to the other
+ * functions instead of its address to skip the lookup.
+ */
+static PyObject *
+robot_handle(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  if(!PyArg_ParseTuple(args, "O", &robot_addr))
+    return NULL;
+
+  RobotPlugin* robot = get_robot(robot_addr);
+  if(robot)
+  {
+    const std::vector<RobotPlugin*>::const_iterator it =
+      std::find(robotOrder.begin(), robotOrder.end(), robot);
+    return Py_BuildValue("l", static_cast<long>(it - robotOrder.begin()));
+  }
+  else
+    return NULL;
+}
+
 /**
  * Python function for: bind
  */
 static PyObject *
 robot_bind(PyObject *, PyObject *args)
 {
-  char* robot_addr;
+  PyObject* robot_addr;
   char* addr;
   int port;
-  if(!PyArg_ParseTuple(args, "ssi", &robot_addr, &addr, &port))
+  if(!PyArg_ParseTuple(args, "Osi", &robot_addr, &addr, &port))
     return NULL;
 
   // Send to the right controller.
-  RobotPlugin* robot = get_robot_pointer(std::string(robot_addr));
+  RobotPlugin* robot = get_robot(robot_addr);
   if(robot)
   {
     bool res = robot->Bind(&RobotPlugin::OnDataReceivedPython,
@@ -73,13 +181,13 @@ robot_bind(PyObject *, PyObject *args)
 static PyObject *
 robot_set_linear_velocity(PyObject *, PyObject *args)
 {
-  char* robot_addr;
+  PyObject* robot_addr;
   float x, y, z;
-  if(!PyArg_ParseTuple(args, "sfff", &robot_addr, &x, &y, &z))
+  if(!PyArg_ParseTuple(args, "Offf", &robot_addr, &x, &y, &z))
     return NULL;
 
   // Send to the right controller.
-  RobotPlugin* robot = get_robot_pointer(std::string(robot_addr));
+  RobotPlugin* robot = get_robot(robot_addr);
   if(robot)
   {
     bool res = robot->SetLinearVelocity(ignition::math::Vector3d(x, y, z));
@@ -95,13 +203,13 @@ robot_set_linear_velocity(PyObject *, PyObject *args)
 static PyObject *
 robot_set_angular_velocity(PyObject *, PyObject *args)
 {
-  char* robot_addr;
+  PyObject* robot_addr;
   float x, y, z;
-  if(!PyArg_ParseTuple(args, "sfff", &robot_addr, &x, &y, &z))
+  if(!PyArg_ParseTuple(args, "Offf", &robot_addr, &x, &y, &z))
     return NULL;
 
   // Send to the right controller.
-  RobotPlugin* robot = get_robot_pointer(std::string(robot_addr));
+  RobotPlugin* robot = get_robot(robot_addr);
   if(robot)
   {
     bool res = robot->SetAngularVelocity(ignition::math::Vector3d(x, y, z));
@@ -117,12 +225,12 @@ robot_set_angular_velocity(PyObject *, PyObject *args)
 static PyObject *
 robot_neighbors(PyObject *, PyObject *args)
 {
-  char* robot_addr;
-  if(!PyArg_ParseTuple(args, "s", &robot_addr))
+  PyObject* robot_addr;
+  if(!PyArg_ParseTuple(args, "O", &robot_addr))
     return NULL;
 
   // Send to the right controller.
-  RobotPlugin* robot = get_robot_pointer(std::string(robot_addr));
+  RobotPlugin* robot = get_robot(robot_addr);
   if(robot)
   {
     const std::vector<std::string> &neighbors = robot->Neighbors();
@@ -139,21 +247,79 @@ robot_neighbors(PyObject *, PyObject *args)
     return NULL;
 }
 
+/**
+ * Convert neighbors to a tuple of (address, latitude, longitude, altitude,
+ * distance) tuples.
+ */
+static PyObject *
+neighbors_tuple(const std::vector<RobotPlugin::NearbyNeighbor> &_neighbors)
+{
+  PyObject *pArgs = PyTuple_New(_neighbors.size());
+  for (unsigned int i = 0; i < _neighbors.size(); ++i)
+  {
+    const RobotPlugin::NearbyNeighbor &neighbor = _neighbors[i];
+    PyObject *pValue = Py_BuildValue("(sdddd)", neighbor.address.c_str(),
+        neighbor.latitude, neighbor.longitude, neighbor.altitude,
+        neighbor.distance);
+    /* pValue reference stolen here: */
+    PyTuple_SetItem(pArgs, i, pValue);
+  }
+  return pArgs;
+}
+
+/**
+ * Python function for: ask for the neighbors within a distance.
+ */
+static PyObject *
+robot_nearby_neighbors(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  double radius;
+  if(!PyArg_ParseTuple(args, "Od", &robot_addr, &radius))
+    return NULL;
+
+  // Send to the right controller.
+  RobotPlugin* robot = get_robot(robot_addr);
+  if(robot)
+    return neighbors_tuple(robot->NearbyNeighbors(radius));
+  else
+    return NULL;
+}
+
+/**
+ * Python function for: ask for the closest neighbors.
+ */
+static PyObject *
+robot_k_nearest_neighbors(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  unsigned int k;
+  if(!PyArg_ParseTuple(args, "OI", &robot_addr, &k))
+    return NULL;
+
+  // Send to the right controller.
+  RobotPlugin* robot = get_robot(robot_addr);
+  if(robot)
+    return neighbors_tuple(robot->KNearestNeighbors(k));
+  else
+    return NULL;
+}
+
 /**
  * Python function for: ask for sending.
  */
 static PyObject *
 robot_send_to(PyObject *, PyObject *args)
 {
-  char* robot_addr;
+  PyObject* robot_addr;
   char *data, *dest;
   int port;
-  if(!PyArg_ParseTuple(args, "sssi", &robot_addr, &data, &dest, &port))
+  if(!PyArg_ParseTuple(args, "Ossi", &robot_addr, &data, &dest, &port))
     return NULL;
 
   // Send message
   // Send to the right controller.
-  RobotPlugin* robot = get_robot_pointer(std::string(robot_addr));
+  RobotPlugin* robot = get_robot(robot_addr);
   if(robot)
   {
     bool sent = robot->SendTo(std::string(data), std::string(dest), port);
@@ -163,22 +329,98 @@ robot_send_to(PyObject *, PyObject *args)
     return NULL;
 }
 
+/**
+ * Python function for: report the lost person to the BOO, in the binary
+ * format.
+ */
+static PyObject *
+robot_send_found(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  double x, y, z, t;
+  if(!PyArg_ParseTuple(args, "Odddd", &robot_addr, &x, &y, &z, &t))
+    return NULL;
+
+  RobotPlugin* robot = get_robot(robot_addr);
+  if(robot)
+  {
+    bool sent = robot->SendFound(ignition::math::Vector3d(x, y, z), t);
+    return Py_BuildValue("b", sent);
+  }
+  else
+    return NULL;
+}
+
+/**
+ * Python function for: ask for sending several messages at once.
+ * The messages are a sequence of (data, destination, port) tuples.
+ */
+static PyObject *
+robot_send_batch(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  PyObject *messages;
+  if(!PyArg_ParseTuple(args, "OO", &robot_addr, &messages))
+    return NULL;
+
+  PyObject *seq = PySequence_Fast(messages, "messages must be a sequence");
+  if(seq == NULL)
+    return NULL;
+
+  // The payloads are kept until the batch is sent.
+  const Py_ssize_t size = PySequence_Fast_GET_SIZE(seq);
+  std::vector<std::string> payloads(size);
+  std::vector<RobotPlugin::OutgoingMessage> batch(size);
+  for(Py_ssize_t i = 0; i < size; ++i)
+  {
+    char *data, *dest;
+    int port;
+    if(!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(seq, i), "ssi",
+          &data, &dest, &port))
+    {
+      Py_DECREF(seq);
+      return NULL;
+    }
+    payloads[i] = data;
+    batch[i].dstAddress = dest;
+    batch[i].port = port;
+    batch[i].data = &payloads[i];
+  }
+  Py_DECREF(seq);
+
+  // Send to the right controller.
+  RobotPlugin* robot = get_robot(robot_addr);
+  if(robot)
+  {
+    bool sent = robot->SendBatch(batch);
+    return Py_BuildValue("b", sent);
+  }
+  else
+    return NULL;
+}
+
 /**
  * Python function for: ask for GPS localization.
  */
 static PyObject *
 robot_pose(PyObject *, PyObject *args)
 {
-  char* robot_addr;
-  if(!PyArg_ParseTuple(args, "s", &robot_addr))
+  PyObject* robot_addr;
+  PyObject* out = NULL;
+  if(!PyArg_ParseTuple(args, "O|O", &robot_addr, &out))
     return NULL;
 
   // Get pose and altitude.
-  RobotPlugin* robot = get_robot_pointer(std::string(robot_addr));
+  RobotPlugin* robot = get_robot(robot_addr);
   if(robot)
   {
     double latitude, longitude, altitude;
     robot->Pose(latitude, longitude, altitude);
+    if(out)
+    {
+      const double values[] = {latitude, longitude, altitude};
+      return fill_buffer(out, values, 3);
+    }
 
     PyObject *pArgs = PyTuple_New(3);
     PyTuple_SetItem(pArgs, 0, Py_BuildValue("d", latitude));
@@ -197,16 +439,22 @@ robot_pose(PyObject *, PyObject *args)
 static PyObject *
 robot_boo_pose(PyObject *, PyObject *args)
 {
-  char* robot_addr;
-  if(!PyArg_ParseTuple(args, "s", &robot_addr))
+  PyObject* robot_addr;
+  PyObject* out = NULL;
+  if(!PyArg_ParseTuple(args, "O|O", &robot_addr, &out))
     return NULL;
 
   // Get pose and altitude.
-  RobotPlugin* robot = get_robot_pointer(std::string(robot_addr));
+  RobotPlugin* robot = get_robot(robot_addr);
   if(robot)
   {
     double latitude, longitude;
     robot->BooPose(latitude, longitude);
+    if(out)
+    {
+      const double values[] = {latitude, longitude};
+      return fill_buffer(out, values, 2);
+    }
 
     PyObject *pArgs = PyTuple_New(2);
     PyTuple_SetItem(pArgs, 0, Py_BuildValue("d", latitude));
@@ -224,15 +472,21 @@ robot_boo_pose(PyObject *, PyObject *args)
 static PyObject *
 robot_lost_person_dir(PyObject *, PyObject *args)
 {
-  char* robot_addr;
-  if(!PyArg_ParseTuple(args, "s", &robot_addr))
+  PyObject* robot_addr;
+  PyObject* out = NULL;
+  if(!PyArg_ParseTuple(args, "O|O", &robot_addr, &out))
     return NULL;
 
   // Get direction
-  RobotPlugin* robot = get_robot_pointer(std::string(robot_addr));
+  RobotPlugin* robot = get_robot(robot_addr);
   if(robot)
   {
     ignition::math::Vector2d dir = robot->LostPersonDir();
+    if(out)
+    {
+      const double values[] = {dir.X(), dir.Y()};
+      return fill_buffer(out, values, 2);
+    }
 
     PyObject *pArgs = PyTuple_New(2);
     PyTuple_SetItem(pArgs, 0, Py_BuildValue("i", dir.X()));
@@ -250,17 +504,25 @@ robot_lost_person_dir(PyObject *, PyObject *args)
 static PyObject *
 robot_imu(PyObject *, PyObject *args)
 {
-  char* robot_addr;
-  if(!PyArg_ParseTuple(args, "s", &robot_addr))
+  PyObject* robot_addr;
+  PyObject* out = NULL;
+  if(!PyArg_ParseTuple(args, "O|O", &robot_addr, &out))
     return NULL;
 
-  RobotPlugin* robot = get_robot_pointer(std::string(robot_addr));
+  RobotPlugin* robot = get_robot(robot_addr);
   if(robot)
   {
     // Get IMU information.
     ignition::math::Vector3d linVel, angVel;
     ignition::math::Quaterniond orient;
     robot->Imu(linVel, angVel, orient);
+    if(out)
+    {
+      const double values[] = {linVel.X(), linVel.Y(), linVel.Z(),
+        angVel.X(), angVel.Y(), angVel.Z(), orient.X(), orient.Y(),
+        orient.Z()};
+      return fill_buffer(out, values, 9);
+    }
 
     // Return
     PyObject *pArgs = PyTuple_New(9);
@@ -286,16 +548,22 @@ robot_imu(PyObject *, PyObject *args)
 static PyObject *
 robot_bearing(PyObject *, PyObject *args)
 {
-  char* robot_addr;
-  if(!PyArg_ParseTuple(args, "s", &robot_addr))
+  PyObject* robot_addr;
+  PyObject* out = NULL;
+  if(!PyArg_ParseTuple(args, "O|O", &robot_addr, &out))
     return NULL;
 
-  RobotPlugin* robot = get_robot_pointer(std::string(robot_addr));
+  RobotPlugin* robot = get_robot(robot_addr);
   if(robot)
   {
     // Get IMU information.
     ignition::math::Angle bearing;
     robot->Bearing(bearing);
+    if(out)
+    {
+      const double value = bearing.Radian();
+      return fill_buffer(out, &value, 1);
+    }
 
     // Return
     return Py_BuildValue("f", bearing.Radian());
@@ -310,16 +578,23 @@ robot_bearing(PyObject *, PyObject *args)
 static PyObject *
 robot_search_area(PyObject *, PyObject *args)
 {
-  char* robot_addr;
-  if(!PyArg_ParseTuple(args, "s", &robot_addr))
+  PyObject* robot_addr;
+  PyObject* out = NULL;
+  if(!PyArg_ParseTuple(args, "O|O", &robot_addr, &out))
     return NULL;
 
-  RobotPlugin* robot = get_robot_pointer(std::string(robot_addr));
+  RobotPlugin* robot = get_robot(robot_addr);
   if(robot)
   {
     // Get pose and altitude.
     double minLatitude, maxLatitude, minLongitude, maxLongitude;
     robot->SearchArea(minLatitude, maxLatitude, minLongitude, maxLongitude);
+    if(out)
+    {
+      const double values[] = {minLatitude, maxLatitude, minLongitude,
+        maxLongitude};
+      return fill_buffer(out, values, 4);
+    }
 
     PyObject *pArgs = PyTuple_New(4);
     PyTuple_SetItem(pArgs, 0, Py_BuildValue("d", minLatitude));
@@ -335,19 +610,45 @@ robot_search_area(PyObject *, PyObject *args)
 
 /**
  * Python function for: image function.
+ * With an output buffer, the positions of the objects are written to it, as
+ * many as fit, and only their names are returned.
  */
 static PyObject *
 robot_image(PyObject *, PyObject *args)
 {
-  char* robot_addr;
-  if(!(PyArg_ParseTuple(args, "s", &robot_addr)))
+  PyObject* robot_addr;
+  PyObject* out = NULL;
+  if(!(PyArg_ParseTuple(args, "O|O", &robot_addr, &out)))
     return NULL;
 
-  RobotPlugin* robot = get_robot_pointer(std::string(robot_addr));
+  RobotPlugin* robot = get_robot(robot_addr);
   if(robot)
   {
     ImageData img;
     robot->Image(img);
+    if(out)
+    {
+      double *data;
+      Py_ssize_t len;
+      if(PyObject_AsWriteBuffer(out, reinterpret_cast<void **>(&data),
+                                &len) != 0)
+        return NULL;
+      const size_t size = std::min(img.objects.size(),
+          static_cast<size_t>(len) / (3 * sizeof(double)));
+      PyObject *names = PyTuple_New(size);
+      size_t i = 0;
+      for (auto const &obj : img.objects)
+      {
+        if(i == size)
+          break;
+        ignition::math::Pose3d pose = robot->CameraToWorld(obj.second);
+        data[3 * i] = pose.Pos().X();
+        data[3 * i + 1] = pose.Pos().Y();
+        data[3 * i + 2] = pose.Pos().Z();
+        PyTuple_SetItem(names, i++, Py_BuildValue("s", obj.first.c_str()));
+      }
+      return names;
+    }
     PyObject *camera_locs = PyTuple_New(img.objects.size());
     int i = 0;
     for (auto const obj : img.objects)
@@ -374,11 +675,11 @@ robot_image(PyObject *, PyObject *args)
 static PyObject *
 robot_type(PyObject *, PyObject *args)
 {
-  char* robot_addr;
-  if(!PyArg_ParseTuple(args, "s", &robot_addr))
+  PyObject* robot_addr;
+  if(!PyArg_ParseTuple(args, "O", &robot_addr))
     return NULL;
 
-  RobotPlugin* robot = get_robot_pointer(std::string(robot_addr));
+  RobotPlugin* robot = get_robot(robot_addr);
   if(robot)
   {
     // Get vehicle type
@@ -416,11 +717,11 @@ robot_type(PyObject *, PyObject *args)
 static PyObject *
 robot_terrain_type(PyObject *, PyObject *args)
 {
-  char* robot_addr;
-  if(!PyArg_ParseTuple(args, "s", &robot_addr))
+  PyObject* robot_addr;
+  if(!PyArg_ParseTuple(args, "O", &robot_addr))
     return NULL;
 
-  RobotPlugin* robot = get_robot_pointer(std::string(robot_addr));
+  RobotPlugin* robot = get_robot(robot_addr);
   if(robot)
   {
     // Get vehicle type
@@ -455,11 +756,11 @@ robot_terrain_type(PyObject *, PyObject *args)
 static PyObject *
 robot_host(PyObject *, PyObject *args)
 {
-  char* robot_addr;
-  if(!PyArg_ParseTuple(args, "s", &robot_addr))
+  PyObject* robot_addr;
+  if(!PyArg_ParseTuple(args, "O", &robot_addr))
     return NULL;
 
-  RobotPlugin* robot = get_robot_pointer(std::string(robot_addr));
+  RobotPlugin* robot = get_robot(robot_addr);
   if(robot)
   {
     // Get host
@@ -477,11 +778,11 @@ robot_host(PyObject *, PyObject *args)
 static PyObject *
 robot_name(PyObject *, PyObject *args)
 {
-  char* robot_addr;
-  if(!PyArg_ParseTuple(args, "s", &robot_addr))
+  PyObject* robot_addr;
+  if(!PyArg_ParseTuple(args, "O", &robot_addr))
     return NULL;
 
-  RobotPlugin* robot = get_robot_pointer(std::string(robot_addr));
+  RobotPlugin* robot = get_robot(robot_addr);
   if(robot)
   {
     // Get host
@@ -499,11 +800,11 @@ robot_name(PyObject *, PyObject *args)
 static PyObject *
 robot_launch(PyObject *, PyObject *args)
 {
-  char* robot_addr;
-  if(!PyArg_ParseTuple(args, "s", &robot_addr))
+  PyObject* robot_addr;
+  if(!PyArg_ParseTuple(args, "O", &robot_addr))
     return NULL;
 
-  RobotPlugin* robot = get_robot_pointer(std::string(robot_addr));
+  RobotPlugin* robot = get_robot(robot_addr);
   if(robot)
   {
     // Launch
@@ -522,11 +823,11 @@ static PyObject *
 robot_dock(PyObject *, PyObject *args)
 {
   char* target;
-  char* robot_addr;
-  if(!PyArg_ParseTuple(args, "ss", &robot_addr, &target))
+  PyObject* robot_addr;
+  if(!PyArg_ParseTuple(args, "Os", &robot_addr, &target))
     return NULL;
 
-  RobotPlugin* robot = get_robot_pointer(std::string(robot_addr));
+  RobotPlugin* robot = get_robot(robot_addr);
   if(robot)
   {
     // Launch
@@ -544,11 +845,11 @@ robot_dock(PyObject *, PyObject *args)
 static PyObject *
 robot_is_docked(PyObject *, PyObject *args)
 {
-  char* robot_addr;
-  if(!PyArg_ParseTuple(args, "s", &robot_addr))
+  PyObject* robot_addr;
+  if(!PyArg_ParseTuple(args, "O", &robot_addr))
     return NULL;
 
-  RobotPlugin* robot = get_robot_pointer(std::string(robot_addr));
+  RobotPlugin* robot = get_robot(robot_addr);
   if(robot)
   {
     // Launch
@@ -608,15 +909,158 @@ robot_gzlog(PyObject *, PyObject *args)
   Py_RETURN_NONE;
 }
 
+/**
+ * Add the layout of the batched update to the swarm module.
+ */
+void
+add_batch_constants(PyObject *module)
+{
+  PyModule_AddIntConstant(module, "OBS_LATITUDE", OBS_LATITUDE);
+  PyModule_AddIntConstant(module, "OBS_LONGITUDE", OBS_LONGITUDE);
+  PyModule_AddIntConstant(module, "OBS_ALTITUDE", OBS_ALTITUDE);
+  PyModule_AddIntConstant(module, "OBS_LIN_VEL", OBS_LIN_VEL);
+  PyModule_AddIntConstant(module, "OBS_ANG_VEL", OBS_ANG_VEL);
+  PyModule_AddIntConstant(module, "OBS_ORIENTATION", OBS_ORIENTATION);
+  PyModule_AddIntConstant(module, "OBS_BEARING", OBS_BEARING);
+  PyModule_AddIntConstant(module, "OBS_BATTERY", OBS_BATTERY);
+  PyModule_AddIntConstant(module, "OBS_NEIGHBORS", OBS_NEIGHBORS);
+  PyModule_AddIntConstant(module, "OBS_DOCKED", OBS_DOCKED);
+  PyModule_AddIntConstant(module, "OBS_SIZE", OBS_SIZE);
+  PyModule_AddIntConstant(module, "ACT_LIN_VEL", ACT_LIN_VEL);
+  PyModule_AddIntConstant(module, "ACT_ANG_VEL", ACT_ANG_VEL);
+  PyModule_AddIntConstant(module, "ACT_SIZE", ACT_SIZE);
+}
+
+/**
+ * Rebuild the Python objects of the batched update after a robot is added.
+ */
+static void
+resize_batch()
+{
+  const size_t size = robotOrder.size();
+  batchObservations.resize(size * OBS_SIZE);
+  batchActions.resize(size * ACT_SIZE);
+
+  Py_XDECREF(batchNames);
+  batchNames = PyTuple_New(size);
+  for (size_t i = 0; i < size; ++i)
+  {
+    PyTuple_SetItem(batchNames, i,
+        PyString_FromString(robotOrder[i]->Name().c_str()));
+  }
+
+  Py_XDECREF(batchObservationsBuffer);
+  batchObservationsBuffer = PyBuffer_FromMemory(batchObservations.data(),
+      batchObservations.size() * sizeof(double));
+  Py_XDECREF(batchActionsBuffer);
+  batchActionsBuffer = PyBuffer_FromReadWriteMemory(batchActions.data(),
+      batchActions.size() * sizeof(double));
+}
+
+/**
+ * Call the batched update function once for all the robots, with
+ * (names, observations, actions, world_name, sim_time, real_time).
+ *
+ * The observations are a read-only buffer of OBS_SIZE doubles per robot and
+ * the actions a writable buffer of ACT_SIZE doubles per robot, in the order
+ * of the names, e.g. numpy.frombuffer(observations).reshape(-1, OBS_SIZE).
+ * Observations that can't be read are NaN. The actions start as NaN, and
+ * the velocities left as NaN aren't set.
+ */
+bool
+update_all(PyObject *func, const gazebo::common::UpdateInfo &info)
+{
+  if (batchNames == NULL ||
+      static_cast<size_t>(PyTuple_GET_SIZE(batchNames)) != robotOrder.size())
+  {
+    resize_batch();
+  }
+
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  std::fill(batchObservations.begin(), batchObservations.end(), nan);
+  std::fill(batchActions.begin(), batchActions.end(), nan);
+
+  for (size_t i = 0; i < robotOrder.size(); ++i)
+  {
+    RobotPlugin *robot = robotOrder[i];
+    double *obs = &batchObservations[i * OBS_SIZE];
+
+    double latitude, longitude, altitude;
+    if (robot->Pose(latitude, longitude, altitude))
+    {
+      obs[OBS_LATITUDE] = latitude;
+      obs[OBS_LONGITUDE] = longitude;
+      obs[OBS_ALTITUDE] = altitude;
+    }
+
+    ignition::math::Vector3d linVel, angVel;
+    ignition::math::Quaterniond orient;
+    if (robot->Imu(linVel, angVel, orient))
+    {
+      for (int j = 0; j < 3; ++j)
+      {
+        obs[OBS_LIN_VEL + j] = linVel[j];
+        obs[OBS_ANG_VEL + j] = angVel[j];
+      }
+      obs[OBS_ORIENTATION + 0] = orient.W();
+      obs[OBS_ORIENTATION + 1] = orient.X();
+      obs[OBS_ORIENTATION + 2] = orient.Y();
+      obs[OBS_ORIENTATION + 3] = orient.Z();
+    }
+
+    ignition::math::Angle bearing;
+    if (robot->Bearing(bearing))
+      obs[OBS_BEARING] = bearing.Radian();
+
+    obs[OBS_BATTERY] = robot->BatteryCapacity();
+    obs[OBS_NEIGHBORS] = robot->Neighbors().size();
+    obs[OBS_DOCKED] = robot->IsDocked();
+  }
+
+  PyObject *args = Py_BuildValue("(OOOsdd)", batchNames,
+      batchObservationsBuffer, batchActionsBuffer, info.worldName.c_str(),
+      info.simTime.Double(), info.realTime.Double());
+  PyObject *res = PyObject_CallObject(func, args);
+  Py_DECREF(args);
+  if (res == NULL)
+  {
+    PyErr_Print();
+    return false;
+  }
+  Py_DECREF(res);
+
+  for (size_t i = 0; i < robotOrder.size(); ++i)
+  {
+    RobotPlugin *robot = robotOrder[i];
+    const double *act = &batchActions[i * ACT_SIZE];
+    if (!std::isnan(act[ACT_LIN_VEL]))
+    {
+      robot->SetLinearVelocity(act[ACT_LIN_VEL], act[ACT_LIN_VEL + 1],
+          act[ACT_LIN_VEL + 2]);
+    }
+    if (!std::isnan(act[ACT_ANG_VEL]))
+    {
+      robot->SetAngularVelocity(act[ACT_ANG_VEL], act[ACT_ANG_VEL + 1],
+          act[ACT_ANG_VEL + 2]);
+    }
+  }
+  return true;
+}
+
 /**
  * Python methods to call c++.
  */
 PyMethodDef EmbMethods[] = {
+        {"handle",               robot_handle,               METH_VARARGS, "Robot handle."},
         {"bind",                 robot_bind,                 METH_VARARGS, "Bind."},
         {"set_linear_velocity",  robot_set_linear_velocity,  METH_VARARGS, "Linear velocity."},
         {"set_angular_velocity", robot_set_angular_velocity, METH_VARARGS, "Angular velocity."},
         {"send_to",              robot_send_to,              METH_VARARGS, "Send message to."},
+        {"send_batch",           robot_send_batch,           METH_VARARGS, "Send messages."},
+        {"send_found",           robot_send_found,           METH_VARARGS, "Report the lost person to the BOO."},
         {"neighbors",            robot_neighbors,            METH_VARARGS, "Neighbors."},
+        {"nearby_neighbors",     robot_nearby_neighbors,     METH_VARARGS, "Neighbors within a distance."},
+        {"k_nearest_neighbors",  robot_k_nearest_neighbors,  METH_VARARGS, "Closest neighbors."},
         {"pose",                 robot_pose,                 METH_VARARGS, "Robot pose using GPS."},
         {"imu",                  robot_imu,                  METH_VARARGS, "Robot IMU."},
         {"bearing",              robot_bearing,              METH_VARARGS, "Robot bearing."},
@@ -0,0 +1,854 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+// Worker process of PythonWorkers. It runs the Python controllers of the
+// robots i with i % workers == index, with a swarm module that reads the
+// state of the robots from the PythonChannel and queues their commands.
+//
+// Usage: swarm_python_worker <channel> <index> <module> <load> <update>
+//                            <ondatareceived>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "swarm/FoundReport.hh"
+#include "swarm/PythonChannel.hh"
+
+#include <Python.h>
+
+using namespace swarm;
+
+// The channel with the plugin.
+static std::unique_ptr<PythonChannel> channel;
+
+// Index of each robot by name.
+static std::unordered_map<std::string, uint32_t> robotIndices;
+
+// Number of robots when robotIndices was built.
+static uint32_t indexedRobots = 0;
+
+// Robot whose function is being called, whose outbox gets the commands.
+static PythonRobot *current = NULL;
+
+static bool
+get_robot_index(const std::string &addr, uint32_t &index)
+{
+  const uint32_t numRobots = channel->Header().numRobots;
+  if (numRobots != indexedRobots)
+  {
+    robotIndices.clear();
+    for (uint32_t i = 0; i < numRobots && i < kPythonMaxRobots; ++i)
+      robotIndices[channel->Robot(i).name] = i;
+    indexedRobots = numRobots;
+  }
+
+  std::unordered_map<std::string, uint32_t>::const_iterator it =
+    robotIndices.find(addr);
+  if(it == robotIndices.end() || channel->Robot(it->second).name[0] == '\0')
+  {
+    char err_buf[1024];
+    snprintf(err_buf, sizeof(err_buf),
+             "Unknown robot address: %s", addr.c_str());
+    PyErr_SetString(PyExc_RuntimeError, err_buf);
+    return false;
+  }
+  index = it->second;
+  return true;
+}
+
+// Get the index of a robot from its address or handle.
+static bool
+get_robot_index(PyObject *robot, uint32_t &index)
+{
+  if(PyInt_Check(robot))
+  {
+    const long handle = PyInt_AsLong(robot);
+    if(handle < 0 || handle >= channel->Header().numRobots ||
+       channel->Robot(handle).name[0] == '\0')
+    {
+      char err_buf[1024];
+      snprintf(err_buf, sizeof(err_buf), "Unknown robot handle: %ld", handle);
+      PyErr_SetString(PyExc_RuntimeError, err_buf);
+      return false;
+    }
+    index = handle;
+    return true;
+  }
+  else if(PyString_Check(robot))
+    return get_robot_index(std::string(PyString_AsString(robot)), index);
+
+  PyErr_SetString(PyExc_TypeError, "robot must be an address or a handle");
+  return false;
+}
+
+static PythonRobot*
+get_robot_pointer(PyObject *robot)
+{
+  uint32_t index;
+  if(!get_robot_index(robot, index))
+    return NULL;
+  return &channel->Robot(index);
+}
+
+// Copy values to a writable buffer of doubles given by the caller, e.g. a
+// numpy array, and return it.
+static PyObject *
+fill_buffer(PyObject *out, const double *values, const size_t size)
+{
+  void *data;
+  Py_ssize_t len;
+  if(PyObject_AsWriteBuffer(out, &data, &len) != 0)
+    return NULL;
+  if(static_cast<size_t>(len) < size * sizeof(double))
+  {
+    PyErr_SetString(PyExc_ValueError, "output buffer is too small");
+    return NULL;
+  }
+  std::memcpy(data, values, size * sizeof(double));
+  Py_INCREF(out);
+  return out;
+}
+
+// Get the robot of a command, which can only be sent from the controller
+// functions.
+static bool
+command_robot(PyObject *robot, uint32_t &index)
+{
+  if(current == NULL)
+  {
+    PyErr_SetString(PyExc_RuntimeError,
+                    "Commands can only be sent from the controller functions");
+    return false;
+  }
+  return get_robot_index(robot, index);
+}
+
+// Start a command, in the outbox of the current robot.
+static void
+start_command(PythonQueueWriter &writer, const uint32_t index,
+              const PythonCommand command)
+{
+  writer.Add(index);
+  writer.Add(static_cast<uint32_t>(command));
+}
+
+/**
+ * Python function for: handle of a robot, which can be passed to the other
+ * functions instead of its address to skip the lookup.
+ */
+static PyObject *
+robot_handle(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  if(!PyArg_ParseTuple(args, "O", &robot_addr))
+    return NULL;
+
+  uint32_t index;
+  if(!get_robot_index(robot_addr, index))
+    return NULL;
+  return Py_BuildValue("l", static_cast<long>(index));
+}
+
+/**
+ * Python function for: bind
+ */
+static PyObject *
+robot_bind(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  char* addr;
+  int port;
+  if(!PyArg_ParseTuple(args, "Osi", &robot_addr, &addr, &port))
+    return NULL;
+
+  uint32_t index;
+  if(!command_robot(robot_addr, index))
+    return NULL;
+  PythonQueueWriter writer(current->outbox);
+  start_command(writer, index, PYTHON_BIND);
+  writer.Add(std::string(addr));
+  writer.Add(static_cast<uint32_t>(port));
+  return Py_BuildValue("b", writer.End());
+}
+
+/**
+ * Python function for: Set linear velocity
+ */
+static PyObject *
+robot_set_linear_velocity(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  float x, y, z;
+  if(!PyArg_ParseTuple(args, "Offf", &robot_addr, &x, &y, &z))
+    return NULL;
+
+  uint32_t index;
+  if(!command_robot(robot_addr, index))
+    return NULL;
+  PythonQueueWriter writer(current->outbox);
+  start_command(writer, index, PYTHON_LINEAR_VELOCITY);
+  writer.Add(static_cast<double>(x));
+  writer.Add(static_cast<double>(y));
+  writer.Add(static_cast<double>(z));
+  return Py_BuildValue("b", writer.End());
+}
+
+/**
+ * Python function for: Set angular velocity
+ */
+static PyObject *
+robot_set_angular_velocity(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  float x, y, z;
+  if(!PyArg_ParseTuple(args, "Offf", &robot_addr, &x, &y, &z))
+    return NULL;
+
+  uint32_t index;
+  if(!command_robot(robot_addr, index))
+    return NULL;
+  PythonQueueWriter writer(current->outbox);
+  start_command(writer, index, PYTHON_ANGULAR_VELOCITY);
+  writer.Add(static_cast<double>(x));
+  writer.Add(static_cast<double>(y));
+  writer.Add(static_cast<double>(z));
+  return Py_BuildValue("b", writer.End());
+}
+
+/**
+ * Python function for: ask for Neighbors.
+ */
+static PyObject *
+robot_neighbors(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  if(!PyArg_ParseTuple(args, "O", &robot_addr))
+    return NULL;
+
+  PythonRobot* robot = get_robot_pointer(robot_addr);
+  if(robot)
+  {
+    PyObject *pArgs = PyList_New(0);
+    PythonQueueReader reader(robot->neighbors);
+    std::string neighbor;
+    while (reader.Read(neighbor))
+    {
+      PyObject *pValue = Py_BuildValue("s", neighbor.c_str());
+      PyList_Append(pArgs, pValue);
+      Py_DECREF(pValue);
+    }
+    PyObject *pTuple = PyList_AsTuple(pArgs);
+    Py_DECREF(pArgs);
+    return pTuple;
+  }
+  else
+    return NULL;
+}
+
+/**
+ * Python function for: ask for sending.
+ */
+static PyObject *
+robot_send_to(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  char *data, *dest;
+  int port;
+  if(!PyArg_ParseTuple(args, "Ossi", &robot_addr, &data, &dest, &port))
+    return NULL;
+
+  uint32_t index;
+  if(!command_robot(robot_addr, index))
+    return NULL;
+  PythonQueueWriter writer(current->outbox);
+  start_command(writer, index, PYTHON_SEND_TO);
+  writer.Add(std::string(data));
+  writer.Add(std::string(dest));
+  writer.Add(static_cast<uint32_t>(port));
+  return Py_BuildValue("b", writer.End());
+}
+
+/**
+ * Python function for: report the lost person to the BOO, in the binary
+ * format.
+ */
+static PyObject *
+robot_send_found(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  double x, y, z, t;
+  if(!PyArg_ParseTuple(args, "Odddd", &robot_addr, &x, &y, &z, &t))
+    return NULL;
+
+  uint32_t index;
+  if(!command_robot(robot_addr, index))
+    return NULL;
+
+  // Address and port of the BOO, as in RobotPlugin.
+  PythonQueueWriter writer(current->outbox);
+  start_command(writer, index, PYTHON_SEND_TO);
+  writer.Add(EncodeFoundReport(x, y, z, t));
+  writer.Add(std::string("boo"));
+  writer.Add(static_cast<uint32_t>(4200));
+  return Py_BuildValue("b", writer.End());
+}
+
+/**
+ * Python function for: ask for sending several messages at once.
+ * The messages are a sequence of (data, destination, port) tuples.
+ */
+static PyObject *
+robot_send_batch(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  PyObject *messages;
+  if(!PyArg_ParseTuple(args, "OO", &robot_addr, &messages))
+    return NULL;
+
+  PyObject *seq = PySequence_Fast(messages, "messages must be a sequence");
+  if(seq == NULL)
+    return NULL;
+
+  uint32_t index;
+  if(!command_robot(robot_addr, index))
+  {
+    Py_DECREF(seq);
+    return NULL;
+  }
+
+  bool queued = true;
+  const Py_ssize_t size = PySequence_Fast_GET_SIZE(seq);
+  for(Py_ssize_t i = 0; i < size; ++i)
+  {
+    char *data, *dest;
+    int port;
+    if(!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(seq, i), "ssi",
+          &data, &dest, &port))
+    {
+      Py_DECREF(seq);
+      return NULL;
+    }
+    PythonQueueWriter writer(current->outbox);
+    start_command(writer, index, PYTHON_SEND_TO);
+    writer.Add(std::string(data));
+    writer.Add(std::string(dest));
+    writer.Add(static_cast<uint32_t>(port));
+    queued = writer.End() && queued;
+  }
+  Py_DECREF(seq);
+  return Py_BuildValue("b", queued);
+}
+
+/**
+ * Python function for: ask for GPS localization.
+ */
+static PyObject *
+robot_pose(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  PyObject* out = NULL;
+  if(!PyArg_ParseTuple(args, "O|O", &robot_addr, &out))
+    return NULL;
+
+  PythonRobot* robot = get_robot_pointer(robot_addr);
+  if(robot && out)
+    return fill_buffer(out, robot->pose, 3);
+  else if(robot)
+    return Py_BuildValue("(ddd)", robot->pose[0], robot->pose[1],
+                         robot->pose[2]);
+  else
+    return NULL;
+}
+
+/**
+ * Python function for: ask for GPS localization.
+ */
+static PyObject *
+robot_boo_pose(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  PyObject* out = NULL;
+  if(!PyArg_ParseTuple(args, "O|O", &robot_addr, &out))
+    return NULL;
+
+  PythonRobot* robot = get_robot_pointer(robot_addr);
+  if(robot && out)
+    return fill_buffer(out, robot->booPose, 2);
+  else if(robot)
+    return Py_BuildValue("(dd)", robot->booPose[0], robot->booPose[1]);
+  else
+    return NULL;
+}
+
+/**
+ * Python function for: ask for lost person direction
+ */
+static PyObject *
+robot_lost_person_dir(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  PyObject* out = NULL;
+  if(!PyArg_ParseTuple(args, "O|O", &robot_addr, &out))
+    return NULL;
+
+  PythonRobot* robot = get_robot_pointer(robot_addr);
+  if(robot && out)
+    return fill_buffer(out, robot->lostPersonDir, 2);
+  else if(robot)
+    return Py_BuildValue("(ii)", static_cast<int>(robot->lostPersonDir[0]),
+                         static_cast<int>(robot->lostPersonDir[1]));
+  else
+    return NULL;
+}
+
+/**
+ * Python function for: ask for IMU.
+ */
+static PyObject *
+robot_imu(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  PyObject* out = NULL;
+  if(!PyArg_ParseTuple(args, "O|O", &robot_addr, &out))
+    return NULL;
+
+  PythonRobot* robot = get_robot_pointer(robot_addr);
+  if(robot && out)
+    return fill_buffer(out, robot->imu, 9);
+  else if(robot)
+  {
+    PyObject *pArgs = PyTuple_New(9);
+    for (int i = 0; i < 9; ++i)
+      PyTuple_SetItem(pArgs, i, Py_BuildValue("f", robot->imu[i]));
+    return pArgs;
+  }
+  else
+    return NULL;
+}
+
+/**
+ * Python function for: ask for IMU.
+ */
+static PyObject *
+robot_bearing(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  PyObject* out = NULL;
+  if(!PyArg_ParseTuple(args, "O|O", &robot_addr, &out))
+    return NULL;
+
+  PythonRobot* robot = get_robot_pointer(robot_addr);
+  if(robot && out)
+    return fill_buffer(out, &robot->bearing, 1);
+  else if(robot)
+    return Py_BuildValue("f", robot->bearing);
+  else
+    return NULL;
+}
+
+/**
+ * Python function for: SearchArea function.
+ */
+static PyObject *
+robot_search_area(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  PyObject* out = NULL;
+  if(!PyArg_ParseTuple(args, "O|O", &robot_addr, &out))
+    return NULL;
+
+  PythonRobot* robot = get_robot_pointer(robot_addr);
+  if(robot && out)
+    return fill_buffer(out, robot->searchArea, 4);
+  else if(robot)
+    return Py_BuildValue("(dddd)", robot->searchArea[0],
+                         robot->searchArea[1], robot->searchArea[2],
+                         robot->searchArea[3]);
+  else
+    return NULL;
+}
+
+/**
+ * Python function for: image function.
+ */
+static PyObject *
+robot_image(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  PyObject* out = NULL;
+  if(!(PyArg_ParseTuple(args, "O|O", &robot_addr, &out)))
+    return NULL;
+
+  PythonRobot* robot = get_robot_pointer(robot_addr);
+  if(robot && out)
+  {
+    double *data;
+    Py_ssize_t len;
+    if(PyObject_AsWriteBuffer(out, reinterpret_cast<void **>(&data),
+                              &len) != 0)
+      return NULL;
+    const uint32_t size = std::min(robot->numObjects,
+        static_cast<uint32_t>(len / (3 * sizeof(double))));
+    PyObject *names = PyTuple_New(size);
+    for (uint32_t i = 0; i < size; ++i)
+    {
+      const PythonObject &obj = robot->objects[i];
+      data[3 * i] = obj.x;
+      data[3 * i + 1] = obj.y;
+      data[3 * i + 2] = obj.z;
+      PyTuple_SetItem(names, i, Py_BuildValue("s", obj.name));
+    }
+    return names;
+  }
+  else if(robot)
+  {
+    PyObject *camera_locs = PyTuple_New(robot->numObjects);
+    for (uint32_t i = 0; i < robot->numObjects; ++i)
+    {
+      const PythonObject &obj = robot->objects[i];
+      PyTuple_SetItem(camera_locs, i, Py_BuildValue("(s(ddd))", obj.name,
+                      obj.x, obj.y, obj.z));
+    }
+    return camera_locs;
+  }
+  else
+    return NULL;
+}
+
+/**
+ * Python function for: vehicle type
+ */
+static PyObject *
+robot_type(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  if(!PyArg_ParseTuple(args, "O", &robot_addr))
+    return NULL;
+
+  PythonRobot* robot = get_robot_pointer(robot_addr);
+  if(robot)
+  {
+    if(robot->type[0] == '\0')
+    {
+      PyErr_SetString(PyExc_RuntimeError, "unknown vehicle type");
+      return NULL;
+    }
+    return Py_BuildValue("s", robot->type);
+  }
+  else
+    return NULL;
+}
+
+/**
+ * Python function for: terrain type
+ */
+static PyObject *
+robot_terrain_type(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  if(!PyArg_ParseTuple(args, "O", &robot_addr))
+    return NULL;
+
+  PythonRobot* robot = get_robot_pointer(robot_addr);
+  if(robot)
+  {
+    if(robot->terrain[0] == '\0')
+    {
+      PyErr_SetString(PyExc_RuntimeError, "unknown terrain type");
+      return NULL;
+    }
+    return Py_BuildValue("s", robot->terrain);
+  }
+  else
+    return NULL;
+}
+
+/**
+ * Python function for: host
+ */
+static PyObject *
+robot_host(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  if(!PyArg_ParseTuple(args, "O", &robot_addr))
+    return NULL;
+
+  PythonRobot* robot = get_robot_pointer(robot_addr);
+  if(robot)
+    return Py_BuildValue("s", robot->host);
+  else
+    return NULL;
+}
+
+/**
+ * Python function for: name
+ */
+static PyObject *
+robot_name(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  if(!PyArg_ParseTuple(args, "O", &robot_addr))
+    return NULL;
+
+  PythonRobot* robot = get_robot_pointer(robot_addr);
+  if(robot)
+    return Py_BuildValue("s", robot->name);
+  else
+    return NULL;
+}
+
+/**
+ * Python function for: launch
+ */
+static PyObject *
+robot_launch(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  if(!PyArg_ParseTuple(args, "O", &robot_addr))
+    return NULL;
+
+  uint32_t index;
+  if(!command_robot(robot_addr, index))
+    return NULL;
+  PythonQueueWriter writer(current->outbox);
+  start_command(writer, index, PYTHON_LAUNCH);
+  writer.End();
+  Py_RETURN_NONE;
+}
+
+/**
+ * Python function for: dock
+ */
+static PyObject *
+robot_dock(PyObject *, PyObject *args)
+{
+  char* target;
+  PyObject* robot_addr;
+  if(!PyArg_ParseTuple(args, "Os", &robot_addr, &target))
+    return NULL;
+
+  uint32_t index;
+  if(!command_robot(robot_addr, index))
+    return NULL;
+  PythonQueueWriter writer(current->outbox);
+  start_command(writer, index, PYTHON_DOCK);
+  writer.Add(std::string(target));
+  return Py_BuildValue("b", writer.End());
+}
+
+/**
+ * Python function for: is docked
+ */
+static PyObject *
+robot_is_docked(PyObject *, PyObject *args)
+{
+  PyObject* robot_addr;
+  if(!PyArg_ParseTuple(args, "O", &robot_addr))
+    return NULL;
+
+  PythonRobot* robot = get_robot_pointer(robot_addr);
+  if(robot)
+    return Py_BuildValue("b", robot->docked != 0);
+  else
+    return NULL;
+}
+
+/**
+ * Print a message through the plugin, or here outside of the controller
+ * functions.
+ */
+static PyObject *
+robot_print(PyObject *args, const PythonCommand command, std::ostream &out)
+{
+  char *message;
+
+  if(!PyArg_ParseTuple(args, "s", &message))
+    return NULL;
+
+  if(current == NULL)
+  {
+    out << message << std::endl;
+    Py_RETURN_NONE;
+  }
+
+  PythonQueueWriter writer(current->outbox);
+  start_command(writer, 0, command);
+  writer.Add(std::string(message));
+  writer.End();
+  Py_RETURN_NONE;
+}
+
+/**
+ * Python function for: print gazebo logging messages.
+ */
+static PyObject *
+robot_gzmsg(PyObject *, PyObject *args)
+{
+  return robot_print(args, PYTHON_GZMSG, std::cout);
+}
+
+/**
+ * Python function for: print gazebo logging messages.
+ */
+static PyObject *
+robot_gzerr(PyObject *, PyObject *args)
+{
+  return robot_print(args, PYTHON_GZERR, std::cerr);
+}
+
+/**
+ * Python function for: print gazebo logging messages.
+ */
+static PyObject *
+robot_gzlog(PyObject *, PyObject *args)
+{
+  return robot_print(args, PYTHON_GZLOG, std::cout);
+}
+
+/**
+ * Python methods, the same as the ones of the plugin.
+ */
+static PyMethodDef WorkerMethods[] = {
+        {"handle",               robot_handle,               METH_VARARGS, "Robot handle."},
+        {"bind",                 robot_bind,                 METH_VARARGS, "Bind."},
+        {"set_linear_velocity",  robot_set_linear_velocity,  METH_VARARGS, "Linear velocity."},
+        {"set_angular_velocity", robot_set_angular_velocity, METH_VARARGS, "Angular velocity."},
+        {"send_to",              robot_send_to,              METH_VARARGS, "Send message to."},
+        {"send_batch",           robot_send_batch,           METH_VARARGS, "Send messages."},
+        {"send_found",           robot_send_found,           METH_VARARGS, "Report the lost person to the BOO."},
+        {"neighbors",            robot_neighbors,            METH_VARARGS, "Neighbors."},
+        {"pose",                 robot_pose,                 METH_VARARGS, "Robot pose using GPS."},
+        {"imu",                  robot_imu,                  METH_VARARGS, "Robot IMU."},
+        {"bearing",              robot_bearing,              METH_VARARGS, "Robot bearing."},
+        {"search_area",          robot_search_area,          METH_VARARGS, "Search area for GPS."},
+        {"image",                robot_image,                METH_VARARGS, "Logic camera."},
+        {"type",                 robot_type,                 METH_VARARGS, "Vehicle type."},
+        {"host",                 robot_host,                 METH_VARARGS, "Vehicle host."},
+        {"name",                 robot_name,                 METH_VARARGS, "Vehicle name."},
+        {"launch",               robot_launch,               METH_VARARGS, "Launch vehicle."},
+        {"dock",                 robot_dock,                 METH_VARARGS, "Dock vehicle."},
+        {"is_docked",            robot_is_docked,            METH_VARARGS, "Is vehicle docked."},
+        {"boo_pose",             robot_boo_pose,             METH_VARARGS, "BOO pose."},
+        {"terrain_type",         robot_terrain_type,         METH_VARARGS, "Terrain type."},
+        {"lost_person_dir",      robot_lost_person_dir,      METH_VARARGS, "Lost person direction."},
+        {"gzmsg",                robot_gzmsg,                METH_VARARGS, "Print gazebo message."},
+        {"gzerr",                robot_gzerr,                METH_VARARGS, "Print gazebo error."},
+        {"gzlog",                robot_gzlog,                METH_VARARGS, "Gazebo log."},
+        {NULL, NULL, 0, NULL}
+};
+
+// Call a function of the controller, and print its exception, if any.
+static void
+call(PyObject *func, PyObject *args)
+{
+  PyObject *res = PyObject_CallObject(func, args);
+  Py_DECREF(args);
+  if(res == NULL)
+    PyErr_Print();
+  else
+    Py_DECREF(res);
+}
+
+// Get a function of the controller.
+static PyObject *
+get_function(PyObject *module, const char *name)
+{
+  PyObject *func = PyObject_GetAttrString(module, name);
+  if(func == NULL)
+    PyErr_Print();
+  return func;
+}
+
+int
+main(int argc, char **argv)
+{
+  if(argc != 7)
+  {
+    std::cerr << "Usage: " << argv[0] << " <channel> <index> <module> "
+              << "<load> <update> <ondatareceived>" << std::endl;
+    return 1;
+  }
+
+  channel = PythonChannel::Open(argv[1]);
+  if(!channel)
+    return 1;
+  const uint32_t worker = std::atoi(argv[2]);
+  const uint32_t numWorkers = channel->Header().numWorkers;
+
+  Py_Initialize();
+  Py_InitModule("swarm", WorkerMethods);
+
+  PyObject* pName = PyString_FromString(argv[3]);
+  PyObject* pModule = PyImport_Import(pName);
+  Py_DECREF(pName);
+  if(pModule == NULL)
+  {
+    PyErr_Print();
+    return 1;
+  }
+  PyObject *pLoad = get_function(pModule, argv[4]);
+  PyObject *pUpdate = get_function(pModule, argv[5]);
+  PyObject *pOnDataReceived = get_function(pModule, argv[6]);
+  if(pLoad == NULL || pUpdate == NULL || pOnDataReceived == NULL)
+    return 1;
+
+  while(true)
+  {
+    channel->WaitStart(worker);
+    const PythonHeader &header = channel->Header();
+    if(header.stop)
+      break;
+
+    for(uint32_t i = worker; i < header.numRobots && i < kPythonMaxRobots;
+        i += numWorkers)
+    {
+      PythonRobot &robot = channel->Robot(i);
+      if(robot.name[0] == '\0')
+        continue;
+      current = &robot;
+
+      if(!robot.loaded)
+      {
+        call(pLoad, Py_BuildValue("(s)", robot.name));
+        robot.loaded = 1;
+      }
+
+      PythonQueueReader reader(robot.inbox);
+      std::string src, dst, data;
+      uint32_t port;
+      while(reader.Read(src) && reader.Read(dst) && reader.Read(port) &&
+            reader.Read(data))
+      {
+        call(pOnDataReceived, Py_BuildValue("(sssIs)", robot.name,
+             src.c_str(), dst.c_str(), port, data.c_str()));
+      }
+
+      call(pUpdate, Py_BuildValue("(ssdd)", robot.name, header.worldName,
+           header.simTime, header.realTime));
+      current = NULL;
+    }
+    channel->Done(worker);
+  }
+
+  Py_Finalize();
+  return 0;
+}
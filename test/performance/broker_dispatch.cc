@@ -0,0 +1,404 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <gazebo/test/ServerFixture.hh>
+#include <gazebo/physics/physics.hh>
+#include <sdf/sdf.hh>
+#include "swarm/Broker.hh"
+#include "swarm/BrokerPlugin.hh"
+#include "swarm/RobotPlugin.hh"
+#include "test/test_config.h"
+
+/// \brief Number of robots, the first members of the open grid of the
+/// benchmark world, 20 m apart.
+static const unsigned int kRobots = 200;
+
+/// \brief Maximum neighbor and comms distances (m), from a few neighbors
+/// to most of the swarm.
+static const double kDistances[] = {50, 100, 250};
+
+/// \brief Payload sizes (bytes), up to the MTU of RobotPlugin.
+static const size_t kPayloads[] = {16, 256, 1500};
+
+/// \brief Steps simulated before each measure.
+static const int kWarmupSteps = 20;
+
+/// \brief Steps measured for each configuration.
+static const int kSteps = 100;
+
+/// \brief Traffic sent by the robots.
+enum TrafficMix
+{
+  /// \brief No messages, to measure the rest of the step.
+  IDLE,
+
+  /// \brief A message to one neighbor.
+  UNICAST,
+
+  /// \brief A message to the broadcast address.
+  BROADCAST,
+
+  /// \brief A message to the multicast group.
+  MULTICAST,
+
+  /// \brief Each of the above, in turns.
+  MIXED
+};
+
+/// \brief Names of the traffic mixes.
+static const char *kMixNames[] =
+  {"idle", "unicast", "broadcast", "multicast", "mixed"};
+
+/// \brief State shared by the robots.
+struct Traffic
+{
+  /// \brief Messages sent by each robot every step.
+  TrafficMix mix = IDLE;
+
+  /// \brief Payload of the messages.
+  std::string payload;
+
+  /// \brief Number of messages sent.
+  uint64_t sent = 0;
+
+  /// \brief Number of messages received.
+  uint64_t delivered = 0;
+};
+
+/// \brief A robot without sensors that sends one message every step and
+/// counts the messages received, on its address and the multicast group.
+class DispatchClient : public swarm::RobotPlugin
+{
+  /// \brief Constructor.
+  /// \param[in] _traffic Traffic shared by the robots.
+  /// \param[in] _index Index of the robot, to alternate the mixed traffic.
+  public: DispatchClient(Traffic &_traffic, const unsigned int _index)
+    : traffic(_traffic),
+      turn(_index)
+  {
+  }
+
+  // Documentation inherited.
+  protected: virtual void Load(sdf::ElementPtr /*_sdf*/)
+  {
+    this->Bind(&DispatchClient::OnDataReceived, this, this->Host());
+    this->Bind(&DispatchClient::OnDataReceived, this, this->kMulticast);
+  }
+
+  // Documentation inherited.
+  protected: virtual void Update(const gazebo::common::UpdateInfo &/*_info*/)
+  {
+    TrafficMix mix = this->traffic.mix;
+    if (mix == IDLE)
+      return;
+
+    ++this->turn;
+    if (mix == MIXED)
+      mix = static_cast<TrafficMix>(UNICAST + this->turn % 3);
+
+    std::string dst;
+    if (mix == BROADCAST)
+      dst = this->kBroadcast;
+    else if (mix == MULTICAST)
+      dst = this->kMulticast;
+    else
+    {
+      const std::vector<std::string> &neighbors = this->NeighborsView();
+      if (neighbors.empty())
+        return;
+      dst = neighbors[this->turn % neighbors.size()];
+    }
+
+    if (this->SendTo(this->traffic.payload, dst))
+      ++this->traffic.sent;
+  }
+
+  /// \brief Callback executed when a new message is received.
+  /// \param[in] _srcAddress Source address of the message.
+  /// \param[in] _dstAddress Destination address of the message.
+  /// \param[in] _dstPort Destination port.
+  /// \param[in] _data Message payload.
+  private: void OnDataReceived(const std::string &/*_srcAddress*/,
+                               const std::string &/*_dstAddress*/,
+                               const uint32_t /*_dstPort*/,
+                               const std::string &/*_data*/)
+  {
+    ++this->traffic.delivered;
+  }
+
+  /// \brief Traffic shared by the robots.
+  private: Traffic &traffic;
+
+  /// \brief Counter of the messages of this robot.
+  private: unsigned int turn;
+};
+
+/// \brief Results of a configuration.
+struct DispatchResult
+{
+  /// \brief Traffic mix.
+  TrafficMix mix;
+
+  /// \brief Payload size (bytes).
+  size_t payload;
+
+  /// \brief Maximum neighbor and comms distance (m).
+  double distance;
+
+  /// \brief Average number of neighbors.
+  double avgNeighbors;
+
+  /// \brief Messages sent.
+  uint64_t sent;
+
+  /// \brief Messages delivered.
+  uint64_t delivered;
+
+  /// \brief Mean time of a step with the traffic (us).
+  double stepUs;
+
+  /// \brief Mean time of a step without traffic (us).
+  double idleStepUs;
+};
+
+/// \brief Benchmark of the dispatch of the messages by the broker. The
+/// BrokerPlugin and the robots are loaded by the test, on the models of the
+/// benchmark world. The cost of the dispatch is the time of a step with
+/// traffic minus the time of a step without it, which includes the
+/// delivery to the callbacks of the robots. The results are printed and
+/// written as JSON to broker_dispatch_benchmark.json, in the directory
+/// SWARM_BENCHMARK_DIR (the current one by default), with the label in
+/// SWARM_BENCHMARK_LABEL (e.g. the commit) to compare runs.
+class BrokerDispatchBenchmark : public gazebo::ServerFixture
+{
+  public: BrokerDispatchBenchmark()
+  {
+    gazebo::common::SystemPaths::Instance()->AddGazeboPaths(
+      SWARM_PROJECT_TEST_WORLD_PATH);
+    gazebo::common::SystemPaths::Instance()->AddGazeboPaths(
+      SWARM_PROJECT_TEST_SOURCE_PATH);
+  }
+
+  /// \brief SDF of the robots and the broker.
+  /// \param[in] _distance Maximum neighbor and comms distance (m).
+  /// \return The world element.
+  protected: sdf::ElementPtr WorldSDF(const double _distance)
+  {
+    std::ostringstream str;
+    str << "<sdf version='1.5'><world name='broker_dispatch'>"
+        << "<spherical_coordinates>"
+        << "<latitude_deg>35.7753257</latitude_deg>"
+        << "<longitude_deg>-120.774063</longitude_deg>"
+        << "<elevation>208</elevation>"
+        << "<heading_deg>0</heading_deg>"
+        << "</spherical_coordinates>";
+    for (unsigned int i = 0; i < kRobots; ++i)
+    {
+      str << "<model name='open_" << i << "'><link name='link'/>"
+          << "<plugin name='client' filename='__none__'>"
+          << "<type>ground</type>"
+          << "<address>open_" << i << "</address>"
+          << "<controller_update_rate>100</controller_update_rate>"
+          << "<swarm_search_area>"
+          << "<min_relative_latitude_deg>-0.01</min_relative_latitude_deg>"
+          << "<max_relative_latitude_deg>0.01</max_relative_latitude_deg>"
+          << "<min_relative_longitude_deg>-0.01</min_relative_longitude_deg>"
+          << "<max_relative_longitude_deg>0.01</max_relative_longitude_deg>"
+          << "</swarm_search_area>"
+          << "</plugin></model>";
+    }
+    str << "<plugin name='broker' filename='__none__'><comms_model>"
+        << "<neighbor_distance_min>0.0</neighbor_distance_min>"
+        << "<neighbor_distance_max>" << _distance
+        << "</neighbor_distance_max>"
+        << "<neighbor_distance_penalty_tree>200.0"
+        << "</neighbor_distance_penalty_tree>"
+        << "<comms_distance_min>0.0</comms_distance_min>"
+        << "<comms_distance_max>" << _distance << "</comms_distance_max>"
+        << "<comms_distance_penalty_tree>200.0</comms_distance_penalty_tree>"
+        << "<comms_drop_probability_min>0.0</comms_drop_probability_min>"
+        << "<comms_drop_probability_max>0.0</comms_drop_probability_max>"
+        << "<comms_outage_probability>0.0</comms_outage_probability>"
+        << "<comms_outage_duration_min>1.0</comms_outage_duration_min>"
+        << "<comms_outage_duration_max>10.0</comms_outage_duration_max>"
+        << "<comms_data_rate_max>1000000000</comms_data_rate_max>"
+        << "<update_rate>100</update_rate>"
+        << "</comms_model></plugin></world></sdf>";
+
+    sdf::SDFPtr sdfParsed(new sdf::SDF());
+    sdf::init(sdfParsed);
+    EXPECT_TRUE(sdf::readString(str.str(), sdfParsed));
+    // The elements keep a pointer to their parent, but not to the SDF.
+    this->parsed.push_back(sdfParsed);
+    return sdfParsed->Root()->GetElement("world");
+  }
+
+  /// \brief Mean time of the measured steps.
+  /// \param[in] _world The world.
+  /// \return The time (us).
+  protected: double StepTime(gazebo::physics::WorldPtr _world)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    for (int step = 0; step < kSteps; ++step)
+      _world->Step(1);
+    return std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - start).count() / kSteps;
+  }
+
+  /// \brief Write the results as JSON.
+  /// \param[in] _results Results of all the configurations.
+  protected: void Write(const std::vector<DispatchResult> &_results)
+  {
+    const char *dirEnv = std::getenv("SWARM_BENCHMARK_DIR");
+    const char *labelEnv = std::getenv("SWARM_BENCHMARK_LABEL");
+    const std::string filename = std::string(dirEnv ? dirEnv : ".") +
+      "/broker_dispatch_benchmark.json";
+
+    std::ostringstream json;
+    json << "{\n  \"benchmark\": \"broker_dispatch\",\n"
+         << "  \"label\": \"" << (labelEnv ? labelEnv : "") << "\",\n"
+         << "  \"robots\": " << kRobots << ",\n"
+         << "  \"steps\": " << kSteps << ",\n"
+         << "  \"results\": [\n";
+    for (size_t i = 0; i < _results.size(); ++i)
+    {
+      const DispatchResult &r = _results[i];
+      const double dispatchUs = std::max(0.0, r.stepUs - r.idleStepUs);
+      const double msgsPerSec = dispatchUs > 0 ?
+        r.sent / (dispatchUs * kSteps * 1e-6) : 0;
+      const double nsPerDelivery = r.delivered > 0 ?
+        dispatchUs * kSteps * 1e3 / r.delivered : 0;
+      json << "    {\"mix\": \"" << kMixNames[r.mix] << "\", "
+           << "\"payload\": " << r.payload << ", "
+           << "\"distance\": " << r.distance << ", "
+           << "\"avg_neighbors\": " << r.avgNeighbors << ", "
+           << "\"sent\": " << r.sent << ", "
+           << "\"delivered\": " << r.delivered << ", "
+           << "\"step_us\": " << r.stepUs << ", "
+           << "\"idle_step_us\": " << r.idleStepUs << ", "
+           << "\"msgs_per_sec\": " << msgsPerSec << ", "
+           << "\"ns_per_delivery\": " << nsPerDelivery << "}"
+           << (i + 1 < _results.size() ? "," : "") << "\n";
+    }
+    json << "  ]\n}\n";
+
+    std::ofstream out(filename);
+    EXPECT_TRUE(out.good()) << "Unable to write [" << filename << "]";
+    out << json.str();
+    std::cout << "Results written to [" << filename << "]" << std::endl;
+  }
+
+  /// \brief The parsed SDFs, alive while their elements are used.
+  protected: std::vector<sdf::SDFPtr> parsed;
+};
+
+/////////////////////////////////////////////////
+/// \brief Unicast, broadcast, multicast and mixed traffic, with payloads up
+/// to the MTU, for several neighbor densities.
+TEST_F(BrokerDispatchBenchmark, Dispatch)
+{
+  Load("comms_model_benchmark.world", true);
+
+  gazebo::physics::WorldPtr world =
+    gazebo::physics::get_world("comms_model_benchmark");
+  ASSERT_TRUE(world != NULL);
+
+  // The robots are loaded once, and reused by the brokers.
+  Traffic traffic;
+  sdf::ElementPtr robotsSDF = this->WorldSDF(kDistances[0]);
+  std::vector<std::unique_ptr<DispatchClient>> clients;
+  sdf::ElementPtr modelElem = robotsSDF->GetElement("model");
+  for (unsigned int i = 0; i < kRobots && modelElem; ++i)
+  {
+    gazebo::physics::ModelPtr model = world->GetModel(
+        modelElem->GetAttribute("name")->GetAsString());
+    ASSERT_TRUE(model != NULL);
+
+    clients.emplace_back(new DispatchClient(traffic, i));
+    gazebo::ModelPlugin *plugin = clients.back().get();
+    plugin->Load(model, modelElem->GetElement("plugin"));
+    modelElem = modelElem->GetNextElement("model");
+  }
+  ASSERT_EQ(clients.size(), kRobots);
+
+  std::vector<DispatchResult> results;
+  for (const double distance : kDistances)
+  {
+    // Nothing sent for the previous broker is dispatched by this one.
+    swarm::Broker::Instance(world->GetName())->Reset();
+
+    sdf::ElementPtr worldSDF = this->WorldSDF(distance);
+    std::unique_ptr<swarm::BrokerPlugin> broker(new swarm::BrokerPlugin());
+    broker->Load(world, worldSDF->GetElement("plugin"));
+
+    traffic.mix = IDLE;
+    world->Step(kWarmupSteps);
+    const double idleStepUs = this->StepTime(world);
+
+    for (int mix = UNICAST; mix <= MIXED; ++mix)
+    {
+      for (const size_t payload : kPayloads)
+      {
+        traffic.mix = static_cast<TrafficMix>(mix);
+        traffic.payload.assign(payload, 'x');
+
+        // The counters are read around the measured steps only.
+        world->Step(kWarmupSteps);
+        traffic.sent = 0;
+        traffic.delivered = 0;
+        const double stepUs = this->StepTime(world);
+
+        double neighbors = 0;
+        for (auto const &client : clients)
+          neighbors += client->NeighborsView().size();
+
+        DispatchResult result;
+        result.mix = traffic.mix;
+        result.payload = payload;
+        result.distance = distance;
+        result.avgNeighbors = neighbors / clients.size();
+        result.sent = traffic.sent;
+        result.delivered = traffic.delivered;
+        result.stepUs = stepUs;
+        result.idleStepUs = idleStepUs;
+        results.push_back(result);
+
+        std::cout << "Dispatch [" << kMixNames[mix] << "] " << payload
+                  << " bytes, " << result.avgNeighbors << " neighbors: "
+                  << result.sent << " sent, " << result.delivered
+                  << " delivered, step " << stepUs << " us (idle "
+                  << idleStepUs << " us)" << std::endl;
+
+        EXPECT_GT(result.sent, 0u);
+      }
+    }
+
+    traffic.mix = IDLE;
+  }
+
+  this->Write(results);
+}
@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <gazebo/test/ServerFixture.hh>
+#include <gazebo/physics/physics.hh>
+#include <sdf/sdf.hh>
+#include "swarm/CommsModel.hh"
+#include "swarm/SwarmTypes.hh"
+#include "test/test_config.h"
+
+/// \brief Sizes of the synthetic swarms.
+static const unsigned int kSizes[] = {10, 50, 200, 1000};
+
+/// \brief Steps simulated before measuring Update().
+static const int kWarmupSteps = 20;
+
+/// \brief Steps measured for each swarm.
+static const int kSteps = 200;
+
+/// \brief Radius of the circle followed by each member (m).
+static const double kDriftRadius = 5.0;
+
+/// \brief Parameters of the comms model, as in the comms worlds.
+static const char kCommsModelSDF[] =
+  "<sdf version='1.5'>"
+  "  <world name='comms_model'>"
+  "    <plugin name='comms_model' filename='__none__'>"
+  "      <comms_model>"
+  "        <neighbor_distance_min>0.0</neighbor_distance_min>"
+  "        <neighbor_distance_max>250.0</neighbor_distance_max>"
+  "        <neighbor_distance_penalty_tree>200.0"
+  "</neighbor_distance_penalty_tree>"
+  "        <comms_distance_min>0.0</comms_distance_min>"
+  "        <comms_distance_max>250.0</comms_distance_max>"
+  "        <comms_distance_penalty_tree>200.0</comms_distance_penalty_tree>"
+  "        <comms_drop_probability_min>0.0</comms_drop_probability_min>"
+  "        <comms_drop_probability_max>0.1</comms_drop_probability_max>"
+  "        <comms_outage_probability>0.0</comms_outage_probability>"
+  "        <comms_outage_duration_min>1.0</comms_outage_duration_min>"
+  "        <comms_outage_duration_max>10.0</comms_outage_duration_max>"
+  "        <comms_data_rate_max>56800</comms_data_rate_max>"
+  "        <update_rate>100</update_rate>"
+  "      </comms_model>"
+  "    </plugin>"
+  "  </world>"
+  "</sdf>";
+
+/// \brief Results of a swarm.
+struct BenchmarkResult
+{
+  /// \brief "open" or "forest".
+  std::string scene;
+
+  /// \brief Number of members.
+  unsigned int members;
+
+  /// \brief Time of the constructor (ms).
+  double constructionMs;
+
+  /// \brief Percentiles 50, 90 and 99, and maximum of Update() (us).
+  double updateUs[4];
+
+  /// \brief Mean latency of Update() (us).
+  double updateMeanUs;
+
+  /// \brief Resident memory gained by the constructor (kB).
+  long rssDeltaKb;
+
+  /// \brief Average number of neighbors after the last step.
+  double avgNeighbors;
+};
+
+//////////////////////////////////////////////////
+/// \brief Read a field of /proc/self/status.
+/// \param[in] _field Name of the field, e.g. "VmRSS".
+/// \return The value (kB), or 0 if unavailable.
+static long ProcStatus(const std::string &_field)
+{
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line))
+  {
+    if (line.compare(0, _field.size() + 1, _field + ":") == 0)
+      return std::atol(line.c_str() + _field.size() + 1);
+  }
+  return 0;
+}
+
+//////////////////////////////////////////////////
+/// \brief Percentile of sorted samples, nearest rank.
+/// \param[in] _sorted Samples in increasing order.
+/// \param[in] _p Percentile, in [0, 100].
+/// \return The sample.
+static double Percentile(const std::vector<double> &_sorted, const double _p)
+{
+  if (_sorted.empty())
+    return 0;
+  const size_t rank = static_cast<size_t>(
+      std::ceil(_p / 100.0 * _sorted.size()));
+  return _sorted[std::min(_sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+/// \brief Benchmark of the CommsModel on synthetic swarms. The results are
+/// printed and written as JSON to comms_model_benchmark.json, in the
+/// directory SWARM_BENCHMARK_DIR (the current one by default), with the
+/// label in SWARM_BENCHMARK_LABEL (e.g. the commit) to compare runs.
+class CommsModelBenchmark : public gazebo::ServerFixture
+{
+  public: CommsModelBenchmark()
+  {
+    gazebo::common::SystemPaths::Instance()->AddGazeboPaths(
+      SWARM_PROJECT_TEST_WORLD_PATH);
+    gazebo::common::SystemPaths::Instance()->AddGazeboPaths(
+      SWARM_PROJECT_TEST_SOURCE_PATH);
+  }
+
+  /// \brief Measure a swarm.
+  /// \param[in] _world The benchmark world.
+  /// \param[in] _scene Prefix of the members: "open" or "forest".
+  /// \param[in] _size Number of members.
+  /// \return The results.
+  protected: BenchmarkResult Run(gazebo::physics::WorldPtr _world,
+                                 const std::string &_scene,
+                                 const unsigned int _size)
+  {
+    BenchmarkResult result;
+    result.scene = _scene;
+    result.members = _size;
+
+    sdf::SDFPtr sdfParsed(new sdf::SDF());
+    sdf::init(sdfParsed);
+    EXPECT_TRUE(sdf::readString(kCommsModelSDF, sdfParsed));
+    sdf::ElementPtr commsSDF =
+      sdfParsed->Root()->GetElement("world")->GetElement("plugin");
+
+    swarm::SwarmMembershipPtr swarm =
+      std::make_shared<swarm::SwarmMembership_M>();
+    std::vector<gazebo::physics::ModelPtr> models;
+    std::vector<ignition::math::Vector3d> origins;
+    for (unsigned int i = 0; i < _size; ++i)
+    {
+      const std::string name = _scene + "_" + std::to_string(i);
+      gazebo::physics::ModelPtr model = _world->GetModel(name);
+      EXPECT_TRUE(model != NULL) << name;
+      if (!model)
+        return result;
+
+      auto member = std::make_shared<swarm::SwarmMember>();
+      member->address = name;
+      member->name = name;
+      member->model = model;
+      (*swarm)[name] = member;
+      models.push_back(model);
+      origins.push_back(model->GetWorldPose().Ign().Pos());
+    }
+
+    const long rss = ProcStatus("VmRSS");
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<swarm::CommsModel> commsModel(
+        new swarm::CommsModel(swarm, _world, commsSDF));
+    result.constructionMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    result.rssDeltaKb = ProcStatus("VmRSS") - rss;
+
+    // The members follow circles, with different phases, so the broadphase
+    // and the visibility see moving robots.
+    std::vector<double> samples;
+    samples.reserve(kSteps);
+    for (int step = 0; step < kWarmupSteps + kSteps; ++step)
+    {
+      const double t = _world->GetSimTime().Double();
+      for (size_t i = 0; i < models.size(); ++i)
+      {
+        const double angle = t + i * 0.1;
+        models[i]->SetWorldPose(gazebo::math::Pose(
+            origins[i].X() + kDriftRadius * std::cos(angle),
+            origins[i].Y() + kDriftRadius * std::sin(angle),
+            origins[i].Z(), 0, 0, 0));
+      }
+      _world->Step(1);
+
+      start = std::chrono::steady_clock::now();
+      commsModel->Update();
+      const double elapsed = std::chrono::duration<double, std::micro>(
+          std::chrono::steady_clock::now() - start).count();
+      if (step >= kWarmupSteps)
+        samples.push_back(elapsed);
+    }
+
+    std::sort(samples.begin(), samples.end());
+    result.updateUs[0] = Percentile(samples, 50);
+    result.updateUs[1] = Percentile(samples, 90);
+    result.updateUs[2] = Percentile(samples, 99);
+    result.updateUs[3] = samples.empty() ? 0 : samples.back();
+    double sum = 0;
+    for (double sample : samples)
+      sum += sample;
+    result.updateMeanUs = samples.empty() ? 0 : sum / samples.size();
+    result.avgNeighbors = commsModel->AvgNeighbors();
+
+    std::cout << "CommsModel [" << _scene << "] " << _size << " members: "
+              << "construction " << result.constructionMs << " ms, "
+              << "update p50 " << result.updateUs[0] << " us, p99 "
+              << result.updateUs[2] << " us, memory " << result.rssDeltaKb
+              << " kB, " << result.avgNeighbors << " neighbors" << std::endl;
+    return result;
+  }
+
+  /// \brief Write the results as JSON.
+  /// \param[in] _results Results of all the swarms.
+  protected: void Write(const std::vector<BenchmarkResult> &_results)
+  {
+    const char *dirEnv = std::getenv("SWARM_BENCHMARK_DIR");
+    const char *labelEnv = std::getenv("SWARM_BENCHMARK_LABEL");
+    const std::string filename = std::string(dirEnv ? dirEnv : ".") +
+      "/comms_model_benchmark.json";
+
+    std::ostringstream json;
+    json << "{\n  \"benchmark\": \"comms_model\",\n"
+         << "  \"label\": \"" << (labelEnv ? labelEnv : "") << "\",\n"
+         << "  \"steps\": " << kSteps << ",\n"
+         << "  \"peak_rss_kb\": " << ProcStatus("VmHWM") << ",\n"
+         << "  \"results\": [\n";
+    for (size_t i = 0; i < _results.size(); ++i)
+    {
+      const BenchmarkResult &r = _results[i];
+      json << "    {\"scene\": \"" << r.scene << "\", "
+           << "\"members\": " << r.members << ", "
+           << "\"construction_ms\": " << r.constructionMs << ", "
+           << "\"update_p50_us\": " << r.updateUs[0] << ", "
+           << "\"update_p90_us\": " << r.updateUs[1] << ", "
+           << "\"update_p99_us\": " << r.updateUs[2] << ", "
+           << "\"update_max_us\": " << r.updateUs[3] << ", "
+           << "\"update_mean_us\": " << r.updateMeanUs << ", "
+           << "\"rss_delta_kb\": " << r.rssDeltaKb << ", "
+           << "\"avg_neighbors\": " << r.avgNeighbors << "}"
+           << (i + 1 < _results.size() ? "," : "") << "\n";
+    }
+    json << "  ]\n}\n";
+
+    std::ofstream out(filename);
+    EXPECT_TRUE(out.good()) << "Unable to write [" << filename << "]";
+    out << json.str();
+    std::cout << "Results written to [" << filename << "]" << std::endl;
+  }
+};
+
+/////////////////////////////////////////////////
+/// \brief Swarms of 10, 50, 200 and 1000 members, without obstacles and
+/// among trees and buildings.
+TEST_F(CommsModelBenchmark, Scaling)
+{
+  Load("comms_model_benchmark.world", true);
+
+  gazebo::physics::WorldPtr world =
+    gazebo::physics::get_world("comms_model_benchmark");
+  ASSERT_TRUE(world != NULL);
+
+  std::vector<BenchmarkResult> results;
+  for (const std::string scene : {"open", "forest"})
+  {
+    for (unsigned int size : kSizes)
+    {
+      results.push_back(this->Run(world, scene, size));
+      EXPECT_GE(results.back().avgNeighbors, 0.0);
+    }
+  }
+
+  this->Write(results);
+}
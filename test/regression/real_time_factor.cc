@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <gazebo/test/ServerFixture.hh>
+#include <gazebo/physics/physics.hh>
+#include "swarm/StepTimers.hh"
+#include "test/test_config.h"
+
+/// \brief Iterations simulated before measuring.
+static const int kWarmupIterations = 100;
+
+/// \brief Iterations measured in each world.
+static const int kIterations = 1000;
+
+/// \brief Default tolerance over the baseline, as a fraction.
+static const double kDefaultTolerance = 0.25;
+
+/// \brief Subsystems faster than this in the baseline are too noisy to be
+/// checked (us per step).
+static const double kMinCheckedUs = 5.0;
+
+/// \brief Name of each StepTimer in the baseline.
+static const char *kTimerNames[swarm::TIMER_COUNT] =
+{
+  "comms_model", "notify_neighbors", "dispatch", "delivery", "logger",
+  "poses", "sensors", "controllers", "actuation"
+};
+
+/// \brief Metrics of a world, by name.
+using Metrics = std::map<std::string, double>;
+
+//////////////////////////////////////////////////
+/// \brief Path to the baseline: SWARM_REGRESSION_BASELINE or the one in
+/// the source tree.
+/// \return The path.
+static std::string BaselinePath()
+{
+  const char *baselineEnv = std::getenv("SWARM_REGRESSION_BASELINE");
+  if (baselineEnv)
+    return baselineEnv;
+  return std::string(SWARM_PROJECT_TEST_SOURCE_PATH) +
+    "/regression/real_time_factor_baseline.txt";
+}
+
+//////////////////////////////////////////////////
+/// \brief Read the baseline.
+/// \param[in] _path Path to the baseline.
+/// \param[out] _comments Comment lines at the top, kept when recording.
+/// \return Metrics of each world, by world.
+static std::map<std::string, Metrics> ReadBaseline(const std::string &_path,
+    std::vector<std::string> &_comments)
+{
+  std::map<std::string, Metrics> baseline;
+  std::ifstream input(_path);
+  std::string line;
+  while (std::getline(input, line))
+  {
+    if (line.empty() || line[0] == '#')
+    {
+      if (baseline.empty())
+        _comments.push_back(line);
+      continue;
+    }
+
+    std::istringstream fields(line);
+    std::string world;
+    std::string metric;
+    double value;
+    if (fields >> world >> metric >> value)
+      baseline[world][metric] = value;
+    else
+      std::cerr << "Ignoring line [" << line << "] of [" << _path << "]\n";
+  }
+  return baseline;
+}
+
+/// \brief Simulates the reference worlds headless, with the controller of
+/// regression_controller_plugin.cc, and compares the wall-clock time per
+/// simulated second and the StepTimers of each subsystem to the baseline.
+/// A metric fails when it exceeds its baseline by more than
+/// SWARM_REGRESSION_TOLERANCE (a fraction, 0.25 by default). With
+/// SWARM_REGRESSION_RECORD=1 the results replace the baseline instead.
+class RealTimeFactorTest : public gazebo::ServerFixture
+{
+  public: RealTimeFactorTest()
+  {
+    // The timers are read when the broker is loaded, and the log would
+    // collect them first.
+    setenv("SWARM_STEP_TIMERS", "1", 1);
+    unsetenv("SWARM_LOG");
+
+    gazebo::common::SystemPaths::Instance()->AddPluginPaths(
+      SWARM_PROJECT_TEST_REGRESSION_PATH);
+    gazebo::common::SystemPaths::Instance()->AddGazeboPaths(
+      SWARM_PROJECT_TEST_REGRESSION_PATH);
+    gazebo::common::SystemPaths::Instance()->AddGazeboPaths(
+      SWARM_PROJECT_TEST_SOURCE_PATH);
+  }
+
+  /// \brief Simulate a reference world.
+  /// \param[in] _name Name of the reference world, e.g. "ground_simple_36".
+  /// \return The metrics.
+  protected: Metrics Measure(const std::string &_name)
+  {
+    Metrics metrics;
+    this->Load("regression_" + _name + ".world", true);
+    gazebo::physics::WorldPtr world = gazebo::physics::get_world("default");
+    EXPECT_TRUE(world != NULL);
+    if (!world)
+      return metrics;
+
+    swarm::StepTimers *timers = swarm::StepTimers::Instance("default");
+    EXPECT_TRUE(timers->Enabled());
+
+    world->Step(kWarmupIterations);
+    uint64_t ns[swarm::TIMER_COUNT];
+    timers->Collect(ns);
+
+    const double simStart = world->GetSimTime().Double();
+    const auto start = std::chrono::steady_clock::now();
+    world->Step(kIterations);
+    const double wall = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    const double sim = world->GetSimTime().Double() - simStart;
+
+    const uint32_t steps = timers->Collect(ns);
+    EXPECT_GT(sim, 0.0);
+    EXPECT_GT(steps, 0u);
+    metrics["wall_per_sim_second"] = sim > 0 ? wall / sim : 0;
+    for (int i = 0; i < swarm::TIMER_COUNT; ++i)
+    {
+      metrics[std::string(kTimerNames[i]) + "_us_per_step"] =
+        steps > 0 ? ns[i] * 1e-3 / steps : 0;
+    }
+
+    std::cout << "Regression [" << _name << "]:";
+    for (const auto &metric : metrics)
+      std::cout << " " << metric.first << " " << metric.second;
+    std::cout << std::endl;
+    return metrics;
+  }
+
+  /// \brief Compare the metrics of a world to the baseline, or record them.
+  /// \param[in] _name Name of the reference world.
+  /// \param[in] _metrics Metrics measured.
+  protected: void Check(const std::string &_name, const Metrics &_metrics)
+  {
+    const std::string path = BaselinePath();
+    std::vector<std::string> comments;
+    std::map<std::string, Metrics> baseline = ReadBaseline(path, comments);
+
+    const char *recordEnv = std::getenv("SWARM_REGRESSION_RECORD");
+    if (recordEnv && std::string(recordEnv) == "1")
+    {
+      baseline[_name] = _metrics;
+      std::ofstream output(path);
+      EXPECT_TRUE(output.good()) << "Unable to write [" << path << "]";
+      for (const std::string &comment : comments)
+        output << comment << "\n";
+      for (const auto &world : baseline)
+      {
+        for (const auto &metric : world.second)
+        {
+          output << world.first << " " << metric.first << " "
+                 << metric.second << "\n";
+        }
+      }
+      std::cout << "Baseline of [" << _name << "] recorded in [" << path
+                << "]" << std::endl;
+      return;
+    }
+
+    double tolerance = kDefaultTolerance;
+    const char *toleranceEnv = std::getenv("SWARM_REGRESSION_TOLERANCE");
+    if (toleranceEnv)
+      tolerance = std::atof(toleranceEnv);
+
+    const Metrics &expected = baseline[_name];
+    if (expected.empty())
+    {
+      std::cout << "No baseline for [" << _name << "] in [" << path << "]"
+                << std::endl;
+    }
+    for (const auto &metric : expected)
+    {
+      auto measured = _metrics.find(metric.first);
+      if (measured == _metrics.end())
+        continue;
+      if (metric.first != "wall_per_sim_second" &&
+          metric.second < kMinCheckedUs)
+      {
+        continue;
+      }
+
+      EXPECT_LE(measured->second, metric.second * (1.0 + tolerance))
+        << _name << " " << metric.first << " regressed from "
+        << metric.second << " (tolerance " << tolerance * 100 << "%)";
+    }
+  }
+};
+
+/////////////////////////////////////////////////
+/// \brief 36 ground vehicles on the random heightmap.
+TEST_F(RealTimeFactorTest, GroundSimple36)
+{
+  const Metrics metrics = this->Measure("ground_simple_36");
+  this->Check("ground_simple_36", metrics);
+}
+
+/////////////////////////////////////////////////
+/// \brief 36 rotorcraft on the random heightmap.
+TEST_F(RealTimeFactorTest, RotorSimple36)
+{
+  const Metrics metrics = this->Measure("rotor_simple_36");
+  this->Check("rotor_simple_36", metrics);
+}
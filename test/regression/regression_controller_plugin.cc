@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <vector>
+#include "regression_controller_plugin.hh"
+
+using namespace swarm;
+
+GZ_REGISTER_MODEL_PLUGIN(RegressionControllerPlugin)
+
+/// \brief Size of the payload of the messages (bytes).
+static const size_t kPayloadSize = 64;
+
+//////////////////////////////////////////////////
+RegressionControllerPlugin::RegressionControllerPlugin()
+: RobotPlugin()
+{
+}
+
+//////////////////////////////////////////////////
+void RegressionControllerPlugin::Load(sdf::ElementPtr /*_sdf*/)
+{
+  this->Bind(&RegressionControllerPlugin::OnDataReceived, this,
+      this->Host());
+}
+
+//////////////////////////////////////////////////
+void RegressionControllerPlugin::Update(
+    const gazebo::common::UpdateInfo & /*_info*/)
+{
+  ImageData img;
+  this->Image(img);
+
+  double latitude, longitude, altitude;
+  this->Pose(latitude, longitude, altitude);
+
+  // Every vehicle follows a wide circle, the aerial ones a bit higher.
+  this->SetLinearVelocity(1.0, 0, this->Type() == GROUND ? 0 : 0.1);
+  this->SetAngularVelocity(0, 0, 0.05);
+
+  const std::string data(kPayloadSize, 'x');
+  this->SendTo(data, this->kBroadcast);
+
+  const std::vector<std::string> neighbors = this->Neighbors();
+  if (!neighbors.empty())
+    this->SendTo(data, neighbors[this->iterations % neighbors.size()]);
+
+  ++this->iterations;
+}
+
+//////////////////////////////////////////////////
+void RegressionControllerPlugin::OnDataReceived(
+    const std::string &/*_srcAddress*/, const std::string &/*_dstAddress*/,
+    const uint32_t /*_dstPort*/, const std::string &/*_data*/)
+{
+  ++this->numReceived;
+}
@@ -0,0 +1,23 @@
+#!/bin/bash
+# Generate a synthetic world for scale testing from worlds/master.erb.
+#
+# Usage: gen_scale_world.sh <ground> <rotor> <fixed> [terrain] [vegetation]
+#                           [controller] > scale.world
+#   terrain:    flat, random or camp_roberts (flat).
+#   vegetation: none, low, med or high (none).
+#   controller: plugin of the vehicles (libNoOpControllerPlugin.so).
+# Set erb_buildings=1 to add the buildings of the terrain.
+if [ $# -lt 3 ]; then
+  sed -n '4,9p' "$0" >&2
+  exit 1
+fi
+
+cd "$(dirname "$0")/../worlds" || exit 1
+erb_gazebo_world_file=scale.world \
+erb_ground_count=$1 \
+erb_rotor_count=$2 \
+erb_fixed_count=$3 \
+erb_terrain=${4:-flat} \
+erb_vegetation=${5:-none} \
+erb_controller=${6:-libNoOpControllerPlugin.so} \
+  erb master.erb
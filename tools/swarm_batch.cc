@@ -0,0 +1,428 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+#include <gazebo/gazebo.hh>
+#include <gazebo/physics/physics.hh>
+#include <gazebo/util/LogRecord.hh>
+#include <ignition/math/Rand.hh>
+#include <sdf/sdf.hh>
+#include "swarm/Logger.hh"
+
+namespace po = boost::program_options;
+
+/// \brief Options of a batch.
+struct BatchOptions
+{
+  /// \brief World file.
+  std::string world;
+
+  /// \brief Number of runs.
+  unsigned int runs;
+
+  /// \brief Seed of the first run. Run k uses seed + k.
+  unsigned int seed;
+
+  /// \brief Identifier of the first run, used in the log paths.
+  unsigned int firstId;
+
+  /// \brief Simulation time of each run (s).
+  double duration;
+
+  /// \brief Directory of the logs.
+  std::string logDir;
+
+  /// \brief Whether to record the Gazebo state of each run.
+  bool record;
+
+  /// \brief Simulation time of the warm-up from which the runs are forked
+  /// (s), negative to run them from the start.
+  double forkAt;
+};
+
+//////////////////////////////////////////////////
+void usage()
+{
+  std::cerr << "Run a batch of experiments over a world loaded only once.\n\n"
+            << " swarm_batch [options] <world file>\n\n"
+            << "Options:\n"
+            << " -h, --help               Show this help message.\n"
+            << " -n, --runs <n>           Number of runs (1 by default).\n"
+            << " -s, --seed <n>           Seed of the first run, the run k"
+            <<                            " uses seed + k.\n"
+            << "                          Random by default.\n"
+            << " -j, --jobs <n>           Number of Gazebo processes running"
+            <<                            " replicas of\n"
+            << "                          the world concurrently (1 by"
+            <<                            " default).\n"
+            << " -d, --duration <t>       Simulation time of each run (s)."
+            <<                            " Defaults to the\n"
+            << "                          <max_time_allowed> of the world.\n"
+            << " -l, --log-dir <dir>      Directory of the logs (current"
+            <<                            " directory by\n"
+            << "                          default).\n"
+            << "     --first-id <n>       Identifier of the first run"
+            <<                            " (0 by default).\n"
+            << "     --record             Record the Gazebo state of each"
+            <<                            " run.\n"
+            << "     --fork-at <t>        Run the world once until t (s), and"
+            <<                            " fork a replica\n"
+            << "                          for each run from there.\n\n"
+            << "Between runs the world is reset instead of reloaded: the"
+            << " vehicles and the\n"
+            << "lost person go back to their initial poses, and the broker,"
+            << " the comms model\n"
+            << "and the logger restart with the seed of the run. The log of"
+            << " the run <id> is\n"
+            << "written to <dir>/swarm/<id>, and its recording to"
+            << " <dir>/gazebo/<id>.\n"
+            << "Each job uses its own GAZEBO_MASTER_URI, from port 11346"
+            << " on.\n\n"
+            << "With --fork-at, the runs share the memory of the warm world"
+            << " copy-on-write.\n"
+            << "The warm-up is logged to <dir>/swarm/warmup, and each run"
+            << " continues with its\n"
+            << "seed, its log and the overrides of the <replicas> element"
+            << " of the broker.\n"
+            << "The replicas run concurrently, --jobs is ignored."
+            << std::endl;
+}
+
+//////////////////////////////////////////////////
+/// \brief Read the <max_time_allowed> of the <log_info> of a world
+/// plugin.
+/// \param[in] _world World file.
+/// \param[out] _time The time allowed (s).
+/// \return True if the world has a time allowed.
+bool maxTimeAllowed(const std::string &_world, double &_time)
+{
+  sdf::SDFPtr sdfParsed(new sdf::SDF());
+  sdf::init(sdfParsed);
+  if (!sdf::readFile(_world, sdfParsed) ||
+      !sdfParsed->Root()->HasElement("world"))
+  {
+    return false;
+  }
+
+  sdf::ElementPtr worldSDF = sdfParsed->Root()->GetElement("world");
+  if (!worldSDF->HasElement("plugin"))
+    return false;
+
+  for (sdf::ElementPtr plugin = worldSDF->GetElement("plugin"); plugin;
+       plugin = plugin->GetNextElement("plugin"))
+  {
+    if (plugin->HasElement("log_info") &&
+        plugin->GetElement("log_info")->HasElement("max_time_allowed"))
+    {
+      _time = plugin->GetElement("log_info")->Get<double>("max_time_allowed");
+      return true;
+    }
+  }
+  return false;
+}
+
+//////////////////////////////////////////////////
+/// \brief Run the runs of a job over a single copy of the world.
+/// \param[in] _options Options of the batch.
+/// \param[in] _job Index of the job.
+/// \param[in] _jobs Number of jobs. The job runs _job, _job + _jobs, ...
+/// \return Exit status of the job.
+int runJob(const BatchOptions &_options, const unsigned int _job,
+    const unsigned int _jobs)
+{
+  const std::string port = std::to_string(11346 + _job);
+  setenv("GAZEBO_MASTER_URI", ("http://localhost:" + port).c_str(), 1);
+  setenv("SWARM_BATCH", "1", 1);
+  setenv("SWARM_LOG", "1", 0);
+  setenv("SWARM_LOG_MIN", "1", 0);
+
+  const std::string firstId = std::to_string(_options.firstId + _job);
+  setenv("SWARM_LOG_PATH",
+      (_options.logDir + "/swarm/" + firstId).c_str(), 1);
+  ignition::math::Rand::Seed(_options.seed + _job);
+
+  if (!gazebo::setupServer())
+  {
+    std::cerr << "Job " << _job << ": Unable to start Gazebo" << std::endl;
+    return -1;
+  }
+
+  gazebo::physics::WorldPtr world = gazebo::loadWorld(_options.world);
+  if (!world)
+  {
+    std::cerr << "Job " << _job << ": Unable to load the world ["
+              << _options.world << "]" << std::endl;
+    gazebo::shutdown();
+    return -1;
+  }
+  world->SetPaused(false);
+
+  const double stepSize = world->GetPhysicsEngine()->GetMaxStepSize();
+  const uint64_t iterations =
+    static_cast<uint64_t>(_options.duration / stepSize + 0.5);
+
+  // Run in chunks, so a world stopped because the lost person was found
+  // is noticed early.
+  const uint64_t chunk = 1000;
+
+  for (unsigned int run = _job; run < _options.runs; run += _jobs)
+  {
+    const std::string id = std::to_string(_options.firstId + run);
+    const unsigned int seed = _options.seed + run;
+    if (run != _job)
+    {
+      // The broker creates the log of the new run in its Reset().
+      setenv("SWARM_LOG_PATH",
+          (_options.logDir + "/swarm/" + id).c_str(), 1);
+      ignition::math::Rand::Seed(seed);
+      world->Reset();
+    }
+
+    if (_options.record)
+    {
+      gazebo::util::LogRecord::Instance()->Start("zlib",
+          _options.logDir + "/gazebo/" + id);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t done = 0;
+    bool stopped = false;
+    while (done < iterations && !stopped)
+    {
+      // The world counts the iterations of each call to runWorld().
+      const uint64_t n = std::min(chunk, iterations - done);
+      gazebo::runWorld(world, static_cast<unsigned int>(n));
+      const uint64_t ran = world->GetIterations();
+      done += ran;
+      stopped = ran < n;
+    }
+    std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+    if (_options.record)
+      gazebo::util::LogRecord::Instance()->Stop();
+
+    std::cout << "Run " << id << ": seed " << seed << ", "
+              << (stopped ? "stopped" : "time limit") << " at "
+              << world->GetSimTime().Double() << " s, "
+              << elapsed.count() << " s of wall time" << std::endl;
+  }
+
+  gazebo::shutdown();
+  return 0;
+}
+
+//////////////////////////////////////////////////
+/// \brief Run the world until the warm-up time, where the broker forks a
+/// replica for each run. The replicas return from runWorld() in their own
+/// process and run until the end.
+/// \param[in] _options Options of the batch.
+/// \return Exit status of the process, parent or replica.
+int runReplicas(const BatchOptions &_options)
+{
+  setenv("GAZEBO_MASTER_URI", "http://localhost:11346", 1);
+  setenv("SWARM_BATCH", "1", 1);
+  setenv("SWARM_LOG", "1", 0);
+  setenv("SWARM_LOG_MIN", "1", 0);
+  setenv("SWARM_LOG_PATH", (_options.logDir + "/swarm/warmup").c_str(), 1);
+  setenv("SWARM_REPLICAS", std::to_string(_options.runs).c_str(), 1);
+  setenv("SWARM_REPLICA_TIME", std::to_string(_options.forkAt).c_str(), 1);
+  setenv("SWARM_REPLICA_SEED", std::to_string(_options.seed).c_str(), 1);
+  setenv("SWARM_REPLICA_LOG_PATH", (_options.logDir + "/swarm").c_str(), 1);
+  setenv("SWARM_REPLICA_FIRST_ID",
+      std::to_string(_options.firstId).c_str(), 1);
+  ignition::math::Rand::Seed(_options.seed);
+
+  if (!gazebo::setupServer())
+  {
+    std::cerr << "Unable to start Gazebo" << std::endl;
+    return -1;
+  }
+
+  gazebo::physics::WorldPtr world = gazebo::loadWorld(_options.world);
+  if (!world)
+  {
+    std::cerr << "Unable to load the world [" << _options.world << "]"
+              << std::endl;
+    gazebo::shutdown();
+    return -1;
+  }
+  world->SetPaused(false);
+
+  const double stepSize = world->GetPhysicsEngine()->GetMaxStepSize();
+  const uint64_t iterations =
+    static_cast<uint64_t>(_options.duration / stepSize + 0.5);
+  const uint64_t chunk = 1000;
+
+  auto start = std::chrono::steady_clock::now();
+  uint64_t done = 0;
+  bool stopped = false;
+  while (done < iterations && !stopped)
+  {
+    const uint64_t n = std::min(chunk, iterations - done);
+    gazebo::runWorld(world, static_cast<unsigned int>(n));
+    const uint64_t ran = world->GetIterations();
+    done += ran;
+    stopped = ran < n;
+  }
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+
+  // A replica has no other thread of Gazebo to shut down, so it only
+  // closes its log.
+  const char *replicaEnv = std::getenv("SWARM_REPLICA");
+  if (replicaEnv)
+  {
+    const unsigned int replica = std::strtoul(replicaEnv, nullptr, 10);
+    swarm::Logger::Instance(world->GetName())->Close();
+    std::cout << "Run " << _options.firstId + replica << ": seed "
+              << _options.seed + replica << ", "
+              << (stopped ? "stopped" : "time limit") << " at "
+              << world->GetSimTime().Double() << " s, "
+              << elapsed.count() << " s of wall time" << std::endl;
+    std::cout.flush();
+    _exit(0);
+  }
+
+  if (world->GetSimTime().Double() < _options.forkAt)
+  {
+    std::cerr << "The world stopped at " << world->GetSimTime().Double()
+              << " s, before the replicas were forked" << std::endl;
+    gazebo::shutdown();
+    return -1;
+  }
+
+  gazebo::shutdown();
+  return 0;
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  po::options_description desc("Options");
+  desc.add_options()
+    ("help,h", "Show this help message.")
+    ("runs,n", po::value<unsigned int>()->default_value(1), "Number of runs.")
+    ("seed,s", po::value<unsigned int>(), "Seed of the first run.")
+    ("jobs,j", po::value<unsigned int>()->default_value(1),
+     "Number of concurrent Gazebo processes.")
+    ("duration,d", po::value<double>(), "Simulation time of each run.")
+    ("log-dir,l", po::value<std::string>()->default_value("."),
+     "Directory of the logs.")
+    ("first-id", po::value<unsigned int>()->default_value(0),
+     "Identifier of the first run.")
+    ("record", "Record the Gazebo state of each run.")
+    ("fork-at", po::value<double>(),
+     "Fork the runs from a warm-up of this simulation time.")
+    ("world", po::value<std::string>(), "World file.");
+
+  po::positional_options_description positional;
+  positional.add("world", 1);
+
+  po::variables_map vm;
+  try
+  {
+    po::store(po::command_line_parser(argc, argv).options(desc)
+        .positional(positional).run(), vm);
+    po::notify(vm);
+  }
+  catch(const po::error &_e)
+  {
+    std::cerr << _e.what() << std::endl;
+    usage();
+    return -1;
+  }
+
+  if (vm.count("help") || !vm.count("world") ||
+      vm["jobs"].as<unsigned int>() < 1)
+  {
+    usage();
+    return vm.count("help") ? 0 : -1;
+  }
+
+  BatchOptions options;
+  options.world = vm["world"].as<std::string>();
+  options.runs = vm["runs"].as<unsigned int>();
+  options.seed = vm.count("seed") ? vm["seed"].as<unsigned int>() :
+    std::random_device()();
+  options.firstId = vm["first-id"].as<unsigned int>();
+  options.logDir = vm["log-dir"].as<std::string>();
+  options.record = vm.count("record") > 0;
+  options.forkAt = vm.count("fork-at") ? vm["fork-at"].as<double>() : -1;
+
+  if (vm.count("duration"))
+    options.duration = vm["duration"].as<double>();
+  else if (!maxTimeAllowed(options.world, options.duration))
+  {
+    std::cerr << "The world [" << options.world << "] has no "
+              << "<max_time_allowed>, use --duration" << std::endl;
+    return -1;
+  }
+
+  if (options.forkAt >= 0)
+  {
+    if (options.forkAt >= options.duration || options.record)
+    {
+      std::cerr << "--fork-at must be lower than the duration, and can't "
+                << "be recorded" << std::endl;
+      return -1;
+    }
+    return runReplicas(options);
+  }
+
+  const unsigned int jobs =
+    std::min(vm["jobs"].as<unsigned int>(), std::max(options.runs, 1u));
+  if (jobs == 1)
+    return runJob(options, 0, 1);
+
+  // Gazebo keeps its state per process, so each replica of the world runs
+  // in its own one.
+  std::vector<pid_t> pids;
+  for (unsigned int job = 0; job < jobs; ++job)
+  {
+    const pid_t pid = fork();
+    if (pid < 0)
+    {
+      std::cerr << "Unable to start job " << job << std::endl;
+      break;
+    }
+    if (pid == 0)
+      _exit(runJob(options, job, jobs) == 0 ? 0 : 1);
+    pids.push_back(pid);
+  }
+
+  int result = pids.size() == jobs ? 0 : -1;
+  for (const pid_t pid : pids)
+  {
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0)
+    {
+      result = -1;
+    }
+  }
+  return result;
+}
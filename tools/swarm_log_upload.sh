@@ -5,10 +5,14 @@ if [ -z "$1" ]; then
   echo "Error: No team name specified"
   echo
   echo "Usage:"
-  echo "    swarm_log_upload.sh <team_name>"
+  echo "    swarm_log_upload.sh <team_name> [--watch]"
   echo
   echo "where <team_name> is one of: byu,gatech,nps,upenn"
   echo
+  echo "With --watch, the chunks of a rotated log (SWARM_LOG_ROTATE_SIZE or"
+  echo "SWARM_LOG_ROTATE_TIME) are uploaded while the run goes on, as soon"
+  echo "as they are complete."
+  echo
   echo "Example:"
   echo "    swarm_log_upload.sh gatech"
   exit 0
@@ -21,6 +25,20 @@ if [ -z "$full_swarm_log" ]; then
   exit 0
 fi
 
+# Upload the complete chunks of the running log every minute. The newest
+# chunk is still being written, so it's left for the final upload.
+if [ "$2" = "--watch" ]; then
+  swarm_timestamp=`basename $full_swarm_log`
+  echo "Uploading the chunks of $full_swarm_log, press Ctrl+C to stop"
+  while true; do
+    chunks=`ls -tr $full_swarm_log/swarm*.log 2>/dev/null | head -n -1`
+    for chunk in $chunks; do
+      s3cmd sync $chunk s3://osrf-swarm/$1/$swarm_timestamp/
+    done
+    sleep 60
+  done
+fi
+
 # Get the most recent gazebo log directory
 full_gazebo_log=`ls -dt ~/.gazebo/log/* 2>/dev/null | head -1`
 if [ -z "$full_gazebo_log" ]; then
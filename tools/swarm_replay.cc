@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <boost/program_options.hpp>
+#include <gazebo/gazebo.hh>
+#include <gazebo/physics/physics.hh>
+#include <ignition/math/Rand.hh>
+#include "msgs/log_header.pb.h"
+#include "swarm/Helpers.hh"
+#include "swarm/LogParser.hh"
+#include "swarm/ReplayLog.hh"
+
+namespace po = boost::program_options;
+
+//////////////////////////////////////////////////
+void usage()
+{
+  std::cerr << "Replay the controllers of a swarm from a log, without the"
+            << " physics nor the\ncomms model.\n\n"
+            << " swarm_replay [options] <world file> <swarm.log>\n\n"
+            << "Options:\n"
+            << " -h, --help               Show this help message.\n"
+            << " -s, --seed <n>           Seed of the world. Defaults to the"
+            <<                            " seed of the log.\n\n"
+            << "The log is written with SWARM_LOG=1, SWARM_ROBOT_LOG=1 and"
+            << " SWARM_LOG_REPLAY=1,\nwithout rotation, and the robots"
+            << " are logged every step. Each controller of\nthe world gets"
+            << " the observations, neighbors and messages logged for each"
+            << " of its\nsteps, and its velocities and messages are"
+            << " compared with the log. The world\nruns until the last"
+            << " step logged, as fast as it can. The exit status is 0 if"
+            << "\nevery step matches."
+            << std::endl;
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  po::options_description desc("Options");
+  desc.add_options()
+    ("help,h", "Show this help message.")
+    ("seed,s", po::value<unsigned int>(), "Seed of the world.")
+    ("world", po::value<std::string>(), "World file.")
+    ("log", po::value<std::string>(), "Log file.");
+
+  po::positional_options_description positional;
+  positional.add("world", 1);
+  positional.add("log", 1);
+
+  po::variables_map vm;
+  try
+  {
+    po::store(po::command_line_parser(argc, argv).options(desc)
+        .positional(positional).run(), vm);
+    po::notify(vm);
+  }
+  catch(const po::error &_e)
+  {
+    std::cerr << _e.what() << std::endl;
+    usage();
+    return -1;
+  }
+
+  if (vm.count("help") || !vm.count("world") || !vm.count("log"))
+  {
+    usage();
+    return vm.count("help") ? 0 : -1;
+  }
+
+  const std::string worldFile = vm["world"].as<std::string>();
+  const std::string logFile = vm["log"].as<std::string>();
+
+  // The world is loaded with the seed of the logged run.
+  swarm::LogParser parser;
+  swarm::msgs::LogHeader header;
+  if (!parser.Load(logFile) || !parser.Header(header))
+  {
+    std::cerr << "Unable to read the header of [" << logFile << "]"
+              << std::endl;
+    return -1;
+  }
+  ignition::math::Rand::Seed(vm.count("seed") ?
+      vm["seed"].as<unsigned int>() : header.seed());
+
+  setenv("SWARM_BATCH", "1", 1);
+  setenv("SWARM_REPLAY", logFile.c_str(), 1);
+  setenv("SWARM_LOG", "0", 1);
+
+  if (!gazebo::setupServer())
+  {
+    std::cerr << "Unable to start Gazebo" << std::endl;
+    return -1;
+  }
+
+  gazebo::physics::WorldPtr world = gazebo::loadWorld(worldFile);
+  if (!world)
+  {
+    std::cerr << "Unable to load the world [" << worldFile << "]"
+              << std::endl;
+    gazebo::shutdown();
+    return -1;
+  }
+  world->SetPaused(false);
+
+  swarm::ReplayLog *replay = swarm::ReplayLog::Instance(world->GetName());
+  if (!replay->Load(logFile))
+  {
+    gazebo::shutdown();
+    return -1;
+  }
+
+  // Each step is compared at the start of the next one, so the world runs
+  // one step past the last one logged.
+  const double stepSize = world->GetPhysicsEngine()->GetMaxStepSize();
+  const uint64_t iterations =
+    static_cast<uint64_t>(replay->EndTime() / stepSize + 0.5) + 2;
+  const uint64_t chunk = 1000;
+
+  auto start = std::chrono::steady_clock::now();
+  uint64_t done = 0;
+  bool stopped = false;
+  while (done < iterations && !stopped)
+  {
+    const uint64_t n = std::min(chunk, iterations - done);
+    gazebo::runWorld(world, static_cast<unsigned int>(n));
+    const uint64_t ran = world->GetIterations();
+    done += ran;
+    stopped = ran < n;
+  }
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+
+  replay->Report(std::cout);
+  std::cout << "Replayed " << world->GetSimTime().Double() << " s of "
+            << "simulation time in " << elapsed.count() << " s of wall time"
+            << std::endl;
+
+  const bool passed = replay->Passed();
+  gazebo::shutdown();
+  return passed ? 0 : 1;
+}
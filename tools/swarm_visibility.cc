@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+#include <gazebo/common/HeightmapData.hh>
+#include <gazebo/common/SphericalCoordinates.hh>
+#include <gazebo/common/SystemPaths.hh>
+#include <ignition/math/Angle.hh>
+#include <ignition/math/Helpers.hh>
+#include <sdf/sdf.hh>
+#include "swarm/Common.hh"
+#include "swarm/Heightmap.hh"
+#include "swarm/VisibilityTable.hh"
+
+namespace po = boost::program_options;
+
+//////////////////////////////////////////////////
+void usage()
+{
+  std::cerr << "Generate the visibility table of a world without running "
+            << "Gazebo.\n\n"
+            << " swarm_visibility [options] <world file>\n\n"
+            << "Options:\n"
+            << " -h, --help               Show this help message.\n"
+            << " -j, --threads <n>        Number of worker threads. Defaults"
+            <<                            " to one per core.\n"
+            << " -k, --keys               Generate the key list format instead"
+            <<                            " of the stencil\n"
+            << "                          format.\n"
+            << " -c, --clearance          Generate the altitude-aware format,"
+            <<                            " for aerial\n"
+            << "                          vehicles.\n"
+            << " -g, --gpu                Run the line of sight tests of the"
+            <<                            " stencil format on\n"
+            << "                          an OpenCL device.\n"
+            << "     --validate <n>       Compare n cells computed by the GPU"
+            <<                            " with the CPU.\n"
+            << "     --sampling <n>       Heightmap subsampling, must match"
+            <<                            " the one used by\n"
+            << "                          Gazebo (2 by default).\n"
+            << "     --shard <i>/<n>      Only generate shard i of n, from 0"
+            <<                            " to n - 1. Merge\n"
+            << "                          the shards with"
+            <<                            " swarm_visibility_merge.\n"
+            << "     --tiles <n>          Also write the table split into"
+            <<                            " compressed tiles\n"
+            << "                          of n x n cells, for very large"
+            <<                            " terrains.\n"
+            << "     --levels <n>         Generate the n finest levels of the"
+            <<                            " table, for\n"
+            << "                          pairs farther apart than 250m"
+            <<                            " (1 by default).\n\n"
+            << "The table is written to $SWARM_VISIBILITY_CACHE "
+            << "(~/.swarm/visibility by default)." << std::endl;
+}
+
+//////////////////////////////////////////////////
+/// \brief Find a child element with a given name attribute.
+/// \param[in] _parent Parent element.
+/// \param[in] _type Type of the child element.
+/// \param[in] _name Value of the name attribute.
+/// \return The child element, or null if not found.
+sdf::ElementPtr findNamed(sdf::ElementPtr _parent, const std::string &_type,
+    const std::string &_name)
+{
+  if (!_parent->HasElement(_type))
+    return sdf::ElementPtr();
+
+  sdf::ElementPtr elem = _parent->GetElement(_type);
+  while (elem && elem->Get<std::string>("name") != _name)
+    elem = elem->GetNextElement(_type);
+
+  return elem;
+}
+
+//////////////////////////////////////////////////
+/// \brief Load the terrain heightmap of a world, sampled the same way
+/// gazebo::physics::HeightmapShape samples it.
+/// \param[in] _worldSDF Pointer to the <world> element.
+/// \param[in] _sampling Heightmap subsampling.
+/// \param[out] _heightmap The samples of the terrain.
+/// \return True if the terrain was loaded.
+bool loadTerrain(sdf::ElementPtr _worldSDF, const int _sampling,
+    swarm::Heightmap &_heightmap)
+{
+  sdf::ElementPtr modelSDF = findNamed(_worldSDF, "model", "terrain");
+  if (!modelSDF || !modelSDF->HasElement("link"))
+  {
+    std::cerr << "No terrain model found" << std::endl;
+    return false;
+  }
+
+  sdf::ElementPtr collisionSDF = findNamed(modelSDF->GetElement("link"),
+      "collision", "collision");
+  if (!collisionSDF || !collisionSDF->HasElement("geometry") ||
+      !collisionSDF->GetElement("geometry")->HasElement("heightmap"))
+  {
+    std::cerr << "The terrain model has no heightmap collision" << std::endl;
+    return false;
+  }
+
+  sdf::ElementPtr heightmapSDF =
+    collisionSDF->GetElement("geometry")->GetElement("heightmap");
+  const std::string uri = heightmapSDF->Get<std::string>("uri");
+  const ignition::math::Vector3d size =
+    heightmapSDF->Get<ignition::math::Vector3d>("size");
+
+  const std::string filename = gazebo::common::find_file(uri);
+  std::unique_ptr<gazebo::common::HeightmapData> data(
+      gazebo::common::HeightmapDataLoader::LoadTerrainFile(filename));
+  if (!data)
+  {
+    std::cerr << "Unable to load the heightmap [" << uri << "]" << std::endl;
+    return false;
+  }
+
+  // Same sampling as HeightmapShape::Load().
+  const unsigned int vertSize = data->GetWidth() * _sampling - _sampling + 1;
+  ignition::math::Vector3d scale(size.X() / vertSize, size.Y() / vertSize,
+      std::abs(size.Z()));
+  if (!ignition::math::equal(data->GetMaxElevation(), 0.0f))
+    scale.Z(std::abs(size.Z()) / data->GetMaxElevation());
+
+  std::vector<float> heights;
+  data->FillHeightMap(_sampling, vertSize, size, scale, true, heights);
+
+  return _heightmap.Set(vertSize, vertSize, size, heights);
+}
+
+//////////////////////////////////////////////////
+/// \brief Load the spherical coordinates of a world.
+/// \param[in] _worldSDF Pointer to the <world> element.
+/// \return The spherical coordinates, or null if not found.
+gazebo::common::SphericalCoordinatesPtr loadSphericalCoordinates(
+    sdf::ElementPtr _worldSDF)
+{
+  if (!_worldSDF->HasElement("spherical_coordinates"))
+    return gazebo::common::SphericalCoordinatesPtr();
+
+  sdf::ElementPtr elem = _worldSDF->GetElement("spherical_coordinates");
+  return gazebo::common::SphericalCoordinatesPtr(
+      new gazebo::common::SphericalCoordinates(
+        gazebo::common::SphericalCoordinates::Convert(
+          elem->Get<std::string>("surface_model")),
+        ignition::math::Angle(IGN_DTOR(elem->Get<double>("latitude_deg"))),
+        ignition::math::Angle(IGN_DTOR(elem->Get<double>("longitude_deg"))),
+        elem->Get<double>("elevation"),
+        ignition::math::Angle(IGN_DTOR(elem->Get<double>("heading_deg")))));
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  po::options_description desc("Options");
+  desc.add_options()
+    ("help,h", "Show this help message.")
+    ("threads,j", po::value<unsigned int>()->default_value(0),
+     "Number of worker threads.")
+    ("keys,k", "Generate the key list format.")
+    ("clearance,c", "Generate the altitude-aware format.")
+    ("gpu,g", "Run the tests on the GPU.")
+    ("validate", po::value<unsigned int>()->default_value(0),
+     "Cells compared with the CPU.")
+    ("sampling", po::value<int>()->default_value(2), "Heightmap subsampling.")
+    ("shard", po::value<std::string>(), "Shard to generate.")
+    ("tiles", po::value<int>()->default_value(0), "Size of the tiles.")
+    ("levels", po::value<int>()->default_value(1), "Number of levels.")
+    ("world", po::value<std::string>(), "World file.");
+
+  po::positional_options_description positional;
+  positional.add("world", 1);
+
+  po::variables_map vm;
+  try
+  {
+    po::store(po::command_line_parser(argc, argv).options(desc)
+        .positional(positional).run(), vm);
+    po::notify(vm);
+  }
+  catch(const po::error &_e)
+  {
+    std::cerr << _e.what() << std::endl;
+    usage();
+    return -1;
+  }
+
+  if (vm.count("help") || !vm.count("world") ||
+      vm["sampling"].as<int>() < 1 || vm["tiles"].as<int>() < 0 ||
+      vm["levels"].as<int>() < 1 ||
+      vm["levels"].as<int>() > swarm::VisibilityTable::kMaxLevels)
+  {
+    usage();
+    return vm.count("help") ? 0 : -1;
+  }
+
+  sdf::SDFPtr sdfParsed(new sdf::SDF());
+  sdf::init(sdfParsed);
+  if (!sdf::readFile(vm["world"].as<std::string>(), sdfParsed) ||
+      !sdfParsed->Root()->HasElement("world"))
+  {
+    std::cerr << "Unable to read the world [" << vm["world"].as<std::string>()
+              << "]" << std::endl;
+    return -1;
+  }
+  sdf::ElementPtr worldSDF = sdfParsed->Root()->GetElement("world");
+
+  swarm::Heightmap heightmap;
+  if (!loadTerrain(worldSDF, vm["sampling"].as<int>(), heightmap))
+    return -1;
+
+  // Cover the same area as the table looked up by the broker.
+  swarm::Common common;
+  gazebo::common::SphericalCoordinatesPtr sphericalCoords =
+    loadSphericalCoordinates(worldSDF);
+  ignition::math::Vector3d searchMin, searchMax;
+  const bool searchArea = sphericalCoords &&
+    common.LoadWorldSearchArea(worldSDF) &&
+    common.SearchAreaBounds(*sphericalCoords, searchMin, searchMax);
+
+  std::cout << "Terrain of " << heightmap.Columns() << "x"
+            << heightmap.Rows() << " samples, hash " << std::hex
+            << heightmap.Hash() << std::dec << std::endl;
+
+  int shardIndex = 0;
+  int shardCount = 1;
+  if (vm.count("shard") && !swarm::VisibilityTable::ParseShard(
+        vm["shard"].as<std::string>(), shardIndex, shardCount))
+  {
+    std::cerr << "Invalid shard [" << vm["shard"].as<std::string>() << "]"
+              << std::endl;
+    return -1;
+  }
+
+  swarm::VisibilityTableFormat format = swarm::STENCIL;
+  if (vm.count("clearance"))
+    format = swarm::CLEARANCE;
+  else if (vm.count("keys"))
+    format = swarm::KEYS;
+
+  // Each level has its own step, and so its own area.
+  for (int level = 0; level < vm["levels"].as<int>(); ++level)
+  {
+    swarm::VisibilityTable table;
+    table.SetLevel(level);
+    if (searchArea)
+    {
+      table.SetArea(heightmap.Hash(), heightmap.Size(), searchMin,
+          searchMax);
+    }
+    else
+      table.SetArea(heightmap.Hash(), heightmap.Size());
+
+    table.SetShard(shardIndex, shardCount);
+    table.SetGpuValidation(vm["validate"].as<unsigned int>());
+    table.SetTileSize(vm["tiles"].as<int>());
+    if (!table.Generate(heightmap, vm["threads"].as<unsigned int>(), format,
+          vm.count("gpu") ? swarm::GPU_BACKEND : swarm::HEIGHTMAP_BACKEND))
+    {
+      return -1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,536 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+#include "swarm/VisibilityLookup.hh"
+
+namespace po = boost::program_options;
+
+/// \brief A pair of points queried, in world coordinates (m).
+struct Query
+{
+  /// \brief X coordinate of the first point.
+  double x1;
+
+  /// \brief Y coordinate of the first point.
+  double y1;
+
+  /// \brief X coordinate of the second point.
+  double x2;
+
+  /// \brief Y coordinate of the second point.
+  double y2;
+};
+
+/// \brief Costs of a table on the workload.
+struct Benchmark
+{
+  /// \brief Time spent by VisibilityLookup::Load() (ms).
+  double loadMs = 0;
+
+  /// \brief Mean time of a lookup in the first pass (ns).
+  double coldNs = 0;
+
+  /// \brief Mean time of a lookup in the second pass (ns).
+  double warmNs = 0;
+
+  /// \brief Median of the mean lookup time of the batches of the second
+  /// pass (ns).
+  double p50Ns = 0;
+
+  /// \brief 99th percentile of the mean lookup time of the batches of the
+  /// second pass (ns).
+  double p99Ns = 0;
+
+  /// \brief Bytes mapped.
+  uint64_t mapped = 0;
+
+  /// \brief Growth of the resident memory of the process (bytes).
+  int64_t resident = 0;
+
+  /// \brief Bytes of the decompressed tiles.
+  uint64_t tileBytes = 0;
+
+  /// \brief Lookups of tiles already decompressed.
+  uint64_t tileHits = 0;
+
+  /// \brief Lookups that decompressed a tile.
+  uint64_t tileMisses = 0;
+
+  /// \brief Visible pairs of the workload.
+  uint64_t visible = 0;
+};
+
+/// \brief Number of queries timed together.
+static const size_t kBatchSize = 1024;
+
+//////////////////////////////////////////////////
+void usage()
+{
+  std::cerr << "Compare the answers of two visibility tables, and measure"
+            << " the cost of their\nlookups.\n\n"
+            << " swarm_visibility_compare [options] <table A> <table B>\n\n"
+            << "Options:\n"
+            << " -h, --help               Show this help message.\n"
+            << " -n, --samples <n>        Number of random pairs compared"
+            <<                            " (1000000 by default).\n"
+            << " -e, --exhaustive         Compare every pair of cells stored"
+            <<                            " by table A instead.\n"
+            << " -q, --queries <n>        Number of random pairs of the"
+            <<                            " benchmark, 0 to skip it\n"
+            << "                          (1000000 by default).\n"
+            << " -s, --seed <n>           Seed of the random pairs (1 by"
+            <<                            " default).\n"
+            << "     --max-report <n>     Number of disagreements printed"
+            <<                            " (10 by default).\n"
+            << "     --tile-cache <n>     Tiles kept decompressed by the"
+            <<                            " tiled tables.\n\n"
+            << "The pairs are taken from the cells of table A, within the"
+            << " radius of both\ntables, and looked up by their world"
+            << " coordinates, so the tables may have\ndifferent formats,"
+            << " steps, areas or tiles. The exit status is 1 if the tables"
+            << "\ndisagree." << std::endl;
+}
+
+//////////////////////////////////////////////////
+/// \brief Name of a table format.
+/// \param[in] _format The format.
+/// \return The name.
+static std::string FormatName(const swarm::VisibilityTableFormat _format)
+{
+  switch (_format)
+  {
+    case swarm::KEYS:
+      return "KEYS";
+    case swarm::STENCIL:
+      return "STENCIL";
+    case swarm::CLEARANCE:
+      return "CLEARANCE";
+    case swarm::OBSTACLES:
+      return "OBSTACLES";
+    default:
+      return "unknown";
+  }
+}
+
+//////////////////////////////////////////////////
+/// \brief Resident memory of the process.
+/// \return The bytes, or 0 if unknown.
+static int64_t ResidentBytes()
+{
+  std::ifstream statm("/proc/self/statm");
+  int64_t size = 0;
+  int64_t resident = 0;
+  if (!(statm >> size >> resident))
+    return 0;
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+//////////////////////////////////////////////////
+/// \brief Whether both tables store a pair of points.
+/// \param[in] _a The first table.
+/// \param[in] _b The second table.
+/// \param[in] _query The pair.
+/// \return True if both tables look the pair up.
+static bool Stored(const swarm::VisibilityLookup &_a,
+    const swarm::VisibilityLookup &_b, const Query &_query)
+{
+  return _a.InRange(_a.Index(_query.x1, _query.y1),
+                    _a.Index(_query.x2, _query.y2)) &&
+    _b.InRange(_b.Index(_query.x1, _query.y1),
+               _b.Index(_query.x2, _query.y2));
+}
+
+//////////////////////////////////////////////////
+/// \brief Whether a table sees a pair of points.
+/// \param[in] _table The table.
+/// \param[in] _query The pair.
+/// \return True if the points are visible.
+static bool Visible(const swarm::VisibilityLookup &_table,
+    const Query &_query)
+{
+  return _table.Visible(_table.Index(_query.x1, _query.y1),
+                        _table.Index(_query.x2, _query.y2));
+}
+
+//////////////////////////////////////////////////
+/// \brief Radius of the pairs taken from the cells of table A, so both
+/// tables may store them.
+/// \param[in] _a Table A.
+/// \param[in] _b Table B.
+/// \return The radius (cells of A).
+static int PairRadius(const swarm::VisibilityLookup &_a,
+    const swarm::VisibilityLookup &_b)
+{
+  const swarm::VisibilityTableHeader &a = _a.Header();
+  const swarm::VisibilityTableHeader &b = _b.Header();
+  return std::min(a.radius, b.radius * b.stepSize / a.stepSize);
+}
+
+//////////////////////////////////////////////////
+/// \brief Go over every pair stored by table A, within the radius of B.
+/// \param[in] _a Table A.
+/// \param[in] _b Table B.
+/// \param[in] _visit Called with each pair.
+static void ExhaustivePairs(const swarm::VisibilityLookup &_a,
+    const swarm::VisibilityLookup &_b,
+    const std::function<void(const Query &)> &_visit)
+{
+  const swarm::VisibilityTableHeader &header = _a.Header();
+  const int radius = PairRadius(_a, _b);
+  const int step = header.stepSize;
+
+  // The half disk of offsets that follows each cell, as in the stencil.
+  for (int row = 0; row < header.rows; ++row)
+  {
+    for (int column = 0; column < header.columns; ++column)
+    {
+      Query query;
+      query.x1 = header.minX + column * step;
+      query.y1 = header.minY + row * step;
+      for (int dy = 0; dy <= radius && row + dy < header.rows; ++dy)
+      {
+        for (int dx = -radius; dx <= radius; ++dx)
+        {
+          if ((dy == 0 && dx <= 0) || dx * dx + dy * dy > radius * radius ||
+              column + dx < 0 || column + dx >= header.columns)
+          {
+            continue;
+          }
+          query.x2 = query.x1 + dx * step;
+          query.y2 = query.y1 + dy * step;
+          _visit(query);
+        }
+      }
+    }
+  }
+}
+
+//////////////////////////////////////////////////
+/// \brief Draw random pairs from the cells of table A that both tables
+/// store.
+/// \param[in] _a Table A.
+/// \param[in] _b Table B.
+/// \param[in] _count Number of pairs.
+/// \param[in] _seed Seed of the pairs.
+/// \return The pairs, fewer if the tables hardly overlap.
+static std::vector<Query> RandomPairs(const swarm::VisibilityLookup &_a,
+    const swarm::VisibilityLookup &_b, const uint64_t _count,
+    const unsigned int _seed)
+{
+  const swarm::VisibilityTableHeader &header = _a.Header();
+  const int radius = PairRadius(_a, _b);
+  const int step = header.stepSize;
+
+  std::mt19937_64 rng(_seed);
+  std::uniform_int_distribution<int> column(0, header.columns - 1);
+  std::uniform_int_distribution<int> row(0, header.rows - 1);
+  std::uniform_int_distribution<int> offset(-radius, radius);
+
+  std::vector<Query> queries;
+  queries.reserve(_count);
+  for (uint64_t attempt = 0; queries.size() < _count &&
+       attempt < 100 * _count; ++attempt)
+  {
+    const int dx = offset(rng);
+    const int dy = offset(rng);
+    if ((dx == 0 && dy == 0) || dx * dx + dy * dy > radius * radius)
+      continue;
+
+    Query query;
+    query.x1 = header.minX + column(rng) * step;
+    query.y1 = header.minY + row(rng) * step;
+    query.x2 = query.x1 + dx * step;
+    query.y2 = query.y1 + dy * step;
+    if (Stored(_a, _b, query))
+      queries.push_back(query);
+  }
+  return queries;
+}
+
+//////////////////////////////////////////////////
+/// \brief Load a table and time its lookups on a workload.
+/// \param[in] _path Path of the table.
+/// \param[in] _queries The workload.
+/// \param[in] _tileCache Tiles kept decompressed, or 0 for the default.
+/// \param[out] _result The costs.
+/// \return True if the table was loaded.
+static bool Measure(const std::string &_path,
+    const std::vector<Query> &_queries, const size_t _tileCache,
+    Benchmark &_result)
+{
+  const int64_t residentBefore = ResidentBytes();
+
+  swarm::VisibilityLookup table;
+  auto start = std::chrono::steady_clock::now();
+  if (!table.Load(_path))
+    return false;
+  _result.loadMs = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start).count();
+  if (_tileCache > 0)
+    table.SetTileCacheSize(_tileCache);
+
+  // The first pass faults the pages in, and decompresses the tiles.
+  std::vector<double> batches;
+  for (int pass = 0; pass < 2; ++pass)
+  {
+    batches.clear();
+    uint64_t visible = 0;
+    double total = 0;
+    for (size_t first = 0; first < _queries.size(); first += kBatchSize)
+    {
+      const size_t last = std::min(first + kBatchSize, _queries.size());
+      start = std::chrono::steady_clock::now();
+      for (size_t i = first; i < last; ++i)
+        visible += Visible(table, _queries[i]);
+      const double ns = std::chrono::duration<double, std::nano>(
+          std::chrono::steady_clock::now() - start).count();
+      total += ns;
+      batches.push_back(ns / (last - first));
+    }
+
+    const double mean = _queries.empty() ? 0 : total / _queries.size();
+    if (pass == 0)
+      _result.coldNs = mean;
+    else
+      _result.warmNs = mean;
+    _result.visible = visible;
+  }
+
+  std::sort(batches.begin(), batches.end());
+  if (!batches.empty())
+  {
+    _result.p50Ns = batches[batches.size() / 2];
+    _result.p99Ns = batches[std::min(batches.size() - 1,
+        static_cast<size_t>(batches.size() * 0.99))];
+  }
+
+  _result.mapped = table.MappedSize();
+  _result.resident = ResidentBytes() - residentBefore;
+  _result.tileBytes = table.TileCacheBytes();
+  _result.tileHits = table.TileHits();
+  _result.tileMisses = table.TileMisses();
+  return true;
+}
+
+//////////////////////////////////////////////////
+/// \brief Print a table and its costs.
+/// \param[in] _name Name of the table in the report.
+/// \param[in] _path Path of the table.
+/// \param[in] _table The table.
+/// \param[in] _result The costs, if measured.
+static void Print(const std::string &_name, const std::string &_path,
+    const swarm::VisibilityLookup &_table, const Benchmark *_result)
+{
+  const swarm::VisibilityTableHeader &header = _table.Header();
+  const double kMB = 1024.0 * 1024.0;
+  std::cout << _name << ": " << _path << "\n"
+            << "  format:     " << FormatName(_table.Format())
+            << ", step " << header.stepSize << " m, " << header.columns
+            << " x " << header.rows << " cells, radius " << header.radius
+            << (_table.Tiled() ? ", tiled" : "") << "\n";
+  if (!_result)
+    return;
+
+  std::cout << std::fixed << std::setprecision(2)
+            << "  load:       " << _result->loadMs << " ms\n"
+            << "  lookup:     cold " << _result->coldNs << " ns, warm "
+            << _result->warmNs << " ns (batches: p50 " << _result->p50Ns
+            << " ns, p99 " << _result->p99Ns << " ns)\n"
+            << "  mapped:     " << _result->mapped / kMB << " MB\n"
+            << "  resident:   " << _result->resident / kMB << " MB more\n";
+  if (_table.Tiled())
+  {
+    std::cout << "  tile cache: " << _result->tileBytes / kMB << " MB, "
+              << _result->tileHits << " hits, " << _result->tileMisses
+              << " misses\n";
+  }
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  po::options_description desc("Options");
+  desc.add_options()
+    ("help,h", "Show this help message.")
+    ("samples,n", po::value<uint64_t>()->default_value(1000000),
+     "Number of random pairs compared.")
+    ("exhaustive,e", "Compare every pair of cells.")
+    ("queries,q", po::value<uint64_t>()->default_value(1000000),
+     "Number of random pairs of the benchmark.")
+    ("seed,s", po::value<unsigned int>()->default_value(1),
+     "Seed of the random pairs.")
+    ("max-report", po::value<uint64_t>()->default_value(10),
+     "Number of disagreements printed.")
+    ("tile-cache", po::value<size_t>()->default_value(0),
+     "Tiles kept decompressed.")
+    ("tables", po::value<std::vector<std::string>>(), "Table files.");
+
+  po::positional_options_description positional;
+  positional.add("tables", 2);
+
+  po::variables_map vm;
+  try
+  {
+    po::store(po::command_line_parser(argc, argv).options(desc)
+        .positional(positional).run(), vm);
+    po::notify(vm);
+  }
+  catch(const po::error &_e)
+  {
+    std::cerr << _e.what() << std::endl;
+    usage();
+    return -1;
+  }
+
+  if (vm.count("help") || !vm.count("tables") ||
+      vm["tables"].as<std::vector<std::string>>().size() != 2)
+  {
+    usage();
+    return vm.count("help") ? 0 : -1;
+  }
+
+  const std::vector<std::string> paths =
+    vm["tables"].as<std::vector<std::string>>();
+  const unsigned int seed = vm["seed"].as<unsigned int>();
+  const uint64_t maxReport = vm["max-report"].as<uint64_t>();
+
+  swarm::VisibilityLookup a;
+  swarm::VisibilityLookup b;
+  if (!a.Load(paths[0]) || !b.Load(paths[1]))
+  {
+    std::cerr << "Unable to load the tables" << std::endl;
+    return -1;
+  }
+
+  if (a.TerrainHash() != b.TerrainHash())
+    std::cerr << "Warning: the tables are of different terrains" << std::endl;
+  if ((a.Format() == swarm::OBSTACLES) != (b.Format() == swarm::OBSTACLES))
+  {
+    std::cerr << "Warning: an OBSTACLES table doesn't describe the terrain,"
+              << " the answers differ by\ndesign" << std::endl;
+  }
+  if (PairRadius(a, b) <= 0)
+  {
+    std::cerr << "The radius of table B is under a cell of table A"
+              << std::endl;
+    return -1;
+  }
+
+  // Compare the answers.
+  uint64_t compared = 0;
+  uint64_t skipped = 0;
+  uint64_t onlyA = 0;
+  uint64_t onlyB = 0;
+  std::vector<Query> reported;
+  auto compare = [&](const Query &_query)
+  {
+    if (!Stored(a, b, _query))
+    {
+      ++skipped;
+      return;
+    }
+
+    ++compared;
+    const bool visibleA = Visible(a, _query);
+    const bool visibleB = Visible(b, _query);
+    if (visibleA == visibleB)
+      return;
+
+    if (visibleA)
+      ++onlyA;
+    else
+      ++onlyB;
+    if (reported.size() < maxReport)
+      reported.push_back(_query);
+  };
+
+  if (vm.count("exhaustive"))
+  {
+    ExhaustivePairs(a, b, compare);
+  }
+  else
+  {
+    for (const Query &query :
+         RandomPairs(a, b, vm["samples"].as<uint64_t>(), seed))
+    {
+      compare(query);
+    }
+  }
+
+  const uint64_t disagreements = onlyA + onlyB;
+  std::cout << "Compared " << compared << " pairs";
+  if (skipped > 0)
+    std::cout << ", skipped " << skipped << " not stored by both tables";
+  std::cout << ".\nDisagreements: " << disagreements;
+  if (compared > 0)
+  {
+    std::cout << " (" << std::setprecision(4)
+              << 100.0 * disagreements / compared << "%)";
+  }
+  std::cout << ", " << onlyA << " visible only in A, " << onlyB
+            << " visible only in B.\n";
+  for (const Query &query : reported)
+  {
+    std::cout << "  (" << query.x1 << ", " << query.y1 << ") -> ("
+              << query.x2 << ", " << query.y2 << "): only "
+              << (Visible(a, query) ? "A" : "B") << " sees it\n";
+  }
+  std::cout << std::endl;
+
+  // Each table is measured alone, so the resident memory is its own.
+  const uint64_t queryCount = vm["queries"].as<uint64_t>();
+  if (queryCount == 0)
+  {
+    Print("A", paths[0], a, nullptr);
+    Print("B", paths[1], b, nullptr);
+    return disagreements > 0 ? 1 : 0;
+  }
+
+  const std::vector<Query> workload = RandomPairs(a, b, queryCount, seed + 1);
+  a.Unload();
+  b.Unload();
+
+  std::cout << "Benchmark over " << workload.size() << " pairs:\n";
+  const size_t tileCache = vm["tile-cache"].as<size_t>();
+  for (size_t i = 0; i < paths.size(); ++i)
+  {
+    Benchmark result;
+    swarm::VisibilityLookup table;
+    if (!Measure(paths[i], workload, tileCache, result) ||
+        !table.Load(paths[i]))
+    {
+      std::cerr << "Unable to load [" << paths[i] << "]" << std::endl;
+      return -1;
+    }
+    Print(i == 0 ? "A" : "B", paths[i], table, &result);
+  }
+
+  return disagreements > 0 ? 1 : 0;
+}
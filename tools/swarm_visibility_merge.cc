@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <iostream>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+#include "swarm/VisibilityTable.hh"
+
+namespace po = boost::program_options;
+
+//////////////////////////////////////////////////
+void usage()
+{
+  std::cerr << "Merge the shards of a visibility table generated with"
+            << " swarm_visibility --shard\nor SWARM_VISIBILITY_SHARD.\n\n"
+            << " swarm_visibility_merge [options] <shard>...\n\n"
+            << "Options:\n"
+            << " -h, --help               Show this help message.\n"
+            << " -o, --output <file>      Path of the table. Defaults to its"
+            <<                            " path in the cache.\n\n"
+            << "Every shard of the table must be given, in any order. The"
+            << " shards are checked\nto be of the same table and to cover"
+            << " each row once, and are kept once the\ntable is written."
+            << std::endl;
+}
+
+//////////////////////////////////////////////////
+int main(int argc, char **argv)
+{
+  po::options_description desc("Options");
+  desc.add_options()
+    ("help,h", "Show this help message.")
+    ("output,o", po::value<std::string>()->default_value(""),
+     "Path of the table.")
+    ("shards", po::value<std::vector<std::string>>(), "Shard files.");
+
+  po::positional_options_description positional;
+  positional.add("shards", -1);
+
+  po::variables_map vm;
+  try
+  {
+    po::store(po::command_line_parser(argc, argv).options(desc)
+        .positional(positional).run(), vm);
+    po::notify(vm);
+  }
+  catch(const po::error &_e)
+  {
+    std::cerr << _e.what() << std::endl;
+    usage();
+    return -1;
+  }
+
+  if (vm.count("help") || !vm.count("shards"))
+  {
+    usage();
+    return vm.count("help") ? 0 : -1;
+  }
+
+  if (!swarm::VisibilityTable::MergeShards(
+        vm["shards"].as<std::vector<std::string>>(),
+        vm["output"].as<std::string>()))
+  {
+    return -1;
+  }
+
+  return 0;
+}
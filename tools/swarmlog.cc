@@ -19,11 +19,18 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 #include <boost/filesystem/operations.hpp>
 #include <boost/program_options.hpp>
 #include "swarm/LogParser.hh"
+#include "swarm/LogRecords.hh"
 #include "msgs/log_entry.pb.h"
+#include "msgs/log_entry_min.pb.h"
 #include "msgs/log_header.pb.h"
+#include "swarmlog_arrow.hh"
+#include "swarmlog_report.hh"
+#include "swarmlog_slice.hh"
 
 namespace po = boost::program_options;
 
@@ -42,8 +49,38 @@ void usage()
             <<                          "option.\n"
             << " -s, --step             Step through the content of a log "
             <<                          "file.\n"
+            << " -a, --analyze <logs>   Write the comms reports and the "
+            <<                          "summary of\n"
+            << "                        each log, next to it.\n"
+            << "     --summary <logs>   Only write the summary of each log, "
+            <<                          "from the\n"
+            << "                        totals written by the logger if "
+            <<                          "any.\n"
+            << " -j, --jobs   <n>       Number of logs analyzed at the same "
+            <<                          "time.\n"
             << " -f, --file   <input>   Path to a Swarm log file.\n"
-            << "     --filter <output>  Filter only broker and BOO entries."
+            << "     --id     <id>      Only output the entries of a client."
+            <<                          " Repeat\n"
+            << "                        it for several clients.\n"
+            << " -t, --time   <time>    Start from the first entry at or "
+            <<                          "after a\n"
+            << "                        simulation time.\n"
+            << "     --until  <time>    Stop after the last entry at or "
+            <<                          "before a\n"
+            << "                        simulation time.\n"
+            << "     --filter <output>  Filter only broker and BOO entries.\n"
+            << "     --slice  <output>  Write the entries selected by --id,"
+            <<                          " --time,\n"
+            << "                        --until and --types into a new "
+            <<                          "log.\n"
+            << "     --types  <types>   Only keep these fields in a slice: "
+            <<                          "sensors,\n"
+            << "                        actions, incoming, visibility, boo,"
+            <<                          " replay,\n"
+            << "                        timing.\n"
+            << "     --arrow  <dir>     Export the log as Arrow IPC tables "
+            <<                          "into a\n"
+            << "                        directory."
             << std::endl;
 }
 
@@ -89,22 +126,55 @@ bool parseArguments(int argc, char **argv, po::variables_map &_vm)
     ("info,i" , "Output information about a log file. Log filename "
                 "should be specified using the --file option.")
     ("step,s" , "Step through the content of a log file.")
+    ("analyze,a", po::value<std::vector<std::string>>()->multitoken(),
+         "Write the comms reports and the summary of each log, next to it.")
+    ("summary", po::value<std::vector<std::string>>()->multitoken(),
+         "Only write the summary of each log, from the totals written by "
+         "the logger if any.")
+    ("jobs,j" , po::value<unsigned int>()->default_value(
+         std::max(1u, std::thread::hardware_concurrency())),
+         "Number of logs analyzed at the same time.")
+    ("id"     , po::value<std::vector<std::string>>()->composing(),
+         "Only output the entries of a client. Repeat it for several "
+         "clients.")
+    ("time,t" , po::value<double>(),
+         "Start from the first entry at or after a simulation time.")
+    ("until"  , po::value<double>(),
+         "Stop after the last entry at or before a simulation time.")
     ("filter" , po::value<std::string>(),
          "Filter only broker and BOO entries.")
-    ("file,f" , po::value<std::string>()->required(),
+    ("slice"  , po::value<std::string>(),
+         "Write the entries selected by --id, --time, --until and --types "
+         "into a new log.")
+    ("types"  , po::value<std::vector<std::string>>()->multitoken(),
+         "Only keep these fields in a slice.")
+    ("arrow"  , po::value<std::string>(),
+         "Export the log as Arrow IPC tables into a directory.")
+    ("file,f" , po::value<std::string>(),
          "Path to a Swarm log file.");
 
   try
   {
     po::store(po::command_line_parser(argc, argv).options(desc).run(), _vm);
 
-    // We require to specify echo or step.
+    // We require to specify echo, step or analyze.
     if ((_vm.count("help")) ||
         (!_vm.count("echo") && !_vm.count("info") && !_vm.count("step") &&
-         !_vm.count("filter")))
+         !_vm.count("filter") && !_vm.count("analyze") &&
+         !_vm.count("summary") &&
+         !_vm.count("arrow") && !_vm.count("slice")))
       return false;
 
     po::notify(_vm);
+
+    // All the options but analyze and summary work on a single file.
+    if (!_vm.count("analyze") && !_vm.count("summary") &&
+        !_vm.count("file"))
+    {
+      std::cerr << "Error: the option '--file' is required but missing"
+                << std::endl << std::endl;
+      return false;
+    }
   }
   catch(po::error& e)
   {
@@ -129,6 +199,16 @@ int main(int argc, char **argv)
   // compatible with the version of the headers we compiled against.
   GOOGLE_PROTOBUF_VERIFY_VERSION;
 
+  if (vm.count("analyze") || vm.count("summary"))
+  {
+    const bool summaryOnly = !vm.count("analyze");
+    int failures = analyzeLogs(vm[summaryOnly ? "summary" : "analyze"].as<
+        std::vector<std::string>>(), vm["jobs"].as<unsigned int>(),
+        summaryOnly);
+    google::protobuf::ShutdownProtobufLibrary();
+    return failures > 0 ? 1 : 0;
+  }
+
   std::string logfile = vm["file"].as<std::string>();
   swarm::LogParser parser(logfile);
   swarm::msgs::LogEntry logEntry;
@@ -200,10 +280,34 @@ int main(int argc, char **argv)
 
     auto fileSize = fileSizeStr(boost::filesystem::file_size(p));
     std::cout << "Size:                  " << fileSize << std::endl;
+    if (parser.Compressed())
+    {
+      std::cout << "Compressed blocks:     "
+                << parser.Blocks().size() << std::endl;
+    }
+    if (header.records())
+    {
+      swarm::LogRecords records(swarm::LogRecordPath(logfile));
+      std::cout << "Records:               " << records.Size() << std::endl;
+    }
     std::cout << std::endl;
     return 0;
   }
 
+  if (vm.count("time") && !parser.Seek(vm["time"].as<double>()))
+  {
+    std::cerr << "No entries at or after time [" << vm["time"].as<double>()
+              << "] in [" << logfile << "]" << std::endl;
+    return 1;
+  }
+
+  if (vm.count("arrow"))
+  {
+    bool exported = exportArrow(parser, vm["arrow"].as<std::string>());
+    google::protobuf::ShutdownProtobufLibrary();
+    return exported ? 0 : 1;
+  }
+
   if (vm.count("filter"))
   {
     // Output file.
@@ -246,9 +350,46 @@ int main(int argc, char **argv)
     return 0;
   }
 
-  while (parser.Next(logEntry) && c != 'q')
+  // The entries of other clients are skipped without being parsed.
+  swarm::LogFilter filter;
+  if (vm.count("id"))
+    filter.ids = vm["id"].as<std::vector<std::string>>();
+  if (vm.count("until"))
+    filter.maxTime = vm["until"].as<double>();
+
+  if (vm.count("slice"))
   {
-    std::cout << logEntry.DebugString() << std::endl;
+    std::vector<std::string> types;
+    if (vm.count("types"))
+      types = vm["types"].as<std::vector<std::string>>();
+    bool sliced = sliceLog(parser, filter, types,
+        vm["slice"].as<std::string>());
+    google::protobuf::ShutdownProtobufLibrary();
+    return sliced ? 0 : 1;
+  }
+
+  // The entries of a minimal log are msgs::LogEntryMin, e.g. with the time
+  // spent by each subsystem when SWARM_STEP_TIMERS was set.
+  swarm::msgs::LogEntryMin logEntryMin;
+  const char *record;
+  int32_t size;
+  while (c != 'q')
+  {
+    if (parser.Minimal())
+    {
+      if (!parser.NextSerialized(record, size))
+        break;
+      if (!logEntryMin.ParseFromArray(record, size))
+        continue;
+      std::cout << logEntryMin.DebugString() << std::endl;
+    }
+    else
+    {
+      if (!parser.Next(logEntry, filter))
+        break;
+      std::cout << logEntry.DebugString() << std::endl;
+    }
+
     if (vm.count("step"))
     {
       std::cout << "\n--- Press space to continue, 'q' to quit ---\n";
@@ -0,0 +1,1053 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/filesystem/operations.hpp>
+#include "swarm/LogParser.hh"
+#include "msgs/log_entry_min.pb.h"
+#include "msgs/log_entry.pb.h"
+#include "swarmlog_arrow.hh"
+
+// The metadata of the Arrow messages are flatbuffers (see Schema.fbs and
+// Message.fbs in the Arrow format). They are small, so they are built as
+// a tree of nodes and serialized front to back: every node is written
+// after the node referencing it, as the offsets of flatbuffers only point
+// forward.
+
+namespace
+{
+  /// \brief Number of rows of each record batch.
+  const size_t kArrowBatchRows = 1 << 16;
+
+  /// \brief Version of the Arrow metadata (V5).
+  const int16_t kArrowMetadataVersion = 4;
+
+  /// \brief Types of the MessageHeader union.
+  enum ArrowMessageType : uint8_t
+  {
+    kArrowSchema = 1,
+    kArrowDictionaryBatch = 2,
+    kArrowRecordBatch = 3
+  };
+
+  /// \brief Types of the Type union.
+  enum ArrowTypeId : uint8_t
+  {
+    kArrowInt = 2,
+    kArrowFloatingPoint = 3,
+    kArrowUtf8 = 5,
+    kArrowBool = 6
+  };
+
+  /// \brief Marks the start of a message in the streaming format.
+  const uint32_t kArrowContinuation = 0xFFFFFFFF;
+
+  //////////////////////////////////////////////////
+  /// \brief Pad a buffer with zeros up to a multiple of an alignment.
+  /// \param[in,out] _buffer The buffer.
+  /// \param[in] _align The alignment (bytes).
+  void padTo(std::string &_buffer, const size_t _align)
+  {
+    _buffer.resize((_buffer.size() + _align - 1) / _align * _align, '\0');
+  }
+
+  //////////////////////////////////////////////////
+  /// \brief Append a little endian value to a buffer.
+  /// \param[in,out] _buffer The buffer.
+  /// \param[in] _value The value.
+  template<typename T>
+  void append(std::string &_buffer, const T _value)
+  {
+    _buffer.append(reinterpret_cast<const char *>(&_value), sizeof(_value));
+  }
+
+  //////////////////////////////////////////////////
+  /// \brief Overwrite a little endian value in a buffer.
+  /// \param[in,out] _buffer The buffer.
+  /// \param[in] _pos Position of the value (bytes).
+  /// \param[in] _value The value.
+  template<typename T>
+  void patch(std::string &_buffer, const size_t _pos, const T _value)
+  {
+    std::memcpy(&_buffer[_pos], &_value, sizeof(_value));
+  }
+
+  class FbNode;
+
+  /// \brief Shared pointer to a flatbuffer node.
+  typedef std::shared_ptr<FbNode> FbNodePtr;
+
+  /// \brief A table, a string or a vector of a flatbuffer.
+  class FbNode
+  {
+    /// \brief Kind of node.
+    public: enum Kind
+    {
+      kTable,
+      kString,
+      kStructs,
+      kTables
+    };
+
+    /// \brief A field of a table.
+    public: struct Field
+    {
+      /// \brief ID of the field in the schema.
+      uint16_t id;
+
+      /// \brief Value of a scalar field.
+      std::string bytes;
+
+      /// \brief Child node of an offset field, or null.
+      FbNodePtr child;
+    };
+
+    /// \brief Constructor.
+    /// \param[in] _kind Kind of node.
+    public: explicit FbNode(const Kind _kind)
+      : kind(_kind)
+    {
+    }
+
+    /// \brief Create a table.
+    /// \return The table.
+    public: static FbNodePtr Table()
+    {
+      return std::make_shared<FbNode>(kTable);
+    }
+
+    /// \brief Create a string.
+    /// \param[in] _str The string.
+    /// \return The node.
+    public: static FbNodePtr String(const std::string &_str)
+    {
+      auto node = std::make_shared<FbNode>(kString);
+      node->data = _str;
+      return node;
+    }
+
+    /// \brief Create a vector of structs.
+    /// \param[in] _data The structs.
+    /// \param[in] _count Number of structs.
+    /// \param[in] _align Alignment of the structs (bytes).
+    /// \return The node.
+    public: static FbNodePtr Structs(const std::string &_data,
+        const size_t _count, const size_t _align)
+    {
+      auto node = std::make_shared<FbNode>(kStructs);
+      node->data = _data;
+      node->count = _count;
+      node->align = _align;
+      return node;
+    }
+
+    /// \brief Create a vector of tables.
+    /// \param[in] _tables The tables.
+    /// \return The node.
+    public: static FbNodePtr Tables(const std::vector<FbNodePtr> &_tables)
+    {
+      auto node = std::make_shared<FbNode>(kTables);
+      node->children = _tables;
+      return node;
+    }
+
+    /// \brief Set a scalar field of a table.
+    /// \param[in] _id ID of the field.
+    /// \param[in] _value The value.
+    /// \return The table.
+    public: template<typename T>
+    FbNode &Scalar(const uint16_t _id, const T _value)
+    {
+      Field field;
+      field.id = _id;
+      append(field.bytes, _value);
+      this->fields.push_back(field);
+      return *this;
+    }
+
+    /// \brief Set an offset field of a table.
+    /// \param[in] _id ID of the field.
+    /// \param[in] _child The node referenced by the field.
+    /// \return The table.
+    public: FbNode &Offset(const uint16_t _id, const FbNodePtr &_child)
+    {
+      Field field;
+      field.id = _id;
+      field.bytes.assign(sizeof(uint32_t), '\0');
+      field.child = _child;
+      this->fields.push_back(field);
+      return *this;
+    }
+
+    /// \brief Serialize a node at the end of a buffer, followed by the nodes
+    /// it references.
+    /// \param[in,out] _buffer The buffer.
+    /// \return Position of the node in the buffer, where its offsets point.
+    public: size_t Serialize(std::string &_buffer) const
+    {
+      size_t pos = 0;
+      switch (this->kind)
+      {
+        case kString:
+          padTo(_buffer, sizeof(uint32_t));
+          pos = _buffer.size();
+          append(_buffer, static_cast<uint32_t>(this->data.size()));
+          _buffer += this->data;
+          _buffer += '\0';
+          break;
+        case kStructs:
+          // The structs are aligned, after the length of the vector.
+          padTo(_buffer, sizeof(uint32_t));
+          while ((_buffer.size() + sizeof(uint32_t)) % this->align != 0)
+            append(_buffer, uint32_t(0));
+          pos = _buffer.size();
+          append(_buffer, static_cast<uint32_t>(this->count));
+          _buffer += this->data;
+          break;
+        case kTables:
+        {
+          padTo(_buffer, sizeof(uint32_t));
+          pos = _buffer.size();
+          append(_buffer, static_cast<uint32_t>(this->children.size()));
+          const size_t slots = _buffer.size();
+          _buffer.resize(slots + this->children.size() * sizeof(uint32_t));
+          for (size_t i = 0; i < this->children.size(); ++i)
+          {
+            const size_t slot = slots + i * sizeof(uint32_t);
+            const size_t child = this->children[i]->Serialize(_buffer);
+            patch(_buffer, slot, static_cast<uint32_t>(child - slot));
+          }
+          break;
+        }
+        default:
+        case kTable:
+          pos = this->SerializeTable(_buffer);
+          break;
+      }
+      return pos;
+    }
+
+    /// \brief Serialize a table, preceded by its vtable.
+    /// \param[in,out] _buffer The buffer.
+    /// \return Position of the table in the buffer.
+    private: size_t SerializeTable(std::string &_buffer) const
+    {
+      // The largest fields first, so they are all aligned once the table
+      // is aligned to 8 bytes.
+      std::vector<const Field *> order;
+      uint16_t numIds = 0;
+      for (const auto &field : this->fields)
+      {
+        order.push_back(&field);
+        numIds = std::max(numIds, static_cast<uint16_t>(field.id + 1));
+      }
+      std::stable_sort(order.begin(), order.end(),
+          [](const Field *_a, const Field *_b)
+          {
+            return _a->bytes.size() > _b->bytes.size();
+          });
+
+      std::vector<uint16_t> offsets(numIds, 0);
+      size_t tableSize = sizeof(int32_t);
+      std::vector<size_t> fieldPos;
+      for (const Field *field : order)
+      {
+        const size_t size = field->bytes.size();
+        tableSize = (tableSize + size - 1) / size * size;
+        offsets[field->id] = tableSize;
+        fieldPos.push_back(tableSize);
+        tableSize += size;
+      }
+
+      padTo(_buffer, sizeof(uint16_t));
+      const size_t vtable = _buffer.size();
+      append(_buffer, static_cast<uint16_t>((2 + numIds) * sizeof(uint16_t)));
+      append(_buffer, static_cast<uint16_t>(tableSize));
+      for (const uint16_t offset : offsets)
+        append(_buffer, offset);
+
+      padTo(_buffer, sizeof(uint64_t));
+      const size_t table = _buffer.size();
+      _buffer.resize(table + tableSize, '\0');
+      patch(_buffer, table, static_cast<int32_t>(table - vtable));
+      for (size_t i = 0; i < order.size(); ++i)
+      {
+        _buffer.replace(table + fieldPos[i], order[i]->bytes.size(),
+            order[i]->bytes);
+      }
+
+      for (size_t i = 0; i < order.size(); ++i)
+      {
+        if (!order[i]->child)
+          continue;
+        const size_t field = table + fieldPos[i];
+        const size_t child = order[i]->child->Serialize(_buffer);
+        patch(_buffer, field, static_cast<uint32_t>(child - field));
+      }
+      return table;
+    }
+
+    /// \brief Kind of node.
+    private: Kind kind;
+
+    /// \brief Fields of a table.
+    private: std::vector<Field> fields;
+
+    /// \brief Bytes of a string or of a vector of structs.
+    private: std::string data;
+
+    /// \brief Number of structs.
+    private: size_t count = 0;
+
+    /// \brief Alignment of the structs (bytes).
+    private: size_t align = 1;
+
+    /// \brief Tables of a vector of tables.
+    private: std::vector<FbNodePtr> children;
+  };
+
+  //////////////////////////////////////////////////
+  /// \brief Create an Int type.
+  /// \param[in] _bitWidth Number of bits.
+  /// \param[in] _signed Whether the integers are signed.
+  /// \return The type.
+  FbNodePtr arrowInt(const int32_t _bitWidth, const bool _signed)
+  {
+    auto type = FbNode::Table();
+    type->Scalar(0, _bitWidth).Scalar(1, static_cast<uint8_t>(_signed));
+    return type;
+  }
+
+  /// \brief Values of a dictionary encoded column, shared by the columns of
+  /// a table holding the same kind of strings.
+  class ArrowDictionary
+  {
+    /// \brief Constructor.
+    /// \param[in] _id ID of the dictionary in the stream.
+    public: explicit ArrowDictionary(const int64_t _id)
+      : id(_id)
+    {
+    }
+
+    /// \brief Get the index of a value, adding it if new.
+    /// \param[in] _value The value.
+    /// \return The index.
+    public: int32_t Index(const std::string &_value)
+    {
+      auto it = this->indices.find(_value);
+      if (it != this->indices.end())
+        return it->second;
+
+      const int32_t index = this->values.size();
+      this->indices[_value] = index;
+      this->values.push_back(_value);
+      return index;
+    }
+
+    /// \brief ID of the dictionary in the stream.
+    public: int64_t id;
+
+    /// \brief Values, by index.
+    public: std::vector<std::string> values;
+
+    /// \brief Number of values already written.
+    public: size_t written = 0;
+
+    /// \brief Whether the dictionary was written.
+    public: bool sent = false;
+
+    /// \brief Index of each value.
+    private: std::unordered_map<std::string, int32_t> indices;
+  };
+
+  /// \brief A column of a record batch being filled.
+  class ArrowColumn
+  {
+    /// \brief Type of the values.
+    public: enum Type
+    {
+      kInt8,
+      kInt32,
+      kUInt32,
+      kFloat64,
+      kBool,
+      kString
+    };
+
+    /// \brief Constructor.
+    /// \param[in] _name Name of the column.
+    /// \param[in] _type Type of the values.
+    /// \param[in] _nullable Whether the column has nulls.
+    /// \param[in] _dictionary Dictionary of a kString column.
+    public: ArrowColumn(const std::string &_name, const Type _type,
+        const bool _nullable, ArrowDictionary *_dictionary)
+      : name(_name), type(_type), nullable(_nullable),
+        dictionary(_dictionary)
+    {
+    }
+
+    /// \brief Append a number.
+    /// \param[in] _value The value.
+    public: void Append(const double _value)
+    {
+      switch (this->type)
+      {
+        case kInt8:
+          append(this->values, static_cast<int8_t>(_value));
+          break;
+        case kInt32:
+          append(this->values, static_cast<int32_t>(_value));
+          break;
+        case kUInt32:
+          append(this->values, static_cast<uint32_t>(_value));
+          break;
+        case kBool:
+          if (this->length % 8 == 0)
+            this->values += '\0';
+          if (static_cast<int>(_value) != 0)
+            this->values.back() |= 1 << (this->length % 8);
+          break;
+        default:
+          append(this->values, _value);
+          break;
+      }
+      this->AppendValidity(true);
+    }
+
+    /// \brief Append a string of a kString column.
+    /// \param[in] _value The value.
+    public: void Append(const std::string &_value)
+    {
+      append(this->values, this->dictionary->Index(_value));
+      this->AppendValidity(true);
+    }
+
+    /// \brief Append a null.
+    public: void AppendNull()
+    {
+      if (this->type == kBool)
+      {
+        if (this->length % 8 == 0)
+          this->values += '\0';
+      }
+      else
+        this->values.append(this->ValueSize(), '\0');
+      ++this->nulls;
+      this->AppendValidity(false);
+    }
+
+    /// \brief Get the field of the column in the schema.
+    /// \return The field.
+    public: FbNodePtr Field() const
+    {
+      FbNodePtr typeTable = FbNode::Table();
+      uint8_t typeId = kArrowInt;
+      switch (this->type)
+      {
+        case kInt8:
+          typeTable = arrowInt(8, true);
+          break;
+        case kInt32:
+          typeTable = arrowInt(32, true);
+          break;
+        case kUInt32:
+          typeTable = arrowInt(32, false);
+          break;
+        case kFloat64:
+          typeId = kArrowFloatingPoint;
+          typeTable->Scalar(0, int16_t(2));
+          break;
+        case kBool:
+          typeId = kArrowBool;
+          break;
+        case kString:
+          typeId = kArrowUtf8;
+          break;
+        default:
+          break;
+      }
+
+      auto field = FbNode::Table();
+      field->Offset(0, FbNode::String(this->name))
+        .Scalar(1, static_cast<uint8_t>(this->nullable))
+        .Scalar(2, typeId)
+        .Offset(3, typeTable)
+        .Offset(5, FbNode::Tables({}));
+      if (this->dictionary)
+      {
+        auto encoding = FbNode::Table();
+        encoding->Scalar(0, this->dictionary->id)
+          .Offset(1, arrowInt(32, true));
+        field->Offset(4, encoding);
+      }
+      return field;
+    }
+
+    /// \brief Size of a value in the values buffer (bytes).
+    /// \return The size.
+    private: size_t ValueSize() const
+    {
+      switch (this->type)
+      {
+        case kInt8:
+          return 1;
+        case kFloat64:
+          return 8;
+        default:
+          return 4;
+      }
+    }
+
+    /// \brief Append a bit to the validity bitmap.
+    /// \param[in] _valid Whether the value is valid.
+    private: void AppendValidity(const bool _valid)
+    {
+      if (this->length % 8 == 0)
+        this->validity += '\0';
+      if (_valid)
+        this->validity.back() |= 1 << (this->length % 8);
+      ++this->length;
+    }
+
+    /// \brief Name of the column.
+    public: std::string name;
+
+    /// \brief Type of the values.
+    public: Type type;
+
+    /// \brief Whether the column has nulls.
+    public: bool nullable;
+
+    /// \brief Dictionary of a kString column, or null.
+    public: ArrowDictionary *dictionary;
+
+    /// \brief Values of the batch, or the dictionary indices.
+    public: std::string values;
+
+    /// \brief Validity bitmap of the batch.
+    public: std::string validity;
+
+    /// \brief Number of rows in the batch.
+    public: size_t length = 0;
+
+    /// \brief Number of nulls in the batch.
+    public: size_t nulls = 0;
+  };
+
+  /// \brief The body and the layout of a record batch.
+  class ArrowBatchBody
+  {
+    /// \brief Add a field node.
+    /// \param[in] _length Number of values.
+    /// \param[in] _nulls Number of nulls.
+    public: void AddNode(const size_t _length, const size_t _nulls)
+    {
+      append(this->nodes, static_cast<int64_t>(_length));
+      append(this->nodes, static_cast<int64_t>(_nulls));
+      ++this->numNodes;
+    }
+
+    /// \brief Add a buffer at the end of the body.
+    /// \param[in] _data The buffer.
+    public: void AddBuffer(const std::string &_data)
+    {
+      append(this->buffers, static_cast<int64_t>(this->body.size()));
+      append(this->buffers, static_cast<int64_t>(_data.size()));
+      ++this->numBuffers;
+      this->body += _data;
+      padTo(this->body, sizeof(uint64_t));
+    }
+
+    /// \brief Get the RecordBatch table of the metadata.
+    /// \param[in] _length Number of rows.
+    /// \return The table.
+    public: FbNodePtr RecordBatch(const size_t _length) const
+    {
+      auto batch = FbNode::Table();
+      batch->Scalar(0, static_cast<int64_t>(_length))
+        .Offset(1, FbNode::Structs(this->nodes, this->numNodes, 8))
+        .Offset(2, FbNode::Structs(this->buffers, this->numBuffers, 8));
+      return batch;
+    }
+
+    /// \brief The body.
+    public: std::string body;
+
+    /// \brief FieldNode structs.
+    private: std::string nodes;
+
+    /// \brief Number of FieldNode structs.
+    private: size_t numNodes = 0;
+
+    /// \brief Buffer structs.
+    private: std::string buffers;
+
+    /// \brief Number of Buffer structs.
+    private: size_t numBuffers = 0;
+  };
+
+  /// \brief A table written as an Arrow IPC stream.
+  class ArrowTable
+  {
+    /// \brief Add a dictionary, shared by kString columns.
+    /// \return The dictionary.
+    public: ArrowDictionary *AddDictionary()
+    {
+      this->dictionaries.emplace_back(
+          new ArrowDictionary(this->dictionaries.size()));
+      return this->dictionaries.back().get();
+    }
+
+    /// \brief Add a column, before Open().
+    /// \param[in] _name Name of the column.
+    /// \param[in] _type Type of the values.
+    /// \param[in] _nullable Whether the column has nulls.
+    /// \param[in] _dictionary Dictionary of a kString column.
+    /// \return The column.
+    public: ArrowColumn *AddColumn(const std::string &_name,
+        const ArrowColumn::Type _type, const bool _nullable = false,
+        ArrowDictionary *_dictionary = nullptr)
+    {
+      this->columns.emplace_back(
+          new ArrowColumn(_name, _type, _nullable, _dictionary));
+      return this->columns.back().get();
+    }
+
+    /// \brief Create the file and write the schema.
+    /// \param[in] _path Path to the file.
+    /// \return True if the file was created.
+    public: bool Open(const std::string &_path)
+    {
+      this->output.open(_path, std::ios::out | std::ios::binary);
+      if (!this->output.is_open())
+        return false;
+
+      std::vector<FbNodePtr> fields;
+      for (const auto &column : this->columns)
+        fields.push_back(column->Field());
+      auto schema = FbNode::Table();
+      schema->Scalar(0, int16_t(0)).Offset(1, FbNode::Tables(fields));
+      this->WriteMessage(kArrowSchema, schema, std::string());
+      return true;
+    }
+
+    /// \brief Finish the current row, once all the columns are appended.
+    public: void EndRow()
+    {
+      if (++this->rows >= kArrowBatchRows)
+        this->WriteBatch();
+    }
+
+    /// \brief Write the last batch and the end of the stream.
+    /// \return True if the file was written.
+    public: bool Close()
+    {
+      if (this->rows > 0)
+        this->WriteBatch();
+      append(this->pending, kArrowContinuation);
+      append(this->pending, uint32_t(0));
+      this->output.write(this->pending.data(), this->pending.size());
+      this->output.close();
+      return !this->output.fail();
+    }
+
+    /// \brief Write the new values of the dictionaries, and the current rows
+    /// as a record batch.
+    private: void WriteBatch()
+    {
+      for (const auto &dictionary : this->dictionaries)
+      {
+        if (dictionary->sent &&
+            dictionary->written == dictionary->values.size())
+        {
+          continue;
+        }
+
+        // A single utf8 column with the new values.
+        std::string offsets;
+        std::string data;
+        append(offsets, int32_t(0));
+        for (size_t i = dictionary->written; i < dictionary->values.size();
+             ++i)
+        {
+          data += dictionary->values[i];
+          append(offsets, static_cast<int32_t>(data.size()));
+        }
+        const size_t count = dictionary->values.size() - dictionary->written;
+        ArrowBatchBody body;
+        body.AddNode(count, 0);
+        body.AddBuffer(std::string());
+        body.AddBuffer(offsets);
+        body.AddBuffer(data);
+
+        auto batch = FbNode::Table();
+        batch->Scalar(0, dictionary->id)
+          .Offset(1, body.RecordBatch(count))
+          .Scalar(2, static_cast<uint8_t>(dictionary->sent));
+        this->WriteMessage(kArrowDictionaryBatch, batch, body.body);
+        dictionary->written = dictionary->values.size();
+        dictionary->sent = true;
+      }
+
+      ArrowBatchBody body;
+      for (const auto &column : this->columns)
+      {
+        body.AddNode(column->length, column->nulls);
+        body.AddBuffer(column->nulls > 0 ? column->validity : std::string());
+        body.AddBuffer(column->values);
+        column->values.clear();
+        column->validity.clear();
+        column->length = 0;
+        column->nulls = 0;
+      }
+      this->WriteMessage(kArrowRecordBatch, body.RecordBatch(this->rows),
+          body.body);
+      this->rows = 0;
+    }
+
+    /// \brief Write a message: its metadata and its body.
+    /// \param[in] _type Type of the header.
+    /// \param[in] _header The header.
+    /// \param[in] _body The body.
+    private: void WriteMessage(const ArrowMessageType _type,
+        const FbNodePtr &_header, const std::string &_body)
+    {
+      auto message = FbNode::Table();
+      message->Scalar(0, kArrowMetadataVersion)
+        .Scalar(1, static_cast<uint8_t>(_type))
+        .Offset(2, _header)
+        .Scalar(3, static_cast<int64_t>(_body.size()));
+
+      std::string metadata;
+      append(metadata, uint32_t(0));
+      patch(metadata, 0, static_cast<uint32_t>(message->Serialize(metadata)));
+      padTo(metadata, sizeof(uint64_t));
+
+      append(this->pending, kArrowContinuation);
+      append(this->pending, static_cast<int32_t>(metadata.size()));
+      this->pending += metadata;
+      this->pending += _body;
+      this->output.write(this->pending.data(), this->pending.size());
+      this->pending.clear();
+    }
+
+    /// \brief Columns, in the order of the schema.
+    private: std::vector<std::unique_ptr<ArrowColumn>> columns;
+
+    /// \brief Dictionaries, by ID.
+    private: std::vector<std::unique_ptr<ArrowDictionary>> dictionaries;
+
+    /// \brief Number of rows in the current batch.
+    private: size_t rows = 0;
+
+    /// \brief Output file.
+    private: std::ofstream output;
+
+    /// \brief Message being written, reused between messages.
+    private: std::string pending;
+  };
+
+  /// \brief The tables of a log.
+  class ArrowExport
+  {
+    /// \brief Constructor. Define the columns of the tables.
+    public: ArrowExport()
+    {
+      typedef ArrowColumn C;
+
+      this->brokerTime = this->broker.AddColumn("time", C::kFloat64);
+      this->numUnicast = this->broker.AddColumn("num_unicast", C::kInt32);
+      this->numBroadcast =
+          this->broker.AddColumn("num_broadcast", C::kInt32);
+      this->numMulticast =
+          this->broker.AddColumn("num_multicast", C::kInt32);
+      this->bytesSent = this->broker.AddColumn("bytes_sent", C::kInt32);
+      this->msgsDelivered =
+          this->broker.AddColumn("msgs_delivered", C::kInt32);
+      this->potentialRecipients =
+          this->broker.AddColumn("potential_recipients", C::kInt32);
+      this->avgNeighbors =
+          this->broker.AddColumn("avg_neighbors", C::kFloat64);
+
+      ArrowDictionary *ids = this->robots.AddDictionary();
+      ArrowDictionary *models = this->robots.AddDictionary();
+      this->robotTime = this->robots.AddColumn("time", C::kFloat64);
+      this->robotId = this->robots.AddColumn("id", C::kString, false, ids);
+      this->model = this->robots.AddColumn("model_name", C::kString, true,
+          models);
+      const char *sensorNames[] =
+      {
+        "latitude", "longitude", "altitude", "linvel_x", "linvel_y",
+        "linvel_z", "angvel_x", "angvel_y", "angvel_z", "orientation_w",
+        "orientation_x", "orientation_y", "orientation_z", "bearing",
+        "battery_capacity"
+      };
+      for (const char *name : sensorNames)
+      {
+        this->sensors.push_back(
+            this->robots.AddColumn(name, C::kFloat64, true));
+      }
+      this->numObjects =
+          this->robots.AddColumn("num_objects", C::kInt32, true);
+      const char *actionNames[] =
+      {
+        "cmd_linvel_x", "cmd_linvel_y", "cmd_linvel_z", "cmd_angvel_x",
+        "cmd_angvel_y", "cmd_angvel_z"
+      };
+      for (const char *name : actionNames)
+      {
+        this->actions.push_back(
+            this->robots.AddColumn(name, C::kFloat64, true));
+      }
+
+      ArrowDictionary *addresses = this->messages.AddDictionary();
+      this->msgTime = this->messages.AddColumn("time", C::kFloat64);
+      this->src = this->messages.AddColumn("src_address", C::kString, false,
+          addresses);
+      this->dst = this->messages.AddColumn("dst_address", C::kString, false,
+          addresses);
+      this->dstPort = this->messages.AddColumn("dst_port", C::kUInt32);
+      this->size = this->messages.AddColumn("size", C::kUInt32);
+      this->neighbor = this->messages.AddColumn("neighbor", C::kString, true,
+          addresses);
+      this->status = this->messages.AddColumn("status", C::kInt8, true);
+
+      this->booTime = this->boo.AddColumn("time", C::kFloat64);
+      this->timeSeen = this->boo.AddColumn("time_seen", C::kFloat64);
+      this->posX = this->boo.AddColumn("x", C::kFloat64);
+      this->posY = this->boo.AddColumn("y", C::kFloat64);
+      this->posZ = this->boo.AddColumn("z", C::kFloat64);
+      this->succeed = this->boo.AddColumn("succeed", C::kBool);
+    }
+
+    /// \brief Export a log.
+    /// \param[in] _parser The log.
+    /// \param[in] _dir Output directory.
+    /// \return True if the tables were written.
+    public: bool Run(swarm::LogParser &_parser,
+                     const boost::filesystem::path &_dir)
+    {
+      if (!this->broker.Open((_dir / "broker_stats.arrows").string()) ||
+          !this->robots.Open((_dir / "robots.arrows").string()) ||
+          !this->messages.Open((_dir / "messages.arrows").string()) ||
+          !this->boo.Open((_dir / "boo_reports.arrows").string()))
+      {
+        std::cerr << "Unable to create the tables in [" << _dir.string()
+                  << "]" << std::endl;
+        return false;
+      }
+
+      if (_parser.Minimal())
+      {
+        swarm::msgs::LogEntryMin entry;
+        const char *record;
+        int32_t recordSize;
+        while (_parser.NextSerialized(record, recordSize))
+        {
+          if (entry.ParseFromArray(record, recordSize))
+            this->AddEntry(entry);
+        }
+      }
+      else
+      {
+        for (const auto &entry : _parser.Entries())
+          this->AddEntry(entry);
+      }
+
+      const bool brokerWritten = this->broker.Close();
+      const bool robotsWritten = this->robots.Close();
+      const bool messagesWritten = this->messages.Close();
+      const bool booWritten = this->boo.Close();
+      return brokerWritten && robotsWritten && messagesWritten && booWritten;
+    }
+
+    /// \brief Add the rows of a minimal entry.
+    /// \param[in] _entry The entry.
+    private: void AddEntry(const swarm::msgs::LogEntryMin &_entry)
+    {
+      // Only the broker logs the comms counters.
+      if (_entry.has_num_unicast())
+      {
+        this->brokerTime->Append(_entry.time());
+        this->numUnicast->Append(_entry.num_unicast());
+        this->numBroadcast->Append(_entry.num_broadcast());
+        this->numMulticast->Append(_entry.num_multicast());
+        this->bytesSent->Append(_entry.bytes_sent());
+        this->msgsDelivered->Append(_entry.msgs_delivered());
+        this->potentialRecipients->Append(_entry.potential_recipients());
+        this->avgNeighbors->Append(_entry.avg_neighbors());
+        this->broker.EndRow();
+      }
+
+      for (const auto &report : _entry.boo_report())
+        this->AddBooReport(_entry.time(), report);
+    }
+
+    /// \brief Add the rows of an entry.
+    /// \param[in] _entry The entry.
+    private: void AddEntry(const swarm::msgs::LogEntry &_entry)
+    {
+      if (_entry.has_sensors() || _entry.has_actions())
+      {
+        this->robotTime->Append(_entry.time());
+        this->robotId->Append(_entry.id());
+        if (_entry.has_model_name())
+          this->model->Append(_entry.model_name());
+        else
+          this->model->AppendNull();
+
+        const auto &s = _entry.sensors();
+        const auto &imu = s.imu();
+        const double sensorValues[] =
+        {
+          s.gps().latitude(), s.gps().longitude(), s.gps().altitude(),
+          imu.linvel().x(), imu.linvel().y(), imu.linvel().z(),
+          imu.angvel().x(), imu.angvel().y(), imu.angvel().z(),
+          imu.orientation().w(), imu.orientation().x(),
+          imu.orientation().y(), imu.orientation().z(), s.bearing(),
+          s.battery_capacity()
+        };
+        for (size_t i = 0; i < this->sensors.size(); ++i)
+        {
+          if (_entry.has_sensors())
+            this->sensors[i]->Append(sensorValues[i]);
+          else
+            this->sensors[i]->AppendNull();
+        }
+        if (_entry.has_sensors())
+          this->numObjects->Append(s.image().object_size());
+        else
+          this->numObjects->AppendNull();
+
+        const auto &a = _entry.actions();
+        const double actionValues[] =
+        {
+          a.linvel().x(), a.linvel().y(), a.linvel().z(),
+          a.angvel().x(), a.angvel().y(), a.angvel().z()
+        };
+        for (size_t i = 0; i < this->actions.size(); ++i)
+        {
+          if (_entry.has_actions())
+            this->actions[i]->Append(actionValues[i]);
+          else
+            this->actions[i]->AppendNull();
+        }
+        this->robots.EndRow();
+      }
+
+      for (const auto &msg : _entry.incoming_msgs().message())
+      {
+        // A message without neighbors still has a row.
+        const int rows = std::max(1, msg.neighbor_size());
+        for (int i = 0; i < rows; ++i)
+        {
+          this->msgTime->Append(_entry.time());
+          this->src->Append(msg.src_address());
+          this->dst->Append(msg.dst_address());
+          this->dstPort->Append(msg.dst_port());
+          this->size->Append(msg.size());
+          if (i < msg.neighbor_size())
+          {
+            this->neighbor->Append(msg.neighbor(i).dst());
+            this->status->Append(msg.neighbor(i).status());
+          }
+          else
+          {
+            this->neighbor->AppendNull();
+            this->status->AppendNull();
+          }
+          this->messages.EndRow();
+        }
+      }
+
+      for (const auto &report : _entry.boo_report())
+        this->AddBooReport(_entry.time(), report);
+    }
+
+    /// \brief Add a report of the lost person.
+    /// \param[in] _time Simulation time of the entry.
+    /// \param[in] _report The report.
+    private: void AddBooReport(const double _time,
+                               const swarm::msgs::BooReport &_report)
+    {
+      this->booTime->Append(_time);
+      this->timeSeen->Append(_report.time_seen());
+      this->posX->Append(_report.pos_seen().x());
+      this->posY->Append(_report.pos_seen().y());
+      this->posZ->Append(_report.pos_seen().z());
+      this->succeed->Append(_report.succeed());
+      this->boo.EndRow();
+    }
+
+    /// \brief Comms counters of each step.
+    private: ArrowTable broker;
+
+    /// \brief Sensors and actions of the robots.
+    private: ArrowTable robots;
+
+    /// \brief Messages sent, by neighbor.
+    private: ArrowTable messages;
+
+    /// \brief Reports of the lost person.
+    private: ArrowTable boo;
+
+    /// \brief Columns of the broker table.
+    private: ArrowColumn *brokerTime, *numUnicast, *numBroadcast,
+                         *numMulticast, *bytesSent, *msgsDelivered,
+                         *potentialRecipients, *avgNeighbors;
+
+    /// \brief Columns of the robots table.
+    private: ArrowColumn *robotTime, *robotId, *model, *numObjects;
+
+    /// \brief Sensor columns of the robots table.
+    private: std::vector<ArrowColumn *> sensors;
+
+    /// \brief Action columns of the robots table.
+    private: std::vector<ArrowColumn *> actions;
+
+    /// \brief Columns of the messages table.
+    private: ArrowColumn *msgTime, *src, *dst, *dstPort, *size, *neighbor,
+                         *status;
+
+    /// \brief Columns of the BOO reports table.
+    private: ArrowColumn *booTime, *timeSeen, *posX, *posY, *posZ,
+                         *succeed;
+  };
+}
+
+//////////////////////////////////////////////////
+bool exportArrow(swarm::LogParser &_parser, const std::string &_dir)
+{
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(_dir, ec);
+  if (ec)
+  {
+    std::cerr << "Unable to create [" << _dir << "]: " << ec.message()
+              << std::endl;
+    return false;
+  }
+
+  ArrowExport arrowExport;
+  return arrowExport.Run(_parser, _dir);
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file swarmlog_arrow.hh
+/// \brief Columnar export of Swarm log files.
+
+#ifndef __SWARM_SWARMLOG_ARROW_HH__
+#define __SWARM_SWARMLOG_ARROW_HH__
+
+#include <string>
+#include "swarm/LogParser.hh"
+
+/// \brief Export the entries of a log, from the current position of the
+/// parser, as tables in the Apache Arrow IPC streaming format. Each table
+/// is written to <table>.arrows in the output directory:
+///   broker_stats: the comms counters of each step (minimal logs).
+///   robots: the sensors and the actions of each robot at each step.
+///   messages: one row per message and neighbor, with the comms status.
+///   boo_reports: the reports of the lost person.
+/// The rows are written in record batches of kArrowBatchRows rows, and the
+/// IDs and addresses are dictionary encoded, with the new values of each
+/// batch sent as a dictionary delta. The tables can be read with e.g.
+/// pyarrow.ipc.open_stream() or polars.read_ipc_stream().
+/// \param[in] _parser The log.
+/// \param[in] _dir Output directory, created if needed.
+/// \return True if all the tables were written.
+bool exportArrow(swarm::LogParser &_parser, const std::string &_dir);
+
+#endif
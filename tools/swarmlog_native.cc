@@ -0,0 +1,610 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file swarmlog_native.cc
+/// \brief Python module reading the columns of Swarm log files.
+///
+/// The module decodes the logs with the LogParser, and the records of the
+/// minimal logs in place, and returns batches of rows as one buffer of
+/// little endian values per column, e.g. with swarmlog_reader.read_columns():
+///
+///   reader = swarmlog_native.Reader('swarm.log', 'broker')
+///   batch = reader.next_batch(65536)
+///   numpy.frombuffer(batch['bytes_sent'], dtype='<i4')
+///
+/// The tables have the columns of the Arrow export of swarmlog:
+///   broker: the comms counters of each step, from the minimal logs, or
+///     computed from the messages and the visibility of the full logs.
+///   robots: the sensors and the actions of each robot at each step (full
+///     logs). The IDs are codes into Reader.ids(), the values missing from
+///     an entry are NaN, and num_objects is -1 without sensors.
+
+#include <Python.h>
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "msgs/log_entry.pb.h"
+#include "msgs/log_entry_min.pb.h"
+#include "msgs/log_header.pb.h"
+#include "swarm/LogFormat.hh"
+#include "swarm/LogParser.hh"
+#include "swarm/LogRecords.hh"
+
+#if PY_MAJOR_VERSION >= 3
+  #define SWARM_PY_STRING PyUnicode_FromString
+#else
+  #define SWARM_PY_STRING PyString_FromString
+#endif
+
+namespace
+{
+  /// \brief Size of the header of a message, as counted by the broker.
+  const int kMsgOverhead = 56;
+
+  /// \brief A column of a table.
+  struct Column
+  {
+    /// \brief Name of the column.
+    const char *name;
+
+    /// \brief NumPy type of the values.
+    const char *dtype;
+  };
+
+  /// \brief Columns of the broker table.
+  const Column kBrokerColumns[] =
+  {
+    {"time", "<f8"}, {"num_unicast", "<i4"}, {"num_broadcast", "<i4"},
+    {"num_multicast", "<i4"}, {"bytes_sent", "<i4"},
+    {"msgs_delivered", "<i4"}, {"potential_recipients", "<i4"},
+    {"avg_neighbors", "<f8"}
+  };
+
+  /// \brief Columns of the robots table.
+  const Column kRobotColumns[] =
+  {
+    {"time", "<f8"}, {"id", "<i4"}, {"latitude", "<f8"},
+    {"longitude", "<f8"}, {"altitude", "<f8"}, {"linvel_x", "<f8"},
+    {"linvel_y", "<f8"}, {"linvel_z", "<f8"}, {"angvel_x", "<f8"},
+    {"angvel_y", "<f8"}, {"angvel_z", "<f8"}, {"orientation_w", "<f8"},
+    {"orientation_x", "<f8"}, {"orientation_y", "<f8"},
+    {"orientation_z", "<f8"}, {"bearing", "<f8"},
+    {"battery_capacity", "<f8"}, {"num_objects", "<i4"},
+    {"cmd_linvel_x", "<f8"}, {"cmd_linvel_y", "<f8"},
+    {"cmd_linvel_z", "<f8"}, {"cmd_angvel_x", "<f8"},
+    {"cmd_angvel_y", "<f8"}, {"cmd_angvel_z", "<f8"}
+  };
+
+  /// \brief Reads the rows of a table of a log, batch after batch.
+  class TableReader
+  {
+    /// \brief The tables.
+    public: enum Table
+    {
+      /// \brief The comms counters of each step.
+      BROKER,
+
+      /// \brief The sensors and actions of the robots.
+      ROBOTS
+    };
+
+    /// \brief Open a log.
+    /// \param[in] _filename Path to the log.
+    /// \param[in] _table The table read.
+    /// \param[in] _start Simulation time of the first rows.
+    /// \param[in] _end Simulation time of the last rows.
+    /// \return True if the log was loaded.
+    public: bool Open(const std::string &_filename, const Table _table,
+                      const double _start, const double _end)
+    {
+      this->table = _table;
+      this->end = _end;
+      if (!this->parser.Load(_filename) || !this->parser.Header(this->header))
+        return false;
+
+      // The scalars of the minimal logs may be in fixed size records.
+      if (this->table == BROKER && this->parser.Minimal() &&
+          this->header.records())
+      {
+        if (!this->records.Load(swarm::LogRecordPath(_filename)))
+          return false;
+        this->nextRecord = this->records.Find(_start);
+        return true;
+      }
+
+      this->parser.Seek(_start);
+      return true;
+    }
+
+    /// \brief Get the columns of the table.
+    /// \param[out] _count Number of columns.
+    /// \return The columns.
+    public: const Column *Columns(size_t &_count) const
+    {
+      if (this->table == BROKER)
+      {
+        _count = sizeof(kBrokerColumns) / sizeof(kBrokerColumns[0]);
+        return kBrokerColumns;
+      }
+      _count = sizeof(kRobotColumns) / sizeof(kRobotColumns[0]);
+      return kRobotColumns;
+    }
+
+    /// \brief Read the next rows into the buffers of the columns.
+    /// \param[in] _rows Maximum number of rows.
+    /// \return Number of rows read, 0 at the end of the table.
+    public: size_t NextBatch(const size_t _rows)
+    {
+      size_t count;
+      this->Columns(count);
+      this->buffers.assign(count, std::string());
+      this->rows = 0;
+
+      if (this->records.Size() > 0)
+      {
+        for (; this->rows < _rows && this->nextRecord < this->records.Size();
+             ++this->nextRecord)
+        {
+          const swarm::LogMinRecord &record = this->records[this->nextRecord];
+          if (record.time > this->end)
+            break;
+          this->AddBroker(record.time, record.numUnicast,
+              record.numBroadcast, record.numMulticast, record.bytesSent,
+              record.msgsDelivered, record.potentialRecipients,
+              record.avgNeighbors);
+        }
+      }
+      else if (this->parser.Minimal())
+      {
+        // The minimal logs only have broker rows.
+        const char *record;
+        int32_t size;
+        while (this->table == BROKER && this->rows < _rows &&
+               this->parser.NextSerialized(record, size))
+        {
+          if (!this->minEntry.ParseFromArray(record, size))
+            continue;
+          if (this->minEntry.time() > this->end)
+            break;
+          if (!this->minEntry.has_num_unicast())
+            continue;
+
+          const swarm::msgs::LogEntryMin &e = this->minEntry;
+          this->AddBroker(e.time(), e.num_unicast(), e.num_broadcast(),
+              e.num_multicast(), e.bytes_sent(), e.msgs_delivered(),
+              e.potential_recipients(), e.avg_neighbors());
+        }
+      }
+      else
+      {
+        while (this->rows < _rows && this->parser.Next(this->entry))
+        {
+          if (this->entry.time() > this->end)
+            break;
+          if (this->table == BROKER)
+            this->AddComms(this->entry);
+          else
+            this->AddRobot(this->entry);
+        }
+      }
+
+      return this->rows;
+    }
+
+    /// \brief Get the buffer of a column of the last batch.
+    /// \param[in] _index Index of the column.
+    /// \return The values.
+    public: const std::string &Buffer(const size_t _index) const
+    {
+      return this->buffers[_index];
+    }
+
+    /// \brief Get the IDs of the robots, by code.
+    /// \return The IDs.
+    public: const std::vector<std::string> &Ids() const
+    {
+      return this->ids;
+    }
+
+    /// \brief Append a value to a column.
+    /// \param[in] _column Index of the column.
+    /// \param[in] _value The value.
+    private: template<typename T>
+             void Append(const size_t _column, const T _value)
+    {
+      this->buffers[_column].append(
+          reinterpret_cast<const char *>(&_value), sizeof(T));
+    }
+
+    /// \brief Add a row of the broker table.
+    /// \param[in] _time Simulation time.
+    /// \param[in] _unicast Number of unicast messages.
+    /// \param[in] _broadcast Number of broadcast messages.
+    /// \param[in] _multicast Number of multicast messages.
+    /// \param[in] _bytes Bytes sent.
+    /// \param[in] _delivered Messages delivered.
+    /// \param[in] _recipients Potential recipients.
+    /// \param[in] _neighbors Average number of neighbors.
+    private: void AddBroker(const double _time, const int32_t _unicast,
+                            const int32_t _broadcast,
+                            const int32_t _multicast, const int32_t _bytes,
+                            const int32_t _delivered,
+                            const int32_t _recipients,
+                            const double _neighbors)
+    {
+      this->Append(0, _time);
+      this->Append(1, _unicast);
+      this->Append(2, _broadcast);
+      this->Append(3, _multicast);
+      this->Append(4, _bytes);
+      this->Append(5, _delivered);
+      this->Append(6, _recipients);
+      this->Append(7, _neighbors);
+      ++this->rows;
+    }
+
+    /// \brief Add the comms counters of a full entry, if it has the
+    /// messages sent and the visibility, like the report of swarmlog.
+    /// \param[in] _entry The entry.
+    private: void AddComms(const swarm::msgs::LogEntry &_entry)
+    {
+      if (!_entry.has_incoming_msgs() || !_entry.has_time() ||
+          !this->parser.Visibility(_entry, this->visibility))
+      {
+        return;
+      }
+
+      int32_t unicast = 0, broadcast = 0, multicast = 0, bytes = 0;
+      int32_t delivered = 0, recipients = 0;
+      for (const auto &msg : _entry.incoming_msgs().message())
+      {
+        if (msg.dst_address() == "broadcast")
+          ++broadcast;
+        else if (msg.dst_address() == "multicast")
+          ++multicast;
+        else
+          ++unicast;
+
+        bytes += msg.size() + kMsgOverhead;
+        for (const auto &neighbor : msg.neighbor())
+        {
+          ++recipients;
+          if (neighbor.status() == swarm::msgs::DELIVERED)
+            ++delivered;
+        }
+      }
+
+      int numRobots = 0;
+      int numNeighbors = 0;
+      for (const auto &row : this->visibility.row())
+      {
+        if (row.src() == "boo")
+          continue;
+
+        ++numRobots;
+        for (const auto &neighbor : row.entry())
+        {
+          if (neighbor.status() == 1)
+            ++numNeighbors;
+        }
+      }
+
+      this->AddBroker(_entry.time(), unicast, broadcast, multicast, bytes,
+          delivered, recipients,
+          numRobots > 0 ? numNeighbors / static_cast<double>(numRobots) : 0);
+    }
+
+    /// \brief Add the sensors and the actions of a full entry, if any.
+    /// \param[in] _entry The entry.
+    private: void AddRobot(const swarm::msgs::LogEntry &_entry)
+    {
+      if (!_entry.has_sensors() && !_entry.has_actions())
+        return;
+
+      auto code = this->codes.find(_entry.id());
+      if (code == this->codes.end())
+      {
+        code = this->codes.emplace(_entry.id(),
+            static_cast<int32_t>(this->ids.size())).first;
+        this->ids.push_back(_entry.id());
+      }
+
+      const double nan = std::numeric_limits<double>::quiet_NaN();
+      const bool sensed = _entry.has_sensors();
+      const auto &s = _entry.sensors();
+      const auto &imu = s.imu();
+      const double sensorValues[] =
+      {
+        s.gps().latitude(), s.gps().longitude(), s.gps().altitude(),
+        imu.linvel().x(), imu.linvel().y(), imu.linvel().z(),
+        imu.angvel().x(), imu.angvel().y(), imu.angvel().z(),
+        imu.orientation().w(), imu.orientation().x(),
+        imu.orientation().y(), imu.orientation().z(), s.bearing(),
+        s.battery_capacity()
+      };
+      const bool acted = _entry.has_actions();
+      const auto &a = _entry.actions();
+      const double actionValues[] =
+      {
+        a.linvel().x(), a.linvel().y(), a.linvel().z(),
+        a.angvel().x(), a.angvel().y(), a.angvel().z()
+      };
+
+      size_t column = 0;
+      this->Append(column++, _entry.time());
+      this->Append(column++, code->second);
+      for (const double value : sensorValues)
+        this->Append(column++, sensed ? value : nan);
+      this->Append(column++,
+          static_cast<int32_t>(sensed ? s.image().object_size() : -1));
+      for (const double value : actionValues)
+        this->Append(column++, acted ? value : nan);
+      ++this->rows;
+    }
+
+    /// \brief The table read.
+    private: Table table = BROKER;
+
+    /// \brief Simulation time of the last rows.
+    private: double end = std::numeric_limits<double>::infinity();
+
+    /// \brief The log.
+    private: swarm::LogParser parser;
+
+    /// \brief Header of the log.
+    private: swarm::msgs::LogHeader header;
+
+    /// \brief Records of the minimal log, if it has them.
+    private: swarm::LogRecords records;
+
+    /// \brief Index of the next record.
+    private: size_t nextRecord = 0;
+
+    /// \brief Entry being read, reused.
+    private: swarm::msgs::LogEntry entry;
+
+    /// \brief Minimal entry being read, reused.
+    private: swarm::msgs::LogEntryMin minEntry;
+
+    /// \brief Visibility of the entry being read, reused.
+    private: swarm::msgs::VisibilityMap visibility;
+
+    /// \brief Values of each column of the last batch.
+    private: std::vector<std::string> buffers;
+
+    /// \brief Number of rows of the last batch.
+    private: size_t rows = 0;
+
+    /// \brief IDs of the robots, by code.
+    private: std::vector<std::string> ids;
+
+    /// \brief Code of each ID.
+    private: std::map<std::string, int32_t> codes;
+  };
+
+  /// \brief The Python object of a reader.
+  struct ReaderObject
+  {
+    PyObject_HEAD
+
+    /// \brief The reader, null if it couldn't be opened.
+    TableReader *reader;
+  };
+
+  //////////////////////////////////////////////////
+  int readerInit(ReaderObject *_self, PyObject *_args, PyObject *_kwds)
+  {
+    static const char *keywords[] = {"logfile", "table", "start", "end",
+      nullptr};
+    const char *logfile;
+    const char *table;
+    double start = -std::numeric_limits<double>::infinity();
+    double end = std::numeric_limits<double>::infinity();
+    if (!PyArg_ParseTupleAndKeywords(_args, _kwds, "ss|dd",
+          const_cast<char **>(keywords), &logfile, &table, &start, &end))
+    {
+      return -1;
+    }
+
+    TableReader::Table kind;
+    if (std::string(table) == "broker")
+      kind = TableReader::BROKER;
+    else if (std::string(table) == "robots")
+      kind = TableReader::ROBOTS;
+    else
+    {
+      PyErr_Format(PyExc_ValueError, "Unknown table [%s]", table);
+      return -1;
+    }
+
+    delete _self->reader;
+    _self->reader = new TableReader();
+    if (!_self->reader->Open(logfile, kind, start, end))
+    {
+      delete _self->reader;
+      _self->reader = nullptr;
+      PyErr_Format(PyExc_IOError, "Unable to read the log [%s]", logfile);
+      return -1;
+    }
+
+    return 0;
+  }
+
+  //////////////////////////////////////////////////
+  void readerDealloc(ReaderObject *_self)
+  {
+    delete _self->reader;
+    Py_TYPE(_self)->tp_free(reinterpret_cast<PyObject *>(_self));
+  }
+
+  //////////////////////////////////////////////////
+  /// \brief Check that a reader was opened.
+  /// \param[in] _self The reader.
+  /// \return True if it was, otherwise the Python error is set.
+  bool readerOpened(ReaderObject *_self)
+  {
+    if (!_self->reader)
+      PyErr_SetString(PyExc_ValueError, "The reader isn't open");
+    return _self->reader != nullptr;
+  }
+
+  //////////////////////////////////////////////////
+  PyObject *readerColumns(ReaderObject *_self, PyObject *)
+  {
+    if (!readerOpened(_self))
+      return nullptr;
+
+    size_t count;
+    const Column *columns = _self->reader->Columns(count);
+    PyObject *list = PyList_New(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+      PyList_SET_ITEM(list, i,
+          Py_BuildValue("(ss)", columns[i].name, columns[i].dtype));
+    }
+    return list;
+  }
+
+  //////////////////////////////////////////////////
+  PyObject *readerIds(ReaderObject *_self, PyObject *)
+  {
+    if (!readerOpened(_self))
+      return nullptr;
+
+    const std::vector<std::string> &ids = _self->reader->Ids();
+    PyObject *list = PyList_New(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i)
+      PyList_SET_ITEM(list, i, SWARM_PY_STRING(ids[i].c_str()));
+    return list;
+  }
+
+  //////////////////////////////////////////////////
+  PyObject *readerNextBatch(ReaderObject *_self, PyObject *_args)
+  {
+    int rows = 65536;
+    if (!PyArg_ParseTuple(_args, "|i", &rows) || !readerOpened(_self))
+      return nullptr;
+
+    if (rows <= 0)
+    {
+      PyErr_SetString(PyExc_ValueError, "The batches need rows");
+      return nullptr;
+    }
+
+    // The log is decoded without holding the interpreter.
+    size_t read;
+    Py_BEGIN_ALLOW_THREADS
+    read = _self->reader->NextBatch(rows);
+    Py_END_ALLOW_THREADS
+
+    if (read == 0)
+      Py_RETURN_NONE;
+
+    size_t count;
+    const Column *columns = _self->reader->Columns(count);
+    PyObject *batch = PyDict_New();
+    for (size_t i = 0; i < count; ++i)
+    {
+      const std::string &buffer = _self->reader->Buffer(i);
+      PyObject *values =
+        PyBytes_FromStringAndSize(buffer.data(), buffer.size());
+      PyDict_SetItemString(batch, columns[i].name, values);
+      Py_DECREF(values);
+    }
+    return batch;
+  }
+
+  //////////////////////////////////////////////////
+  PyMethodDef readerMethods[] =
+  {
+    {"columns", reinterpret_cast<PyCFunction>(readerColumns), METH_NOARGS,
+      "Names and NumPy types of the columns."},
+    {"ids", reinterpret_cast<PyCFunction>(readerIds), METH_NOARGS,
+      "IDs of the robots seen so far, by code."},
+    {"next_batch", reinterpret_cast<PyCFunction>(readerNextBatch),
+      METH_VARARGS, "Read the next rows, or None at the end."},
+    {nullptr, nullptr, 0, nullptr}
+  };
+
+  PyTypeObject readerType =
+  {
+    PyVarObject_HEAD_INIT(nullptr, 0)
+    "swarmlog_native.Reader",
+    sizeof(ReaderObject),
+  };
+
+  //////////////////////////////////////////////////
+  /// \brief Set up the type of the readers.
+  /// \return True if the type is ready.
+  bool readyReaderType()
+  {
+    readerType.tp_flags = Py_TPFLAGS_DEFAULT;
+    readerType.tp_doc = "Reader(logfile, table, start, end) reads the "
+      "'broker' or 'robots' table of a Swarm log in batches.";
+    readerType.tp_methods = readerMethods;
+    readerType.tp_init = reinterpret_cast<initproc>(readerInit);
+    readerType.tp_dealloc = reinterpret_cast<destructor>(readerDealloc);
+    readerType.tp_new = PyType_GenericNew;
+    return PyType_Ready(&readerType) >= 0;
+  }
+}
+
+#if PY_MAJOR_VERSION >= 3
+static PyModuleDef swarmlogModule =
+{
+  PyModuleDef_HEAD_INIT, "swarmlog_native",
+  "Columns of Swarm log files.", -1, nullptr
+};
+
+//////////////////////////////////////////////////
+PyMODINIT_FUNC PyInit_swarmlog_native()
+{
+  if (!readyReaderType())
+    return nullptr;
+
+  PyObject *module = PyModule_Create(&swarmlogModule);
+  if (!module)
+    return nullptr;
+
+  Py_INCREF(&readerType);
+  PyModule_AddObject(module, "Reader",
+      reinterpret_cast<PyObject *>(&readerType));
+  return module;
+}
+#else
+//////////////////////////////////////////////////
+PyMODINIT_FUNC initswarmlog_native()
+{
+  if (!readyReaderType())
+    return;
+
+  PyObject *module = Py_InitModule3("swarmlog_native", nullptr,
+      "Columns of Swarm log files.");
+  if (!module)
+    return;
+
+  Py_INCREF(&readerType);
+  PyModule_AddObject(module, "Reader",
+      reinterpret_cast<PyObject *>(&readerType));
+}
+#endif
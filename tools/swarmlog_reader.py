@@ -0,0 +1,185 @@
+#!/usr/bin/env python
+
+# A class to read Swarm log files, in the flat format and in the block format
+# of include/swarm/LogFormat.hh.
+
+import bisect, os, struct, zlib
+from swarm import log_entry_pb2, log_header_pb2
+
+BLOCK_MAGIC = b'SWLOG002'
+INDEX_MAGIC = b'SWIDX002'
+BLOCK_HEADER = struct.Struct('<IIdI')
+INDEX_ENTRY = struct.Struct('<QdI')
+
+class LogReader:
+    # With expand_visibility, the visibility of the entries logged as changes
+    # (see VisibilityDelta in log_entry.proto) is rebuilt into their
+    # visibility field
+    def __init__(self, logfile, expand_visibility=True):
+        self.logfile = logfile
+        self.expand_visibility = expand_visibility
+        self.visibility_addresses = []
+        self.visibility_status = None
+        self.stream = open(logfile, 'rb')
+        self.compressed = self.stream.read(len(BLOCK_MAGIC)) == BLOCK_MAGIC
+        if not self.compressed:
+            self.stream.seek(0)
+
+        # The first message in the log is a LogHeader; the rest are LogEntry
+        size = struct.unpack('<I', self.stream.read(4))[0]
+        self.header = log_header_pb2.LogHeader()
+        self.header.ParseFromString(self.stream.read(size))
+        self.data_start = self.stream.tell()
+
+        # Offset, time of the first entry and number of entries of each block
+        self.blocks = []
+        self.block = b''
+        self.block_pos = 0
+        self.next_block = 0
+        if self.compressed:
+            self._load_index()
+
+    # Load the index at the end of the log, or walk over the blocks when the
+    # log has no index
+    def _load_index(self):
+        self.stream.seek(0, os.SEEK_END)
+        file_size = self.stream.tell()
+        tail = 8 + len(INDEX_MAGIC)
+        if file_size - self.data_start >= tail:
+            self.stream.seek(file_size - tail)
+            index_offset = struct.unpack('<Q', self.stream.read(8))[0]
+            if self.stream.read(len(INDEX_MAGIC)) == INDEX_MAGIC:
+                self.stream.seek(index_offset)
+                count = struct.unpack('<I', self.stream.read(4))[0]
+                data = self.stream.read(count * INDEX_ENTRY.size)
+                self.blocks = [
+                    INDEX_ENTRY.unpack_from(data, i * INDEX_ENTRY.size)
+                    for i in range(count)]
+                return
+
+        offset = self.data_start
+        while offset + BLOCK_HEADER.size <= file_size:
+            self.stream.seek(offset)
+            compressed_size, _, time, entries = BLOCK_HEADER.unpack(
+                self.stream.read(BLOCK_HEADER.size))
+            end = offset + BLOCK_HEADER.size + compressed_size
+            if end > file_size:
+                break
+            self.blocks.append((offset, time, entries))
+            offset = end
+
+    # Decompress a block
+    def _read_block(self, index):
+        self.stream.seek(self.blocks[index][0])
+        compressed_size, _, _, _ = BLOCK_HEADER.unpack(
+            self.stream.read(BLOCK_HEADER.size))
+        self.block = zlib.decompress(self.stream.read(compressed_size))
+        self.block_pos = 0
+        self.next_block = index + 1
+
+    # Get the next message
+    def next(self):
+        if self.compressed:
+            while self.block_pos >= len(self.block):
+                if self.next_block >= len(self.blocks):
+                    return None
+                self._read_block(self.next_block)
+            size = struct.unpack_from('<I', self.block, self.block_pos)[0]
+            self.block_pos += 4
+            msg = self.block[self.block_pos:self.block_pos + size]
+            self.block_pos += size
+        else:
+            # Read the 4-byte size field
+            sizestring = self.stream.read(4)
+            if len(sizestring) < 4:
+                return None
+            size = struct.unpack('<I', sizestring)[0]
+            msg = self.stream.read(size)
+
+        # Make a protobuf message out of it
+        pbmsg = log_entry_pb2.LogEntry()
+        pbmsg.ParseFromString(msg)
+        if pbmsg.HasField('visibility_delta'):
+            self._apply_visibility_delta(pbmsg)
+        return pbmsg
+
+    # Update the visibility with the changes of an entry, or its keyframe
+    def _apply_visibility_delta(self, entry):
+        delta = entry.visibility_delta
+        if len(delta.address) > 0:
+            self.visibility_addresses = list(delta.address)
+            self.visibility_status = bytearray(delta.status)
+        elif self.visibility_status is not None:
+            for pair, status in zip(delta.changed_pair, delta.changed_status):
+                self.visibility_status[pair] = status
+        if not self.expand_visibility or self.visibility_status is None:
+            return
+
+        n = len(self.visibility_addresses)
+        for a in range(n):
+            row = entry.visibility.row.add()
+            row.src = self.visibility_addresses[a]
+            for b in range(n):
+                neighbor = row.entry.add()
+                neighbor.dst = self.visibility_addresses[b]
+                neighbor.status = self.visibility_status[a * n + b]
+
+    # Move to the first entry at or after a simulation time, so next() returns
+    # it. Returns False if there is no such entry.
+    def seek(self, time):
+        # The visibility is unknown until the next keyframe
+        self.visibility_status = None
+        if not self.compressed:
+            self.stream.seek(self.data_start)
+            while True:
+                pos = self.stream.tell()
+                msg = self.next()
+                if msg is None:
+                    return False
+                if msg.time >= time:
+                    self.stream.seek(pos)
+                    return True
+
+        # The entries of a simulation time are never split between blocks
+        times = [block[1] for block in self.blocks]
+        index = max(bisect.bisect_left(times, time) - 1, 0)
+        for index in range(index, len(self.blocks)):
+            self._read_block(index)
+            while self.block_pos < len(self.block):
+                pos = self.block_pos
+                msg = self.next()
+                if msg.time >= time:
+                    self.block_pos = pos
+                    return True
+        self.block = b''
+        self.next_block = len(self.blocks)
+        return False
+
+    # Apply a given function to each message in the file
+    def apply(self, func):
+        while True:
+            msg = self.next()
+            if msg is None:
+                break
+            func(msg)
+
+# Read a table of a log with the swarmlog_native module, built by
+# tools/CMakeLists.txt, and yield its rows in batches: a dict of NumPy arrays,
+# one per column. The tables are 'broker', the comms counters of each step,
+# and 'robots', the sensors and the actions of the robots
+def read_columns(logfile, table, rows=65536, start=float('-inf'),
+                 end=float('inf')):
+    import numpy
+    import swarmlog_native
+    reader = swarmlog_native.Reader(logfile, table, start, end)
+    dtypes = dict(reader.columns())
+    while True:
+        batch = reader.next_batch(rows)
+        if batch is None:
+            break
+        columns = dict((name, numpy.frombuffer(values, dtype=dtypes[name]))
+                       for name, values in batch.items())
+        # The module gives the IDs of the robots as codes
+        if 'id' in columns:
+            columns['id'] = numpy.array(reader.ids())[columns['id']]
+        yield columns
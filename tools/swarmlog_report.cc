@@ -0,0 +1,802 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+#include <zlib.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/filesystem/operations.hpp>
+#include "swarm/LogParser.hh"
+#include "swarm/LogRecords.hh"
+#include "swarm/RunSummary.hh"
+#include "msgs/log_entry_min.pb.h"
+#include "msgs/log_entry.pb.h"
+#include "msgs/log_header.pb.h"
+#include "msgs/run_summary.pb.h"
+#include "swarmlog_report.hh"
+
+namespace
+{
+  /// \brief Serializes the messages printed by the threads.
+  std::mutex outputMutex;
+
+  /// \brief Size of the buffer of the compressed JSON (bytes).
+  const size_t kDeflateBufferSize = 1 << 16;
+
+  /// \brief Bytes added to the payload of each message sent, for the
+  /// headers.
+  const int kMsgOverhead = 56;
+
+  /// \brief Default maximum duration of a run, used by the score (seconds).
+  const double kDefaultMaxDuration = 7200;
+
+  /// \brief Default maximum number of wrong reports, used by the score.
+  const unsigned int kDefaultMaxWrongReports = 20;
+
+  /// \brief Subsystems timed in msgs::StepTimings, as reported in the
+  /// summary.
+  const char *kTimingNames[] =
+  {
+    "comms_model", "notify_neighbors", "dispatch", "delivery", "logger",
+    "poses", "sensors", "controllers", "actuation"
+  };
+
+  /// \brief Number of subsystems timed.
+  const size_t kNumTimings = sizeof(kTimingNames) / sizeof(kTimingNames[0]);
+
+  //////////////////////////////////////////////////
+  /// \brief Whether a formatted number parses back to the same value, bit
+  /// for bit.
+  /// \param[in] _buffer The formatted number.
+  /// \param[in] _value The value.
+  /// \return True if the number is exact.
+  bool roundTrips(const char *_buffer, const double _value)
+  {
+    const double parsed = std::strtod(_buffer, nullptr);
+    return std::memcmp(&parsed, &_value, sizeof(parsed)) == 0;
+  }
+
+  //////////////////////////////////////////////////
+  /// \brief Format a number the way the previous Ruby reports did: the
+  /// shortest representation that parses back to the same value, with at
+  /// least one decimal.
+  /// \param[in] _value The number.
+  /// \return The formatted number.
+  std::string formatFloat(const double _value)
+  {
+    if (std::isnan(_value))
+      return "NaN";
+    if (std::isinf(_value))
+      return _value > 0 ? "Infinity" : "-Infinity";
+
+    char buffer[64];
+    const double magnitude = std::fabs(_value);
+    if (std::fpclassify(_value) == FP_ZERO ||
+        (magnitude >= 1e-4 && magnitude < 1e16))
+    {
+      for (int decimals = 1; decimals <= 17; ++decimals)
+      {
+        snprintf(buffer, sizeof(buffer), "%.*f", decimals, _value);
+        if (roundTrips(buffer, _value))
+          break;
+      }
+      return buffer;
+    }
+
+    for (int digits = 1; digits <= 17; ++digits)
+    {
+      snprintf(buffer, sizeof(buffer), "%.*e", digits, _value);
+      if (roundTrips(buffer, _value))
+        break;
+    }
+    return buffer;
+  }
+
+  //////////////////////////////////////////////////
+  /// \brief Quote a string for JSON.
+  /// \param[in] _str The string.
+  /// \return The quoted string.
+  std::string jsonString(const std::string &_str)
+  {
+    std::string quoted = "\"";
+    for (const char c : _str)
+    {
+      if (c == '"' || c == '\\')
+      {
+        quoted += '\\';
+        quoted += c;
+      }
+      else if (static_cast<unsigned char>(c) < 0x20)
+      {
+        char escaped[8];
+        snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        quoted += escaped;
+      }
+      else
+        quoted += c;
+    }
+    return quoted + "\"";
+  }
+
+  //////////////////////////////////////////////////
+  /// \brief Escape the '_' of a string for LaTeX.
+  /// \param[in] _str The string.
+  /// \return The escaped string.
+  std::string texString(const std::string &_str)
+  {
+    std::string escaped;
+    for (const char c : _str)
+    {
+      if (c == '_')
+        escaped += '\\';
+      escaped += c;
+    }
+    return escaped;
+  }
+
+  //////////////////////////////////////////////////
+  /// \brief Path to a chunk of a rotated log, following the names of
+  /// swarm::Logger::ChunkPath(), e.g. swarm.0001.log.
+  /// \param[in] _logFile Path to the first chunk, e.g. swarm.log.
+  /// \param[in] _chunk Index of the chunk, from 1.
+  /// \return The path.
+  std::string chunkPath(const std::string &_logFile, const unsigned int _chunk)
+  {
+    char index[16];
+    std::snprintf(index, sizeof(index), ".%04u", _chunk);
+    boost::filesystem::path path(_logFile);
+    const std::string extension = path.extension().string();
+    return path.replace_extension().string() + index + extension;
+  }
+
+  /// \brief Communication metrics of a simulation step: the scalars of
+  /// the records, with the bytes sent including the headers, and the
+  /// average number of neighbors of each robot if known.
+  class CommsStep : public swarm::LogMinRecord
+  {
+    /// \brief Whether avgNeighbors is known.
+    public: bool hasNeighbors = false;
+
+    /// \brief Senders and receivers of the messages, as a JSON array.
+    public: std::string msgs = "[]";
+  };
+
+  /// \brief Streams a zlib compressed file.
+  class DeflateFile
+  {
+    /// \brief Constructor.
+    public: DeflateFile()
+    {
+      this->stream.zalloc = Z_NULL;
+      this->stream.zfree = Z_NULL;
+      this->stream.opaque = Z_NULL;
+      deflateInit(&this->stream, Z_DEFAULT_COMPRESSION);
+    }
+
+    /// \brief Destructor.
+    public: ~DeflateFile()
+    {
+      deflateEnd(&this->stream);
+    }
+
+    /// \brief Open the file.
+    /// \param[in] _path Path to the file.
+    /// \return True if the file was opened.
+    public: bool Open(const std::string &_path)
+    {
+      this->output.open(_path, std::ios::out | std::ios::binary);
+      return this->output.is_open();
+    }
+
+    /// \brief Compress data at the end of the file.
+    /// \param[in] _data The data.
+    public: void Write(const std::string &_data)
+    {
+      this->Deflate(_data.data(), _data.size(), Z_NO_FLUSH);
+    }
+
+    /// \brief Write the end of the compressed stream and close the file.
+    /// \return True if the whole file was written.
+    public: bool Close()
+    {
+      this->Deflate(nullptr, 0, Z_FINISH);
+      this->output.close();
+      return !this->output.fail();
+    }
+
+    /// \brief Compress data into the file.
+    /// \param[in] _data The data.
+    /// \param[in] _size Size of the data (bytes).
+    /// \param[in] _flush Flush mode of deflate().
+    private: void Deflate(const char *_data, const size_t _size,
+                          const int _flush)
+    {
+      this->stream.next_in =
+          reinterpret_cast<Bytef *>(const_cast<char *>(_data));
+      this->stream.avail_in = _size;
+      do
+      {
+        this->stream.next_out = reinterpret_cast<Bytef *>(this->buffer);
+        this->stream.avail_out = sizeof(this->buffer);
+        deflate(&this->stream, _flush);
+        this->output.write(this->buffer,
+            sizeof(this->buffer) - this->stream.avail_out);
+      } while (this->stream.avail_out == 0);
+    }
+
+    /// \brief The compressed stream.
+    private: z_stream stream;
+
+    /// \brief Output file.
+    private: std::ofstream output;
+
+    /// \brief Compressed data waiting to be written.
+    private: char buffer[kDeflateBufferSize];
+  };
+
+  /// \brief Analyzes a log: writes the metrics of each simulation step and
+  /// accumulates the summary of the run.
+  class LogReport
+  {
+    /// \brief Constructor.
+    /// \param[in] _logFile Path to the log.
+    /// \param[in] _summaryOnly Whether only the summary is written, when the
+    /// log has the totals of its run.
+    public: LogReport(const std::string &_logFile, const bool _summaryOnly)
+      : logFile(_logFile), summaryOnly(_summaryOnly)
+    {
+    }
+
+    /// \brief Write all the report files next to the log, or only the
+    /// summary.
+    /// \return True if the log was analyzed.
+    public: bool Run()
+    {
+      if (!this->parser.Load(this->logFile) ||
+          !this->parser.Header(this->header))
+      {
+        return false;
+      }
+      this->summary = swarm::RunSummary(this->header);
+
+      // The totals written by the logger replace the ones of the entries.
+      const boost::filesystem::path dir =
+          boost::filesystem::path(this->logFile).parent_path();
+      swarm::msgs::RunSummary totals;
+      this->hasTotals = this->ReadTotals(totals);
+      if (this->hasTotals && this->summaryOnly)
+        return this->ToSummary(dir, totals);
+      this->csv = fopen((dir / "swarm.csv").string().c_str(), "w");
+      if (!this->csv ||
+          !this->commsJson.Open((dir / "swarm_comms.json.zip").string()))
+      {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::cerr << "Unable to write the comms report of ["
+                  << this->logFile << "]" << std::endl;
+        if (this->csv)
+          fclose(this->csv);
+        return false;
+      }
+
+      fprintf(this->csv, "# time, msg_sent, msg_freq, num_unicast, "
+          "num_broadcast, num_multicast, potential_recipients, "
+          "msgs_delivered, drop_ratio, bytes_sent, data_rate, "
+          "avg_num_neighbors\n");
+      this->commsJson.Write("[");
+
+      // A rotated log is analyzed as a whole, one chunk after the other.
+      for (unsigned int chunk = 1; ; ++chunk)
+      {
+        if (this->parser.Minimal())
+        {
+          this->ToCommsMin(chunk == 1 ? this->logFile :
+              chunkPath(this->logFile, chunk - 1));
+        }
+        else
+          this->ToComms();
+
+        const std::string next = chunkPath(this->logFile, chunk);
+        if (!this->header.has_chunk() || !boost::filesystem::exists(next) ||
+            !this->parser.Load(next))
+        {
+          break;
+        }
+      }
+
+      this->commsJson.Write("]");
+      const bool written = this->commsJson.Close() && fclose(this->csv) == 0;
+      if (!this->hasTotals)
+        totals = this->summary.Totals();
+      return this->ToSummary(dir, totals) && written;
+    }
+
+    /// \brief Read the totals of the run written next to the log, if they
+    /// were written once the log was complete.
+    /// \param[out] _totals The totals.
+    /// \return True if the log has its totals.
+    private: bool ReadTotals(swarm::msgs::RunSummary &_totals) const
+    {
+      const std::string path = swarm::RunSummaryPath(this->logFile);
+      boost::system::error_code ec;
+      if (!this->header.has_timestamp() ||
+          !boost::filesystem::exists(path, ec) ||
+          boost::filesystem::last_write_time(path, ec) <
+          boost::filesystem::last_write_time(this->logFile, ec) ||
+          !swarm::RunSummary::Read(path, _totals))
+      {
+        return false;
+      }
+      return _totals.timestamp() == this->header.timestamp();
+    }
+
+    /// \brief Go over a log of msgs::LogEntryMin. Each entry is a step,
+    /// or each record when the scalars are in the records of the chunk.
+    /// The records are added in order with the entries left in the log,
+    /// which aren't read if the log has the totals of its run.
+    /// \param[in] _chunkFile Path to the chunk.
+    private: void ToCommsMin(const std::string &_chunkFile)
+    {
+      const bool hasRecords = this->header.records();
+      swarm::LogRecords records;
+      size_t next = 0;
+      if (hasRecords)
+        records.Load(swarm::LogRecordPath(_chunkFile));
+      auto addRecords = [&](const double _until)
+      {
+        for (; next < records.Size() && records[next].time < _until; ++next)
+        {
+          CommsStep step;
+          static_cast<swarm::LogMinRecord &>(step) = records[next];
+          step.hasNeighbors = true;
+          this->AddStep(step);
+          this->summary.UpdateDuration(step.time);
+        }
+      };
+
+      swarm::msgs::LogEntryMin entry;
+      const char *record;
+      int32_t size;
+      while ((!hasRecords || !this->hasTotals) &&
+             this->parser.NextSerialized(record, size))
+      {
+        if (!entry.ParseFromArray(record, size))
+          continue;
+
+        if (hasRecords)
+        {
+          addRecords(entry.time());
+          this->summary.AddEntry(entry);
+          continue;
+        }
+
+        CommsStep step;
+        static_cast<swarm::LogMinRecord &>(step) =
+            swarm::RunSummary::Record(entry);
+        step.hasNeighbors = true;
+        this->AddStep(step);
+        this->summary.AddEntry(entry);
+      }
+      addRecords(std::numeric_limits<double>::infinity());
+    }
+
+    /// \brief Go over a log of msgs::LogEntry. The entries with the
+    /// messages sent and the visibility are the steps.
+    private: void ToComms()
+    {
+      swarm::msgs::LogEntry entry;
+      swarm::msgs::VisibilityMap visibility;
+      while (this->parser.Next(entry))
+      {
+        this->modelMapping[entry.id()] = entry.model_name();
+
+        if (entry.has_incoming_msgs() && entry.has_time() &&
+            this->parser.Visibility(entry, visibility))
+        {
+          CommsStep step;
+          step.time = entry.time();
+          step.msgs = "[";
+          for (const auto &msg : entry.incoming_msgs().message())
+          {
+            if (msg.dst_address() == "broadcast")
+              ++step.numBroadcast;
+            else if (msg.dst_address() == "multicast")
+              ++step.numMulticast;
+            else
+              ++step.numUnicast;
+
+            step.bytesSent += msg.size() + kMsgOverhead;
+            std::string dsts;
+            for (const auto &neighbor : msg.neighbor())
+            {
+              ++step.potentialRecipients;
+              if (neighbor.status() == swarm::msgs::DELIVERED)
+              {
+                ++step.msgsDelivered;
+                if (!dsts.empty())
+                  dsts += ",";
+                dsts += this->ModelName(this->modelMapping, neighbor.dst());
+              }
+            }
+
+            if (step.msgs.size() > 1)
+              step.msgs += ",";
+            step.msgs += "[" + this->ModelName(this->modelMapping,
+                msg.src_address()) + ",[" + dsts + "]]";
+          }
+          step.msgs += "]";
+
+          int numRobots = 0;
+          int numNeighbors = 0;
+          for (const auto &row : visibility.row())
+          {
+            if (row.src() == "boo")
+              continue;
+
+            ++numRobots;
+            for (const auto &neighbor : row.entry())
+            {
+              if (neighbor.status() == 1)
+                ++numNeighbors;
+            }
+          }
+
+          if (numRobots > 0)
+          {
+            step.avgNeighbors = numNeighbors / static_cast<double>(numRobots);
+            step.hasNeighbors = true;
+          }
+          this->AddStep(step);
+        }
+
+        for (const auto &report : entry.boo_report())
+          this->summary.AddBooReport(report);
+        this->summary.UpdateDuration(entry.time());
+      }
+    }
+
+    /// \brief Get the model name of a client, as JSON.
+    /// \param[in] _mapping Model name of each client seen so far.
+    /// \param[in] _id ID of the client.
+    /// \return The quoted model name, or null if unknown.
+    private: std::string ModelName(
+        const std::map<std::string, std::string> &_mapping,
+        const std::string &_id) const
+    {
+      auto it = _mapping.find(_id);
+      return it == _mapping.end() ? "null" : jsonString(it->second);
+    }
+
+    /// \brief Write the metrics of a step and add them to the summary.
+    /// \param[in] _step The step.
+    private: void AddStep(const CommsStep &_step)
+    {
+      const int msgSent =
+          _step.numUnicast + _step.numBroadcast + _step.numMulticast;
+      const swarm::StepRates rates = this->summary.AddStep(_step);
+
+      fprintf(this->csv, "%f,%d,%f,%d,%d,%d,%d,%d,%f,%d,%f,%f\n",
+          _step.time, msgSent, rates.msgFreq, _step.numUnicast,
+          _step.numBroadcast, _step.numMulticast, _step.potentialRecipients,
+          _step.msgsDelivered, rates.dropRatio, _step.bytesSent,
+          rates.dataRate, _step.avgNeighbors);
+
+      this->commsJson.Write(std::string(this->steps > 0 ? "," : "") +
+          "{\"time\":" + formatFloat(_step.time) +
+          ",\"msg_sent\":" + std::to_string(msgSent) +
+          ",\"num_unicast\":" + std::to_string(_step.numUnicast) +
+          ",\"num_broadcast\":" + std::to_string(_step.numBroadcast) +
+          ",\"num_multicast\":" + std::to_string(_step.numMulticast) +
+          ",\"msg_freq\":" + formatFloat(rates.msgFreq) +
+          ",\"potential_recipients\":" +
+          std::to_string(_step.potentialRecipients) +
+          ",\"msgs_delivered\":" + std::to_string(_step.msgsDelivered) +
+          ",\"drop_ratio\":" +
+          (_step.potentialRecipients > 0 ? formatFloat(rates.dropRatio) : "0") +
+          ",\"bytes_sent\":" + std::to_string(_step.bytesSent) +
+          ",\"data_rate\":" + formatFloat(rates.dataRate) +
+          ",\"avg_neighbors\":" +
+          (_step.hasNeighbors ? formatFloat(_step.avgNeighbors) : "0") +
+          ",\"msgs\":" + _step.msgs + "}");
+
+      ++this->steps;
+    }
+
+    /// \brief Format the average of a metric over the steps.
+    /// \param[in] _total Sum of the metric over the steps.
+    /// \param[in] _steps Number of steps.
+    /// \param[in] _scale Factor applied to the average.
+    /// \return The formatted average, or 0 without steps.
+    private: static std::string Average(const double _total,
+                                        const uint64_t _steps,
+                                        const double _scale)
+    {
+      if (_steps == 0)
+        return "0";
+      return formatFloat(_scale * _total / _steps);
+    }
+
+    /// \brief Write the summary of the run.
+    /// \param[in] _dir Directory of the log.
+    /// \param[in] _totals Totals of the run.
+    /// \return True if the summary was written.
+    private: bool ToSummary(const boost::filesystem::path &_dir,
+                            const swarm::msgs::RunSummary &_totals)
+    {
+      std::ofstream tex((_dir / "swarm_summary.tex").string().c_str());
+      std::ofstream json((_dir / "summary.json").string().c_str());
+      if (!tex || !json)
+      {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::cerr << "Unable to write the summary of [" << this->logFile
+                  << "]" << std::endl;
+        return false;
+      }
+
+      auto texCommand = [&tex](const std::string &_name,
+          const std::string &_value)
+      {
+        tex << "\\newcommand{\\swarm" << _name << "}{" << _value << "}\n";
+      };
+      auto jsonField = [&json](const std::string &_name,
+          const std::string &_value)
+      {
+        json << "\"" << _name << "\" : " << _value << ",";
+      };
+      auto count = [](const bool _has, const unsigned int _value)
+      {
+        return _has ? std::to_string(_value) : std::string("Unknown");
+      };
+
+      uint64_t timestamp = this->header.timestamp();
+      if (!this->header.has_timestamp())
+        timestamp = boost::filesystem::last_write_time(this->logFile);
+
+      const std::string unknown = "Unknown";
+      json << "{";
+      jsonField("timestamp", std::to_string(timestamp));
+
+      const std::string team =
+          this->header.has_team_name() ? this->header.team_name() : unknown;
+      texCommand("TeamName", texString(team));
+      jsonField("team", jsonString(team));
+
+      const std::string ground = count(this->header.has_num_ground_vehicles(),
+          this->header.num_ground_vehicles());
+      texCommand("NumGroundVehicles", ground);
+      jsonField("ground_vehicles", this->header.has_num_ground_vehicles() ?
+          ground : jsonString(ground));
+
+      const std::string fixed = count(this->header.has_num_fixed_vehicles(),
+          this->header.num_fixed_vehicles());
+      texCommand("NumFixedVehicles", fixed);
+      jsonField("fixed_vehicles", this->header.has_num_fixed_vehicles() ?
+          fixed : jsonString(fixed));
+
+      const std::string rotor = count(this->header.has_num_rotor_vehicles(),
+          this->header.num_rotor_vehicles());
+      texCommand("NumRotorVehicles", rotor);
+      jsonField("rotor_vehicles", this->header.has_num_rotor_vehicles() ?
+          rotor : jsonString(rotor));
+
+      // The environment is only in the JSON summary if known.
+      texCommand("TerrainName", texString(this->header.has_terrain_name() ?
+          this->header.terrain_name() : unknown));
+      if (this->header.has_terrain_name())
+        jsonField("terrain", jsonString(this->header.terrain_name()));
+
+      texCommand("VegetationName", texString(
+          this->header.has_vegetation_name() ?
+          this->header.vegetation_name() : unknown));
+      if (this->header.has_vegetation_name())
+        jsonField("vegetation", jsonString(this->header.vegetation_name()));
+
+      texCommand("SearchArea", texString(this->header.has_search_area() ?
+          this->header.search_area() : unknown));
+      if (this->header.has_search_area())
+        jsonField("search_area", jsonString(this->header.search_area()));
+
+      // As in the previous reports, the score uses the default limits, and
+      // the limits of the log are only reported.
+      double score = 0;
+      if (_totals.succeed())
+      {
+        const double a = 0.8 *
+            (1.0 - std::min(1.0, _totals.duration() / kDefaultMaxDuration));
+        const double b = 0.2 * (1.0 - std::min(1u,
+              _totals.wrong_reports() / kDefaultMaxWrongReports));
+        score = a + b;
+      }
+      texCommand("Succeed", _totals.succeed() ? "Yes" : "No");
+      jsonField("success", _totals.succeed() ? "true" : "false");
+
+      texCommand("WrongBooReports", std::to_string(_totals.wrong_reports()));
+      jsonField("incorrect_reports",
+          std::to_string(_totals.wrong_reports()));
+
+      texCommand("Duration", formatFloat(_totals.duration()));
+      jsonField("duration", formatFloat(_totals.duration()));
+
+      std::string maxDuration = "7200";
+      if (this->header.has_max_time_allowed())
+        maxDuration = formatFloat(this->header.max_time_allowed());
+      else
+      {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::cout << "Warning: <max_time_allowed> not present in log file ["
+                  << this->logFile << "]." << std::endl;
+      }
+
+      std::string maxWrongReports = std::to_string(kDefaultMaxWrongReports);
+      if (this->header.has_max_wrong_reports())
+        maxWrongReports = std::to_string(this->header.max_wrong_reports());
+      else
+      {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::cout << "Warning: <max_wrong_reports> not present in log file ["
+                  << this->logFile << "]." << std::endl;
+      }
+
+      texCommand("Score", formatFloat(score));
+      jsonField("score", formatFloat(score));
+
+      // Time spent by each subsystem, if the run had SWARM_STEP_TIMERS.
+      const swarm::msgs::StepTimings &timings = _totals.timings();
+      const int64_t timingNs[] =
+      {
+        timings.comms_model(), timings.notify_neighbors(),
+        timings.dispatch(), timings.delivery(), timings.logger(),
+        timings.poses(), timings.sensors(), timings.controllers(),
+        timings.actuation()
+      };
+      static_assert(sizeof(timingNs) / sizeof(timingNs[0]) == kNumTimings,
+          "A time for each subsystem");
+      for (size_t i = 0; timings.steps() > 0 && i < kNumTimings; ++i)
+      {
+        jsonField(std::string("timing_") + kTimingNames[i] + "_us_per_step",
+            formatFloat(timingNs[i] * 1e-3 / timings.steps()));
+      }
+
+      // Connectivity of the swarm, averaged over the time.
+      const double span = _totals.connectivity_span();
+      if (span > 0)
+      {
+        jsonField("avg_components",
+            formatFloat(_totals.total_components() / span));
+        jsonField("avg_boo_reachable",
+            formatFloat(_totals.total_boo_reachable() / span));
+        jsonField("avg_hops_to_boo", formatFloat(_totals.total_hops() / span));
+      }
+
+      // Comms summary.
+      const uint64_t numSteps = _totals.steps();
+      const std::vector<std::pair<std::string, std::string>> comms =
+      {
+        {"NumMsgsSent", std::to_string(_totals.msgs_sent())},
+        {"NumUnicastSent", std::to_string(_totals.unicast_sent())},
+        {"NumBroadcastSent", std::to_string(_totals.broadcast_sent())},
+        {"NumMulticastSent", std::to_string(_totals.multicast_sent())},
+        {"FreqMsgsSent", Average(_totals.total_msg_freq(), numSteps, 1)},
+        {"AvgMsgsDrop", Average(_totals.total_drop_ratio(), numSteps, 100)},
+        // mbps.
+        {"AvgDataRateRobot",
+          Average(_totals.total_data_rate(), numSteps, 1e-6)},
+        {"AvgNeighborsRobot",
+          Average(_totals.total_neighbors(), numSteps, 1)},
+        {"MaxDuration", maxDuration},
+        {"MaxWrongReports", maxWrongReports}
+      };
+      const char *jsonNames[] =
+      {
+        "messages_sent", "unicast_sent", "broadcast_sent", "multicast_sent",
+        "avg_pub_freq", "avg_percent_drop", "avg_data_rate_per_robot",
+        "avg_neighbors_per_robot", "max_duration", "max_wrong_reports"
+      };
+      for (size_t i = 0; i < comms.size(); ++i)
+      {
+        texCommand(comms[i].first, comms[i].second);
+        json << "\"" << jsonNames[i] << "\" : " << comms[i].second
+             << (i + 1 < comms.size() ? "," : "");
+      }
+      json << "}";
+
+      tex.close();
+      json.close();
+      return !tex.fail() && !json.fail();
+    }
+
+    /// \brief Path to the log.
+    private: std::string logFile;
+
+    /// \brief Parser of the log.
+    private: swarm::LogParser parser;
+
+    /// \brief Header of the log.
+    private: swarm::msgs::LogHeader header;
+
+    /// \brief Gazebo model name of each robot, by address, kept between
+    /// the chunks of a rotated log.
+    private: std::map<std::string, std::string> modelMapping;
+
+    /// \brief Metrics of each step, in CSV.
+    private: FILE *csv = nullptr;
+
+    /// \brief Metrics of each step, in compressed JSON.
+    private: DeflateFile commsJson;
+
+    /// \brief Number of steps written.
+    private: uint64_t steps = 0;
+
+    /// \brief Totals of the run, from the entries.
+    private: swarm::RunSummary summary;
+
+    /// \brief Whether the log has the totals of its run, written by the
+    /// logger.
+    private: bool hasTotals = false;
+
+    /// \brief Whether only the summary is written, when the log has its
+    /// totals.
+    private: bool summaryOnly = false;
+  };
+}
+
+//////////////////////////////////////////////////
+int analyzeLogs(const std::vector<std::string> &_logs,
+    const unsigned int _jobs, const bool _summaryOnly)
+{
+  std::atomic<size_t> next(0);
+  std::atomic<int> failures(0);
+  auto worker = [&]()
+  {
+    for (size_t i = next++; i < _logs.size(); i = next++)
+    {
+      {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::cout << "Analyzing [" << _logs[i] << "]" << std::endl;
+      }
+
+      LogReport report(_logs[i], _summaryOnly);
+      if (!report.Run())
+      {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::cerr << "Error analyzing [" << _logs[i] << "]" << std::endl;
+        ++failures;
+      }
+    }
+  };
+
+  const size_t jobs = std::max(1u,
+      std::min(_jobs, static_cast<unsigned int>(_logs.size())));
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < jobs; ++i)
+    threads.emplace_back(worker);
+  worker();
+
+  for (auto &thread : threads)
+    thread.join();
+
+  return failures;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file swarmlog_report.hh
+/// \brief Communication metrics and run summaries of Swarm log files.
+
+#ifndef __SWARM_SWARMLOG_REPORT_HH__
+#define __SWARM_SWARMLOG_REPORT_HH__
+
+#include <string>
+#include <vector>
+
+/// \brief Compute the communication metrics of each simulation step and
+/// the summary of the run of each log. The files are written next to each
+/// log: swarm.csv and swarm_comms.json.zip (per step), swarm_summary.tex and
+/// summary.json (summary). The logs are read in parallel, and each log is
+/// streamed, so the memory used doesn't depend on the length of the runs.
+///
+/// The summary is computed from the totals that the logger writes next to
+/// a minimal log when the run ends (see swarm::RunSummary), if they belong
+/// to the log, so only the header of the log is read for it, and the steps
+/// of a log with records are only read from its records. Without the
+/// totals, e.g. when the simulation was killed, the whole log is read, and
+/// all the files are written even if only the summary was asked for.
+/// \param[in] _logs Paths to the log files.
+/// \param[in] _jobs Number of logs read at the same time.
+/// \param[in] _summaryOnly Whether only the summary is written.
+/// \return Number of logs that couldn't be analyzed.
+int analyzeLogs(const std::vector<std::string> &_logs,
+    const unsigned int _jobs, const bool _summaryOnly);
+
+#endif
@@ -0,0 +1,450 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "swarm/LogFormat.hh"
+#include "swarm/LogParser.hh"
+#include "msgs/log_entry.pb.h"
+#include "msgs/log_header.pb.h"
+#include "swarmlog_slice.hh"
+
+using swarm::msgs::LogEntry;
+
+namespace
+{
+  /// \brief Raw size of the blocks of the slice (bytes), like the chunks
+  /// of the logger.
+  const size_t kSliceBlockSize = 1 << 20;
+
+  /// \brief A top-level field of a serialized entry.
+  struct FieldSpan
+  {
+    /// \brief Number of the field.
+    uint64_t number;
+
+    /// \brief First byte of the field, its tag.
+    const char *begin;
+
+    /// \brief End of the field.
+    const char *end;
+  };
+
+  //////////////////////////////////////////////////
+  /// \brief Read a varint of a serialized message.
+  /// \param[in,out] _p Position in the message, moved after the varint.
+  /// \param[in] _end End of the message.
+  /// \param[out] _value The value.
+  /// \return True if the varint was read.
+  bool readVarint(const char *&_p, const char *_end, uint64_t &_value)
+  {
+    _value = 0;
+    for (int shift = 0; shift < 64 && _p < _end; shift += 7)
+    {
+      const uint8_t byte = *_p++;
+      _value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return true;
+    }
+    return false;
+  }
+
+  //////////////////////////////////////////////////
+  /// \brief Append a varint to a serialized message.
+  /// \param[in] _value The value.
+  /// \param[in,out] _out The message.
+  void appendVarint(uint64_t _value, std::string &_out)
+  {
+    while (_value >= 0x80)
+    {
+      _out.push_back(static_cast<char>((_value & 0x7f) | 0x80));
+      _value >>= 7;
+    }
+    _out.push_back(static_cast<char>(_value));
+  }
+
+  //////////////////////////////////////////////////
+  /// \brief Split a serialized entry into its top-level fields.
+  /// \param[in] _record The serialized entry.
+  /// \param[in] _size Size of the serialized entry.
+  /// \param[out] _fields The fields.
+  /// \param[out] _time Simulation time of the entry.
+  /// \return True if the entry was split, or false if it is malformed.
+  bool splitFields(const char *_record, const int32_t _size,
+      std::vector<FieldSpan> &_fields, double &_time)
+  {
+    _fields.clear();
+    _time = 0;
+    const char *p = _record;
+    const char *end = _record + _size;
+    while (p < end)
+    {
+      FieldSpan span;
+      span.begin = p;
+      uint64_t tag, length;
+      if (!readVarint(p, end, tag))
+        return false;
+      span.number = tag >> 3;
+      switch (tag & 7)
+      {
+        case 0:
+          if (!readVarint(p, end, length))
+            return false;
+          break;
+        case 1:
+          if (end - p < 8)
+            return false;
+          if (span.number == LogEntry::kTimeFieldNumber)
+            std::memcpy(&_time, p, sizeof(_time));
+          p += 8;
+          break;
+        case 2:
+          if (!readVarint(p, end, length) ||
+              length > static_cast<uint64_t>(end - p))
+          {
+            return false;
+          }
+          p += length;
+          break;
+        case 5:
+          if (end - p < 4)
+            return false;
+          p += 4;
+          break;
+        default:
+          return false;
+      }
+      span.end = p;
+      _fields.push_back(span);
+    }
+    return true;
+  }
+
+  //////////////////////////////////////////////////
+  /// \brief Select the fields of a type of a slice.
+  /// \param[in] _type The type.
+  /// \param[in,out] _selected Whether each field is kept, by number.
+  /// \return False if the type is unknown.
+  bool selectType(const std::string &_type, std::vector<bool> &_selected)
+  {
+    std::vector<int> fields;
+    if (_type == "sensors")
+      fields = {LogEntry::kSensorsFieldNumber};
+    else if (_type == "actions")
+      fields = {LogEntry::kActionsFieldNumber};
+    else if (_type == "incoming")
+      fields = {LogEntry::kIncomingMsgsFieldNumber};
+    else if (_type == "visibility")
+    {
+      fields = {LogEntry::kVisibilityFieldNumber,
+        LogEntry::kVisibilityDeltaFieldNumber,
+        LogEntry::kCommsFidelityFieldNumber};
+    }
+    else if (_type == "boo")
+      fields = {LogEntry::kBooReportFieldNumber};
+    else if (_type == "replay")
+    {
+      fields = {LogEntry::kStepTimeFieldNumber,
+        LogEntry::kDeliveredFieldNumber, LogEntry::kSentFieldNumber,
+        LogEntry::kNeighborFieldNumber};
+    }
+    else if (_type == "timing")
+      fields = {LogEntry::kControllerTimingFieldNumber};
+    else
+      return false;
+
+    for (const int field : fields)
+    {
+      if (_selected.size() <= static_cast<size_t>(field))
+        _selected.resize(field + 1, false);
+      _selected[field] = true;
+    }
+    return true;
+  }
+
+  //////////////////////////////////////////////////
+  /// \brief Writes the entries of a slice in the block format.
+  class SliceWriter
+  {
+    /// \brief Create the log and write its header.
+    /// \param[in] _path Path of the log.
+    /// \param[in] _header The header.
+    /// \return True if the log was created.
+    public: bool Open(const std::string &_path,
+                      const swarm::msgs::LogHeader &_header)
+    {
+      this->output.open(_path,
+          std::ios::out | std::ios::trunc | std::ios::binary);
+      if (!this->output.is_open())
+      {
+        std::cerr << "Failed to create log file [" << _path << "]"
+                  << std::endl;
+        return false;
+      }
+
+      this->output.write(swarm::kLogBlockMagic, swarm::kLogMagicSize);
+      const int32_t size = _header.ByteSize();
+      this->output.write(reinterpret_cast<const char*>(&size), sizeof(size));
+      return _header.SerializeToOstream(&this->output);
+    }
+
+    /// \brief Append an entry. The entries of a simulation time are kept in
+    /// the same block, and a new block only starts at a later time, so the
+    /// times of the index never go back.
+    /// \param[in] _entry The serialized entry.
+    /// \param[in] _size Size of the serialized entry.
+    /// \param[in] _time Simulation time of the entry.
+    public: void Append(const char *_entry, const int32_t _size,
+                        const double _time)
+    {
+      if (this->info.entries > 0 && _time > this->lastTime &&
+          this->raw.size() >= kSliceBlockSize)
+      {
+        this->Flush();
+      }
+
+      if (this->info.entries == 0)
+        this->info.time = _time;
+      this->raw.append(reinterpret_cast<const char*>(&_size), sizeof(_size));
+      this->raw.append(_entry, _size);
+      ++this->info.entries;
+      this->lastTime = _time;
+    }
+
+    /// \brief Write the last block and the index.
+    /// \return True if the log was written.
+    public: bool Close()
+    {
+      this->Flush();
+
+      const uint64_t indexOffset = static_cast<uint64_t>(this->output.tellp());
+      const uint32_t count = this->blocks.size();
+      this->output.write(reinterpret_cast<const char*>(&count), sizeof(count));
+      for (const auto &block : this->blocks)
+      {
+        this->output.write(reinterpret_cast<const char*>(&block.offset),
+            sizeof(block.offset));
+        this->output.write(reinterpret_cast<const char*>(&block.time),
+            sizeof(block.time));
+        this->output.write(reinterpret_cast<const char*>(&block.entries),
+            sizeof(block.entries));
+      }
+      this->output.write(reinterpret_cast<const char*>(&indexOffset),
+          sizeof(indexOffset));
+      this->output.write(swarm::kLogIndexMagic, swarm::kLogMagicSize);
+      this->output.close();
+      return this->ok && !this->output.fail();
+    }
+
+    /// \brief Number of entries written.
+    /// \return The number of entries.
+    public: uint64_t Entries() const
+    {
+      return this->entries;
+    }
+
+    /// \brief Compress and write the current block.
+    private: void Flush()
+    {
+      if (this->info.entries == 0)
+        return;
+
+      if (!swarm::CompressLogBlock(this->raw, this->compressed))
+      {
+        std::cerr << "Failed to compress log block." << std::endl;
+        this->ok = false;
+      }
+      else
+      {
+        this->info.offset = static_cast<uint64_t>(this->output.tellp());
+        const uint32_t compressedSize = this->compressed.size();
+        const uint32_t rawSize = this->raw.size();
+        this->output.write(reinterpret_cast<const char*>(&compressedSize),
+            sizeof(compressedSize));
+        this->output.write(reinterpret_cast<const char*>(&rawSize),
+            sizeof(rawSize));
+        this->output.write(reinterpret_cast<const char*>(&this->info.time),
+            sizeof(this->info.time));
+        this->output.write(reinterpret_cast<const char*>(&this->info.entries),
+            sizeof(this->info.entries));
+        this->output.write(this->compressed.data(), compressedSize);
+        this->blocks.push_back(this->info);
+        this->entries += this->info.entries;
+      }
+
+      this->raw.clear();
+      this->info = swarm::LogBlockInfo();
+    }
+
+    /// \brief The log.
+    private: std::ofstream output;
+
+    /// \brief Entries of the current block, in the flat format.
+    private: std::string raw;
+
+    /// \brief The current block, compressed.
+    private: std::string compressed;
+
+    /// \brief Time and number of entries of the current block.
+    private: swarm::LogBlockInfo info;
+
+    /// \brief Simulation time of the last entry appended.
+    private: double lastTime = 0;
+
+    /// \brief The blocks written.
+    private: std::vector<swarm::LogBlockInfo> blocks;
+
+    /// \brief Number of entries in the blocks written.
+    private: uint64_t entries = 0;
+
+    /// \brief False if a block couldn't be compressed.
+    private: bool ok = true;
+  };
+}
+
+//////////////////////////////////////////////////
+bool sliceLog(swarm::LogParser &_parser, const swarm::LogFilter &_filter,
+    const std::vector<std::string> &_types, const std::string &_output)
+{
+  swarm::msgs::LogHeader header;
+  if (!_parser.Header(header))
+    return false;
+
+  // The entries of a minimal log are msgs::LogEntryMin.
+  if (_parser.Minimal())
+  {
+    std::cerr << "Minimal logs can't be sliced" << std::endl;
+    return false;
+  }
+
+  // The ID, the time and the model name identify the entries.
+  std::vector<bool> selected(LogEntry::kModelNameFieldNumber + 1, false);
+  selected[LogEntry::kIdFieldNumber] = true;
+  selected[LogEntry::kTimeFieldNumber] = true;
+  selected[LogEntry::kModelNameFieldNumber] = true;
+  for (auto const &type : _types)
+  {
+    if (!selectType(type, selected))
+    {
+      std::cerr << "Unknown type [" << type << "]" << std::endl;
+      return false;
+    }
+  }
+
+  SliceWriter writer;
+  if (!writer.Open(_output, header))
+    return false;
+
+  // The changes of the visibility need the previous ones, so the first
+  // changes of the slice, and the ones after a dropped change, are
+  // replaced by the visibility they lead to.
+  bool needKeyframe = true;
+  swarm::msgs::VisibilityDelta keyframe;
+  std::string keyframeBytes;
+
+  std::vector<FieldSpan> fields;
+  std::string entry;
+  uint64_t malformed = 0;
+  const char *record;
+  int32_t size;
+  bool skippedDelta;
+  while (_parser.NextSerialized(record, size, _filter, skippedDelta))
+  {
+    needKeyframe = needKeyframe || skippedDelta;
+
+    double time;
+    if (!splitFields(record, size, fields, time))
+    {
+      ++malformed;
+      continue;
+    }
+
+    bool hasDelta = false;
+    for (auto const &field : fields)
+    {
+      hasDelta = hasDelta ||
+        field.number == LogEntry::kVisibilityDeltaFieldNumber;
+    }
+    const bool deltaSelected = _types.empty() ||
+      (selected.size() > LogEntry::kVisibilityDeltaFieldNumber &&
+       selected[LogEntry::kVisibilityDeltaFieldNumber]);
+    const bool replace = hasDelta && deltaSelected && needKeyframe &&
+      _parser.VisibilityKeyframe(keyframe);
+    if (replace)
+    {
+      keyframe.SerializeToString(&keyframeBytes);
+      needKeyframe = false;
+    }
+
+    // The entries of all the types are copied as is.
+    if (_types.empty() && !replace)
+    {
+      writer.Append(record, size, time);
+      continue;
+    }
+
+    entry.clear();
+    bool typed = false;
+    for (auto const &field : fields)
+    {
+      if (!_types.empty() &&
+          (field.number >= selected.size() || !selected[field.number]))
+      {
+        continue;
+      }
+
+      typed = typed || (field.number != LogEntry::kIdFieldNumber &&
+          field.number != LogEntry::kTimeFieldNumber &&
+          field.number != LogEntry::kModelNameFieldNumber);
+      if (replace && field.number == LogEntry::kVisibilityDeltaFieldNumber)
+      {
+        appendVarint((field.number << 3) | 2, entry);
+        appendVarint(keyframeBytes.size(), entry);
+        entry.append(keyframeBytes);
+      }
+      else
+        entry.append(field.begin, field.end - field.begin);
+    }
+
+    // Drop the entries without any field of the types.
+    if (!_types.empty() && !typed)
+    {
+      needKeyframe = needKeyframe || hasDelta;
+      continue;
+    }
+
+    writer.Append(entry.data(), entry.size(), time);
+  }
+
+  if (malformed > 0)
+  {
+    std::cerr << "Skipped " << malformed << " malformed entries"
+              << std::endl;
+  }
+
+  const bool written = writer.Close();
+  if (written)
+  {
+    std::cout << "Wrote " << writer.Entries() << " entries into ["
+              << _output << "]" << std::endl;
+  }
+  return written;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+/// \file swarmlog_slice.hh
+/// \brief Trimmed copies of Swarm log files.
+
+#ifndef __SWARM_SWARMLOG_SLICE_HH__
+#define __SWARM_SWARMLOG_SLICE_HH__
+
+#include <string>
+#include <vector>
+#include "swarm/LogParser.hh"
+
+/// \brief Copy the entries of a log matching a filter, from the current
+/// position of the parser, into a new log in the block format with the
+/// original header. The entries are copied without being parsed, only
+/// keeping the ID, the time, the model name and the fields of the types:
+///   sensors: the sensors of the robots.
+///   actions: the velocities sent to the robots.
+///   incoming: the messages received by the robots.
+///   visibility: the visibility and the fidelity of the comms model.
+///   boo: the reports of the lost person.
+///   replay: the steps, datagrams and neighbors of the replayed robots.
+///   timing: the wall time of the controllers.
+/// The entries left without any of these fields are dropped. When the
+/// visibility is logged as changes, the first changes of the slice, and the
+/// ones following a dropped change, are replaced by a keyframe.
+/// \param[in] _parser The log.
+/// \param[in] _filter The IDs and the time window of the entries.
+/// \param[in] _types The types of the fields kept, or all of them if empty.
+/// \param[in] _output Path of the new log.
+/// \return True if the log was written.
+bool sliceLog(swarm::LogParser &_parser, const swarm::LogFilter &_filter,
+    const std::vector<std::string> &_types, const std::string &_output);
+
+#endif
@@ -2,6 +2,7 @@
 
 import struct, sys, functools
 from swarm import log_entry_pb2, log_header_pb2
+from swarmlog_reader import LogReader
 
 # Global variables.
 total_msgs_sent = 0
@@ -21,49 +22,6 @@ succeed = False
 duration = 0.0
 time_step = 0.01
 
-# A simple class to read log files
-class LogReader:
-    def __init__(self, logfile):
-        self.logfile = logfile
-        self.stream = open(fname, 'rb')
-        self.header = None
-
-    # Get the next message
-    def next(self):
-        global time_step
-
-        # Read the 4-byte size field
-        sizestring = self.stream.read(4)
-        if len(sizestring) < 4:
-            self.stream.close()
-            return None
-        size = struct.unpack('<I', sizestring)[0]
-        msg = self.stream.read(size)
-        # Make a protobuf message out of it
-        # The first message in the log is a LogHeader; the rest are LogEntry
-        if not self.header:
-            pbmsg = log_header_pb2.LogHeader()
-            pbmsg.ParseFromString(msg)
-            self.header = pbmsg
-            if self.header.HasField("time_step"):
-                time_step = self.header.time_step
-        else:
-            pbmsg = log_entry_pb2.LogEntry()
-            pbmsg.ParseFromString(msg)
-        return pbmsg
-
-    # Apply a given function to each message in the file
-    def apply(self, func):
-        first = True
-        while True:
-            msg = self.next()
-            if not msg:
-                break
-            # Only pass through LogEntry messages (e.g., skip LogHeader
-            # messages)
-            if type(msg) == log_entry_pb2.LogEntry:
-                func(msg)
-
 # An example of processing a single log entry
 def process_msg(entry):
     global total_msgs_sent
@@ -285,6 +243,8 @@ if __name__ == '__main__':
         sys.exit(1)
     fname = sys.argv[1]
     reader = LogReader(fname)
+    if reader.header.HasField("time_step"):
+        time_step = reader.header.time_step
     print('# time, msg_sent, msg_freq, num_unicast, num_broadcast, num_multicast, potential_recipients, msgs_delivered, drop_ratio, bytes_sent, data_rate, avg_num_neighbors')
     reader.apply(process_msg)
     create_swarm_summary_report(reader, sys.argv[2])
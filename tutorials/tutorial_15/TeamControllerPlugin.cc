@@ -33,6 +33,7 @@ GZ_REGISTER_MODEL_PLUGIN(TeamControllerPlugin)
 //////////////////////////////////////////////////
 void TeamControllerPlugin::Load(sdf::ElementPtr _sdf)
 {
+  // Pass "myupdateall" as a fifth argument to update all the robots at once.
   this->LoadPython("mycontroller", "myload", "myupdate", "myondatareceived");
 }
 
@@ -1,3 +1,4 @@
+import struct
 import swarm
 
 def myload(me):
@@ -48,6 +49,20 @@ def myupdate(me, world_name, sim_time, real_time):
     swarm.launch(me)
     swarm.dock(me, me)
 
+def myupdateall(names, observations, actions, world_name, sim_time, real_time):
+    # Batched alternative to myupdate(), called once per step for all the
+    # robots when passed as the last argument of LoadPython(). With NumPy,
+    # numpy.frombuffer(observations).reshape(-1, swarm.OBS_SIZE) is a view of
+    # the observations without copies, and the same works for the actions.
+    for i, me in enumerate(names):
+        battery = struct.unpack_from(
+            'd', observations, 8 * (i * swarm.OBS_SIZE + swarm.OBS_BATTERY))
+        swarm.gzmsg('[%s] battery: %f'%(me, battery[0]))
+        struct.pack_into('ddd', actions, 8 * (i * swarm.ACT_SIZE), 0.5, 0, 0)
+        struct.pack_into('ddd', actions,
+                         8 * (i * swarm.ACT_SIZE + swarm.ACT_ANG_VEL),
+                         0, 0, 0.25)
+
 def myondatareceived(me, src_address, dst_address, dst_port, data):
     swarm.gzmsg('[%s] ondatareceived(): %s %s %d %s'
           %(me, src_address, dst_address, dst_port, data))
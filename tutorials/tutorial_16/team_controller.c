@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2016 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <swarm/ControllerAbi.h>
+
+/// \brief The state of the controller of a robot.
+struct Controller
+{
+  /// \brief Functions to act on the robot.
+  const SwarmRobotApi *api;
+
+  /// \brief The robot.
+  SwarmRobot *robot;
+
+  /// \brief Messages received.
+  unsigned int received;
+};
+
+//////////////////////////////////////////////////
+static void *create(const SwarmRobotApi *_api, SwarmRobot *_robot)
+{
+  struct Controller *controller = calloc(1, sizeof(struct Controller));
+  controller->api = _api;
+  controller->robot = _robot;
+
+  // Listen on the local address and the default port.
+  _api->bind(_robot, _api->host(_robot), 4100);
+  return controller;
+}
+
+//////////////////////////////////////////////////
+static void update(void *_controller, double _simTime)
+{
+  struct Controller *controller = _controller;
+  const SwarmRobotApi *api = controller->api;
+
+  // Move forward and say hello to the neighbors once per second.
+  api->set_linear_velocity(controller->robot, 1, 0, 0);
+  if ((long)(_simTime * 10) % 10 == 0)
+  {
+    char msg[64];
+    const int size = snprintf(msg, sizeof(msg), "hello from %s",
+        api->host(controller->robot));
+    api->send_to(controller->robot, msg, size, "broadcast", 4100);
+  }
+}
+
+//////////////////////////////////////////////////
+static void on_message(void *_controller, const char *_srcAddress,
+    const char *_dstAddress, uint32_t _dstPort, const void *_data,
+    size_t _size)
+{
+  struct Controller *controller = _controller;
+  ++controller->received;
+}
+
+//////////////////////////////////////////////////
+static void destroy(void *_controller)
+{
+  free(_controller);
+}
+
+//////////////////////////////////////////////////
+SWARM_CONTROLLER_EXPORT const SwarmController *swarm_controller(void)
+{
+  static const SwarmController controller =
+  {
+    SWARM_CONTROLLER_ABI_VERSION, &create, &update, &on_message, &destroy
+  };
+  return &controller;
+}